@@ -36,6 +36,16 @@ extern pid_t arch_fork(run_t* run);
 
 extern void arch_reapChild(run_t* run);
 
+/*
+ * --async_runs (Linux): arch_reapChild() which doesn't wait, returns true when the run is over.
+ * arch_asyncWait() returns the runs of the thread which have events, arch_asyncDrain() discards
+ * the events of a run which doesn't wait for its process currently
+ */
+extern bool arch_reapPoll(run_t* run);
+extern bool arch_asyncInit(run_t* runs, size_t cnt);
+extern size_t arch_asyncWait(run_t* ready[], size_t readyMax, int timeoutMillis);
+extern void arch_asyncDrain(run_t* run);
+
 extern void arch_prepareParent(run_t* run);
 
 extern void arch_prepareParentAfterFork(run_t* run);
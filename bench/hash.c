@@ -0,0 +1,150 @@
+/*
+ *
+ * honggfuzz - CRC64 and hashing microbenchmark
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+/*
+ * Checks that util_CRC64() and util_CRC64Rev() (which are used in the names of the coverage
+ * files, so they must never change) return the same values as the byte-at-a-time reference for
+ * all sizes up to 4KiB and all alignments, and measures their speed, and the one of util_hash64()
+ * and util_hash(), for a few input sizes
+ *
+ *   bench/hash [-n iterations] [size...]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
+
+#include "honggfuzz.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+static uint64_t refTable[256];
+
+static void refInit(void) {
+    for (size_t i = 0; i < 256; i++) {
+        uint64_t c = i;
+        for (size_t j = 0; j < 8; j++) {
+            c = (c >> 1) ^ ((c & 1) ? 0xD800000000000000ULL : 0ULL);
+        }
+        refTable[i] = c;
+    }
+}
+
+static uint64_t refCRC64(const uint8_t* buf, size_t len, bool rev) {
+    uint64_t res = 0;
+    for (size_t i = 0; i < len; i++) {
+        res = refTable[(uint8_t)res ^ buf[rev ? (len - i - 1) : i]] ^ (res >> 8);
+    }
+    return res;
+}
+
+static bool benchVerify(const uint8_t* buf) {
+    for (size_t len = 0; len <= 4096; len++) {
+        for (size_t align = 0; align < 16; align++) {
+            if (util_CRC64(&buf[align], len) != refCRC64(&buf[align], len, false) ||
+                util_CRC64Rev(&buf[align], len) != refCRC64(&buf[align], len, true)) {
+                LOG_E("CRC64 mismatch for size: %zu, alignment: %zu", len, align);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static volatile uint64_t benchSink;
+
+static void benchReport(const char* name, size_t sz, size_t iters, uint64_t usecs) {
+    double nsPerByte = ((double)usecs * 1000.0) / ((double)sz * (double)iters);
+    double mbPerSec = usecs ? ((double)sz * (double)iters) / (double)usecs : 0.0;
+    printf("%-12s size: %zu, %.3f ns/byte, %.1f MB/s\n", name, sz, nsPerByte, mbPerSec);
+}
+
+#define BENCH_RUN(name, expr)                                                                      \
+    do {                                                                                           \
+        uint64_t t0 = util_timeNowUSecs();                                                         \
+        for (size_t i = 0; i < iters; i++) {                                                       \
+            benchSink ^= (expr);                                                                   \
+        }                                                                                          \
+        benchReport(name, sz, iters, util_timeNowUSecs() - t0);                                    \
+    } while (0)
+
+static void benchSize(const uint8_t* buf, size_t sz, size_t iters) {
+    BENCH_RUN("reference", refCRC64(buf, sz, false));
+    BENCH_RUN("CRC64", util_CRC64(buf, sz));
+    BENCH_RUN("CRC64Rev", util_CRC64Rev(buf, sz));
+    BENCH_RUN("hash64", util_hash64(buf, sz));
+    BENCH_RUN("hash", util_hash((const char*)buf, sz));
+}
+
+int main(int argc, char** argv) {
+    size_t iters = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+            case 'n':
+                iters = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [size...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    size_t sizes[64] = {64, 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    size_t sizesCnt = 5;
+    if (optind < argc) {
+        sizesCnt = 0;
+        for (int i = optind; i < argc && sizesCnt < ARRAYSIZE(sizes); i++) {
+            sizes[sizesCnt++] = strtoul(argv[i], NULL, 0);
+        }
+    }
+    size_t maxSz = 4096 + 16;
+    for (size_t i = 0; i < sizesCnt; i++) {
+        maxSz = MAX(maxSz, sizes[i]);
+    }
+
+    uint8_t* buf = util_Malloc(maxSz);
+    defer {
+        free(buf);
+    };
+    util_rndBuf(buf, maxSz);
+
+    refInit();
+    if (!benchVerify(buf)) {
+        return EXIT_FAILURE;
+    }
+    printf("CRC64: matches the reference for all sizes up to 4096, and all alignments\n");
+
+    for (size_t i = 0; i < sizesCnt; i++) {
+        if (sizes[i] == 0) {
+            continue;
+        }
+        /* About 256MiB per measurement by default */
+        benchSize(buf, sizes[i], iters ? iters : MAX((256 * 1024 * 1024) / sizes[i], 1U));
+    }
+
+    return EXIT_SUCCESS;
+}
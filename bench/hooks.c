@@ -0,0 +1,307 @@
+/*
+ *
+ * honggfuzz - instrumentation hooks microbenchmark
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+/*
+ * Measures the cost (ns per call) of the libhfuzz instrumentation hooks (libhfuzz/instrument.c)
+ * and of the libc wrappers (libhfuzz/memorycmp.c), with 1..N processes sharing one feedback_t,
+ * the way processes started by the fuzzing threads do
+ *
+ *   bench/hooks [-n iterations] [-p max_processes]
+ *
+ * Every measurement starts (re-executes) worker processes with the feedback_t file as
+ * _HF_BITMAP_FD, so they map it in the libhfuzz constructor
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "honggfuzz.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+/* Workers wait for EOF on this fd before starting, and send results over the other one */
+#define BENCH_START_FD 1019
+#define BENCH_RESULT_FD 1020
+#define BENCH_GUARDS_CNT 4096U
+
+extern void __sanitizer_cov_trace_pc_guard_init(uint32_t* start, uint32_t* stop);
+extern void __sanitizer_cov_trace_pc_guard(uint32_t* guard);
+extern void __sanitizer_cov_trace_cmp1(uint8_t Arg1, uint8_t Arg2);
+extern void __sanitizer_cov_trace_cmp2(uint16_t Arg1, uint16_t Arg2);
+extern void __sanitizer_cov_trace_cmp4(uint32_t Arg1, uint32_t Arg2);
+extern void __sanitizer_cov_trace_cmp8(uint64_t Arg1, uint64_t Arg2);
+extern void __sanitizer_cov_trace_switch(uint64_t Val, uint64_t* Cases);
+extern void __sanitizer_cov_trace_gep(uintptr_t Idx);
+extern int __wrap_memcmp(const void* m1, const void* m2, size_t n);
+extern int __wrap_strcmp(const char* s1, const char* s2);
+
+static uint32_t guards[BENCH_GUARDS_CNT];
+static volatile int sink;
+
+/* Guards which were already hit: the common case */
+static void benchPcGuardSeen(size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+        __sanitizer_cov_trace_pc_guard(&guards[i % BENCH_GUARDS_CNT]);
+    }
+}
+
+/* Re-armed guards, every call updates the shared guard map */
+static void benchPcGuardArmed(size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+        guards[i % BENCH_GUARDS_CNT] = (i % BENCH_GUARDS_CNT) + 1;
+        __sanitizer_cov_trace_pc_guard(&guards[i % BENCH_GUARDS_CNT]);
+    }
+}
+
+static void benchCmp1(size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+        __sanitizer_cov_trace_cmp1((uint8_t)i, 0x41);
+    }
+}
+
+static void benchCmp2(size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+        __sanitizer_cov_trace_cmp2((uint16_t)i, 0x4142);
+    }
+}
+
+static void benchCmp4(size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+        __sanitizer_cov_trace_cmp4((uint32_t)i, 0x41424344U);
+    }
+}
+
+static void benchCmp8(size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+        __sanitizer_cov_trace_cmp8((uint64_t)i, 0x4142434445464748ULL);
+    }
+}
+
+static void benchSwitch(size_t iters) {
+    uint64_t cases[2 + 16] = {16, 64};
+    for (size_t i = 0; i < 16; i++) {
+        cases[2 + i] = 0x1000 + i * 0x101;
+    }
+    for (size_t i = 0; i < iters; i++) {
+        __sanitizer_cov_trace_switch((uint64_t)i, cases);
+    }
+}
+
+static void benchGep(size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+        __sanitizer_cov_trace_gep((uintptr_t)i);
+    }
+}
+
+/* Buffers which differ in the last byte only, the worst case for the wrappers */
+static void benchMemcmp(size_t iters) {
+    uint8_t m1[64];
+    uint8_t m2[64];
+    memset(m1, 'A', sizeof(m1));
+    memset(m2, 'A', sizeof(m2));
+    m2[sizeof(m2) - 1] = 'B';
+    for (size_t i = 0; i < iters; i++) {
+        sink += __wrap_memcmp(m1, m2, sizeof(m1));
+    }
+}
+
+static void benchStrcmp(size_t iters) {
+    char s1[64];
+    char s2[64];
+    memset(s1, 'A', sizeof(s1) - 1);
+    memset(s2, 'A', sizeof(s2) - 1);
+    s1[sizeof(s1) - 1] = s2[sizeof(s2) - 1] = '\0';
+    s2[sizeof(s2) - 2] = 'B';
+    for (size_t i = 0; i < iters; i++) {
+        sink += __wrap_strcmp(s1, s2);
+    }
+}
+
+static const struct {
+    const char* name;
+    void (*func)(size_t iters);
+} benchHooks[] = {
+    {"trace_pc_guard (seen)", benchPcGuardSeen},
+    {"trace_pc_guard (armed)", benchPcGuardArmed},
+    {"trace_cmp1", benchCmp1},
+    {"trace_cmp2", benchCmp2},
+    {"trace_cmp4", benchCmp4},
+    {"trace_cmp8", benchCmp8},
+    {"trace_switch (16 cases)", benchSwitch},
+    {"trace_gep", benchGep},
+    {"memcmp (64 bytes)", benchMemcmp},
+    {"strcmp (64 bytes)", benchStrcmp},
+};
+
+typedef struct {
+    size_t hook;
+    double nsPerCall;
+} benchResult_t;
+
+static void benchWorker(size_t hook, size_t iters) {
+    __sanitizer_cov_trace_pc_guard_init(guards, &guards[BENCH_GUARDS_CNT]);
+    /* Warm-up: marks all the guards as seen, and maps the pages */
+    benchPcGuardArmed(BENCH_GUARDS_CNT);
+    benchHooks[hook].func(iters / 16);
+
+    uint8_t b;
+    if (files_readFromFd(BENCH_START_FD, &b, sizeof(b)) != 0) {
+        LOG_F("Unexpected data on the start fd");
+    }
+
+    uint64_t t0 = util_timeNowUSecs();
+    benchHooks[hook].func(iters);
+    uint64_t usecs = util_timeNowUSecs() - t0;
+
+    benchResult_t res = {
+        .hook = hook,
+        .nsPerCall = ((double)usecs * 1000.0) / (double)iters,
+    };
+    if (!files_writeToFd(BENCH_RESULT_FD, (uint8_t*)&res, sizeof(res))) {
+        LOG_F("Couldn't send the result");
+    }
+}
+
+/* Runs 'procs' workers at once, and returns the mean ns/call */
+static double benchRun(char* self, int feedbackFd, size_t hook, size_t iters, size_t procs) {
+    int startPipe[2];
+    int resPipe[2];
+    if (pipe(startPipe) == -1 || pipe(resPipe) == -1) {
+        PLOG_F("pipe()");
+    }
+
+    for (size_t p = 0; p < procs; p++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            PLOG_F("fork()");
+        }
+        if (pid == 0) {
+            char thrNo[32];
+            char hookNo[32];
+            char itersStr[32];
+            snprintf(thrNo, sizeof(thrNo), "%zu", p);
+            snprintf(hookNo, sizeof(hookNo), "%zu", hook);
+            snprintf(itersStr, sizeof(itersStr), "%zu", iters);
+            setenv(_HF_THREAD_NO_ENV, thrNo, 1);
+            if (dup2(feedbackFd, _HF_BITMAP_FD) == -1 || dup2(startPipe[0], BENCH_START_FD) == -1 ||
+                dup2(resPipe[1], BENCH_RESULT_FD) == -1) {
+                PLOG_F("dup2()");
+            }
+            close(startPipe[1]);
+            char* const args[] = {self, "-w", hookNo, itersStr, NULL};
+            execv("/proc/self/exe", args);
+            execv(self, args);
+            PLOG_F("execv('%s')", self);
+        }
+    }
+    close(startPipe[0]);
+    close(resPipe[1]);
+    /* Start all the workers at once */
+    close(startPipe[1]);
+
+    double sum = 0.0;
+    for (size_t p = 0; p < procs; p++) {
+        benchResult_t res;
+        if (files_readFromFd(resPipe[0], (uint8_t*)&res, sizeof(res)) != sizeof(res)) {
+            LOG_F("Worker didn't report its result");
+        }
+        sum += res.nsPerCall;
+    }
+    close(resPipe[0]);
+    while (wait(NULL) > 0 || errno == EINTR) {
+    }
+
+    return sum / (double)procs;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "-w") == 0) {
+        benchWorker(strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+        return EXIT_SUCCESS;
+    }
+
+    size_t iters = 10000000;
+    size_t maxProcs = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    int c;
+    while ((c = getopt(argc, argv, "n:p:")) != -1) {
+        switch (c) {
+            case 'n':
+                iters = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                maxProcs = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-p max_processes]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (iters == 0 || maxProcs == 0 || maxProcs > _HF_THREAD_MAX) {
+        fprintf(stderr, "Usage: %s [-n iterations] [-p max_processes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int feedbackFd;
+    feedback_t* fb = files_mapSharedMem(
+        sizeof(feedback_t), &feedbackFd, "hfuzz-bench", true, FILES_HUGE_NONE);
+    if (!fb) {
+        LOG_F("files_mapSharedMem(sz=%zu) failed", sizeof(feedback_t));
+    }
+    fb->hdr = (feedback_hdr_t){
+        .magic = _HF_FEEDBACK_MAGIC,
+        .hdrSz = sizeof(feedback_hdr_t),
+        .pcGuardMapSz = sizeof(fb->pcGuardMap),
+        .pcCntMapSz = sizeof(fb->pcCntMap),
+        .bbMapPcSz = sizeof(fb->bbMapPc),
+        .cmpMapSz = sizeof(fb->cmpMap),
+        .cmpSitesSz = sizeof(fb->cmpSites),
+        .pidFeedbackSz = sizeof(fb->pidFeedback),
+        .persistentCtlSz = sizeof(fb->persistentCtl),
+        .cmpLogSz = sizeof(fb->cmpLog),
+        .crashRecSz = sizeof(fb->crashRec),
+    };
+    /* The whole object is backed already */
+    fb->pcGuardMapLen = sizeof(fb->pcGuardMap);
+
+    printf("%-26s", "ns/call, processes:");
+    for (size_t procs = 1; procs <= maxProcs; procs *= 2) {
+        printf("%10zu", procs);
+    }
+    printf("\n");
+    for (size_t h = 0; h < ARRAYSIZE(benchHooks); h++) {
+        printf("%-26s", benchHooks[h].name);
+        for (size_t procs = 1; procs <= maxProcs; procs *= 2) {
+            printf("%10.2f", benchRun(argv[0], feedbackFd, h, iters, procs));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*
+ *
+ * honggfuzz - Intel PT TIP scanner microbenchmark
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+/*
+ * Replays raw Intel PT traces (copies of the perf AUX buffer, e.g. extracted from perf.data with
+ * libipt's script/perf-read-aux.bash) through the built-in TIP scanner, and through libipt if
+ * honggfuzz was built with it, checking that both produce the same coverage bitmap
+ *
+ *   bench/pt_scan [-n iterations] trace.bin...
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "honggfuzz.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+#include "linux/pt.h"
+
+static void benchReport(const char* name, const char* impl, size_t sz, size_t iters,
+    uint64_t usecs, size_t newBits) {
+    double nsPerByte = ((double)usecs * 1000.0) / ((double)sz * (double)iters);
+    double mbPerSec = usecs ? ((double)sz * (double)iters) / (double)usecs : 0.0;
+    printf("%s: %-8s size: %zu, bits: %zu, %.3f ns/byte, %.1f MB/s\n", name, impl, sz, newBits,
+        nsPerByte, mbPerSec);
+}
+
+static void benchFile(const char* name, size_t iters) {
+    off_t sz;
+    int fd;
+    uint8_t* buf = files_mapFile(name, &sz, &fd, /* isWritable= */ false);
+    if (buf == NULL) {
+        LOG_F("Couldn't map '%s'", name);
+    }
+    defer {
+        munmap(buf, sz);
+        close(fd);
+    };
+    if (sz == 0) {
+        LOG_W("'%s' is empty", name);
+        return;
+    }
+
+    uint8_t* bitmap = util_Calloc(_HF_PERF_BITMAP_SIZE_16M);
+    defer {
+        free(bitmap);
+    };
+
+    size_t newBits = 0;
+    uint64_t usecs = 0;
+    for (size_t i = 0; i < iters; i++) {
+        memset(bitmap, '\0', _HF_PERF_BITMAP_SIZE_16M);
+        uint64_t t0 = util_timeNowUSecs();
+        newBits = perf_ptScanTip(buf, (size_t)sz, ~(0ULL), bitmap);
+        usecs += util_timeNowUSecs() - t0;
+    }
+    benchReport(name, "scanner", (size_t)sz, iters, usecs, newBits);
+
+#ifdef _HF_LINUX_INTEL_PT_LIB
+    uint8_t* libiptBitmap = util_Calloc(_HF_PERF_BITMAP_SIZE_16M);
+    defer {
+        free(libiptBitmap);
+    };
+    void* ptd = perf_ptAllocDecoder(buf, (size_t)sz);
+    defer {
+        perf_ptFreeDecoder(ptd);
+    };
+
+    size_t libiptBits = 0;
+    usecs = 0;
+    for (size_t i = 0; i < iters; i++) {
+        memset(libiptBitmap, '\0', _HF_PERF_BITMAP_SIZE_16M);
+        uint64_t t0 = util_timeNowUSecs();
+        libiptBits = perf_ptDecodeTip(ptd, 0, (uint64_t)sz, ~(0ULL), libiptBitmap);
+        usecs += util_timeNowUSecs() - t0;
+    }
+    benchReport(name, "libipt", (size_t)sz, iters, usecs, libiptBits);
+
+    if (newBits != libiptBits || memcmp(bitmap, libiptBitmap, _HF_PERF_BITMAP_SIZE_16M) != 0) {
+        LOG_E("'%s': the scanner and libipt produced different bitmaps (%zu vs %zu bits)", name,
+            newBits, libiptBits);
+    }
+#endif /* _HF_LINUX_INTEL_PT_LIB */
+}
+
+int main(int argc, char** argv) {
+    size_t iters = 10;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+            case 'n':
+                iters = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] trace.bin...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || iters == 0) {
+        fprintf(stderr, "Usage: %s [-n iterations] trace.bin...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    perf_ptInit();
+    for (int i = optind; i < argc; i++) {
+        benchFile(argv[i], iters);
+    }
+
+    return EXIT_SUCCESS;
+}
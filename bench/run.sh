@@ -0,0 +1,151 @@
+#!/bin/sh
+#
+#   honggfuzz - benchmark driver
+#   -----------------------------------------
+#
+#   Copyright 2019 by Google Inc. All Rights Reserved.
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+#   Runs fixed-seed, fixed-duration campaigns against the targets from bench/targets.conf, and
+#   appends one JSON object per campaign to <outdir>/<version>.jsonl, with: execs/sec,
+#   time-to-N-edges (seconds, null if not reached), peak RSS of honggfuzz and of the fuzzed
+#   processes (KiB), and syscalls/iteration (if 'perf stat' can count them, null otherwise)
+#
+#   Run from the top directory (or with 'make bench'):
+#
+#     bench/run.sh [-t seconds] [-s seed] [-n threads] [-e edges] [-o outdir] [-c targets.conf]
+#
+
+set -e
+
+DURATION=60
+SEED=1
+THREADS=1
+EDGES=100
+OUT=bench/out
+CONF=bench/targets.conf
+
+while getopts "t:s:n:e:o:c:" opt; do
+	case "$opt" in
+		t) DURATION="$OPTARG" ;;
+		s) SEED="$OPTARG" ;;
+		n) THREADS="$OPTARG" ;;
+		e) EDGES="$OPTARG" ;;
+		o) OUT="$OPTARG" ;;
+		c) CONF="$OPTARG" ;;
+		*) sed -n 's/^#     //p' "$0"; exit 1 ;;
+	esac
+done
+
+if [ ! -x ./honggfuzz ] || [ ! -x ./hfuzz_cc/hfuzz-cc ]; then
+	echo "Build honggfuzz first (make)"
+	exit 1
+fi
+
+VERSION="`git describe --always --dirty 2>/dev/null || sed -n 's/^#define PROG_VERSION "\(.*\)"/\1/p' honggfuzz.h`"
+BENCH_BIN="$OUT/bin"
+RESULTS="$OUT/$VERSION.jsonl"
+mkdir -p "$BENCH_BIN"
+
+CFLAGS="-O2 -fno-stack-protector -w"
+${HFUZZ_CC:-./hfuzz_cc/hfuzz-clang} $CFLAGS -o "$BENCH_BIN/badcode1.hfuzz" \
+	examples/badcode/targets/badcode1.c || echo "Couldn't build the instrumented badcode1"
+${CC:-cc} $CFLAGS -o "$BENCH_BIN/badcode1" examples/badcode/targets/badcode1.c
+
+PERF=""
+if perf stat -e raw_syscalls:sys_enter -x, -o /dev/null true >/dev/null 2>&1; then
+	PERF="perf"
+fi
+TIME=""
+if /usr/bin/time -f %M true >/dev/null 2>&1; then
+	TIME="/usr/bin/time"
+fi
+
+# Seconds since the first log line, when the total coverage (Tot:) field no. $2 reached $3 edges
+timeToCov() {
+	START="`sed -n '1s/^\[\([^]]*\)\].*/\1/p' "$1"`"
+	HIT="`awk -v field="$2" -v edges="$3" '/Tot:/ {
+		split(substr($0, index($0, "Tot:") + 4), tot, "/")
+		if (tot[field] + 0 >= edges) { print substr($1, 2, index($1, "]") - 2); exit }
+	}' "$1"`"
+	if [ -z "$START" ] || [ -z "$HIT" ]; then
+		echo null
+		return
+	fi
+	echo $((`date -d "$HIT" +%s` - `date -d "$START" +%s`))
+}
+
+# Value of the $1 field of the 'Summary' log line
+summaryField() {
+	sed -n "s/.*[ :]$1:\([0-9]*\).*/\1/p" "$RUN/summary"
+}
+
+grep -v '^[[:space:]]*\(#.*\)\?$' "$CONF" | while read -r NAME MODE BIN CORPUS ARGS; do
+	# Expands ${VARIABLES} of targets.conf
+	eval "BIN=\"$BIN\"; CORPUS=\"$CORPUS\""
+	if [ ! -x "$BIN" ] || [ ! -d "$CORPUS" ]; then
+		echo "Skipping $NAME/$MODE: no binary ('$BIN') or corpus ('$CORPUS')"
+		continue
+	fi
+
+	case "$MODE" in
+		persistent) FLAGS="-P"; COVFIELD=4 ;;
+		pcguard) FLAGS=""; COVFIELD=4 ;;
+		bts) FLAGS="--linux_perf_bts_edge"; COVFIELD=3 ;;
+		pt) FLAGS="--linux_perf_ipt_block"; COVFIELD=3 ;;
+		*) echo "Unknown mode '$MODE' of $NAME"; exit 1 ;;
+	esac
+
+	RUN="$OUT/$VERSION/$NAME-$MODE"
+	rm -rf "$RUN"
+	mkdir -p "$RUN/corpus" "$RUN/workspace"
+	echo "Benchmarking $NAME/$MODE for ${DURATION}s"
+
+	set -- ./honggfuzz -v -l "$RUN/log" -n "$THREADS" --seed "$SEED" --run_time "$DURATION" \
+		-f "$CORPUS" --covdir_all "$RUN/corpus" -W "$RUN/workspace" $FLAGS -- "$BIN" $ARGS
+	if [ -n "$TIME" ]; then
+		set -- "$TIME" -f %M -o "$RUN/rss" "$@"
+	fi
+	if [ -n "$PERF" ]; then
+		set -- "$PERF" stat -e raw_syscalls:sys_enter -x, -o "$RUN/perf" "$@"
+	fi
+	if ! "$@" >/dev/null 2>&1; then
+		echo "$NAME/$MODE failed, see $RUN/log"
+		continue
+	fi
+
+	grep 'Summary iterations:' "$RUN/log" | tail -n1 >"$RUN/summary"
+	ITERS="`summaryField iterations`"
+	EDGESTOT="`awk -v f="$COVFIELD" '/Tot:/ {
+		split(substr($0, index($0, "Tot:") + 4), tot, "/"); cov = tot[f]
+	} END { print cov + 0 }' "$RUN/log"`"
+	SYSCALLS=null
+	if [ -n "$PERF" ] && [ "${ITERS:-0}" -gt 0 ]; then
+		CNT="`awk -F, '/raw_syscalls:sys_enter/ { print $1 }' "$RUN/perf"`"
+		SYSCALLS="`awk -v c="$CNT" -v i="$ITERS" 'BEGIN { printf("%.1f", c / i) }'`"
+	fi
+	RSS=null
+	if [ -n "$TIME" ]; then
+		RSS="`tail -n1 "$RUN/rss"`"
+	fi
+
+	printf '{"version":"%s","target":"%s","mode":"%s","seed":%s,"threads":%s,"duration":%s,' \
+		"$VERSION" "$NAME" "$MODE" "$SEED" "$THREADS" "`summaryField time`" >>"$RESULTS"
+	printf '"iterations":%s,"execs_per_sec":%s,"edges":%s,"time_to_%s_edges":%s,' \
+		"${ITERS:-0}" "`summaryField speed`" "$EDGESTOT" "$EDGES" "`timeToCov "$RUN/log" "$COVFIELD" "$EDGES"`" >>"$RESULTS"
+	printf '"rss_kb":%s,"target_rss_kb":%s,"syscalls_per_iteration":%s}\n' \
+		"$RSS" "$((`summaryField peak_rss_mb` * 1024))" "$SYSCALLS" >>"$RESULTS"
+done
+
+echo "Results: $RESULTS"
@@ -0,0 +1,350 @@
+/*
+ *
+ * honggfuzz - checkpoints of the coverage state
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fuzz.h"
+#include "input.h"
+#include "libhfcommon/bitmap.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+typedef struct {
+    uint8_t* map;
+    size_t sz;
+    /* Bytes which are backed by the shared memory object (pcGuardMap grows), the rest is zero */
+    size_t len;
+} checkpointMap_t;
+
+#define CHECKPOINT_MAPS_CNT 5
+
+static size_t checkpoint_maps(honggfuzz_t* hfuzz, checkpointMap_t maps[CHECKPOINT_MAPS_CNT]) {
+    feedback_t* fb = hfuzz->feedback.feedbackMap;
+    maps[0] = (checkpointMap_t){
+        fb->pcGuardMap, sizeof(fb->pcGuardMap), ATOMIC_GET_ACQUIRE(fb->pcGuardMapLen)};
+    maps[1] = (checkpointMap_t){fb->pcCntMap, sizeof(fb->pcCntMap), sizeof(fb->pcCntMap)};
+    maps[2] = (checkpointMap_t){fb->bbMapPc, sizeof(fb->bbMapPc), sizeof(fb->bbMapPc)};
+    maps[3] = (checkpointMap_t){fb->cmpMap, sizeof(fb->cmpMap), sizeof(fb->cmpMap)};
+    /* The IDs which index cmpMap */
+    maps[4] = (checkpointMap_t){
+        (uint8_t*)fb->cmpSites, sizeof(fb->cmpSites), sizeof(fb->cmpSites)};
+    return CHECKPOINT_MAPS_CNT;
+}
+
+static bool checkpoint_blockIsZero(const uint8_t* block) {
+    uint64_t any = 0;
+    for (size_t i = 0; i < BITMAP_BLOCK_SZ; i += sizeof(uint64_t)) {
+        uint64_t v;
+        memcpy(&v, &block[i], sizeof(v));
+        any |= v;
+    }
+    return any == 0;
+}
+
+static bool checkpoint_writeMap(FILE* f, const checkpointMap_t* m) {
+    /* The map is being updated concurrently, so the runs are found first, and written afterwards */
+    size_t runsCap = 1024;
+    size_t runsCnt = 0;
+    checkpointRun_t* runs = util_Malloc(sizeof(checkpointRun_t) * runsCap);
+    defer {
+        free(runs);
+    };
+
+    uint32_t blocks = (uint32_t)(m->len / BITMAP_BLOCK_SZ);
+    for (uint32_t b = 0; b < blocks; b++) {
+        if (checkpoint_blockIsZero(&m->map[(size_t)b * BITMAP_BLOCK_SZ])) {
+            continue;
+        }
+        if (runsCnt && (runs[runsCnt - 1].block + runs[runsCnt - 1].blocksCnt) == b) {
+            runs[runsCnt - 1].blocksCnt++;
+            continue;
+        }
+        if (runsCnt == runsCap) {
+            runsCap *= 2;
+            runs = util_Realloc(runs, sizeof(checkpointRun_t) * runsCap);
+        }
+        runs[runsCnt++] = (checkpointRun_t){.block = b, .blocksCnt = 1};
+    }
+
+    checkpointMapHdr_t hdr = {
+        .sz = m->sz,
+        .runsCnt = runsCnt,
+    };
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        return false;
+    }
+    for (size_t i = 0; i < runsCnt; i++) {
+        size_t len = (size_t)runs[i].blocksCnt * BITMAP_BLOCK_SZ;
+        if (fwrite(&runs[i], sizeof(runs[i]), 1, f) != 1 ||
+            fwrite(&m->map[(size_t)runs[i].block * BITMAP_BLOCK_SZ], len, 1, f) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkpoint_write(honggfuzz_t* hfuzz, FILE* f) {
+    checkpointHdr_t hdr = {};
+    memcpy(hdr.magic, _HF_CHECKPOINT_MAGIC, sizeof(hdr.magic));
+    hdr.version = _HF_CHECKPOINT_VERSION;
+    hdr.binaryId = files_crc64File(hfuzz->exe.cmdline[0]);
+    hdr.guardNb = ATOMIC_GET(hfuzz->feedback.feedbackMap->guardNb);
+    hdr.cmpSitesCnt = ATOMIC_GET(hfuzz->feedback.feedbackMap->cmpSitesCnt);
+    {
+        MX_SCOPED_LOCK(&hfuzz->feedback.feedback_mutex);
+        hdr.hwCnts = hfuzz->linux.hwCnts;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        return false;
+    }
+
+    checkpointMap_t maps[CHECKPOINT_MAPS_CNT];
+    hdr.mapsCnt = (uint32_t)checkpoint_maps(hfuzz, maps);
+    for (size_t i = 0; i < hdr.mapsCnt; i++) {
+        if (!checkpoint_writeMap(f, &maps[i])) {
+            return false;
+        }
+    }
+
+    /*
+     * The corpus is read after the maps: an input whose bits are missing in the maps is harmless,
+     * while bits of an input missing from the corpus would make the coverage unreachable
+     */
+    hdr.corpusCnt = ATOMIC_GET_ACQUIRE(hfuzz->io.dynfileqCnt);
+    for (size_t i = 0; i < hdr.corpusCnt; i++) {
+        struct dynfile_t* dynfile = input_getDynamicInput(hfuzz, i);
+        checkpointInput_t in = {
+            .timeExecUSecs = dynfile->timeExecUSecs,
+            .newCov = dynfile->newCov,
+            .len = dynfile->size,
+        };
+        if (fwrite(&in, sizeof(in), 1, f) != 1 ||
+            (dynfile->size && fwrite(dynfile->data, dynfile->size, 1, f) != 1)) {
+            return false;
+        }
+    }
+
+    if (fseek(f, 0, SEEK_SET) == -1 || fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        return false;
+    }
+    return true;
+}
+
+bool checkpoint_save(honggfuzz_t* hfuzz) {
+    if (!hfuzz->checkpoint.path ||
+        ATOMIC_GET(hfuzz->feedback.state) != _HF_STATE_DYNAMIC_MAIN) {
+        return true;
+    }
+
+    char tmpPath[PATH_MAX];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", hfuzz->checkpoint.path);
+    FILE* f = fopen(tmpPath, "wbe");
+    if (!f) {
+        PLOG_W("Couldn't open '%s' for writing", tmpPath);
+        return false;
+    }
+
+    uint64_t t0 = util_timeNowUSecs();
+    bool ret = checkpoint_write(hfuzz, f) && (fflush(f) == 0) && (fsync(fileno(f)) == 0);
+    if (fclose(f) != 0) {
+        ret = false;
+    }
+    if (!ret) {
+        PLOG_W("Couldn't write the checkpoint to '%s'", tmpPath);
+        unlink(tmpPath);
+        return false;
+    }
+    if (rename(tmpPath, hfuzz->checkpoint.path) == -1) {
+        PLOG_W("rename('%s', '%s')", tmpPath, hfuzz->checkpoint.path);
+        unlink(tmpPath);
+        return false;
+    }
+    LOG_I("Checkpoint saved to '%s' in %" PRIu64 "ms", hfuzz->checkpoint.path,
+        (util_timeNowUSecs() - t0) / 1000U);
+    return true;
+}
+
+void checkpoint_periodic(honggfuzz_t* hfuzz) {
+    static time_t lastSave = 0;
+    if (!hfuzz->checkpoint.path) {
+        return;
+    }
+    time_t now = time(NULL);
+    if (lastSave == 0) {
+        lastSave = now;
+    }
+    if ((now - lastSave) < hfuzz->checkpoint.interval) {
+        return;
+    }
+    lastSave = now;
+    checkpoint_save(hfuzz);
+}
+
+/* Bounds-checked reading of the mapped checkpoint */
+static const uint8_t* checkpoint_get(const uint8_t* buf, size_t sz, size_t* off, size_t len) {
+    if (len > sz - *off) {
+        return NULL;
+    }
+    const uint8_t* ret = &buf[*off];
+    *off += len;
+    return ret;
+}
+
+static bool checkpoint_restore(honggfuzz_t* hfuzz, const uint8_t* buf, size_t sz) {
+    size_t off = 0;
+    checkpointHdr_t hdr;
+    const uint8_t* p = checkpoint_get(buf, sz, &off, sizeof(hdr));
+    if (!p) {
+        LOG_E("The checkpoint is truncated (%zu bytes)", sz);
+        return false;
+    }
+    memcpy(&hdr, p, sizeof(hdr));
+
+    checkpointMap_t maps[CHECKPOINT_MAPS_CNT];
+    size_t mapsCnt = checkpoint_maps(hfuzz, maps);
+    if (memcmp(hdr.magic, _HF_CHECKPOINT_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != _HF_CHECKPOINT_VERSION || hdr.mapsCnt != mapsCnt) {
+        LOG_E("Not a compatible checkpoint (version: %" PRIu32 ", maps: %" PRIu32 ")",
+            hdr.version, hdr.mapsCnt);
+        return false;
+    }
+
+    for (size_t i = 0; i < mapsCnt; i++) {
+        checkpointMapHdr_t mhdr;
+        if (!(p = checkpoint_get(buf, sz, &off, sizeof(mhdr)))) {
+            LOG_E("The checkpoint is truncated (map #%zu)", i);
+            return false;
+        }
+        memcpy(&mhdr, p, sizeof(mhdr));
+        if (mhdr.sz != maps[i].sz) {
+            LOG_E("Map #%zu has size %" PRIu64 ", expected %zu", i, mhdr.sz, maps[i].sz);
+            return false;
+        }
+        for (uint64_t r = 0; r < mhdr.runsCnt; r++) {
+            checkpointRun_t run;
+            if (!(p = checkpoint_get(buf, sz, &off, sizeof(run)))) {
+                LOG_E("The checkpoint is truncated (map #%zu, run #%" PRIu64 ")", i, r);
+                return false;
+            }
+            memcpy(&run, p, sizeof(run));
+            size_t start = (size_t)run.block * BITMAP_BLOCK_SZ;
+            size_t len = (size_t)run.blocksCnt * BITMAP_BLOCK_SZ;
+            if (start > maps[i].sz || len > maps[i].sz - start ||
+                !(p = checkpoint_get(buf, sz, &off, len))) {
+                LOG_E("Invalid run in map #%zu: block %" PRIu32 ", blocks: %" PRIu32, i, run.block,
+                    run.blocksCnt);
+                return false;
+            }
+            if ((start + len) > maps[i].len) {
+                if (!fuzz_feedbackGrowGuardMap(hfuzz->feedback.bbFd, hfuzz->feedback.feedbackMap,
+                        start + len)) {
+                    LOG_E("Couldn't grow map #%zu to %zu bytes", i, start + len);
+                    return false;
+                }
+                maps[i].len = ATOMIC_GET(hfuzz->feedback.feedbackMap->pcGuardMapLen);
+            }
+            memcpy(&maps[i].map[start], p, len);
+        }
+    }
+
+    for (uint64_t i = 0; i < hdr.corpusCnt; i++) {
+        checkpointInput_t in;
+        if (!(p = checkpoint_get(buf, sz, &off, sizeof(in)))) {
+            LOG_E("The checkpoint is truncated (input #%" PRIu64 ")", i);
+            return false;
+        }
+        memcpy(&in, p, sizeof(in));
+        if (in.len > hfuzz->mutate.maxFileSz || !(p = checkpoint_get(buf, sz, &off, in.len))) {
+            LOG_E("Invalid input #%" PRIu64 " in the checkpoint, len: %" PRIu64, i, in.len);
+            return false;
+        }
+        input_addDynamicInput(hfuzz, p, in.len, in.timeExecUSecs, in.newCov);
+    }
+
+    ATOMIC_SET(hfuzz->feedback.feedbackMap->guardNb, hdr.guardNb);
+    ATOMIC_SET(hfuzz->feedback.feedbackMap->cmpSitesCnt, hdr.cmpSitesCnt);
+    hfuzz->linux.hwCnts = hdr.hwCnts;
+    hfuzz->linux.hwCnts.newBBCnt = 0;
+    LOG_I("Restored %" PRIu64 " corpus entries, and the coverage (edges: %" PRIu64 ", pc: %" PRIu64
+          ", cmp: %" PRIu64 ") from the checkpoint",
+        hdr.corpusCnt, hdr.hwCnts.softCntEdge, hdr.hwCnts.softCntPc, hdr.hwCnts.softCntCmp);
+    return true;
+}
+
+bool checkpoint_load(honggfuzz_t* hfuzz) {
+    if (!hfuzz->checkpoint.path || !files_exists(hfuzz->checkpoint.path)) {
+        return true;
+    }
+    if (hfuzz->feedback.dynFileMethod == _HF_DYNFILE_NONE || hfuzz->cfg.minimize ||
+        hfuzz->socketFuzzer.enabled) {
+        LOG_W("Checkpoints are used in the feedback-driven fuzzing mode only, ignoring '%s'",
+            hfuzz->checkpoint.path);
+        return true;
+    }
+
+    off_t sz;
+    int fd;
+    uint8_t* buf = files_mapFile(hfuzz->checkpoint.path, &sz, &fd, /* isWritable= */ false);
+    if (!buf) {
+        LOG_E("Couldn't map the checkpoint '%s'", hfuzz->checkpoint.path);
+        return false;
+    }
+    defer {
+        munmap(buf, sz);
+        close(fd);
+    };
+    if (madvise(buf, sz, MADV_SEQUENTIAL) == -1) {
+        PLOG_D("madvise('%s', MADV_SEQUENTIAL)", hfuzz->checkpoint.path);
+    }
+
+    checkpointHdr_t hdr;
+    if ((size_t)sz >= sizeof(hdr)) {
+        memcpy(&hdr, buf, sizeof(hdr));
+        uint64_t binaryId = files_crc64File(hfuzz->exe.cmdline[0]);
+        if (binaryId != hdr.binaryId) {
+            LOG_W("The checkpoint '%s' was made for a different binary than '%s', ignoring it",
+                hfuzz->checkpoint.path, hfuzz->exe.cmdline[0]);
+            return true;
+        }
+        if (hdr.corpusCnt == 0) {
+            LOG_W("The checkpoint '%s' has an empty corpus, ignoring it", hfuzz->checkpoint.path);
+            return true;
+        }
+    }
+    if (!checkpoint_restore(hfuzz, buf, (size_t)sz)) {
+        LOG_E("Couldn't restore the checkpoint '%s'", hfuzz->checkpoint.path);
+        return false;
+    }
+    hfuzz->checkpoint.resumed = true;
+    return true;
+}
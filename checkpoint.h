@@ -0,0 +1,84 @@
+/*
+ *
+ * honggfuzz - checkpoints of the coverage state
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_CHECKPOINT_H_
+#define _HF_CHECKPOINT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "honggfuzz.h"
+
+/*
+ * A checkpoint (--checkpoint) holds the feedback maps (pcGuardMap, pcCntMap, bbMapPc, cmpMap and
+ * the cmpSites registry), the coverage counters and the dynamic corpus with its scheduler metadata.
+ * The maps are stored as runs of non-zero BITMAP_BLOCK_SZ blocks, i.e. all-zero blocks are
+ * run-length encoded away:
+ *
+ *   checkpointHdr_t
+ *   checkpointMapHdr_t, followed by its runs (checkpointRun_t and the blocks), for every map
+ *   checkpointInput_t and the input's data, for every corpus entry
+ *
+ * All the fields use the host byte order
+ */
+#define _HF_CHECKPOINT_MAGIC "HFCKPT\x00\x01"
+#define _HF_CHECKPOINT_VERSION 2U
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t mapsCnt;
+    /* CRC64 of the fuzzed binary, the maps are useless for other ones */
+    uint64_t binaryId;
+    uint64_t guardNb;
+    uint64_t cmpSitesCnt;
+    uint64_t corpusCnt;
+    hwcnt_t hwCnts;
+} checkpointHdr_t;
+
+typedef struct {
+    uint64_t sz;
+    uint64_t runsCnt;
+} checkpointMapHdr_t;
+
+typedef struct {
+    /* In BITMAP_BLOCK_SZ blocks */
+    uint32_t block;
+    uint32_t blocksCnt;
+} checkpointRun_t;
+
+typedef struct {
+    uint64_t timeExecUSecs;
+    uint64_t newCov;
+    uint64_t len;
+} checkpointInput_t;
+
+/*
+ * Restores the state from the --checkpoint file, if it exists. Then hfuzz->checkpoint.resumed is
+ * set, and the dry run is skipped
+ */
+extern bool checkpoint_load(honggfuzz_t* hfuzz);
+/* Writes the checkpoint (atomically, replacing the previous one) */
+extern bool checkpoint_save(honggfuzz_t* hfuzz);
+/* Called by the main thread regularly, saves the checkpoint every --checkpoint_interval seconds */
+extern void checkpoint_periodic(honggfuzz_t* hfuzz);
+
+#endif /* ifndef _HF_CHECKPOINT_H_ */
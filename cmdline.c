@@ -36,7 +36,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
-#include <sys/queue.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -125,8 +124,7 @@ static void cmdlineHelp(const char* pname, struct custom_option* opts) {
     LOG_HELP_BOLD("  " PROG_NAME " --linux_perf_branch -- /usr/bin/djpeg " _HF_FILE_PLACEHOLDER);
     LOG_HELP(" As above, maximize unique branches (edges) via Intel BTS:");
     LOG_HELP_BOLD("  " PROG_NAME " --linux_perf_bts_edge -- /usr/bin/djpeg " _HF_FILE_PLACEHOLDER);
-    LOG_HELP(
-        " As above, maximize unique code blocks via Intel Processor Trace (requires libipt.so):");
+    LOG_HELP(" As above, maximize unique code blocks via Intel Processor Trace:");
     LOG_HELP_BOLD("  " PROG_NAME " --linux_perf_ipt_block -- /usr/bin/djpeg " _HF_FILE_PLACEHOLDER);
 #endif /* defined(_HF_ARCH_LINUX) */
 }
@@ -193,6 +191,92 @@ static bool cmdlineVerify(honggfuzz_t* hfuzz) {
         return false;
     }
 
+    if (hfuzz->exe.forkServer && hfuzz->exe.persistent) {
+        LOG_W("Persistent mode is enabled, the fork-server will not be used");
+        hfuzz->exe.forkServer = false;
+    } else if (hfuzz->exe.forkServer) {
+        hfuzz->exe.persistent = true;
+    }
+    /* Processes forked by the fork-server read the input file, so they need its real size */
+    hfuzz->exe.inputFixedSz = hfuzz->exe.persistent && !hfuzz->exe.forkServer;
+
+#if !defined(_HF_ARCH_LINUX)
+    if (hfuzz->exe.snapshot) {
+        LOG_W("The --snapshot mode is supported under Linux only, ignoring it");
+        hfuzz->exe.snapshot = false;
+    }
+#endif /* !defined(_HF_ARCH_LINUX) */
+    if (hfuzz->exe.snapshot && (!hfuzz->exe.persistent || hfuzz->exe.forkServer)) {
+        LOG_E("The --snapshot mode works with persistent binaries only");
+        return false;
+    }
+
+#if !defined(_HF_ARCH_LINUX)
+    if (hfuzz->exe.stdinPipe) {
+        LOG_W("The --stdin_pipe mode is supported under Linux only, ignoring it");
+        hfuzz->exe.stdinPipe = false;
+    }
+#endif /* !defined(_HF_ARCH_LINUX) */
+    if (hfuzz->exe.stdinPipe && !hfuzz->exe.fuzzStdin) {
+        LOG_E("--stdin_pipe requires -s (--stdin_input)");
+        return false;
+    }
+    if (hfuzz->exe.stdinPipe && hfuzz->exe.persistent && !hfuzz->exe.forkServer) {
+        LOG_W("Persistent binaries get their inputs with the persistent protocol, ignoring "
+              "--stdin_pipe");
+        hfuzz->exe.stdinPipe = false;
+    }
+
+#if !defined(_HF_ARCH_LINUX)
+    if (hfuzz->threads.asyncRuns > 1) {
+        LOG_W("The --async_runs mode is supported under Linux only, ignoring it");
+        hfuzz->threads.asyncRuns = 0;
+    }
+#endif /* !defined(_HF_ARCH_LINUX) */
+    /* -n is only where --threads_auto starts from, all threads up to the maximum are started */
+    if (hfuzz->threads.threadsAutoMax) {
+        if (hfuzz->threads.threadsAutoMax < hfuzz->threads.threadsMax) {
+            LOG_W("--threads_auto %zu is lower than --threads %zu, using the latter",
+                hfuzz->threads.threadsAutoMax, hfuzz->threads.threadsMax);
+            hfuzz->threads.threadsAutoMax = hfuzz->threads.threadsMax;
+        }
+        hfuzz->threads.threadsAutoCnt = (uint32_t)MAX(hfuzz->threads.threadsMax, 1);
+        hfuzz->threads.threadsMax = hfuzz->threads.threadsAutoMax;
+    }
+
+    if (hfuzz->threads.asyncRuns > 1) {
+        /* Events of ptrace()-d processes come from all of their threads, not routed to runs */
+        if (!hfuzz->exe.persistent || hfuzz->exe.forkServer || !hfuzz->linux.inprocCrash) {
+            LOG_E("--async_runs works with persistent binaries, and --linux_inprocess_crash only");
+            return false;
+        }
+        if (hfuzz->exe.snapshot || hfuzz->socketFuzzer.enabled || hfuzz->cfg.useVerifier ||
+            hfuzz->cfg.minimize || hfuzz->cfg.minimizeCrash) {
+            LOG_E("--async_runs doesn't work with --snapshot, --socket_fuzzer, --verifier, "
+                  "--minimize and --minimize_crash");
+            return false;
+        }
+        if ((hfuzz->threads.threadsMax * hfuzz->threads.asyncRuns) >= _HF_THREAD_MAX) {
+            LOG_E("Too many processes: %zu threads * %zu (--async_runs) >= _HF_THREAD_MAX (%u)",
+                hfuzz->threads.threadsMax, hfuzz->threads.asyncRuns, _HF_THREAD_MAX);
+            return false;
+        }
+    }
+
+    if (hfuzz->exe.persistentBatch > _HF_BATCH_MAX) {
+        LOG_E("--persistent_batch %zu is bigger than the maximum of %u", hfuzz->exe.persistentBatch,
+            _HF_BATCH_MAX);
+        return false;
+    }
+    if (hfuzz->exe.persistentBatch > 1 &&
+        (!hfuzz->exe.persistent || hfuzz->exe.forkServer || hfuzz->exe.netDriver ||
+            hfuzz->socketFuzzer.enabled || hfuzz->cfg.useVerifier ||
+            hfuzz->threads.asyncRuns > 1)) {
+        LOG_W("--persistent_batch works with persistent binaries only, and without the verifier "
+              "and --async_runs. Disabling it");
+        hfuzz->exe.persistentBatch = 0;
+    }
+
     if (hfuzz->threads.threadsMax >= _HF_THREAD_MAX) {
         LOG_E("Too many fuzzing threads specified %zu (>= _HF_THREAD_MAX (%u))",
             hfuzz->threads.threadsMax, _HF_THREAD_MAX);
@@ -214,11 +298,50 @@ static bool cmdlineVerify(honggfuzz_t* hfuzz) {
     if (hfuzz->io.crashDir == NULL) {
         hfuzz->io.crashDir = hfuzz->io.workDir;
     }
+    /* With the packed corpus, coverage files go to the covdir_all only if it's explicitly set */
+    if (hfuzz->io.covDirAll == NULL && hfuzz->io.corpusPack == NULL) {
+        hfuzz->io.covDirAll = hfuzz->io.inputDir;
+    }
     if (mkdir(hfuzz->io.crashDir, 0700) && errno != EEXIST) {
         PLOG_E("Couldn't create the crash directory '%s'", hfuzz->io.crashDir);
         return false;
     }
 
+    if (hfuzz->cfg.minimize) {
+        if (hfuzz->feedback.dynFileMethod == _HF_DYNFILE_NONE || hfuzz->socketFuzzer.enabled) {
+            LOG_E("--minimize requires coverage feedback, and doesn't work with --socket_fuzzer");
+            return false;
+        }
+        if (hfuzz->io.covDirAll == NULL ||
+            (hfuzz->io.inputDir && strcmp(hfuzz->io.covDirAll, hfuzz->io.inputDir) == 0)) {
+            LOG_E("--minimize saves the minimized corpus into --covdir_all, which must be set to a "
+                  "directory different than --input");
+            return false;
+        }
+    }
+
+    if (hfuzz->cfg.minimizeCrash) {
+        if (hfuzz->socketFuzzer.enabled || hfuzz->cfg.minimize || hfuzz->cfg.trim) {
+            LOG_E("--minimize_crash doesn't work with --socket_fuzzer, --minimize and --trim");
+            return false;
+        }
+        /* Only the stack hashes of the crashes are needed, see arch_traceAnalyze() */
+        hfuzz->linux.triageThreads = 0;
+    }
+
+    if (hfuzz->cfg.trim) {
+        if (hfuzz->feedback.dynFileMethod == _HF_DYNFILE_NONE || hfuzz->socketFuzzer.enabled ||
+            hfuzz->cfg.minimize) {
+            LOG_E("--trim requires coverage feedback, and doesn't work with --socket_fuzzer and "
+                  "--minimize");
+            return false;
+        }
+        if (hfuzz->threads.threadsMax < 2) {
+            LOG_W("--trim needs at least 2 threads (-n), disabling it");
+            hfuzz->cfg.trim = false;
+        }
+    }
+
     if (hfuzz->mutate.mutationsPerRun == 0U && hfuzz->cfg.useVerifier) {
         LOG_I("Verifier enabled with mutationsPerRun == 0, activating the dry run mode");
     }
@@ -241,6 +364,9 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                     long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
                     (ncpus <= 1 ? 1 : ncpus / 2);
                 }),
+                .asyncRuns = 0,
+                .threadsAutoMax = 0,
+                .threadsAutoCnt = 0,
                 .threadsActiveCnt = 0,
                 .mainThread = pthread_self(),
                 .mainPid = getpid(),
@@ -248,7 +374,6 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
         .io =
             {
                 .inputDir = NULL,
-                .inputDirPtr = NULL,
                 .fileCnt = 0,
                 .fileCntDone = false,
                 .newUnitsAdded = 0,
@@ -257,9 +382,15 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                 .crashDir = NULL,
                 .covDirAll = NULL,
                 .covDirNew = NULL,
+                .corpusPack = NULL,
                 .saveUnique = true,
                 .dynfileqCnt = 0U,
-                .dynfileq_mutex = PTHREAD_RWLOCK_INITIALIZER,
+                .dynfileq_mutex = PTHREAD_MUTEX_INITIALIZER,
+                .dynfileqTimeExecUSecs = 0U,
+                .dynfileqExecTimes = {},
+                .dynfileqMedianUSecs = 0U,
+                .dynfileqSlowCnt = 0U,
+                .dynfileqSched = _HF_SCHED_RR,
             },
         .exe =
             {
@@ -267,10 +398,15 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                 .cmdline = NULL,
                 .nullifyStdio = true,
                 .fuzzStdin = false,
+                .stdinPipe = false,
                 .externalCommand = NULL,
                 .postExternalCommand = NULL,
                 .feedbackMutateCommand = NULL,
                 .persistent = false,
+                .forkServer = false,
+                .snapshot = false,
+                .persistentBatch = 0U,
+                .inputFixedSz = false,
                 .netDriver = false,
                 .asLimit = 0U,
                 .rssLimit = 0U,
@@ -282,7 +418,11 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             {
                 .timeStart = time(NULL),
                 .runEndTime = 0,
-                .tmOut = 10,
+                .tmOutMillis = 10000,
+                .tmOutAutoMul = 0,
+                .tmOutAutoMillis = 0,
+                .execTimesMutex = PTHREAD_MUTEX_INITIALIZER,
+                .execTimes = {},
                 .lastCovUpdate = time(NULL),
                 .timeOfLongestUnitInMilliseconds = 0,
                 .tmoutVTALRM = false,
@@ -291,7 +431,28 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             {
                 .mutationsMax = 0,
                 .dictionaryFile = NULL,
-                .dictionaryCnt = 0,
+                .dict =
+                    {
+                        .arena = NULL,
+                        .arenaSz = 0,
+                        .arenaUsed = 0,
+                        .entries = NULL,
+                        .capacity = 0,
+                        .cnt = 0,
+                        .staticCnt = 0,
+                        .slots = NULL,
+                        .slotsCnt = 0,
+                        .fixed = false,
+                        .mutex = PTHREAD_MUTEX_INITIALIZER,
+                    },
+                .cmpLog = false,
+                .custom =
+                    {
+                        .lib = NULL,
+                        .handle = NULL,
+                        .mutate = NULL,
+                        .crossOver = NULL,
+                    },
                 .mutationsPerRun = 6U,
                 .maxFileSz = 0UL,
             },
@@ -299,6 +460,8 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             {
                 .useScreen = true,
                 .lastDisplayMillis = util_timeNowMillis(),
+                .statsSocket = NULL,
+                .phaseClock = _HF_PHASE_CLOCK_NONE,
                 .cmdline_txt[0] = '\0',
             },
         .cfg =
@@ -307,6 +470,7 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                 .exitUponCrash = false,
                 .report_mutex = PTHREAD_MUTEX_INITIALIZER,
                 .reportFile = NULL,
+                .reportJson = false,
                 .dynFileIterExpire = 0,
 #if defined(__ANDROID__)
                 .monitorSIGABRT = false,
@@ -314,6 +478,12 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                 .monitorSIGABRT = true,
 #endif
                 .only_printable = false,
+                .minimize = false,
+                .trim = false,
+                .minimizeCrash = NULL,
+                .seedSet = false,
+                .seed = 0,
+                .nodeId = 0,
             },
         .sanitizer =
             {
@@ -326,9 +496,13 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                 .bbFd = -1,
                 .blacklistFile = NULL,
                 .blacklist = NULL,
-                .blacklistCnt = 0,
                 .skipFeedbackOnTimeout = false,
+                .localCov = false,
+                .hugePages = false,
                 .dynFileMethod = _HF_DYNFILE_SOFT,
+                .covExportFile = NULL,
+                .covPcs = NULL,
+                .covPcsFd = -1,
                 .state = _HF_STATE_UNSET,
             },
         .cnts =
@@ -343,8 +517,24 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
         .socketFuzzer =
             {
                 .enabled = false,
+                .binary = false,
                 .serverSocket = -1,
                 .clientSocket = -1,
+                .announce = true,
+                .seq = 0,
+                .events = 0,
+            },
+        .checkpoint =
+            {
+                .path = NULL,
+                .interval = 300,
+                .resumed = false,
+            },
+        .sync =
+            {
+                .listen = NULL,
+                .peers = {},
+                .peersCnt = 0,
             },
 
         /* Linux code */
@@ -371,8 +561,23 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                 .symsWlCnt = 0,
                 .symsWl = NULL,
                 .cloneFlags = 0,
+                .nsFresh = false,
+                .cgroupMem = 0,
+                .cgroupCpu = 0,
+                .cgroupDir = NULL,
                 .kernelOnly = false,
+                .pinCpus = false,
+                .perfAuxSz = _HF_PERF_AUX_SZ,
+                .perfAuxOverwrite = false,
+                .ptLibipt = false,
+                .ptEdges = false,
+                .ptCfg = NULL,
+                .ptFilterExe = false,
+                .ptFilterDsos = {},
+                .ptFilterDsosCnt = 0,
                 .useClone = true,
+                .triageThreads = 0,
+                .inprocCrash = false,
             },
         /* NetBSD code */
         .netbsd =
@@ -388,9 +593,6 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             },
     };
 
-    TAILQ_INIT(&hfuzz->io.dynfileq);
-    TAILQ_INIT(&hfuzz->mutate.dictq);
-
     // clang-format off
     struct custom_option custom_opts[] = {
         { { "help", no_argument, NULL, 'h' }, "Help plz.." },
@@ -399,12 +601,18 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
         { { "instrument", no_argument, NULL, 'z' }, "*DEFAULT-MODE-BY-DEFAULT* Enable compile-time instrumentation (use hfuzz_cc/hfuzz-clang to compile code)" },
         { { "noinst", no_argument, NULL, 'x' }, "Static mode only, disable any instrumentation (hw/sw) feedback" },
         { { "keep_output", no_argument, NULL, 'Q' }, "Don't close children's stdin, stdout, stderr; can be noisy" },
-        { { "timeout", required_argument, NULL, 't' }, "Timeout in seconds (default: 10)" },
+        { { "timeout", required_argument, NULL, 't' }, "Timeout in seconds, can be a fraction of a second, e.g. 0.05 (default: 10)" },
+        { { "timeout_auto", required_argument, NULL, 0x11D }, "Derive the timeout from the exec times seen so far: this multiple of their 99.9th percentile (e.g. 5), with -t as its upper bound (default: 0, disabled)" },
         { { "threads", required_argument, NULL, 'n' }, "Number of concurrent fuzzing threads (default: number of CPUs / 2)" },
+        { { "threads_auto", required_argument, NULL, 0x122 }, "Scale the number of fuzzing threads between 1 and N (all of them are started, the ones which aren't needed wait), to maximize the total exec/sec. It starts from the number of --threads (default: 0 [disabled])" },
+        { { "async_runs", required_argument, NULL, 0x121 }, "Persistent mode: every fuzzing thread drives this many processes at once, preparing inputs and processing feedback while the others run, for slow or I/O-bound targets (default: 0 - one process per thread). Requires --linux_inprocess_crash (Linux)" },
         { { "stdin_input", no_argument, NULL, 's' }, "Provide fuzzing input on STDIN, instead of ___FILE___" },
+        { { "stdin_pipe", no_argument, NULL, 0x120 }, "With -s: provide the input on STDIN through a pipe filled from the shared input memory with vmsplice(), instead of the input file, for programs which can't read from a file; also with --forkserver. Inputs bigger than the maximal pipe size (/proc/sys/fs/pipe-max-size) are truncated (Linux)" },
         { { "mutations_per_run", required_argument, NULL, 'r' }, "Maximal number of mutations per one run (default: 6)" },
         { { "logfile", required_argument, NULL, 'l' }, "Log file" },
         { { "verbose", no_argument, NULL, 'v' }, "Disable ANSI console; use simple log output" },
+        { { "stats_socket", required_argument, NULL, 0x117 }, "Serve live stats (JSON, and Prometheus at /metrics) over HTTP on this Unix socket, e.g. 'curl --unix-socket <path> http://localhost/metrics'. It also enables histograms of the durations of the fuzzing iteration phases" },
+        { { "phase_timing", required_argument, NULL, 0x118 }, "Keep histograms of the durations of the fuzzing iteration phases (fetch/mangle/send/round-trip/reap/analyze/feedback/report), measured with 'raw' (CLOCK_MONOTONIC_RAW) or 'tsc' (the x86 time-stamp counter), and log them at exit; they're also served by --stats_socket" },
         { { "verifier", no_argument, NULL, 'V' }, "Enable crashes verifier" },
         { { "debug", no_argument, NULL, 'd' }, "Show debug messages (level >= 4)" },
         { { "quiet", no_argument, NULL, 'q' }, "Show only warnings and more serious messages (level <= 1)" },
@@ -413,11 +621,22 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
         { { "crashdir", required_argument, NULL, 0x600 }, "Directory where crashes are saved to (default: workspace directory)" },
         { { "covdir_all", required_argument, NULL, 0x601 }, "Coverage is written to a separate directory (default: input directory)" },
         { { "covdir_new", required_argument, NULL, 0x602 }, "New coverage (beyond the dry-run fuzzing phase) is written to this separate directory" },
+        { { "corpus_pack", required_argument, NULL, 0x603 }, "Packed corpus file (with its '<file>.idx' index), created if it doesn't exist. Its inputs are used alongside the input directory, and coverage is appended to it instead of being written to the covdir_all (unless it's explicitly set)" },
+        { { "checkpoint", required_argument, NULL, 0x604 }, "Save the coverage maps and the dynamic corpus to this file regularly, and at exit. If it exists at startup, the fuzzing resumes from it without the dry run (new files in the input directory are not used then)" },
+        { { "checkpoint_interval", required_argument, NULL, 0x605 }, "Number of seconds between checkpoints (default: 300)" },
+        { { "export_cov", required_argument, NULL, 0x606 }, "Append the newly covered PCs (as module offsets) to this binary log once per second, for live coverage reports. The target must be compiled with -fsanitize-coverage=pc-table (HFUZZ_CC_PC_TABLE=1 for hfuzz-clang)" },
         { { "dict", required_argument, NULL, 'w' }, "Dictionary file. Format:http://llvm.org/docs/LibFuzzer.html#dictionaries" },
-        { { "stackhash_bl", required_argument, NULL, 'B' }, "Stackhashes blacklist file (one entry per line)" },
+        { { "cmplog", no_argument, NULL, 0x113 }, "Log operands of comparisons which didn't match (integer ones, and of the memcmp()/strcmp()-like functions) in instrumented binaries, and use them as an additional dictionary" },
+        { { "custom_mutator", required_argument, NULL, 0x114 }, "Shared library with a libFuzzer-compatible LLVMFuzzerCustomMutator() (and, optionally, LLVMFuzzerCustomCrossOver()), used instead of the internal mutators. It's called in-process by all fuzzing threads, so it must be thread-safe" },
+        { { "seed", required_argument, NULL, 0x115 }, "Seed the random number generators with this value, instead of with /dev/urandom. Every fuzzing thread gets its own, non-overlapping, stream of random values. Mutations are fully reproducible with a single thread (-n 1) only, as threads share the corpus" },
+        { { "node_id", required_argument, NULL, 0x116 }, "Index of this honggfuzz instance among the ones fuzzing the same target with the same --seed, they'll use non-overlapping random streams (default: 0)" },
+        { { "sync_listen", required_argument, NULL, 0x119 }, "Accept connections from other honggfuzz nodes fuzzing the same target on this TCP '[addr:]port', and exchange new corpus entries (with their coverage) with them" },
+        { { "sync_peer", required_argument, NULL, 0x11A }, "Connect to another honggfuzz node's --sync_listen 'host:port' to exchange new corpus entries (with their coverage) with it, can be used multiple times. Inputs whose coverage is already known locally are added to the corpus without being executed" },
+        { { "stackhash_bl", required_argument, NULL, 'B' }, "Stackhashes blacklist file (one entry per line), reloaded when it changes" },
         { { "mutate_cmd", required_argument, NULL, 'c' }, "External command producing fuzz files (instead of internal mutators)" },
         { { "pprocess_cmd", required_argument, NULL, 0x104 }, "External command postprocessing files produced by internal mutators" },
         { { "ffmutate_cmd", required_argument, NULL, 0x110 }, "External command mutating files which have effective coverage feedback" },
+        { { "schedule", required_argument, NULL, 0x10A }, "Dynamic corpus input selection: 'rr' (round-robin), 'weighted' (prefer fast inputs with high coverage yield) (default: 'rr')" },
         { { "run_time", required_argument, NULL, 0x109 }, "Number of seconds this fuzzing session will last (default: 0 [no limit])" },
         { { "iterations", required_argument, NULL, 'N' }, "Number of fuzzing iterations (default: 0 [no limit])" },
         { { "rlimit_as", required_argument, NULL, 0x100 }, "Per process RLIMIT_AS in MiB (default: 0 [no limit])" },
@@ -425,6 +644,7 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
         { { "rlimit_data", required_argument, NULL, 0x102 }, "Per process RLIMIT_DATA in MiB (default: 0 [no limit])" },
         { { "rlimit_core", required_argument, NULL, 0x103 }, "Per process RLIMIT_CORE in MiB (default: 0 [no cores are produced])" },
         { { "report", required_argument, NULL, 'R' }, "Write report to this file (default: '<workdir>/" _HF_REPORT_FILE "')" },
+        { { "report_json", no_argument, NULL, 0x123 }, "Write the reports as JSON lines: one object per crash, with the fields (e.g. \"stack_hash\", \"signal\", \"pc\", \"fuzz_fname\") of the text report and the time (default: '<workdir>/" _HF_REPORT_JSON_FILE "')" },
         { { "max_file_size", required_argument, NULL, 'F' }, "Maximal size of files processed by the fuzzer in bytes (default: 134217728 = 128MB)" },
         { { "clear_env", no_argument, NULL, 0x108 }, "Clear all environment variables before executing the binary" },
         { { "env", required_argument, NULL, 'E' }, "Pass this environment variable, can be used multiple times" },
@@ -434,9 +654,17 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
         { { "monitor_sigabrt", required_argument, NULL, 0x105 }, "Monitor SIGABRT (default: false for Android, true for other platforms)" },
         { { "no_fb_timeout", required_argument, NULL, 0x106 }, "Skip feedback if the process has timeouted (default: false)" },
         { { "exit_upon_crash", no_argument, NULL, 0x107 }, "Exit upon seeing the first crash (default: false)" },
+        { { "minimize", no_argument, NULL, 0x112 }, "Minimize the input corpus: run all inputs (with all threads), and save the smallest and fastest set of them which covers the same features into --covdir_all, then exit" },
+        { { "trim", no_argument, NULL, 0x11E }, "Dedicate one of the fuzzing threads to trimming new corpus entries: remove chunks of them as long as the coverage stays the same (requires at least 2 threads)" },
+        { { "minimize_crash", required_argument, NULL, 0x11F }, "Minimize this crash reproducer: remove chunks (down to single bytes) of it with all threads, as long as it crashes with the same stack hash, save the result as <crashdir>/<name>.minimized, then exit" },
         { { "socket_fuzzer", no_argument, NULL, 0x10B }, "Instrument external fuzzer via socket" },
+        { { "socket_fuzzer_binary", no_argument, NULL, 0x11B }, "Like --socket_fuzzer, but talk to the external fuzzer with the binary framed protocol (see socketfuzzer.h), which batches the events, carries the coverage counters, and lets the fuzzer pipeline its inputs" },
         { { "netdriver", no_argument, NULL, 0x10C }, "Use netdriver (libhfnetdriver/). In most cases it will be autodetected through a binary signature" },
         { { "only_printable", no_argument, NULL, 'o' }, "Only generate printable inputs" },
+        { { "local_cov", no_argument, NULL, 0x10D }, "Record new PCs in a per-process map first, and merge them into the shared feedback map once per iteration (persistent mode)" },
+        { { "snapshot", no_argument, NULL, 0x10F }, "Persistent mode: keep an initialized copy of the persistent process, and fork new processes from it after crashes and timeouts, instead of starting the binary again (Linux)" },
+        { { "persistent_batch", required_argument, NULL, 0x111 }, "Persistent mode: send this many inputs to the fuzzed process at once, for very fast targets (max: 64, default: 0 - one input at a time). Hardware (perf) based feedback is not attributed to separate inputs, and is not used then" },
+        { { "forkserver", no_argument, NULL, 0x10E }, "Fork new processes from a libhfuzz fork-server, which has already been initialized, instead of calling execve() for every input (non-persistent binaries compiled with hfuzz_cc/hfuzz-clang)" },
 
 #if defined(_HF_ARCH_LINUX)
         { { "linux_symbols_bl", required_argument, NULL, 0x504 }, "Symbols blacklist filter file (one entry per line)" },
@@ -447,11 +675,26 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
         { { "linux_perf_instr", no_argument, NULL, 0x510 }, "Use PERF_COUNT_HW_INSTRUCTIONS perf" },
         { { "linux_perf_branch", no_argument, NULL, 0x511 }, "Use PERF_COUNT_HW_BRANCH_INSTRUCTIONS perf" },
         { { "linux_perf_bts_edge", no_argument, NULL, 0x513 }, "Use Intel BTS to count unique edges" },
-        { { "linux_perf_ipt_block", no_argument, NULL, 0x514 }, "Use Intel Processor Trace to count unique blocks (requires libipt.so)" },
+        { { "linux_perf_ipt_block", no_argument, NULL, 0x514 }, "Use Intel Processor Trace to count unique blocks" },
+        { { "linux_perf_ipt_libipt", no_argument, NULL, 0x516 }, "Decode Intel PT with libipt.so instead of the built-in TIP packet scanner (slower, for validation)" },
+        { { "linux_perf_ipt_edge", no_argument, NULL, 0x517 }, "Use Intel Processor Trace to count unique edges, following the trace (TNT and TIP packets) over the code of the binary disassembled at startup (x86-64; PIE binaries require disabled ASLR)" },
+        { { "linux_perf_ipt_filter", no_argument, NULL, 0x51E }, "Make Intel PT trace only the code of the fuzzed binary (with address filters, so the rest of the trace is not even generated)" },
+        { { "linux_perf_ipt_filter_dso", required_argument, NULL, 0x51F }, "Make Intel PT trace only the code of this DSO (and of other ones given with this option, or of the binary with --linux_perf_ipt_filter). The number of the objects is limited by the CPU, see /sys/bus/event_source/devices/intel_pt/caps/num_address_ranges" },
+        { { "linux_perf_aux_size", required_argument, NULL, 0x519 }, "Size (in KiB, a power of 2) of the per-process perf AUX buffer used with Intel BTS and PT (default: 1024)" },
+        { { "linux_perf_aux_overwrite", no_argument, NULL, 0x51A }, "Use the perf AUX buffer in the overwrite mode: keep only the most recent trace data of every run, instead of losing the newest one when the buffer is full" },
+        { { "linux_kcov", no_argument, NULL, 0x51D }, "Use KCOV (/sys/kernel/debug/kcov) to count unique kernel edges. Non-persistent processes are covered from execve(), persistent ones (libhfuzz) only while they process inputs, and only in the thread which fetches them" },
         { { "linux_perf_kernel_only", no_argument, NULL, 0x515 }, "Gather kernel-only coverage with Intel PT and with Intel BTS" },
+        { { "linux_huge_pages", no_argument, NULL, 0x520 }, "Back the shared feedback map with huge pages (hugetlbfs, if enough of them are reserved with vm.nr_hugepages, transparent ones otherwise), and the input buffers with transparent huge pages, to cut the TLB misses of the instrumentation" },
+        { { "linux_cgroup_mem", required_argument, NULL, 0x521 }, "Limit the memory of the processes of each fuzzing thread to N MiB with memory.max of a cgroup v2 leaf of its own, without RLIMIT_AS or *SAN's soft_rss_limit_mb. Processes killed by its OOM killer are saved as 'OOM' crashes (default: 0 [no limit])" },
+        { { "linux_cgroup_cpu", required_argument, NULL, 0x522 }, "cpu.weight (1-10000) of the cgroup v2 leaf of each fuzzing thread's processes (default: not set)" },
+        { { "linux_cgroup_dir", required_argument, NULL, 0x523 }, "Delegated cgroup v2 dir to create the leaves of --linux_cgroup_mem/--linux_cgroup_cpu in (default: the cgroup of honggfuzz, which then moves itself to a leaf of its own)" },
+        { { "linux_pin_cpus", no_argument, NULL, 0x518 }, "Pin every fuzzing thread (and the processes it starts) to its own CPU, from the set honggfuzz was started with (e.g. with taskset). Its buffers are then allocated on that CPU's NUMA node" },
+        { { "linux_triage_threads", required_argument, NULL, 0x51B }, "Number of threads analyzing (symbolizing, deduplicating, saving and reporting) the crashes found by the fuzzing threads, which then only unwind the crashed process and resume fuzzing (default: 0, the fuzzing threads analyze the crashes). Not used with the verifier, the socket fuzzer and --minimize" },
+        { { "linux_inprocess_crash", no_argument, NULL, 0x51C }, "Don't ptrace() persistent processes, they describe their crashes (caught by libhfuzz's signal handlers and the sanitizer's death callback) in shared memory. Non-persistent binaries, and --forkserver, still use ptrace()" },
         { { "linux_ns_net", no_argument, NULL, 0x0530 }, "Use Linux NET namespace isolation" },
         { { "linux_ns_pid", no_argument, NULL, 0x0531 }, "Use Linux PID namespace isolation" },
         { { "linux_ns_ipc", no_argument, NULL, 0x0532 }, "Use Linux IPC namespace isolation" },
+        { { "linux_ns_fresh", no_argument, NULL, 0x0533 }, "Let every process of a netdriver target create its own namespaces, instead of joining ones which are created once per fuzzing thread, and reused by its processes" },
 #endif // defined(_HF_ARCH_LINUX)
 
 #if defined(_HF_ARCH_NETBSD)
@@ -483,9 +726,6 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
                 break;
             case 'f':
                 hfuzz->io.inputDir = optarg;
-                if (hfuzz->io.covDirAll == NULL) {
-                    hfuzz->io.covDirAll = optarg;
-                }
                 break;
             case 'x':
                 hfuzz->feedback.dynFileMethod = _HF_DYNFILE_NONE;
@@ -529,6 +769,22 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             case 0x602:
                 hfuzz->io.covDirNew = optarg;
                 break;
+            case 0x603:
+                hfuzz->io.corpusPack = optarg;
+                break;
+            case 0x604:
+                hfuzz->checkpoint.path = optarg;
+                break;
+            case 0x606:
+                hfuzz->feedback.covExportFile = optarg;
+                break;
+            case 0x605:
+                hfuzz->checkpoint.interval = (time_t)strtol(optarg, NULL, 0);
+                if (hfuzz->checkpoint.interval <= 0) {
+                    LOG_E("Invalid --checkpoint_interval value: '%s'", optarg);
+                    return false;
+                }
+                break;
             case 'r':
                 hfuzz->mutate.mutationsPerRun = strtoul(optarg, NULL, 10);
                 break;
@@ -538,13 +794,40 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             case 'S':
                 hfuzz->sanitizer.enable = true;
                 break;
+            case 0x10A:
+                if (strcasecmp(optarg, "rr") == 0) {
+                    hfuzz->io.dynfileqSched = _HF_SCHED_RR;
+                } else if (strcasecmp(optarg, "weighted") == 0) {
+                    hfuzz->io.dynfileqSched = _HF_SCHED_WEIGHTED;
+                } else {
+                    LOG_E("Unknown --schedule value: '%s' (use 'rr' or 'weighted')", optarg);
+                    return false;
+                }
+                break;
             case 0x10B:
                 hfuzz->socketFuzzer.enabled = true;
-                hfuzz->timing.tmOut = 0;  // Disable process timeout checks
+                hfuzz->timing.tmOutMillis = 0;  // Disable process timeout checks
+                break;
+            case 0x11B:
+                hfuzz->socketFuzzer.enabled = true;
+                hfuzz->socketFuzzer.binary = true;
+                hfuzz->timing.tmOutMillis = 0;
                 break;
             case 0x10C:
                 hfuzz->exe.netDriver = true;
                 break;
+            case 0x10D:
+                hfuzz->feedback.localCov = true;
+                break;
+            case 0x10E:
+                hfuzz->exe.forkServer = true;
+                break;
+            case 0x10F:
+                hfuzz->exe.snapshot = true;
+                break;
+            case 0x111:
+                hfuzz->exe.persistentBatch = strtoul(optarg, NULL, 0);
+                break;
             case 'o':
                 hfuzz->cfg.only_printable = true;
                 break;
@@ -554,12 +837,18 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             case 'F':
                 hfuzz->mutate.maxFileSz = strtoul(optarg, NULL, 0);
                 break;
+            case 0x11D:
+                hfuzz->timing.tmOutAutoMul = strtoul(optarg, NULL, 0);
+                break;
             case 't':
-                hfuzz->timing.tmOut = atol(optarg);
+                hfuzz->timing.tmOutMillis = (int64_t)(strtod(optarg, NULL) * 1000.0);
                 break;
             case 'R':
                 hfuzz->cfg.reportFile = optarg;
                 break;
+            case 0x123:
+                hfuzz->cfg.reportJson = true;
+                break;
             case 'n':
                 if (optarg[0] == 'a') {
                     long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
@@ -608,6 +897,60 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             case 0x107:
                 hfuzz->cfg.exitUponCrash = true;
                 break;
+            case 0x112:
+                hfuzz->cfg.minimize = true;
+                break;
+            case 0x11E:
+                hfuzz->cfg.trim = true;
+                break;
+            case 0x11F:
+                hfuzz->cfg.minimizeCrash = optarg;
+                break;
+            case 0x120:
+                hfuzz->exe.stdinPipe = true;
+                break;
+            case 0x121:
+                hfuzz->threads.asyncRuns = strtoul(optarg, NULL, 0);
+                break;
+            case 0x122:
+                hfuzz->threads.threadsAutoMax = strtoul(optarg, NULL, 0);
+                break;
+            case 0x113:
+                hfuzz->mutate.cmpLog = true;
+                break;
+            case 0x114:
+                hfuzz->mutate.custom.lib = optarg;
+                break;
+            case 0x115:
+                hfuzz->cfg.seedSet = true;
+                hfuzz->cfg.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 0x116:
+                hfuzz->cfg.nodeId = strtoull(optarg, NULL, 0);
+                break;
+            case 0x117:
+                hfuzz->display.statsSocket = optarg;
+                break;
+            case 0x119:
+                hfuzz->sync.listen = optarg;
+                break;
+            case 0x11A:
+                if (hfuzz->sync.peersCnt >= ARRAYSIZE(hfuzz->sync.peers)) {
+                    LOG_E("Too many --sync_peer nodes (max: %zu)", ARRAYSIZE(hfuzz->sync.peers));
+                    return false;
+                }
+                hfuzz->sync.peers[hfuzz->sync.peersCnt++] = optarg;
+                break;
+            case 0x118:
+                if (strcasecmp(optarg, "raw") == 0) {
+                    hfuzz->display.phaseClock = _HF_PHASE_CLOCK_MONOTONIC_RAW;
+                } else if (strcasecmp(optarg, "tsc") == 0) {
+                    hfuzz->display.phaseClock = _HF_PHASE_CLOCK_TSC;
+                } else {
+                    LOG_E("Unknown --phase_timing value: '%s' (use 'raw' or 'tsc')", optarg);
+                    return false;
+                }
+                break;
             case 0x108:
                 hfuzz->exe.clearEnv = true;
                 break;
@@ -659,6 +1002,63 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             case 0x515:
                 hfuzz->linux.kernelOnly = true;
                 break;
+            case 0x516:
+#if !defined(_HF_LINUX_INTEL_PT_LIB)
+                LOG_E("--linux_perf_ipt_libipt: honggfuzz was built without libipt.so");
+                return false;
+#endif /* !defined(_HF_LINUX_INTEL_PT_LIB) */
+                hfuzz->linux.ptLibipt = true;
+                break;
+            case 0x517:
+                hfuzz->feedback.dynFileMethod |= _HF_DYNFILE_IPT_BLOCK;
+                hfuzz->linux.ptEdges = true;
+                break;
+            case 0x518:
+                hfuzz->linux.pinCpus = true;
+                break;
+            case 0x519:
+                hfuzz->linux.perfAuxSz = (size_t)strtoul(optarg, NULL, 0) * 1024;
+                break;
+            case 0x51A:
+                hfuzz->linux.perfAuxOverwrite = true;
+                break;
+            case 0x51B:
+                hfuzz->linux.triageThreads = (size_t)strtoul(optarg, NULL, 0);
+                break;
+            case 0x51C:
+                hfuzz->linux.inprocCrash = true;
+                break;
+            case 0x51D:
+                hfuzz->feedback.dynFileMethod |= _HF_DYNFILE_KCOV;
+                break;
+            case 0x520:
+                hfuzz->feedback.hugePages = true;
+                break;
+            case 0x521:
+                hfuzz->linux.cgroupMem = strtoull(optarg, NULL, 0);
+                break;
+            case 0x522:
+                hfuzz->linux.cgroupCpu = strtoull(optarg, NULL, 0);
+                if (hfuzz->linux.cgroupCpu < 1 || hfuzz->linux.cgroupCpu > 10000) {
+                    LOG_E("--linux_cgroup_cpu must be in the 1-10000 range ('%s' provided)",
+                        optarg);
+                    return false;
+                }
+                break;
+            case 0x523:
+                hfuzz->linux.cgroupDir = optarg;
+                break;
+            case 0x51E:
+                hfuzz->linux.ptFilterExe = true;
+                break;
+            case 0x51F:
+                if (hfuzz->linux.ptFilterDsosCnt >= ARRAYSIZE(hfuzz->linux.ptFilterDsos)) {
+                    LOG_E("Too many --linux_perf_ipt_filter_dso objects (max: %zu)",
+                        ARRAYSIZE(hfuzz->linux.ptFilterDsos));
+                    return false;
+                }
+                hfuzz->linux.ptFilterDsos[hfuzz->linux.ptFilterDsosCnt++] = optarg;
+                break;
             case 0x530:
                 hfuzz->linux.cloneFlags |= (CLONE_NEWUSER | CLONE_NEWNET);
                 break;
@@ -668,6 +1068,9 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
             case 0x532:
                 hfuzz->linux.cloneFlags |= (CLONE_NEWUSER | CLONE_NEWIPC);
                 break;
+            case 0x533:
+                hfuzz->linux.nsFresh = true;
+                break;
 #endif /* defined(_HF_ARCH_LINUX) */
 #if defined(_HF_ARCH_NETBSD)
             case 0x500:
@@ -711,10 +1114,10 @@ bool cmdlineParse(int argc, char* argv[], honggfuzz_t* hfuzz) {
     sigaddset(&hfuzz->exe.waitSigSet, SIGCHLD); /* Ping from the signal thread */
 
     LOG_I("cmdline:'%s', bin:'%s' inputDir:'%s', fuzzStdin:%s, mutationsPerRun:%u, "
-          "externalCommand:'%s', timeout:%ld, mutationsMax:%zu, threadsMax:%zu",
+          "externalCommand:'%s', timeout:%" PRId64 "ms, mutationsMax:%zu, threadsMax:%zu",
         hfuzz->display.cmdline_txt, hfuzz->exe.cmdline[0], hfuzz->io.inputDir,
         cmdlineYesNo(hfuzz->exe.fuzzStdin), hfuzz->mutate.mutationsPerRun,
-        !hfuzz->exe.externalCommand ? "" : hfuzz->exe.externalCommand, (long)hfuzz->timing.tmOut,
+        !hfuzz->exe.externalCommand ? "" : hfuzz->exe.externalCommand, hfuzz->timing.tmOutMillis,
         hfuzz->mutate.mutationsMax, hfuzz->threads.threadsMax);
 
     return true;
@@ -0,0 +1,304 @@
+/*
+ *
+ * honggfuzz - packed corpus files
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "corpus.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+static struct {
+    int dataFd;
+    int idxFd;
+    /* The mapping of both files, as they were when opened */
+    uint8_t* data;
+    size_t dataSz;
+    corpusIdxEntry_t* idx;
+    size_t idxMapSz;
+    size_t cnt;
+    /* Where the next input will be appended */
+    uint64_t dataEnd;
+    /* Open-addressing set of (mixed) CRCs of all inputs, for deduplication of appended ones */
+    uint64_t* hashes;
+    size_t hashesCapacity;
+    size_t hashesCnt;
+} corpus = {
+    .dataFd = -1,
+    .idxFd = -1,
+    .data = NULL,
+    .dataSz = 0,
+    .idx = NULL,
+    .idxMapSz = 0,
+    .cnt = 0,
+    .dataEnd = 0,
+    .hashes = NULL,
+    .hashesCapacity = 0,
+    .hashesCnt = 0,
+};
+
+static uint64_t corpus_hashKey(uint64_t crc64f, uint64_t crc64r) {
+    /* Both CRCs are the same for palindromes, so they're not simply XOR-ed */
+    uint64_t key = crc64f ^ (crc64r * 0x9E3779B97F4A7C15ULL);
+    /* 0 marks empty slots */
+    return key ? key : 1ULL;
+}
+
+static bool corpus_hashInsert(uint64_t key) {
+    if (((corpus.hashesCnt + 1) * 2) > corpus.hashesCapacity) {
+        size_t oldCapacity = corpus.hashesCapacity;
+        uint64_t* oldHashes = corpus.hashes;
+        corpus.hashesCapacity = oldCapacity ? (oldCapacity * 2) : 1024;
+        corpus.hashes = util_Calloc(corpus.hashesCapacity * sizeof(uint64_t));
+        corpus.hashesCnt = 0;
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldHashes[i] != 0) {
+                corpus_hashInsert(oldHashes[i]);
+            }
+        }
+        free(oldHashes);
+    }
+
+    size_t mask = corpus.hashesCapacity - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+        if (corpus.hashes[i] == key) {
+            return false;
+        }
+        if (corpus.hashes[i] == 0) {
+            corpus.hashes[i] = key;
+            corpus.hashesCnt++;
+            return true;
+        }
+    }
+}
+
+static bool corpus_hashContains(uint64_t key) {
+    if (corpus.hashesCapacity == 0) {
+        return false;
+    }
+    size_t mask = corpus.hashesCapacity - 1;
+    for (size_t i = key & mask; corpus.hashes[i] != 0; i = (i + 1) & mask) {
+        if (corpus.hashes[i] == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Writes the header into a new (empty) file, or checks it in an existing one */
+static bool corpus_checkHdr(int fd, const char* fname, off_t* fileSz) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        PLOG_W("fstat('%s')", fname);
+        return false;
+    }
+
+    corpusHdr_t hdr;
+    if (st.st_size == 0) {
+        memset(&hdr, '\0', sizeof(hdr));
+        memcpy(hdr.magic, _HF_CORPUS_MAGIC, sizeof(hdr.magic));
+        hdr.version = _HF_CORPUS_VERSION;
+        if (!files_writeToFd(fd, (const uint8_t*)&hdr, sizeof(hdr))) {
+            LOG_W("Couldn't write the header to '%s'", fname);
+            return false;
+        }
+        *fileSz = (off_t)sizeof(hdr);
+        return true;
+    }
+
+    if (files_readFromFdSeek(fd, (uint8_t*)&hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        memcmp(hdr.magic, _HF_CORPUS_MAGIC, sizeof(hdr.magic)) != 0) {
+        LOG_W("'%s' is not a packed corpus file", fname);
+        return false;
+    }
+    if (hdr.version != _HF_CORPUS_VERSION) {
+        LOG_W("'%s' has an unsupported version of the packed corpus format: %" PRIu32, fname,
+            hdr.version);
+        return false;
+    }
+    *fileSz = st.st_size;
+    return true;
+}
+
+static void* corpus_map(int fd, size_t sz, const char* fname) {
+    void* ret = mmap(NULL, sz, PROT_READ, MAP_SHARED, fd, 0);
+    if (ret == MAP_FAILED) {
+        PLOG_W("mmap('%s', sz=%zu)", fname, sz);
+        return NULL;
+    }
+    return ret;
+}
+
+bool corpus_open(const char* path) {
+    char idxPath[PATH_MAX];
+    snprintf(idxPath, sizeof(idxPath), "%s%s", path, _HF_CORPUS_IDX_EXTN);
+
+    corpus.dataFd =
+        TEMP_FAILURE_RETRY(open(path, O_CREAT | O_RDWR | O_APPEND | O_CLOEXEC, 0644));
+    if (corpus.dataFd == -1) {
+        PLOG_W("Couldn't open '%s'", path);
+        return false;
+    }
+    /* Offsets of appended inputs are tracked in-process, so there can be only one writer */
+    if (flock(corpus.dataFd, LOCK_EX | LOCK_NB) == -1) {
+        PLOG_W("Couldn't lock '%s', is it used by another honggfuzz instance?", path);
+        return false;
+    }
+    corpus.idxFd =
+        TEMP_FAILURE_RETRY(open(idxPath, O_CREAT | O_RDWR | O_APPEND | O_CLOEXEC, 0644));
+    if (corpus.idxFd == -1) {
+        PLOG_W("Couldn't open '%s'", idxPath);
+        return false;
+    }
+
+    off_t dataSz, idxSz;
+    if (!corpus_checkHdr(corpus.dataFd, path, &dataSz) ||
+        !corpus_checkHdr(corpus.idxFd, idxPath, &idxSz)) {
+        return false;
+    }
+
+    corpus.dataSz = (size_t)dataSz;
+    corpus.dataEnd = (uint64_t)dataSz;
+    if (!(corpus.data = corpus_map(corpus.dataFd, corpus.dataSz, path))) {
+        return false;
+    }
+    corpus.idxMapSz = (size_t)idxSz;
+    uint8_t* idxMap = corpus_map(corpus.idxFd, corpus.idxMapSz, idxPath);
+    if (!idxMap) {
+        return false;
+    }
+    corpus.idx = (corpusIdxEntry_t*)&idxMap[sizeof(corpusHdr_t)];
+
+    /*
+     * Inputs are appended before their index entries, so a torn append can only leave a partial
+     * (or pointing past the data) entry at the end of the index. It's cut off here
+     */
+    size_t maxCnt = (corpus.idxMapSz - sizeof(corpusHdr_t)) / sizeof(corpusIdxEntry_t);
+    for (corpus.cnt = 0; corpus.cnt < maxCnt; corpus.cnt++) {
+        const corpusIdxEntry_t* e = &corpus.idx[corpus.cnt];
+        if (e->off < sizeof(corpusHdr_t) || e->off > corpus.dataSz ||
+            e->len > (corpus.dataSz - e->off)) {
+            break;
+        }
+        corpus_hashInsert(corpus_hashKey(e->crc64f, e->crc64r));
+    }
+    size_t validSz = sizeof(corpusHdr_t) + corpus.cnt * sizeof(corpusIdxEntry_t);
+    if (validSz != corpus.idxMapSz) {
+        LOG_W("Cutting off %zu bytes of the incomplete index of '%s'", corpus.idxMapSz - validSz,
+            path);
+        if (ftruncate(corpus.idxFd, (off_t)validSz) == -1) {
+            PLOG_W("ftruncate('%s', %zu)", idxPath, validSz);
+            return false;
+        }
+    }
+
+    LOG_I("Opened the packed corpus '%s': %zu inputs, %zu bytes", path, corpus.cnt, corpus.dataSz);
+    return true;
+}
+
+void corpus_close(void) {
+    if (corpus.data) {
+        munmap(corpus.data, corpus.dataSz);
+        corpus.data = NULL;
+    }
+    if (corpus.idx) {
+        munmap((uint8_t*)corpus.idx - sizeof(corpusHdr_t), corpus.idxMapSz);
+        corpus.idx = NULL;
+    }
+    if (corpus.dataFd != -1) {
+        close(corpus.dataFd);
+        corpus.dataFd = -1;
+    }
+    if (corpus.idxFd != -1) {
+        close(corpus.idxFd);
+        corpus.idxFd = -1;
+    }
+    free(corpus.hashes);
+    corpus.hashes = NULL;
+    corpus.hashesCapacity = 0;
+    corpus.hashesCnt = 0;
+    corpus.cnt = 0;
+}
+
+size_t corpus_cnt(void) {
+    return corpus.cnt;
+}
+
+const uint8_t* corpus_get(size_t idx, size_t* len) {
+    if (idx >= corpus.cnt) {
+        return NULL;
+    }
+    *len = corpus.idx[idx].len;
+    return &corpus.data[corpus.idx[idx].off];
+}
+
+bool corpus_append(const uint8_t* data, size_t len, uint64_t crc64f, uint64_t crc64r) {
+    if (corpus.dataFd == -1) {
+        return false;
+    }
+    if (len > UINT32_MAX) {
+        LOG_W("Input of size %zu is too big for the packed corpus", len);
+        return false;
+    }
+    /* It's inserted once the input is appended, so a failed append can be retried */
+    uint64_t key = corpus_hashKey(crc64f, crc64r);
+    if (corpus_hashContains(key)) {
+        LOG_D("Input (len=%zu) is already in the packed corpus", len);
+        return true;
+    }
+
+    corpusIdxEntry_t e = {
+        .off = corpus.dataEnd,
+        .crc64f = crc64f,
+        .crc64r = crc64r,
+        .len = (uint32_t)len,
+        .reserved = 0,
+    };
+    if (!files_writeToFd(corpus.dataFd, data, len)) {
+        LOG_W("Couldn't append %zu bytes to the packed corpus", len);
+        /* A part of it might have been written */
+        off_t end = lseek(corpus.dataFd, 0, SEEK_END);
+        if (end != (off_t)-1) {
+            corpus.dataEnd = (uint64_t)end;
+        }
+        return false;
+    }
+    corpus.dataEnd += len;
+    if (!files_writeToFd(corpus.idxFd, (const uint8_t*)&e, sizeof(e))) {
+        LOG_W("Couldn't append the index entry to the packed corpus");
+        return false;
+    }
+    corpus_hashInsert(key);
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+ *
+ * honggfuzz - packed corpus files
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_CORPUS_H_
+#define _HF_CORPUS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A packed corpus is an append-only pair of files: '<path>' holds the inputs one after another,
+ * '<path>.idx' describes them with an array of corpusIdxEntry_t. Both start with a corpusHdr_t
+ */
+#define _HF_CORPUS_MAGIC "HFCORPUS"
+#define _HF_CORPUS_VERSION 1U
+#define _HF_CORPUS_IDX_EXTN ".idx"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} corpusHdr_t;
+
+typedef struct {
+    /* Offset of the input in '<path>' */
+    uint64_t off;
+    uint64_t crc64f;
+    uint64_t crc64r;
+    uint32_t len;
+    uint32_t reserved;
+} corpusIdxEntry_t;
+
+/* Opens (or creates) the packed corpus, and maps its current contents */
+extern bool corpus_open(const char* path);
+extern void corpus_close(void);
+/* Number of inputs which were in the packed corpus when it was opened */
+extern size_t corpus_cnt(void);
+/* Zero-copy access to the mapped input no. 'idx' */
+extern const uint8_t* corpus_get(size_t idx, size_t* len);
+/* Appends the input to the packed corpus, unless it's already there. Not thread-safe */
+extern bool corpus_append(const uint8_t* data, size_t len, uint64_t crc64f, uint64_t crc64r);
+
+#endif /* ifndef _HF_CORPUS_H_ */
@@ -0,0 +1,226 @@
+/*
+ *
+ * honggfuzz - live export of the coverage (--export_cov)
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "covexport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+/* The records of one export, written with a single write() */
+typedef struct {
+    uint8_t* buf;
+    size_t sz;
+    size_t off;
+    /* Offset of the COVEXPORT_REC_PCS record which is being filled, or SIZE_MAX */
+    size_t pcsRec;
+} covExportBuf_t;
+
+static struct {
+    int fd;
+    /* What's been exported already: by the guard number, and by the counter index */
+    uint8_t* guardsDone;
+    uint8_t* cntsDone;
+    bool modulesDone[_HF_COV_MODULES_MAX];
+    uint64_t pcsCnt;
+    time_t lastExport;
+} covexp = {
+    .fd = -1,
+    .guardsDone = NULL,
+    .cntsDone = NULL,
+    .pcsCnt = 0,
+    .lastExport = 0,
+};
+
+bool covexport_init(honggfuzz_t* hfuzz) {
+    if (!hfuzz->feedback.covExportFile) {
+        return true;
+    }
+    if (!(hfuzz->feedback.covPcs = files_mapSharedMemSparse(
+              sizeof(covPcs_t), &hfuzz->feedback.covPcsFd, "hfuzz-covpcs"))) {
+        LOG_E("files_mapSharedMemSparse(sz=%zu) failed", sizeof(covPcs_t));
+        return false;
+    }
+    hfuzz->feedback.covPcs->magic = _HF_COV_PCS_MAGIC;
+
+    covexp.fd = TEMP_FAILURE_RETRY(open(hfuzz->feedback.covExportFile,
+        O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644));
+    if (covexp.fd == -1) {
+        PLOG_E("Couldn't open('%s') for writing", hfuzz->feedback.covExportFile);
+        return false;
+    }
+    struct stat st;
+    if (fstat(covexp.fd, &st) == -1) {
+        PLOG_E("fstat('%s')", hfuzz->feedback.covExportFile);
+        return false;
+    }
+    if (st.st_size == 0 && !files_writeToFd(covexp.fd, (const uint8_t*)_HF_COVEXPORT_MAGIC,
+                               strlen(_HF_COVEXPORT_MAGIC))) {
+        LOG_E("Couldn't write to '%s'", hfuzz->feedback.covExportFile);
+        return false;
+    }
+
+    /* Only the pages for the first guardNb bits get touched */
+    covexp.guardsDone = util_Calloc(_HF_PC_GUARD_MAX / 8);
+    covexp.cntsDone = util_Calloc(_HF_PC_CNT_MAX / 8);
+
+    LOG_I("Newly covered PCs will be appended to '%s'", hfuzz->feedback.covExportFile);
+    return true;
+}
+
+static void covexport_put(covExportBuf_t* b, const void* data, size_t len) {
+    if (b->off + len > b->sz) {
+        b->sz = MAX(b->sz * 2, b->off + len);
+        b->buf = util_Realloc(b->buf, b->sz);
+    }
+    memcpy(&b->buf[b->off], data, len);
+    b->off += len;
+}
+
+static void covexport_closePcsRec(covExportBuf_t* b) {
+    if (b->pcsRec == SIZE_MAX) {
+        return;
+    }
+    covExportRec_t rec = {
+        .type = COVEXPORT_REC_PCS,
+        .len = (uint32_t)(b->off - b->pcsRec - sizeof(rec)),
+    };
+    memcpy(&b->buf[b->pcsRec], &rec, sizeof(rec));
+    b->pcsRec = SIZE_MAX;
+}
+
+/* Describes the module first, if it's not been described yet. False if it's not registered yet */
+static bool covexport_module(covExportBuf_t* b, covPcs_t* covPcs, uint32_t id) {
+    if (id == 0 || id > _HF_COV_MODULES_MAX) {
+        return false;
+    }
+    if (covexp.modulesDone[id - 1]) {
+        return true;
+    }
+    covModule_t* m = &covPcs->modules[id - 1];
+    if (ATOMIC_GET_ACQUIRE(m->ready) == 0) {
+        return false;
+    }
+    covexport_closePcsRec(b);
+
+    size_t len = strnlen(m->path, sizeof(m->path));
+    covExportRec_t rec = {
+        .type = COVEXPORT_REC_MODULE,
+        .len = (uint32_t)(sizeof(id) + len),
+    };
+    covexport_put(b, &rec, sizeof(rec));
+    covexport_put(b, &id, sizeof(id));
+    covexport_put(b, m->path, len);
+    covexp.modulesDone[id - 1] = true;
+    return true;
+}
+
+/* False if the PC of this guard/counter isn't known (yet), it'll be retried with the next export */
+static bool covexport_pc(covExportBuf_t* b, covPcs_t* covPcs, time_t now, uint64_t entry) {
+    if (entry == 0 || !covexport_module(b, covPcs, (uint32_t)(entry >> _HF_COV_PC_MOD_SHIFT))) {
+        return false;
+    }
+    if (b->pcsRec == SIZE_MAX) {
+        b->pcsRec = b->off;
+        covExportRec_t rec = {.type = COVEXPORT_REC_PCS, .len = 0};
+        covexport_put(b, &rec, sizeof(rec));
+        uint64_t tm = (uint64_t)now;
+        covexport_put(b, &tm, sizeof(tm));
+    }
+    covexport_put(b, &entry, sizeof(entry));
+    covexp.pcsCnt++;
+    return true;
+}
+
+static void covexport_export(honggfuzz_t* hfuzz) {
+    feedback_t* fb = hfuzz->feedback.feedbackMap;
+    covPcs_t* covPcs = hfuzz->feedback.covPcs;
+    time_t now = time(NULL);
+    covExportBuf_t b = {.buf = NULL, .sz = 0, .off = 0, .pcsRec = SIZE_MAX};
+    defer {
+        free(b.buf);
+    };
+
+    /* Both, the number of the guards and of the counters, end up in guardNb */
+    uint64_t guardNb = ATOMIC_GET(fb->guardNb);
+
+    size_t guardBytes = MIN((guardNb / 8) + 1, ATOMIC_GET(fb->pcGuardMapLen));
+    for (size_t i = 0; i < guardBytes; i++) {
+        uint8_t fresh = ATOMIC_GET(fb->pcGuardMap[i]) & ~covexp.guardsDone[i];
+        for (; fresh; fresh &= (uint8_t)(fresh - 1)) {
+            unsigned bit = __builtin_ctz(fresh);
+            if (covexport_pc(&b, covPcs, now, ATOMIC_GET(covPcs->guardPcs[i * 8 + bit]))) {
+                covexp.guardsDone[i] |= (uint8_t)(1U << bit);
+            }
+        }
+    }
+
+    size_t cnts = MIN(guardNb, _HF_PC_CNT_MAX);
+    for (size_t i = 0; i < cnts; i++) {
+        if (ATOMIC_GET(fb->pcCntMap[i]) == 0 || (covexp.cntsDone[i / 8] & (1U << (i % 8)))) {
+            continue;
+        }
+        if (covexport_pc(&b, covPcs, now, ATOMIC_GET(covPcs->cntPcs[i]))) {
+            covexp.cntsDone[i / 8] |= (uint8_t)(1U << (i % 8));
+        }
+    }
+
+    covexport_closePcsRec(&b);
+    if (b.off && !files_writeToFd(covexp.fd, b.buf, b.off)) {
+        PLOG_W("Couldn't append %zu bytes to '%s'", b.off, hfuzz->feedback.covExportFile);
+    }
+}
+
+void covexport_periodic(honggfuzz_t* hfuzz) {
+    if (covexp.fd == -1) {
+        return;
+    }
+    time_t now = time(NULL);
+    if ((now - covexp.lastExport) < _HF_COVEXPORT_SECS) {
+        return;
+    }
+    covexp.lastExport = now;
+    covexport_export(hfuzz);
+}
+
+void covexport_close(honggfuzz_t* hfuzz) {
+    if (covexp.fd == -1) {
+        return;
+    }
+    covexport_export(hfuzz);
+    LOG_I("Exported %" PRIu64 " covered PCs to '%s'", covexp.pcsCnt, hfuzz->feedback.covExportFile);
+    close(covexp.fd);
+    covexp.fd = -1;
+    free(covexp.guardsDone);
+    free(covexp.cntsDone);
+}
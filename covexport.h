@@ -0,0 +1,67 @@
+/*
+ *
+ * honggfuzz - live export of the coverage (--export_cov)
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_COVEXPORT_H_
+#define _HF_COVEXPORT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "honggfuzz.h"
+
+/*
+ * The --export_cov file is an append-only log of the PCs covered so far, as they get covered. The
+ * instrumented processes register the PCs of their guards/counters in covPcs_t, and the main thread
+ * writes the newly covered ones every _HF_COVEXPORT_SECS:
+ *
+ *   _HF_COVEXPORT_MAGIC (only if the file is empty)
+ *   records: covExportRec_t, followed by 'len' bytes
+ *     COVEXPORT_REC_MODULE: uint32_t id, and the path of the module (not NUL-terminated)
+ *     COVEXPORT_REC_PCS: uint64_t unix time, and uint64_t entries of the PCs covered by then:
+ *       the module id (bits 48-63), the offset into it (bits 1-47), the function entry flag (bit 0)
+ *
+ * A module is described before its first PC, in every session appending to the file (the ids are
+ * valid until the next COVEXPORT_REC_MODULE with the same id). All the fields use the host byte
+ * order
+ */
+#define _HF_COVEXPORT_MAGIC "HFCOVLOG"
+#define _HF_COVEXPORT_SECS 1
+
+typedef enum {
+    COVEXPORT_REC_MODULE = 1,
+    COVEXPORT_REC_PCS = 2,
+} covExportRecType_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t len;
+} covExportRec_t;
+
+/* Maps the PC tables (covPcs_t) shared with the fuzzed processes, and opens the log */
+extern bool covexport_init(honggfuzz_t* hfuzz);
+
+/* Called by the main thread, exports the new coverage every _HF_COVEXPORT_SECS */
+extern void covexport_periodic(honggfuzz_t* hfuzz);
+
+/* Exports what was covered since the last export, and closes the log */
+extern void covexport_close(honggfuzz_t* hfuzz);
+
+#endif /* ifndef _HF_COVEXPORT_H_ */
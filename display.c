@@ -21,8 +21,6 @@
  *
  */
 
-#define _WITH_DPRINTF
-
 #include "display.h"
 
 #include <inttypes.h>
@@ -33,7 +31,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "input.h"
 #include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
 
@@ -55,13 +55,75 @@
 /* printf() nonmonetary separator. According to MacOSX's man it's supported there as well */
 #define _HF_NONMON_SEP "'"
 
+/* Number of the lines above the scroll region of the logs */
+#define _HF_DISPLAY_LINES 12
+/* Without a terminal, only a summary is logged that often */
+#define _HF_DISPLAY_NOTTY_SECS 60
+
+/*
+ * The lines are put into a frame first, and only the ones which differ from what's on the screen
+ * already are redrawn, with a single write()
+ */
+static struct {
+    char buf[1024 * 16];
+    char lines[_HF_DISPLAY_LINES][1024];
+    /* If false, the next frame is drawn in full, e.g. after display_clear() */
+    bool drawn;
+} displayFrame = {
+    .buf = {},
+    .drawn = false,
+};
+
 __attribute__((format(printf, 1, 2))) static void display_put(const char* fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    vdprintf(logFd(), fmt, args);
+    util_vssnprintf(displayFrame.buf, sizeof(displayFrame.buf), fmt, args);
     va_end(args);
 }
 
+/* Escape sequences which go to the terminal directly */
+static void display_write(const char* str) {
+    if (!files_writeToFd(logFd(), (const uint8_t*)str, strlen(str))) {
+        PLOG_D("Couldn't write the display escape sequences");
+    }
+}
+
+static void display_flush(void) {
+    static char out[sizeof(displayFrame.buf) * 2];
+    out[0] = '\0';
+
+    /* The cursor stays where the logs are written, unless the scroll region has to be set again */
+    util_ssnprintf(out, sizeof(out), "%s", displayFrame.drawn ? "\0337" : "");
+    bool changed = false;
+    char* line = displayFrame.buf;
+    for (size_t i = 0; i < _HF_DISPLAY_LINES; i++) {
+        char* nl = line ? strchr(line, '\n') : NULL;
+        if (nl) {
+            *nl = '\0';
+        }
+        const char* cur = line ? line : "";
+        if (!displayFrame.drawn || strcmp(cur, displayFrame.lines[i]) != 0) {
+            util_ssnprintf(out, sizeof(out), "\033[%zu;1H" ESC_CLEAR_LINE "%s", i + 1, cur);
+            snprintf(displayFrame.lines[i], sizeof(displayFrame.lines[i]), "%s", cur);
+            changed = true;
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+    displayFrame.buf[0] = '\0';
+
+    if (!changed) {
+        return;
+    }
+    if (displayFrame.drawn) {
+        util_ssnprintf(out, sizeof(out), "\0338");
+    } else {
+        util_ssnprintf(out, sizeof(out),
+            ESC_SCROLL_REGION(13, ) ESC_NAV_HORIZ(1) ESC_NAV_DOWN(500));
+        displayFrame.drawn = true;
+    }
+    display_write(out);
+}
+
 static void display_printKMG(uint64_t val) {
     if (val >= 1000000000000ULL) {
         display_put(" [%.02LfT]", (long double)val / 1000000000.0L);
@@ -74,44 +136,6 @@ static void display_printKMG(uint64_t val) {
     }
 }
 
-static unsigned getCpuUse(int numCpus) {
-    static uint64_t prevUserT = 0UL;
-    static uint64_t prevNiceT = 0UL;
-    static uint64_t prevSystemT = 0UL;
-    static uint64_t prevIdleT = 0UL;
-
-    FILE* f = fopen("/proc/stat", "re");
-    if (f == NULL) {
-        return 0;
-    }
-    defer {
-        fclose(f);
-    };
-    uint64_t userT, niceT, systemT, idleT;
-    if (fscanf(f, "cpu  %" PRIu64 "%" PRIu64 "%" PRIu64 "%" PRIu64, &userT, &niceT, &systemT,
-            &idleT) != 4) {
-        LOG_W("fscanf('/proc/stat') != 4");
-        return 0;
-    }
-
-    uint64_t userCycles = (userT - prevUserT);
-    uint64_t niceCycles = (niceT - prevNiceT);
-    uint64_t systemCycles = (systemT - prevSystemT);
-    uint64_t idleCycles = (idleT - prevIdleT);
-
-    prevUserT = userT;
-    prevNiceT = niceT;
-    prevSystemT = systemT;
-    prevIdleT = idleT;
-
-    uint64_t allCycles = userCycles + niceCycles + systemCycles + idleCycles;
-    if (allCycles == 0) {
-        return 0;
-    }
-
-    return ((userCycles + niceCycles + systemCycles) * numCpus * 100) / (allCycles);
-}
-
 static void getDuration(time_t elapsed_second, char* buf, size_t bufSz) {
     if (elapsed_second < 0) {
         snprintf(buf, bufSz, "----");
@@ -163,7 +187,6 @@ static void display_displayLocked(honggfuzz_t* hfuzz) {
         elapsed_millis ? ((curr_exec_cnt - prev_exec_cnt) * 1000) / elapsed_millis : 0;
     prev_exec_cnt = curr_exec_cnt;
 
-    display_put(ESC_NAV(13, 1) ESC_CLEAR_ABOVE ESC_NAV(1, 1));
     display_put("------------------------[" ESC_BOLD "%31s " ESC_RESET "]----------------------\n",
         timeStr);
     display_put("  Iterations : " ESC_BOLD "%" _HF_NONMON_SEP "zu" ESC_RESET, curr_exec_cnt);
@@ -186,6 +209,12 @@ static void display_displayLocked(honggfuzz_t* hfuzz) {
         case _HF_STATE_DYNAMIC_MAIN:
             display_put("\n  Mode [3/3] : " ESC_BOLD "Feedback Driven Mode" ESC_RESET "\n");
             break;
+        case _HF_STATE_MINIMIZE:
+            display_put("\n        Mode : " ESC_BOLD "Corpus Minimization" ESC_RESET "\n");
+            break;
+        case _HF_STATE_MINIMIZE_CRASH:
+            display_put("\n        Mode : " ESC_BOLD "Crash Minimization" ESC_RESET "\n");
+            break;
         default:
             display_put("\n        Mode : " ESC_BOLD "Unknown" ESC_RESET "\n");
             break;
@@ -199,10 +228,19 @@ static void display_displayLocked(honggfuzz_t* hfuzz) {
     if (num_cpu <= 0) {
         num_cpu = 1;
     }
-    unsigned cpuUse = getCpuUse(num_cpu);
-    display_put("     Threads : " ESC_BOLD "%zu" ESC_RESET ", CPUs: " ESC_BOLD "%ld" ESC_RESET
+    static cpuTimes_t cpuTimes = {};
+    unsigned cpuUse = util_getCpuUse(&cpuTimes, num_cpu);
+    /* With --threads_auto, the ones which are not parked, out of all */
+    char threadsStr[64];
+    if (hfuzz->threads.threadsAutoMax) {
+        snprintf(threadsStr, sizeof(threadsStr), "%" PRIu32 ESC_RESET " [auto, max: %zu]",
+            ATOMIC_GET(hfuzz->threads.threadsAutoCnt), hfuzz->threads.threadsMax);
+    } else {
+        snprintf(threadsStr, sizeof(threadsStr), "%zu" ESC_RESET, hfuzz->threads.threadsMax);
+    }
+    display_put("     Threads : " ESC_BOLD "%s, CPUs: " ESC_BOLD "%ld" ESC_RESET
                 ", CPU%%: " ESC_BOLD "%u" ESC_RESET "%% [" ESC_BOLD "%lu" ESC_RESET "%%/CPU]\n",
-        hfuzz->threads.threadsMax, num_cpu, cpuUse, cpuUse / num_cpu);
+        threadsStr, num_cpu, cpuUse, cpuUse / num_cpu);
 
     size_t tot_exec_per_sec = elapsed_sec ? (curr_exec_cnt / elapsed_sec) : 0;
     display_put("       Speed : " ESC_BOLD "%" _HF_NONMON_SEP "zu" ESC_RESET "/sec [avg: " ESC_BOLD
@@ -217,13 +255,27 @@ static void display_displayLocked(honggfuzz_t* hfuzz) {
         crashesCnt > 0 ? ESC_RED : "", hfuzz->cnts.crashesCnt, crashesCnt > 0 ? ESC_RED : "",
         ATOMIC_GET(hfuzz->cnts.uniqueCrashesCnt), ATOMIC_GET(hfuzz->cnts.blCrashesCnt),
         ATOMIC_GET(hfuzz->cnts.verifiedCrashesCnt));
-    display_put("    Timeouts : " ESC_BOLD "%" _HF_NONMON_SEP "zu" ESC_RESET " [%lu sec]\n",
-        ATOMIC_GET(hfuzz->cnts.timeoutedCnt), (unsigned long)hfuzz->timing.tmOut);
+    int64_t tmOutMillis = ATOMIC_GET(hfuzz->timing.tmOutAutoMillis);
+    const char* tmOutType = tmOutMillis ? "auto: " : "";
+    if (!tmOutMillis) {
+        tmOutMillis = hfuzz->timing.tmOutMillis;
+    }
+    if (tmOutMillis % 1000) {
+        display_put("    Timeouts : " ESC_BOLD "%" _HF_NONMON_SEP "zu" ESC_RESET " [%s%" PRId64
+                    " ms]\n",
+            ATOMIC_GET(hfuzz->cnts.timeoutedCnt), tmOutType, tmOutMillis);
+    } else {
+        display_put("    Timeouts : " ESC_BOLD "%" _HF_NONMON_SEP "zu" ESC_RESET " [%s%" PRId64
+                    " sec]\n",
+            ATOMIC_GET(hfuzz->cnts.timeoutedCnt), tmOutType, tmOutMillis / 1000);
+    }
     /* Feedback data sources. Common headers. */
+    size_t corpusCnt = ATOMIC_GET(hfuzz->io.dynfileqCnt);
     display_put(" Corpus Size : " ESC_BOLD "%" _HF_NONMON_SEP "zu" ESC_RESET ", max: " ESC_BOLD
                 "%" _HF_NONMON_SEP "zu" ESC_RESET " bytes, init: " ESC_BOLD "%" _HF_NONMON_SEP
-                "zu" ESC_RESET " files\n",
-        hfuzz->io.dynfileqCnt, hfuzz->mutate.maxFileSz, ATOMIC_GET(hfuzz->io.fileCnt));
+                "zu" ESC_RESET " files, slow: " ESC_BOLD "%.1f%%" ESC_RESET "\n",
+        corpusCnt, hfuzz->mutate.maxFileSz, ATOMIC_GET(hfuzz->io.fileCnt),
+        corpusCnt ? (input_slowDynamicInputs(hfuzz) * 100.0) / corpusCnt : 0.0);
     display_put("  Cov Update : " ESC_BOLD "%s" ESC_RESET " ago\n" ESC_RESET, lastCovStr);
     display_put("    Coverage :");
 
@@ -247,6 +299,10 @@ static void display_displayLocked(honggfuzz_t* hfuzz) {
         display_put(" ipt: " ESC_BOLD "%" _HF_NONMON_SEP PRIu64 ESC_RESET,
             ATOMIC_GET(hfuzz->linux.hwCnts.bbCnt));
     }
+    if (hfuzz->feedback.dynFileMethod & _HF_DYNFILE_KCOV) {
+        display_put(" kcov: " ESC_BOLD "%" _HF_NONMON_SEP PRIu64 ESC_RESET,
+            ATOMIC_GET(hfuzz->linux.hwCnts.bbCnt));
+    }
     if (hfuzz->feedback.dynFileMethod & _HF_DYNFILE_SOFT) {
         uint64_t softCntPc = ATOMIC_GET(hfuzz->linux.hwCnts.softCntPc);
         uint64_t softCntEdge = ATOMIC_GET(hfuzz->linux.hwCnts.softCntEdge);
@@ -262,7 +318,7 @@ static void display_displayLocked(honggfuzz_t* hfuzz) {
     display_put("\n---------------------------------- [ " ESC_BOLD "LOGS" ESC_RESET
                 " ] ------------------/ " ESC_BOLD "%s %s " ESC_RESET "/-",
         PROG_NAME, PROG_VERSION);
-    display_put(ESC_SCROLL_REGION(13, ) ESC_NAV_HORIZ(1) ESC_NAV_DOWN(500));
+    display_flush();
 }
 
 void display_createTargetStr(honggfuzz_t* hfuzz) {
@@ -288,8 +344,35 @@ void display_createTargetStr(honggfuzz_t* hfuzz) {
         &tmpstr[len - 27]);
 }
 
+/* Logged instead of the screen, when the logs don't go to a terminal */
+static void display_summary(honggfuzz_t* hfuzz) {
+    static time_t lastSec = 0;
+    static size_t lastExecCnt = 0;
+    time_t now = time(NULL);
+    if (lastSec == 0) {
+        lastSec = now;
+    }
+    if ((now - lastSec) < _HF_DISPLAY_NOTTY_SECS) {
+        return;
+    }
+
+    size_t execCnt = ATOMIC_GET(hfuzz->cnts.mutationsCnt);
+    char lastCovStr[64];
+    getDuration(now - ATOMIC_GET(hfuzz->timing.lastCovUpdate), lastCovStr, sizeof(lastCovStr));
+    LOG_I("Iterations: %zu, speed: %zu/sec, crashes: %zu (unique: %zu), timeouts: %zu, corpus: "
+          "%zu, cov. update: %s ago",
+        execCnt, (execCnt - lastExecCnt) / (size_t)(now - lastSec),
+        (size_t)ATOMIC_GET(hfuzz->cnts.crashesCnt),
+        (size_t)ATOMIC_GET(hfuzz->cnts.uniqueCrashesCnt),
+        (size_t)ATOMIC_GET(hfuzz->cnts.timeoutedCnt), (size_t)ATOMIC_GET(hfuzz->io.dynfileqCnt),
+        lastCovStr);
+    lastSec = now;
+    lastExecCnt = execCnt;
+}
+
 void display_display(honggfuzz_t* hfuzz) {
     if (logIsTTY() == false) {
+        display_summary(hfuzz);
         return;
     }
     MX_SCOPED_LOCK(logMutexGet());
@@ -297,15 +380,22 @@ void display_display(honggfuzz_t* hfuzz) {
 }
 
 void display_fini(void) {
-    display_put(ESC_SCROLL_RESET ESC_NAV_DOWN(500));
+    display_write(ESC_SCROLL_RESET ESC_NAV_DOWN(500));
 }
 
 void display_clear(void) {
-    display_put(ESC_CLEAR_ALL);
-    display_put(ESC_NAV_DOWN(500));
+    if (logIsTTY() == false) {
+        return;
+    }
+    display_write(ESC_CLEAR_ALL);
+    display_write(ESC_NAV_DOWN(500));
+    displayFrame.drawn = false;
 }
 
 void display_init(void) {
+    if (logIsTTY() == false) {
+        return;
+    }
     atexit(display_fini);
     display_clear();
 }
@@ -44,6 +44,7 @@
 #include <unistd.h>
 
 #include "arch.h"
+#include "corpus.h"
 #include "honggfuzz.h"
 #include "input.h"
 #include "libhfcommon/common.h"
@@ -51,10 +52,13 @@
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
 #include "mangle.h"
+#include "minimize.h"
 #include "report.h"
 #include "sanitizers.h"
 #include "socketfuzzer.h"
+#include "stats.h"
 #include "subproc.h"
+#include "sync.h"
 
 static time_t termTimeStamp = 0;
 
@@ -82,17 +86,128 @@ bool fuzz_shouldTerminate() {
     return false;
 }
 
+/* pcGuardMapLen only grows, the processes growing the object can finish in any order */
+static void fuzz_feedbackSetGuardMapLen(feedback_t* fb, size_t fileSz) {
+    size_t off = offsetof(feedback_t, pcGuardMap);
+    uint64_t len = (fileSz > off) ? MIN(fileSz - off, sizeof(fb->pcGuardMap)) : 0;
+    for (uint64_t cur = ATOMIC_GET(fb->pcGuardMapLen); cur < len;) {
+        if (__atomic_compare_exchange_n(&fb->pcGuardMapLen, &cur, len, /* weak= */ false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+feedback_t* fuzz_feedbackMapNew(honggfuzz_t* hfuzz, int* fd) {
+    feedback_t* fb = files_mapSharedMem(sizeof(feedback_t), fd, "hfuzz-feedback",
+        /* nocore= */ true, hfuzz->feedback.hugePages ? FILES_HUGE_TLB : FILES_HUGE_NONE);
+    if (fb == NULL) {
+        return NULL;
+    }
+    fb->hdr = (feedback_hdr_t){
+        .magic = _HF_FEEDBACK_MAGIC,
+        .hdrSz = sizeof(feedback_hdr_t),
+        .pcGuardMapSz = sizeof(fb->pcGuardMap),
+        .pcCntMapSz = sizeof(fb->pcCntMap),
+        .bbMapPcSz = sizeof(fb->bbMapPc),
+        .cmpMapSz = sizeof(fb->cmpMap),
+        .cmpSitesSz = sizeof(fb->cmpSites),
+        .pidFeedbackSz = sizeof(fb->pidFeedback),
+        .persistentCtlSz = sizeof(fb->persistentCtl),
+        .cmpLogSz = sizeof(fb->cmpLog),
+        .crashRecSz = sizeof(fb->crashRec),
+    };
+
+    /* Cut off pcGuardMap (to the block size, e.g. of huge pages), it's grown as guards show up */
+    struct stat st;
+    if (fstat(*fd, &st) == -1) {
+        PLOG_W("fstat(fd=%d)", *fd);
+        fuzz_feedbackSetGuardMapLen(fb, sizeof(feedback_t));
+        return fb;
+    }
+    size_t blk = (st.st_blksize > 0) ? (size_t)st.st_blksize : 4096U;
+    size_t sz = ((offsetof(feedback_t, pcGuardMap) + blk - 1) / blk) * blk;
+    if (sz < (size_t)st.st_size && TEMP_FAILURE_RETRY(ftruncate(*fd, sz)) == -1) {
+        PLOG_W("ftruncate(fd=%d, %zu)", *fd, sz);
+        sz = (size_t)st.st_size;
+    }
+    fuzz_feedbackSetGuardMapLen(fb, MIN(sz, (size_t)st.st_size));
+    return fb;
+}
+
+bool fuzz_feedbackGrowGuardMap(int fd, feedback_t* fb, size_t len) {
+    if (ATOMIC_GET(fb->pcGuardMapLen) >= len) {
+        return true;
+    }
+    ssize_t sz = files_growSharedMem(fd, offsetof(feedback_t, pcGuardMap) + len);
+    if (sz == -1) {
+        return false;
+    }
+    fuzz_feedbackSetGuardMapLen(fb, (size_t)sz);
+    return true;
+}
+
 static fuzzState_t fuzz_getState(honggfuzz_t* hfuzz) {
     return ATOMIC_GET(hfuzz->feedback.state);
 }
 
-static bool fuzz_writeCovFile(const char* dir, const uint8_t* data, size_t len) {
-    char fname[PATH_MAX];
+/* The run fuzzes the dynamic corpus: all runs, or at least this one, are done with the dry run */
+static bool fuzz_isMainPhase(run_t* run) {
+    return run->mainPhase || fuzz_getState(run->global) == _HF_STATE_DYNAMIC_MAIN;
+}
+
+/*
+ * Coverage files are persisted by a dedicated writer thread, so the fuzzing threads don't stall
+ * on (potentially slow) file-system I/O. The queue is bounded, and the producers block only if
+ * the writer thread falls _HF_COVQ_SZ files behind
+ */
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+    bool newCov;
+    uint64_t crc64f;
+    uint64_t crc64r;
+    char fname[64];
+    /* The file of the corpus entry which this one has replaced (--trim), or empty */
+    char replacedFname[64];
+} covfile_t;
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    covfile_t q[_HF_COVQ_SZ];
+    size_t head;
+    size_t cnt;
+    bool done;
+    pthread_t thread;
+} covq = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .notEmpty = PTHREAD_COND_INITIALIZER,
+    .notFull = PTHREAD_COND_INITIALIZER,
+    .head = 0,
+    .cnt = 0,
+    .done = false,
+};
 
-    uint64_t crc64f = util_CRC64(data, len);
-    uint64_t crc64r = util_CRC64Rev(data, len);
-    snprintf(fname, sizeof(fname), "%s/%016" PRIx64 "%016" PRIx64 ".%08" PRIx32 ".honggfuzz.cov",
-        dir, crc64f, crc64r, (uint32_t)len);
+/*
+ * Indices of the new corpus entries, waiting for the trimmer thread (--trim). If it falls behind,
+ * the new entries are simply not trimmed
+ */
+static struct {
+    pthread_mutex_t mutex;
+    size_t q[_HF_TRIMQ_SZ];
+    size_t head;
+    size_t cnt;
+} trimq = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .head = 0,
+    .cnt = 0,
+};
+
+static bool fuzz_writeCovFile(const char* dir, const covfile_t* cf) {
+    char fname[PATH_MAX];
+    snprintf(fname, sizeof(fname), "%s/%s", dir, cf->fname);
 
     if (files_exists(fname)) {
         LOG_D("File '%s' already exists in the output corpus directory '%s'", fname, dir);
@@ -101,7 +216,7 @@ static bool fuzz_writeCovFile(const char* dir, const uint8_t* data, size_t len)
 
     LOG_D("Adding file '%s' to the corpus directory '%s'", fname, dir);
 
-    if (!files_writeBufToFile(fname, data, len, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC)) {
+    if (!files_writeBufToFile(fname, cf->data, cf->len, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC)) {
         LOG_W("Couldn't write buffer to file '%s'", fname);
         return false;
     }
@@ -109,82 +224,188 @@ static bool fuzz_writeCovFile(const char* dir, const uint8_t* data, size_t len)
     return true;
 }
 
-static void fuzz_addFileToFileQ(honggfuzz_t* hfuzz, const uint8_t* data, size_t len) {
-    ATOMIC_SET(hfuzz->timing.lastCovUpdate, time(NULL));
+/* Files of the initial corpus (not named after the content hash) are not there, or are kept */
+static void fuzz_removeCovFile(const char* dir, const char* name) {
+    char fname[PATH_MAX];
+    snprintf(fname, sizeof(fname), "%s/%s", dir, name);
 
-    struct dynfile_t* dynfile = (struct dynfile_t*)util_Malloc(sizeof(struct dynfile_t));
-    dynfile->size = len;
-    dynfile->data = (uint8_t*)util_Malloc(len);
-    memcpy(dynfile->data, data, len);
+    LOG_D("Removing file '%s' from the corpus directory '%s'", fname, dir);
 
-    MX_SCOPED_RWLOCK_WRITE(&hfuzz->io.dynfileq_mutex);
-    TAILQ_INSERT_TAIL(&hfuzz->io.dynfileq, dynfile, pointers);
-    hfuzz->io.dynfileqCnt++;
+    if (unlink(fname) == -1 && errno != ENOENT) {
+        PLOG_W("Couldn't remove file '%s'", fname);
+    }
+}
 
-    if (hfuzz->socketFuzzer.enabled) {
-        /* Don't add coverage data to files in socketFuzzer mode */
+static void* fuzz_covWriterThread(void* arg) {
+    honggfuzz_t* hfuzz = (honggfuzz_t*)arg;
+    covfile_t batch[_HF_COVQ_SZ];
+
+    for (;;) {
+        size_t cnt = 0;
+        {
+            MX_SCOPED_LOCK(&covq.mutex);
+            while (covq.cnt == 0 && !covq.done) {
+                pthread_cond_wait(&covq.notEmpty, &covq.mutex);
+            }
+            if (covq.cnt == 0 && covq.done) {
+                break;
+            }
+            for (cnt = 0; covq.cnt > 0; cnt++) {
+                batch[cnt] = covq.q[covq.head];
+                covq.head = (covq.head + 1) % _HF_COVQ_SZ;
+                covq.cnt--;
+            }
+            pthread_cond_broadcast(&covq.notFull);
+        }
+
+        for (size_t i = 0; i < cnt; i++) {
+            if (hfuzz->io.corpusPack &&
+                !corpus_append(batch[i].data, batch[i].len, batch[i].crc64f, batch[i].crc64r)) {
+                LOG_E("Couldn't append the coverage data to '%s'", hfuzz->io.corpusPack);
+            }
+            if (hfuzz->io.covDirAll && !fuzz_writeCovFile(hfuzz->io.covDirAll, &batch[i])) {
+                LOG_E("Couldn't save the coverage data to '%s'", hfuzz->io.covDirAll);
+            } else if (hfuzz->io.covDirAll && batch[i].replacedFname[0]) {
+                fuzz_removeCovFile(hfuzz->io.covDirAll, batch[i].replacedFname);
+            }
+            if (batch[i].newCov && hfuzz->io.covDirNew &&
+                !fuzz_writeCovFile(hfuzz->io.covDirNew, &batch[i])) {
+                LOG_E("Couldn't save the new coverage data to '%s'", hfuzz->io.covDirNew);
+            }
+        }
+    }
+
+    LOG_D("The coverage writer thread has finished");
+    return NULL;
+}
+
+/* Wait until all pending coverage files are written, and terminate the writer thread */
+void fuzz_covWriterStop(void) {
+    {
+        MX_SCOPED_LOCK(&covq.mutex);
+        if (covq.done) {
+            return;
+        }
+        covq.done = true;
+        pthread_cond_signal(&covq.notEmpty);
+    }
+    pthread_join(covq.thread, NULL);
+}
+
+/* The name of the file comes from the content hash, and is used for all coverage directories */
+static void fuzz_covFileName(char* fname, size_t sz, const struct dynfile_t* dynfile) {
+    snprintf(fname, sz, "%016" PRIx64 "%016" PRIx64 ".%08" PRIx32 ".honggfuzz.cov",
+        dynfile->crc64f, dynfile->crc64r, (uint32_t)dynfile->size);
+}
+
+/* The file of 'replaced' (the entry which 'dynfile' replaces) is removed once 'dynfile' is saved */
+static void fuzz_enqueueCovFile(
+    const struct dynfile_t* dynfile, bool newCov, const struct dynfile_t* replaced) {
+    covfile_t cf = {
+        .data = dynfile->data,
+        .len = dynfile->size,
+        .newCov = newCov,
+        .crc64f = dynfile->crc64f,
+        .crc64r = dynfile->crc64r,
+        .replacedFname = "",
+    };
+    fuzz_covFileName(cf.fname, sizeof(cf.fname), dynfile);
+    if (replaced) {
+        fuzz_covFileName(cf.replacedFname, sizeof(cf.replacedFname), replaced);
+    }
+
+    MX_SCOPED_LOCK(&covq.mutex);
+    while (covq.cnt == _HF_COVQ_SZ) {
+        pthread_cond_wait(&covq.notFull, &covq.mutex);
+    }
+    covq.q[(covq.head + covq.cnt) % _HF_COVQ_SZ] = cf;
+    covq.cnt++;
+    pthread_cond_signal(&covq.notEmpty);
+}
+
+static void fuzz_addFileToFileQ(
+    run_t* run, const uint8_t* data, size_t len, uint64_t timeExecUSecs, uint64_t newCov) {
+    honggfuzz_t* hfuzz = run->global;
+    ATOMIC_SET(hfuzz->timing.lastCovUpdate, time(NULL));
+
+    /* NULL also for byte-identical inputs, which are already in the corpus */
+    struct dynfile_t* dynfile = input_addDynamicInput(hfuzz, data, len, timeExecUSecs, newCov);
+    if (dynfile == NULL) {
         return;
     }
 
-    if (!fuzz_writeCovFile(hfuzz->io.covDirAll, data, len)) {
-        LOG_E("Couldn't save the coverage data to '%s'", hfuzz->io.covDirAll);
+    if (hfuzz->socketFuzzer.enabled) {
+        /* Don't add coverage data to files in socketFuzzer mode */
+        return;
     }
 
     /* No need to add files to the new coverage dir, if it's not the main phase */
-    if (fuzz_getState(hfuzz) != _HF_STATE_DYNAMIC_MAIN) {
-        return;
+    bool isMain = fuzz_isMainPhase(run);
+    if (isMain) {
+        ATOMIC_POST_INC(hfuzz->io.newUnitsAdded);
+    }
+    if (isMain && hfuzz->cfg.trim) {
+        MX_SCOPED_LOCK(&trimq.mutex);
+        if (trimq.cnt < _HF_TRIMQ_SZ) {
+            trimq.q[(trimq.head + trimq.cnt) % _HF_TRIMQ_SZ] = dynfile->idx;
+            trimq.cnt++;
+        }
     }
 
-    hfuzz->io.newUnitsAdded++;
+    /* Corpus entries are never freed, so the writer thread can use the data without copying it */
+    fuzz_enqueueCovFile(dynfile, isMain, /* replaced= */ NULL);
+    sync_addInput(dynfile->data, dynfile->size);
+}
 
-    if (hfuzz->io.covDirNew && !fuzz_writeCovFile(hfuzz->io.covDirNew, data, len)) {
-        LOG_E("Couldn't save the new coverage data to '%s'", hfuzz->io.covDirNew);
+/* Number of runs of all fuzzing threads (see --async_runs), the trimmer thread has a single one */
+static size_t fuzz_runsCnt(honggfuzz_t* hfuzz) {
+    size_t perThread = MAX(hfuzz->threads.asyncRuns, 1U);
+    if (hfuzz->cfg.trim) {
+        return (hfuzz->threads.threadsMax - 1) * perThread + 1;
     }
+    return hfuzz->threads.threadsMax * perThread;
 }
 
+/*
+ * Every run starts fuzzing the corpus as soon as it runs out of dry run inputs, while the others
+ * are still busy with their last ones. The global state becomes DYNAMIC_MAIN with the last run
+ */
 static void fuzz_setDynamicMainState(run_t* run) {
-    /* All threads need to indicate willingness to switch to the DYNAMIC_MAIN state. Count them! */
-    static uint32_t cnt = 0;
-    ATOMIC_PRE_INC(cnt);
-
+    static size_t cnt = 0;
     static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
     MX_SCOPED_LOCK(&state_mutex);
 
-    if (fuzz_getState(run->global) == _HF_STATE_DYNAMIC_MAIN) {
+    if (run->mainPhase) {
         return;
     }
-
-    LOG_I("Entering phase 2/3: Switching to Dynamic Main (Feedback Driven Mode)");
-    ATOMIC_SET(run->global->feedback.state, _HF_STATE_DYNAMIC_SWITCH_TO_MAIN);
-
-    for (;;) {
-        /* Check if all threads have already reported in for changing state */
-        if (ATOMIC_GET(cnt) == run->global->threads.threadsMax) {
-            break;
-        }
-        if (fuzz_isTerminating()) {
-            return;
-        }
-        util_sleepForMSec(10); /* Check every 10ms */
+    if (fuzz_getState(run->global) == _HF_STATE_DYNAMIC_DRY_RUN) {
+        LOG_I("Entering phase 2/3: Switching to Dynamic Main (Feedback Driven Mode)");
+        ATOMIC_SET(run->global->feedback.state, _HF_STATE_DYNAMIC_SWITCH_TO_MAIN);
     }
 
     /*
-     * If the initial fuzzing yielded no useful coverage, just add a single 1-byte file to the
-     * dynamic corpus, so the dynamic phase doesn't fail because of lack of useful inputs
+     * If the initial fuzzing yielded no useful coverage (so far), just add a single 1-byte file to
+     * the dynamic corpus, so the dynamic phase doesn't fail because of lack of useful inputs
      */
-    if (run->global->io.dynfileqCnt == 0) {
+    if (ATOMIC_GET(run->global->io.dynfileqCnt) == 0) {
         const char* single_byte = run->global->cfg.only_printable ? " " : "\0";
-        fuzz_addFileToFileQ(run->global, (const uint8_t*)single_byte, 1U);
+        fuzz_addFileToFileQ(run, (const uint8_t*)single_byte, 1U, 0U, 0U);
     }
 
-    LOG_I("Entering phase 3/3: Dynamic Main (Feedback Driven Mode)");
+    run->mainPhase = true;
     snprintf(run->origFileName, sizeof(run->origFileName), "[DYNAMIC]");
+
+    if (++cnt < fuzz_runsCnt(run->global)) {
+        return;
+    }
+    LOG_I("Entering phase 3/3: Dynamic Main (Feedback Driven Mode)");
     ATOMIC_SET(run->global->feedback.state, _HF_STATE_DYNAMIC_MAIN);
 }
 
-static void fuzz_perfFeedback(run_t* run) {
+/* Returns true if the input has produced new coverage, and was added to the corpus */
+static bool fuzz_perfFeedback(run_t* run) {
     if (run->global->feedback.skipFeedbackOnTimeout && run->tmOutSignaled) {
-        return;
+        return false;
     }
 
     LOG_D("New file size: %zu, Perf feedback new/cur (instr,branch): %" PRIu64 "/%" PRIu64
@@ -193,21 +414,23 @@ static void fuzz_perfFeedback(run_t* run) {
         run->linux.hwCnts.cpuBranchCnt, run->global->linux.hwCnts.cpuBranchCnt,
         run->linux.hwCnts.newBBCnt, run->global->linux.hwCnts.bbCnt);
 
+    /* The per-thread counters are only written by this thread's children, no lock needed */
+    uint64_t softCntPc = ATOMIC_XCHG(run->feedbackMap->pidFeedback[run->fuzzNo].pc, 0);
+    uint64_t softCntEdge = ATOMIC_XCHG(run->feedbackMap->pidFeedback[run->fuzzNo].edge, 0);
+    uint64_t softCntCmp = ATOMIC_XCHG(run->feedbackMap->pidFeedback[run->fuzzNo].cmp, 0);
+
+    /* Fast path: nothing new was found, so don't contend for the global feedback lock */
+    if (run->linux.hwCnts.newBBCnt == 0 && softCntPc == 0 && softCntEdge == 0 && softCntCmp == 0 &&
+        run->linux.hwCnts.cpuInstrCnt <= ATOMIC_GET(run->global->linux.hwCnts.cpuInstrCnt) &&
+        run->linux.hwCnts.cpuBranchCnt <= ATOMIC_GET(run->global->linux.hwCnts.cpuBranchCnt)) {
+        return false;
+    }
+
     MX_SCOPED_LOCK(&run->global->feedback.feedback_mutex);
     defer {
         wmb();
     };
 
-    uint64_t softCntPc = 0;
-    uint64_t softCntEdge = 0;
-    uint64_t softCntCmp = 0;
-    softCntPc = ATOMIC_GET(run->global->feedback.feedbackMap->pidFeedbackPc[run->fuzzNo]);
-    ATOMIC_CLEAR(run->global->feedback.feedbackMap->pidFeedbackPc[run->fuzzNo]);
-    softCntEdge = ATOMIC_GET(run->global->feedback.feedbackMap->pidFeedbackEdge[run->fuzzNo]);
-    ATOMIC_CLEAR(run->global->feedback.feedbackMap->pidFeedbackEdge[run->fuzzNo]);
-    softCntCmp = ATOMIC_GET(run->global->feedback.feedbackMap->pidFeedbackCmp[run->fuzzNo]);
-    ATOMIC_CLEAR(run->global->feedback.feedbackMap->pidFeedbackCmp[run->fuzzNo]);
-
     int64_t diff0 = run->global->linux.hwCnts.cpuInstrCnt - run->linux.hwCnts.cpuInstrCnt;
     int64_t diff1 = run->global->linux.hwCnts.cpuBranchCnt - run->linux.hwCnts.cpuBranchCnt;
 
@@ -215,10 +438,10 @@ static void fuzz_perfFeedback(run_t* run) {
     if (run->linux.hwCnts.newBBCnt > 0 || softCntPc > 0 || softCntEdge > 0 || softCntCmp > 0 ||
         diff0 < 0 || diff1 < 0) {
         if (diff0 < 0) {
-            run->global->linux.hwCnts.cpuInstrCnt = run->linux.hwCnts.cpuInstrCnt;
+            ATOMIC_SET(run->global->linux.hwCnts.cpuInstrCnt, run->linux.hwCnts.cpuInstrCnt);
         }
         if (diff1 < 0) {
-            run->global->linux.hwCnts.cpuBranchCnt = run->linux.hwCnts.cpuBranchCnt;
+            ATOMIC_SET(run->global->linux.hwCnts.cpuBranchCnt, run->linux.hwCnts.cpuBranchCnt);
         }
         run->global->linux.hwCnts.bbCnt += run->linux.hwCnts.newBBCnt;
         run->global->linux.hwCnts.softCntPc += softCntPc;
@@ -234,13 +457,17 @@ static void fuzz_perfFeedback(run_t* run) {
             run->global->linux.hwCnts.bbCnt, run->global->linux.hwCnts.softCntEdge,
             run->global->linux.hwCnts.softCntPc, run->global->linux.hwCnts.softCntCmp);
 
-        fuzz_addFileToFileQ(run->global, run->dynamicFile, run->dynamicFileSz);
+        uint64_t newCov = run->linux.hwCnts.newBBCnt + softCntPc + softCntEdge + softCntCmp +
+                          (diff0 < 0 ? 1 : 0) + (diff1 < 0 ? 1 : 0);
+        fuzz_addFileToFileQ(run, run->dynamicFile, run->dynamicFileSz, run->timeExecUSecs, newCov);
 
         if (run->global->socketFuzzer.enabled) {
             LOG_D("SocketFuzzer: fuzz: new BB (perf)");
             fuzz_notifySocketFuzzerNewCov(run->global);
         }
+        return true;
     }
+    return false;
 }
 
 /* Return value indicates whether report file should be updated with the current verified crash */
@@ -263,8 +490,8 @@ static bool fuzz_runVerifier(run_t* run) {
     }
 
     for (int i = 0; i < _HF_VERIFIER_ITER; i++) {
-        LOG_I("Launching verifier for HASH: %" PRIx64 " (iteration: %d out of %d)", run->backtrace,
-            i + 1, _HF_VERIFIER_ITER);
+        LOG_I("Launching verifier for HASH: %" PRIx64 " (iteration: %d out of at most %d)",
+            backtrace, i + 1, _HF_VERIFIER_ITER);
         run->timeStartedMillis = 0;
         run->backtrace = 0;
         run->access = 0;
@@ -283,8 +510,13 @@ static bool fuzz_runVerifier(run_t* run) {
             return true;
         }
 
-        LOG_I("Verifier for HASH: %" PRIx64 " (iteration: %d, left: %d). MATCH!", run->backtrace,
-            i + 1, _HF_VERIFIER_ITER - i - 1);
+        LOG_I("Verifier for HASH: %" PRIx64 " (iteration: %d, left: %d). MATCH!", backtrace,
+            i + 1, _HF_VERIFIER_STABLE_ITER - i - 1);
+        /* A mismatch rejects the crash, so all runs so far have matched */
+        if ((i + 1) >= _HF_VERIFIER_STABLE_ITER) {
+            LOG_I("Verifier for HASH: %" PRIx64 " is stable after %d runs", backtrace, i + 1);
+            break;
+        }
     }
 
     /* Copy file with new suffix & remove original copy */
@@ -312,21 +544,177 @@ static bool fuzz_runVerifier(run_t* run) {
     return true;
 }
 
+/*
+ * Crashes waiting for the verification. They're handed over by the fuzzing threads which found
+ * them, and taken (between iterations) by at most 1/_HF_VERIFIER_THREADS_DIV of the threads, which
+ * re-run them within their own (persistent or fork-server) processes
+ */
+typedef struct verifyJob {
+    uint8_t* data;
+    size_t len;
+    uint64_t backtrace;
+    char origFileName[PATH_MAX];
+    char crashFileName[PATH_MAX];
+    char report[_HF_REPORT_SIZE];
+    struct verifyJob* next;
+} verifyJob_t;
+
+static struct {
+    pthread_mutex_t mutex;
+    verifyJob_t* head;
+    verifyJob_t* tail;
+    size_t cnt;
+    size_t active;
+} verifyq = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .head = NULL,
+    .tail = NULL,
+    .cnt = 0,
+    .active = 0,
+};
+
+/* The verifier runs in this thread, if it's the dry run mode (-M) or the socket fuzzer */
+static bool fuzz_verifyInline(run_t* run) {
+    return run->global->mutate.mutationsPerRun == 0U || run->global->socketFuzzer.enabled;
+}
+
+static void fuzz_verifyEnqueue(run_t* run) {
+    if (!run->crashFileName[0] || !run->backtrace) {
+        return;
+    }
+
+    if (ATOMIC_GET(verifyq.cnt) >= _HF_VERIFIER_QUEUE_MAX) {
+        LOG_W("Too many crashes are waiting for the verification, not verifying '%s'",
+            run->crashFileName);
+        report_Report(run);
+        return;
+    }
+
+    verifyJob_t* job = (verifyJob_t*)util_Malloc(sizeof(verifyJob_t));
+    job->data = (uint8_t*)util_Malloc(MAX(run->dynamicFileSz, 1U));
+    memcpy(job->data, run->dynamicFile, run->dynamicFileSz);
+    job->len = run->dynamicFileSz;
+    job->backtrace = run->backtrace;
+    snprintf(job->origFileName, sizeof(job->origFileName), "%s", run->origFileName);
+    snprintf(job->crashFileName, sizeof(job->crashFileName), "%s", run->crashFileName);
+    snprintf(job->report, sizeof(job->report), "%s", run->report);
+    job->next = NULL;
+
+    MX_SCOPED_LOCK(&verifyq.mutex);
+    if (verifyq.tail) {
+        verifyq.tail->next = job;
+    } else {
+        verifyq.head = job;
+    }
+    verifyq.tail = job;
+    ATOMIC_POST_INC(verifyq.cnt);
+}
+
+/* Takes the oldest queued crash, NULL if there's none, or too many threads verify already */
+static verifyJob_t* fuzz_verifyPop(run_t* run, bool force) {
+    MX_SCOPED_LOCK(&verifyq.mutex);
+    size_t maxActive = MAX(run->global->threads.threadsMax / _HF_VERIFIER_THREADS_DIV, 1U);
+    if (verifyq.head == NULL || (!force && verifyq.active >= maxActive)) {
+        return NULL;
+    }
+    verifyJob_t* job = verifyq.head;
+    verifyq.head = job->next;
+    if (verifyq.head == NULL) {
+        verifyq.tail = NULL;
+    }
+    ATOMIC_POST_DEC(verifyq.cnt);
+    verifyq.active++;
+    return job;
+}
+
+/* Makes the queued crash the current input of the run */
+static void fuzz_verifyLoad(run_t* run, const verifyJob_t* job) {
+    /* It's not a copy of the corpus entry anymore, which the journal would restore over it */
+    input_journalReset(run, NULL);
+    input_setSize(run, job->len);
+    memcpy(run->dynamicFile, job->data, job->len);
+    snprintf(run->origFileName, sizeof(run->origFileName), "%s", job->origFileName);
+    snprintf(run->crashFileName, sizeof(run->crashFileName), "%s", job->crashFileName);
+    snprintf(run->report, sizeof(run->report), "%s", job->report);
+    run->backtrace = job->backtrace;
+    run->tmOutSignaled = false;
+}
+
+static void fuzz_verifyDone(run_t* run, verifyJob_t* job) {
+    run->crashFileName[0] = '\0';
+    run->report[0] = '\0';
+    run->backtrace = 0;
+
+    free(job->data);
+    free(job);
+    MX_SCOPED_LOCK(&verifyq.mutex);
+    verifyq.active--;
+}
+
+/*
+ * Verifies one of the queued crashes, if there are any, and if not too many threads are verifying
+ * already (unless 'force' is set). Returns false if it didn't
+ */
+static bool fuzz_verifyQueued(run_t* run, bool force) {
+    if (ATOMIC_GET(verifyq.cnt) == 0) {
+        return false;
+    }
+    verifyJob_t* job = fuzz_verifyPop(run, force);
+    if (job == NULL) {
+        return false;
+    }
+
+    fuzz_verifyLoad(run, job);
+    if (fuzz_runVerifier(run)) {
+        report_Report(run);
+    }
+    fuzz_verifyDone(run, job);
+
+    return true;
+}
+
+/* Crashes still queued when terminating are reported unverified, as when the queue is full */
+static void fuzz_verifyReportQueued(run_t* run) {
+    for (verifyJob_t* job; (job = fuzz_verifyPop(run, /* force= */ true));) {
+        LOG_W("Terminating, not verifying '%s' (HASH: %" PRIx64 ")", job->crashFileName,
+            job->backtrace);
+        fuzz_verifyLoad(run, job);
+        report_Report(run);
+        fuzz_verifyDone(run, job);
+    }
+}
+
+/* The next file of the static corpus in the dry run phase, false if there are no more of them */
+static bool fuzz_fetchDryRunInput(run_t* run) {
+    fuzzState_t st = fuzz_getState(run->global);
+    if ((st != _HF_STATE_DYNAMIC_DRY_RUN && st != _HF_STATE_DYNAMIC_SWITCH_TO_MAIN) ||
+        run->mainPhase) {
+        return false;
+    }
+    run->mutationsPerRun = 0U;
+    if (input_prepareStaticFile(run, /* rewind= */ false, true)) {
+        return true;
+    }
+    run->mutationsPerRun = run->global->mutate.mutationsPerRun;
+    return false;
+}
+
 static bool fuzz_fetchInput(run_t* run) {
     {
         fuzzState_t st = fuzz_getState(run->global);
-        if (st == _HF_STATE_DYNAMIC_DRY_RUN || st == _HF_STATE_DYNAMIC_SWITCH_TO_MAIN) {
-            run->mutationsPerRun = 0U;
-            if (input_prepareStaticFile(run, /* rewind= */ false, true)) {
+        if ((st == _HF_STATE_DYNAMIC_DRY_RUN || st == _HF_STATE_DYNAMIC_SWITCH_TO_MAIN) &&
+            !run->mainPhase) {
+            if (fuzz_fetchDryRunInput(run)) {
                 return true;
             }
             fuzz_setDynamicMainState(run);
-            run->mutationsPerRun = run->global->mutate.mutationsPerRun;
         }
     }
 
-    if (fuzz_getState(run->global) == _HF_STATE_DYNAMIC_MAIN) {
-        if (run->global->exe.externalCommand) {
+    if (fuzz_isMainPhase(run)) {
+        if (sync_fetchInput(run)) {
+            /* An input from another node, which is executed as-is */
+        } else if (run->global->exe.externalCommand) {
             if (!input_prepareExternalFile(run)) {
                 LOG_E("input_prepareFileExternally() failed");
                 return false;
@@ -372,7 +760,85 @@ static bool fuzz_fetchInput(run_t* run) {
     return true;
 }
 
-static void fuzz_fuzzLoop(run_t* run) {
+/* Feedback for the input no. 'idx' of a batch: the persistent process has counted it separately */
+static void fuzz_batchFeedback(run_t* run, size_t idx) {
+    const pidFeedback_t* cov = &run->batchHdr->cov[idx];
+    uint64_t newCov = cov->pc + cov->edge + cov->cmp;
+    if (newCov == 0) {
+        return;
+    }
+
+    const uint8_t* data = (const uint8_t*)run->batchHdr + run->batchHdr->off[idx];
+    size_t len = run->batchHdr->len[idx];
+
+    MX_SCOPED_LOCK(&run->global->feedback.feedback_mutex);
+    run->global->linux.hwCnts.softCntPc += cov->pc;
+    run->global->linux.hwCnts.softCntEdge += cov->edge;
+    run->global->linux.hwCnts.softCntCmp += cov->cmp;
+
+    LOG_I("Size:%zu (batch:%zu/%zu) (edge,ip,cmp): %" PRIu64 "/%" PRIu64 "/%" PRIu64
+          ", Tot:%" PRIu64 "/%" PRIu64 "/%" PRIu64,
+        len, idx + 1, run->batchCnt, cov->edge, cov->pc, cov->cmp,
+        run->global->linux.hwCnts.softCntEdge, run->global->linux.hwCnts.softCntPc,
+        run->global->linux.hwCnts.softCntCmp);
+
+    fuzz_addFileToFileQ(run, data, len, run->timeExecUSecs / run->batchCnt, newCov);
+}
+
+/*
+ * Sends up to exe.persistentBatch inputs to the persistent process in one round. If the process
+ * crashes (or times out), the remaining inputs of the batch are not tested
+ */
+static void fuzz_fuzzLoopBatch(run_t* run) {
+    batchHdr_t* hdr = run->batchHdr;
+    size_t off = sizeof(batchHdr_t);
+    size_t cnt = 0;
+    for (; cnt < run->global->exe.persistentBatch; cnt++) {
+        uint64_t started = stats_start();
+        if (!fuzz_fetchInput(run)) {
+            LOG_F("Cound't prepare input for fuzzing");
+        }
+        stats_record(run, STATS_PHASE_MUTATE, started);
+        memcpy((uint8_t*)hdr + off, run->dynamicFile, run->dynamicFileSz);
+        hdr->off[cnt] = off;
+        hdr->len[cnt] = run->dynamicFileSz;
+        off += run->dynamicFileSz;
+    }
+    memset(hdr->cov, '\0', sizeof(hdr->cov[0]) * cnt);
+    ATOMIC_POST_ADD(run->global->cnts.mutationsCnt, cnt - 1);
+
+    run->batchCnt = cnt;
+    uint64_t started = stats_start();
+    if (!subproc_Run(run)) {
+        LOG_F("Couldn't run fuzzed command");
+    }
+    stats_record(run, STATS_PHASE_RUN, started);
+
+    started = stats_start();
+    if (run->global->mutate.cmpLog) {
+        input_cmpLogConsume(run);
+    }
+    /* The per-input counters are in hdr->cov[], the totals are not needed */
+    ATOMIC_CLEAR(run->feedbackMap->pidFeedback[run->fuzzNo].pc);
+    ATOMIC_CLEAR(run->feedbackMap->pidFeedback[run->fuzzNo].edge);
+    ATOMIC_CLEAR(run->feedbackMap->pidFeedback[run->fuzzNo].cmp);
+
+    if (run->global->feedback.dynFileMethod != _HF_DYNFILE_NONE &&
+        !(run->global->feedback.skipFeedbackOnTimeout && run->tmOutSignaled)) {
+        size_t done = MIN(ATOMIC_GET(hdr->done), cnt);
+        for (size_t i = 0; i < done; i++) {
+            fuzz_batchFeedback(run, i);
+        }
+    }
+    stats_record(run, STATS_PHASE_FEEDBACK, started);
+    run->batchCnt = 0;
+
+    started = stats_start();
+    report_Report(run);
+    stats_record(run, STATS_PHASE_REPORT, started);
+}
+
+static void fuzz_fuzzLoopReset(run_t* run) {
     run->timeStartedMillis = 0;
     run->crashFileName[0] = '\0';
     run->pc = 0;
@@ -388,21 +854,239 @@ static void fuzz_fuzzLoop(run_t* run) {
     run->linux.hwCnts.cpuBranchCnt = 0;
     run->linux.hwCnts.bbCnt = 0;
     run->linux.hwCnts.newBBCnt = 0;
+}
 
+/* The feedback, verification and report of the input which has just been run */
+static void fuzz_fuzzLoopFinish(run_t* run) {
+    uint64_t started = stats_start();
+    if (run->global->mutate.cmpLog) {
+        input_cmpLogConsume(run);
+    }
+    if (run->global->feedback.dynFileMethod != _HF_DYNFILE_NONE) {
+        uint64_t perfStarted = stats_start();
+        bool newCov = fuzz_perfFeedback(run);
+        stats_record(run, STATS_PHASE_PERF_FEEDBACK, perfStarted);
+        mangle_feedback(run, newCov);
+    }
+    stats_record(run, STATS_PHASE_FEEDBACK, started);
+    if (run->global->cfg.useVerifier && !fuzz_verifyInline(run)) {
+        fuzz_verifyEnqueue(run);
+        return;
+    }
+    if (run->global->cfg.useVerifier && !fuzz_runVerifier(run)) {
+        return;
+    }
+    started = stats_start();
+    report_Report(run);
+    stats_record(run, STATS_PHASE_REPORT, started);
+}
+
+static void fuzz_fuzzLoop(run_t* run) {
+    fuzz_fuzzLoopReset(run);
+
+    if (run->batchCapable && fuzz_isMainPhase(run)) {
+        fuzz_fuzzLoopBatch(run);
+        return;
+    }
+
+    uint64_t started = stats_start();
     if (!fuzz_fetchInput(run)) {
         LOG_F("Cound't prepare input for fuzzing");
     }
+    stats_record(run, STATS_PHASE_MUTATE, started);
+
+    started = stats_start();
     if (!subproc_Run(run)) {
         LOG_F("Couldn't run fuzzed command");
     }
+    stats_record(run, STATS_PHASE_RUN, started);
 
-    if (run->global->feedback.dynFileMethod != _HF_DYNFILE_NONE) {
-        fuzz_perfFeedback(run);
+    fuzz_fuzzLoopFinish(run);
+}
+
+/* Runs the next input of the corpus and records its coverage, returns false if there are no more */
+static bool fuzz_minimizeLoop(run_t* run) {
+    run->timeStartedMillis = 0;
+    run->crashFileName[0] = '\0';
+    run->pc = 0;
+    run->backtrace = 0;
+    run->access = 0;
+    run->exception = 0;
+    run->report[0] = '\0';
+    run->mainWorker = true;
+    run->mutationsPerRun = 0U;
+    run->tmOutSignaled = false;
+
+    run->linux.hwCnts.cpuInstrCnt = 0;
+    run->linux.hwCnts.cpuBranchCnt = 0;
+    run->linux.hwCnts.bbCnt = 0;
+    run->linux.hwCnts.newBBCnt = 0;
+
+    if (!input_prepareStaticFile(run, /* rewind= */ false, /* need_mangle= */ false)) {
+        return false;
     }
-    if (run->global->cfg.useVerifier && !fuzz_runVerifier(run)) {
-        return;
+    if (!subproc_Run(run)) {
+        LOG_F("Couldn't run fuzzed command");
     }
+
+    minimize_record(run);
     report_Report(run);
+    return true;
+}
+
+/* Runs a candidate of the trimmed input, returns false if it crashed or timed out */
+static bool fuzz_trimExec(run_t* run, const uint8_t* data, size_t len, uint64_t* sig) {
+    run->timeStartedMillis = 0;
+    run->crashFileName[0] = '\0';
+    run->pc = 0;
+    run->backtrace = 0;
+    run->access = 0;
+    run->exception = 0;
+    run->report[0] = '\0';
+    run->mainWorker = true;
+    run->mutationsPerRun = 0U;
+    run->tmOutSignaled = false;
+
+    run->linux.hwCnts.cpuInstrCnt = 0;
+    run->linux.hwCnts.cpuBranchCnt = 0;
+    run->linux.hwCnts.bbCnt = 0;
+    run->linux.hwCnts.newBBCnt = 0;
+
+    input_setSize(run, len);
+    memcpy(run->dynamicFile, data, len);
+    if (!subproc_Run(run)) {
+        LOG_F("Couldn't run fuzzed command");
+    }
+
+    *sig = minimize_signature(run);
+    bool ok = (run->crashFileName[0] == '\0' && !run->tmOutSignaled);
+    report_Report(run);
+    return ok;
+}
+
+/*
+ * Removes chunks of the corpus entry (AFL-style: from 1/16th down to 1/1024th of its size, rounded
+ * up to a power of 2) for as long as its coverage signature doesn't change
+ */
+static void fuzz_trimInput(run_t* run, const struct dynfile_t* dynfile) {
+    size_t len = dynfile->size;
+    if (len <= 4) {
+        return;
+    }
+
+    /* Inputs with unstable coverage (or crashing ones) can't be trimmed reliably */
+    uint64_t sig, sig2;
+    if (!fuzz_trimExec(run, dynfile->data, len, &sig) ||
+        !fuzz_trimExec(run, dynfile->data, len, &sig2) || sig != sig2) {
+        LOG_D("Corpus entry #%zu (size: %zu) is not stable, not trimming it", dynfile->idx, len);
+        return;
+    }
+    uint64_t timeExecUSecs = run->timeExecUSecs;
+
+    uint8_t* buf = (uint8_t*)util_Malloc(len);
+    defer {
+        free(buf);
+    };
+    uint8_t* tmp = (uint8_t*)util_Malloc(len);
+    defer {
+        free(tmp);
+    };
+    memcpy(buf, dynfile->data, len);
+
+    size_t lenP2 = 1;
+    while (lenP2 < len) {
+        lenP2 *= 2;
+    }
+    size_t execs = 2;
+    for (size_t removeLen = MAX(lenP2 / 16, 4U);; removeLen /= 2) {
+        for (size_t pos = removeLen; pos < len && execs < _HF_TRIM_EXECS_MAX; execs++) {
+            if (fuzz_isTerminating()) {
+                return;
+            }
+            size_t cut = MIN(removeLen, len - pos);
+            memcpy(tmp, buf, pos);
+            memcpy(&tmp[pos], &buf[pos + cut], len - pos - cut);
+
+            uint64_t s;
+            if (fuzz_trimExec(run, tmp, len - cut, &s) && s == sig) {
+                memcpy(buf, tmp, len - cut);
+                len -= cut;
+                timeExecUSecs = run->timeExecUSecs;
+            } else {
+                pos += removeLen;
+            }
+        }
+        if (removeLen <= MAX(lenP2 / 1024, 4U)) {
+            break;
+        }
+    }
+
+    if (len == dynfile->size) {
+        return;
+    }
+    struct dynfile_t* trimmed =
+        input_replaceDynamicInput(run->global, dynfile->idx, buf, len, timeExecUSecs);
+    if (trimmed == NULL) {
+        LOG_D("Trimmed corpus entry #%zu is already in the corpus", dynfile->idx);
+        return;
+    }
+    LOG_I("Trimmed corpus entry #%zu: %zu -> %zu bytes, execs: %zu", dynfile->idx, dynfile->size,
+        len, execs);
+    fuzz_enqueueCovFile(trimmed, /* newCov= */ false, /* replaced= */ dynfile);
+}
+
+/* The loop of the trimmer thread (--trim), it doesn't fuzz at all */
+static void fuzz_trimLoop(run_t* run) {
+    if (!fuzz_isMainPhase(run)) {
+        fuzz_setDynamicMainState(run);
+    }
+    snprintf(run->origFileName, sizeof(run->origFileName), "[TRIM]");
+
+    /* Finishes also after all the fuzzing threads (e.g. because of --iterations) */
+    size_t fuzzersCnt = run->global->threads.threadsMax - 1;
+    while (!fuzz_isTerminating() && ATOMIC_GET(run->global->threads.threadsFinished) < fuzzersCnt) {
+        size_t idx;
+        {
+            MX_SCOPED_LOCK(&trimq.mutex);
+            if (trimq.cnt > 0) {
+                idx = trimq.q[trimq.head];
+                trimq.head = (trimq.head + 1) % _HF_TRIMQ_SZ;
+                trimq.cnt--;
+            } else {
+                idx = SIZE_MAX;
+            }
+        }
+        if (idx == SIZE_MAX) {
+            util_sleepForMSec(100);
+            continue;
+        }
+        fuzz_trimInput(run, input_getDynamicInput(run->global, idx));
+    }
+}
+
+/* Runs the next candidate of the crash minimization, returns false if it's over */
+static bool fuzz_minimizeCrashLoop(run_t* run) {
+    run->timeStartedMillis = 0;
+    run->crashFileName[0] = '\0';
+    run->pc = 0;
+    run->backtrace = 0;
+    run->access = 0;
+    run->exception = 0;
+    run->report[0] = '\0';
+    /* Like with the verifier: only the stack hash of the crash is calculated, nothing is saved */
+    run->mainWorker = false;
+    run->mutationsPerRun = 0U;
+    run->tmOutSignaled = false;
+
+    minCrashCand_t cand;
+    if (!minimize_crashNext(run, &cand)) {
+        return false;
+    }
+    if (!subproc_Run(run)) {
+        LOG_F("Couldn't run fuzzed command");
+    }
+    minimize_crashResult(run, &cand);
+    return true;
 }
 
 static void fuzz_fuzzLoopSocket(run_t* run) {
@@ -452,6 +1136,7 @@ static void fuzz_fuzzLoopSocket(run_t* run) {
     if (run->global->feedback.dynFileMethod != _HF_DYNFILE_NONE) {
         fuzz_perfFeedback(run);
     }
+    fuzz_notifySocketFuzzerResult(run);
     if (run->global->cfg.useVerifier && !fuzz_runVerifier(run)) {
         return;
     }
@@ -459,77 +1144,431 @@ static void fuzz_fuzzLoopSocket(run_t* run) {
     report_Report(run);
 }
 
-static void* fuzz_threadNew(void* arg) {
-    honggfuzz_t* hfuzz = (honggfuzz_t*)arg;
-    unsigned int fuzzNo = ATOMIC_POST_INC(hfuzz->threads.threadsActiveCnt);
-    LOG_I("Launched new fuzzing thread, no. #%" PRId32, fuzzNo);
+/* Counts the next iteration, returns false if the limit of iterations has been reached */
+static bool fuzz_nextIteration(honggfuzz_t* hfuzz) {
+    /* Check if dry run mode with verifier enabled */
+    if (hfuzz->mutate.mutationsPerRun == 0U && hfuzz->cfg.useVerifier &&
+        !hfuzz->socketFuzzer.enabled) {
+        if (ATOMIC_POST_INC(hfuzz->cnts.mutationsCnt) >= hfuzz->io.fileCnt) {
+            return false;
+        }
+    }
+    /* Check for max iterations limit if set */
+    else if ((ATOMIC_POST_INC(hfuzz->cnts.mutationsCnt) >= hfuzz->mutate.mutationsMax) &&
+             hfuzz->mutate.mutationsMax) {
+        return false;
+    }
+    return true;
+}
 
-    run_t run = {
-        .global = hfuzz,
-        .pid = 0,
-        .dynfileqCurrent = NULL,
-        .dynamicFile = NULL,
-        .dynamicFileFd = -1,
-        .fuzzNo = fuzzNo,
-        .persistentSock = -1,
-        .tmOutSignaled = false,
-        .origFileName = "[DYNAMIC]",
+static void fuzz_checkExitUponCrash(honggfuzz_t* hfuzz) {
+    if (hfuzz->cfg.exitUponCrash && ATOMIC_GET(hfuzz->cnts.crashesCnt) > 0) {
+        LOG_I("Seen a crash. Terminating all fuzzing threads");
+        fuzz_setTerminating();
+    }
+}
+
+/* --threads_auto: how often the number of fuzzing threads is revised */
+#define _HF_AUTOSCALE_SECS 5
+/* Smaller changes of the total exec/sec (in %) are considered noise */
+#define _HF_AUTOSCALE_NOISE_PCT 3
+/* Above this average use of all CPUs (in %), they're considered saturated */
+#define _HF_AUTOSCALE_CPU_BUSY_PCT 90
+/* Parked threads check for termination at least that often */
+#define _HF_AUTOSCALE_PARK_MSEC 250
+
+/*
+ * --threads_auto: threads numbered at or above the limit are parked. Only after their dry runs,
+ * as the main phase starts once all of them are done with it
+ */
+static bool fuzz_isParked(run_t* run, uint32_t autoCnt) {
+    honggfuzz_t* hfuzz = run->global;
+    if (!hfuzz->threads.threadsAutoMax || run->fuzzNo < autoCnt) {
+        return false;
+    }
+    return (ATOMIC_GET(hfuzz->feedback.state) == _HF_STATE_STATIC || fuzz_isMainPhase(run));
+}
+
+static void fuzz_waitWhileParked(run_t* run) {
+    uint32_t* autoCnt = &run->global->threads.threadsAutoCnt;
+    for (;;) {
+        uint32_t cnt = ATOMIC_GET(*autoCnt);
+        if (fuzz_isTerminating() || !fuzz_isParked(run, cnt)) {
+            return;
+        }
+        util_futexWait(autoCnt, cnt, _HF_AUTOSCALE_PARK_MSEC);
+    }
+}
+
+/*
+ * Called periodically by the main thread. It's a hill climb: the number of fuzzing threads is
+ * changed in the same direction as long as the total exec/sec improves, and back when it gets
+ * worse. If it doesn't change, there are more threads only while the CPUs aren't all busy (e.g.
+ * with I/O-bound targets), and fewer otherwise (e.g. with memory bandwidth-bound ones)
+ */
+void fuzz_threadsAutoscale(honggfuzz_t* hfuzz) {
+    static struct {
+        time_t lastTime;
+        uint64_t lastExecs;
+        uint64_t lastRate;
+        cpuTimes_t cpuTimes;
+        int dir;
+    } as = {
+        .dir = 1,
     };
 
-    /* Do not try to handle input files with socketfuzzer */
-    if (!hfuzz->socketFuzzer.enabled) {
-        if (!(run.dynamicFile = files_mapSharedMem(hfuzz->mutate.maxFileSz, &run.dynamicFileFd,
-                  "hfuzz-input", /* nocore= */ true))) {
-            LOG_F("Couldn't create an input file of size: %zu", hfuzz->mutate.maxFileSz);
+    if (!hfuzz->threads.threadsAutoMax) {
+        return;
+    }
+    fuzzState_t state = ATOMIC_GET(hfuzz->feedback.state);
+    if (state != _HF_STATE_STATIC && state != _HF_STATE_DYNAMIC_MAIN) {
+        return;
+    }
+
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ncpus = (ncpus < 1) ? 1 : ncpus;
+    time_t now = time(NULL);
+    uint64_t execs = ATOMIC_GET(hfuzz->cnts.mutationsCnt);
+    if (as.lastTime == 0) {
+        as.lastTime = now;
+        as.lastExecs = execs;
+        util_getCpuUse(&as.cpuTimes, ncpus);
+        return;
+    }
+    if ((now - as.lastTime) < _HF_AUTOSCALE_SECS) {
+        return;
+    }
+
+    uint64_t rate = (execs - as.lastExecs) / (uint64_t)(now - as.lastTime);
+    unsigned cpuPct = util_getCpuUse(&as.cpuTimes, ncpus) / ncpus;
+    as.lastTime = now;
+    as.lastExecs = execs;
+
+    if (as.lastRate) {
+        if (rate * 100 < as.lastRate * (100 - _HF_AUTOSCALE_NOISE_PCT)) {
+            as.dir = -as.dir;
+        } else if (rate * 100 <= as.lastRate * (100 + _HF_AUTOSCALE_NOISE_PCT)) {
+            as.dir = (cpuPct < _HF_AUTOSCALE_CPU_BUSY_PCT) ? 1 : -1;
         }
     }
-    defer {
-        if (run.dynamicFileFd != -1) {
-            close(run.dynamicFileFd);
+    as.lastRate = rate;
+
+    size_t cur = ATOMIC_GET(hfuzz->threads.threadsAutoCnt);
+    size_t step = MAX(cur / 8, 1U);
+    size_t next = (as.dir > 0) ? MIN(cur + step, hfuzz->threads.threadsMax)
+                               : ((cur > step) ? cur - step : 1);
+    if (next == cur) {
+        /* At one of the bounds */
+        as.dir = -as.dir;
+        return;
+    }
+
+    LOG_D("Autoscaling: %zu -> %zu fuzzing threads (%" PRIu64 " exec/sec, CPU: %u%%)", cur, next,
+        rate, cpuPct);
+    ATOMIC_SET(hfuzz->threads.threadsAutoCnt, (uint32_t)next);
+    util_futexWake(&hfuzz->threads.threadsAutoCnt);
+}
+
+#if defined(_HF_ARCH_LINUX)
+
+/* Longest wait for events of the runs, the time limits of all of them are checked at least then */
+#define _HF_ASYNC_POLL_MSEC 100
+
+typedef enum {
+    _HF_ASYNC_IDLE = 0,
+    _HF_ASYNC_RUNNING,
+} asyncState_t;
+
+static void fuzz_asyncPoll(run_t* run, asyncState_t* state, size_t* running) {
+    if (!arch_reapPoll(run)) {
+        return;
+    }
+    subproc_runDone(run);
+    *state = _HF_ASYNC_IDLE;
+    (*running)--;
+
+    fuzz_fuzzLoopFinish(run);
+    fuzz_checkExitUponCrash(run->global);
+}
+
+/* How long to wait for the events of the runs: until the nearest time limit check is due */
+static int fuzz_asyncTimeout(run_t* runs, const asyncState_t* state, size_t cnt) {
+    int64_t now = util_timeNowMillis();
+    int64_t tmOut = _HF_ASYNC_POLL_MSEC;
+    for (size_t i = 0; i < cnt; i++) {
+        if (state[i] != _HF_ASYNC_RUNNING) {
+            continue;
         }
-    };
+        int64_t deadline = subproc_timeLimitDeadline(&runs[i]);
+        if (deadline) {
+            /* Past the deadline already, the process has been signaled, don't spin until it dies */
+            tmOut = MIN(tmOut, (deadline > now) ? (deadline - now + 1) : 10);
+        }
+    }
+    return (int)tmOut;
+}
 
-    if (!arch_archThreadInit(&run)) {
-        LOG_F("Could not initialize the thread");
+/*
+ * --async_runs: the thread drives the persistent processes of all of its runs at once. Inputs are
+ * prepared, and the feedback of finished runs is processed, while the other processes are busy,
+ * so the number of concurrently fuzzed processes is not bound to the number of threads
+ */
+static void fuzz_asyncLoop(run_t* runs, size_t cnt) {
+    honggfuzz_t* hfuzz = runs[0].global;
+    if (!arch_asyncInit(runs, cnt)) {
+        LOG_F("Couldn't initialize the asynchronous executor");
     }
+    asyncState_t* state = (asyncState_t*)util_Calloc(sizeof(asyncState_t) * cnt);
+    defer {
+        free(state);
+    };
 
+    size_t running = 0;
+    bool stopping = false;
+    int64_t polledAll = util_timeNowMillis();
     for (;;) {
-        /* Check if dry run mode with verifier enabled */
-        if (run.global->mutate.mutationsPerRun == 0U && run.global->cfg.useVerifier &&
-            !hfuzz->socketFuzzer.enabled) {
-            if (ATOMIC_POST_INC(run.global->cnts.mutationsCnt) >= run.global->io.fileCnt) {
+        /* A parked thread (--threads_auto) lets its processes finish, and starts no new ones */
+        bool parked = fuzz_isParked(&runs[0], ATOMIC_GET(hfuzz->threads.threadsAutoCnt));
+        for (size_t i = 0; i < cnt && !stopping && !parked; i++) {
+            run_t* run = &runs[i];
+            if (state[i] == _HF_ASYNC_RUNNING) {
+                continue;
+            }
+            if (fuzz_isTerminating() || !fuzz_nextIteration(hfuzz)) {
+                stopping = true;
                 break;
             }
+
+            fuzz_fuzzLoopReset(run);
+            uint64_t started = stats_start();
+            if (!fuzz_fetchInput(run)) {
+                LOG_F("Cound't prepare input for fuzzing");
+            }
+            stats_record(run, STATS_PHASE_MUTATE, started);
+
+            if (!subproc_runStart(run)) {
+                LOG_F("Couldn't run fuzzed command");
+            }
+            state[i] = _HF_ASYNC_RUNNING;
+            running++;
+            /* Sends the input to the process */
+            fuzz_asyncPoll(run, &state[i], &running);
+        }
+
+        if (running == 0) {
+            if (stopping) {
+                break;
+            }
+            if (parked) {
+                fuzz_waitWhileParked(&runs[0]);
+            }
+            continue;
+        }
+
+        run_t* ready[64];
+        size_t readyCnt =
+            arch_asyncWait(ready, ARRAYSIZE(ready), fuzz_asyncTimeout(runs, state, cnt));
+        for (size_t i = 0; i < readyCnt; i++) {
+            size_t idx = (size_t)(ready[i] - runs);
+            if (state[idx] == _HF_ASYNC_RUNNING) {
+                fuzz_asyncPoll(ready[i], &state[idx], &running);
+            } else {
+                arch_asyncDrain(ready[i]);
+            }
+        }
+        /*
+         * Time limits, and processes reaped by other runs of the thread, when there's no pidfd to
+         * report it (see arch_checkWait())
+         */
+        if (readyCnt == 0 || (util_timeNowMillis() - polledAll) >= _HF_ASYNC_POLL_MSEC) {
+            for (size_t i = 0; i < cnt; i++) {
+                if (state[i] == _HF_ASYNC_RUNNING) {
+                    fuzz_asyncPoll(&runs[i], &state[i], &running);
+                }
+            }
+            polledAll = util_timeNowMillis();
+        }
+    }
+}
+
+#else /* defined(_HF_ARCH_LINUX) */
+
+static void fuzz_asyncLoop(run_t* runs HF_ATTR_UNUSED, size_t cnt HF_ATTR_UNUSED) {
+    LOG_F("--async_runs is supported under Linux only");
+}
+
+#endif /* defined(_HF_ARCH_LINUX) */
+
+/* The fuzzing loop of a thread with a single run */
+static void fuzz_threadLoop(run_t* run, bool trimmer) {
+    honggfuzz_t* hfuzz = run->global;
+    for (;;) {
+        if (trimmer) {
+            fuzz_trimLoop(run);
+            break;
         }
-        /* Check for max iterations limit if set */
-        else if ((ATOMIC_POST_INC(run.global->cnts.mutationsCnt) >=
-                     run.global->mutate.mutationsMax) &&
-                 run.global->mutate.mutationsMax) {
+        fuzz_waitWhileParked(run);
+        if (fuzz_isTerminating() || !fuzz_nextIteration(hfuzz)) {
             break;
         }
 
-        if (hfuzz->socketFuzzer.enabled) {
-            fuzz_fuzzLoopSocket(&run);
+        if (hfuzz->cfg.useVerifier && fuzz_verifyQueued(run, /* force= */ false)) {
+            continue;
+        }
+
+        if (hfuzz->cfg.minimize) {
+            if (!fuzz_minimizeLoop(run)) {
+                break;
+            }
+        } else if (hfuzz->cfg.minimizeCrash) {
+            if (!fuzz_minimizeCrashLoop(run)) {
+                break;
+            }
+        } else if (hfuzz->socketFuzzer.enabled) {
+            fuzz_fuzzLoopSocket(run);
         } else {
-            fuzz_fuzzLoop(&run);
+            fuzz_fuzzLoop(run);
         }
 
         if (fuzz_isTerminating()) {
             break;
         }
 
-        if (run.global->cfg.exitUponCrash && ATOMIC_GET(run.global->cnts.crashesCnt) > 0) {
-            LOG_I("Seen a crash. Terminating all fuzzing threads");
-            fuzz_setTerminating();
+        fuzz_checkExitUponCrash(hfuzz);
+        if (fuzz_isTerminating()) {
             break;
         }
     }
 
-    if (run.pid) {
-        kill(run.pid, SIGKILL);
+    /* Crashes found by the last iterations are still waiting for the verification */
+    while (hfuzz->cfg.useVerifier && !fuzz_isTerminating() &&
+           fuzz_verifyQueued(run, /* force= */ true)) {
+    }
+    if (hfuzz->cfg.useVerifier) {
+        fuzz_verifyReportQueued(run);
+    }
+}
+
+/* 'fuzzNo' is the index of the run's entries in the shared feedback map (pidFeedback[] etc.) */
+static void fuzz_runInit(honggfuzz_t* hfuzz, run_t* run, uint32_t fuzzNo, bool trimmer) {
+    *run = (run_t){
+        .global = hfuzz,
+        .pid = 0,
+        .feedbackMap = hfuzz->feedback.feedbackMap,
+        .feedbackFd = hfuzz->feedback.bbFd,
+        .dynfileqCurrent = SIZE_MAX,
+        .dynamicFile = NULL,
+        .dynamicFileFd = -1,
+        .fuzzNo = fuzzNo,
+        .asyncRuns = NULL,
+        .asyncCnt = 0,
+        .persistentSock = -1,
+        .persistentShm = false,
+        .snapshotPid = 0,
+        .batchHdr = NULL,
+        .batchHdrSz = 0,
+        .batchFd = -1,
+        .batchCnt = 0,
+        .batchCapable = false,
+        .mainPhase = false,
+        .tmOutSignaled = false,
+        .origFileName = "[DYNAMIC]",
+    };
+
+    /* Before the buffers get mapped, as it might set the CPU affinity of this thread */
+    if (!arch_archThreadInit(run)) {
+        LOG_F("Could not initialize the thread");
     }
 
-    size_t j = ATOMIC_PRE_INC(run.global->threads.threadsFinished);
+    /* Coverage signatures of separate inputs are taken from the thread's own map */
+    if (hfuzz->cfg.minimize || trimmer) {
+        if (!(run->feedbackMap = fuzz_feedbackMapNew(hfuzz, &run->feedbackFd))) {
+            LOG_F("Couldn't create the feedback map of size: %zu", sizeof(feedback_t));
+        }
+        ATOMIC_SET(run->feedbackMap->guardsRearm, 1U);
+    }
+
+    /* Do not try to handle input files with socketfuzzer */
+    if (!hfuzz->socketFuzzer.enabled) {
+        /* Resized with ftruncate() for every input, so it can't use hugetlbfs */
+        if (!(run->dynamicFile = files_mapSharedMem(hfuzz->mutate.maxFileSz, &run->dynamicFileFd,
+                  "hfuzz-input", /* nocore= */ true,
+                  hfuzz->feedback.hugePages ? FILES_HUGE_THP : FILES_HUGE_NONE))) {
+            LOG_F("Couldn't create an input file of size: %zu", hfuzz->mutate.maxFileSz);
+        }
+    }
+
+    if (hfuzz->exe.persistentBatch > 1) {
+        run->batchHdrSz = sizeof(batchHdr_t) + hfuzz->exe.persistentBatch * hfuzz->mutate.maxFileSz;
+        if (!(run->batchHdr = files_mapSharedMem(run->batchHdrSz, &run->batchFd, "hfuzz-batch",
+                  /* nocore= */ true,
+                  hfuzz->feedback.hugePages ? FILES_HUGE_THP : FILES_HUGE_NONE))) {
+            LOG_F("Couldn't create a batch input file of size: %zu", run->batchHdrSz);
+        }
+    }
+
+    /* Operands are looked for in the input, so it's only used with internally generated inputs */
+    if (hfuzz->mutate.cmpLog && !hfuzz->cfg.minimize && !hfuzz->cfg.minimizeCrash &&
+        !hfuzz->socketFuzzer.enabled && !trimmer) {
+        ATOMIC_SET(run->feedbackMap->cmpLog[fuzzNo].enabled, 1U);
+    }
+}
+
+static void fuzz_runFini(run_t* run) {
+    if (run->pid) {
+        kill(run->pid, SIGKILL);
+    }
+    if (run->batchFd != -1) {
+        close(run->batchFd);
+    }
+    if (run->dynamicFileFd != -1) {
+        close(run->dynamicFileFd);
+    }
+    if (run->feedbackFd != run->global->feedback.bbFd) {
+        close(run->feedbackFd);
+    }
+}
+
+static void* fuzz_threadNew(void* arg) {
+    honggfuzz_t* hfuzz = (honggfuzz_t*)arg;
+    unsigned int fuzzNo = ATOMIC_POST_INC(hfuzz->threads.threadsActiveCnt);
+    LOG_I("Launched new fuzzing thread, no. #%" PRId32, fuzzNo);
+    if (hfuzz->cfg.seedSet) {
+        /* Stream #0 is used by the main thread */
+        util_rndSeed(hfuzz->cfg.seed, hfuzz->cfg.nodeId, (uint64_t)fuzzNo + 1);
+    }
+
+    /* The last thread trims the new corpus entries (--trim) instead of fuzzing */
+    bool trimmer = hfuzz->cfg.trim && (fuzzNo == hfuzz->threads.threadsMax - 1);
+
+    size_t runsCnt = (hfuzz->threads.asyncRuns > 1 && !trimmer) ? hfuzz->threads.asyncRuns : 1;
+    run_t* runs = (run_t*)util_Calloc(sizeof(run_t) * runsCnt);
+    defer {
+        free(runs);
+    };
+    for (size_t i = 0; i < runsCnt; i++) {
+        /* Further runs of a thread are numbered after the first runs of all threads */
+        uint32_t no = (i == 0) ? fuzzNo
+                               : (uint32_t)(hfuzz->threads.threadsMax + fuzzNo * (runsCnt - 1) +
+                                            i - 1);
+        fuzz_runInit(hfuzz, &runs[i], no, trimmer);
+        if (runsCnt > 1) {
+            runs[i].asyncRuns = runs;
+            runs[i].asyncCnt = runsCnt;
+        }
+    }
+
+    if (runsCnt > 1) {
+        fuzz_asyncLoop(runs, runsCnt);
+    } else {
+        fuzz_threadLoop(&runs[0], trimmer);
+    }
+
+    for (size_t i = 0; i < runsCnt; i++) {
+        fuzz_runFini(&runs[i]);
+    }
+
+    size_t j = ATOMIC_PRE_INC(hfuzz->threads.threadsFinished);
     LOG_I("Terminating thread no. #%" PRId32 ", left: %zu", fuzzNo, hfuzz->threads.threadsMax - j);
     return NULL;
 }
@@ -542,10 +1581,19 @@ void fuzz_threadsStart(honggfuzz_t* hfuzz) {
         LOG_F("Couldn't prepare sanitizer options");
     }
 
-    if (hfuzz->socketFuzzer.enabled) {
+    if (hfuzz->cfg.minimize) {
+        LOG_I("Entering phase: Corpus Minimization");
+        hfuzz->feedback.state = _HF_STATE_MINIMIZE;
+    } else if (hfuzz->cfg.minimizeCrash) {
+        LOG_I("Entering phase: Crash Minimization");
+        hfuzz->feedback.state = _HF_STATE_MINIMIZE_CRASH;
+    } else if (hfuzz->socketFuzzer.enabled) {
         /* Don't do dry run with socketFuzzer */
         LOG_I("Entering phase - Feedback Driven Mode (SocketFuzzer)");
         hfuzz->feedback.state = _HF_STATE_DYNAMIC_MAIN;
+    } else if (hfuzz->checkpoint.resumed) {
+        LOG_I("Entering phase 3/3: Dynamic Main (resumed from '%s')", hfuzz->checkpoint.path);
+        hfuzz->feedback.state = _HF_STATE_DYNAMIC_MAIN;
     } else if (hfuzz->feedback.dynFileMethod != _HF_DYNFILE_NONE) {
         LOG_I("Entering phase 1/3: Dry Run");
         hfuzz->feedback.state = _HF_STATE_DYNAMIC_DRY_RUN;
@@ -554,6 +1602,11 @@ void fuzz_threadsStart(honggfuzz_t* hfuzz) {
         hfuzz->feedback.state = _HF_STATE_STATIC;
     }
 
+    if (!hfuzz->socketFuzzer.enabled &&
+        !subproc_runThread(hfuzz, &covq.thread, fuzz_covWriterThread, /* joinable= */ true)) {
+        PLOG_F("Couldn't run the coverage writer thread");
+    }
+
     for (size_t i = 0; i < hfuzz->threads.threadsMax; i++) {
         if (!subproc_runThread(
                 hfuzz, &hfuzz->threads.threads[i], fuzz_threadNew, /* joinable= */ true)) {
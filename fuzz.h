@@ -29,8 +29,15 @@
 #include "honggfuzz.h"
 
 extern void fuzz_threadsStart(honggfuzz_t* fuzz);
+/* --threads_auto: adjusts the number of fuzzing threads, called periodically */
+extern void fuzz_threadsAutoscale(honggfuzz_t* hfuzz);
+extern void fuzz_covWriterStop(void);
 extern bool fuzz_isTerminating(void);
 extern void fuzz_setTerminating(void);
 extern bool fuzz_shouldTerminate(void);
+/* The shared feedback map, its pcGuardMap initially covers (almost) no guards */
+extern feedback_t* fuzz_feedbackMapNew(honggfuzz_t* hfuzz, int* fd);
+/* Makes at least 'len' bytes of pcGuardMap accessible */
+extern bool fuzz_feedbackGrowGuardMap(int fd, feedback_t* fb, size_t len);
 
 #endif
@@ -79,6 +79,20 @@ static bool useM32() {
     return false;
 }
 
+static bool use8bitCounters() {
+    if (getenv("HFUZZ_CC_8BIT_COUNTERS")) {
+        return true;
+    }
+    return false;
+}
+
+static bool usePcTable() {
+    if (getenv("HFUZZ_CC_PC_TABLE")) {
+        return true;
+    }
+    return false;
+}
+
 static bool useBelowGCC8() {
     if (getenv("HFUZZ_CC_USE_GCC_BELOW_8")) {
         return true;
@@ -86,6 +100,29 @@ static bool useBelowGCC8() {
     return false;
 }
 
+/*
+ * HFUZZ_CC_PROFILE selects how much is instrumented:
+ *   full (default): all the coverage and comparison feedback, with inlining disabled
+ *   light: no trace-gep/trace-div, inlining and builtins are kept (except for the *cmp functions,
+ *          which libhfuzz intercepts), for faster targets
+ */
+typedef enum {
+    HF_CC_PROFILE_FULL = 0,
+    HF_CC_PROFILE_LIGHT,
+} ccProfile_t;
+
+static ccProfile_t getProfile() {
+    const char* profile = getenv("HFUZZ_CC_PROFILE");
+    if (!profile || strcmp(profile, "full") == 0) {
+        return HF_CC_PROFILE_FULL;
+    }
+    if (strcmp(profile, "light") == 0) {
+        return HF_CC_PROFILE_LIGHT;
+    }
+    LOG_W("Unknown HFUZZ_CC_PROFILE='%s' (expected 'full' or 'light'), using 'full'", profile);
+    return HF_CC_PROFILE_FULL;
+}
+
 static bool isLDMode(int argc, char** argv) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--version") == 0) {
@@ -299,7 +336,37 @@ static char* getLibHFCommonPath() {
     return path;
 }
 
+/*
+ * HFUZZ_CC_ALLOWLIST/HFUZZ_CC_DENYLIST: files in the sanitizer special case list format
+ * (src:/fun: entries), which limit the instrumentation to (or exclude from it) the listed source
+ * files and functions. Requires clang-12+
+ */
+static void covListOpts(int* j, char** args) {
+    static char allowlist[PATH_MAX + 64];
+    static char denylist[PATH_MAX + 64];
+
+    const char* allow = getenv("HFUZZ_CC_ALLOWLIST");
+    const char* deny = getenv("HFUZZ_CC_DENYLIST");
+    if (!allow && !deny) {
+        return;
+    }
+    if (isGCC) {
+        LOG_W("HFUZZ_CC_ALLOWLIST/HFUZZ_CC_DENYLIST are not supported by gcc, ignoring them");
+        return;
+    }
+    if (allow) {
+        snprintf(allowlist, sizeof(allowlist), "-fsanitize-coverage-allowlist=%s", allow);
+        args[(*j)++] = allowlist;
+    }
+    if (deny) {
+        snprintf(denylist, sizeof(denylist), "-fsanitize-coverage-ignorelist=%s", deny);
+        args[(*j)++] = denylist;
+    }
+}
+
 static void commonOpts(int* j, char** args) {
+    ccProfile_t profile = getProfile();
+
     args[(*j)++] = getIncPaths();
     if (isGCC) {
         if (useBelowGCC8()) {
@@ -311,17 +378,47 @@ static void commonOpts(int* j, char** args) {
         }
     } else {
         args[(*j)++] = "-Wno-unused-command-line-argument";
-        args[(*j)++] = "-fsanitize-coverage=trace-pc-guard,trace-cmp,trace-div,indirect-calls,trace-gep";
+        if (profile == HF_CC_PROFILE_LIGHT) {
+            args[(*j)++] = use8bitCounters()
+                               ? "-fsanitize-coverage=inline-8bit-counters,trace-cmp,indirect-calls"
+                               : "-fsanitize-coverage=trace-pc-guard,trace-cmp,indirect-calls";
+        } else if (use8bitCounters()) {
+            /* Hit-counts of edges, classified into buckets by libhfuzz after each iteration */
+            args[(*j)++] =
+                "-fsanitize-coverage=inline-8bit-counters,trace-cmp,trace-div,indirect-calls,"
+                "trace-gep";
+        } else {
+            args[(*j)++] =
+                "-fsanitize-coverage=trace-pc-guard,trace-cmp,trace-div,indirect-calls,trace-gep";
+        }
         args[(*j)++] = "-mllvm";
         args[(*j)++] = "-sanitizer-coverage-level=3";
+        /* PCs of the guards/counters, registered with honggfuzz for --export_cov */
+        if (usePcTable()) {
+            args[(*j)++] = "-fsanitize-coverage=pc-table";
+        }
+    }
+    covListOpts(j, args);
+
+    if (profile == HF_CC_PROFILE_LIGHT) {
+        /* Comparisons done by these are still reported by the libhfuzz wrappers */
+        args[(*j)++] = "-fno-builtin-memcmp";
+        args[(*j)++] = "-fno-builtin-bcmp";
+        args[(*j)++] = "-fno-builtin-strcmp";
+        args[(*j)++] = "-fno-builtin-strncmp";
+        args[(*j)++] = "-fno-builtin-strcasecmp";
+        args[(*j)++] = "-fno-builtin-strncasecmp";
+        args[(*j)++] = "-fno-builtin-strstr";
+        args[(*j)++] = "-fno-builtin-strcasestr";
+        args[(*j)++] = "-fno-builtin-memmem";
+    } else {
+        /*
+         * Make the execution flow more explicit, allowing for more code blocks
+         * (and better code coverage estimates)
+         */
+        args[(*j)++] = "-fno-inline";
+        args[(*j)++] = "-fno-builtin";
     }
-
-    /*
-     * Make the execution flow more explicit, allowing for more code blocks
-     * (and better code coverage estimates)
-     */
-    args[(*j)++] = "-fno-inline";
-    args[(*j)++] = "-fno-builtin";
     args[(*j)++] = "-fno-omit-frame-pointer";
     args[(*j)++] = "-D__NO_STRING_INLINES";
 
@@ -414,6 +511,13 @@ static int ldMode(int argc, char** argv) {
     /* Some Samba functions */
     args[j++] = "-Wl,--wrap=memcmp_const_time";
     args[j++] = "-Wl,--wrap=strcsequal";
+    /*
+     * The fork-server (--forkserver) is started right before main(), see libhfuzz/forkserver.c.
+     * The only reference to main() is then the (weak) one of libhfuzz, which doesn't pull the
+     * default main() of libhfuzz (for LLVMFuzzerTestOneInput() programs) from the archive
+     */
+    args[j++] = "-Wl,--wrap=main";
+    args[j++] = "-Wl,-u,main";
 #endif /* _HF_ARCH_DARWIN */
 
     /* Pull modules defining the following symbols (if they exist) */
@@ -421,10 +525,12 @@ static int ldMode(int argc, char** argv) {
     args[j++] = "-Wl,-U,_HonggfuzzNetDriver_main";
     args[j++] = "-Wl,-U,_LIBHFUZZ_module_instrument";
     args[j++] = "-Wl,-U,_LIBHFUZZ_module_memorycmp";
+    args[j++] = "-Wl,-U,_LIBHFUZZ_module_forkserver";
 #else  /* _HF_ARCH_DARWIN */
     args[j++] = "-Wl,-u,HonggfuzzNetDriver_main";
     args[j++] = "-Wl,-u,LIBHFUZZ_module_instrument";
     args[j++] = "-Wl,-u,LIBHFUZZ_module_memorycmp";
+    args[j++] = "-Wl,-u,LIBHFUZZ_module_forkserver";
 #endif /* _HF_ARCH_DARWIN */
 
     for (int i = 1; i < argc; i++) {
@@ -441,6 +547,10 @@ static int ldMode(int argc, char** argv) {
 #if !defined(_HF_ARCH_DARWIN) && !defined(__OpenBSD__)
     args[j++] = "-lrt";
 #endif /* !defined(_HF_ARCH_DARWIN) && !defined(__OpenBSD__) */
+#if defined(_HF_ARCH_LINUX)
+    /* dladdr() of --export_cov, it's in libc with newer glibc versions only */
+    args[j++] = "-ldl";
+#endif /* defined(_HF_ARCH_LINUX) */
 
     /* Disable -fsanitize=fuzzer */
     if (isFSanitizeFuzzer(argc, argv)) {
@@ -35,7 +35,10 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "checkpoint.h"
 #include "cmdline.h"
+#include "corpus.h"
+#include "covexport.h"
 #include "display.h"
 #include "fuzz.h"
 #include "input.h"
@@ -43,8 +46,17 @@
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
+#include "minimize.h"
+#include "mutator.h"
 #include "socketfuzzer.h"
+#include "stats.h"
 #include "subproc.h"
+#include "sync.h"
+
+#if defined(_HF_ARCH_LINUX)
+#include "linux/cgroup.h"
+#include "linux/trace.h"
+#endif
 
 static int sigReceived = 0;
 static bool clearWin = false;
@@ -280,6 +292,10 @@ static void mainThreadLoop(honggfuzz_t* hfuzz) {
             LOG_I("Maximum run time reached, terminating");
             break;
         }
+        checkpoint_periodic(hfuzz);
+        covexport_periodic(hfuzz);
+        input_reloadBlacklist(hfuzz);
+        fuzz_threadsAutoscale(hfuzz);
         pingThreads(hfuzz);
         pause();
     }
@@ -313,6 +329,9 @@ int main(int argc, char** argv) {
     if (cmdlineParse(argc, myargs, &hfuzz) == false) {
         LOG_F("Parsing of the cmd-line arguments failed");
     }
+    if (hfuzz.cfg.seedSet) {
+        util_rndSeed(hfuzz.cfg.seed, hfuzz.cfg.nodeId, /* stream= */ 0);
+    }
 
     if (hfuzz.display.useScreen) {
         display_init();
@@ -322,6 +341,10 @@ int main(int argc, char** argv) {
         LOG_I("No input file corpus loaded, the external socket_fuzzer is responsible for "
               "creating the fuzz data");
         setupSocketFuzzer(&hfuzz);
+    } else if (hfuzz.cfg.minimizeCrash) {
+        if (!minimize_crashInit(&hfuzz)) {
+            LOG_F("Couldn't load the crash reproducer ('%s')", hfuzz.cfg.minimizeCrash);
+        }
     } else if (!input_init(&hfuzz)) {
         LOG_F("Couldn't load input corpus");
         exit(EXIT_FAILURE);
@@ -330,6 +353,12 @@ int main(int argc, char** argv) {
     if (hfuzz.mutate.dictionaryFile && (input_parseDictionary(&hfuzz) == false)) {
         LOG_F("Couldn't parse dictionary file ('%s')", hfuzz.mutate.dictionaryFile);
     }
+    if (hfuzz.mutate.cmpLog) {
+        input_initCmpLogDict(&hfuzz);
+    }
+    if (!mutator_init(&hfuzz)) {
+        LOG_F("Couldn't load the custom mutator ('%s')", hfuzz.mutate.custom.lib);
+    }
 
     if (hfuzz.feedback.blacklistFile && (input_parseBlacklist(&hfuzz) == false)) {
         LOG_F("Couldn't parse stackhash blacklist file ('%s')", hfuzz.feedback.blacklistFile);
@@ -345,13 +374,27 @@ int main(int argc, char** argv) {
         LOG_F("Couldn't parse symbols whitelist file ('%s')", hfuzzl.symsWlFile);
     }
 
-    if (!(hfuzz.feedback.feedbackMap = files_mapSharedMem(
-              sizeof(feedback_t), &hfuzz.feedback.bbFd, "hfuzz-feedback", /* nocore= */ true))) {
+    if (!(hfuzz.feedback.feedbackMap = fuzz_feedbackMapNew(&hfuzz, &hfuzz.feedback.bbFd))) {
         LOG_F("files_mapSharedMem(sz=%zu, dir='%s') failed", sizeof(feedback_t), hfuzz.io.workDir);
     }
 
     setupRLimits();
     setupSignalsPreThreads();
+    if (!stats_init(&hfuzz)) {
+        LOG_F("Couldn't start the stats endpoint ('%s')", hfuzz.display.statsSocket);
+    }
+    if (!checkpoint_load(&hfuzz)) {
+        LOG_F("Couldn't resume from the checkpoint ('%s')", hfuzz.checkpoint.path);
+    }
+    if (!sync_init(&hfuzz)) {
+        LOG_F("Couldn't initialize the corpus sync");
+    }
+    if (!covexport_init(&hfuzz)) {
+        LOG_F("Couldn't initialize the coverage export ('%s')", hfuzz.feedback.covExportFile);
+    }
+    if (!logAsyncStart()) {
+        LOG_W("Couldn't start the log writer thread, logging synchronously");
+    }
     fuzz_threadsStart(&hfuzz);
 
     pthread_t sigthread;
@@ -360,12 +403,28 @@ int main(int argc, char** argv) {
     }
 
     mainThreadLoop(&hfuzz);
+    checkpoint_save(&hfuzz);
+    covexport_close(&hfuzz);
+    /* fuzz_isTerminating() is always true here, the threads have been stopped */
+    if (hfuzz.cfg.minimize && ATOMIC_GET(sigReceived) == 0 && !minimize_finish(&hfuzz)) {
+        LOG_E("Couldn't save the minimized corpus");
+    }
+    /* The best reproducer found so far is saved even if interrupted */
+    if (hfuzz.cfg.minimizeCrash && !minimize_crashFinish(&hfuzz)) {
+        LOG_E("Couldn't minimize the crash reproducer ('%s')", hfuzz.cfg.minimizeCrash);
+    }
+    if (!hfuzz.socketFuzzer.enabled) {
+        fuzz_covWriterStop();
+    }
+    corpus_close();
 
     /* Clean-up global buffers */
     if (hfuzz.feedback.blacklist) {
         free(hfuzz.feedback.blacklist);
     }
 #if defined(_HF_ARCH_LINUX)
+    arch_traceTriageClose();
+    arch_cgroupClose(&hfuzz);
     if (hfuzz.linux.symsBl) {
         free(hfuzz.linux.symsBl);
     }
@@ -385,6 +444,9 @@ int main(int argc, char** argv) {
     }
 
     printSummary(&hfuzz);
+    stats_close(&hfuzz);
+    sync_close(&hfuzz);
+    logAsyncStop();
 
     return EXIT_SUCCESS;
 }
@@ -31,7 +31,6 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/param.h>
-#include <sys/queue.h>
 #include <sys/types.h>
 #include <time.h>
 
@@ -45,6 +44,8 @@
 
 /* Default name of the report created with some architectures */
 #define _HF_REPORT_FILE "HONGGFUZZ.REPORT.TXT"
+/* ... and its name with --report_json */
+#define _HF_REPORT_JSON_FILE "HONGGFUZZ.REPORT.JSONL"
 
 /* Default stack-size of created threads. */
 #define _HF_PTHREAD_STACKSIZE (1024ULL * 1024ULL * 2ULL) /* 2MB */
@@ -55,11 +56,37 @@
 /* Name of envvar which indicates that the netDriver should be used */
 #define _HF_THREAD_NETDRIVER_ENV "HFUZZ_USE_NETDRIVER"
 
+/* Name of envvar which indicates that new PCs should be merged into the feedback map in batches */
+#define _HF_LOCAL_COV_ENV "HFUZZ_LOCAL_COV"
+
+/* Name of envvar which indicates that libhfuzz should run the fork-server (--forkserver) */
+#define _HF_FORKSERVER_ENV "HFUZZ_FORKSERVER"
+
+/* Name of envvar which indicates that the persistent process should keep a template (--snapshot) */
+#define _HF_SNAPSHOT_ENV "HFUZZ_SNAPSHOT"
+
+/* Name of envvar which indicates that the fork-server should provide inputs via stdin pipes */
+#define _HF_STDIN_PIPE_ENV "HFUZZ_STDIN_PIPE"
+
+/* Name of envvar which indicates that netdriver should join the namespaces at _HF_NS_FD (Linux) */
+#define _HF_NS_FD_ENV "HFUZZ_NS_FD"
+
+/* Name of envvar which indicates that crashes should be described in crashRec_t (Linux) */
+#define _HF_INPROC_CRASH_ENV "HFUZZ_INPROC_CRASH"
+
 /* Name of envvar which indicates honggfuzz's log level in use */
 #define _HF_LOG_LEVEL_ENV "HFUZZ_LOG_LEVEL"
 
+/* Map the feedback structure with huge pages (--linux_huge_pages) */
+#define _HF_HUGE_PAGES_ENV "HFUZZ_HUGE_PAGES"
+
 /* Number of crash verifier iterations before tag crash as stable */
 #define _HF_VERIFIER_ITER 5
+/* ... but the crash is tagged as stable early, once this many runs in a row have matched */
+#define _HF_VERIFIER_STABLE_ITER 3
+/* At most 1/_HF_VERIFIER_THREADS_DIV of fuzzing threads verify crashes at the same time */
+#define _HF_VERIFIER_THREADS_DIV 4
+#define _HF_VERIFIER_QUEUE_MAX 64
 
 /* Size (in bytes) for report data to be stored in stack before written to file */
 #define _HF_REPORT_SIZE 8192
@@ -67,12 +94,40 @@
 /* Perf bitmap size */
 #define _HF_PERF_BITMAP_SIZE_16M (1024U * 1024U * 16U)
 #define _HF_PERF_BITMAP_BITSZ_MASK 0x7FFFFFFULL
+/* Default size of the perf AUX area (Intel BTS/PT) */
+#define _HF_PERF_AUX_SZ (1024 * 1024)
 /* Maximum number of PC guards (=trace-pc-guard) we support */
 #define _HF_PC_GUARD_MAX (1024ULL * 1024ULL * 64ULL)
+/* Maximum number of edge counters (=inline-8bit-counters) we support */
+#define _HF_PC_CNT_MAX (1024ULL * 1024ULL * 16ULL)
+/* Maximum number of distinct comparison sites (trace-cmp, trace-div, trace-gep, *cmp wrappers) */
+#define _HF_CMP_SITE_ID_BITS 20
+#define _HF_CMP_SITES_MAX (1U << _HF_CMP_SITE_ID_BITS)
+/* Slots (8 bytes each) of the (open addressing) cmp site registry, 2x the max. number of sites */
+#define _HF_CMP_SITES_HT_BITS (_HF_CMP_SITE_ID_BITS + 1)
+#define _HF_CMP_SITES_HT (1U << _HF_CMP_SITES_HT_BITS)
 
 /* Maximum size of the input file in bytes (128 MiB) */
 #define _HF_INPUT_MAX_SIZE (1024ULL * 1024ULL * 128ULL)
 
+/* Max. number of --linux_perf_ipt_filter_dso objects */
+#define _HF_PERF_FILTERS_MAX 8
+
+/* Max. number of --sync_peer nodes */
+#define _HF_SYNC_PEERS_MAX 32
+
+/* Buckets of the (log2, 4 per octave) histograms of exec times in usecs, up to ~70 min. */
+#define _HF_EXEC_TIMES_BUCKETS 128
+
+/* FD of the PC tables of the coverage (--export_cov), see covPcs_t */
+#define _HF_COV_PCS_FD 1012
+/* FDs of the namespaces created for netdriver targets, from _HF_NS_FD to _HF_NS_FD+_HF_NS_CNT-1 */
+#define _HF_NS_FD 1013
+#define _HF_NS_CNT 5
+/* FD of the KCOV (--linux_kcov) instance of the fuzzing thread */
+#define _HF_KCOV_FD 1018
+/* FD used to pass batches of inputs to a persistent process */
+#define _HF_BATCH_FD 1019
 /* FD used to log inside the child process */
 #define _HF_LOG_FD 1020
 /* FD used to represent the input file */
@@ -85,9 +140,25 @@
 /* Message indicating that the fuzzed process is ready for new data */
 static const uint8_t HFReadyTag = 'R';
 
+/* Size of the CPU cache line */
+#define _HF_CACHELINE_SZ 64U
+
 /* Maximum number of active fuzzing threads */
 #define _HF_THREAD_MAX 1024U
 
+/* The dynamic corpus is stored in lazily-allocated segments of _HF_DYNFILE_SEG_SZ entries */
+#define _HF_DYNFILE_SEG_SHIFT 12U
+#define _HF_DYNFILE_SEG_SZ (1U << _HF_DYNFILE_SEG_SHIFT)
+/* Maximum number of segments, i.e. at most 4M inputs in the dynamic corpus */
+#define _HF_DYNFILE_SEG_MAX 1024U
+
+/* Maximum number of coverage files waiting to be written by the coverage writer thread */
+#define _HF_COVQ_SZ 256U
+
+/* --trim: max. number of corpus entries waiting to be trimmed, and of executions per entry */
+#define _HF_TRIMQ_SZ 1024U
+#define _HF_TRIM_EXECS_MAX 1024U
+
 /* Persistent-binary signature - if found within file, it means it's a persistent mode binary */
 #define _HF_PERSISTENT_SIG "\x01_LIBHFUZZ_PERSISTENT_BINARY_SIGNATURE_\x02\xFF"
 /* HF NetDriver signature - if found within file, it means it's a NetDriver-based binary */
@@ -100,6 +171,7 @@ typedef enum {
     _HF_DYNFILE_BTS_EDGE = 0x10,
     _HF_DYNFILE_IPT_BLOCK = 0x20,
     _HF_DYNFILE_SOFT = 0x40,
+    _HF_DYNFILE_KCOV = 0x80,
 } dynFileMethod_t;
 
 typedef struct {
@@ -151,35 +223,250 @@ typedef enum {
     _HF_STATE_DYNAMIC_DRY_RUN = 2,
     _HF_STATE_DYNAMIC_SWITCH_TO_MAIN = 3,
     _HF_STATE_DYNAMIC_MAIN = 4,
+    _HF_STATE_MINIMIZE = 5,
+    _HF_STATE_MINIMIZE_CRASH = 6,
 } fuzzState_t;
 
+typedef enum {
+    _HF_SCHED_RR = 0,
+    _HF_SCHED_WEIGHTED = 1,
+} dynfileSched_t;
+
+/* Clock of the iteration phase histograms, see stats.h */
+typedef enum {
+    _HF_PHASE_CLOCK_NONE = 0,
+    _HF_PHASE_CLOCK_MONOTONIC = 1,
+    _HF_PHASE_CLOCK_MONOTONIC_RAW = 2,
+    _HF_PHASE_CLOCK_TSC = 3,
+} phaseClock_t;
+
+/*
+ * Stack hashes blacklist (--stackhash_bl): open-addressing set, with the hash function chosen when
+ * it's built so that no entry is further than maxProbe slots away from its home slot
+ */
+typedef struct {
+    uint64_t mul;
+    unsigned shift;
+    size_t maxProbe;
+    size_t cnt;
+    uint64_t slots[];
+} stackHashBl_t;
+
 struct dynfile_t {
     uint8_t* data;
     size_t size;
-    TAILQ_ENTRY(dynfile_t)
-    pointers;
+    /* Index in the dynamic corpus */
+    size_t idx;
+    /* Content hash (also the name of the coverage file), see util_CRC64() and util_CRC64Rev() */
+    uint64_t crc64f;
+    uint64_t crc64r;
+    /* Scheduler metadata */
+    uint64_t timeExecUSecs;
+    uint64_t newCov;
+    uint64_t picked;
 };
 
-struct strings_t {
-    char* s;
-    size_t len;
-    TAILQ_ENTRY(strings_t)
-    pointers;
-};
+/*
+ * Per-thread coverage counters, padded to a full cache line, so fuzzed processes belonging to
+ * different fuzzing threads don't share (and bounce) cache lines when updating them
+ */
+typedef struct {
+    uint64_t pc;
+    uint64_t edge;
+    uint64_t cmp;
+} __attribute__((aligned(_HF_CACHELINE_SZ))) pidFeedback_t;
+_Static_assert(sizeof(pidFeedback_t) == _HF_CACHELINE_SZ, "pidFeedback_t must fill a cache line");
 
+/*
+ * Per-thread persistent mode handshake. The fuzzer and the persistent process poll 'state' for a
+ * short while, and only fall back to sleeping (on the socket/SIGIO, or on a futex) when the other
+ * side is slow, announcing it via 'parentWaiting' / 'childWaiting'
+ */
+#define _HF_PERSISTENT_NONE 0U
+#define _HF_PERSISTENT_READY 1U
+#define _HF_PERSISTENT_DATA 2U
 typedef struct {
-    bool pcGuardMap[_HF_PC_GUARD_MAX];
+    uint32_t state;
+    uint32_t parentWaiting;
+    uint32_t childWaiting;
+    /* With --snapshot: the current worker, forked from the template (the process started by us) */
+    pid_t workerPid;
+    /* Set by LLVMFuzzerTestOneInput()-style processes, which can process batches of inputs */
+    uint32_t batchCapable;
+    uint64_t len;
+} __attribute__((aligned(_HF_CACHELINE_SZ))) persistentCtl_t;
+
+/*
+ * Header of the --persistent_batch input region, the inputs follow it. The persistent process
+ * records the new coverage found by every input separately, and the index of the input which is
+ * being processed, so crashes can be attributed to it
+ */
+#define _HF_BATCH_MAX 64U
+typedef struct {
+    uint64_t cnt;
+    uint64_t done;
+    uint64_t off[_HF_BATCH_MAX];
+    uint64_t len[_HF_BATCH_MAX];
+    pidFeedback_t cov[_HF_BATCH_MAX];
+} batchHdr_t;
+
+/*
+ * Operands of comparisons which didn't match (integer ones, and of memcmp()/strcmp()-like
+ * functions), logged by the instrumented processes with --cmplog. The fuzzer turns them into
+ * dictionary entries, and resets the ring after every run. Up to _HF_CMPLOG_MAX entries are logged
+ * per run, and repeated (call-site, operands) pairs are dropped with the 'seen' bloom filter
+ */
+#define _HF_CMPLOG_MAX 256U
+#define _HF_CMPLOG_VAL_MAX 32U
+#define _HF_CMPLOG_SEEN_SZ 256U
+/* v1 is a compile-time constant (__sanitizer_cov_trace_const_cmp*) */
+#define _HF_CMPLOG_CONST 0x1U
+/* The operands are integers, so they're also looked for in the other byte order */
+#define _HF_CMPLOG_INT 0x2U
+typedef struct {
+    uint8_t flags;
+    uint8_t len1;
+    uint8_t len2;
+    uint8_t v1[_HF_CMPLOG_VAL_MAX];
+    uint8_t v2[_HF_CMPLOG_VAL_MAX];
+} cmpLogEntry_t;
+typedef struct {
+    uint32_t enabled;
+    uint32_t cnt;
+    uint8_t seen[_HF_CMPLOG_SEEN_SZ];
+    cmpLogEntry_t entries[_HF_CMPLOG_MAX];
+} __attribute__((aligned(_HF_CACHELINE_SZ))) cmpLog_t;
+
+/* Max number of mangle functions (mangle.c), they're tracked as bits of a uint32_t */
+#define _HF_MANGLE_FUNCS_MAX 32U
+
+/*
+ * A word of the dictionary, stored in mutate.dict.arena. Space for _HF_CMPLOG_DICT_MAX words (of up
+ * to _HF_CMPLOG_VAL_MAX bytes) is reserved for the ones found with --cmplog
+ */
+#define _HF_CMPLOG_DICT_MAX (1024U * 16U)
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} dictEntry_t;
+
+/*
+ * With --linux_inprocess_crash, persistent processes aren't traced. They catch their own crashes
+ * (in signal handlers, and in the sanitizers' death callback), and describe them here: the PC, and
+ * the return addresses with their modules (and offsets into them), so the fuzzer computes the same
+ * stack hash as for crashes unwound with ptrace(). 'valid' is set last
+ */
+#define _HF_CRASHREC_FRAMES_MAX 32U
+#define _HF_CRASHREC_MODULE_SZ 256U
+#define _HF_CRASHREC_INSTR_SZ 16U
+typedef struct {
+    uint64_t pc;
+    uint64_t modOff;
+    char module[_HF_CRASHREC_MODULE_SZ];
+} crashFrame_t;
+typedef struct {
+    uint32_t valid;
+    int32_t pid;
+    /* 0, if it's the sanitizer's death callback */
+    int32_t signo;
+    int32_t code;
+    uint64_t addr;
+    uint64_t pc;
+    /* The instruction at 'pc' */
+    uint8_t instr[_HF_CRASHREC_INSTR_SZ];
+    uint32_t instrSz;
+    uint32_t frameCnt;
+    crashFrame_t frames[_HF_CRASHREC_FRAMES_MAX];
+} __attribute__((aligned(_HF_CACHELINE_SZ))) crashRec_t;
+
+/*
+ * Comparison sites get dense IDs (1..cmpSitesCnt) when they're executed for the first time by any
+ * of the fuzzed processes, so the comparison feedback is kept in a small array instead of one
+ * indexed by the PCs. A slot packs the tag of the site (a hash of its PC, never 0) in the bits
+ * above _HF_CMP_SITE_ID_BITS, and its ID (0: over _HF_CMP_SITES_MAX) below them. 0: free slot
+ */
+typedef uint64_t cmpSite_t;
+
+/* Describes the layout of the shared feedback map, checked by the instrumented processes */
+#define _HF_FEEDBACK_MAGIC 0x48464642U /* 'HFFB' */
+typedef struct {
+    uint32_t magic;
+    uint32_t hdrSz;
+    uint64_t pcGuardMapSz;
+    uint64_t pcCntMapSz;
+    uint64_t bbMapPcSz;
+    uint64_t cmpMapSz;
+    uint64_t cmpSitesSz;
+    uint64_t pidFeedbackSz;
+    uint64_t persistentCtlSz;
+    uint64_t cmpLogSz;
+    uint64_t crashRecSz;
+} feedback_hdr_t;
+
+/*
+ * pcGuardMap comes last: the shared memory object initially ends where it starts, and it's grown by
+ * the instrumented processes (up to _HF_PC_GUARD_MAX bits) as they register their PC guards. Only
+ * its first pcGuardMapLen bytes can be accessed
+ */
+typedef struct {
+    feedback_hdr_t hdr;
+    /* Hit-count buckets (as bitmasks) seen so far for each of the inline-8bit-counters */
+    uint8_t pcCntMap[_HF_PC_CNT_MAX];
     uint8_t bbMapPc[_HF_PERF_BITMAP_SIZE_16M];
-    uint32_t bbMapCmp[_HF_PERF_BITMAP_SIZE_16M];
-    uint64_t pidFeedbackPc[_HF_THREAD_MAX];
-    uint64_t pidFeedbackEdge[_HF_THREAD_MAX];
-    uint64_t pidFeedbackCmp[_HF_THREAD_MAX];
+    /* Best comparison progress seen for every cmp site, by the site ID ([0] is a dump slot) */
+    uint8_t cmpMap[_HF_CMP_SITES_MAX];
+    cmpSite_t cmpSites[_HF_CMP_SITES_HT];
+    pidFeedback_t pidFeedback[_HF_THREAD_MAX];
+    persistentCtl_t persistentCtl[_HF_THREAD_MAX];
+    cmpLog_t cmpLog[_HF_THREAD_MAX];
+    crashRec_t crashRec[_HF_THREAD_MAX];
     uint64_t guardNb;
+    uint64_t cmpSitesCnt;
+    /*
+     * Set in the per-thread maps (--minimize, --trim), which are cleared after every input: each
+     * input's PC guards must be hit again, also by the same persistent process
+     */
+    uint64_t guardsRearm;
+    uint64_t pcGuardMapLen;
+    uint8_t pcGuardMap[_HF_PC_GUARD_MAX / 8];
 } feedback_t;
 
+/*
+ * --export_cov: PCs of the PC guards (by the guard number) and of the 8-bit counters (by their
+ * index), registered by the instrumented processes from the -fsanitize-coverage=pc-table tables
+ * (__sanitizer_cov_pcs_init()). An entry is the module's slot + 1 (bits 48-63), the offset into the
+ * module (bits 1-47) and the function entry flag (bit 0), or 0 if it's not registered (yet). It's a
+ * separate map from feedback_t (populated lazily), as it's big, and only used with --export_cov
+ */
+#define _HF_COV_PCS_MAGIC 0x48464350U /* 'HFCP' */
+#define _HF_COV_MODULES_MAX 256U
+#define _HF_COV_MODULE_SZ 256U
+#define _HF_COV_PC_MOD_SHIFT 48
+#define _HF_COV_PC_FUNC_ENTRY 1ULL
+typedef struct {
+    /* Hash of the path | 1, 0: free slot */
+    uint64_t key;
+    /* Set after the path is written */
+    uint32_t ready;
+    uint32_t reserved;
+    char path[_HF_COV_MODULE_SZ];
+} covModule_t;
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    covModule_t modules[_HF_COV_MODULES_MAX];
+    uint64_t guardPcs[_HF_PC_GUARD_MAX];
+    uint64_t cntPcs[_HF_PC_CNT_MAX];
+} covPcs_t;
+
 typedef struct {
     struct {
         size_t threadsMax;
+        /* Number of target processes driven by every fuzzing thread at once (0/1: one) */
+        size_t asyncRuns;
+        /* --threads_auto: threadsMax threads are started, only the first threadsAutoCnt fuzz */
+        size_t threadsAutoMax;
+        uint32_t threadsAutoCnt;
         size_t threadsFinished;
         uint32_t threadsActiveCnt;
         pthread_t mainThread;
@@ -188,7 +475,6 @@ typedef struct {
     } threads;
     struct {
         const char* inputDir;
-        DIR* inputDirPtr;
         size_t fileCnt;
         const char* fileExtn;
         bool fileCntDone;
@@ -197,21 +483,44 @@ typedef struct {
         const char* crashDir;
         const char* covDirAll;
         const char* covDirNew;
+        /* --corpus_pack (corpus.h) */
+        const char* corpusPack;
         bool saveUnique;
         size_t dynfileqCnt;
-        pthread_rwlock_t dynfileq_mutex;
-        TAILQ_HEAD(dyns_t, dynfile_t) dynfileq;
+        pthread_mutex_t dynfileq_mutex;
+        struct dynfile_t** dynfileqSegs[_HF_DYNFILE_SEG_MAX];
+        uint64_t dynfileqTimeExecUSecs;
+        /*
+         * Histogram of the exec times of the corpus entries, their median, and the number of slow
+         * entries (see input_addDynamicInput()), which the scheduler demotes
+         */
+        uint64_t dynfileqExecTimes[_HF_EXEC_TIMES_BUCKETS];
+        uint64_t dynfileqMedianUSecs;
+        size_t dynfileqSlowCnt;
+        dynfileSched_t dynfileqSched;
     } io;
     struct {
         int argc;
         const char* const* cmdline;
         bool nullifyStdio;
         bool fuzzStdin;
+        /* With fuzzStdin: stdin is a pipe filled with the input (vmsplice), not the input file */
+        bool stdinPipe;
         const char* externalCommand;
         const char* postExternalCommand;
         const char* feedbackMutateCommand;
         bool netDriver;
         bool persistent;
+        /* Implies 'persistent': the fork-server speaks the persistent mode protocol */
+        bool forkServer;
+        bool snapshot;
+        /* Number of inputs sent to the persistent process in one round (0/1: no batching) */
+        size_t persistentBatch;
+        /*
+         * The input file stays at its maximal size, as persistent processes get the length of the
+         * input with the persistent protocol, and don't need ftruncate() for every input
+         */
+        bool inputFixedSz;
         uint64_t asLimit;
         uint64_t rssLimit;
         uint64_t dataLimit;
@@ -223,16 +532,57 @@ typedef struct {
     struct {
         time_t timeStart;
         time_t runEndTime;
-        time_t tmOut;
+        /* -t, 0 means no limit */
+        int64_t tmOutMillis;
+        /*
+         * --timeout_auto: the multiplier of the 99.9th percentile of the exec times, and the limit
+         * derived from it (0 until enough executions were seen). The histogram of the exec times
+         * is merged from the per-thread ones, see subproc_Run()
+         */
+        unsigned tmOutAutoMul;
+        int64_t tmOutAutoMillis;
+        pthread_mutex_t execTimesMutex;
+        uint64_t execTimes[_HF_EXEC_TIMES_BUCKETS];
         time_t lastCovUpdate;
         int64_t timeOfLongestUnitInMilliseconds;
         bool tmoutVTALRM;
     } timing;
     struct {
         const char* dictionaryFile;
-        TAILQ_HEAD(strq_t, strings_t) dictq;
-        size_t dictionaryCnt;
+        /*
+         * The dictionary: words from the --dict file (the first staticCnt ones), followed by the
+         * ones extracted from comparison operands (--cmplog, see cmpLog_t), without duplicates.
+         * Once the arrays are 'fixed', they're not reallocated anymore, and new words are published
+         * with a release store of 'cnt', so they're read lock-free
+         */
+        struct {
+            uint8_t* arena;
+            size_t arenaSz;
+            size_t arenaUsed;
+            dictEntry_t* entries;
+            size_t capacity;
+            size_t cnt;
+            size_t staticCnt;
+            /* Open-addressing hash set (of entry indexes + 1), for deduplication */
+            uint32_t* slots;
+            size_t slotsCnt;
+            bool fixed;
+            pthread_mutex_t mutex;
+        } dict;
+        bool cmpLog;
+        /* In-process custom mutator (--custom_mutator), see mutator.h */
+        struct {
+            const char* lib;
+            void* handle;
+            size_t (*mutate)(uint8_t* data, size_t size, size_t maxSize, unsigned int seed);
+            size_t (*crossOver)(const uint8_t* data1, size_t size1, const uint8_t* data2,
+                size_t size2, uint8_t* out, size_t maxOutSize, unsigned int seed);
+        } custom;
         size_t mutationsMax;
+        struct {
+            uint64_t used[_HF_MANGLE_FUNCS_MAX];
+            uint64_t hits[_HF_MANGLE_FUNCS_MAX];
+        } mangleStats;
         unsigned mutationsPerRun;
         size_t maxFileSz;
     } mutate;
@@ -240,15 +590,32 @@ typedef struct {
         bool useScreen;
         char cmdline_txt[65];
         int64_t lastDisplayMillis;
+        /* --stats_socket, see stats.h */
+        const char* statsSocket;
+        /* --phase_timing */
+        phaseClock_t phaseClock;
     } display;
     struct {
         bool useVerifier;
         bool exitUponCrash;
         const char* reportFile;
+        /* --report_json: one JSON object per line, instead of the text reports */
+        bool reportJson;
         pthread_mutex_t report_mutex;
         bool monitorSIGABRT;
         size_t dynFileIterExpire;
         bool only_printable;
+        /* --minimize (minimize.h) */
+        bool minimize;
+        /* --trim, one of the threads trims the new corpus entries instead of fuzzing */
+        bool trim;
+        /* --minimize_crash, the crash reproducer to minimize (minimize.h) */
+        const char* minimizeCrash;
+        /* --seed, makes the random number generators of all threads deterministic */
+        bool seedSet;
+        uint64_t seed;
+        /* --node_id, index of this instance among the ones fuzzing the same target */
+        uint64_t nodeId;
     } cfg;
     struct {
         bool enable;
@@ -259,10 +626,17 @@ typedef struct {
         int bbFd;
         pthread_mutex_t feedback_mutex;
         const char* blacklistFile;
-        uint64_t* blacklist;
-        size_t blacklistCnt;
+        /* Replaced when the file changes (input_reloadBlacklist()), read with ATOMIC_GET_ACQUIRE */
+        stackHashBl_t* blacklist;
         bool skipFeedbackOnTimeout;
+        bool localCov;
+        /* --linux_huge_pages */
+        bool hugePages;
         dynFileMethod_t dynFileMethod;
+        /* --export_cov, see covexport.h */
+        const char* covExportFile;
+        covPcs_t* covPcs;
+        int covPcsFd;
     } feedback;
     struct {
         size_t mutationsCnt;
@@ -274,9 +648,29 @@ typedef struct {
     } cnts;
     struct {
         bool enabled;
+        /* --socket_fuzzer_binary, see socketfuzzer.h */
+        bool binary;
         int serverSocket;
         int clientSocket;
+        /* Binary protocol: the target has to be announced with SOCKFUZZ_MSG_READY */
+        bool announce;
+        /* Binary protocol: seq of the last SOCKFUZZ_MSG_DONE */
+        uint64_t seq;
+        /* Binary protocol: SOCKFUZZ_EV_* which weren't sent yet */
+        uint32_t events;
     } socketFuzzer;
+    /* --checkpoint, see checkpoint.h */
+    struct {
+        const char* path;
+        time_t interval;
+        bool resumed;
+    } checkpoint;
+    /* --sync_listen/--sync_peer, see sync.h */
+    struct {
+        const char* listen;
+        const char* peers[_HF_SYNC_PEERS_MAX];
+        size_t peersCnt;
+    } sync;
     /* For the Linux code */
     struct {
         int exeFd;
@@ -292,8 +686,26 @@ typedef struct {
         char** symsWl;
         size_t symsWlCnt;
         uintptr_t cloneFlags;
+        bool nsFresh;
+        /* --linux_cgroup_mem (MiB), --linux_cgroup_cpu (cpu.weight), see linux/cgroup.h */
+        uint64_t cgroupMem;
+        uint64_t cgroupCpu;
+        const char* cgroupDir;
         bool kernelOnly;
+        bool pinCpus;
+        size_t perfAuxSz;
+        bool perfAuxOverwrite;
+        bool ptLibipt;
+        bool ptEdges;
+        /* ptCfg_t (linux/pt.h) of the fuzzed binary, with ptEdges */
+        void* ptCfg;
+        /* Intel PT traces only the code of the fuzzed binary, and/or of these DSOs */
+        bool ptFilterExe;
+        const char* ptFilterDsos[_HF_PERF_FILTERS_MAX];
+        size_t ptFilterDsosCnt;
         bool useClone;
+        size_t triageThreads;
+        bool inprocCrash;
     } linux;
     /* For the NetBSD code */
     struct {
@@ -308,6 +720,25 @@ typedef struct {
     } netbsd;
 } honggfuzz_t;
 
+/*
+ * Changes done by the mangler to run->dynamicFile since it was a copy of 'dynfile', so the next
+ * mutation of the same input only needs to restore them. Large inputs are mutated a few times in a
+ * row (_HF_JOURNAL_REUSE_MAX), as for them restoring a few ranges is much cheaper than a full copy
+ */
+#define _HF_JOURNAL_MAX 32U
+#define _HF_JOURNAL_MIN_SZ (1024U * 64U)
+#define _HF_JOURNAL_REUSE_MAX 16U
+typedef struct {
+    struct dynfile_t* dynfile;
+    size_t reused;
+    /* More than _HF_JOURNAL_MAX: too many changes, the whole input needs to be copied */
+    size_t cnt;
+    struct {
+        size_t off;
+        size_t len;
+    } ranges[_HF_JOURNAL_MAX];
+} mangleJournal_t;
+
 typedef enum {
     _HF_RS_UNKNOWN = 0,
     _HF_RS_WAITING_FOR_INITIAL_READY = 1,
@@ -315,10 +746,11 @@ typedef enum {
     _HF_RS_SEND_DATA = 3,
 } runState_t;
 
-typedef struct {
+typedef struct run_t {
     honggfuzz_t* global;
     pid_t pid;
     int64_t timeStartedMillis;
+    uint64_t timeStartedUSecs;
     char origFileName[PATH_MAX];
     char crashFileName[PATH_MAX];
     uint64_t pc;
@@ -327,16 +759,64 @@ typedef struct {
     int exception;
     char report[_HF_REPORT_SIZE];
     bool mainWorker;
+    /* The feedback map used by this thread: the global one, or its own one with --minimize */
+    feedback_t* feedbackMap;
+    int feedbackFd;
     unsigned mutationsPerRun;
-    struct dynfile_t* dynfileqCurrent;
+    /* The corpus entry being fuzzed, SIZE_MAX (the round-robin starts with 0 then) before any */
+    size_t dynfileqCurrent;
+    /* Done with its part of the dry run, it fuzzes the corpus, see fuzz_setDynamicMainState() */
+    bool mainPhase;
+    uint64_t timeExecUSecs;
     uint8_t* dynamicFile;
     size_t dynamicFileSz;
     int dynamicFileFd;
+    mangleJournal_t journal;
+    /* Operands logged (--cmplog) while processing the previous input, for the input-to-state one */
+    struct {
+        cmpLogEntry_t entries[_HF_CMPLOG_MAX];
+        size_t cnt;
+    } inputToState;
+    /*
+     * Per-thread statistics of the mangle functions: in how many runs each one was used, and how
+     * many of these runs produced new coverage. They're merged into mutate.mangleStats periodically,
+     * and the selection weights are recomputed from the global totals then
+     */
+    struct {
+        uint64_t used[_HF_MANGLE_FUNCS_MAX];
+        uint64_t hits[_HF_MANGLE_FUNCS_MAX];
+        uint32_t cumWeight[_HF_MANGLE_FUNCS_MAX];
+        uint32_t usedThisRun;
+        uint64_t runs;
+    } mangleStats;
     uint32_t fuzzNo;
+    /* --async_runs: all runs of the fuzzing thread (this one included), which share its waits */
+    struct run_t* asyncRuns;
+    size_t asyncCnt;
+    /* argv and envp of the fuzzed processes, built once (see subproc_initExec()) */
+    const char** execArgs;
+    char** execEnvs;
     int persistentSock;
+    /* The persistent process uses feedback->persistentCtl[] instead of the socket */
+    bool persistentShm;
+    /* The worker processing inputs, if the persistent process is a snapshot template */
+    pid_t snapshotPid;
+    /* --persistent_batch: the shared input region, and the number of inputs in the current round */
+    batchHdr_t* batchHdr;
+    size_t batchHdrSz;
+    int batchFd;
+    size_t batchCnt;
+    bool batchCapable;
     bool waitingForReady;
+    /* When the input was sent to the persistent process, see STATS_PHASE_ROUNDTRIP */
+    uint64_t roundTripStarted;
     runState_t runState;
     bool tmOutSignaled;
+    /* Exec times (--timeout_auto) not merged into timing.execTimes yet */
+    struct {
+        uint32_t hist[_HF_EXEC_TIMES_BUCKETS];
+        uint32_t cnt;
+    } execTimes;
 #if !defined(_HF_ARCH_DARWIN)
     timer_t timerId;
 #endif  // !defined(_HF_ARCH_DARWIN)
@@ -345,10 +825,41 @@ typedef struct {
         /* For Linux code */
         uint8_t* perfMmapBuf;
         uint8_t* perfMmapAux;
+        /* Per-thread hash set of the BTS and KCOV edges of a run, and its used slots */
+        uint32_t* perfEdgesSet;
+        uint32_t* perfEdges;
+        size_t perfEdgesCnt;
+        /* --linux_kcov: the number of the PCs, followed by them */
+        uint64_t* kcovArea;
+        int kcovFd;
+        /* libipt's packet decoder over perfMmapAux, kept across iterations */
+        void* ptDecoder;
         hwcnt_t hwCnts;
         int cpuInstrFd;
         int cpuBranchFd;
         int cpuIptBtsFd;
+        /* cpuInstrFd leads a perf group, with cpuBranchFd in it */
+        bool cpuCntGroup;
+        /* arch_reapChild() waits for the persistent socket, the pidfd and SIGCHLD in one epoll */
+        int epollFd;
+        int sigFd;
+        int pidFd;
+        /* The process which is waited for, and if it was reaped by another run of the thread */
+        pid_t reapPid;
+        bool reaped;
+        /* nsfs fds of the namespaces joined by netdriver processes of the run, see nsCreate() */
+        int nsFds[_HF_NS_CNT];
+        /* cgroup.procs and memory.events of the run's cgroup, and its last seen 'oom_kill' count */
+        int cgroupProcsFd;
+        int cgroupEventsFd;
+        uint64_t cgroupOomKills;
+        /* The target's stderr (with sanitizers), and what was read from it, see linux/trace.h */
+        int sanFd;
+        int sanWrFd;
+        char* sanBuf;
+        size_t sanBufLen;
+        /* Offset of the line with the '==ERROR: ' header in sanBuf, or -1 */
+        ssize_t sanReportOff;
     } linux;
 
     struct {
@@ -359,7 +870,17 @@ typedef struct {
         int cpuInstrFd;
         int cpuBranchFd;
         int cpuIptBtsFd;
+        /* The thread's kqueue: the persistent socket and SIGCHLD (exits and ptrace() stops) */
+        int kqFd;
     } netbsd;
+
+    struct {
+        /* For MacOSX code: the thread's kqueue, and the port set (mach_port_t) of its exc. port */
+        int kqFd;
+        uint32_t excPortSet;
+        /* The process' exit (EVFILT_PROC) is watched by the kqueue */
+        bool procWatched;
+    } mac;
 } run_t;
 
 /*
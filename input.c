@@ -32,17 +32,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "corpus.h"
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "mangle.h"
+#include "mutator.h"
+#include "stats.h"
 #include "subproc.h"
 
 #if defined(_HF_ARCH_LINUX)
+#include <sys/inotify.h>
 #include <sys/syscall.h>
 #if defined(__NR_memfd_create)
 #include <linux/memfd.h>
@@ -61,21 +66,224 @@ void input_setSize(run_t* run, size_t sz) {
     }
     /* ftruncate of a mmaped file fails under CygWin, it's also painfully slow under MacOS X */
 #if !defined(__CYGWIN__) && !defined(_HF_ARCH_DARWIN)
-    if (TEMP_FAILURE_RETRY(ftruncate(run->dynamicFileFd, sz)) == -1) {
+    if (!run->global->exe.inputFixedSz &&
+        TEMP_FAILURE_RETRY(ftruncate(run->dynamicFileFd, sz)) == -1) {
         PLOG_W("ftruncate(run->dynamicFileFd=%d, sz=%zu)", run->dynamicFileFd, sz);
     }
 #endif /* !defined(__CYGWIN__) && !defined(_HF_ARCH_DARWIN) */
     run->dynamicFileSz = sz;
 }
 
-static bool input_getDirStatsAndRewind(honggfuzz_t* hfuzz) {
-    rewinddir(hfuzz->io.inputDirPtr);
+void input_journalReset(run_t* run, struct dynfile_t* dynfile) {
+    run->journal.dynfile = dynfile;
+    run->journal.cnt = 0;
+}
+
+/*
+ * With --persistent_batch, run->dynamicFile contains the last input of the batch. Make it contain
+ * the one which is being processed, so crashes are saved (and hashed) with the right input
+ */
+void input_setBatchCrashInput(run_t* run) {
+    if (!run->batchCnt) {
+        return;
+    }
+    size_t idx = ATOMIC_GET(run->batchHdr->done);
+    if (idx >= run->batchCnt) {
+        return;
+    }
+    size_t len = run->batchHdr->len[idx];
+    input_journalReset(run, NULL);
+    input_setSize(run, len);
+    memcpy(run->dynamicFile, (uint8_t*)run->batchHdr + run->batchHdr->off[idx], len);
+}
+
+/*
+ * Index of the input directory. It's built once by input_init(), and later it's only extended with
+ * files which appear in the directory (picked up via inotify under Linux, or by re-scanning the
+ * directory elsewhere) when the listing wraps around. Entries are claimed with an atomic cursor
+ */
+typedef struct {
+    size_t nameOff;
+    size_t size;
+} inputEntry_t;
+
+static struct {
+    pthread_rwlock_t lock;
+    inputEntry_t* entries;
+    size_t cnt;
+    /* entries[0..sortedCnt) are sorted by name, the ones added later are not */
+    size_t sortedCnt;
+    size_t capacity;
+    char* names;
+    size_t namesSz;
+    size_t namesCapacity;
+    /* Inputs of the packed corpus, which precede the entries */
+    size_t packCnt;
+    size_t cursor;
+    int dirFd;
+    int inotifyFd;
+} inputIdx = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+    .entries = NULL,
+    .cnt = 0,
+    .sortedCnt = 0,
+    .capacity = 0,
+    .names = NULL,
+    .namesSz = 0,
+    .namesCapacity = 0,
+    .packCnt = 0,
+    .cursor = 0,
+    .dirFd = -1,
+    .inotifyFd = -1,
+};
+
+static const char* input_idxName(size_t i) {
+    return &inputIdx.names[inputIdx.entries[i].nameOff];
+}
+
+static int input_idxCmp(const void* a, const void* b) {
+    const inputEntry_t* ea = (const inputEntry_t*)a;
+    const inputEntry_t* eb = (const inputEntry_t*)b;
+    return strcmp(&inputIdx.names[ea->nameOff], &inputIdx.names[eb->nameOff]);
+}
+
+static bool input_idxHas(const char* name) {
+    size_t lo = 0, hi = inputIdx.sortedCnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(input_idxName(mid), name);
+        if (cmp == 0) {
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (size_t i = inputIdx.sortedCnt; i < inputIdx.cnt; i++) {
+        if (strcmp(input_idxName(i), name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void input_idxAdd(const char* name, size_t size) {
+    size_t nameLen = strlen(name) + 1;
+    if ((inputIdx.namesSz + nameLen) > inputIdx.namesCapacity) {
+        inputIdx.namesCapacity = MAX(inputIdx.namesCapacity * 2, inputIdx.namesSz + nameLen);
+        inputIdx.namesCapacity = MAX(inputIdx.namesCapacity, (size_t)(1024 * 64));
+        if (!(inputIdx.names = util_Realloc(inputIdx.names, inputIdx.namesCapacity))) {
+            LOG_F("Couldn't extend the input index to %zu bytes", inputIdx.namesCapacity);
+        }
+    }
+    if (inputIdx.cnt == inputIdx.capacity) {
+        inputIdx.capacity = inputIdx.capacity ? (inputIdx.capacity * 2) : 1024;
+        if (!(inputIdx.entries =
+                    util_Realloc(inputIdx.entries, inputIdx.capacity * sizeof(inputEntry_t)))) {
+            LOG_F("Couldn't extend the input index to %zu entries", inputIdx.capacity);
+        }
+    }
+
+    memcpy(&inputIdx.names[inputIdx.namesSz], name, nameLen);
+    inputIdx.entries[inputIdx.cnt].nameOff = inputIdx.namesSz;
+    inputIdx.entries[inputIdx.cnt].size = size;
+    inputIdx.namesSz += nameLen;
+    inputIdx.cnt++;
+}
+
+/* 'dtype' (DT_*) from the directory listing allows to skip fstatat() for non-regular files */
+static void input_idxAddFile(honggfuzz_t* hfuzz, const char* name, unsigned char dtype) {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return;
+    }
+    if (dtype != DT_REG && dtype != DT_LNK && dtype != DT_UNKNOWN) {
+        LOG_D("'%s/%s' is not a regular file, skipping", hfuzz->io.inputDir, name);
+        return;
+    }
+
+    struct stat st;
+    if (fstatat(inputIdx.dirFd, name, &st, 0) == -1) {
+        LOG_W("Couldn't stat() the '%s/%s' file", hfuzz->io.inputDir, name);
+        return;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        LOG_D("'%s/%s' is not a regular file, skipping", hfuzz->io.inputDir, name);
+        return;
+    }
+    if (hfuzz->mutate.maxFileSz != 0UL && st.st_size > (off_t)hfuzz->mutate.maxFileSz) {
+        LOG_D("File '%s/%s' is bigger than maximal defined file size (-F): %" PRId64 " > %" PRId64,
+            hfuzz->io.inputDir, name, (int64_t)st.st_size, (int64_t)hfuzz->mutate.maxFileSz);
+    }
+
+    input_idxAdd(name, (size_t)st.st_size);
+}
+
+#if defined(_HF_ARCH_LINUX)
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* Large buffers for getdents64() mean fewer round-trips with network file-systems */
+#define _HF_INPUT_DENTS_BUF_SZ (1024 * 1024)
+
+static bool input_idxScanDir(honggfuzz_t* hfuzz, bool skipKnown) {
+    if (lseek(inputIdx.dirFd, (off_t)0, SEEK_SET) == (off_t)-1) {
+        PLOG_W("lseek('%s', 0)", hfuzz->io.inputDir);
+        return false;
+    }
+
+    uint8_t* buf = util_Malloc(_HF_INPUT_DENTS_BUF_SZ);
+    defer {
+        free(buf);
+    };
+    for (;;) {
+        long len = syscall(__NR_getdents64, inputIdx.dirFd, buf, _HF_INPUT_DENTS_BUF_SZ);
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
+        if (len == -1) {
+            PLOG_W("getdents64('%s')", hfuzz->io.inputDir);
+            return false;
+        }
+        if (len == 0) {
+            return true;
+        }
+        for (long off = 0; off < len;) {
+            struct linux_dirent64* de = (struct linux_dirent64*)&buf[off];
+            off += de->d_reclen;
+            if (skipKnown && input_idxHas(de->d_name)) {
+                continue;
+            }
+            input_idxAddFile(hfuzz, de->d_name, de->d_type);
+        }
+    }
+}
+#else  /* defined(_HF_ARCH_LINUX) */
+static bool input_idxScanDir(honggfuzz_t* hfuzz, bool skipKnown) {
+    int fd = TEMP_FAILURE_RETRY(openat(inputIdx.dirFd, ".", O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        PLOG_W("openat('%s')", hfuzz->io.inputDir);
+        return false;
+    }
+    DIR* dir = fdopendir(fd);
+    if (dir == NULL) {
+        PLOG_W("fdopendir(dir='%s', fd=%d)", hfuzz->io.inputDir, fd);
+        close(fd);
+        return false;
+    }
+    defer {
+        closedir(dir);
+    };
 
-    size_t maxSize = 0U;
-    size_t fileCnt = 0U;
     for (;;) {
         errno = 0;
-        struct dirent* entry = readdir(hfuzz->io.inputDirPtr);
+        struct dirent* entry = readdir(dir);
         if (entry == NULL && errno == EINTR) {
             continue;
         }
@@ -84,33 +292,164 @@ static bool input_getDirStatsAndRewind(honggfuzz_t* hfuzz) {
             return false;
         }
         if (entry == NULL) {
-            break;
+            return true;
+        }
+        if (skipKnown && input_idxHas(entry->d_name)) {
+            continue;
         }
+        input_idxAddFile(hfuzz, entry->d_name, entry->d_type);
+    }
+}
+#endif /* defined(_HF_ARCH_LINUX) */
 
-        char fname[PATH_MAX];
-        snprintf(fname, sizeof(fname), "%s/%s", hfuzz->io.inputDir, entry->d_name);
-        LOG_D("Analyzing file '%s'", fname);
+/* Adds files which appeared in the input directory since the last time */
+static void input_idxRefresh(honggfuzz_t* hfuzz) {
+    size_t oldCnt = inputIdx.cnt;
+#if defined(_HF_ARCH_LINUX)
+    if (inputIdx.inotifyFd != -1) {
+        uint8_t buf[1024 * 16] __attribute__((aligned(__alignof__(struct inotify_event))));
+        for (;;) {
+            ssize_t len = TEMP_FAILURE_RETRY(read(inputIdx.inotifyFd, buf, sizeof(buf)));
+            if (len <= 0) {
+                break;
+            }
+            for (ssize_t off = 0; off < len;) {
+                struct inotify_event* ev = (struct inotify_event*)&buf[off];
+                off += sizeof(struct inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    LOG_W("The inotify queue for '%s' has overflown, re-scanning it",
+                        hfuzz->io.inputDir);
+                    input_idxScanDir(hfuzz, /* skipKnown= */ true);
+                    continue;
+                }
+                if (ev->len == 0 || input_idxHas(ev->name)) {
+                    continue;
+                }
+                input_idxAddFile(hfuzz, ev->name, DT_UNKNOWN);
+            }
+        }
+    } else {
+        input_idxScanDir(hfuzz, /* skipKnown= */ true);
+    }
+#else  /* defined(_HF_ARCH_LINUX) */
+    input_idxScanDir(hfuzz, /* skipKnown= */ true);
+#endif /* defined(_HF_ARCH_LINUX) */
 
-        struct stat st;
-        if (stat(fname, &st) == -1) {
-            LOG_W("Couldn't stat() the '%s' file", fname);
-            continue;
+    if (inputIdx.cnt != oldCnt) {
+        LOG_D("Added %zu new files from '%s' to the input index", inputIdx.cnt - oldCnt,
+            hfuzz->io.inputDir);
+    }
+    ATOMIC_SET(hfuzz->io.fileCnt, inputIdx.packCnt + inputIdx.cnt);
+}
+
+static void input_idxRewind(honggfuzz_t* hfuzz) {
+    MX_SCOPED_RWLOCK_WRITE(&inputIdx.lock);
+
+    /* Another thread has just done it */
+    if (ATOMIC_GET(inputIdx.cursor) < (inputIdx.packCnt + inputIdx.cnt)) {
+        return;
+    }
+    if (inputIdx.dirFd != -1) {
+        input_idxRefresh(hfuzz);
+    }
+    ATOMIC_SET(inputIdx.cursor, 0);
+}
+
+/*
+ * Inputs from the packed corpus (--corpus_pack) come first. For them '*data' and '*len' describe
+ * the input in the mapping of the corpus, for files from the input directory '*data' is NULL
+ */
+bool input_getNext(run_t* run, char* fname, const uint8_t** data, size_t* len, bool rewind) {
+    if (ATOMIC_GET(run->global->io.fileCnt) == 0U) {
+        LOG_W("No useful files in the input directory");
+        return false;
+    }
+
+    for (;;) {
+        size_t idx = ATOMIC_POST_INC(inputIdx.cursor);
+        if (idx < inputIdx.packCnt) {
+            *data = corpus_get(idx, len);
+            snprintf(fname, PATH_MAX, "%s:%zu", run->global->io.corpusPack, idx);
+            return true;
         }
-        if (!S_ISREG(st.st_mode)) {
-            LOG_D("'%s' is not a regular file, skipping", fname);
-            continue;
+        idx -= inputIdx.packCnt;
+        {
+            MX_SCOPED_RWLOCK_READ(&inputIdx.lock);
+            if (idx < inputIdx.cnt) {
+                *data = NULL;
+                snprintf(fname, PATH_MAX, "%s/%s", run->global->io.inputDir, input_idxName(idx));
+                return true;
+            }
         }
-        if (hfuzz->mutate.maxFileSz != 0UL && st.st_size > (off_t)hfuzz->mutate.maxFileSz) {
-            LOG_D("File '%s' is bigger than maximal defined file size (-F): %" PRId64 " > %" PRId64,
-                fname, (int64_t)st.st_size, (int64_t)hfuzz->mutate.maxFileSz);
+        if (!rewind) {
+            return false;
         }
-        if ((size_t)st.st_size > maxSize) {
-            maxSize = st.st_size;
+        input_idxRewind(run->global);
+    }
+}
+
+static bool input_initDir(honggfuzz_t* hfuzz) {
+    inputIdx.dirFd =
+        TEMP_FAILURE_RETRY(open(hfuzz->io.inputDir, O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+    if (inputIdx.dirFd == -1) {
+        PLOG_W("open('%s', O_DIRECTORY|O_RDONLY|O_CLOEXEC)", hfuzz->io.inputDir);
+        return false;
+    }
+
+#if defined(_HF_ARCH_LINUX)
+    /* Started before the initial scan, so files created during it are not missed */
+    inputIdx.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inputIdx.inotifyFd == -1) {
+        PLOG_W("inotify_init1(), new files in '%s' will be found by re-scanning it",
+            hfuzz->io.inputDir);
+    } else if (inotify_add_watch(inputIdx.inotifyFd, hfuzz->io.inputDir,
+                   IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        PLOG_W("inotify_add_watch('%s'), new files in it will be found by re-scanning it",
+            hfuzz->io.inputDir);
+        close(inputIdx.inotifyFd);
+        inputIdx.inotifyFd = -1;
+    }
+#endif /* defined(_HF_ARCH_LINUX) */
+
+    if (!input_idxScanDir(hfuzz, /* skipKnown= */ false)) {
+        LOG_W("Couldn't read the input directory '%s'", hfuzz->io.inputDir);
+        return false;
+    }
+    qsort(inputIdx.entries, inputIdx.cnt, sizeof(inputEntry_t), input_idxCmp);
+    inputIdx.sortedCnt = inputIdx.cnt;
+
+    return true;
+}
+
+bool input_init(honggfuzz_t* hfuzz) {
+    hfuzz->io.fileCnt = 0U;
+
+    if (!hfuzz->io.inputDir && !hfuzz->io.corpusPack) {
+        LOG_W("No input file/dir specified");
+        return false;
+    }
+
+    size_t maxSize = 0U;
+    if (hfuzz->io.corpusPack) {
+        if (!corpus_open(hfuzz->io.corpusPack)) {
+            LOG_W("Couldn't open the packed corpus '%s'", hfuzz->io.corpusPack);
+            return false;
+        }
+        inputIdx.packCnt = corpus_cnt();
+        for (size_t i = 0; i < inputIdx.packCnt; i++) {
+            size_t len;
+            corpus_get(i, &len);
+            maxSize = MAX(maxSize, len);
         }
-        fileCnt++;
+    }
+    if (hfuzz->io.inputDir && !input_initDir(hfuzz)) {
+        return false;
     }
 
-    ATOMIC_SET(hfuzz->io.fileCnt, fileCnt);
+    for (size_t i = 0; i < inputIdx.cnt; i++) {
+        maxSize = MAX(maxSize, inputIdx.entries[i].size);
+    }
+    ATOMIC_SET(hfuzz->io.fileCnt, inputIdx.packCnt + inputIdx.cnt);
     if (hfuzz->mutate.maxFileSz == 0U) {
         if (maxSize < 8192) {
             hfuzz->mutate.maxFileSz = 8192;
@@ -125,83 +464,92 @@ static bool input_getDirStatsAndRewind(honggfuzz_t* hfuzz) {
         LOG_W("No usable files in the input directory '%s'", hfuzz->io.inputDir);
     }
 
-    LOG_D("Re-read the '%s', maxFileSz:%zu, number of usable files:%zu", hfuzz->io.inputDir,
+    LOG_D("Indexed '%s', maxFileSz:%zu, number of usable files:%zu", hfuzz->io.inputDir,
         hfuzz->mutate.maxFileSz, hfuzz->io.fileCnt);
 
-    rewinddir(hfuzz->io.inputDirPtr);
-
     return true;
 }
 
-bool input_getNext(run_t* run, char* fname, bool rewind) {
-    static pthread_mutex_t input_mutex = PTHREAD_MUTEX_INITIALIZER;
-    MX_SCOPED_LOCK(&input_mutex);
-
-    if (run->global->io.fileCnt == 0U) {
-        LOG_W("No useful files in the input directory");
-        return false;
-    }
+static uint64_t input_dictHash(const uint8_t* val, size_t len) {
+    return util_hash64(val, len);
+}
 
-    for (;;) {
-        errno = 0;
-        struct dirent* entry = readdir(run->global->io.inputDirPtr);
-        if (entry == NULL && errno == EINTR) {
-            continue;
+/* Returns the slot of the word in the hash set, or of the empty slot where it should be inserted */
+static size_t input_dictSlot(honggfuzz_t* hfuzz, const uint8_t* val, size_t len) {
+    const size_t mask = hfuzz->mutate.dict.slotsCnt - 1;
+    for (size_t i = input_dictHash(val, len) & mask;; i = (i + 1) & mask) {
+        uint32_t idx = hfuzz->mutate.dict.slots[i];
+        if (idx == 0) {
+            return i;
         }
-        if (entry == NULL && errno != 0) {
-            PLOG_W("readdir_r('%s')", run->global->io.inputDir);
-            return false;
+        const dictEntry_t* e = &hfuzz->mutate.dict.entries[idx - 1];
+        if (e->len == len && memcmp(&hfuzz->mutate.dict.arena[e->off], val, len) == 0) {
+            return i;
         }
-        if (entry == NULL && rewind == false) {
+    }
+}
+
+/* Makes space for 'cnt' words and 'bytes' of words in total. Called with the dict mutex held */
+static bool input_dictGrow(honggfuzz_t* hfuzz, size_t cnt, size_t bytes) {
+    if (cnt > hfuzz->mutate.dict.capacity) {
+        if (hfuzz->mutate.dict.fixed) {
             return false;
         }
-        if (entry == NULL && rewind == true) {
-            if (input_getDirStatsAndRewind(run->global) == false) {
-                LOG_E("input_getDirStatsAndRewind('%s')", run->global->io.inputDir);
-                return false;
-            }
-            continue;
-        }
-
-        snprintf(fname, PATH_MAX, "%s/%s", run->global->io.inputDir, entry->d_name);
+        size_t capacity = MAX(cnt, MAX(hfuzz->mutate.dict.capacity * 2, 1024));
+        hfuzz->mutate.dict.entries =
+            util_Realloc(hfuzz->mutate.dict.entries, sizeof(dictEntry_t) * capacity);
+        hfuzz->mutate.dict.capacity = capacity;
 
-        struct stat st;
-        if (stat(fname, &st) == -1) {
-            LOG_W("Couldn't stat() the '%s' file", fname);
-            continue;
+        /* The hash set is kept at most half-full */
+        size_t slotsCnt = 1;
+        while (slotsCnt < (capacity * 2)) {
+            slotsCnt <<= 1;
         }
-        if (!S_ISREG(st.st_mode)) {
-            LOG_D("'%s' is not a regular file, skipping", fname);
-            continue;
+        free(hfuzz->mutate.dict.slots);
+        hfuzz->mutate.dict.slots = util_Calloc(sizeof(uint32_t) * slotsCnt);
+        hfuzz->mutate.dict.slotsCnt = slotsCnt;
+        for (size_t i = 0; i < hfuzz->mutate.dict.cnt; i++) {
+            const dictEntry_t* e = &hfuzz->mutate.dict.entries[i];
+            size_t slot = input_dictSlot(hfuzz, &hfuzz->mutate.dict.arena[e->off], e->len);
+            hfuzz->mutate.dict.slots[slot] = (uint32_t)(i + 1);
         }
-        return true;
     }
+    if (bytes > hfuzz->mutate.dict.arenaSz) {
+        if (hfuzz->mutate.dict.fixed) {
+            return false;
+        }
+        size_t arenaSz = MAX(bytes, MAX(hfuzz->mutate.dict.arenaSz * 2, 1024 * 64));
+        hfuzz->mutate.dict.arena = util_Realloc(hfuzz->mutate.dict.arena, arenaSz);
+        hfuzz->mutate.dict.arenaSz = arenaSz;
+    }
+    return true;
 }
 
-bool input_init(honggfuzz_t* hfuzz) {
-    hfuzz->io.fileCnt = 0U;
-
-    if (!hfuzz->io.inputDir) {
-        LOG_W("No input file/dir specified");
+/* Returns false if the word is already in the dictionary, or if the dictionary is full */
+static bool input_dictAdd(honggfuzz_t* hfuzz, const uint8_t* val, size_t len) {
+    if (len == 0) {
         return false;
     }
 
-    int dir_fd = TEMP_FAILURE_RETRY(open(hfuzz->io.inputDir, O_DIRECTORY | O_RDONLY | O_CLOEXEC));
-    if (dir_fd == -1) {
-        PLOG_W("open('%s', O_DIRECTORY|O_RDONLY|O_CLOEXEC)", hfuzz->io.inputDir);
-        return false;
-    }
-    if ((hfuzz->io.inputDirPtr = fdopendir(dir_fd)) == NULL) {
-        PLOG_W("fdopendir(dir='%s', fd=%d)", hfuzz->io.inputDir, dir_fd);
-        close(dir_fd);
+    MX_SCOPED_LOCK(&hfuzz->mutate.dict.mutex);
+
+    size_t cnt = hfuzz->mutate.dict.cnt;
+    if (!input_dictGrow(hfuzz, cnt + 1, hfuzz->mutate.dict.arenaUsed + len)) {
         return false;
     }
-    if (input_getDirStatsAndRewind(hfuzz) == false) {
-        hfuzz->io.fileCnt = 0U;
-        LOG_W("input_getDirStatsAndRewind('%s')", hfuzz->io.inputDir);
+    size_t slot = input_dictSlot(hfuzz, val, len);
+    if (hfuzz->mutate.dict.slots[slot] != 0) {
         return false;
     }
 
+    size_t off = hfuzz->mutate.dict.arenaUsed;
+    memcpy(&hfuzz->mutate.dict.arena[off], val, len);
+    hfuzz->mutate.dict.arenaUsed += len;
+    hfuzz->mutate.dict.entries[cnt].off = (uint32_t)off;
+    hfuzz->mutate.dict.entries[cnt].len = (uint32_t)len;
+    hfuzz->mutate.dict.slots[slot] = (uint32_t)(cnt + 1);
+    ATOMIC_SET_RELEASE(hfuzz->mutate.dict.cnt, cnt + 1);
+
     return true;
 }
 
@@ -248,95 +596,573 @@ bool input_parseDictionary(honggfuzz_t* hfuzz) {
 
         LOG_D("Parsing word: '%s'", bufv);
 
-        char* s = util_StrDup(bufv);
-        struct strings_t* str = (struct strings_t*)util_Malloc(sizeof(struct strings_t));
-        str->len = util_decodeCString(s);
-        str->s = s;
-        hfuzz->mutate.dictionaryCnt += 1;
-        TAILQ_INSERT_TAIL(&hfuzz->mutate.dictq, str, pointers);
-
-        LOG_D("Dictionary: loaded word: '%s' (len=%zu)", str->s, str->len);
+        size_t wlen = util_decodeCString(bufv);
+        if (!input_dictAdd(hfuzz, (const uint8_t*)bufv, wlen)) {
+            LOG_D("Dictionary: skipping duplicate word: '%s' (len=%zu)", bufv, wlen);
+            continue;
+        }
+        LOG_D("Dictionary: loaded word: '%s' (len=%zu)", bufv, wlen);
     }
-    LOG_I("Loaded %zu words from the dictionary", hfuzz->mutate.dictionaryCnt);
+    hfuzz->mutate.dict.staticCnt = hfuzz->mutate.dict.cnt;
+    LOG_I("Loaded %zu words from the dictionary", hfuzz->mutate.dict.cnt);
     return true;
 }
 
-bool input_parseBlacklist(honggfuzz_t* hfuzz) {
-    FILE* fBl = fopen(hfuzz->feedback.blacklistFile, "rb");
+/* Space for the --cmplog words is reserved upfront, as the dictionary is read lock-free */
+void input_initCmpLogDict(honggfuzz_t* hfuzz) {
+    MX_SCOPED_LOCK(&hfuzz->mutate.dict.mutex);
+    if (!input_dictGrow(hfuzz, hfuzz->mutate.dict.cnt + _HF_CMPLOG_DICT_MAX,
+            hfuzz->mutate.dict.arenaUsed + (_HF_CMPLOG_DICT_MAX * _HF_CMPLOG_VAL_MAX))) {
+        LOG_F("Couldn't reserve space for %u --cmplog dictionary words", _HF_CMPLOG_DICT_MAX);
+    }
+    hfuzz->mutate.dict.fixed = true;
+}
+
+static void input_addCmpLogWord(honggfuzz_t* hfuzz, const uint8_t* val, size_t len) {
+    if (len < 2) {
+        return;
+    }
+    /* Words made of one repeated byte (0x0000, 0xffffffff, "    ") are not useful */
+    size_t i = 1;
+    for (; i < len && val[i] == val[0]; i++) {
+    }
+    if (i == len) {
+        return;
+    }
+    if (ATOMIC_GET(hfuzz->mutate.dict.cnt) >= hfuzz->mutate.dict.capacity) {
+        return;
+    }
+
+    if (input_dictAdd(hfuzz, val, len)) {
+        size_t cnt = ATOMIC_GET(hfuzz->mutate.dict.cnt);
+        LOG_D("CmpLog dictionary: added word #%zu (len=%zu)", cnt, len);
+        if (cnt == hfuzz->mutate.dict.capacity) {
+            LOG_I("The dictionary is full (%zu words)", cnt);
+        }
+    }
+}
+
+/* Integers are also added in the other byte order, for inputs storing them as big-endian ones */
+static void input_addCmpLogVal(run_t* run, const uint8_t* val, size_t len, bool isInt) {
+    input_addCmpLogWord(run->global, val, len);
+    if (isInt) {
+        uint8_t rev[_HF_CMPLOG_VAL_MAX];
+        for (size_t i = 0; i < len; i++) {
+            rev[i] = val[len - i - 1];
+        }
+        input_addCmpLogWord(run->global, rev, len);
+    }
+}
+
+/* Operands which can be found in the input are most likely read from it, they're not constants */
+static bool input_cmpLogInInput(run_t* run, const uint8_t* val, size_t len, bool isInt) {
+    if (len == 0 || memmem(run->dynamicFile, run->dynamicFileSz, val, len)) {
+        return true;
+    }
+    if (isInt) {
+        uint8_t rev[_HF_CMPLOG_VAL_MAX];
+        for (size_t i = 0; i < len; i++) {
+            rev[i] = val[len - i - 1];
+        }
+        if (memmem(run->dynamicFile, run->dynamicFileSz, rev, len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void input_cmpLogConsume(run_t* run) {
+    cmpLog_t* cl = &run->feedbackMap->cmpLog[run->fuzzNo];
+    size_t cnt = MIN(ATOMIC_GET(cl->cnt), _HF_CMPLOG_MAX);
+
+    memcpy(run->inputToState.entries, cl->entries, sizeof(cl->entries[0]) * cnt);
+    run->inputToState.cnt = cnt;
+
+    for (size_t i = 0; i < cnt; i++) {
+        const cmpLogEntry_t* e = &cl->entries[i];
+        /* The ring is written by the fuzzed process, don't trust the lengths */
+        size_t len1 = MIN(e->len1, _HF_CMPLOG_VAL_MAX);
+        size_t len2 = MIN(e->len2, _HF_CMPLOG_VAL_MAX);
+        bool isInt = (e->flags & _HF_CMPLOG_INT);
+
+        if (e->flags & _HF_CMPLOG_CONST) {
+            input_addCmpLogVal(run, e->v1, len1, isInt);
+            continue;
+        }
+        if (!input_cmpLogInInput(run, e->v1, len1, isInt)) {
+            input_addCmpLogVal(run, e->v1, len1, isInt);
+        }
+        if (!input_cmpLogInInput(run, e->v2, len2, isInt)) {
+            input_addCmpLogVal(run, e->v2, len2, isInt);
+        }
+    }
+
+    memset(cl->seen, '\0', sizeof(cl->seen));
+    ATOMIC_SET(cl->cnt, 0);
+}
+
+/* Max. distance of the blacklist entries from their home slots, i.e. the max. lookup cost */
+#define _HF_BL_MAX_PROBE 8U
+
+static size_t input_blSlot(const stackHashBl_t* bl, uint64_t hash) {
+    return (size_t)((hash * bl->mul) >> bl->shift);
+}
+
+/* Returns NULL if some entry ends up further than _HF_BL_MAX_PROBE slots from its home slot */
+static stackHashBl_t* input_blBuild(
+    const uint64_t* hashes, size_t cnt, unsigned bits, uint64_t mul) {
+    size_t capacity = (size_t)1 << bits;
+    stackHashBl_t* bl = util_Calloc(sizeof(stackHashBl_t) + capacity * sizeof(uint64_t));
+    bl->mul = mul | 1ULL;
+    bl->shift = 64 - bits;
+    bl->maxProbe = 0;
+    bl->cnt = 0;
+
+    for (size_t i = 0; i < cnt; i++) {
+        size_t home = input_blSlot(bl, hashes[i]);
+        for (size_t p = 0;; p++) {
+            uint64_t* slot = &bl->slots[(home + p) & (capacity - 1)];
+            if (*slot == hashes[i]) {
+                break;
+            }
+            if (p >= _HF_BL_MAX_PROBE) {
+                free(bl);
+                return NULL;
+            }
+            if (*slot == 0) {
+                *slot = hashes[i];
+                bl->maxProbe = MAX(bl->maxProbe, p);
+                bl->cnt++;
+                break;
+            }
+        }
+    }
+    return bl;
+}
+
+/* Parses the file (hex stack hashes, one per line, in any order), returns NULL if it's empty */
+static stackHashBl_t* input_blLoad(const char* fname) {
+    FILE* fBl = fopen(fname, "rb");
     if (fBl == NULL) {
-        PLOG_W("Couldn't open '%s' - R/O mode", hfuzz->feedback.blacklistFile);
-        return false;
+        PLOG_W("Couldn't open '%s' - R/O mode", fname);
+        return NULL;
     }
     defer {
         fclose(fBl);
     };
 
+    uint64_t* hashes = NULL;
+    size_t cnt = 0;
+    size_t capacity = 0;
+    defer {
+        free(hashes);
+    };
     char* lineptr = NULL;
     /* lineptr can be NULL, but it's fine for free() */
     defer {
         free(lineptr);
     };
     size_t n = 0;
-    for (;;) {
-        if (getline(&lineptr, &n, fBl) == -1) {
-            break;
+    while (getline(&lineptr, &n, fBl) != -1) {
+        /* Stack hash 0 means 'no stack hash', so it also marks the empty slots */
+        uint64_t hash = strtoull(lineptr, 0, 16);
+        if (hash == 0) {
+            continue;
         }
+        if (cnt == capacity) {
+            capacity = capacity ? (capacity * 2) : 1024;
+            hashes = util_Realloc(hashes, capacity * sizeof(hashes[0]));
+        }
+        hashes[cnt++] = hash;
+        LOG_D("Blacklist: loaded %'" PRIu64 "'", hash);
+    }
+    if (cnt == 0) {
+        return NULL;
+    }
+
+    /* Hashes masked with _HF_SINGLE_FRAME_MASK cluster, so try a few multipliers before growing */
+    unsigned bits = 6;
+    while (((size_t)1 << bits) < cnt * 2) {
+        bits++;
+    }
+    for (uint64_t mul = 0x9E3779B97F4A7C15ULL;; bits++) {
+        for (size_t i = 0; i < 8; i++) {
+            stackHashBl_t* bl = input_blBuild(hashes, cnt, bits, mul);
+            if (bl) {
+                return bl;
+            }
+            mul = mul * 0xbf58476d1ce4e5b9ULL + 0x94d049bb133111ebULL;
+        }
+    }
+}
+
+bool input_parseBlacklist(honggfuzz_t* hfuzz) {
+    hfuzz->feedback.blacklist = input_blLoad(hfuzz->feedback.blacklistFile);
+    if (hfuzz->feedback.blacklist == NULL) {
+        LOG_F("Empty stack hashes blacklist file '%s'", hfuzz->feedback.blacklistFile);
+        return false;
+    }
+    LOG_I("Loaded %zu stack hash(es) from the blacklist file (max. probes: %zu)",
+        hfuzz->feedback.blacklist->cnt, hfuzz->feedback.blacklist->maxProbe + 1);
+    return true;
+}
+
+void input_reloadBlacklist(honggfuzz_t* hfuzz) {
+    static time_t lastCheck = 0;
+    static struct stat lastSt = {};
+    if (!hfuzz->feedback.blacklistFile) {
+        return;
+    }
+    time_t now = time(NULL);
+    if (now == lastCheck) {
+        return;
+    }
+    lastCheck = now;
+
+    struct stat st;
+    if (stat(hfuzz->feedback.blacklistFile, &st) == -1) {
+        return;
+    }
+    if (lastSt.st_mtime == 0) {
+        /* The file was parsed at the start-up */
+        lastSt = st;
+        return;
+    }
+    /* Also replaced files (e.g. with mv) and files modified within the same second */
+    if (st.st_mtime == lastSt.st_mtime && st.st_size == lastSt.st_size &&
+        st.st_ino == lastSt.st_ino) {
+        return;
+    }
+    lastSt = st;
 
-        if ((hfuzz->feedback.blacklist = util_Realloc(hfuzz->feedback.blacklist,
-                 (hfuzz->feedback.blacklistCnt + 1) * sizeof(hfuzz->feedback.blacklist[0]))) ==
-            NULL) {
-            PLOG_W("realloc failed (sz=%zu)",
-                (hfuzz->feedback.blacklistCnt + 1) * sizeof(hfuzz->feedback.blacklist[0]));
+    stackHashBl_t* bl = input_blLoad(hfuzz->feedback.blacklistFile);
+    if (bl == NULL) {
+        LOG_W("The stack hashes blacklist file '%s' is empty now, keeping the old blacklist",
+            hfuzz->feedback.blacklistFile);
+        return;
+    }
+    /*
+     * The old one is not freed, as the crash analysis might still be using it. It's small, and the
+     * file changes rarely
+     */
+    ATOMIC_SET_RELEASE(hfuzz->feedback.blacklist, bl);
+    LOG_I("Reloaded %zu stack hash(es) from the blacklist file '%s'", bl->cnt,
+        hfuzz->feedback.blacklistFile);
+}
+
+bool input_isBlacklisted(honggfuzz_t* hfuzz, uint64_t hash) {
+    const stackHashBl_t* bl = ATOMIC_GET_ACQUIRE(hfuzz->feedback.blacklist);
+    if (bl == NULL || hash == 0) {
+        return false;
+    }
+    size_t mask = ((size_t)1 << (64 - bl->shift)) - 1;
+    size_t home = input_blSlot(bl, hash);
+    for (size_t p = 0; p <= bl->maxProbe; p++) {
+        uint64_t slot = bl->slots[(home + p) & mask];
+        if (slot == hash) {
+            return true;
+        }
+        if (slot == 0) {
             return false;
         }
+    }
+    return false;
+}
+
+/*
+ * The dynamic corpus is an append-only array of dynfile_t pointers, split into segments which are
+ * never reallocated. Writers serialize on dynfileq_mutex, and publish new entries by a
+ * release-store of dynfileqCnt, so readers can index the array without taking any lock.
+ */
+struct dynfile_t* input_getDynamicInput(honggfuzz_t* hfuzz, size_t idx) {
+    /* Entries can be replaced (with input_replaceDynamicInput()) by a release-store as well */
+    return ATOMIC_GET_ACQUIRE(
+        hfuzz->io.dynfileqSegs[idx >> _HF_DYNFILE_SEG_SHIFT][idx & (_HF_DYNFILE_SEG_SZ - 1)]);
+}
+
+/*
+ * Corpus entries executing this many times slower than the median one are slow: their share of
+ * the fuzzing time is cut to what an entry this much slower would get
+ */
+#define _HF_DYNFILE_SLOW_MUL 10
+
+/* Called with dynfileq_mutex held, after dynfileqExecTimes was changed for 'cnt' entries */
+static void input_updateExecTimes(honggfuzz_t* hfuzz, size_t cnt) {
+    size_t idx = 0;
+    for (uint64_t seen = 0; idx < _HF_EXEC_TIMES_BUCKETS - 1; idx++) {
+        seen += hfuzz->io.dynfileqExecTimes[idx];
+        if (seen * 2 >= cnt) {
+            break;
+        }
+    }
+    uint64_t median = subproc_execTimesBucketMax(idx);
+    size_t slowCnt = 0;
+    for (size_t i = 0; i < _HF_EXEC_TIMES_BUCKETS; i++) {
+        /* Buckets which aren't entirely above the limit are not counted */
+        if (i && subproc_execTimesBucketMax(i - 1) > (median * _HF_DYNFILE_SLOW_MUL)) {
+            slowCnt += hfuzz->io.dynfileqExecTimes[i];
+        }
+    }
+    ATOMIC_SET(hfuzz->io.dynfileqMedianUSecs, median);
+    ATOMIC_SET(hfuzz->io.dynfileqSlowCnt, slowCnt);
+}
+
+/*
+ * 0 for the usual corpus entries, otherwise the exec time above which an entry is slow: it then
+ * gets (slowLimit / dynfile->timeExecUSecs) of the scheduler's turns it'd get otherwise
+ */
+static uint64_t input_dynfileSlowLimit(run_t* run, struct dynfile_t* dynfile) {
+    uint64_t slowLimit = ATOMIC_GET(run->global->io.dynfileqMedianUSecs) * _HF_DYNFILE_SLOW_MUL;
+    return (slowLimit && dynfile->timeExecUSecs > slowLimit) ? slowLimit : 0;
+}
 
-        hfuzz->feedback.blacklist[hfuzz->feedback.blacklistCnt] = strtoull(lineptr, 0, 16);
-        LOG_D("Blacklist: loaded %'" PRIu64 "'",
-            hfuzz->feedback.blacklist[hfuzz->feedback.blacklistCnt]);
+size_t input_slowDynamicInputs(honggfuzz_t* hfuzz) {
+    return ATOMIC_GET(hfuzz->io.dynfileqSlowCnt);
+}
+
+/*
+ * Content hashes of the corpus entries (the entries themselves, as they're never freed), used to
+ * reject byte-identical inputs (e.g. found concurrently by a few threads). Open addressing, grown
+ * at 50% load, protected by dynfileq_mutex
+ */
+static struct {
+    const struct dynfile_t** slots;
+    size_t capacity;
+    size_t cnt;
+} dynHashes = {
+    .slots = NULL,
+    .capacity = 0,
+    .cnt = 0,
+};
 
-        /* Verify entries are sorted so we can use interpolation search */
-        if (hfuzz->feedback.blacklistCnt > 1) {
-            if (hfuzz->feedback.blacklist[hfuzz->feedback.blacklistCnt - 1] >
-                hfuzz->feedback.blacklist[hfuzz->feedback.blacklistCnt]) {
-                LOG_F("Blacklist file not sorted. Use 'tools/createStackBlacklist.sh' to sort "
-                      "records");
-                return false;
+static const struct dynfile_t** input_dynHashesSlot(uint64_t crc64f, uint64_t crc64r) {
+    const size_t mask = dynHashes.capacity - 1;
+    for (size_t i = crc64f & mask;; i = (i + 1) & mask) {
+        const struct dynfile_t* e = dynHashes.slots[i];
+        if (e == NULL || (e->crc64f == crc64f && e->crc64r == crc64r)) {
+            return &dynHashes.slots[i];
+        }
+    }
+}
+
+/* Returns false if an input with the same content hash is already in the corpus */
+static bool input_dynHashesAdd(const struct dynfile_t* dynfile) {
+    if ((dynHashes.cnt + 1) * 2 > dynHashes.capacity) {
+        const struct dynfile_t** old = dynHashes.slots;
+        size_t oldCapacity = dynHashes.capacity;
+        dynHashes.capacity = oldCapacity ? (oldCapacity * 2) : 4096;
+        dynHashes.slots = util_Calloc(dynHashes.capacity * sizeof(dynHashes.slots[0]));
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i]) {
+                *input_dynHashesSlot(old[i]->crc64f, old[i]->crc64r) = old[i];
             }
         }
-        hfuzz->feedback.blacklistCnt += 1;
+        free(old);
     }
 
-    if (hfuzz->feedback.blacklistCnt > 0) {
-        LOG_I("Loaded %zu stack hash(es) from the blacklist file", hfuzz->feedback.blacklistCnt);
-    } else {
-        LOG_F("Empty stack hashes blacklist file '%s'", hfuzz->feedback.blacklistFile);
+    const struct dynfile_t** slot = input_dynHashesSlot(dynfile->crc64f, dynfile->crc64r);
+    if (*slot) {
+        return false;
     }
+    *slot = dynfile;
+    dynHashes.cnt++;
     return true;
 }
 
-bool input_prepareDynamicInput(run_t* run, bool need_mangle) {
-    {
-        MX_SCOPED_RWLOCK_READ(&run->global->io.dynfileq_mutex);
+struct dynfile_t* input_addDynamicInput(honggfuzz_t* hfuzz, const uint8_t* data, size_t len,
+    uint64_t timeExecUSecs, uint64_t newCov) {
+    struct dynfile_t* dynfile = (struct dynfile_t*)util_Malloc(sizeof(struct dynfile_t));
+    dynfile->size = len;
+    dynfile->idx = 0;
+    dynfile->crc64f = util_CRC64(data, len);
+    dynfile->crc64r = util_CRC64Rev(data, len);
+    dynfile->timeExecUSecs = timeExecUSecs;
+    dynfile->newCov = newCov;
+    dynfile->picked = 0;
+    dynfile->data = (uint8_t*)util_Malloc(len);
+    memcpy(dynfile->data, data, len);
+
+    MX_SCOPED_LOCK(&hfuzz->io.dynfileq_mutex);
+
+    size_t idx = hfuzz->io.dynfileqCnt;
+    size_t seg = idx >> _HF_DYNFILE_SEG_SHIFT;
+    if (seg >= _HF_DYNFILE_SEG_MAX) {
+        LOG_W("The dynamic corpus is full (%zu entries), not adding a new input", idx);
+        free(dynfile->data);
+        free(dynfile);
+        return NULL;
+    }
+    if (!input_dynHashesAdd(dynfile)) {
+        LOG_D("Input of size %zu (%016" PRIx64 "%016" PRIx64 ") is already in the corpus", len,
+            dynfile->crc64f, dynfile->crc64r);
+        free(dynfile->data);
+        free(dynfile);
+        return NULL;
+    }
+    if (hfuzz->io.dynfileqSegs[seg] == NULL) {
+        hfuzz->io.dynfileqSegs[seg] =
+            (struct dynfile_t**)util_Calloc(sizeof(struct dynfile_t*) * _HF_DYNFILE_SEG_SZ);
+    }
+    dynfile->idx = idx;
+    hfuzz->io.dynfileqSegs[seg][idx & (_HF_DYNFILE_SEG_SZ - 1)] = dynfile;
+    ATOMIC_POST_ADD(hfuzz->io.dynfileqTimeExecUSecs, timeExecUSecs);
+    hfuzz->io.dynfileqExecTimes[subproc_execTimesBucket(timeExecUSecs)]++;
+    input_updateExecTimes(hfuzz, idx + 1);
+    ATOMIC_SET_RELEASE(hfuzz->io.dynfileqCnt, idx + 1);
 
-        if (run->global->io.dynfileqCnt == 0) {
-            LOG_F("The dynamic file corpus is empty. This shouldn't happen");
+    return dynfile;
+}
+
+struct dynfile_t* input_replaceDynamicInput(
+    honggfuzz_t* hfuzz, size_t idx, const uint8_t* data, size_t len, uint64_t timeExecUSecs) {
+    struct dynfile_t* dynfile = (struct dynfile_t*)util_Malloc(sizeof(struct dynfile_t));
+    dynfile->data = (uint8_t*)util_Malloc(len ? len : 1);
+    memcpy(dynfile->data, data, len);
+    dynfile->size = len;
+    dynfile->idx = idx;
+    dynfile->crc64f = util_CRC64(data, len);
+    dynfile->crc64r = util_CRC64Rev(data, len);
+    dynfile->timeExecUSecs = timeExecUSecs;
+
+    MX_SCOPED_LOCK(&hfuzz->io.dynfileq_mutex);
+
+    /* The old content stays in the set of hashes, as it's equivalent to the new one */
+    if (!input_dynHashesAdd(dynfile)) {
+        free(dynfile->data);
+        free(dynfile);
+        return NULL;
+    }
+
+    struct dynfile_t* old = input_getDynamicInput(hfuzz, idx);
+    dynfile->newCov = old->newCov;
+    dynfile->picked = ATOMIC_GET(old->picked);
+    ATOMIC_POST_ADD(hfuzz->io.dynfileqTimeExecUSecs, timeExecUSecs - old->timeExecUSecs);
+    hfuzz->io.dynfileqExecTimes[subproc_execTimesBucket(old->timeExecUSecs)]--;
+    hfuzz->io.dynfileqExecTimes[subproc_execTimesBucket(timeExecUSecs)]++;
+    input_updateExecTimes(hfuzz, hfuzz->io.dynfileqCnt);
+    /* The old entry stays allocated, its data might still be in use by other threads */
+    ATOMIC_SET_RELEASE(
+        hfuzz->io.dynfileqSegs[idx >> _HF_DYNFILE_SEG_SHIFT][idx & (_HF_DYNFILE_SEG_SZ - 1)],
+        dynfile);
+
+    return dynfile;
+}
+
+/*
+ * Energy of a corpus entry in the (1-256) range: inputs which yielded more new coverage, and which
+ * execute faster than the corpus average are preferred, while large and already often picked
+ * inputs are penalized
+ */
+static uint64_t input_dynfileEnergy(run_t* run, struct dynfile_t* dynfile, size_t cnt) {
+    uint64_t avgExecUSecs = ATOMIC_GET(run->global->io.dynfileqTimeExecUSecs) / cnt;
+    uint64_t avgPicked = ATOMIC_GET(run->global->cnts.mutationsCnt) / cnt;
+
+    uint64_t energy = 16 + MIN(dynfile->newCov, 48);
+
+    if (dynfile->timeExecUSecs * 4 < avgExecUSecs) {
+        energy *= 4;
+    } else if (dynfile->timeExecUSecs * 2 < avgExecUSecs) {
+        energy *= 2;
+    } else if (dynfile->timeExecUSecs > avgExecUSecs * 4) {
+        energy /= 4;
+    } else if (dynfile->timeExecUSecs > avgExecUSecs * 2) {
+        energy /= 2;
+    }
+    if (dynfile->size > (64 * 1024)) {
+        energy /= 2;
+    }
+    if (ATOMIC_GET(dynfile->picked) > (avgPicked * 2 + 16)) {
+        energy /= 2;
+    }
+    uint64_t slowLimit = input_dynfileSlowLimit(run, dynfile);
+    if (slowLimit) {
+        energy = (energy * slowLimit) / dynfile->timeExecUSecs;
+    }
+
+    return MAX(energy, 1);
+}
+
+/* Weighted sampling by rejection: bounded number of tries, each one O(1) */
+static size_t input_schedWeighted(run_t* run, size_t cnt) {
+    size_t idx = 0;
+    for (int i = 0; i < 32; i++) {
+        idx = (size_t)util_rndGet(0, cnt - 1);
+        uint64_t energy = input_dynfileEnergy(run, input_getDynamicInput(run->global, idx), cnt);
+        if (util_rndGet(1, 256) <= energy) {
+            break;
         }
+    }
+    return idx;
+}
 
-        if (run->dynfileqCurrent == NULL) {
-            run->dynfileqCurrent = TAILQ_FIRST(&run->global->io.dynfileq);
-        } else {
-            if (run->dynfileqCurrent == TAILQ_LAST(&run->global->io.dynfileq, dyns_t)) {
-                run->dynfileqCurrent = TAILQ_FIRST(&run->global->io.dynfileq);
-            } else {
-                run->dynfileqCurrent = TAILQ_NEXT(run->dynfileqCurrent, pointers);
+static void input_schedNext(run_t* run, size_t cnt) {
+    switch (run->global->io.dynfileqSched) {
+        case _HF_SCHED_WEIGHTED:
+            run->dynfileqCurrent = input_schedWeighted(run, cnt);
+            break;
+        case _HF_SCHED_RR:
+        default:
+            /* Slow entries are skipped with the (1 - slowLimit / timeExecUSecs) probability */
+            for (int i = 0; i < 16; i++) {
+                run->dynfileqCurrent++;
+                if (run->dynfileqCurrent >= cnt) {
+                    run->dynfileqCurrent = 0;
+                }
+                struct dynfile_t* df = input_getDynamicInput(run->global, run->dynfileqCurrent);
+                uint64_t slowLimit = input_dynfileSlowLimit(run, df);
+                if (!slowLimit || util_rndGet(1, df->timeExecUSecs) <= slowLimit) {
+                    break;
+                }
+            }
+            break;
+    }
+}
+
+struct dynfile_t* input_pickDynamicInput(honggfuzz_t* hfuzz) {
+    size_t cnt = ATOMIC_GET_ACQUIRE(hfuzz->io.dynfileqCnt);
+    if (cnt == 0) {
+        return NULL;
+    }
+    return input_getDynamicInput(hfuzz, util_rndGet(0, cnt - 1));
+}
+
+bool input_prepareDynamicInput(run_t* run, bool need_mangle) {
+    size_t cnt = ATOMIC_GET_ACQUIRE(run->global->io.dynfileqCnt);
+    if (cnt == 0) {
+        LOG_F("The dynamic file corpus is empty. This shouldn't happen");
+    }
+
+    /* Large inputs are mutated a few times in a row, see mangleJournal_t */
+    if (run->journal.dynfile && run->journal.dynfile->size >= _HF_JOURNAL_MIN_SZ &&
+        run->journal.reused < _HF_JOURNAL_REUSE_MAX) {
+        run->journal.reused++;
+    } else {
+        run->journal.reused = 0;
+        input_schedNext(run, cnt);
+    }
+    struct dynfile_t* dynfile = input_getDynamicInput(run->global, run->dynfileqCurrent);
+    ATOMIC_POST_INC(dynfile->picked);
+
+    input_setSize(run, dynfile->size);
+    if (run->journal.dynfile == dynfile && run->journal.cnt <= _HF_JOURNAL_MAX) {
+        for (size_t i = 0; i < run->journal.cnt; i++) {
+            size_t off = run->journal.ranges[i].off;
+            if (off < dynfile->size) {
+                size_t len = MIN(run->journal.ranges[i].len, dynfile->size - off);
+                memcpy(&run->dynamicFile[off], &dynfile->data[off], len);
             }
         }
+    } else {
+        memcpy(run->dynamicFile, dynfile->data, dynfile->size);
     }
+    input_journalReset(run, dynfile);
 
-    input_setSize(run, run->dynfileqCurrent->size);
-    memcpy(run->dynamicFile, run->dynfileqCurrent->data, run->dynfileqCurrent->size);
     if (need_mangle) {
-        mangle_mangleContent(run);
+        uint64_t started = stats_start();
+        if (!mutator_crossOver(run, dynfile)) {
+            mangle_mangleContent(run);
+        }
+        stats_record(run, STATS_PHASE_MANGLE, started);
     }
 
     return true;
@@ -344,21 +1170,32 @@ bool input_prepareDynamicInput(run_t* run, bool need_mangle) {
 
 bool input_prepareStaticFile(run_t* run, bool rewind, bool need_mangle) {
     char fname[PATH_MAX];
-    if (!input_getNext(run, fname, /* rewind= */ rewind)) {
+    const uint8_t* data;
+    size_t len;
+    if (!input_getNext(run, fname, &data, &len, /* rewind= */ rewind)) {
         return false;
     }
     snprintf(run->origFileName, sizeof(run->origFileName), "%s", fname);
 
-    input_setSize(run, run->global->mutate.maxFileSz);
-    ssize_t fileSz = files_readFileToBufMax(fname, run->dynamicFile, run->global->mutate.maxFileSz);
-    if (fileSz < 0) {
-        LOG_E("Couldn't read contents of '%s'", fname);
-        return false;
+    input_journalReset(run, NULL);
+    if (data) {
+        len = MIN(len, run->global->mutate.maxFileSz);
+        input_setSize(run, len);
+        memcpy(run->dynamicFile, data, len);
+    } else {
+        input_setSize(run, run->global->mutate.maxFileSz);
+        ssize_t fileSz =
+            files_readFileToBufMax(fname, run->dynamicFile, run->global->mutate.maxFileSz);
+        if (fileSz < 0) {
+            LOG_E("Couldn't read contents of '%s'", fname);
+            return false;
+        }
+        input_setSize(run, fileSz);
     }
-
-    input_setSize(run, fileSz);
     if (need_mangle) {
+        uint64_t started = stats_start();
         mangle_mangleContent(run);
+        stats_record(run, STATS_PHASE_MANGLE, started);
     }
 
     return true;
@@ -386,6 +1223,7 @@ bool input_prepareExternalFile(run_t* run) {
     }
     LOG_D("Subporcess '%s' finished with success", run->global->exe.externalCommand);
 
+    input_journalReset(run, NULL);
     input_setSize(run, run->global->mutate.maxFileSz);
     ssize_t sz = files_readFromFdSeek(fd, run->dynamicFile, run->global->mutate.maxFileSz, 0);
     if (sz == -1) {
@@ -418,6 +1256,7 @@ bool input_postProcessFile(run_t* run) {
     }
     LOG_D("Subporcess '%s' finished with success", run->global->exe.externalCommand);
 
+    input_journalReset(run, NULL);
     input_setSize(run, run->global->mutate.maxFileSz);
     ssize_t sz = files_readFromFdSeek(fd, run->dynamicFile, run->global->mutate.maxFileSz, 0);
     if (sz == -1) {
@@ -450,6 +1289,7 @@ bool input_feedbackMutateFile(run_t* run) {
     }
     LOG_D("Subporcess '%s' finished with success", run->global->exe.externalCommand);
 
+    input_journalReset(run, NULL);
     input_setSize(run, run->global->mutate.maxFileSz);
     ssize_t sz = files_readFromFdSeek(fd, run->dynamicFile, run->global->mutate.maxFileSz, 0);
     if (sz == -1) {
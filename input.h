@@ -27,10 +27,36 @@
 #include "honggfuzz.h"
 
 extern void input_setSize(run_t* run, size_t sz);
-extern bool input_getNext(run_t* run, char* fname, bool rewind);
+/* Starts a new journal of changes of run->dynamicFile, NULL if it's not a copy of a corpus entry */
+extern void input_journalReset(run_t* run, struct dynfile_t* dynfile);
+extern void input_setBatchCrashInput(run_t* run);
+extern bool input_getNext(
+    run_t* run, char* fname, const uint8_t** data, size_t* len, bool rewind);
 extern bool input_init(honggfuzz_t* hfuzz);
 extern bool input_parseDictionary(honggfuzz_t* hfuzz);
 extern bool input_parseBlacklist(honggfuzz_t* hfuzz);
+/* Re-parses the stack hashes blacklist file if it has changed, called from the main thread */
+extern void input_reloadBlacklist(honggfuzz_t* hfuzz);
+/* O(1): at most stackHashBl_t.maxProbe + 1 slots are checked */
+extern bool input_isBlacklisted(honggfuzz_t* hfuzz, uint64_t hash);
+extern void input_initCmpLogDict(honggfuzz_t* hfuzz);
+/* Adds operands logged by the fuzzed process (cmpLog_t) to the dictionary, and resets the ring */
+extern void input_cmpLogConsume(run_t* run);
+extern struct dynfile_t* input_addDynamicInput(honggfuzz_t* hfuzz, const uint8_t* data, size_t len,
+    uint64_t timeExecUSecs, uint64_t newCov);
+/*
+ * Replaces the corpus entry no. 'idx' with a new one (e.g. trimmed, --trim), which keeps the
+ * scheduler metadata of the old one. Readers get either of them. Returns NULL if the new content
+ * is already in the corpus (as does input_addDynamicInput())
+ */
+extern struct dynfile_t* input_replaceDynamicInput(
+    honggfuzz_t* hfuzz, size_t idx, const uint8_t* data, size_t len, uint64_t timeExecUSecs);
+/* Returns a random entry of the dynamic corpus, or NULL if it's empty */
+extern struct dynfile_t* input_pickDynamicInput(honggfuzz_t* hfuzz);
+/* Number of the corpus entries which are slow compared to the median one (demoted by scheduler) */
+extern size_t input_slowDynamicInputs(honggfuzz_t* hfuzz);
+/* The corpus entry no. 'idx', which must be below (an acquire-load of) io.dynfileqCnt */
+extern struct dynfile_t* input_getDynamicInput(honggfuzz_t* hfuzz, size_t idx);
 extern bool input_prepareDynamicInput(run_t* run, bool need_mangele);
 extern bool input_prepareStaticFile(run_t* run, bool rewind, bool need_mangele);
 extern bool input_prepareExternalFile(run_t* run);
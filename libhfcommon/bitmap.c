@@ -0,0 +1,282 @@
+/*
+ *
+ * honggfuzz - coverage bitmap operations
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "libhfcommon/bitmap.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif /* defined(__x86_64__) || defined(__i386__) */
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif /* defined(__aarch64__) */
+
+#include "libhfcommon/common.h"
+#include "libhfcommon/util.h"
+
+/*
+ * Merges a block which (probably) contains new bits. The vectorized scanners only find such blocks,
+ * the merge itself must use atomic RMW operations, as 'dst' is shared with other processes
+ */
+static size_t bitmap_mergeBlock(uint8_t* dst, uint8_t* src, size_t len, bool clearSrc) {
+    size_t newBits = 0;
+    size_t i = 0;
+
+    if (((uintptr_t)dst % sizeof(uint64_t)) == 0) {
+        for (; (i + sizeof(uint64_t)) <= len; i += sizeof(uint64_t)) {
+            uint64_t s;
+            memcpy(&s, &src[i], sizeof(s));
+            uint64_t* d = (uint64_t*)&dst[i];
+            if ((s & ~ATOMIC_GET(*d)) == 0) {
+                continue;
+            }
+            uint64_t old = ATOMIC_POST_OR(*d, s);
+            newBits += __builtin_popcountll(s & ~old);
+        }
+    }
+    for (; i < len; i++) {
+        uint8_t s = src[i];
+        if ((s & ~ATOMIC_GET(dst[i])) == 0) {
+            continue;
+        }
+        uint8_t old = ATOMIC_POST_OR(dst[i], s);
+        newBits += __builtin_popcount(s & ~old);
+    }
+
+    if (clearSrc) {
+        memset(src, 0, len);
+    }
+    return newBits;
+}
+
+static size_t bitmap_mergeGeneric(uint8_t* dst, uint8_t* src, size_t sz, bool clearSrc) {
+    size_t newBits = 0;
+    size_t i = 0;
+    for (; (i + BITMAP_BLOCK_SZ) <= sz; i += BITMAP_BLOCK_SZ) {
+        uint64_t s[BITMAP_BLOCK_SZ / sizeof(uint64_t)];
+        uint64_t d[BITMAP_BLOCK_SZ / sizeof(uint64_t)];
+        memcpy(s, &src[i], sizeof(s));
+        uint64_t any = 0;
+        for (size_t j = 0; j < ARRAYSIZE(s); j++) {
+            any |= s[j];
+        }
+        if (any == 0) {
+            continue;
+        }
+        memcpy(d, &dst[i], sizeof(d));
+        uint64_t fresh = 0;
+        for (size_t j = 0; j < ARRAYSIZE(s); j++) {
+            fresh |= (s[j] & ~d[j]);
+        }
+        if (fresh == 0) {
+            if (clearSrc) {
+                memset(&src[i], 0, BITMAP_BLOCK_SZ);
+            }
+            continue;
+        }
+        newBits += bitmap_mergeBlock(&dst[i], &src[i], BITMAP_BLOCK_SZ, clearSrc);
+    }
+    return newBits + bitmap_mergeBlock(&dst[i], &src[i], sz - i, clearSrc);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static size_t bitmap_mergeAVX2(
+    uint8_t* dst, uint8_t* src, size_t sz, bool clearSrc) {
+    size_t newBits = 0;
+    size_t i = 0;
+    for (; (i + BITMAP_BLOCK_SZ) <= sz; i += BITMAP_BLOCK_SZ) {
+        __m256i s0 = _mm256_loadu_si256((const __m256i*)&src[i]);
+        __m256i s1 = _mm256_loadu_si256((const __m256i*)&src[i + 32]);
+        __m256i any = _mm256_or_si256(s0, s1);
+        if (_mm256_testz_si256(any, any)) {
+            continue;
+        }
+        __m256i d0 = _mm256_loadu_si256((const __m256i*)&dst[i]);
+        __m256i d1 = _mm256_loadu_si256((const __m256i*)&dst[i + 32]);
+        __m256i fresh = _mm256_or_si256(_mm256_andnot_si256(d0, s0), _mm256_andnot_si256(d1, s1));
+        if (_mm256_testz_si256(fresh, fresh)) {
+            if (clearSrc) {
+                memset(&src[i], 0, BITMAP_BLOCK_SZ);
+            }
+            continue;
+        }
+        newBits += bitmap_mergeBlock(&dst[i], &src[i], BITMAP_BLOCK_SZ, clearSrc);
+    }
+    return newBits + bitmap_mergeBlock(&dst[i], &src[i], sz - i, clearSrc);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static size_t bitmap_mergeAVX512(
+    uint8_t* dst, uint8_t* src, size_t sz, bool clearSrc) {
+    size_t newBits = 0;
+    size_t i = 0;
+    for (; (i + BITMAP_BLOCK_SZ) <= sz; i += BITMAP_BLOCK_SZ) {
+        __m512i s = _mm512_loadu_si512((const void*)&src[i]);
+        if (_mm512_test_epi64_mask(s, s) == 0) {
+            continue;
+        }
+        __m512i d = _mm512_loadu_si512((const void*)&dst[i]);
+        __m512i fresh = _mm512_andnot_si512(d, s);
+        if (_mm512_test_epi64_mask(fresh, fresh) == 0) {
+            if (clearSrc) {
+                memset(&src[i], 0, BITMAP_BLOCK_SZ);
+            }
+            continue;
+        }
+        newBits += bitmap_mergeBlock(&dst[i], &src[i], BITMAP_BLOCK_SZ, clearSrc);
+    }
+    return newBits + bitmap_mergeBlock(&dst[i], &src[i], sz - i, clearSrc);
+}
+#endif /* defined(__x86_64__) || defined(__i386__) */
+
+#if defined(__aarch64__)
+static size_t bitmap_mergeNEON(uint8_t* dst, uint8_t* src, size_t sz, bool clearSrc) {
+    size_t newBits = 0;
+    size_t i = 0;
+    for (; (i + BITMAP_BLOCK_SZ) <= sz; i += BITMAP_BLOCK_SZ) {
+        uint8x16_t s0 = vld1q_u8(&src[i]);
+        uint8x16_t s1 = vld1q_u8(&src[i + 16]);
+        uint8x16_t s2 = vld1q_u8(&src[i + 32]);
+        uint8x16_t s3 = vld1q_u8(&src[i + 48]);
+        uint8x16_t any = vorrq_u8(vorrq_u8(s0, s1), vorrq_u8(s2, s3));
+        if (vmaxvq_u8(any) == 0) {
+            continue;
+        }
+        uint8x16_t f0 = vbicq_u8(s0, vld1q_u8(&dst[i]));
+        uint8x16_t f1 = vbicq_u8(s1, vld1q_u8(&dst[i + 16]));
+        uint8x16_t f2 = vbicq_u8(s2, vld1q_u8(&dst[i + 32]));
+        uint8x16_t f3 = vbicq_u8(s3, vld1q_u8(&dst[i + 48]));
+        uint8x16_t fresh = vorrq_u8(vorrq_u8(f0, f1), vorrq_u8(f2, f3));
+        if (vmaxvq_u8(fresh) == 0) {
+            if (clearSrc) {
+                memset(&src[i], 0, BITMAP_BLOCK_SZ);
+            }
+            continue;
+        }
+        newBits += bitmap_mergeBlock(&dst[i], &src[i], BITMAP_BLOCK_SZ, clearSrc);
+    }
+    return newBits + bitmap_mergeBlock(&dst[i], &src[i], sz - i, clearSrc);
+}
+#endif /* defined(__aarch64__) */
+
+static size_t (*bitmap_mergeImpl)(uint8_t* dst, uint8_t* src, size_t sz, bool clearSrc) =
+    bitmap_mergeGeneric;
+static const char* bitmap_mergeImplName = "generic";
+
+static void bitmap_initImpl(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        bitmap_mergeImpl = bitmap_mergeAVX512;
+        bitmap_mergeImplName = "avx512";
+        return;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        bitmap_mergeImpl = bitmap_mergeAVX2;
+        bitmap_mergeImplName = "avx2";
+        return;
+    }
+#endif /* defined(__x86_64__) || defined(__i386__) */
+#if defined(__aarch64__)
+    bitmap_mergeImpl = bitmap_mergeNEON;
+    bitmap_mergeImplName = "neon";
+#endif /* defined(__aarch64__) */
+}
+
+static pthread_once_t bitmap_initOnce = PTHREAD_ONCE_INIT;
+
+size_t bitmap_merge(uint8_t* dst, uint8_t* src, size_t sz, bool clearSrc) {
+    pthread_once(&bitmap_initOnce, bitmap_initImpl);
+    return bitmap_mergeImpl(dst, src, sz, clearSrc);
+}
+
+const char* bitmap_implName(void) {
+    pthread_once(&bitmap_initOnce, bitmap_initImpl);
+    return bitmap_mergeImplName;
+}
+
+static unsigned bitmap_closestWordGeneric(
+    uint64_t val, const uint64_t* words, size_t cnt, size_t* idx) {
+    unsigned best = 65;
+    for (size_t i = 0; i < cnt; i++) {
+        unsigned d = (unsigned)__builtin_popcountll(val ^ words[i]);
+        if (d < best) {
+            best = d;
+            *idx = i;
+            if (d == 0) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx512f,avx512vpopcntdq"))) static unsigned bitmap_closestWordAVX512(
+    uint64_t val, const uint64_t* words, size_t cnt, size_t* idx) {
+    const __m512i v = _mm512_set1_epi64((long long)val);
+    unsigned best = 65;
+    size_t i = 0;
+    for (; (i + 8) <= cnt; i += 8) {
+        __m512i d = _mm512_popcnt_epi64(_mm512_xor_si512(_mm512_loadu_si512(&words[i]), v));
+        unsigned min = (unsigned)_mm512_reduce_min_epu64(d);
+        if (min < best) {
+            best = min;
+            __mmask8 m = _mm512_cmpeq_epu64_mask(d, _mm512_set1_epi64(min));
+            *idx = i + (size_t)__builtin_ctz(m);
+            if (min == 0) {
+                return 0;
+            }
+        }
+    }
+    if (i < cnt) {
+        size_t tailIdx = 0;
+        unsigned d = bitmap_closestWordGeneric(val, &words[i], cnt - i, &tailIdx);
+        if (d < best) {
+            best = d;
+            *idx = i + tailIdx;
+        }
+    }
+    return best;
+}
+#endif /* defined(__x86_64__) */
+
+static unsigned (*bitmap_closestWordImpl)(
+    uint64_t val, const uint64_t* words, size_t cnt, size_t* idx) = bitmap_closestWordGeneric;
+
+static void bitmap_initClosestWord(void) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vpopcntdq")) {
+        bitmap_closestWordImpl = bitmap_closestWordAVX512;
+    }
+#endif /* defined(__x86_64__) */
+}
+
+static pthread_once_t bitmap_closestWordOnce = PTHREAD_ONCE_INIT;
+
+unsigned bitmap_closestWord(uint64_t val, const uint64_t* words, size_t cnt, size_t* idx) {
+    pthread_once(&bitmap_closestWordOnce, bitmap_initClosestWord);
+    *idx = 0;
+    return bitmap_closestWordImpl(val, words, cnt, idx);
+}
@@ -0,0 +1,48 @@
+/*
+ *
+ * honggfuzz - coverage bitmap operations
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_COMMON_BITMAP_H_
+#define _HF_COMMON_BITMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bitmaps are scanned in blocks of this size, all-zero blocks of 'src' are skipped */
+#define BITMAP_BLOCK_SZ 64U
+
+/*
+ * Merges (ORs) the 'src' bitmap into the (shared, concurrently updated) 'dst' one, and returns the
+ * number of bits which were not set in 'dst' before. If 'clearSrc' is set, 'src' is zeroed. The
+ * AVX-512, AVX2, NEON or generic implementation is selected at runtime
+ */
+extern size_t bitmap_merge(uint8_t* dst, uint8_t* src, size_t sz, bool clearSrc);
+
+/* Name of the implementation used by bitmap_merge() */
+extern const char* bitmap_implName(void);
+
+/*
+ * Returns the smallest Hamming distance between 'val' and any of words[0..cnt-1] (cnt > 0), and
+ * stores the index of the (first) closest word in 'idx'. Uses AVX-512 VPOPCNTDQ if available
+ */
+extern unsigned bitmap_closestWord(uint64_t val, const uint64_t* words, size_t cnt, size_t* idx);
+
+#endif /* ifndef _HF_COMMON_BITMAP_H_ */
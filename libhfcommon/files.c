@@ -43,6 +43,10 @@
 #endif /* defined(_HF_ARCH_LINUX) */
 #include <sys/time.h>
 #include <sys/types.h>
+#if defined(_HF_ARCH_LINUX)
+#include <sys/uio.h>
+#endif /* defined(_HF_ARCH_LINUX) */
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "libhfcommon/common.h"
@@ -280,6 +284,19 @@ uint8_t* files_mapFile(const char* fileName, off_t* fileSz, int* fd, bool isWrit
     return buf;
 }
 
+uint64_t files_crc64File(const char* fileName) {
+    off_t sz;
+    int fd;
+    uint8_t* buf = files_mapFile(fileName, &sz, &fd, /* isWritable= */ false);
+    if (!buf) {
+        return 0;
+    }
+    uint64_t crc = util_CRC64(buf, (size_t)sz);
+    munmap(buf, sz);
+    close(fd);
+    return crc;
+}
+
 /* mmap flags for various OSs, when mmap'ing a temporary file or a shared mem */
 int files_getTmpMapFlags(int flag, bool nocore) {
 #if defined(MAP_NOSYNC)
@@ -311,14 +328,14 @@ int files_getTmpMapFlags(int flag, bool nocore) {
     return flag;
 }
 
-void* files_mapSharedMem(size_t sz, int* fd, const char* name, bool nocore) {
-    *fd = -1;
-
 #if defined(_HF_ARCH_LINUX)
 
 #if !defined(MFD_CLOEXEC) /* sys/memfd.h is not always present */
 #define MFD_CLOEXEC 0x0001U
 #endif /* !defined(MFD_CLOEXEC) */
+#if !defined(MFD_HUGETLB)
+#define MFD_HUGETLB 0x0004U
+#endif /* !defined(MFD_HUGETLB) */
 
 #if !defined(__NR_memfd_create)
 #if defined(__x86_64__)
@@ -327,11 +344,113 @@ void* files_mapSharedMem(size_t sz, int* fd, const char* name, bool nocore) {
 #endif /* !defined(__NR_memfd_create) */
 
 #if defined(__NR_memfd_create)
-    *fd = syscall(__NR_memfd_create, name, (uintptr_t)MFD_CLOEXEC);
-#endif /* defined__NR_memfd_create) */
+/*
+ * hugetlbfs files can only have sizes which are multiples of the huge page size, and their
+ * mappings (without MAP_NORESERVE) fail, rather than the page faults later, if there are not enough
+ * reserved huge pages (vm.nr_hugepages)
+ */
+static void* files_mapHugeTlb(size_t* sz, int* fd, const char* name) {
+    int hfd = syscall(__NR_memfd_create, name, (uintptr_t)(MFD_CLOEXEC | MFD_HUGETLB));
+    if (hfd == -1) {
+        PLOG_D("memfd_create('%s', MFD_CLOEXEC|MFD_HUGETLB)", name);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(hfd, &st) == -1) {
+        PLOG_W("fstat(%d)", hfd);
+        close(hfd);
+        return NULL;
+    }
+    /* st_blksize of a hugetlbfs file is its huge page size */
+    size_t hsz = ((*sz + st.st_blksize - 1) / st.st_blksize) * st.st_blksize;
+    if (TEMP_FAILURE_RETRY(ftruncate(hfd, hsz)) == -1) {
+        PLOG_D("ftruncate(%d, %zu)", hfd, hsz);
+        close(hfd);
+        return NULL;
+    }
+    int mflags = files_getTmpMapFlags(MAP_SHARED, /* nocore= */ true);
+    void* ret = mmap(NULL, hsz, PROT_READ | PROT_WRITE, mflags, hfd, 0);
+    if (ret == MAP_FAILED) {
+        PLOG_D("mmap(sz=%zu, fd=%d) of huge pages, not enough of them reserved?", hsz, hfd);
+        close(hfd);
+        return NULL;
+    }
+    LOG_D("'%s' (size: %zu) is backed by %zu KiB huge pages", name, hsz,
+        (size_t)st.st_blksize / 1024);
+    *sz = hsz;
+    *fd = hfd;
+    return ret;
+}
+#endif /* defined(__NR_memfd_create) */
 
 #endif /* defined(_HF_ARCH_LINUX) */
 
+#if defined(_HF_ARCH_LINUX)
+static size_t files_pipeMaxSz(void) {
+    static size_t maxSz = 0;
+    if (ATOMIC_GET(maxSz) == 0) {
+        char buf[32] = {};
+        ssize_t sz = files_readFileToBufMax("/proc/sys/fs/pipe-max-size", (uint8_t*)buf, 31);
+        size_t val = (sz > 0) ? strtoul(buf, NULL, 10) : 0;
+        ATOMIC_SET(maxSz, (val > 65536 && val <= INT_MAX) ? val : 65536);
+    }
+    return ATOMIC_GET(maxSz);
+}
+
+int files_pipeFromBuf(const uint8_t* buf, size_t len) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        PLOG_W("pipe2(O_CLOEXEC)");
+        return -1;
+    }
+    /* The default pipe capacity is 64KiB, bigger ones are limited by /proc/sys/fs/pipe-max-size */
+    if (len > 65536) {
+        int psz = len > files_pipeMaxSz() ? (int)files_pipeMaxSz() : (int)len;
+        if (fcntl(fds[1], F_SETPIPE_SZ, psz) == -1) {
+            PLOG_D("fcntl(%d, F_SETPIPE_SZ, %d)", fds[1], psz);
+        }
+    }
+    /* The pages of the buffer are referenced by the pipe, not copied into it */
+    for (size_t off = 0; off < len;) {
+        struct iovec iov = {
+            .iov_base = (void*)(buf + off),
+            .iov_len = len - off,
+        };
+        ssize_t sz = TEMP_FAILURE_RETRY(vmsplice(fds[1], &iov, 1, SPLICE_F_NONBLOCK));
+        if (sz == -1 && errno == EAGAIN) {
+            LOG_D("The pipe is full, the input is truncated from %zu to %zu bytes", len, off);
+            break;
+        }
+        if (sz <= 0) {
+            PLOG_W("vmsplice(fd=%d, len=%zu)", fds[1], len - off);
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        off += (size_t)sz;
+    }
+    close(fds[1]);
+    return fds[0];
+}
+#else  /* defined(_HF_ARCH_LINUX) */
+int files_pipeFromBuf(const uint8_t* buf HF_ATTR_UNUSED, size_t len HF_ATTR_UNUSED) {
+    LOG_E("Pipes filled with vmsplice() are supported under Linux only");
+    return -1;
+}
+#endif /* defined(_HF_ARCH_LINUX) */
+
+static void* files_mapSharedFd(
+    size_t sz, int* fd, const char* name, files_huge_t huge, bool populate) {
+#if defined(_HF_ARCH_LINUX) && defined(__NR_memfd_create)
+    if (huge == FILES_HUGE_TLB) {
+        void* ret = files_mapHugeTlb(&sz, fd, name);
+        if (ret != NULL) {
+            return ret;
+        }
+    }
+    *fd = syscall(__NR_memfd_create, name, (uintptr_t)MFD_CLOEXEC);
+#endif /* defined(_HF_ARCH_LINUX) && defined(__NR_memfd_create) */
+
 /* SHM_ANON is available with some *BSD OSes */
 #if defined(SHM_ANON)
     if (*fd == -1) {
@@ -371,11 +490,46 @@ void* files_mapSharedMem(size_t sz, int* fd, const char* name, bool nocore) {
         return NULL;
     }
     int mflags = files_getTmpMapFlags(MAP_SHARED, /* nocore= */ true);
+#if defined(MAP_POPULATE)
+    if (!populate) {
+        mflags &= ~MAP_POPULATE;
+    }
+#endif /* defined(MAP_POPULATE) */
+#if defined(MADV_HUGEPAGE)
+    /*
+     * Transparent huge pages (of shmem, with /sys/kernel/mm/transparent_hugepage/shmem_enabled set
+     * to 'advise' or 'always') are allocated by the page faults which come after the madvise()
+     */
+    if (huge != FILES_HUGE_NONE) {
+        mflags &= ~MAP_POPULATE;
+    }
+#endif /* defined(MADV_HUGEPAGE) */
     void* ret = mmap(NULL, sz, PROT_READ | PROT_WRITE, mflags, *fd, 0);
     if (ret == MAP_FAILED) {
         PLOG_W("mmap(sz=%zu, fd=%d)", sz, *fd);
-        *fd = -1;
         close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+#if defined(MADV_HUGEPAGE)
+    if (huge != FILES_HUGE_NONE) {
+        if (madvise(ret, sz, MADV_HUGEPAGE) == -1) {
+            PLOG_D("madvise(sz=%zu, MADV_HUGEPAGE)", sz);
+        }
+#if defined(MADV_POPULATE_WRITE)
+        if (madvise(ret, sz, MADV_POPULATE_WRITE) == -1) {
+            PLOG_D("madvise(sz=%zu, MADV_POPULATE_WRITE)", sz);
+        }
+#endif /* defined(MADV_POPULATE_WRITE) */
+    }
+#endif /* defined(MADV_HUGEPAGE) */
+    return ret;
+}
+
+void* files_mapSharedMem(size_t sz, int* fd, const char* name, bool nocore, files_huge_t huge) {
+    *fd = -1;
+    void* ret = files_mapSharedFd(sz, fd, name, huge, /* populate= */ true);
+    if (ret == NULL) {
         return NULL;
     }
     if (posix_madvise(ret, sz, POSIX_MADV_RANDOM) == -1) {
@@ -396,6 +550,57 @@ void* files_mapSharedMem(size_t sz, int* fd, const char* name, bool nocore) {
     return ret;
 }
 
+void* files_mapSharedMemSparse(size_t sz, int* fd, const char* name) {
+    *fd = -1;
+    void* ret = files_mapSharedFd(sz, fd, name, FILES_HUGE_NONE, /* populate= */ false);
+    if (ret == NULL) {
+        return NULL;
+    }
+#if defined(MADV_DONTDUMP)
+    if (madvise(ret, sz, MADV_DONTDUMP) == -1) {
+        PLOG_W("madvise(sz=%zu, MADV_DONTDUMP)", sz);
+    }
+#endif /* defined(MADV_DONTDUMP) */
+    return ret;
+}
+
+ssize_t files_growSharedMem(int fd, size_t sz) {
+    /* The object is shared by many processes, which could otherwise shrink it after one another */
+    struct flock fl = {
+        .l_type = F_WRLCK,
+        .l_whence = SEEK_SET,
+        .l_start = 0,
+        .l_len = 0,
+    };
+    if (TEMP_FAILURE_RETRY(fcntl(fd, F_SETLKW, &fl)) == -1) {
+        PLOG_W("fcntl(fd=%d, F_SETLKW)", fd);
+        return -1;
+    }
+
+    ssize_t ret = -1;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        PLOG_W("fstat(fd=%d)", fd);
+    } else if ((size_t)st.st_size >= sz) {
+        ret = (ssize_t)st.st_size;
+    } else {
+        /* st_blksize of a hugetlbfs file is its huge page size */
+        size_t blk = (st.st_blksize > 0) ? (size_t)st.st_blksize : 4096U;
+        size_t newSz = ((sz + blk - 1) / blk) * blk;
+        if (TEMP_FAILURE_RETRY(ftruncate(fd, newSz)) == -1) {
+            PLOG_W("ftruncate(fd=%d, %zu)", fd, newSz);
+        } else {
+            ret = (ssize_t)newSz;
+        }
+    }
+
+    fl.l_type = F_UNLCK;
+    if (fcntl(fd, F_SETLK, &fl) == -1) {
+        PLOG_W("fcntl(fd=%d, F_SETLK, F_UNLCK)", fd);
+    }
+    return ret;
+}
+
 sa_family_t files_sockFamily(int sock) {
     struct sockaddr addr;
     socklen_t addrlen = sizeof(addr);
@@ -430,6 +635,12 @@ const char* files_sockAddrToStr(const struct sockaddr* sa) {
         return str;
     }
 
+    if (sa->sa_family == AF_UNIX) {
+        const struct sockaddr_un* sun = (const struct sockaddr_un*)sa;
+        snprintf(str, sizeof(str), "unix:%.*s", (int)sizeof(sun->sun_path), sun->sun_path);
+        return str;
+    }
+
     snprintf(str, sizeof(str), "Unsupported sockaddr family=%d", (int)sa->sa_family);
     return str;
 }
@@ -58,9 +58,36 @@ extern const char* files_basename(const char* path);
 
 extern uint8_t* files_mapFile(const char* fileName, off_t* fileSz, int* fd, bool isWritable);
 
+/* CRC64 of the file's contents, or 0 if it couldn't be read */
+extern uint64_t files_crc64File(const char* fileName);
+
 extern int files_getTmpMapFlags(int flag, bool nocore);
 
-extern void* files_mapSharedMem(size_t sz, int* fd, const char* name, bool nocore);
+/* Huge pages backing the memory of files_mapSharedMem() (Linux, ignored elsewhere) */
+typedef enum {
+    FILES_HUGE_NONE = 0,
+    /* Transparent huge pages (madvise), the file can still be resized, and read with read() */
+    FILES_HUGE_THP,
+    /* hugetlbfs pages (with the size rounded up to their size), or THP if none are reserved */
+    FILES_HUGE_TLB,
+} files_huge_t;
+
+extern void* files_mapSharedMem(
+    size_t sz, int* fd, const char* name, bool nocore, files_huge_t huge);
+/* Its pages are allocated as they're touched, not up-front, for big maps which are mostly empty */
+extern void* files_mapSharedMemSparse(size_t sz, int* fd, const char* name);
+/*
+ * Grows the shared memory object to at least 'sz' bytes (rounded up to its block size), never
+ * shrinks it. Returns its new size, or -1
+ */
+extern ssize_t files_growSharedMem(int fd, size_t sz);
+
+/*
+ * A pipe with the buffer spliced (vmsplice) into it, and its write end closed. The buffer must
+ * not change until the pipe is read, and what exceeds the maximal pipe size is dropped. Returns
+ * the read end of the pipe, or -1 (Linux)
+ */
+extern int files_pipeFromBuf(const uint8_t* buf, size_t len);
 
 extern size_t files_parseSymbolFilter(const char* inFIle, char*** filterList);
 
@@ -26,10 +26,14 @@
 #include <getopt.h>
 #include <limits.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -53,6 +57,60 @@ static bool log_fd_isatty = false;
 enum llevel_t log_level = INFO;
 static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Asynchronous logging (logAsyncStart()): every thread formats its messages into its own
+ * single-producer ring of records, and the writer thread drains all the rings (in the order of the
+ * records' global sequence numbers) to log_fd in batches. Only the rings' consumer needs log_mutex,
+ * so a producer which finds its ring full (or logs a FATAL message) drains the rings itself, and
+ * keeps the ordering. INFO and WARNING messages are rate-limited per thread, and consecutive
+ * identical messages are coalesced into a single "repeated" line
+ */
+#define LOG_MSG_SZ 2048
+#define LOG_RING_RECS 64
+#define LOG_RINGS_MAX 128
+#define LOG_RATE_PER_SEC 200
+#define LOG_WRITER_TICK_NSEC (10ULL * 1000ULL * 1000ULL)
+
+typedef struct {
+    uint64_t seq;
+    enum llevel_t ll;
+    int ln;
+    pid_t tid;
+    time_t ts;
+    /* __FUNCTION__ or a string literal */
+    const char* fn;
+    char msg[LOG_MSG_SZ];
+} logRec_t;
+
+typedef struct {
+    /* Only the owner thread produces records */
+    bool owned;
+    logRec_t* recs;
+    uint64_t head;
+    uint64_t tail;
+    /* Rate-limiting state of the owner thread */
+    time_t rateSec;
+    size_t rateCnt;
+    size_t suppressed;
+} logRing_t;
+
+static bool log_async = false;
+static pid_t log_async_pid = 0;
+static bool log_async_stop = false;
+static pthread_t log_writer;
+static pthread_key_t log_ring_key;
+static __thread logRing_t* log_ring = NULL;
+static logRing_t log_rings[LOG_RINGS_MAX];
+static uint64_t log_seq = 0;
+
+/* Consumer state, protected by log_mutex */
+static struct {
+    char buf[1024 * 64];
+    size_t len;
+    logRec_t last;
+    size_t repeats;
+} log_out;
+
 __attribute__((constructor)) static void log_init(void) {
     log_fd = fcntl(log_fd, F_DUPFD_CLOEXEC, 0);
     if (log_fd == -1) {
@@ -82,11 +140,18 @@ void logInitLogFile(const char* logfile, int fd, enum llevel_t ll) {
     log_fd_isatty = (isatty(log_fd) == 1 ? true : false);
 }
 
-void logLog(enum llevel_t ll, const char* fn, int ln, bool perr, const char* fmt, ...) {
-    char strerr[512];
-    if (perr == true) {
-        snprintf(strerr, sizeof(strerr), "%s", strerror(errno));
+static void logFlushLocked(void) {
+    for (size_t off = 0; off < log_out.len;) {
+        ssize_t sz = TEMP_FAILURE_RETRY(write(log_fd, &log_out.buf[off], log_out.len - off));
+        if (sz <= 0) {
+            break;
+        }
+        off += (size_t)sz;
     }
+    log_out.len = 0;
+}
+
+static void logFormatLocked(const logRec_t* rec) {
     struct ll_t {
         const char* descr;
         const char* prefix;
@@ -103,44 +168,288 @@ void logLog(enum llevel_t ll, const char* fn, int ln, bool perr, const char* fmt
         {"HB", "\033[1m", false, false},
     };
 
-    time_t ltstamp = time(NULL);
-    struct tm utctime;
-    localtime_r(&ltstamp, &utctime);
-    char timestr[32];
-    if (strftime(timestr, sizeof(timestr) - 1, "%FT%T%z", &utctime) == 0) {
-        timestr[0] = '\0';
+    /* Enough for the longest line */
+    if ((sizeof(log_out.buf) - log_out.len) < (LOG_MSG_SZ + 256)) {
+        logFlushLocked();
     }
+    char* out = &log_out.buf[log_out.len];
+    size_t outSz = sizeof(log_out.buf) - log_out.len;
+    size_t len = 0;
 
-    /* Start printing logs */
-    {
-        MX_LOCK(&log_mutex);
+    if (log_fd_isatty) {
+        len += snprintf(&out[len], outSz - len, "%s", logLevels[rec->ll].prefix);
+    }
+    if (logLevels[rec->ll].print_time) {
+        struct tm utctime;
+        localtime_r(&rec->ts, &utctime);
+        char timestr[32];
+        if (strftime(timestr, sizeof(timestr) - 1, "%FT%T%z", &utctime) == 0) {
+            timestr[0] = '\0';
+        }
+        len += snprintf(&out[len], outSz - len, "[%s][%s][%d] ", timestr,
+            logLevels[rec->ll].descr, (int)rec->tid);
+    }
+    if (logLevels[rec->ll].print_funcline) {
+        len += snprintf(&out[len], outSz - len, "%s():%d ", rec->fn, rec->ln);
+    }
+    len += snprintf(&out[len], outSz - len, "%s", rec->msg);
+    if (log_fd_isatty) {
+        len += snprintf(&out[len], outSz - len, "\033[0m");
+    }
+    len += snprintf(&out[len], outSz - len, "\n");
 
-        if (log_fd_isatty) {
-            dprintf(log_fd, "%s", logLevels[ll].prefix);
+    log_out.len += MIN(len, outSz - 1);
+}
+
+static void logFlushRepeatsLocked(void) {
+    if (log_out.repeats == 0) {
+        return;
+    }
+    logRec_t* rec = &log_out.last;
+    char msg[LOG_MSG_SZ];
+    snprintf(msg, sizeof(msg), "%s", rec->msg);
+    snprintf(rec->msg, sizeof(rec->msg), "Last message repeated %zu times: %s", log_out.repeats,
+        msg);
+    rec->ts = time(NULL);
+    logFormatLocked(rec);
+    log_out.repeats = 0;
+    /* Don't coalesce with the summary */
+    log_out.last.fn = NULL;
+}
+
+static void logEmitLocked(const logRec_t* rec) {
+    logRec_t* last = &log_out.last;
+    if (rec->ll != FATAL && last->fn == rec->fn && last->ln == rec->ln && last->ll == rec->ll &&
+        strcmp(last->msg, rec->msg) == 0) {
+        log_out.repeats++;
+        return;
+    }
+    logFlushRepeatsLocked();
+    logFormatLocked(rec);
+    memcpy(last, rec, offsetof(logRec_t, msg));
+    snprintf(last->msg, sizeof(last->msg), "%s", rec->msg);
+}
+
+/* Writes all the queued records, the caller is the consumer (holds log_mutex) */
+static void logDrainLocked(void) {
+    for (;;) {
+        logRing_t* next = NULL;
+        uint64_t nextSeq = UINT64_MAX;
+        for (size_t i = 0; i < LOG_RINGS_MAX; i++) {
+            logRing_t* ring = &log_rings[i];
+            if (ring->tail == ATOMIC_GET_ACQUIRE(ring->head)) {
+                continue;
+            }
+            const logRec_t* rec = &ring->recs[ring->tail % LOG_RING_RECS];
+            if (rec->seq < nextSeq) {
+                nextSeq = rec->seq;
+                next = ring;
+            }
         }
-        if (logLevels[ll].print_time) {
-            dprintf(log_fd, "[%s][%s][%d] ", timestr, logLevels[ll].descr, __hf_pid());
+        if (!next) {
+            break;
         }
-        if (logLevels[ll].print_funcline) {
-            dprintf(log_fd, "%s():%d ", fn, ln);
+        logEmitLocked(&next->recs[next->tail % LOG_RING_RECS]);
+        ATOMIC_SET_RELEASE(next->tail, next->tail + 1);
+    }
+
+    for (size_t i = 0; i < LOG_RINGS_MAX; i++) {
+        size_t suppressed = ATOMIC_XCHG(log_rings[i].suppressed, 0);
+        if (suppressed) {
+            logFlushRepeatsLocked();
+            logRec_t rec = {
+                .ll = WARNING,
+                .ln = __LINE__,
+                .tid = __hf_pid(),
+                .ts = time(NULL),
+                .fn = __FUNCTION__,
+            };
+            snprintf(rec.msg, sizeof(rec.msg), "%zu log messages suppressed (rate limit: %d/s)",
+                suppressed, LOG_RATE_PER_SEC);
+            logFormatLocked(&rec);
         }
+    }
+}
 
-        va_list args;
-        va_start(args, fmt);
-        vdprintf(log_fd, fmt, args);
-        va_end(args);
+static void logRingRelease(void* arg) {
+    logRing_t* ring = (logRing_t*)arg;
+    ATOMIC_SET_RELEASE(ring->owned, false);
+}
 
-        if (perr == true) {
-            dprintf(log_fd, ": %s", strerr);
+static logRing_t* logRingGet(void) {
+    if (log_ring) {
+        return log_ring;
+    }
+    for (size_t i = 0; i < LOG_RINGS_MAX; i++) {
+        bool expected = false;
+        if (ATOMIC_GET(log_rings[i].owned) ||
+            !__atomic_compare_exchange_n(&log_rings[i].owned, &expected, true, false,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
         }
-        if (log_fd_isatty) {
-            dprintf(log_fd, "\033[0m");
+        if (!log_rings[i].recs) {
+            log_rings[i].recs = (logRec_t*)calloc(LOG_RING_RECS, sizeof(logRec_t));
+            if (!log_rings[i].recs) {
+                ATOMIC_SET_RELEASE(log_rings[i].owned, false);
+                return NULL;
+            }
         }
-        dprintf(log_fd, "\n");
+        log_rings[i].rateSec = 0;
+        log_rings[i].rateCnt = 0;
+        log_ring = &log_rings[i];
+        pthread_setspecific(log_ring_key, log_ring);
+        return log_ring;
+    }
+    return NULL;
+}
 
+/* Returns false if the record has to be written synchronously */
+static bool logRingPush(enum llevel_t ll, const char* fn, int ln, time_t ts, const char* msg) {
+    logRing_t* ring = logRingGet();
+    if (!ring) {
+        return false;
+    }
+    if (ll == INFO || ll == WARNING) {
+        if (ring->rateSec != ts) {
+            ring->rateSec = ts;
+            ring->rateCnt = 0;
+        }
+        if (++ring->rateCnt > LOG_RATE_PER_SEC) {
+            ATOMIC_POST_INC(ring->suppressed);
+            return true;
+        }
+    }
+    if ((ring->head - ATOMIC_GET_ACQUIRE(ring->tail)) >= LOG_RING_RECS) {
+        return false;
+    }
+
+    logRec_t* rec = &ring->recs[ring->head % LOG_RING_RECS];
+    rec->seq = ATOMIC_POST_INC(log_seq);
+    rec->ll = ll;
+    rec->ln = ln;
+    rec->tid = __hf_pid();
+    rec->ts = ts;
+    rec->fn = fn;
+    snprintf(rec->msg, sizeof(rec->msg), "%s", msg);
+    ATOMIC_SET_RELEASE(ring->head, ring->head + 1);
+    return true;
+}
+
+static void* logWriterThread(void* arg HF_ATTR_UNUSED) {
+    for (;;) {
+        const struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = LOG_WRITER_TICK_NSEC,
+        };
+        nanosleep(&ts, NULL);
+
+        bool stop = ATOMIC_GET_ACQUIRE(log_async_stop);
+        MX_LOCK(&log_mutex);
+        logDrainLocked();
+        /* Coalesced messages are summarized at least once a second */
+        if (log_out.repeats && (time(NULL) - log_out.last.ts) >= 1) {
+            logFlushRepeatsLocked();
+        }
+        logFlushLocked();
+        MX_UNLOCK(&log_mutex);
+
+        if (stop) {
+            return NULL;
+        }
+    }
+}
+
+static void logAsyncDrain(void) {
+    MX_LOCK(&log_mutex);
+    logDrainLocked();
+    logFlushRepeatsLocked();
+    logFlushLocked();
+    MX_UNLOCK(&log_mutex);
+}
+
+static void logAsyncAtExit(void) {
+    if (ATOMIC_GET(log_async) && getpid() == log_async_pid) {
+        logAsyncDrain();
+    }
+}
+
+bool logAsyncStart(void) {
+    if (ATOMIC_GET(log_async)) {
+        return true;
+    }
+    static bool registered = false;
+    if (!registered) {
+        if (pthread_key_create(&log_ring_key, logRingRelease) != 0) {
+            return false;
+        }
+        atexit(logAsyncAtExit);
+        registered = true;
+    }
+
+    /* The writer thread doesn't handle any signals */
+    sigset_t ss, oss;
+    sigfillset(&ss);
+    pthread_sigmask(SIG_SETMASK, &ss, &oss);
+    ATOMIC_SET(log_async_stop, false);
+    int ret = pthread_create(&log_writer, NULL, logWriterThread, NULL);
+    pthread_sigmask(SIG_SETMASK, &oss, NULL);
+    if (ret != 0) {
+        return false;
+    }
+
+    log_async_pid = getpid();
+    ATOMIC_SET_RELEASE(log_async, true);
+    return true;
+}
+
+void logAsyncStop(void) {
+    if (!ATOMIC_GET(log_async) || getpid() != log_async_pid) {
+        return;
+    }
+    ATOMIC_SET_RELEASE(log_async_stop, true);
+    pthread_join(log_writer, NULL);
+    ATOMIC_SET(log_async, false);
+    /* Records which were queued while the writer was exiting */
+    logAsyncDrain();
+}
+
+void logLog(enum llevel_t ll, const char* fn, int ln, bool perr, const char* fmt, ...) {
+    char strerr[512];
+    if (perr == true) {
+        snprintf(strerr, sizeof(strerr), "%s", strerror(errno));
+    }
+
+    logRec_t rec = {
+        .seq = 0,
+        .ll = ll,
+        .ln = ln,
+        .tid = __hf_pid(),
+        .ts = time(NULL),
+        .fn = fn,
+    };
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(rec.msg, sizeof(rec.msg), fmt, args);
+    va_end(args);
+    if (perr == true && len >= 0 && (size_t)len < sizeof(rec.msg)) {
+        snprintf(&rec.msg[len], sizeof(rec.msg) - len, ": %s", strerr);
+    }
+
+    bool async = ATOMIC_GET_ACQUIRE(log_async);
+    if (!async || ll == FATAL || !logRingPush(ll, fn, ln, rec.ts, rec.msg)) {
+        MX_LOCK(&log_mutex);
+        if (async) {
+            logDrainLocked();
+            logEmitLocked(&rec);
+        } else {
+            logFormatLocked(&rec);
+        }
+        if (ll == FATAL) {
+            logFlushRepeatsLocked();
+        }
+        logFlushLocked();
         MX_UNLOCK(&log_mutex);
     }
-    /* End printing logs */
 
     if (ll == FATAL) {
         exit(EXIT_FAILURE);
@@ -166,6 +475,10 @@ pthread_mutex_t* logMutexGet(void) {
 
 void logMutexReset(void) {
     pthread_mutex_init(&log_mutex, NULL);
+    /* The writer thread is gone after fork(), so is the ownership of the rings */
+    ATOMIC_SET(log_async, false);
+    log_out.len = 0;
+    log_out.repeats = 0;
 }
 
 bool logIsTTY(void) {
@@ -78,6 +78,14 @@ extern void logInitLogFile(const char* logfile, int fd, enum llevel_t ll);
 extern void logLog(enum llevel_t ll, const char* fn, int ln, bool perr, const char* fmt, ...)
     __attribute__((format(printf, 5, 6)));
 
+/*
+ * Makes logLog() queue the messages in per-thread rings, which are written by a separate thread,
+ * see log.c. Forked processes (after logMutexReset()) log synchronously again
+ */
+extern bool logAsyncStart(void);
+/* Writes the queued messages, and stops the writer thread */
+extern void logAsyncStop(void);
+
 extern void logStop(int sig);
 
 extern bool logIsTTY(void);
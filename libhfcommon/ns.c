@@ -30,7 +30,9 @@
 #if defined(_HF_ARCH_LINUX)
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <net/if.h>
 #include <sched.h>
 #include <stdbool.h>
@@ -42,6 +44,8 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 bool nsEnter(uintptr_t cloneFlags) {
     pid_t current_uid = getuid();
@@ -129,4 +133,99 @@ bool nsMountTmpfs(const char* dst) {
     return true;
 }
 
+bool nsRemountTmpfs(const char* dst) {
+    if (umount2(dst, MNT_DETACH) == -1 && errno != EINVAL) {
+        PLOG_E("umount2(dst='%s', MNT_DETACH)", dst);
+        return false;
+    }
+    return nsMountTmpfs(dst);
+}
+
+static const struct {
+    uintptr_t flag;
+    const char* name;
+} nsTypes[NS_CNT] = {
+    [NS_USER] = {CLONE_NEWUSER, "user"},
+    [NS_NET] = {CLONE_NEWNET, "net"},
+    [NS_MNT] = {CLONE_NEWNS, "mnt"},
+    [NS_IPC] = {CLONE_NEWIPC, "ipc"},
+    [NS_UTS] = {CLONE_NEWUTS, "uts"},
+};
+
+bool nsCreate(uintptr_t cloneFlags, int fds[NS_CNT]) {
+    for (size_t i = 0; i < NS_CNT; i++) {
+        fds[i] = -1;
+    }
+
+    /*
+     * unshare(CLONE_NEWUSER) needs a single-threaded process, so a forked helper creates the
+     * namespaces, reports it over the socket, and waits there until their nsfs files are opened
+     */
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        PLOG_E("socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC)");
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        PLOG_E("fork()");
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        logMutexReset();
+        close(sv[0]);
+        bool ok = nsEnter(cloneFlags);
+        if (ok && (cloneFlags & CLONE_NEWNET)) {
+            ok = nsIfaceUp("lo");
+        }
+        uint8_t res = ok ? 1 : 0;
+        if (files_writeToFd(sv[1], &res, sizeof(res))) {
+            files_readFromFd(sv[1], &res, sizeof(res));
+        }
+        _exit(0);
+    }
+
+    close(sv[1]);
+    uint8_t res = 0;
+    bool ret = (files_readFromFd(sv[0], &res, sizeof(res)) == sizeof(res)) && (res == 1);
+    for (size_t i = 0; ret && i < NS_CNT; i++) {
+        if (!(cloneFlags & nsTypes[i].flag)) {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "/proc/%d/ns/%s", (int)pid, nsTypes[i].name);
+        if ((fds[i] = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC))) == -1) {
+            PLOG_E("open('%s', O_RDONLY|O_CLOEXEC)", path);
+            ret = false;
+        }
+    }
+    close(sv[0]);
+    /* It might have been reaped already by a wait for any child in another thread */
+    TEMP_FAILURE_RETRY(waitpid(pid, NULL, __WALL));
+
+    if (!ret) {
+        LOG_E("Couldn't create namespaces with flags=%#tx", cloneFlags);
+        for (size_t i = 0; i < NS_CNT; i++) {
+            if (fds[i] != -1) {
+                close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+    }
+    return ret;
+}
+
+bool nsJoin(const int fds[NS_CNT]) {
+    for (size_t i = 0; i < NS_CNT; i++) {
+        if (fds[i] != -1 && setns(fds[i], (int)nsTypes[i].flag) == -1) {
+            PLOG_E("setns(fd=%d, '%s')", fds[i], nsTypes[i].name);
+            return false;
+        }
+    }
+    return true;
+}
+
 #endif /* defined(_HF_ARCH_LINUX) */
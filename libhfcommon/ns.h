@@ -33,6 +33,26 @@ bool nsEnter(uintptr_t cloneFlags);
 bool nsIfaceUp(const char* ifacename);
 bool nsMountTmpfs(const char* dst);
 
+/* Indices of the nsfs fds in the nsCreate()/nsJoin() arrays, the user namespace is joined first */
+enum {
+    NS_USER = 0,
+    NS_NET,
+    NS_MNT,
+    NS_IPC,
+    NS_UTS,
+    NS_CNT,
+};
+
+/*
+ * Creates namespaces (with 'lo' up in the NET one) in a short-lived helper process, and keeps them
+ * alive with their nsfs fds, which are -1 for the types not in cloneFlags
+ */
+bool nsCreate(uintptr_t cloneFlags, int fds[NS_CNT]);
+/* Joins namespaces kept by nsCreate(), which is much cheaper than creating them with nsEnter() */
+bool nsJoin(const int fds[NS_CNT]);
+/* As nsMountTmpfs(), but drops the tmpfs mounted over dst before, if any */
+bool nsRemountTmpfs(const char* dst);
+
 #endif /* defined(_HF_ARCH_LINUX) */
 
 #endif
@@ -40,6 +40,18 @@
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif /* defined(__x86_64__) */
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif /* defined(__aarch64__) */
+#if defined(_HF_ARCH_LINUX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* defined(_HF_ARCH_LINUX) */
 
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
@@ -122,6 +134,60 @@ uint64_t util_rnd64(void) {
     return util_InternalRnd64();
 }
 
+void util_rnd64N(uint64_t* vals, size_t n) {
+    pthread_once(&rndThreadOnce, util_rndInitThread);
+    for (size_t i = 0; i < n; i++) {
+        vals[i] = util_InternalRnd64();
+    }
+}
+
+/*
+ * Advances the state by 2^64 (jump) or 2^96 (long jump) steps. The polynomials are the ones of
+ * xoroshiro128+ with the (55, 14, 36) parameters
+ */
+static void util_rndJump(const uint64_t poly[2]) {
+    uint64_t s0 = 0;
+    uint64_t s1 = 0;
+    for (size_t i = 0; i < 2; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (poly[i] & (1ULL << b)) {
+                s0 ^= rndState[0];
+                s1 ^= rndState[1];
+            }
+            util_InternalRnd64();
+        }
+    }
+    rndState[0] = s0;
+    rndState[1] = s1;
+}
+
+/* splitmix64, expands the seed into the generator state */
+static uint64_t util_rndSplitMix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void util_rndInitNone(void) {
+}
+
+void util_rndSeed(uint64_t seed, uint64_t node, uint64_t stream) {
+    static const uint64_t jump[2] = {0xbeac0467eba5facbULL, 0xd86b048b86aa9922ULL};
+    static const uint64_t longJump[2] = {0x18f7c399ccebda8dULL, 0xf2deac28bef3bb07ULL};
+
+    /* Don't read /dev/urandom in this thread anymore */
+    pthread_once(&rndThreadOnce, util_rndInitNone);
+    rndState[0] = util_rndSplitMix64(&seed);
+    rndState[1] = util_rndSplitMix64(&seed);
+    for (uint64_t i = 0; i < node; i++) {
+        util_rndJump(longJump);
+    }
+    for (uint64_t i = 0; i < stream; i++) {
+        util_rndJump(jump);
+    }
+}
+
 uint64_t util_rndGet(uint64_t min, uint64_t max) {
     if (min > max) {
         LOG_F("min:%" PRIu64 " > max:%" PRIu64, min, max);
@@ -139,26 +205,60 @@ uint8_t util_rndPrintable(void) {
     return util_rndGet(32, 126);
 }
 
-/* Turn one byte to a printable ASCII */
-void util_turnToPrintable(uint8_t* buf, size_t sz) {
-    for (size_t i = 0; i < sz; i++) {
-        buf[i] = buf[i] % 95 + 32;
+/*
+ * Maps bytes to printable ASCII ([32-126]) with a multiply-shift (32 + (b * 95) / 256), instead of
+ * a modulo, so 16 (SSE2/NEON, which are always available on x86-64/AArch64), or 8 bytes (generic)
+ * are processed in one go
+ */
+static void util_bytesToPrintable(uint8_t* buf, size_t sz) {
+    size_t i = 0;
+#if defined(__x86_64__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi16(95);
+    const __m128i base = _mm_set1_epi8(32);
+    for (; (i + 16) <= sz; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&buf[i]);
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), mul), 8);
+        __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), mul), 8);
+        _mm_storeu_si128((__m128i*)&buf[i], _mm_add_epi8(_mm_packus_epi16(lo, hi), base));
+    }
+#endif /* defined(__x86_64__) */
+#if defined(__aarch64__)
+    const uint8x8_t mul = vdup_n_u8(95);
+    const uint8x16_t base = vdupq_n_u8(32);
+    for (; (i + 16) <= sz; i += 16) {
+        uint8x16_t v = vld1q_u8(&buf[i]);
+        uint8x8_t lo = vshrn_n_u16(vmull_u8(vget_low_u8(v), mul), 8);
+        uint8x8_t hi = vshrn_n_u16(vmull_u8(vget_high_u8(v), mul), 8);
+        vst1q_u8(&buf[i], vaddq_u8(vcombine_u8(lo, hi), base));
     }
+#endif /* defined(__aarch64__) */
+    for (; i < sz; i++) {
+        buf[i] = (uint8_t)(32U + (((unsigned)buf[i] * 95U) >> 8));
+    }
+}
+
+/* Turn bytes to printable ASCII */
+void util_turnToPrintable(uint8_t* buf, size_t sz) {
+    util_bytesToPrintable(buf, sz);
 }
 
 void util_rndBufPrintable(uint8_t* buf, size_t sz) {
-    for (size_t i = 0; i < sz; i++) {
-        buf[i] = util_rndPrintable();
-    }
+    util_rndBuf(buf, sz);
+    util_bytesToPrintable(buf, sz);
 }
 
+/* One 64-bit random value provides 8 bytes */
 void util_rndBuf(uint8_t* buf, size_t sz) {
     pthread_once(&rndThreadOnce, util_rndInitThread);
-    if (sz == 0) {
-        return;
+    size_t i = 0;
+    for (; (i + sizeof(uint64_t)) <= sz; i += sizeof(uint64_t)) {
+        const uint64_t rnd = util_InternalRnd64();
+        memcpy(&buf[i], &rnd, sizeof(rnd));
     }
-    for (size_t i = 0; i < sz; i++) {
-        buf[i] = (uint8_t)util_InternalRnd64();
+    if (i < sz) {
+        const uint64_t rnd = util_InternalRnd64();
+        memcpy(&buf[i], &rnd, sz - i);
     }
 }
 
@@ -233,6 +333,112 @@ uint64_t util_hash(const char* buf, size_t len) {
     return ret;
 }
 
+static inline uint64_t util_load64LE(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/* XXH64 (with seed = 0): processes 32 bytes per round, in four independent lanes */
+#define UTIL_XXH_P1 0x9E3779B185EBCA87ULL
+#define UTIL_XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define UTIL_XXH_P3 0x165667B19E3779F9ULL
+#define UTIL_XXH_P4 0x85EBCA77C2B2AE63ULL
+#define UTIL_XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t util_rotl64(uint64_t x, unsigned r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t util_xxhRound(uint64_t acc, uint64_t v) {
+    return util_rotl64(acc + v * UTIL_XXH_P2, 31) * UTIL_XXH_P1;
+}
+
+static inline uint64_t util_xxhMerge(uint64_t h, uint64_t v) {
+    return (h ^ util_xxhRound(0, v)) * UTIL_XXH_P1 + UTIL_XXH_P4;
+}
+
+uint64_t util_hash64(const uint8_t* buf, size_t len) {
+    size_t i = 0;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = UTIL_XXH_P1 + UTIL_XXH_P2;
+        uint64_t v2 = UTIL_XXH_P2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -UTIL_XXH_P1;
+        for (; (i + 32) <= len; i += 32) {
+            v1 = util_xxhRound(v1, util_load64LE(&buf[i]));
+            v2 = util_xxhRound(v2, util_load64LE(&buf[i + 8]));
+            v3 = util_xxhRound(v3, util_load64LE(&buf[i + 16]));
+            v4 = util_xxhRound(v4, util_load64LE(&buf[i + 24]));
+        }
+        h = util_rotl64(v1, 1) + util_rotl64(v2, 7) + util_rotl64(v3, 12) + util_rotl64(v4, 18);
+        h = util_xxhMerge(h, v1);
+        h = util_xxhMerge(h, v2);
+        h = util_xxhMerge(h, v3);
+        h = util_xxhMerge(h, v4);
+    } else {
+        h = UTIL_XXH_P5;
+    }
+    h += (uint64_t)len;
+
+    for (; (i + 8) <= len; i += 8) {
+        h ^= util_xxhRound(0, util_load64LE(&buf[i]));
+        h = util_rotl64(h, 27) * UTIL_XXH_P1 + UTIL_XXH_P4;
+    }
+    if ((i + 4) <= len) {
+        uint64_t v = (uint64_t)buf[i] | ((uint64_t)buf[i + 1] << 8) |
+                     ((uint64_t)buf[i + 2] << 16) | ((uint64_t)buf[i + 3] << 24);
+        h ^= v * UTIL_XXH_P1;
+        h = util_rotl64(h, 23) * UTIL_XXH_P2 + UTIL_XXH_P3;
+        i += 4;
+    }
+    for (; i < len; i++) {
+        h ^= buf[i] * UTIL_XXH_P5;
+        h = util_rotl64(h, 11) * UTIL_XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= UTIL_XXH_P2;
+    h ^= h >> 29;
+    h *= UTIL_XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* The splitmix64 finalizer */
+static inline uint64_t util_mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t util_hashFrame(uint64_t hash, uint64_t pc, uint64_t modOff, const char* module) {
+    uint64_t frame = pc & 0xFFF;
+    if (modOff && module) {
+        const char* base = strrchr(module, '/');
+        base = base ? base + 1 : module;
+        /* FNV-1a */
+        uint64_t modHash = 0xcbf29ce484222325ULL;
+        for (; *base; base++) {
+            modHash ^= (uint8_t)*base;
+            modHash *= 0x100000001b3ULL;
+        }
+        frame = util_mix64(modHash ^ modOff);
+    }
+    /*
+     * Mixing the previous value in makes the hash depend on the order of frames. The constant keeps
+     * the hash of (e.g.) a zero PC non-zero
+     */
+    return util_mix64(hash ^ frame ^ 0x9e3779b97f4a7c15ULL);
+}
+
 int64_t util_timeNowMillis(void) {
     struct timeval tv;
     if (gettimeofday(&tv, NULL) == -1) {
@@ -242,6 +448,15 @@ int64_t util_timeNowMillis(void) {
     return (((int64_t)tv.tv_sec * 1000LL) + ((int64_t)tv.tv_usec / 1000LL));
 }
 
+uint64_t util_timeNowUSecs(void) {
+    struct timeval tv;
+    if (gettimeofday(&tv, NULL) == -1) {
+        PLOG_F("gettimeofday()");
+    }
+
+    return (((uint64_t)tv.tv_sec * 1000000ULL) + (uint64_t)tv.tv_usec);
+}
+
 void util_sleepForMSec(uint64_t msec) {
     if (msec == 0) {
         return;
@@ -253,6 +468,83 @@ void util_sleepForMSec(uint64_t msec) {
     TEMP_FAILURE_RETRY(nanosleep(&ts, &ts));
 }
 
+unsigned util_getCpuUse(cpuTimes_t* prev, long numCpus) {
+    /* Kept open, and re-read from the beginning every time */
+    static int statFd = -1;
+    if (statFd == -1) {
+        statFd = TEMP_FAILURE_RETRY(open("/proc/stat", O_RDONLY | O_CLOEXEC));
+    }
+    if (statFd == -1) {
+        return 0;
+    }
+    /* Only the first line, with the sums for all CPUs, is needed */
+    char buf[256];
+    ssize_t sz = TEMP_FAILURE_RETRY(pread(statFd, buf, sizeof(buf) - 1, 0));
+    if (sz <= 0) {
+        PLOG_W("pread('/proc/stat')");
+        return 0;
+    }
+    buf[sz] = '\0';
+    cpuTimes_t cur;
+    if (sscanf(buf, "cpu  %" PRIu64 "%" PRIu64 "%" PRIu64 "%" PRIu64, &cur.user, &cur.nice,
+            &cur.system, &cur.idle) != 4) {
+        LOG_W("sscanf('/proc/stat') != 4");
+        return 0;
+    }
+
+    uint64_t busyCycles =
+        (cur.user - prev->user) + (cur.nice - prev->nice) + (cur.system - prev->system);
+    uint64_t allCycles = busyCycles + (cur.idle - prev->idle);
+    *prev = cur;
+
+    if (allCycles == 0) {
+        return 0;
+    }
+    return (busyCycles * numCpus * 100) / allCycles;
+}
+
+void util_cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/*
+ * Waits (up to 'msec') until '*addr' stops being equal to 'val'. The futex is not process-private,
+ * as it's used with memory shared between the fuzzer and the fuzzed process. Returns false on
+ * timeout. On systems without futexes it just sleeps for a bit, and the caller re-checks '*addr'
+ */
+bool util_futexWait(uint32_t* addr, uint32_t val, uint64_t msec) {
+#if defined(_HF_ARCH_LINUX)
+    struct timespec ts = {
+        .tv_sec = msec / 1000U,
+        .tv_nsec = (msec % 1000U) * 1000000U,
+    };
+    if (syscall(__NR_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0) == -1 && errno == ETIMEDOUT) {
+        return false;
+    }
+    return true;
+#else
+    if (ATOMIC_GET(*addr) != val) {
+        return true;
+    }
+    util_sleepForMSec(msec < 1U ? msec : 1U);
+    return (ATOMIC_GET(*addr) != val);
+#endif /* defined(_HF_ARCH_LINUX) */
+}
+
+void util_futexWake(uint32_t* addr) {
+#if defined(_HF_ARCH_LINUX)
+    syscall(__NR_futex, addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+    (void)addr;
+#endif /* defined(_HF_ARCH_LINUX) */
+}
+
 uint64_t util_getUINT32(const uint8_t* buf) {
     uint32_t r;
     memcpy(&r, buf, sizeof(r));
@@ -642,22 +934,130 @@ static const uint64_t util_CRC64ISOPoly[] = {
     0x9090000000000000ULL,
 };
 
-uint64_t util_CRC64(const uint8_t* buf, size_t len) {
-    uint64_t res = 0ULL;
+/*
+ * Slicing-by-8: util_CRC64Slices[k][b] is the CRC of a byte 'b' followed by 'k' zero bytes, so 8
+ * input bytes are processed with 8 independent table lookups
+ */
+static uint64_t util_CRC64Slices[8][256];
 
-    for (size_t i = 0; i < len; i++) {
+static inline uint64_t util_CRC64Slice8(uint64_t res, uint64_t v) {
+    res ^= v;
+    return util_CRC64Slices[7][res & 0xFF] ^ util_CRC64Slices[6][(res >> 8) & 0xFF] ^
+           util_CRC64Slices[5][(res >> 16) & 0xFF] ^ util_CRC64Slices[4][(res >> 24) & 0xFF] ^
+           util_CRC64Slices[3][(res >> 32) & 0xFF] ^ util_CRC64Slices[2][(res >> 40) & 0xFF] ^
+           util_CRC64Slices[1][(res >> 48) & 0xFF] ^ util_CRC64Slices[0][res >> 56];
+}
+
+static uint64_t util_CRC64Generic(uint64_t res, const uint8_t* buf, size_t len) {
+    size_t i = 0;
+    for (; (i + 8) <= len; i += 8) {
+        res = util_CRC64Slice8(res, util_load64LE(&buf[i]));
+    }
+    for (; i < len; i++) {
         res = util_CRC64ISOPoly[(uint8_t)res ^ buf[i]] ^ (res >> 8);
     }
+    return res;
+}
 
+/* Same as above, but the bytes are processed backwards, from buf[len - 1] to buf[0] */
+static uint64_t util_CRC64RevGeneric(uint64_t res, const uint8_t* buf, size_t len) {
+    for (; len >= 8; len -= 8) {
+        res = util_CRC64Slice8(res, __builtin_bswap64(util_load64LE(&buf[len - 8])));
+    }
+    for (; len > 0; len--) {
+        res = util_CRC64ISOPoly[(uint8_t)res ^ buf[len - 1]] ^ (res >> 8);
+    }
     return res;
 }
 
-uint64_t util_CRC64Rev(const uint8_t* buf, size_t len) {
-    uint64_t res = 0ULL;
+#if defined(__x86_64__)
+/*
+ * Folds 64 bytes per iteration into four 128-bit accumulators with carry-less multiplications, and
+ * then folds them into one. The constants are bit-reflected x^(128*n+63) and x^(128*n-1) mod P.
+ * The last 16 bytes (the folded remainder) and the tail are processed by the generic code, which
+ * saves the Barrett reduction
+ */
+__attribute__((target("pclmul,ssse3"))) static uint64_t util_CRC64Clmul(
+    const uint8_t* buf, size_t len, bool rev) {
+    const __m128i k512 = _mm_set_epi64x(0xb100010100000001ULL, 0x01b001b1b0000001ULL);
+    const __m128i k128 = _mm_set_epi64x(0xf500000000000001ULL, 0x6b70000000000001ULL);
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
 
-    for (ssize_t i = (ssize_t)len - 1; i >= 0; i--) {
-        res = util_CRC64ISOPoly[(uint8_t)res ^ buf[i]] ^ (res >> 8);
+/* Backwards: the blocks are taken from the end of the buffer, with their bytes reversed */
+#define UTIL_CRC64_LOAD(off)                                                                       \
+    (rev ? _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&buf[len - (off) - 16]), bswap)       \
+         : _mm_loadu_si128((const __m128i*)&buf[(off)]))
+#define UTIL_CRC64_FOLD(x, k)                                                                      \
+    _mm_xor_si128(_mm_clmulepi64_si128((x), (k), 0x00), _mm_clmulepi64_si128((x), (k), 0x11))
+
+    __m128i x0 = UTIL_CRC64_LOAD(0);
+    __m128i x1 = UTIL_CRC64_LOAD(16);
+    __m128i x2 = UTIL_CRC64_LOAD(32);
+    __m128i x3 = UTIL_CRC64_LOAD(48);
+    size_t off = 64;
+    for (; (off + 64) <= len; off += 64) {
+        x0 = _mm_xor_si128(UTIL_CRC64_FOLD(x0, k512), UTIL_CRC64_LOAD(off));
+        x1 = _mm_xor_si128(UTIL_CRC64_FOLD(x1, k512), UTIL_CRC64_LOAD(off + 16));
+        x2 = _mm_xor_si128(UTIL_CRC64_FOLD(x2, k512), UTIL_CRC64_LOAD(off + 32));
+        x3 = _mm_xor_si128(UTIL_CRC64_FOLD(x3, k512), UTIL_CRC64_LOAD(off + 48));
+    }
+    x0 = _mm_xor_si128(UTIL_CRC64_FOLD(x0, k128), x1);
+    x0 = _mm_xor_si128(UTIL_CRC64_FOLD(x0, k128), x2);
+    x0 = _mm_xor_si128(UTIL_CRC64_FOLD(x0, k128), x3);
+    for (; (off + 16) <= len; off += 16) {
+        x0 = _mm_xor_si128(UTIL_CRC64_FOLD(x0, k128), UTIL_CRC64_LOAD(off));
     }
 
-    return res;
+#undef UTIL_CRC64_LOAD
+#undef UTIL_CRC64_FOLD
+
+    uint8_t rem[16];
+    _mm_storeu_si128((__m128i*)rem, x0);
+    uint64_t res = util_CRC64Generic(0ULL, rem, sizeof(rem));
+    if (rev) {
+        return util_CRC64RevGeneric(res, buf, len - off);
+    }
+    return util_CRC64Generic(res, &buf[off], len - off);
+}
+#endif /* defined(__x86_64__) */
+
+/* The folding needs at least four 16-byte blocks */
+#define UTIL_CRC64_CLMUL_MIN 64U
+
+static bool util_CRC64HasClmul = false;
+
+static void util_CRC64Init(void) {
+    memcpy(util_CRC64Slices[0], util_CRC64ISOPoly, sizeof(util_CRC64Slices[0]));
+    for (size_t k = 1; k < ARRAYSIZE(util_CRC64Slices); k++) {
+        for (size_t b = 0; b < 256; b++) {
+            uint64_t prev = util_CRC64Slices[k - 1][b];
+            util_CRC64Slices[k][b] = util_CRC64ISOPoly[prev & 0xFF] ^ (prev >> 8);
+        }
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    util_CRC64HasClmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#endif /* defined(__x86_64__) */
+}
+
+static pthread_once_t util_CRC64Once = PTHREAD_ONCE_INIT;
+
+uint64_t util_CRC64(const uint8_t* buf, size_t len) {
+    pthread_once(&util_CRC64Once, util_CRC64Init);
+#if defined(__x86_64__)
+    if (util_CRC64HasClmul && len >= UTIL_CRC64_CLMUL_MIN) {
+        return util_CRC64Clmul(buf, len, /* rev= */ false);
+    }
+#endif /* defined(__x86_64__) */
+    return util_CRC64Generic(0ULL, buf, len);
+}
+
+uint64_t util_CRC64Rev(const uint8_t* buf, size_t len) {
+    pthread_once(&util_CRC64Once, util_CRC64Init);
+#if defined(__x86_64__)
+    if (util_CRC64HasClmul && len >= UTIL_CRC64_CLMUL_MIN) {
+        return util_CRC64Clmul(buf, len, /* rev= */ true);
+    }
+#endif /* defined(__x86_64__) */
+    return util_CRC64RevGeneric(0ULL, buf, len);
 }
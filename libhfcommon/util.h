@@ -43,6 +43,10 @@
 #define ATOMIC_GET(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
 #define ATOMIC_SET(x, y) __atomic_store_n(&(x), y, __ATOMIC_RELAXED)
 #define ATOMIC_CLEAR(x) __atomic_store_n(&(x), 0, __ATOMIC_RELAXED)
+#define ATOMIC_GET_ACQUIRE(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define ATOMIC_SET_RELEASE(x, y) __atomic_store_n(&(x), y, __ATOMIC_RELEASE)
+#define ATOMIC_GET_SEQCST(x) __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define ATOMIC_SET_SEQCST(x, y) __atomic_store_n(&(x), y, __ATOMIC_SEQ_CST)
 #define ATOMIC_XCHG(x, y) __atomic_exchange_n(&(x), y, __ATOMIC_RELAXED)
 
 #define ATOMIC_PRE_INC(x) __atomic_add_fetch(&(x), 1, __ATOMIC_RELAXED)
@@ -66,11 +70,11 @@
 #define ATOMIC_PRE_INC_RELAXED(x) __atomic_add_fetch(&(x), 1, __ATOMIC_RELAXED)
 #define ATOMIC_POST_OR_RELAXED(x, y) __atomic_fetch_or(&(x), y, __ATOMIC_RELAXED)
 
+/* Sets the bit in the bitmap, and returns its previous value (0 or 1) */
 __attribute__((always_inline)) static inline uint8_t ATOMIC_BTS(uint8_t* addr, size_t offset) {
-    uint8_t oldbit;
+    uint8_t mask = (uint8_t)1U << (offset % 8);
     addr += (offset / 8);
-    oldbit = ATOMIC_POST_OR_RELAXED(*addr, ((uint8_t)1U << (offset % 8)));
-    return oldbit;
+    return (ATOMIC_POST_OR_RELAXED(*addr, mask) & mask) ? 1U : 0U;
 }
 
 extern void* util_Malloc(size_t sz);
@@ -91,6 +95,16 @@ extern void util_rndBufPrintable(uint8_t* buf, size_t sz);
 
 extern uint64_t util_rnd64(void);
 
+/* Fills 'vals' with 'n' random values */
+extern void util_rnd64N(uint64_t* vals, size_t n);
+
+/*
+ * Makes the random number generator of the calling thread deterministic: it's seeded with 'seed',
+ * and moved to the 'stream' (2^64 values long) of the 'node' (2^96 values long), so the streams of
+ * all threads and nodes don't overlap
+ */
+extern void util_rndSeed(uint64_t seed, uint64_t node, uint64_t stream);
+
 extern uint8_t util_rndPrintable(void);
 
 extern void util_turnToPrintable(uint8_t* buf, size_t sz);
@@ -107,10 +121,36 @@ extern void util_getLocalTime(const char* fmt, char* buf, size_t len, time_t tm)
 extern void util_closeStdio(bool close_stdin, bool close_stdout, bool close_stderr);
 
 extern uint64_t util_hash(const char* buf, size_t len);
+/*
+ * A fast (XXH64) hash, for in-memory keys only. Unlike util_hash() and util_CRC64(), its values
+ * don't end up in any file names or stack hashes, so it can be replaced freely
+ */
+extern uint64_t util_hash64(const uint8_t* buf, size_t len);
+/*
+ * Mixes a stack frame into the callstack hash: its offset in the module (e.g. in the mapped file)
+ * and the module's basename, or only the low 12 bits of the PC (not affected by ASLR) if the
+ * module is not known (modOff == 0)
+ */
+extern uint64_t util_hashFrame(uint64_t hash, uint64_t pc, uint64_t modOff, const char* module);
 
 extern int64_t util_timeNowMillis(void);
+extern uint64_t util_timeNowUSecs(void);
 extern void util_sleepForMSec(uint64_t msec);
 
+/* Cumulative CPU times of all CPUs, from /proc/stat, see util_getCpuUse() */
+typedef struct {
+    uint64_t user;
+    uint64_t nice;
+    uint64_t system;
+    uint64_t idle;
+} cpuTimes_t;
+/* Busy CPU time since the previous call with 'prev' (in %, 100 per busy CPU), 0 if unknown */
+extern unsigned util_getCpuUse(cpuTimes_t* prev, long numCpus);
+
+extern void util_cpuRelax(void);
+extern bool util_futexWait(uint32_t* addr, uint32_t val, uint64_t msec);
+extern void util_futexWake(uint32_t* addr);
+
 extern uint64_t util_getUINT32(const uint8_t* buf);
 extern uint64_t util_getUINT64(const uint8_t* buf);
 
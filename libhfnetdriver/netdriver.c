@@ -5,13 +5,18 @@
 #include <inttypes.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 #if defined(_HF_ARCH_LINUX)
 #include <sched.h>
@@ -29,6 +34,24 @@ const char *const LIBHFNETDRIVER_module_netdriver = _HF_NETDRIVER_SIG;
 
 #define HFND_TCP_PORT_ENV "HFND_TCP_PORT"
 #define HFND_SKIP_FUZZING_ENV "HFND_SKIP_FUZZING"
+/* Path of the server's unix socket, used instead of the TCP port */
+#define HFND_UNIX_SOCKET_ENV "HFND_UNIX_SOCKET"
+/* Connections are reused by subsequent inputs, for servers supporting that */
+#define HFND_KEEPALIVE_ENV "HFND_KEEPALIVE"
+/* Number of connections driven by every input, see LLVMFuzzerTestOneInput() */
+#define HFND_SESSIONS_ENV "HFND_SESSIONS"
+/*
+ * The response is complete once the server has been idle for that many microseconds. By default,
+ * kept-alive connections use HFND_KEEPALIVE_IDLE_USEC, and the other ones wait for the server to
+ * close the connection
+ */
+#define HFND_IDLE_USEC_ENV "HFND_IDLE_USEC"
+/* Close connections with RST (SO_LINGER=0), so they don't linger in TIME_WAIT */
+#define HFND_RST_CLOSE_ENV "HFND_RST_CLOSE"
+
+/* Max. number of connections driven by a single input (HFND_SESSIONS) */
+#define HFND_SESSIONS_MAX 16
+#define HFND_KEEPALIVE_IDLE_USEC 20000
 
 static char *initial_server_argv[] = {"fuzzer", NULL};
 
@@ -37,13 +60,33 @@ static struct {
     char **argv_server;
     uint16_t tcp_port;
     sa_family_t sa_family;
+    const char *unix_path;
+    bool keepalive;
+    /* < 0: no idle deadline */
+    int64_t idle_usec;
+    bool rst_close;
+    size_t sessions_cnt;
+    int sessions[HFND_SESSIONS_MAX];
 } hfnd_globals = {
     .argc_server = 1,
     .argv_server = initial_server_argv,
     .tcp_port = 0,
     .sa_family = AF_UNSPEC,
+    .unix_path = NULL,
+    .keepalive = false,
+    .idle_usec = -1,
+    .rst_close = false,
+    .sessions_cnt = 1,
 };
 
+/*
+ * Use BSS for the responses of the server, to avoid putting pressure on the stack size
+ */
+static uint8_t hfnd_rbuf[1024ULL * 1024ULL * 4ULL];
+
+__attribute__((weak)) void HonggfuzzNetDriverAcceptFd(int fd);
+__attribute__((weak)) bool HonggfuzzNetDriverResponseDone(const uint8_t *buf, size_t len);
+
 extern int HonggfuzzNetDriver_main(int argc, char **argv);
 
 static void *netDriver_mainProgram(void *unused HF_ATTR_UNUSED) {
@@ -74,11 +117,31 @@ static void netDriver_initNsIfNeeded(void) {
     initialized = true;
 
 #if defined(_HF_ARCH_LINUX)
-    if (!nsEnter(CLONE_NEWUSER | CLONE_NEWNET | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWUTS)) {
-        LOG_F("nsEnter(CLONE_NEWUSER|CLONE_NEWNET|CLONE_NEWNS|CLONE_NEWIPC|CLONE_NEWUTS) failed");
-    }
-    if (!nsIfaceUp("lo")) {
-        LOG_F("nsIfaceUp('lo') failed");
+    /*
+     * Namespaces created once by the fuzzing thread (see nsCreate()) are passed at _HF_NS_FD, and
+     * joined instead. The tmpfs dirs are remounted then, to drop what previous processes left there
+     */
+    bool reuse = (getenv(_HF_NS_FD_ENV) != NULL);
+    if (reuse) {
+        unsetenv(_HF_NS_FD_ENV);
+        int fds[NS_CNT];
+        for (int i = 0; i < NS_CNT; i++) {
+            fds[i] = _HF_NS_FD + i;
+        }
+        if (!nsJoin(fds)) {
+            LOG_F("nsJoin(fds=%d-%d) failed", _HF_NS_FD, _HF_NS_FD + NS_CNT - 1);
+        }
+        for (int i = 0; i < NS_CNT; i++) {
+            close(fds[i]);
+        }
+    } else {
+        if (!nsEnter(CLONE_NEWUSER | CLONE_NEWNET | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWUTS)) {
+            LOG_F("nsEnter(CLONE_NEWUSER|CLONE_NEWNET|CLONE_NEWNS|CLONE_NEWIPC|CLONE_NEWUTS) "
+                  "failed");
+        }
+        if (!nsIfaceUp("lo")) {
+            LOG_F("nsIfaceUp('lo') failed");
+        }
     }
     if (mkdir(HFND_TMP_DIR_OLD, 0755) == -1 && errno != EEXIST) {
         PLOG_F("mkdir('%s', 0755)", HFND_TMP_DIR_OLD);
@@ -86,11 +149,11 @@ static void netDriver_initNsIfNeeded(void) {
     if (mkdir(HFND_TMP_DIR, 0755) == -1 && errno != EEXIST) {
         PLOG_F("mkdir('%s', 0755)", HFND_TMP_DIR);
     }
-    if (!nsMountTmpfs(HFND_TMP_DIR_OLD)) {
-        LOG_F("nsMountTmpfs('%s') failed", HFND_TMP_DIR_OLD);
+    if (!(reuse ? nsRemountTmpfs(HFND_TMP_DIR_OLD) : nsMountTmpfs(HFND_TMP_DIR_OLD))) {
+        LOG_F("Couldn't mount tmpfs at '%s'", HFND_TMP_DIR_OLD);
     }
-    if (!nsMountTmpfs(HFND_TMP_DIR)) {
-        LOG_F("nsMountTmpfs('%s') failed", HFND_TMP_DIR);
+    if (!(reuse ? nsRemountTmpfs(HFND_TMP_DIR) : nsMountTmpfs(HFND_TMP_DIR))) {
+        LOG_F("Couldn't mount tmpfs at '%s'", HFND_TMP_DIR);
     }
     return;
 #endif /* defined(_HF_ARCH_LINUX) */
@@ -118,13 +181,7 @@ static void netDriver_bindToRndLoopback(int sock, sa_family_t sa_family) {
     }
 }
 
-static int netDriver_sockConnAddr(const struct sockaddr *addr, socklen_t socklen) {
-    int sock = socket(addr->sa_family, SOCK_STREAM, 0);
-    if (sock == -1) {
-        PLOG_D("socket(type=%d for dst_addr='%s', SOCK_STREAM, 0)", addr->sa_family,
-            files_sockAddrToStr(addr));
-        return -1;
-    }
+static void netDriver_setTcpOpts(int sock) {
     int val = 1;
     if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &val, (socklen_t)sizeof(val)) == -1) {
         PLOG_W("setsockopt(sock=%d, SOL_SOCKET, SO_REUSEADDR, %d)", sock, val);
@@ -141,8 +198,19 @@ static int netDriver_sockConnAddr(const struct sockaddr *addr, socklen_t socklen
         PLOG_D("setsockopt(sock=%d, SOL_TCP, TCP_QUICKACK, %d)", sock, val);
     }
 #endif /* defined(SOL_TCP) && defined(TCP_QUICKACK) */
+}
 
-    netDriver_bindToRndLoopback(sock, addr->sa_family);
+static int netDriver_sockConnAddr(const struct sockaddr *addr, socklen_t socklen) {
+    int sock = socket(addr->sa_family, SOCK_STREAM, 0);
+    if (sock == -1) {
+        PLOG_D("socket(type=%d for dst_addr='%s', SOCK_STREAM, 0)", addr->sa_family,
+            files_sockAddrToStr(addr));
+        return -1;
+    }
+    if (addr->sa_family != AF_UNIX) {
+        netDriver_setTcpOpts(sock);
+        netDriver_bindToRndLoopback(sock, addr->sa_family);
+    }
 
     LOG_D("Connecting to '%s'", files_sockAddrToStr(addr));
     if (TEMP_FAILURE_RETRY(connect(sock, addr, socklen)) == -1) {
@@ -184,6 +252,35 @@ int netDriver_sockConnLoopback(sa_family_t sa_family, uint16_t portno) {
     return -1;
 }
 
+static int netDriver_sockConnUnix(const char *path) {
+    struct sockaddr_un saddr = {
+        .sun_family = AF_UNIX,
+    };
+    if (strlen(path) >= sizeof(saddr.sun_path)) {
+        LOG_F("The unix socket path '%s' is too long (> %zu)", path, sizeof(saddr.sun_path) - 1);
+    }
+    snprintf(saddr.sun_path, sizeof(saddr.sun_path), "%s", path);
+    return netDriver_sockConnAddr((const struct sockaddr *)&saddr, sizeof(saddr));
+}
+
+/* Opens a new connection to the server, using the transport in use */
+static int netDriver_connect(void) {
+    if (HonggfuzzNetDriverAcceptFd) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            PLOG_W("socketpair(AF_UNIX, SOCK_STREAM)");
+            return -1;
+        }
+        /* The server owns its end of the connection from now on */
+        HonggfuzzNetDriverAcceptFd(sv[1]);
+        return sv[0];
+    }
+    if (hfnd_globals.unix_path) {
+        return netDriver_sockConnUnix(hfnd_globals.unix_path);
+    }
+    return netDriver_sockConnLoopback(hfnd_globals.sa_family, hfnd_globals.tcp_port);
+}
+
 /*
  * Decide which TCP port should be used for sending inputs
  */
@@ -193,6 +290,14 @@ __attribute__((weak)) uint16_t HonggfuzzNetDriverPort(
     return 8080;
 }
 
+/*
+ * Decide whether the server accepts connections at a unix socket (path) instead of the TCP port
+ */
+__attribute__((weak)) const char *HonggfuzzNetDriverUnixSocket(
+    int argc HF_ATTR_UNUSED, char **argv HF_ATTR_UNUSED) {
+    return NULL;
+}
+
 /*
  * The return value is a number of arguments passed returned to libfuzzer (if used)
  *
@@ -235,6 +340,22 @@ __attribute__((weak)) int HonggfuzzNetDriverArgsForServer(
 }
 
 static void netDriver_waitForServerReady(uint16_t portno) {
+    /* Connections are handed over to the server directly */
+    if (HonggfuzzNetDriverAcceptFd) {
+        return;
+    }
+    while (hfnd_globals.unix_path) {
+        int fd = netDriver_sockConnUnix(hfnd_globals.unix_path);
+        if (fd >= 0) {
+            close(fd);
+            return;
+        }
+        LOG_I("Honggfuzz Net Driver (pid=%d): Waiting for the server process to start accepting "
+              "connections at '%s'. Sleeping for 0.5 seconds ...",
+            (int)getpid(), hfnd_globals.unix_path);
+
+        util_sleepForMSec(500);
+    }
     for (;;) {
         int fd = -1;
         fd = netDriver_sockConnLoopback(AF_INET, portno);
@@ -281,6 +402,41 @@ uint16_t netDriver_getTCPPort(int argc, char **argv) {
     return HonggfuzzNetDriverPort(argc, argv);
 }
 
+static const char *netDriver_getUnixSocket(int argc, char **argv) {
+    const char *path = getenv(HFND_UNIX_SOCKET_ENV);
+    if (path) {
+        return path;
+    }
+    return HonggfuzzNetDriverUnixSocket(argc, argv);
+}
+
+static size_t netDriver_getSessionsCnt(void) {
+    const char *sessions_str = getenv(HFND_SESSIONS_ENV);
+    if (!sessions_str) {
+        return 1;
+    }
+    unsigned long cnt = strtoul(sessions_str, NULL, 0);
+    if (cnt < 1 || cnt > HFND_SESSIONS_MAX) {
+        LOG_F("Specified number of sessions '%s'='%s' must be between 1 and %d", HFND_SESSIONS_ENV,
+            sessions_str, HFND_SESSIONS_MAX);
+    }
+    return (size_t)cnt;
+}
+
+static int64_t netDriver_getIdleUsec(void) {
+    const char *usec_str = getenv(HFND_IDLE_USEC_ENV);
+    if (!usec_str) {
+        return hfnd_globals.keepalive ? HFND_KEEPALIVE_IDLE_USEC : -1;
+    }
+    errno = 0;
+    long long usec = strtoll(usec_str, NULL, 0);
+    if (errno != 0 || usec < 0) {
+        LOG_F("Specified idle deadline '%s'='%s' must be a number >= 0", HFND_IDLE_USEC_ENV,
+            usec_str);
+    }
+    return (int64_t)usec;
+}
+
 int LLVMFuzzerInitialize(int *argc, char ***argv) {
     if (getenv(HFND_SKIP_FUZZING_ENV)) {
         LOG_I(
@@ -293,6 +449,14 @@ int LLVMFuzzerInitialize(int *argc, char ***argv) {
     LOG_D("Module: %s", LIBHFNETDRIVER_module_netdriver);
 
     hfnd_globals.tcp_port = netDriver_getTCPPort(*argc, *argv);
+    hfnd_globals.unix_path = netDriver_getUnixSocket(*argc, *argv);
+    hfnd_globals.keepalive = (getenv(HFND_KEEPALIVE_ENV) != NULL);
+    hfnd_globals.idle_usec = netDriver_getIdleUsec();
+    hfnd_globals.rst_close = (getenv(HFND_RST_CLOSE_ENV) != NULL);
+    hfnd_globals.sessions_cnt = netDriver_getSessionsCnt();
+    for (size_t i = 0; i < ARRAYSIZE(hfnd_globals.sessions); i++) {
+        hfnd_globals.sessions[i] = -1;
+    }
     *argc = HonggfuzzNetDriverArgsForServer(
         *argc, *argv, &hfnd_globals.argc_server, &hfnd_globals.argv_server);
 
@@ -305,23 +469,117 @@ int LLVMFuzzerInitialize(int *argc, char ***argv) {
     netDriver_startOriginalProgramInThread();
     netDriver_waitForServerReady(hfnd_globals.tcp_port);
 
-    LOG_I("Honggfuzz Net Driver (pid=%d): The TCP server process is ready to accept connections at "
-          "%s:%" PRIu16 ". TCP fuzzing starts now!",
-        (int)getpid(), (hfnd_globals.sa_family == AF_INET ? "TCP4:127.0.0.1" : "TCP6:[::1]"),
-        hfnd_globals.tcp_port);
+    if (HonggfuzzNetDriverAcceptFd) {
+        LOG_I("Honggfuzz Net Driver (pid=%d): Connections will be passed to the server with "
+              "HonggfuzzNetDriverAcceptFd(). Fuzzing starts now!",
+            (int)getpid());
+    } else if (hfnd_globals.unix_path) {
+        LOG_I("Honggfuzz Net Driver (pid=%d): The server process is ready to accept connections at "
+              "'%s'. Fuzzing starts now!",
+            (int)getpid(), hfnd_globals.unix_path);
+    } else {
+        LOG_I("Honggfuzz Net Driver (pid=%d): The TCP server process is ready to accept "
+              "connections at %s:%" PRIu16 ". TCP fuzzing starts now!",
+            (int)getpid(), (hfnd_globals.sa_family == AF_INET ? "TCP4:127.0.0.1" : "TCP6:[::1]"),
+            hfnd_globals.tcp_port);
+    }
+    LOG_I("Honggfuzz Net Driver (pid=%d): Sessions per input: %zu, keep-alive connections: %s, "
+          "idle deadline: %" PRId64 " usecs, RST close: %s",
+        (int)getpid(), hfnd_globals.sessions_cnt, hfnd_globals.keepalive ? "true" : "false",
+        hfnd_globals.idle_usec, hfnd_globals.rst_close ? "true" : "false");
 
     return 0;
 }
 
-int LLVMFuzzerTestOneInput(const uint8_t *buf, size_t len) {
-    int sock = netDriver_sockConnLoopback(hfnd_globals.sa_family, hfnd_globals.tcp_port);
+static void netDriver_sessionClose(size_t idx) {
+    int sock = hfnd_globals.sessions[idx];
     if (sock == -1) {
-        LOG_F("Couldn't connect to the server TCP port");
+        return;
+    }
+    if (hfnd_globals.rst_close) {
+        const struct linger lin = {
+            .l_onoff = 1,
+            .l_linger = 0,
+        };
+        if (setsockopt(sock, SOL_SOCKET, SO_LINGER, &lin, (socklen_t)sizeof(lin)) == -1) {
+            PLOG_D("setsockopt(sock=%d, SOL_SOCKET, SO_LINGER, {1, 0})", sock);
+        }
+    }
+    close(sock);
+    hfnd_globals.sessions[idx] = -1;
+}
+
+/* Waits for data from the server, for up to 'usec' (< 0: indefinitely) */
+static int netDriver_pollIn(int sock, int64_t usec) {
+    struct pollfd pfd = {
+        .fd = sock,
+        .events = POLLIN,
+    };
+#if defined(_HF_ARCH_LINUX)
+    const struct timespec ts = {
+        .tv_sec = usec / 1000000,
+        .tv_nsec = (usec % 1000000) * 1000,
+    };
+    return TEMP_FAILURE_RETRY(ppoll(&pfd, 1, (usec < 0) ? NULL : &ts, NULL));
+#else  /* defined(_HF_ARCH_LINUX) */
+    return TEMP_FAILURE_RETRY(poll(&pfd, 1, (usec < 0) ? -1 : (int)((usec + 999) / 1000)));
+#endif /* defined(_HF_ARCH_LINUX) */
+}
+
+/*
+ * Reads the response of the server, which is complete when HonggfuzzNetDriverResponseDone() says
+ * so, or when the server has been idle for 'idle_usec'. Returns false if the server has closed the
+ * connection instead
+ */
+static bool netDriver_drain(int sock) {
+    size_t len = 0;
+    for (;;) {
+        int ret = netDriver_pollIn(sock, hfnd_globals.idle_usec);
+        if (ret == -1) {
+            PLOG_W("poll(sock=%d)", sock);
+            return false;
+        }
+        if (ret == 0) {
+            return true;
+        }
+        /* Only the tail of responses longer than the buffer is seen by the callback */
+        if (len == sizeof(hfnd_rbuf)) {
+            len = 0;
+        }
+        ssize_t sz = TEMP_FAILURE_RETRY(recv(sock, &hfnd_rbuf[len], sizeof(hfnd_rbuf) - len, 0));
+        if (sz <= 0) {
+            return false;
+        }
+        len += (size_t)sz;
+        if (HonggfuzzNetDriverResponseDone && HonggfuzzNetDriverResponseDone(hfnd_rbuf, len)) {
+            return true;
+        }
     }
+}
+
+/* Sends a chunk of the input over the session no. 'idx', (re-)connecting first if needed */
+static void netDriver_sendChunk(size_t idx, const uint8_t *buf, size_t len) {
+    if (hfnd_globals.sessions[idx] == -1 &&
+        (hfnd_globals.sessions[idx] = netDriver_connect()) == -1) {
+        LOG_F("Couldn't connect to the server");
+    }
+    int sock = hfnd_globals.sessions[idx];
     if (!files_sendToSocket(sock, buf, len)) {
         PLOG_W("files_sendToSocket(sock=%d, len=%zu) failed", sock, len);
-        close(sock);
-        return 0;
+        netDriver_sessionClose(idx);
+        return;
+    }
+    if (hfnd_globals.keepalive && !netDriver_drain(sock)) {
+        LOG_D("The server has closed the kept-alive connection (sock=%d)", sock);
+        netDriver_sessionClose(idx);
+    }
+}
+
+/* Ends the session no. 'idx', unless it's kept alive for the next input */
+static void netDriver_sessionEnd(size_t idx) {
+    int sock = hfnd_globals.sessions[idx];
+    if (sock == -1 || hfnd_globals.keepalive) {
+        return;
     }
     /*
      * Indicate EOF (via the FIN flag) to the TCP server
@@ -331,22 +589,42 @@ int LLVMFuzzerTestOneInput(const uint8_t *buf, size_t len) {
      */
     if (TEMP_FAILURE_RETRY(shutdown(sock, SHUT_WR)) == -1) {
         if (errno == ENOTCONN) {
-            close(sock);
-            return 0;
+            netDriver_sessionClose(idx);
+            return;
         }
         PLOG_F("shutdown(sock=%d, SHUT_WR)", sock);
     }
 
     /*
      * Try to read data from the server, assuming that an early TCP close would sometimes cause the
-     * TCP server to drop the input data, instead of processing it. Use BSS to avoid putting
-     * pressure on the stack size
+     * TCP server to drop the input data, instead of processing it. The process is done with the
+     * input once the server goes idle (if there's a deadline), it doesn't need to close the
+     * connection
      */
-    static char b[1024ULL * 1024ULL * 4ULL];
-    while (TEMP_FAILURE_RETRY(recv(sock, b, sizeof(b), MSG_WAITALL)) > 0)
-        ;
+    netDriver_drain(sock);
 
-    close(sock);
+    netDriver_sessionClose(idx);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *buf, size_t len) {
+    if (hfnd_globals.sessions_cnt == 1) {
+        netDriver_sendChunk(0, buf, len);
+    } else {
+        /*
+         * The input drives several sessions (connections): it's a sequence of chunks, each one
+         * being the session number (1 byte), the data length (2 bytes, big-endian), and the data
+         */
+        while (len >= 3) {
+            size_t idx = buf[0] % hfnd_globals.sessions_cnt;
+            size_t sz = MIN(((size_t)buf[1] << 8) | (size_t)buf[2], len - 3);
+            netDriver_sendChunk(idx, &buf[3], sz);
+            buf += 3 + sz;
+            len -= 3 + sz;
+        }
+    }
+    for (size_t i = 0; i < hfnd_globals.sessions_cnt; i++) {
+        netDriver_sessionEnd(i);
+    }
 
     return 0;
 }
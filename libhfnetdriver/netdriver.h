@@ -2,6 +2,8 @@
 #define _HF_NETDRIVER_NETDRIVER_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -20,6 +22,22 @@ int HonggfuzzNetDriverArgsForServer(int argc, char** argv, int* server_argc, cha
  * TCP port that the fuzzed data inputs will be sent to
  */
 uint16_t HonggfuzzNetDriverPort(int argc, char** argv);
+/*
+ * Path of the unix socket that the fuzzed data inputs will be sent to, or NULL for the TCP port
+ * (the HFND_UNIX_SOCKET envvar overrides it)
+ */
+const char* HonggfuzzNetDriverUnixSocket(int argc, char** argv);
+/*
+ * Optional: connections become socketpair()s, and the server's end of every new connection is
+ * passed to this function, which should hand it over to the server (e.g. to its event loop)
+ */
+void HonggfuzzNetDriverAcceptFd(int fd);
+/*
+ * Optional: called with the response received so far, returns true if it's complete. Otherwise,
+ * the response is complete once the server closes the connection, or has been idle for
+ * HFND_IDLE_USEC (20ms by default, with HFND_KEEPALIVE where the connections are reused)
+ */
+bool HonggfuzzNetDriverResponseDone(const uint8_t* buf, size_t len);
 
 #ifdef __cplusplus
 }
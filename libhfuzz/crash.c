@@ -0,0 +1,228 @@
+/*
+ *
+ * honggfuzz - in-process crash capture
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "libhfuzz/crash.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(_HF_ARCH_LINUX)
+#include <execinfo.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#endif /* defined(_HF_ARCH_LINUX) */
+
+#include "honggfuzz.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+#include "libhfuzz/instrument.h"
+
+#if defined(_HF_ARCH_LINUX)
+
+static crashRec_t* crashRec = NULL;
+/* Only the first crash of the process is described, e.g. not SIGABRT after the sanitizer's report */
+static uint32_t crashRecorded = 0;
+
+static const int crashSigs[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGSYS, SIGTRAP};
+/* Stack overflows are described too */
+static uint8_t crashAltStack[1024 * 64];
+
+extern void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+/*
+ * Executable mappings of the process, read from /proc/self/maps by crashInit(), so the handlers
+ * don't need dladdr() (which is not async-signal-safe), and the offsets of the frames are file
+ * offsets, as computed by the unwinder of the fuzzer. Modules dlopen()'d later are not described
+ */
+#define _HF_CRASH_MAPS_MAX 512U
+static struct {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t offset;
+    char name[_HF_CRASHREC_MODULE_SZ];
+} crashMaps[_HF_CRASH_MAPS_MAX];
+static size_t crashMapsCnt = 0;
+
+static void crashReadMaps(void) {
+    FILE* f = fopen("/proc/self/maps", "re");
+    if (f == NULL) {
+        PLOG_W("Couldn't open '/proc/self/maps'");
+        return;
+    }
+    char* line = NULL;
+    size_t lineSz = 0;
+    while (crashMapsCnt < _HF_CRASH_MAPS_MAX && getline(&line, &lineSz, f) > 0) {
+        unsigned long start, end, offset;
+        char perms[5];
+        int nameOff = 0;
+        /* start-end perms offset dev inode [name] */
+        int cnt =
+            sscanf(line, "%lx-%lx %4s %lx %*s %*u %n", &start, &end, perms, &offset, &nameOff);
+        if (cnt < 4 || nameOff == 0 || perms[2] != 'x') {
+            continue;
+        }
+        crashMaps[crashMapsCnt].start = start;
+        crashMaps[crashMapsCnt].end = end;
+        crashMaps[crashMapsCnt].offset = offset;
+        snprintf(crashMaps[crashMapsCnt].name, sizeof(crashMaps[crashMapsCnt].name), "%.*s",
+            (int)strcspn(&line[nameOff], "\n"), &line[nameOff]);
+        crashMapsCnt++;
+    }
+    free(line);
+    fclose(f);
+}
+
+static uintptr_t crashGetPc(const void* ctx) {
+    const ucontext_t* uc = (const ucontext_t*)ctx;
+#if defined(__x86_64__)
+    return (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+    return (uintptr_t)uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+    return (uintptr_t)uc->uc_mcontext.pc;
+#elif defined(__arm__)
+    return (uintptr_t)uc->uc_mcontext.arm_pc;
+#else
+    return 0;
+#endif
+}
+
+static void crashAddFrame(uintptr_t pc) {
+    crashFrame_t* f = &crashRec->frames[crashRec->frameCnt++];
+    f->pc = pc;
+    f->modOff = 0;
+    f->module[0] = '\0';
+
+    for (size_t i = 0; i < crashMapsCnt; i++) {
+        if (pc >= crashMaps[i].start && pc < crashMaps[i].end) {
+            f->modOff = pc - crashMaps[i].start + crashMaps[i].offset;
+            memcpy(f->module, crashMaps[i].name, sizeof(f->module));
+            return;
+        }
+    }
+}
+
+/*
+ * Frames before 'skip' (or before 'pc', if it's found among the return addresses) belong to the
+ * handler itself
+ */
+static void crashRecord(int signo, int code, uintptr_t addr, uintptr_t pc, size_t skip) {
+    if (crashRec == NULL || ATOMIC_XCHG(crashRecorded, 1)) {
+        return;
+    }
+
+    void* bt[_HF_CRASHREC_FRAMES_MAX + 8];
+    size_t btCnt = (size_t)backtrace(bt, ARRAYSIZE(bt));
+    size_t first = skip;
+    bool pcFound = false;
+    for (size_t i = 0; pc && i < btCnt; i++) {
+        if ((uintptr_t)bt[i] == pc) {
+            first = i;
+            pcFound = true;
+            break;
+        }
+    }
+
+    crashRec->pid = getpid();
+    crashRec->signo = signo;
+    crashRec->code = code;
+    crashRec->addr = addr;
+    crashRec->pc = pc;
+    /* It doesn't fault if 'pc' is not mapped, it's what caused the crash sometimes */
+    struct iovec local = {.iov_base = crashRec->instr, .iov_len = sizeof(crashRec->instr)};
+    struct iovec remote = {.iov_base = (void*)pc, .iov_len = sizeof(crashRec->instr)};
+    ssize_t instrSz = pc ? process_vm_readv(crashRec->pid, &local, 1, &remote, 1, 0) : -1;
+    crashRec->instrSz = (instrSz > 0) ? (uint32_t)instrSz : 0U;
+    crashRec->frameCnt = 0;
+    if (pc && !pcFound) {
+        crashAddFrame(pc);
+    }
+    for (size_t i = first; i < btCnt && crashRec->frameCnt < _HF_CRASHREC_FRAMES_MAX; i++) {
+        crashAddFrame((uintptr_t)bt[i]);
+    }
+    ATOMIC_SET_RELEASE(crashRec->valid, 1U);
+}
+
+static void crashSigHandler(int signo, siginfo_t* si, void* ctx) {
+    crashRecord(signo, si->si_code, (uintptr_t)si->si_addr, crashGetPc(ctx), /* skip= */ 1);
+    /*
+     * The default action is back (SA_RESETHAND), so faults kill the process once the instruction
+     * is restarted, and signals sent by the process itself (e.g. abort()) need to be raised again
+     */
+    if (si->si_code <= 0) {
+        raise(signo);
+    }
+}
+
+static void crashSanDeathCallback(void) {
+    /* This function, and the sanitizer's Die() */
+    crashRecord(0, 0, 0, 0, /* skip= */ 2);
+}
+
+void crashInit(void) {
+    if (!getenv(_HF_INPROC_CRASH_ENV)) {
+        return;
+    }
+    hfuzzInstrumentInit();
+    if ((crashRec = instrumentCrashRec()) == NULL) {
+        return;
+    }
+
+    /* backtrace() loads libgcc_s on the first use, it shouldn't happen in a signal handler */
+    void* bt[1];
+    backtrace(bt, ARRAYSIZE(bt));
+    crashReadMaps();
+
+    stack_t ss = {
+        .ss_sp = crashAltStack,
+        .ss_size = sizeof(crashAltStack),
+        .ss_flags = 0,
+    };
+    if (sigaltstack(&ss, NULL) == -1) {
+        PLOG_W("sigaltstack(size=%zu)", sizeof(crashAltStack));
+    }
+    for (size_t i = 0; i < ARRAYSIZE(crashSigs); i++) {
+        struct sigaction sa = {
+            .sa_sigaction = crashSigHandler,
+            .sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESETHAND,
+        };
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(crashSigs[i], &sa, NULL) == -1) {
+            PLOG_F("sigaction(%d)", crashSigs[i]);
+        }
+    }
+    if (__sanitizer_set_death_callback) {
+        __sanitizer_set_death_callback(crashSanDeathCallback);
+    }
+    LOG_D("Crashes will be described in the shared crash record");
+}
+
+#else  /* defined(_HF_ARCH_LINUX) */
+
+void crashInit(void) {
+}
+
+#endif /* defined(_HF_ARCH_LINUX) */
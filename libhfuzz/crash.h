@@ -0,0 +1,31 @@
+/*
+ *
+ * honggfuzz - in-process crash capture
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_LIBHFUZZ_CRASH_H_
+#define _HF_LIBHFUZZ_CRASH_H_
+
+/*
+ * With _HF_INPROC_CRASH_ENV, installs the handlers of the crash signals (and the sanitizers' death
+ * callback), which describe the crash in the process' crashRec_t
+ */
+extern void crashInit(void);
+
+#endif /* ifdef _HF_LIBHFUZZ_CRASH_H_ */
@@ -6,14 +6,26 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#if defined(_HF_ARCH_LINUX)
+#include <sys/prctl.h>
+#endif /* defined(_HF_ARCH_LINUX) */
 
 #include "honggfuzz.h"
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+#include "libhfuzz/crash.h"
+#include "libhfuzz/instrument.h"
+#include "libhfuzz/kcov.h"
 
 /*
  * If this signature is visible inside a binary, it's probably a persistent-style fuzzing program.
@@ -23,18 +35,131 @@ __attribute__((visibility("default"))) __attribute__((used)) const char* LIBHFUZ
     _HF_PERSISTENT_SIG;
 
 static const uint8_t* inputFile = NULL;
+static batchHdr_t* batchHdr = NULL;
+
+static void initBatch(void) {
+    struct stat st;
+    if (fstat(_HF_BATCH_FD, &st) == -1) {
+        return;
+    }
+    if ((size_t)st.st_size < sizeof(batchHdr_t)) {
+        LOG_F("Size of the batch input file is too small: %zu < %zu", (size_t)st.st_size,
+            sizeof(batchHdr_t));
+    }
+    if ((batchHdr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+             _HF_BATCH_FD, 0)) == MAP_FAILED) {
+        PLOG_F("mmap(fd=%d, size=%zu) of the batch input file failed", _HF_BATCH_FD,
+            (size_t)st.st_size);
+    }
+}
+
 __attribute__((constructor)) static void init(void) {
     if (fcntl(_HF_INPUT_FD, F_GETFD) == -1 && errno == EBADF) {
         return;
     }
+    initBatch();
     if ((inputFile = mmap(NULL, _HF_INPUT_MAX_SIZE, PROT_READ, MAP_SHARED, _HF_INPUT_FD, 0)) ==
         MAP_FAILED) {
         PLOG_F("mmap(fd=%d, size=%zu) of the input file failed", _HF_INPUT_FD,
             (size_t)_HF_INPUT_MAX_SIZE);
     }
+    crashInit();
 }
 
-void HonggfuzzFetchData(const uint8_t** buf_ptr, size_t* len_ptr) {
+/* For how many iterations to poll for new data before going to sleep on the futex */
+#define _HF_PERSISTENT_SPIN_CNT (1024U * 16U)
+
+/*
+ * Shared memory handshake with the fuzzer (see persistentCtl_t). The ready tag is written to the
+ * socket (to wake up the fuzzer) only if the fuzzer is sleeping. The wakeup is claimed by clearing
+ * 'parentWaiting', so the fuzzer knows whether a tag is on its way
+ */
+static void fetchDataShm(persistentCtl_t* ctl, const uint8_t** buf_ptr, size_t* len_ptr) {
+    ATOMIC_SET_SEQCST(ctl->state, _HF_PERSISTENT_READY);
+    if (ATOMIC_XCHG(ctl->parentWaiting, 0U)) {
+        if (!files_writeToFd(_HF_PERSISTENT_FD, &HFReadyTag, sizeof(HFReadyTag))) {
+            LOG_F("writeToFd(size=%zu, readyTag) failed", sizeof(HFReadyTag));
+        }
+    }
+
+    for (unsigned i = 0; i < _HF_PERSISTENT_SPIN_CNT; i++) {
+        if (ATOMIC_GET_ACQUIRE(ctl->state) == _HF_PERSISTENT_DATA) {
+            break;
+        }
+        util_cpuRelax();
+    }
+    if (ATOMIC_GET_ACQUIRE(ctl->state) != _HF_PERSISTENT_DATA) {
+        ATOMIC_SET_SEQCST(ctl->childWaiting, 1U);
+        while (ATOMIC_GET_SEQCST(ctl->state) != _HF_PERSISTENT_DATA) {
+            if (util_futexWait(&ctl->state, _HF_PERSISTENT_READY, /* msec= */ 1000U)) {
+                continue;
+            }
+            /* No new data for a while, check whether the fuzzer is still there */
+            uint8_t b;
+            if (recv(_HF_PERSISTENT_FD, &b, sizeof(b), MSG_PEEK | MSG_DONTWAIT) == 0) {
+                LOG_I("The fuzzer has closed the persistent socket, exiting");
+                _exit(0);
+            }
+        }
+        ATOMIC_CLEAR(ctl->childWaiting);
+    }
+
+    *buf_ptr = inputFile;
+    *len_ptr = (size_t)ctl->len;
+}
+
+/*
+ * Snapshot mode (_HF_SNAPSHOT_ENV): the initialized process becomes a template, which doesn't
+ * process inputs itself, but forks workers which do. A new worker is forked whenever the previous
+ * one exits (crashes, is killed due to a timeout), so the initialization is not repeated
+ */
+static void fetchSnapshotTemplate(persistentCtl_t* ctl) {
+    for (;;) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            PLOG_F("fork()");
+        }
+        if (pid == 0) {
+#if defined(_HF_ARCH_LINUX)
+            if (prctl(PR_SET_PDEATHSIG, (unsigned long)SIGKILL, 0UL, 0UL, 0UL) == -1) {
+                PLOG_W("prctl(PR_SET_PDEATHSIG, SIGKILL)");
+            }
+#endif /* defined(_HF_ARCH_LINUX) */
+            ATOMIC_SET(ctl->workerPid, getpid());
+            return;
+        }
+
+        int status;
+        if (TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)) == -1) {
+            PLOG_F("waitpid(pid=%d)", (int)pid);
+        }
+        LOG_D("Snapshot worker pid=%d finished with status: %d", (int)pid, status);
+
+        /* The new worker starts with the initial (socket-based) ready message */
+        ATOMIC_SET_SEQCST(ctl->state, _HF_PERSISTENT_NONE);
+        ATOMIC_SET_SEQCST(ctl->parentWaiting, 1U);
+        ATOMIC_CLEAR(ctl->childWaiting);
+    }
+}
+
+static void fetchData(const uint8_t** buf_ptr, size_t* len_ptr) {
+    /*
+     * The fuzzer starts with ctl->parentWaiting set, so the first ready message always goes over
+     * the socket too, and the fuzzer learns from it that this process uses the shared handshake
+     */
+    persistentCtl_t* ctl = instrumentPersistentCtl();
+    static bool snapshotChecked = false;
+    if (ctl && !snapshotChecked) {
+        snapshotChecked = true;
+        if (getenv(_HF_SNAPSHOT_ENV)) {
+            fetchSnapshotTemplate(ctl);
+        }
+    }
+    if (ctl) {
+        fetchDataShm(ctl, buf_ptr, len_ptr);
+        return;
+    }
+
     if (!files_writeToFd(_HF_PERSISTENT_FD, &HFReadyTag, sizeof(HFReadyTag))) {
         LOG_F("writeToFd(size=%zu, readyTag) failed", sizeof(HFReadyTag));
     }
@@ -57,6 +182,20 @@ void HonggfuzzFetchData(const uint8_t** buf_ptr, size_t* len_ptr) {
     }
 }
 
+void HonggfuzzFetchData(const uint8_t** buf_ptr, size_t* len_ptr) {
+    /* The kernel coverage is collected only while the input is processed */
+    kcovDisable();
+    /* The new coverage must be visible to the fuzzer before the process reports readiness */
+    instrumentMergeLocalCov();
+
+    fetchData(buf_ptr, len_ptr);
+    kcovEnable();
+}
+
+batchHdr_t* fetchGetBatch(void) {
+    return batchHdr;
+}
+
 bool fetchIsInputAvailable(void) {
     LOG_D("Current module: %s", LIBHFUZZ_module_fetch);
     return (inputFile != NULL);
@@ -29,7 +29,11 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "honggfuzz.h"
+
 extern void HonggfuzzFetchData(const uint8_t** buf_ptr, size_t* len_ptr);
 extern bool fetchIsInputAvailable(void);
+/* Returns NULL if the fuzzer doesn't send batches of inputs (--persistent_batch) */
+extern batchHdr_t* fetchGetBatch(void);
 
 #endif /* ifdef _HF_LIBHFUZZ_FETCH_H_ */
@@ -0,0 +1,161 @@
+/*
+ *
+ * honggfuzz - fork-server mode of fuzzing
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(_HF_ARCH_LINUX)
+#include <sys/prctl.h>
+#endif /* defined(_HF_ARCH_LINUX) */
+
+#include "honggfuzz.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfuzz/kcov.h"
+#include "libhfuzz/libhfuzz.h"
+
+const char* const LIBHFUZZ_module_forkserver = "LIBHFUZZ_module_forkserver";
+
+/* The input file (--stdin_pipe), which the forked processes get on stdin through a pipe */
+static const uint8_t* stdinPipeInput = NULL;
+
+/*
+ * The fork-server speaks the (socket-based) persistent mode protocol with the fuzzer, with every
+ * round being one forked process processing the input. It doesn't use HonggfuzzFetchData(), as
+ * linking it in would make the binary look like a persistent one (_HF_PERSISTENT_SIG)
+ */
+static void forkServerLoop(void) {
+    for (;;) {
+        if (!files_writeToFd(_HF_PERSISTENT_FD, &HFReadyTag, sizeof(HFReadyTag))) {
+            LOG_F("writeToFd(size=%zu, readyTag) failed", sizeof(HFReadyTag));
+        }
+
+        uint64_t rcvLen;
+        ssize_t sz = files_readFromFd(_HF_PERSISTENT_FD, (uint8_t*)&rcvLen, sizeof(rcvLen));
+        if (sz == 0) {
+            LOG_D("The fuzzer has closed the fork-server socket, exiting");
+            _exit(0);
+        }
+        if (sz != sizeof(rcvLen)) {
+            LOG_F("readFromFd(fd=%d, size=%zu) failed, received=%zd bytes", _HF_PERSISTENT_FD,
+                sizeof(rcvLen), sz);
+        }
+
+        /* The input file (and stdin, with -s) offset is shared with all forked processes */
+        if (lseek(_HF_INPUT_FD, (off_t)0, SEEK_SET) == -1) {
+            PLOG_W("lseek(_HF_INPUT_FD=%d, 0)", _HF_INPUT_FD);
+        }
+
+        pid_t pid = fork();
+        if (pid == -1) {
+            PLOG_F("fork()");
+        }
+        if (pid == 0) {
+#if defined(_HF_ARCH_LINUX)
+            /* The fuzzer kills the fork-server on timeouts */
+            if (prctl(PR_SET_PDEATHSIG, (unsigned long)SIGKILL, 0UL, 0UL, 0UL) == -1) {
+                PLOG_W("prctl(PR_SET_PDEATHSIG, SIGKILL)");
+            }
+#endif /* defined(_HF_ARCH_LINUX) */
+            close(_HF_PERSISTENT_FD);
+            if (stdinPipeInput) {
+                int pipeFd = files_pipeFromBuf(
+                    stdinPipeInput, MIN((size_t)rcvLen, (size_t)_HF_INPUT_MAX_SIZE));
+                if (pipeFd == -1 || TEMP_FAILURE_RETRY(dup2(pipeFd, STDIN_FILENO)) == -1) {
+                    LOG_F("Couldn't provide the input (size=%" PRIu64 ") on stdin", rcvLen);
+                }
+                close(pipeFd);
+            }
+            /* KCOV isn't inherited, the fork-server itself never enables it */
+            kcovEnable();
+            return;
+        }
+
+        int status;
+        if (TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)) == -1) {
+            PLOG_F("waitpid(pid=%d)", (int)pid);
+        }
+        LOG_D("Fork-server child pid=%d finished with status: %d", (int)pid, status);
+    }
+}
+
+void HonggfuzzForkServer(void) {
+    static bool started = false;
+    if (started) {
+        return;
+    }
+    started = true;
+
+    if (!getenv(_HF_FORKSERVER_ENV)) {
+        return;
+    }
+    if (fcntl(_HF_PERSISTENT_FD, F_GETFD) == -1 && errno == EBADF) {
+        return;
+    }
+    /* Processes spawned by the forked ones must not try to become fork-servers too */
+    unsetenv(_HF_FORKSERVER_ENV);
+
+    if (getenv(_HF_STDIN_PIPE_ENV)) {
+        void* ret = mmap(NULL, _HF_INPUT_MAX_SIZE, PROT_READ, MAP_SHARED, _HF_INPUT_FD, 0);
+        if (ret == MAP_FAILED) {
+            PLOG_F("mmap(fd=%d, size=%zu) of the input file failed", _HF_INPUT_FD,
+                (size_t)_HF_INPUT_MAX_SIZE);
+        }
+        stdinPipeInput = ret;
+    }
+
+    LOG_D("Starting the fork-server, pid=%d", (int)getpid());
+    forkServerLoop();
+}
+
+/* Defined with HF_FORKSERVER_DEFERRED by programs which call HonggfuzzForkServer() themselves */
+__attribute__((weak)) extern const int LIBHFUZZ_forkserver_deferred;
+
+/*
+ * hfuzz-cc links binaries with -Wl,--wrap=main, so the fork-server is started right before main(),
+ * i.e. after all constructors (also the ones of the program) have run. This reference resolves to
+ * main() then, and it's NULL otherwise
+ */
+__attribute__((weak)) extern int __real_main(int argc, char** argv, char** envp);
+
+int __wrap_main(int argc, char** argv, char** envp) {
+    if (&LIBHFUZZ_forkserver_deferred == NULL) {
+        HonggfuzzForkServer();
+    }
+    return __real_main(argc, argv, envp);
+}
+
+/* Binaries linked without hfuzz-cc (or on MacOS X, without --wrap) start it from a constructor */
+__attribute__((constructor)) static void initializeForkServer(void) {
+    if (&LIBHFUZZ_forkserver_deferred != NULL || __real_main != NULL) {
+        return;
+    }
+    HonggfuzzForkServer();
+}
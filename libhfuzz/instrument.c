@@ -1,20 +1,24 @@
 #include "instrument.h"
 
 #include <ctype.h>
+#include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "honggfuzz.h"
+#include "libhfcommon/bitmap.h"
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
@@ -40,6 +44,65 @@ const char* const LIBHFUZZ_module_instrument = "LIBHFUZZ_module_instrument";
 static feedback_t bbMapFb;
 feedback_t* feedback = &bbMapFb;
 uint32_t my_thread_no = 0;
+static bool feedbackShared = false;
+
+/*
+ * Local coverage mode (_HF_LOCAL_COV_ENV): new PCs are recorded in a private bitmap first, so the
+ * hot path doesn't do locked RMW operations on cache lines shared with other fuzzed processes. The
+ * recorded positions are merged into feedback->bbMapPc by instrumentMergeLocalCov()
+ */
+#define _HF_LOCAL_COV_PENDING_MAX (1024U * 64U)
+static bool localCovEnabled = false;
+static uint8_t* localBbMapPc = NULL;
+static uint32_t localCovPending[_HF_LOCAL_COV_PENDING_MAX];
+static size_t localCovPendingCnt = 0;
+
+/*
+ * -fsanitize-coverage=inline-8bit-counters: the compiler increments the counters (non-atomically),
+ * and they're classified into hit-count buckets, and reset, once per iteration
+ */
+#define _HF_CNT_MODULES_MAX 256U
+static struct {
+    uint8_t* start;
+    uint8_t* stop;
+    size_t base;
+} cntModules[_HF_CNT_MODULES_MAX];
+static size_t cntModulesCnt = 0;
+static size_t cntTotal = 0;
+
+/*
+ * -fsanitize-coverage=trace-pc-guard: a guard is zeroed once it's hit. With a private feedback map
+ * (feedback_t.guardsRearm) they're all re-armed before every input, see instrumentRearmGuards()
+ */
+static struct {
+    uint32_t* start;
+    uint32_t* stop;
+    uint32_t first;
+} guardModules[_HF_CNT_MODULES_MAX];
+static size_t guardModulesCnt = 0;
+
+/*
+ * --export_cov (_HF_COV_PCS_FD): the PCs of the guards and counters are registered in covPcs. The
+ * module constructors (-fsanitize-coverage=pc-table) call __sanitizer_cov_pcs_init() right after
+ * registering their guards or counters, so these are remembered until then
+ */
+static covPcs_t* covPcs = NULL;
+static struct {
+    uint64_t* pcs;
+    size_t cnt;
+} covPcsGuards, covPcsCnts;
+
+static const uint8_t cntBuckets[256] = {
+    [0] = 0,
+    [1] = 1,
+    [2] = 2,
+    [3] = 4,
+    [4 ... 7] = 8,
+    [8 ... 15] = 16,
+    [16 ... 31] = 32,
+    [32 ... 127] = 64,
+    [128 ... 255] = 128,
+};
 
 static void initializeInstrument(void) {
     if (fcntl(_HF_LOG_FD, F_GETFD) != -1) {
@@ -67,18 +130,77 @@ static void initializeInstrument(void) {
     if (fstat(_HF_BITMAP_FD, &st) == -1) {
         return;
     }
-    if (st.st_size != sizeof(feedback_t)) {
-        LOG_F(
-            "size of the feedback structure mismatch: st.size != sizeof(feedback_t) (%zu != %zu). "
-            "Link your fuzzed binaries with the newest honggfuzz sources via hfuzz-clang(++)",
-            (size_t)st.st_size, sizeof(feedback_t));
+    /*
+     * With hugetlbfs, the file is rounded up to the huge page size. pcGuardMap is mostly beyond its
+     * end, and it's grown with instrumentGrowGuardMap()
+     */
+    if ((size_t)st.st_size < offsetof(feedback_t, pcGuardMap)) {
+        LOG_F("size of the feedback structure mismatch: st.size < offsetof(feedback_t, pcGuardMap) "
+              "(%zu < %zu). Link your fuzzed binaries with the newest honggfuzz sources via "
+              "hfuzz-clang(++)",
+            (size_t)st.st_size, offsetof(feedback_t, pcGuardMap));
     }
     int mflags = files_getTmpMapFlags(MAP_SHARED, /* nocore= */ true);
+#if defined(MADV_HUGEPAGE)
+    /* Same as in files_mapSharedMem(): the mapping is advised before it's faulted in */
+    bool hugePages = (getenv(_HF_HUGE_PAGES_ENV) != NULL);
+    if (hugePages) {
+        mflags &= ~MAP_POPULATE;
+    }
+#endif /* defined(MADV_HUGEPAGE) */
     if ((feedback = mmap(NULL, sizeof(feedback_t), PROT_READ | PROT_WRITE, mflags, _HF_BITMAP_FD,
              0)) == MAP_FAILED) {
         PLOG_F("mmap(fd=%d, size=%zu) of the feedback structure failed", _HF_BITMAP_FD,
             sizeof(feedback_t));
     }
+#if defined(MADV_HUGEPAGE)
+    /* Fails (EINVAL) for hugetlbfs mappings, which use huge pages anyway */
+    if (hugePages && madvise(feedback, sizeof(feedback_t), MADV_HUGEPAGE) == -1) {
+        PLOG_D("madvise(size=%zu, MADV_HUGEPAGE)", sizeof(feedback_t));
+    }
+#endif /* defined(MADV_HUGEPAGE) */
+    if (feedback->hdr.magic != _HF_FEEDBACK_MAGIC ||
+        feedback->hdr.hdrSz != sizeof(feedback_hdr_t) ||
+        feedback->hdr.pcGuardMapSz != sizeof(feedback->pcGuardMap) ||
+        feedback->hdr.pcCntMapSz != sizeof(feedback->pcCntMap) ||
+        feedback->hdr.bbMapPcSz != sizeof(feedback->bbMapPc) ||
+        feedback->hdr.cmpMapSz != sizeof(feedback->cmpMap) ||
+        feedback->hdr.cmpSitesSz != sizeof(feedback->cmpSites) ||
+        feedback->hdr.pidFeedbackSz != sizeof(feedback->pidFeedback) ||
+        feedback->hdr.persistentCtlSz != sizeof(feedback->persistentCtl) ||
+        feedback->hdr.cmpLogSz != sizeof(feedback->cmpLog) ||
+        feedback->hdr.crashRecSz != sizeof(feedback->crashRec)) {
+        LOG_F("Layout of the feedback structure mismatch (magic:%" PRIx32 ", guards:%" PRIu64
+              "/%zu, pc:%" PRIu64 "/%zu, cmp:%" PRIu64 "/%zu). Link your fuzzed binaries with the "
+              "newest honggfuzz sources via hfuzz-clang(++)",
+            feedback->hdr.magic, feedback->hdr.pcGuardMapSz, sizeof(feedback->pcGuardMap),
+            feedback->hdr.bbMapPcSz, sizeof(feedback->bbMapPc), feedback->hdr.cmpMapSz,
+            sizeof(feedback->cmpMap));
+    }
+    feedbackShared = true;
+
+    if (fstat(_HF_COV_PCS_FD, &st) != -1 && (size_t)st.st_size >= sizeof(covPcs_t)) {
+        /* It's mostly empty, so not with the MAP_POPULATE of files_getTmpMapFlags() */
+        covPcs_t* m = mmap(
+            NULL, sizeof(covPcs_t), PROT_READ | PROT_WRITE, MAP_SHARED, _HF_COV_PCS_FD, 0);
+        if (m == MAP_FAILED) {
+            PLOG_W("mmap(fd=%d, size=%zu) of the PC tables failed", _HF_COV_PCS_FD,
+                sizeof(covPcs_t));
+        } else if (m->magic != _HF_COV_PCS_MAGIC) {
+            LOG_W("Unexpected magic of the PC tables: %" PRIx32, m->magic);
+            munmap(m, sizeof(covPcs_t));
+        } else {
+            covPcs = m;
+        }
+    }
+
+    if (getenv(_HF_LOCAL_COV_ENV)) {
+        if ((localBbMapPc = mmap(NULL, sizeof(feedback->bbMapPc), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED) {
+            PLOG_F("mmap(size=%zu) of the local coverage map failed", sizeof(feedback->bbMapPc));
+        }
+        localCovEnabled = true;
+    }
 
     /* Reset coverage counters to their initial state */
     instrumentClearNewCov();
@@ -86,16 +208,130 @@ static void initializeInstrument(void) {
 
 static __thread pthread_once_t localInitOnce = PTHREAD_ONCE_INIT;
 
-extern void hfuzzInstrumentInit(void);
 __attribute__((constructor)) void hfuzzInstrumentInit(void) {
     pthread_once(&localInitOnce, initializeInstrument);
 }
 
+persistentCtl_t* instrumentPersistentCtl(void) {
+    if (!feedbackShared) {
+        return NULL;
+    }
+    return &feedback->persistentCtl[my_thread_no];
+}
+
+crashRec_t* instrumentCrashRec(void) {
+    if (!feedbackShared) {
+        return NULL;
+    }
+    return &feedback->crashRec[my_thread_no];
+}
+
+const pidFeedback_t* instrumentNewCov(void) {
+    return &feedback->pidFeedback[my_thread_no];
+}
+
+/* Flush the remaining local coverage for processes which are not running in the persistent mode */
+__attribute__((destructor)) static void instrumentFini(void) {
+    instrumentMergeLocalCov();
+}
+
+ATTRIBUTE_X86_REQUIRE_SSE42 static inline void instrumentAddPc(size_t pos) {
+    if (localCovEnabled) {
+        uint8_t mask = (uint8_t)1U << (pos % 8);
+        if (ATOMIC_GET(localBbMapPc[pos / 8]) & mask) {
+            return;
+        }
+        if (ATOMIC_POST_OR(localBbMapPc[pos / 8], mask) & mask) {
+            return;
+        }
+        size_t idx = ATOMIC_POST_INC(localCovPendingCnt);
+        if (idx < _HF_LOCAL_COV_PENDING_MAX) {
+            localCovPending[idx] = (uint32_t)pos;
+            return;
+        }
+        /* The pending buffer is full, update the shared map directly */
+    }
+
+    register uint8_t prev = ATOMIC_BTS(feedback->bbMapPc, pos);
+    if (!prev) {
+        ATOMIC_PRE_INC_RELAXED(feedback->pidFeedback[my_thread_no].pc);
+    }
+}
+
+static void instrumentClassifyCounters(uint8_t* cnts, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        cnts[i] = cntBuckets[cnts[i]];
+    }
+}
+
+/*
+ * Classify the inline 8-bit counters into buckets (in place), and merge them into the shared
+ * feedback map, which also resets them
+ */
+static void instrumentMergeCounters(void) {
+    uint64_t newCnt = 0;
+    for (size_t m = 0; m < ATOMIC_GET(cntModulesCnt); m++) {
+        uint8_t* cnts = cntModules[m].start;
+        size_t len = cntModules[m].stop - cntModules[m].start;
+        size_t i = 0;
+        /* Most counters are 0, skip them a word at a time */
+        for (; (i + sizeof(uint64_t)) <= len; i += sizeof(uint64_t)) {
+            uint64_t w;
+            memcpy(&w, &cnts[i], sizeof(w));
+            if (w != 0) {
+                instrumentClassifyCounters(&cnts[i], sizeof(w));
+            }
+        }
+        instrumentClassifyCounters(&cnts[i], len - i);
+        newCnt += bitmap_merge(
+            &feedback->pcCntMap[cntModules[m].base], cnts, len, /* clearSrc= */ true);
+    }
+    if (newCnt) {
+        ATOMIC_POST_ADD(feedback->pidFeedback[my_thread_no].edge, newCnt);
+    }
+}
+
+/*
+ * Merge the coverage recorded locally since the last call (PCs in the local mode, and the inline
+ * 8-bit counters) into the shared feedback map
+ */
+void instrumentMergeLocalCov(void) {
+    instrumentMergeCounters();
+    if (!localCovEnabled) {
+        return;
+    }
+    size_t cnt = ATOMIC_XCHG(localCovPendingCnt, 0);
+    if (cnt > _HF_LOCAL_COV_PENDING_MAX) {
+        cnt = _HF_LOCAL_COV_PENDING_MAX;
+    }
+    uint64_t newCnt = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        if (!ATOMIC_BTS(feedback->bbMapPc, localCovPending[i])) {
+            newCnt++;
+        }
+    }
+    if (newCnt) {
+        ATOMIC_POST_ADD(feedback->pidFeedback[my_thread_no].pc, newCnt);
+    }
+}
+
+void instrumentRearmGuards(void) {
+    if (!ATOMIC_GET(feedback->guardsRearm)) {
+        return;
+    }
+    for (size_t m = 0; m < ATOMIC_GET(guardModulesCnt); m++) {
+        uint32_t n = guardModules[m].first;
+        for (uint32_t* x = guardModules[m].start; x < guardModules[m].stop; x++, n++) {
+            ATOMIC_SET(*x, n);
+        }
+    }
+}
+
 /* Reset the counters of newly discovered edges/pcs/features */
 void instrumentClearNewCov() {
-    feedback->pidFeedbackPc[my_thread_no] = 0U;
-    feedback->pidFeedbackEdge[my_thread_no] = 0U;
-    feedback->pidFeedbackCmp[my_thread_no] = 0U;
+    feedback->pidFeedback[my_thread_no].pc = 0U;
+    feedback->pidFeedback[my_thread_no].edge = 0U;
+    feedback->pidFeedback[my_thread_no].cmp = 0U;
 }
 
 /*
@@ -104,10 +340,7 @@ void instrumentClearNewCov() {
 ATTRIBUTE_X86_REQUIRE_SSE42 void __cyg_profile_func_enter(void* func, void* caller) {
     register size_t pos =
         (((uintptr_t)func << 12) | ((uintptr_t)caller & 0xFFF)) & _HF_PERF_BITMAP_BITSZ_MASK;
-    register uint8_t prev = ATOMIC_BTS(feedback->bbMapPc, pos);
-    if (!prev) {
-        ATOMIC_PRE_INC_RELAXED(feedback->pidFeedbackPc[my_thread_no]);
-    }
+    instrumentAddPc(pos);
 }
 
 ATTRIBUTE_X86_REQUIRE_SSE42 void __cyg_profile_func_exit(
@@ -115,15 +348,58 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void __cyg_profile_func_exit(
     return;
 }
 
+/*
+ * Returns the ID of the comparison site at 'pc' (see cmpSite_t), registering it with the first
+ * free slot of its probe sequence if needed. 0 is returned for sites which don't fit in the
+ * registry. The ID is allocated before the slot is taken, with a single CAS of both, so a process
+ * dying in between leaves no site without its ID (the ID is lost then, as when the CAS is lost)
+ */
+#define HF_CMP_SITES_PROBES 32
+
+static inline uint32_t instrumentCmpSiteId(uintptr_t pc) {
+    const uint64_t key = (uint64_t)pc + 1U;
+    const uint64_t idMask = _HF_CMP_SITES_MAX - 1;
+    const uint64_t tag = (((key * 0x9E3779B97F4A7C15ULL) >> _HF_CMP_SITE_ID_BITS) | 1U)
+                         << _HF_CMP_SITE_ID_BITS;
+    uint64_t newSite = 0;
+    /* Keeps the locality of the code: neighbouring sites usually end up in neighbouring slots */
+    size_t idx = (size_t)((key ^ (key >> _HF_CMP_SITES_HT_BITS)) & (_HF_CMP_SITES_HT - 1));
+    for (size_t i = 0; i < HF_CMP_SITES_PROBES; i++, idx = (idx + 1) & (_HF_CMP_SITES_HT - 1)) {
+        cmpSite_t* site = &feedback->cmpSites[idx];
+        uint64_t cur = ATOMIC_GET(*site);
+        if (cur == 0) {
+            if (newSite == 0) {
+                uint64_t id = ATOMIC_PRE_INC(feedback->cmpSitesCnt);
+                newSite = tag | ((id < _HF_CMP_SITES_MAX) ? id : 0U);
+            }
+            if (__atomic_compare_exchange_n(site, &cur, newSite, /* weak= */ false,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return (uint32_t)(newSite & idMask);
+            }
+        }
+        /* 'cur' is what another process has stored, if the CAS failed */
+        if ((cur & ~idMask) == tag) {
+            return (uint32_t)(cur & idMask);
+        }
+    }
+    return 0U;
+}
+
+ATTRIBUTE_X86_REQUIRE_SSE42 static inline void instrumentCmpUpdate(uintptr_t pc, uint8_t v) {
+    uint32_t id = instrumentCmpSiteId(pc);
+    uint8_t prev = ATOMIC_GET(feedback->cmpMap[id]);
+    if (prev < v) {
+        ATOMIC_SET(feedback->cmpMap[id], v);
+        ATOMIC_POST_ADD(feedback->pidFeedback[my_thread_no].cmp, v - prev);
+    }
+}
+
 /*
  * -fsanitize-coverage=trace-pc
  */
 ATTRIBUTE_X86_REQUIRE_SSE42 static inline void hfuzz_trace_pc_internal(uintptr_t pc) {
     register uintptr_t ret = pc & _HF_PERF_BITMAP_BITSZ_MASK;
-    register uint8_t prev = ATOMIC_BTS(feedback->bbMapPc, ret);
-    if (!prev) {
-        ATOMIC_PRE_INC_RELAXED(feedback->pidFeedbackPc[my_thread_no]);
-    }
+    instrumentAddPc(ret);
 }
 
 ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_pc(void) {
@@ -138,65 +414,68 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void hfuzz_trace_pc(uintptr_t pc) {
  * -fsanitize-coverage=trace-cmp
  */
 ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmp1(uint8_t Arg1, uint8_t Arg2) {
-    uintptr_t pos = (uintptr_t)__builtin_return_address(0) % _HF_PERF_BITMAP_SIZE_16M;
     register uint8_t v = ((sizeof(Arg1) * 8) - __builtin_popcount(Arg1 ^ Arg2));
-    uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
+    instrumentCmpUpdate((uintptr_t)__builtin_return_address(0), v);
+}
+
+/* --cmplog: 1-byte comparisons are not logged, their operands are useless as dictionary words */
+static inline void instrumentCmpLogInt(
+    uintptr_t pc, const void* Arg1, const void* Arg2, size_t sz, uint8_t flags) {
+    if (ATOMIC_GET(feedback->cmpLog[my_thread_no].enabled)) {
+        instrumentCmpLog(pc, Arg1, sz, Arg2, sz, flags | _HF_CMPLOG_INT);
     }
 }
 
-ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmp2(uint16_t Arg1, uint16_t Arg2) {
-    uintptr_t pos = (uintptr_t)__builtin_return_address(0) % _HF_PERF_BITMAP_SIZE_16M;
+ATTRIBUTE_X86_REQUIRE_SSE42 static inline void hfuzz_trace_cmp2_internal(
+    uintptr_t pc, uint16_t Arg1, uint16_t Arg2, uint8_t flags) {
     register uint8_t v = ((sizeof(Arg1) * 8) - __builtin_popcount(Arg1 ^ Arg2));
-    uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
+    instrumentCmpUpdate(pc, v);
+    if (Arg1 != Arg2) {
+        instrumentCmpLogInt(pc, &Arg1, &Arg2, sizeof(Arg1), flags);
     }
 }
 
+ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmp2(uint16_t Arg1, uint16_t Arg2) {
+    hfuzz_trace_cmp2_internal((uintptr_t)__builtin_return_address(0), Arg1, Arg2, 0);
+}
+
 ATTRIBUTE_X86_REQUIRE_SSE42 static inline void hfuzz_trace_cmp4_internal(
-    uintptr_t pc, uint32_t Arg1, uint32_t Arg2) {
-    uintptr_t pos = pc % _HF_PERF_BITMAP_SIZE_16M;
+    uintptr_t pc, uint32_t Arg1, uint32_t Arg2, uint8_t flags) {
     register uint8_t v = ((sizeof(Arg1) * 8) - __builtin_popcount(Arg1 ^ Arg2));
-    uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
+    instrumentCmpUpdate(pc, v);
+    if (Arg1 != Arg2) {
+        instrumentCmpLogInt(pc, &Arg1, &Arg2, sizeof(Arg1), flags);
     }
 }
 
 ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmp4(uint32_t Arg1, uint32_t Arg2) {
-    hfuzz_trace_cmp4_internal((uintptr_t)__builtin_return_address(0), Arg1, Arg2);
+    hfuzz_trace_cmp4_internal((uintptr_t)__builtin_return_address(0), Arg1, Arg2, 0);
 }
 
 ATTRIBUTE_X86_REQUIRE_SSE42 void hfuzz_trace_cmp4(uintptr_t pc, uint32_t Arg1, uint32_t Arg2) {
-    hfuzz_trace_cmp4_internal(pc, Arg1, Arg2);
+    hfuzz_trace_cmp4_internal(pc, Arg1, Arg2, 0);
 }
 
 ATTRIBUTE_X86_REQUIRE_SSE42 static inline void hfuzz_trace_cmp8_internal(
-    uintptr_t pc, uint64_t Arg1, uint64_t Arg2) {
-    uintptr_t pos = pc % _HF_PERF_BITMAP_SIZE_16M;
+    uintptr_t pc, uint64_t Arg1, uint64_t Arg2, uint8_t flags) {
     register uint8_t v = ((sizeof(Arg1) * 8) - __builtin_popcountll(Arg1 ^ Arg2));
-    uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
+    instrumentCmpUpdate(pc, v);
+    if (Arg1 != Arg2) {
+        instrumentCmpLogInt(pc, &Arg1, &Arg2, sizeof(Arg1), flags);
     }
 }
 
 ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmp8(uint64_t Arg1, uint64_t Arg2) {
-    hfuzz_trace_cmp8_internal((uintptr_t)__builtin_return_address(0), Arg1, Arg2);
+    hfuzz_trace_cmp8_internal((uintptr_t)__builtin_return_address(0), Arg1, Arg2, 0);
 }
 
 ATTRIBUTE_X86_REQUIRE_SSE42 void hfuzz_trace_cmp8(uintptr_t pc, uint64_t Arg1, uint64_t Arg2) {
-    hfuzz_trace_cmp8_internal(pc, Arg1, Arg2);
+    hfuzz_trace_cmp8_internal(pc, Arg1, Arg2, 0);
 }
 
 /*
- * Const versions of trace_cmp, we don't use any special handling for these
+ * Const versions of trace_cmp, Arg1 is the compile-time constant, which is marked as such in the
+ * --cmplog entries
  *
  * For MacOS, these're weak aliases, as Darwin supports only them
  */
@@ -209,28 +488,35 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void hfuzz_trace_cmp8(uintptr_t pc, uint64_t Arg1, u
 #else
 void __sanitizer_cov_trace_const_cmp1(uint8_t Arg1, uint8_t Arg2)
     __attribute__((alias("__sanitizer_cov_trace_cmp1")));
-void __sanitizer_cov_trace_const_cmp2(uint16_t Arg1, uint16_t Arg2)
-    __attribute__((alias("__sanitizer_cov_trace_cmp2")));
-void __sanitizer_cov_trace_const_cmp4(uint32_t Arg1, uint32_t Arg2)
-    __attribute__((alias("__sanitizer_cov_trace_cmp4")));
-void __sanitizer_cov_trace_const_cmp8(uint64_t Arg1, uint64_t Arg2)
-    __attribute__((alias("__sanitizer_cov_trace_cmp8")));
+ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_const_cmp2(uint16_t Arg1, uint16_t Arg2) {
+    hfuzz_trace_cmp2_internal(
+        (uintptr_t)__builtin_return_address(0), Arg1, Arg2, _HF_CMPLOG_CONST);
+}
+ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_const_cmp4(uint32_t Arg1, uint32_t Arg2) {
+    hfuzz_trace_cmp4_internal(
+        (uintptr_t)__builtin_return_address(0), Arg1, Arg2, _HF_CMPLOG_CONST);
+}
+ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_const_cmp8(uint64_t Arg1, uint64_t Arg2) {
+    hfuzz_trace_cmp8_internal(
+        (uintptr_t)__builtin_return_address(0), Arg1, Arg2, _HF_CMPLOG_CONST);
+}
 #endif /* defined(_HF_ARCH_DARWIN) */
 
 /*
  * Cases[0] is number of comparison entries
  * Cases[1] is length of Val in bits
+ *
+ * Only the case closest to Val (by the Hamming distance) is scored, at its own site (pc + i), so
+ * a switch costs one map update instead of one per case
  */
 ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_switch(uint64_t Val, uint64_t* Cases) {
-    for (uint64_t i = 0; i < Cases[0]; i++) {
-        uintptr_t pos = ((uintptr_t)__builtin_return_address(0) + i) % _HF_PERF_BITMAP_SIZE_16M;
-        uint8_t v = (uint8_t)Cases[1] - __builtin_popcountll(Val ^ Cases[i + 2]);
-        uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-        if (prev < v) {
-            ATOMIC_SET(feedback->bbMapCmp[pos], v);
-            ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
-        }
+    if (Cases[0] == 0) {
+        return;
     }
+    size_t i;
+    unsigned dist = bitmap_closestWord(Val, &Cases[2], Cases[0], &i);
+    uint8_t v = (uint8_t)Cases[1] - (uint8_t)dist;
+    instrumentCmpUpdate((uintptr_t)__builtin_return_address(0) + i, v);
 }
 
 /*
@@ -256,52 +542,74 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmp(
 }
 
 /*
- * gcc-8 -fsanitize-coverage=trace-cmp trace hooks
- * TODO: evaluate, whether it makes sense to implement them
+ * gcc-8 -fsanitize-coverage=trace-cmp trace hooks for floating-point comparisons
+ *
+ * The score is the number of leading zero bits of the distance between the arguments in ULPs,
+ * i.e. it grows by one every time the distance halves. The bits of the arguments are mapped to
+ * integers which are ordered the same way as the values, so the distance is their difference.
+ * NaNs aren't close to anything
  */
-ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmpf(
-    float Arg1 HF_ATTR_UNUSED, float Arg2 HF_ATTR_UNUSED) {
+static inline uint32_t instrumentFloatKey(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return (u & 0x80000000U) ? ~u : (u | 0x80000000U);
+}
+
+static inline uint64_t instrumentDoubleKey(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return (u & 0x8000000000000000ULL) ? ~u : (u | 0x8000000000000000ULL);
+}
+
+ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmpf(float Arg1, float Arg2) {
+    if (__builtin_isnan(Arg1) || __builtin_isnan(Arg2)) {
+        return;
+    }
+    uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+    uint32_t k1 = instrumentFloatKey(Arg1);
+    uint32_t k2 = instrumentFloatKey(Arg2);
+    uint32_t dist = (k1 > k2) ? (k1 - k2) : (k2 - k1);
+    instrumentCmpUpdate(pc, dist ? (uint8_t)__builtin_clz(dist) : (sizeof(dist) * 8));
+    if (dist) {
+        instrumentCmpLogInt(pc, &Arg1, &Arg2, sizeof(Arg1), 0);
+    }
 }
-ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmpd(
-    double Arg1 HF_ATTR_UNUSED, double Arg2 HF_ATTR_UNUSED) {
+
+ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_cmpd(double Arg1, double Arg2) {
+    if (__builtin_isnan(Arg1) || __builtin_isnan(Arg2)) {
+        return;
+    }
+    uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+    uint64_t k1 = instrumentDoubleKey(Arg1);
+    uint64_t k2 = instrumentDoubleKey(Arg2);
+    uint64_t dist = (k1 > k2) ? (k1 - k2) : (k2 - k1);
+    instrumentCmpUpdate(pc, dist ? (uint8_t)__builtin_clzll(dist) : (sizeof(dist) * 8));
+    if (dist) {
+        instrumentCmpLogInt(pc, &Arg1, &Arg2, sizeof(Arg1), 0);
+    }
 }
 
 /*
  * -fsanitize-coverage=trace-div
  */
 void __sanitizer_cov_trace_div8(uint64_t Val) {
-    uintptr_t pos = (uintptr_t)__builtin_return_address(0) % _HF_PERF_BITMAP_SIZE_16M;
     uint8_t v = ((sizeof(Val) * 8) - __builtin_popcountll(Val));
-    uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
-    }
+    instrumentCmpUpdate((uintptr_t)__builtin_return_address(0), v);
 }
 
 void __sanitizer_cov_trace_div4(uint32_t Val) {
-    uintptr_t pos = (uintptr_t)__builtin_return_address(0) % _HF_PERF_BITMAP_SIZE_16M;
     uint8_t v = ((sizeof(Val) * 8) - __builtin_popcount(Val));
-    uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
-    }
+    instrumentCmpUpdate((uintptr_t)__builtin_return_address(0), v);
 }
 
 /*
  * -fsanitize-coverage=trace-gep
  */
 ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_gep(uintptr_t Idx) {
-    uintptr_t pos = (uintptr_t)__builtin_return_address(0) % _HF_PERF_BITMAP_SIZE_16M;
     //register uint8_t v = ((sizeof(Idx) * 8) - __builtin_popcountll(Idx));
     //register uint8_t v = ((sizeof(Idx) * 8) - __builtin_clzll(Idx));
     register uint8_t v =  (((sizeof(Idx) * 8) - __builtin_popcountll(Idx))) + (64 + ((sizeof(Idx) * 8) - __builtin_clzll(Idx)));
-    uint8_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
-    }
+    instrumentCmpUpdate((uintptr_t)__builtin_return_address(0), v);
 }
 
 /*
@@ -312,10 +620,7 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_pc_indir(uintptr_t callee
     register size_t pos2 = callee & 0xFFF;
     register size_t pos = (pos1 | pos2) & _HF_PERF_BITMAP_BITSZ_MASK;
 
-    register uint8_t prev = ATOMIC_BTS(feedback->bbMapPc, pos);
-    if (!prev) {
-        ATOMIC_PRE_INC_RELAXED(feedback->pidFeedbackPc[my_thread_no]);
-    }
+    instrumentAddPc(pos);
 }
 
 /*
@@ -328,9 +633,30 @@ __attribute__((weak)) ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_indir_cal
     register size_t pos2 = (uintptr_t)callee & 0xFFF;
     register size_t pos = (pos1 | pos2) & _HF_PERF_BITMAP_BITSZ_MASK;
 
-    register uint8_t prev = ATOMIC_BTS(feedback->bbMapPc, pos);
-    if (!prev) {
-        ATOMIC_PRE_INC_RELAXED(feedback->pidFeedbackPc[my_thread_no]);
+    instrumentAddPc(pos);
+}
+
+/*
+ * Makes pcGuardMap cover the guards up to 'guards', by growing the shared memory object. It's done
+ * by the processes, as only they know the number of their guards
+ */
+static void instrumentGrowGuardMap(size_t guards) {
+    size_t len = MIN((guards / 8) + 1, sizeof(feedback->pcGuardMap));
+    if (!feedbackShared || ATOMIC_GET(feedback->pcGuardMapLen) >= len) {
+        return;
+    }
+    const size_t off = offsetof(feedback_t, pcGuardMap);
+    ssize_t sz = files_growSharedMem(_HF_BITMAP_FD, off + len);
+    if (sz == -1) {
+        LOG_F("Couldn't grow the feedback structure for %zu PC guards", guards);
+    }
+    uint64_t newLen = MIN((size_t)sz - off, sizeof(feedback->pcGuardMap));
+    /* Another process might have grown it even further in the meantime */
+    for (uint64_t cur = ATOMIC_GET(feedback->pcGuardMapLen); cur < newLen;) {
+        if (__atomic_compare_exchange_n(&feedback->pcGuardMapLen, &cur, newLen, /* weak= */ false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            break;
+        }
     }
 }
 
@@ -351,6 +677,17 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_pc_guard_init(
         return;
     }
 
+    if (covPcs) {
+        covPcsGuards.pcs = &covPcs->guardPcs[n];
+        covPcsGuards.cnt = stop - start;
+    }
+    instrumentGrowGuardMap(n + (size_t)(stop - start));
+    if (guardModulesCnt < _HF_CNT_MODULES_MAX) {
+        guardModules[guardModulesCnt].start = start;
+        guardModules[guardModulesCnt].stop = stop;
+        guardModules[guardModulesCnt].first = n;
+        ATOMIC_PRE_INC(guardModulesCnt);
+    }
     for (uint32_t* x = start; x < stop; x++, n++) {
         if (n >= _HF_PC_GUARD_MAX) {
             LOG_F("This process has too many PC guards:%" PRIu32
@@ -358,7 +695,7 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_pc_guard_init(
                 n, ((uintptr_t)stop - (uintptr_t)start) / sizeof(start), start, stop);
         }
         /* If the corresponding PC was already hit, map this specific guard as uninteresting (0) */
-        *x = ATOMIC_GET(feedback->pcGuardMap[n]) ? 0U : n;
+        *x = (ATOMIC_GET(feedback->pcGuardMap[n / 8]) & (1U << (n % 8))) ? 0U : n;
     }
 
     /* Store number of guards for statistical purposes */
@@ -399,18 +736,158 @@ ATTRIBUTE_X86_REQUIRE_SSE42 void __sanitizer_cov_trace_pc_guard(uint32_t* guard)
     if (ATOMIC_GET(*guard) == 0U) {
         return;
     }
-    bool prev = ATOMIC_XCHG(feedback->pcGuardMap[*guard], true);
-    if (prev == false) {
-        ATOMIC_PRE_INC_RELAXED(feedback->pidFeedbackEdge[my_thread_no]);
+    if (!ATOMIC_BTS(feedback->pcGuardMap, *guard)) {
+        ATOMIC_PRE_INC_RELAXED(feedback->pidFeedback[my_thread_no].edge);
     }
     ATOMIC_SET(*guard, 0U);
 }
 
+/*
+ * -fsanitize-coverage=inline-8bit-counters
+ */
+void __sanitizer_cov_8bit_counters_init(char* start, char* stop) {
+    /* Make sure that the feedback struct is already mmap()'d */
+    hfuzzInstrumentInit();
+
+    for (size_t i = 0; i < cntModulesCnt; i++) {
+        if (cntModules[i].start == (uint8_t*)start) {
+            return;
+        }
+    }
+    if (cntModulesCnt >= _HF_CNT_MODULES_MAX) {
+        LOG_F("This process has too many modules with 8-bit counters: %zu", cntModulesCnt);
+    }
+    size_t len = (uintptr_t)stop - (uintptr_t)start;
+    if ((cntTotal + len) > _HF_PC_CNT_MAX) {
+        LOG_F("This process has too many 8-bit counters: %zu (current module:%zu start:%p stop:%p)",
+            cntTotal + len, len, start, stop);
+    }
+    cntModules[cntModulesCnt].start = (uint8_t*)start;
+    cntModules[cntModulesCnt].stop = (uint8_t*)stop;
+    cntModules[cntModulesCnt].base = cntTotal;
+    if (covPcs) {
+        covPcsCnts.pcs = &covPcs->cntPcs[cntTotal];
+        covPcsCnts.cnt = len;
+    }
+    cntTotal += len;
+    ATOMIC_PRE_INC(cntModulesCnt);
+
+    /* Store number of counters for statistical purposes */
+    if (ATOMIC_GET(feedback->guardNb) < cntTotal) {
+        ATOMIC_SET(feedback->guardNb, cntTotal);
+    }
+}
+
+/* Slot (+ 1) of the module in covPcs->modules, registered by the first process which finds it */
+static uint64_t instrumentCovModule(const char* path) {
+    const uint64_t key = util_hash(path, strlen(path)) | 1U;
+    size_t idx = (size_t)(key % _HF_COV_MODULES_MAX);
+    for (size_t i = 0; i < _HF_COV_MODULES_MAX; i++, idx = (idx + 1) % _HF_COV_MODULES_MAX) {
+        covModule_t* m = &covPcs->modules[idx];
+        uint64_t cur = ATOMIC_GET(m->key);
+        if (cur == 0 && __atomic_compare_exchange_n(&m->key, &cur, key, /* weak= */ false,
+                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            snprintf(m->path, sizeof(m->path), "%s", path);
+            ATOMIC_SET_RELEASE(m->ready, 1U);
+            return idx + 1;
+        }
+        if (cur == key) {
+            return idx + 1;
+        }
+    }
+    return 0;
+}
+
+static void instrumentCovPcsSet(uint64_t* dst, size_t dstCnt, const uintptr_t* pcs, size_t cnt,
+    uint64_t mod, uintptr_t base) {
+    if (dstCnt != cnt) {
+        LOG_W("The PC table has %zu entries, and the module has %zu guards/counters", cnt, dstCnt);
+        return;
+    }
+    for (size_t i = 0; i < cnt; i++) {
+        /* Pairs of the PC and its flags, the first one (1) marks the function entry blocks */
+        uint64_t off = (uint64_t)(pcs[i * 2] - base) << 1;
+        ATOMIC_SET(dst[i], (mod << _HF_COV_PC_MOD_SHIFT) |
+                               (off & ((1ULL << _HF_COV_PC_MOD_SHIFT) - 1ULL)) |
+                               (pcs[i * 2 + 1] & _HF_COV_PC_FUNC_ENTRY));
+    }
+}
+
+/*
+ * -fsanitize-coverage=pc-table
+ */
+void __sanitizer_cov_pcs_init(const uintptr_t* pcs_beg, const uintptr_t* pcs_end) {
+    /* Make sure that the feedback struct is already mmap()'d */
+    hfuzzInstrumentInit();
+
+    uint64_t* guardPcs = covPcsGuards.pcs;
+    uint64_t* cntPcs = covPcsCnts.pcs;
+    covPcsGuards.pcs = NULL;
+    covPcsCnts.pcs = NULL;
+    if (covPcs == NULL || pcs_beg == pcs_end) {
+        return;
+    }
+
+    /* The same offset as the one computed from /proc/<pid>/maps, as in libhfuzz/crash.c */
+    Dl_info info;
+    if (dladdr((void*)pcs_beg[0], &info) == 0 || info.dli_fname == NULL) {
+        LOG_W("dladdr(%p) failed, the PCs of this module won't be exported", (void*)pcs_beg[0]);
+        return;
+    }
+    char path[PATH_MAX];
+    if (realpath(info.dli_fname, path) == NULL) {
+        snprintf(path, sizeof(path), "%s", info.dli_fname);
+    }
+    uint64_t mod = instrumentCovModule(path);
+    if (mod == 0) {
+        LOG_W("Too many modules (%u), the PCs of '%s' won't be exported", _HF_COV_MODULES_MAX,
+            path);
+        return;
+    }
+
+    size_t cnt = (pcs_end - pcs_beg) / 2;
+    uintptr_t base = (uintptr_t)info.dli_fbase;
+    if (guardPcs) {
+        instrumentCovPcsSet(guardPcs, covPcsGuards.cnt, pcs_beg, cnt, mod, base);
+    }
+    if (cntPcs) {
+        instrumentCovPcsSet(cntPcs, covPcsCnts.cnt, pcs_beg, cnt, mod, base);
+    }
+}
+
 void instrumentUpdateCmpMap(uintptr_t addr, uint32_t v) {
-    uintptr_t pos = addr % _HF_PERF_BITMAP_SIZE_16M;
-    uint32_t prev = ATOMIC_GET(feedback->bbMapCmp[pos]);
-    if (prev < v) {
-        ATOMIC_SET(feedback->bbMapCmp[pos], v);
-        ATOMIC_POST_ADD(feedback->pidFeedbackCmp[my_thread_no], v - prev);
+    /* The map holds 8-bit values, longer matches (e.g. of memcmp()) saturate */
+    instrumentCmpUpdate(addr, (uint8_t)MIN(v, UINT8_MAX));
+}
+
+void instrumentCmpLog(
+    uintptr_t addr, const void* v1, size_t len1, const void* v2, size_t len2, uint8_t flags) {
+    cmpLog_t* cl = &feedback->cmpLog[my_thread_no];
+    if (!ATOMIC_GET(cl->enabled) || ATOMIC_GET(cl->cnt) >= _HF_CMPLOG_MAX) {
+        return;
+    }
+    len1 = MIN(len1, _HF_CMPLOG_VAL_MAX);
+    len2 = MIN(len2, _HF_CMPLOG_VAL_MAX);
+
+    uint64_t k1 = 0, k2 = 0;
+    memcpy(&k1, v1, MIN(len1, sizeof(k1)));
+    memcpy(&k2, v2, MIN(len2, sizeof(k2)));
+    uint64_t h = (addr ^ k1 ^ (k2 * 0x9E3779B97F4A7C15ULL)) * 0xFF51AFD7ED558CCDULL;
+    size_t bit = (h >> 32) % (_HF_CMPLOG_SEEN_SZ * 8U);
+    uint8_t mask = (uint8_t)(1U << (bit % 8U));
+    if (ATOMIC_GET(cl->seen[bit / 8U]) & mask) {
+        return;
+    }
+    ATOMIC_POST_OR(cl->seen[bit / 8U], mask);
+
+    uint32_t idx = ATOMIC_POST_INC(cl->cnt);
+    if (idx >= _HF_CMPLOG_MAX) {
+        return;
     }
+    cmpLogEntry_t* e = &cl->entries[idx];
+    e->flags = flags;
+    e->len1 = (uint8_t)len1;
+    e->len2 = (uint8_t)len2;
+    memcpy(e->v1, v1, len1);
+    memcpy(e->v2, v2, len2);
 }
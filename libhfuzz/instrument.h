@@ -26,7 +26,23 @@
 
 #include <inttypes.h>
 
+#include "honggfuzz.h"
+
 void instrumentUpdateCmpMap(uintptr_t addr, uint32_t v);
+/* With --cmplog, records the operands of a comparison which didn't match, see cmpLog_t */
+void instrumentCmpLog(
+    uintptr_t addr, const void* v1, size_t len1, const void* v2, size_t len2, uint8_t flags);
 void instrumentClearNewCov();
+void instrumentMergeLocalCov(void);
+/* Re-arms all PC guards (before an input) if the fuzzer asked for it, see feedback_t.guardsRearm */
+void instrumentRearmGuards(void);
+/* Maps the feedback structure. It's a constructor, but other constructors might need it first */
+void hfuzzInstrumentInit(void);
+/* Returns NULL if the process doesn't share the feedback map with the fuzzer */
+persistentCtl_t* instrumentPersistentCtl(void);
+/* Same, it's where the process describes its crash with _HF_INPROC_CRASH_ENV */
+crashRec_t* instrumentCrashRec(void);
+/* Counters of new coverage found by this process, since the fuzzer has last reset them */
+const pidFeedback_t* instrumentNewCov(void);
 
 #endif /* ifdef _HF_LIBHFUZZ_INSTRUMENT_H_ */
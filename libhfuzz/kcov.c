@@ -0,0 +1,58 @@
+#include "libhfuzz/kcov.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#if defined(_HF_ARCH_LINUX)
+#include <linux/kcov.h>
+#include <sys/ioctl.h>
+#endif /* defined(_HF_ARCH_LINUX) */
+
+#include "honggfuzz.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/log.h"
+
+#if defined(_HF_ARCH_LINUX)
+
+/* -1: not checked yet, 0: no _HF_KCOV_FD, or it's not a KCOV descriptor, 1: in use */
+static int kcovState = -1;
+
+static bool kcovAvailable(void) {
+    if (kcovState == -1) {
+        kcovState = (fcntl(_HF_KCOV_FD, F_GETFD) != -1);
+    }
+    return (kcovState == 1);
+}
+
+static void kcovIoctl(unsigned long req, unsigned long arg) {
+    if (!kcovAvailable() || ioctl(_HF_KCOV_FD, req, arg) == 0) {
+        return;
+    }
+    /*
+     * EINVAL: disabling it in a thread (or a fork()-ed worker of a snapshot template) which hasn't
+     * enabled it. EBUSY: it's enabled already, e.g. by another thread
+     */
+    if (errno == EINVAL || errno == EBUSY) {
+        return;
+    }
+    PLOG_W("ioctl(_HF_KCOV_FD=%d, %#lx), the kernel coverage won't be collected", _HF_KCOV_FD, req);
+    kcovState = 0;
+}
+
+void kcovEnable(void) {
+    kcovIoctl(KCOV_ENABLE, KCOV_TRACE_PC);
+}
+
+void kcovDisable(void) {
+    kcovIoctl(KCOV_DISABLE, 0UL);
+}
+
+#else /* defined(_HF_ARCH_LINUX) */
+
+void kcovEnable(void) {
+}
+
+void kcovDisable(void) {
+}
+
+#endif /* defined(_HF_ARCH_LINUX) */
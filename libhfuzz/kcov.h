@@ -0,0 +1,33 @@
+/*
+ *
+ * honggfuzz - kernel coverage (KCOV) of persistent processes
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_LIBHFUZZ_KCOV_H_
+#define _HF_LIBHFUZZ_KCOV_H_
+
+/*
+ * With --linux_kcov, the fuzzer passes its KCOV descriptor as _HF_KCOV_FD, and it's the process
+ * which enables the collection for its calling thread, only while an input is processed. Both are
+ * no-ops otherwise
+ */
+extern void kcovEnable(void);
+extern void kcovDisable(void);
+
+#endif /* ifdef _HF_LIBHFUZZ_KCOV_H_ */
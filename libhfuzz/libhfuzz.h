@@ -41,6 +41,19 @@ size_t LLVMFuzzerMutate(uint8_t* Data, size_t Size, size_t MaxSize);
 void HF_ITER(const uint8_t** buf_ptr, size_t* len_ptr);
 void HonggfuzzFetchData(const uint8_t** buf_ptr, size_t* len_ptr);
 
+/*
+ * Fork-server mode (honggfuzz --forkserver): the fork-server is started right before main() (in
+ * binaries linked by hfuzz-cc, with -Wl,--wrap=main, otherwise from a libhfuzz constructor, which
+ * can run before the constructors of the program), and then every input is processed by a freshly
+ * forked process.
+ *
+ * Programs which want to fork processes at a later point (e.g. after an expensive initialization)
+ * should put HF_FORKSERVER_DEFERRED in one of their source files, and call HonggfuzzForkServer()
+ */
+extern const int LIBHFUZZ_forkserver_deferred;
+#define HF_FORKSERVER_DEFERRED const int LIBHFUZZ_forkserver_deferred = 1
+void HonggfuzzForkServer(void);
+
 #if defined(__linux__)
 
 #include <sched.h>
@@ -2,7 +2,11 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* defined(__SSE2__) */
 
 #include "libhfcommon/common.h"
 #include "libhfuzz/instrument.h"
@@ -12,99 +16,212 @@ const char* const LIBHFUZZ_module_memorycmp = "LIBHFUZZ_module_memorycmp";
 
 #define RET_CALL_CHAIN (uintptr_t) __builtin_return_address(0)
 
-static inline int HF_strcmp(const char* s1, const char* s2, uintptr_t addr) {
-    size_t i;
-    for (i = 0; s1[i] == s2[i]; i++) {
-        if (s1[i] == '\0' || s2[i] == '\0') {
-            break;
+/*
+ * The comparison kernels, which return the length of the common prefix, i.e. the feedback value.
+ * Strings are read a word at a time only when the word doesn't cross a page boundary, as their
+ * terminating NUL can be anywhere in it
+ */
+#define HF_PAGE_SZ 4096U
+#define HF_WORD_READABLE(p) (((uintptr_t)(p) & (HF_PAGE_SZ - 1)) <= (HF_PAGE_SZ - sizeof(uint64_t)))
+/* 0x80 in every NUL byte of the word, and 0x00 elsewhere */
+#define HF_WORD_NULS(w)                                                                       \
+    (~((((w)&0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | (w) | 0x7F7F7F7F7F7F7F7FULL))
+
+static inline uint64_t HF_loadWord(const void* p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+/* Index of the first (in memory order) non-zero byte of a non-zero word */
+static inline size_t HF_wordFirstByte(uint64_t w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return (size_t)__builtin_ctzll(w) / 8U;
+#else
+    return (size_t)__builtin_clzll(w) / 8U;
+#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ */
+}
+
+/* Index of the first byte which differs, or 'n' */
+static inline size_t HF_memMismatch(const uint8_t* s1, const uint8_t* s2, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; (n - i) >= sizeof(__m128i); i += sizeof(__m128i)) {
+        __m128i v1 = _mm_loadu_si128((const __m128i*)&s1[i]);
+        __m128i v2 = _mm_loadu_si128((const __m128i*)&s2[i]);
+        unsigned eq = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2));
+        if (eq != 0xFFFFU) {
+            return i + (size_t)__builtin_ctz(~eq);
         }
     }
-    instrumentUpdateCmpMap(addr, i);
-    return ((unsigned char)s1[i] - (unsigned char)s2[i]);
+#endif /* defined(__SSE2__) */
+    for (; (n - i) >= sizeof(uint64_t); i += sizeof(uint64_t)) {
+        uint64_t diff = HF_loadWord(&s1[i]) ^ HF_loadWord(&s2[i]);
+        if (diff) {
+            return i + HF_wordFirstByte(diff);
+        }
+    }
+    for (; i < n && s1[i] == s2[i]; i++) {
+    }
+    return i;
 }
 
-static inline int HF_strcasecmp(const char* s1, const char* s2, uintptr_t addr) {
-    size_t i;
-    for (i = 0; tolower((unsigned char)s1[i]) == tolower((unsigned char)s2[i]); i++) {
-        if (s1[i] == '\0' || s2[i] == '\0') {
-            break;
+/* Index of the first byte which differs, or which is the NUL of both strings, or 'n' */
+static inline size_t HF_strMismatch(const char* s1, const char* s2, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if ((n - i) >= sizeof(uint64_t) && HF_WORD_READABLE(&s1[i]) && HF_WORD_READABLE(&s2[i])) {
+            uint64_t w1 = HF_loadWord(&s1[i]);
+            uint64_t stop = (w1 ^ HF_loadWord(&s2[i])) | HF_WORD_NULS(w1);
+            if (stop) {
+                return i + HF_wordFirstByte(stop);
+            }
+            i += sizeof(uint64_t);
+            continue;
         }
+        if (s1[i] != s2[i] || s1[i] == '\0') {
+            return i;
+        }
+        i++;
     }
-    instrumentUpdateCmpMap(addr, i);
-    return (tolower((unsigned char)s1[i]) - tolower((unsigned char)s2[i]));
+    return n;
 }
 
-static inline int HF_strncmp(const char* s1, const char* s2, size_t n, uintptr_t addr) {
-    size_t i;
-    for (i = 0; i < n; i++) {
-        if ((s1[i] != s2[i]) || s1[i] == '\0' || s2[i] == '\0') {
-            break;
+/* As above, but the bytes are compared after tolower() */
+static inline size_t HF_strCaseMismatch(const char* s1, const char* s2, size_t n) {
+    size_t i = 0;
+    for (;;) {
+        /* Bytes which are equal as they are, are also equal after tolower() */
+        i += HF_strMismatch(&s1[i], &s2[i], n - i);
+        if (i == n || s1[i] == '\0' ||
+            tolower((unsigned char)s1[i]) != tolower((unsigned char)s2[i])) {
+            return i;
         }
+        i++;
     }
+}
+
+/* --cmplog: strings are logged up to their terminating NUL, and up to 'n' bytes */
+static inline size_t HF_strnlen(const char* s, size_t n) {
+    size_t i = 0;
+    for (; i < n && s[i]; i++) {
+    }
+    return i;
+}
+
+static inline void HF_cmpLogStr(const char* s1, const char* s2, size_t n, uintptr_t addr) {
+    n = (n < _HF_CMPLOG_VAL_MAX) ? n : _HF_CMPLOG_VAL_MAX;
+    instrumentCmpLog(addr, s1, HF_strnlen(s1, n), s2, HF_strnlen(s2, n), 0);
+}
 
+static inline int HF_strcmp(const char* s1, const char* s2, uintptr_t addr) {
+    size_t i = HF_strMismatch(s1, s2, SIZE_MAX);
+    instrumentUpdateCmpMap(addr, i);
+    if (s1[i] != s2[i]) {
+        HF_cmpLogStr(s1, s2, _HF_CMPLOG_VAL_MAX, addr);
+    }
+    return ((unsigned char)s1[i] - (unsigned char)s2[i]);
+}
+
+static inline int HF_strcasecmp(const char* s1, const char* s2, uintptr_t addr) {
+    size_t i = HF_strCaseMismatch(s1, s2, SIZE_MAX);
+    instrumentUpdateCmpMap(addr, i);
+    if (tolower((unsigned char)s1[i]) != tolower((unsigned char)s2[i])) {
+        HF_cmpLogStr(s1, s2, _HF_CMPLOG_VAL_MAX, addr);
+    }
+    return (tolower((unsigned char)s1[i]) - tolower((unsigned char)s2[i]));
+}
+
+static inline int HF_strncmp(
+    const char* s1, const char* s2, size_t n, uintptr_t addr, bool cmpLog) {
+    size_t i = HF_strMismatch(s1, s2, n);
     instrumentUpdateCmpMap(addr, i);
     if (i == n) {
         return 0;
     }
+    if (cmpLog && s1[i] != s2[i]) {
+        HF_cmpLogStr(s1, s2, n, addr);
+    }
     return (unsigned char)s1[i] - (unsigned char)s2[i];
 }
 
-static inline int HF_strncasecmp(const char* s1, const char* s2, size_t n, uintptr_t addr) {
-    size_t i;
-    for (i = 0; i < n; i++) {
-        if ((tolower((unsigned char)s1[i]) != tolower((unsigned char)s2[i])) || s1[i] == '\0' ||
-            s2[i] == '\0') {
-            break;
-        }
-    }
-
+static inline int HF_strncasecmp(
+    const char* s1, const char* s2, size_t n, uintptr_t addr, bool cmpLog) {
+    size_t i = HF_strCaseMismatch(s1, s2, n);
     instrumentUpdateCmpMap(addr, i);
     if (i == n) {
         return 0;
     }
+    if (cmpLog && tolower((unsigned char)s1[i]) != tolower((unsigned char)s2[i])) {
+        HF_cmpLogStr(s1, s2, n, addr);
+    }
     return tolower((unsigned char)s1[i]) - tolower((unsigned char)s2[i]);
 }
 
+/*
+ * The search loops only try the positions where the first byte of the needle matches (found with
+ * the vectorized memchr()/strchr() of libc), as the other ones have no common prefix with it. The
+ * feedback is the longest prefix of the needle found in the haystack, and it's reported once. A
+ * two-way search would skip over positions, and so over their partial matches
+ */
 static inline char* HF_strstr(const char* haystack, const char* needle, uintptr_t addr) {
     size_t needle_len = __builtin_strlen(needle);
     if (needle_len == 0) {
         return (char*)haystack;
     }
 
-    const char* h = haystack;
-    for (; (h = __builtin_strchr(h, needle[0])) != NULL; h++) {
-        if (HF_strncmp(h, needle, needle_len, addr) == 0) {
+    size_t best = 0;
+    for (const char* h = haystack; (h = __builtin_strchr(h, needle[0])) != NULL; h++) {
+        size_t i = HF_strMismatch(h, needle, needle_len);
+        if (i == needle_len) {
+            instrumentUpdateCmpMap(addr, i);
             return (char*)h;
         }
+        best = (i > best) ? i : best;
     }
+    instrumentUpdateCmpMap(addr, best);
+    /* Log the needle only once, not for every position tried */
+    HF_cmpLogStr(needle, haystack, needle_len, addr);
     return NULL;
 }
 
 static inline char* HF_strcasestr(const char* haystack, const char* needle, uintptr_t addr) {
     size_t needle_len = __builtin_strlen(needle);
-    for (size_t i = 0; haystack[i]; i++) {
-        if (HF_strncasecmp(&haystack[i], needle, needle_len, addr) == 0) {
-            return (char*)(&haystack[i]);
+    if (needle_len == 0) {
+        return (char*)haystack;
+    }
+
+    int first = tolower((unsigned char)needle[0]);
+    size_t best = 0;
+    for (const char* h = haystack; *h; h++) {
+        if (tolower((unsigned char)*h) != first) {
+            continue;
         }
+        size_t i = HF_strCaseMismatch(h, needle, needle_len);
+        if (i == needle_len) {
+            instrumentUpdateCmpMap(addr, i);
+            return (char*)h;
+        }
+        best = (i > best) ? i : best;
     }
+    instrumentUpdateCmpMap(addr, best);
+    HF_cmpLogStr(needle, haystack, needle_len, addr);
     return NULL;
 }
 
-static inline int HF_memcmp(const void* m1, const void* m2, size_t n, uintptr_t addr) {
+static inline int HF_memcmp(
+    const void* m1, const void* m2, size_t n, uintptr_t addr, bool cmpLog) {
     const unsigned char* s1 = (const unsigned char*)m1;
     const unsigned char* s2 = (const unsigned char*)m2;
 
-    size_t i;
-    for (i = 0; i < n; i++) {
-        if (s1[i] != s2[i]) {
-            break;
-        }
-    }
-
+    size_t i = HF_memMismatch(s1, s2, n);
     instrumentUpdateCmpMap(addr, i);
     if (i == n) {
         return 0;
     }
+    if (cmpLog) {
+        instrumentCmpLog(addr, s1, n, s2, n, 0);
+    }
     return ((unsigned char)s1[i] - (unsigned char)s2[i]);
 }
 
@@ -117,12 +234,20 @@ static inline void* HF_memmem(const void* haystack, size_t haystacklen, const vo
         return (void*)haystack;
     }
 
-    const char* h = haystack;
-    for (size_t i = 0; i <= (haystacklen - needlelen); i++) {
-        if (HF_memcmp(&h[i], needle, needlelen, addr) == 0) {
-            return (void*)(&h[i]);
+    const uint8_t* n = (const uint8_t*)needle;
+    /* One past the last position at which the needle can start */
+    const uint8_t* end = (const uint8_t*)haystack + (haystacklen - needlelen) + 1;
+    size_t best = 0;
+    for (const uint8_t* h = haystack; (h = __builtin_memchr(h, n[0], end - h)) != NULL; h++) {
+        size_t i = HF_memMismatch(h, n, needlelen);
+        if (i == needlelen) {
+            instrumentUpdateCmpMap(addr, i);
+            return (void*)h;
         }
+        best = (i > best) ? i : best;
     }
+    instrumentUpdateCmpMap(addr, best);
+    instrumentCmpLog(addr, needle, needlelen, haystack, needlelen, 0);
     return NULL;
 }
 
@@ -149,10 +274,10 @@ HF_WEAK_WRAP(int, strcasecmp, const char* s1, const char* s2) {
     return HF_strcasecmp(s1, s2, RET_CALL_CHAIN);
 }
 HF_WEAK_WRAP(int, strncmp, const char* s1, const char* s2, size_t n) {
-    return HF_strncmp(s1, s2, n, RET_CALL_CHAIN);
+    return HF_strncmp(s1, s2, n, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 HF_WEAK_WRAP(int, strncasecmp, const char* s1, const char* s2, size_t n) {
-    return HF_strncasecmp(s1, s2, n, RET_CALL_CHAIN);
+    return HF_strncasecmp(s1, s2, n, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 HF_WEAK_WRAP(char*, strstr, const char* haystack, const char* needle) {
     return HF_strstr(haystack, needle, RET_CALL_CHAIN);
@@ -161,10 +286,10 @@ HF_WEAK_WRAP(char*, strcasestr, const char* haystack, const char* needle) {
     return HF_strcasestr(haystack, needle, RET_CALL_CHAIN);
 }
 HF_WEAK_WRAP(int, memcmp, const void* m1, const void* m2, size_t n) {
-    return HF_memcmp(m1, m2, n, RET_CALL_CHAIN);
+    return HF_memcmp(m1, m2, n, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 HF_WEAK_WRAP(int, bcmp, const void* m1, const void* m2, size_t n) {
-    return HF_memcmp(m1, m2, n, RET_CALL_CHAIN);
+    return HF_memcmp(m1, m2, n, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 HF_WEAK_WRAP(
     void*, memmem, const void* haystack, size_t haystacklen, const void* needle, size_t needlelen) {
@@ -182,7 +307,7 @@ HF_WEAK_WRAP(int, ap_cstr_casecmp, const char* s1, const char* s2) {
 }
 
 HF_WEAK_WRAP(int, ap_cstr_casecmpn, const char* s1, const char* s2, size_t n) {
-    return HF_strncasecmp(s1, s2, n, RET_CALL_CHAIN);
+    return HF_strncasecmp(s1, s2, n, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 HF_WEAK_WRAP(const char*, ap_strcasestr, const char* s1, const char* s2) {
@@ -194,18 +319,18 @@ HF_WEAK_WRAP(int, apr_cstr_casecmp, const char* s1, const char* s2) {
 }
 
 HF_WEAK_WRAP(int, apr_cstr_casecmpn, const char* s1, const char* s2, size_t n) {
-    return HF_strncasecmp(s1, s2, n, RET_CALL_CHAIN);
+    return HF_strncasecmp(s1, s2, n, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 /*
  * *SSL wrappers
  */
 HF_WEAK_WRAP(int, CRYPTO_memcmp, const void* m1, const void* m2, size_t len) {
-    return HF_memcmp(m1, m2, len, RET_CALL_CHAIN);
+    return HF_memcmp(m1, m2, len, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 HF_WEAK_WRAP(int, OPENSSL_memcmp, const void* m1, const void* m2, size_t len) {
-    return HF_memcmp(m1, m2, len, RET_CALL_CHAIN);
+    return HF_memcmp(m1, m2, len, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 HF_WEAK_WRAP(int, OPENSSL_strcasecmp, const char* s1, const char* s2) {
@@ -213,11 +338,11 @@ HF_WEAK_WRAP(int, OPENSSL_strcasecmp, const char* s1, const char* s2) {
 }
 
 HF_WEAK_WRAP(int, OPENSSL_strncasecmp, const char* s1, const char* s2, size_t len) {
-    return HF_strncasecmp(s1, s2, len, RET_CALL_CHAIN);
+    return HF_strncasecmp(s1, s2, len, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 HF_WEAK_WRAP(int32_t, memcmpct, const void* s1, const void* s2, size_t len) {
-    return HF_memcmp(s1, s2, len, RET_CALL_CHAIN);
+    return HF_memcmp(s1, s2, len, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 /*
@@ -236,7 +361,7 @@ HF_WEAK_WRAP(int, xmlStrncmp, const char* s1, const char* s2, int len) {
     if (s2 == NULL) {
         return 1;
     }
-    return HF_strncmp(s1, s2, (size_t)len, RET_CALL_CHAIN);
+    return HF_strncmp(s1, s2, (size_t)len, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 HF_WEAK_WRAP(int, xmlStrcmp, const char* s1, const char* s2) {
@@ -294,7 +419,7 @@ HF_WEAK_WRAP(int, xmlStrncasecmp, const char* s1, const char* s2, int len) {
     if (s2 == NULL) {
         return 1;
     }
-    return HF_strncasecmp(s1, s2, (size_t)len, RET_CALL_CHAIN);
+    return HF_strncasecmp(s1, s2, (size_t)len, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 HF_WEAK_WRAP(const char*, xmlStrstr, const char* haystack, const char* needle) {
@@ -321,7 +446,7 @@ HF_WEAK_WRAP(const char*, xmlStrcasestr, const char* haystack, const char* needl
  * Samba wrappers
  */
 HF_WEAK_WRAP(int, memcmp_const_time, const void* s1, const void* s2, size_t n) {
-    return HF_memcmp(s1, s2, n, RET_CALL_CHAIN);
+    return HF_memcmp(s1, s2, n, RET_CALL_CHAIN, /* cmpLog= */ true);
 }
 
 HF_WEAK_WRAP(bool, strcsequal, const void* s1, const void* s2) {
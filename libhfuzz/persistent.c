@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -17,6 +18,7 @@
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
 #include "libhfuzz/fetch.h"
 #include "libhfuzz/instrument.h"
 #include "libhfuzz/libhfuzz.h"
@@ -57,13 +59,56 @@ void HF_ITER(const uint8_t** buf_ptr, size_t* len_ptr) {
 }
 
 static void HonggfuzzRunOneInput(const uint8_t* buf, size_t len) {
+    instrumentRearmGuards();
     int ret = LLVMFuzzerTestOneInput(buf, len);
     if (ret != 0) {
         LOG_F("LLVMFuzzerTestOneInput() returned '%d' instead of '0'", ret);
     }
 }
 
+/*
+ * --persistent_batch: a round can contain many inputs. The new coverage is recorded separately for
+ * each of them, and hdr->done always points to the one being processed, in case it crashes
+ */
+static void HonggfuzzBatchLoop(batchHdr_t* hdr, persistentCtl_t* ctl) {
+    const pidFeedback_t* newCov = instrumentNewCov();
+    ATOMIC_SET(ctl->batchCapable, 1U);
+
+    for (;;) {
+        size_t len;
+        const uint8_t* buf;
+
+        HonggfuzzFetchData(&buf, &len);
+        size_t cnt = MIN(hdr->cnt, _HF_BATCH_MAX);
+        if (cnt == 0) {
+            HonggfuzzRunOneInput(buf, len);
+            continue;
+        }
+
+        for (size_t i = 0; i < cnt; i++) {
+            ATOMIC_SET(hdr->done, i);
+            uint64_t pc = ATOMIC_GET(newCov->pc);
+            uint64_t edge = ATOMIC_GET(newCov->edge);
+            uint64_t cmp = ATOMIC_GET(newCov->cmp);
+
+            HonggfuzzRunOneInput((const uint8_t*)hdr + hdr->off[i], hdr->len[i]);
+            instrumentMergeLocalCov();
+
+            hdr->cov[i].pc = ATOMIC_GET(newCov->pc) - pc;
+            hdr->cov[i].edge = ATOMIC_GET(newCov->edge) - edge;
+            hdr->cov[i].cmp = ATOMIC_GET(newCov->cmp) - cmp;
+        }
+        ATOMIC_SET(hdr->done, cnt);
+    }
+}
+
 static void HonggfuzzPersistentLoop(void) {
+    batchHdr_t* hdr = fetchGetBatch();
+    persistentCtl_t* ctl = instrumentPersistentCtl();
+    if (hdr && ctl) {
+        HonggfuzzBatchLoop(hdr, ctl);
+    }
+
     for (;;) {
         size_t len;
         const uint8_t* buf;
@@ -29,14 +29,18 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <locale.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
+#include <sys/epoll.h>
+#include <sys/param.h>
 #include <sys/personality.h>
 #include <sys/prctl.h>
+#include <sys/signalfd.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -52,13 +56,20 @@
 #include "libhfcommon/log.h"
 #include "libhfcommon/ns.h"
 #include "libhfcommon/util.h"
+#include "linux/cgroup.h"
 #include "linux/perf.h"
 #include "linux/trace.h"
 #include "sanitizers.h"
+#include "stats.h"
 #include "subproc.h"
 
 static uint8_t arch_clone_stack[128 * 1024] __attribute__((aligned(__BIGGEST_ALIGNMENT__)));
 static __thread jmp_buf env;
+/* --async_runs: the epoll of the fuzzing thread, which waits for the epolls of all of its runs */
+static __thread int arch_asyncFd = -1;
+/* CPUs available at startup, fuzzing threads get pinned to them with --linux_pin_cpus */
+static cpu_set_t arch_cpuSet;
+static size_t arch_cpuCnt = 0;
 
 HF_ATTR_NO_SANITIZE_ADDRESS
 HF_ATTR_NO_SANITIZE_MEMORY
@@ -97,11 +108,9 @@ pid_t arch_fork(run_t* run) {
     return pid;
 }
 
-bool arch_launchChild(run_t* run) {
-    if ((run->global->linux.cloneFlags & CLONE_NEWNET) && (nsIfaceUp("lo") == false)) {
-        LOG_W("Cannot bring interface 'lo' up");
-    }
+_Static_assert(_HF_NS_CNT == NS_CNT, "_HF_NS_CNT must match the nsCreate() array size");
 
+bool arch_launchChild(run_t* run) {
     /*
      * Make it attach-able by ptrace()
      */
@@ -110,18 +119,6 @@ bool arch_launchChild(run_t* run) {
         return false;
     }
 
-    /*
-     * Kill a process which corrupts its own heap (with ABRT)
-     */
-    if (setenv("MALLOC_CHECK_", "7", 0) == -1) {
-        PLOG_E("setenv(MALLOC_CHECK_=7) failed");
-        return false;
-    }
-    if (setenv("MALLOC_PERTURB_", "85", 0) == -1) {
-        PLOG_E("setenv(MALLOC_PERTURB_=85) failed");
-        return false;
-    }
-
     /* Increase our OOM score, so fuzzed processes die faster */
     static const char score100[] = "+500";
     if (!files_writeBufToFile(
@@ -139,28 +136,29 @@ bool arch_launchChild(run_t* run) {
         PLOG_D("personality(ADDR_NO_RANDOMIZE) failed");
     }
 
-#define ARGS_MAX 512
-    const char* args[ARGS_MAX + 2];
-    char argData[PATH_MAX];
-    const char inputFile[] = "/dev/fd/" HF_XSTR(_HF_INPUT_FD);
-
-    int x = 0;
-    for (x = 0; x < ARGS_MAX && x < run->global->exe.argc; x++) {
-        if (!strcmp(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER)) {
-            args[x] = inputFile;
-        } else if (strstr(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER)) {
-            const char* off = strstr(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER);
-            snprintf(argData, sizeof(argData), "%.*s%s", (int)(off - run->global->exe.cmdline[x]),
-                run->global->exe.cmdline[x], inputFile);
-            args[x] = argData;
-        } else {
-            args[x] = run->global->exe.cmdline[x];
+    /* Sanitizer reports go to stderr, i.e. to the pipe read by arch_traceSanDrain() */
+    if (run->linux.sanWrFd != -1 && dup2(run->linux.sanWrFd, STDERR_FILENO) == -1) {
+        PLOG_E("dup2(%d, STDERR_FILENO)", run->linux.sanWrFd);
+        return false;
+    }
+
+    if (!arch_cgroupChild(run)) {
+        return false;
+    }
+
+    /* Joined by netdriver, see netDriver_initNsIfNeeded() */
+    for (size_t i = 0; i < ARRAYSIZE(run->linux.nsFds); i++) {
+        if (run->linux.nsFds[i] != -1 && dup2(run->linux.nsFds[i], _HF_NS_FD + i) == -1) {
+            PLOG_E("dup2(%d, %zu)", run->linux.nsFds[i], (size_t)_HF_NS_FD + i);
+            return false;
         }
     }
-    args[x++] = NULL;
+
+    /* Built once by the thread, see subproc_initExec() */
+    const char* const* args = run->execArgs;
 
     LOG_D("Launching '%s' on file '%s'", args[0],
-        run->global->exe.persistent ? "PERSISTENT_MODE" : inputFile);
+        run->global->exe.persistent ? "PERSISTENT_MODE" : "/dev/fd/" HF_XSTR(_HF_INPUT_FD));
 
     /* alarms persist across execve(), so disable it here */
     alarm(0);
@@ -169,6 +167,9 @@ bool arch_launchChild(run_t* run) {
     if (kill(syscall(__NR_getpid), SIGSTOP) == -1) {
         LOG_F("Couldn't stop itself");
     }
+    if (!arch_perfKcovChild(run)) {
+        return false;
+    }
 #if defined(__NR_execveat)
     syscall(__NR_execveat, run->global->linux.exeFd, "", args, environ, AT_EMPTY_PATH);
 #endif /* defined__NR_execveat) */
@@ -182,6 +183,18 @@ bool arch_launchChild(run_t* run) {
 }
 
 static bool arch_attachToNewPid(run_t* run) {
+    arch_traceInprocReset(run);
+    if (run->global->linux.inprocCrash) {
+        /* The process describes its own crashes, it only needs to be resumed */
+        if (!arch_traceWaitForPidStop(run->pid)) {
+            return false;
+        }
+        if (kill(run->pid, SIGCONT) == -1) {
+            PLOG_W("kill(pid=%d, SIGCONT)", (int)run->pid);
+            return false;
+        }
+        return true;
+    }
     if (!arch_traceAttach(run)) {
         LOG_W("arch_traceAttach(pid=%d) failed", run->pid);
         return false;
@@ -190,23 +203,47 @@ static bool arch_attachToNewPid(run_t* run) {
     return true;
 }
 
+static void arch_epollAdd(run_t* run, int fd, uint32_t events) {
+    struct epoll_event ev = {
+        .events = events,
+        .data.fd = fd,
+    };
+    if (epoll_ctl(run->linux.epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        PLOG_F("epoll_ctl(epfd=%d, EPOLL_CTL_ADD, fd=%d)", run->linux.epollFd, fd);
+    }
+}
+
+static void arch_pidFdOpen(run_t* run) {
+    if (run->linux.pidFd != -1) {
+        close(run->linux.pidFd);
+        run->linux.pidFd = -1;
+    }
+#if defined(__NR_pidfd_open)
+    /*
+     * The pidfd becomes readable when the process exits. It's a one-shot event, as a zombie which
+     * is still traced might not be reapable immediately. Older kernels rely on SIGCHLD only
+     */
+    run->linux.pidFd = syscall(__NR_pidfd_open, run->pid, 0);
+    if (run->linux.pidFd == -1) {
+        PLOG_D("pidfd_open(pid=%d)", (int)run->pid);
+        return;
+    }
+    if (fcntl(run->linux.pidFd, F_SETFD, FD_CLOEXEC) == -1) {
+        PLOG_W("fcntl(%d, F_SETFD, FD_CLOEXEC)", run->linux.pidFd);
+    }
+    arch_epollAdd(run, run->linux.pidFd, EPOLLIN | EPOLLONESHOT);
+#endif /* defined(__NR_pidfd_open) */
+}
+
 void arch_prepareParentAfterFork(run_t* run) {
     /* Parent */
     if (run->global->exe.persistent) {
-        const struct f_owner_ex fown = {
-            .type = F_OWNER_TID,
-            .pid = syscall(__NR_gettid),
-        };
-        if (fcntl(run->persistentSock, F_SETOWN_EX, &fown)) {
-            PLOG_F("fcntl(%d, F_SETOWN_EX)", run->persistentSock);
-        }
-        if (fcntl(run->persistentSock, F_SETSIG, SIGIO) == -1) {
-            PLOG_F("fcntl(%d, F_SETSIG, SIGIO)", run->persistentSock);
-        }
-        if (fcntl(run->persistentSock, F_SETFL, O_ASYNC) == -1) {
-            PLOG_F("fcntl(%d, F_SETFL, O_ASYNC)", run->persistentSock);
-        }
+        /* A new socket is created for every process, closing the old one removes it from epoll */
+        arch_epollAdd(run, run->persistentSock, EPOLLIN);
     }
+    arch_pidFdOpen(run);
+    /* Whatever is left in the pipe came from the previous process */
+    arch_traceSanReset(run);
 
     arch_perfClose(run);
     if (!arch_perfOpen(run)) {
@@ -218,12 +255,21 @@ void arch_prepareParentAfterFork(run_t* run) {
 }
 
 void arch_prepareParent(run_t* run) {
+    run->linux.reapPid = run->pid;
     if (!arch_perfEnable(run)) {
         LOG_F("Couldn't enable perf counters for pid=%d", (int)run->pid);
     }
 }
 
-static bool arch_checkWait(run_t* run) {
+/*
+ * Returns true if run->pid is gone. 'workerExited' is set if it was the snapshot worker which
+ * exited, which ends the current round, as the template will fork a fresh worker
+ */
+static bool arch_checkWait(run_t* run, bool* workerExited) {
+    if (run->linux.reaped) {
+        run->linux.reaped = false;
+        return true;
+    }
     /* All queued wait events must be tested when SIGCHLD was delivered */
     for (;;) {
         int status;
@@ -243,65 +289,189 @@ static bool arch_checkWait(run_t* run) {
         LOG_D("pid=%d returned with status: %s", pid,
             subproc_StatusToStr(status, statusStr, sizeof(statusStr)));
 
-        arch_traceAnalyze(run, status, pid);
+        /* With --async_runs, processes of all runs of the thread are reaped here */
+        run_t* owner = run;
+        for (size_t i = 0; i < run->asyncCnt; i++) {
+            if (run->asyncRuns[i].pid == pid) {
+                owner = &run->asyncRuns[i];
+                break;
+            }
+        }
+        arch_traceAnalyze(owner, status, pid);
+        /* The OOM killer of the run's cgroup (--linux_cgroup_mem) sends SIGKILL */
+        if (pid == owner->pid && WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL &&
+            arch_cgroupOomKilled(owner)) {
+            arch_traceOomAnalyze(owner, pid);
+        }
 
-        if (pid == run->pid && (WIFEXITED(status) || WIFSIGNALED(status))) {
-            if (run->global->exe.persistent) {
+        if (run->snapshotPid && pid == run->snapshotPid &&
+            (WIFEXITED(status) || WIFSIGNALED(status))) {
+            LOG_D("Snapshot worker pid=%d exited with status: %s", (int)pid,
+                subproc_StatusToStr(status, statusStr, sizeof(statusStr)));
+            run->snapshotPid = 0;
+            run->runState = _HF_RS_WAITING_FOR_INITIAL_READY;
+            *workerExited = true;
+        }
+        if (pid == owner->pid && (WIFEXITED(status) || WIFSIGNALED(status))) {
+            if (owner->global->exe.persistent) {
                 if (!fuzz_isTerminating()) {
-                    LOG_W("Persistent mode: pid=%d exited with status: %s", (int)run->pid,
+                    LOG_W("Persistent mode: pid=%d exited with status: %s", (int)owner->pid,
                         subproc_StatusToStr(status, statusStr, sizeof(statusStr)));
                 }
             }
-            return true;
+            if (owner == run) {
+                return true;
+            }
+            /* The other run finds out with its next arch_reapPoll() */
+            owner->linux.reaped = true;
         }
     }
 }
 
-void arch_reapChild(run_t* run) {
-    for (;;) {
-        if (subproc_persistentModeStateMachine(run)) {
-            break;
+/* How long to wait for events: until the next time limit check is due, or forever */
+static int arch_reapTimeoutMillis(run_t* run) {
+    /* The target is driven by the external fuzzer, only pick up what has happened so far */
+    if (run->global->socketFuzzer.enabled) {
+        return run->global->socketFuzzer.binary ? 0 : 250;
+    }
+    int64_t deadline = subproc_timeLimitDeadline(run);
+    if (!deadline) {
+        return -1;
+    }
+    int64_t diff = deadline - util_timeNowMillis() + 1;
+    /* Past the deadline already, the process has been signaled, don't spin until it dies */
+    if (diff <= 0) {
+        return 10;
+    }
+    return (int)MIN(diff, INT32_MAX);
+}
+
+static void arch_reapWaitForEvents(run_t* run, int timeoutMillis) {
+    struct epoll_event evs[4];
+    int nfds = epoll_wait(run->linux.epollFd, evs, ARRAYSIZE(evs), timeoutMillis);
+    if (nfds == -1 && errno != EINTR) {
+        PLOG_F("epoll_wait(epfd=%d)", run->linux.epollFd);
+    }
+    for (int i = 0; i < nfds; i++) {
+        if (evs[i].data.fd == run->linux.sigFd) {
+            /* SIGCHLD: ptrace events, or a ping from the main/signal thread */
+            struct signalfd_siginfo si[8];
+            while (read(run->linux.sigFd, si, sizeof(si)) > 0) {
+            }
+        }
+        if (evs[i].data.fd == run->linux.sanFd) {
+            arch_traceSanDrain(run);
+        }
+        /*
+         * With the shared memory handshake the tags only wake the thread up, and they can arrive
+         * late, e.g. between the runs. The socket is level-triggered, so a tag which is left in it
+         * makes this epoll (and the one of --async_runs, which watches it) return at once, forever
+         */
+        if (evs[i].data.fd == run->persistentSock && run->persistentShm &&
+            run->runState != _HF_RS_WAITING_FOR_INITIAL_READY) {
+            subproc_persistentDrainTags(run);
         }
+    }
+}
 
-        subproc_checkTimeLimit(run);
-        subproc_checkTermination(run);
+/* Processes the events of the run (waiting for them if 'block' is set), true if the run is over */
+static bool arch_reapStep(run_t* run, bool block) {
+    if (subproc_persistentModeStateMachine(run)) {
+        return true;
+    }
 
-        const struct timespec ts = {
-            .tv_sec = 0ULL,
-            .tv_nsec = (1000ULL * 1000ULL * 250ULL),
-        };
-        /* Return with SIGIO, SIGCHLD */
-        int sig = sigtimedwait(&run->global->exe.waitSigSet, NULL, &ts /* 0.25s */);
-        if (sig == -1 && (errno != EAGAIN && errno != EINTR)) {
-            PLOG_F("sigwaitinfo(SIGIO|SIGCHLD)");
-        }
+    subproc_checkTimeLimit(run);
+    subproc_checkTermination(run);
 
-        if (arch_checkWait(run)) {
-            run->pid = 0;
-            break;
-        }
-        if (run->global->socketFuzzer.enabled) {
-            // Do not wait for new events
-            break;
+    /* Return on persistent socket data, the process' exit, SIGCHLD or the time limit */
+    arch_reapWaitForEvents(run, block ? arch_reapTimeoutMillis(run) : 0);
+
+    bool workerExited = false;
+    if (arch_checkWait(run, &workerExited)) {
+        run->pid = 0;
+        run->snapshotPid = 0;
+        if (run->linux.pidFd != -1) {
+            close(run->linux.pidFd);
+            run->linux.pidFd = -1;
         }
+        return true;
+    }
+    if (workerExited) {
+        return true;
+    }
+    if (run->global->socketFuzzer.enabled) {
+        // Do not wait for new events
+        return true;
     }
+    return false;
+}
+
+static void arch_reapFinish(run_t* run) {
     if (run->global->sanitizer.enable) {
-        char crashReport[PATH_MAX];
-        snprintf(crashReport, sizeof(crashReport), "%s/%s.%d", run->global->io.workDir, kLOGPREFIX,
-            run->pid);
-        if (files_exists(crashReport)) {
-            if (run->backtrace) {
-                unlink(crashReport);
-            } else {
-                LOG_W("Un-handled ASan report due to compiler-rt internal error - retry with '%s'",
-                    crashReport);
-                /* Try to parse report file */
-                arch_traceExitAnalyze(run, run->pid);
+        /* A report which wasn't consumed by arch_traceExitAnalyze() on PTRACE_EVENT_EXIT */
+        arch_traceSanDrain(run);
+        if (run->linux.sanReportOff != -1) {
+            if (!run->backtrace) {
+                LOG_W("Un-handled ASan report due to compiler-rt internal error - retrying");
+                arch_traceExitAnalyze(run, run->linux.reapPid);
             }
+            arch_traceSanReset(run);
         }
     }
 
+    uint64_t started = stats_start();
     arch_perfAnalyze(run);
+    stats_record(run, STATS_PHASE_ANALYZE, started);
+}
+
+void arch_reapChild(run_t* run) {
+    while (!arch_reapStep(run, /* block= */ true)) {
+    }
+    arch_reapFinish(run);
+}
+
+bool arch_reapPoll(run_t* run) {
+    if (!arch_reapStep(run, /* block= */ false)) {
+        return false;
+    }
+    arch_reapFinish(run);
+    return true;
+}
+
+bool arch_asyncInit(run_t* runs, size_t cnt) {
+    if ((arch_asyncFd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        PLOG_E("epoll_create1(EPOLL_CLOEXEC)");
+        return false;
+    }
+    /* An epoll is readable when any of the fds which it watches has events */
+    for (size_t i = 0; i < cnt; i++) {
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.ptr = &runs[i],
+        };
+        if (epoll_ctl(arch_asyncFd, EPOLL_CTL_ADD, runs[i].linux.epollFd, &ev) == -1) {
+            PLOG_E("epoll_ctl(epfd=%d, EPOLL_CTL_ADD, fd=%d)", arch_asyncFd,
+                runs[i].linux.epollFd);
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t arch_asyncWait(run_t* ready[], size_t readyMax, int timeoutMillis) {
+    struct epoll_event evs[64];
+    int nfds = epoll_wait(arch_asyncFd, evs, (int)MIN(readyMax, ARRAYSIZE(evs)), timeoutMillis);
+    if (nfds == -1 && errno != EINTR) {
+        PLOG_F("epoll_wait(epfd=%d)", arch_asyncFd);
+    }
+    for (int i = 0; i < nfds; i++) {
+        ready[i] = (run_t*)evs[i].data.ptr;
+    }
+    return (nfds > 0) ? (size_t)nfds : 0;
+}
+
+void arch_asyncDrain(run_t* run) {
+    arch_reapWaitForEvents(run, 0);
 }
 
 bool arch_archInit(honggfuzz_t* hfuzz) {
@@ -343,6 +513,19 @@ bool arch_archInit(honggfuzz_t* hfuzz) {
         break;
     }
 
+    if (hfuzz->linux.pinCpus) {
+        CPU_ZERO(&arch_cpuSet);
+        if (sched_getaffinity(0, sizeof(arch_cpuSet), &arch_cpuSet) == -1) {
+            PLOG_E("sched_getaffinity()");
+            return false;
+        }
+        arch_cpuCnt = CPU_COUNT(&arch_cpuSet);
+        if (hfuzz->threads.threadsMax > arch_cpuCnt) {
+            LOG_W("More fuzzing threads (%zu) than available CPUs (%zu), some will share CPUs",
+                hfuzz->threads.threadsMax, arch_cpuCnt);
+        }
+    }
+
     if (hfuzz->feedback.dynFileMethod != _HF_DYNFILE_NONE) {
         unsigned long major = 0, minor = 0;
         char* p = NULL;
@@ -406,6 +589,14 @@ bool arch_archInit(honggfuzz_t* hfuzz) {
 
     /* Updates the important signal array based on input args */
     arch_traceSignalsInit(hfuzz);
+    if (!arch_traceTriageInit(hfuzz)) {
+        return false;
+    }
+    if (hfuzz->linux.inprocCrash && (!hfuzz->exe.persistent || hfuzz->exe.forkServer)) {
+        LOG_W("--linux_inprocess_crash needs persistent binaries (without --forkserver), crashes "
+              "will be analyzed with ptrace()");
+        hfuzz->linux.inprocCrash = false;
+    }
 
     /*
      * If sanitizer fuzzing enabled and SIGABRT is monitored (abort_on_error=1),
@@ -420,16 +611,100 @@ bool arch_archInit(honggfuzz_t* hfuzz) {
         LOG_E("unshare(%tx)", hfuzz->linux.cloneFlags);
         return false;
     }
+    if (!arch_cgroupInit(hfuzz)) {
+        return false;
+    }
+
+    /* All children share this NET namespace, so 'lo' stays up for them */
+    if ((hfuzz->linux.cloneFlags & CLONE_NEWNET) && !nsIfaceUp("lo")) {
+        LOG_W("Cannot bring interface 'lo' up");
+    }
 
     return true;
 }
 
+/*
+ * Pins the fuzzing thread, and so its children, to a single CPU. Memory which is touched first
+ * afterwards (the input mapping, the perf AUX buffers) gets allocated on that CPU's NUMA node
+ */
+static void arch_pinThread(run_t* run) {
+    size_t idx = run->fuzzNo % arch_cpuCnt;
+    int cpu = 0;
+    for (size_t i = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &arch_cpuSet)) {
+            continue;
+        }
+        if (i++ == idx) {
+            break;
+        }
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        PLOG_W("sched_setaffinity(cpu=%d)", cpu);
+        return;
+    }
+    LOG_D("Fuzzing thread #%" PRIu32 " pinned to CPU #%d", run->fuzzNo, cpu);
+}
+
 bool arch_archThreadInit(run_t* run) {
+    /* Runs of a thread other than its first one (--async_runs) have numbers >= threadsMax */
+    if (run->global->linux.pinCpus && arch_cpuCnt > 0 &&
+        run->fuzzNo < run->global->threads.threadsMax) {
+        arch_pinThread(run);
+    }
+
     run->linux.perfMmapBuf = NULL;
     run->linux.perfMmapAux = NULL;
+    run->linux.ptDecoder = NULL;
     run->linux.cpuInstrFd = -1;
     run->linux.cpuBranchFd = -1;
     run->linux.cpuIptBtsFd = -1;
+    run->linux.cpuCntGroup = false;
+    run->linux.pidFd = -1;
+    run->linux.reapPid = 0;
+    run->linux.reaped = false;
+    for (size_t i = 0; i < ARRAYSIZE(run->linux.nsFds); i++) {
+        run->linux.nsFds[i] = -1;
+    }
+    /*
+     * netdriver targets would create their own namespaces on every start otherwise. These ones are
+     * reused by all processes of the run, as nothing keeps them busy once a process is gone
+     */
+    if (run->global->exe.netDriver && !run->global->linux.nsFresh &&
+        !nsCreate(CLONE_NEWUSER | CLONE_NEWNET | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWUTS,
+            run->linux.nsFds)) {
+        LOG_W("Couldn't create namespaces for netdriver, its processes will create their own");
+    }
+    if (!arch_perfKcovOpen(run)) {
+        return false;
+    }
+    if (!arch_cgroupThreadInit(run)) {
+        return false;
+    }
+
+    if ((run->linux.epollFd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        PLOG_E("epoll_create1(EPOLL_CLOEXEC)");
+        return false;
+    }
+    /* SIGCHLD is blocked in all fuzzing threads, see setupSignalsPreThreads() */
+    sigset_t ss;
+    sigemptyset(&ss);
+    sigaddset(&ss, SIGCHLD);
+    if ((run->linux.sigFd = signalfd(-1, &ss, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+        PLOG_E("signalfd(SIGCHLD)");
+        return false;
+    }
+    arch_epollAdd(run, run->linux.sigFd, EPOLLIN);
+
+    if (!arch_traceSanInit(run)) {
+        return false;
+    }
+    if (run->linux.sanFd != -1) {
+        arch_epollAdd(run, run->linux.sanFd, EPOLLIN);
+    }
 
     if (prctl(PR_SET_CHILD_SUBREAPER, 1UL, 0UL, 0UL, 0UL) == -1) {
         PLOG_W("prctl(PR_SET_CHILD_SUBREAPER, 1)");
@@ -32,6 +32,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "honggfuzz.h"
@@ -40,12 +42,6 @@
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
 
-typedef struct {
-    bfd* bfdh;
-    asection* section;
-    asymbol** syms;
-} bfd_t;
-
 /*
  * This is probably the only define which was added with binutils 2.29, so we us
  * it, do decide which disassembler() prototype from dis-asm.h to use
@@ -54,83 +50,286 @@ typedef struct {
 #define _HF_BFD_GE_2_29
 #endif
 
+/*
+ * Binaries (the fuzzed one and its DSOs) are opened by libbfd once and stay in the cache, keyed by
+ * the device, inode and mtime of the file, so a rebuilt binary gets a new entry. Entries are never
+ * modified after being published, so that looking up the function symbols (sorted by address)
+ * needs no locking. Only libbfd itself (line numbers, disassembly) still requires arch_bfd_mutex
+ */
+typedef struct {
+    bfd_vma addr;
+    const char* name;
+} bfdSym_t;
+
+typedef struct {
+    bfd_vma vma;
+    bfd_size_type size;
+    file_ptr filepos;
+    asection* section;
+} bfdSection_t;
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    bfd* bfdh;
+    asymbol** syms;
+    bfdSym_t* funcs;
+    size_t funcsCnt;
+    bfdSection_t* sections;
+    size_t sectionsCnt;
+    /* Position-independent (PIE or DSO), its addresses are relative to the load address */
+    bool isDyn;
+    bool hasLines;
+    disassembler_ftype disassemble;
+} bfdBinary_t;
+
+#define _HF_BFD_CACHE_MAX 1024
+
+static bfdBinary_t* arch_bfdCache[_HF_BFD_CACHE_MAX];
+static size_t arch_bfdCacheCnt = 0;
+
 static pthread_mutex_t arch_bfd_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static bool arch_bfdInit(pid_t pid, bfd_t* bfdParams) {
-    char fname[PATH_MAX];
-    snprintf(fname, sizeof(fname), "/proc/%d/exe", pid);
-    if ((bfdParams->bfdh = bfd_openr(fname, 0)) == NULL) {
-        LOG_E("bfd_openr(%s) failed", fname);
-        return false;
+static int arch_bfdSymCmp(const void* a, const void* b) {
+    const bfdSym_t* sa = (const bfdSym_t*)a;
+    const bfdSym_t* sb = (const bfdSym_t*)b;
+    if (sa->addr == sb->addr) {
+        return 0;
     }
+    return sa->addr < sb->addr ? -1 : 1;
+}
 
-    if (!bfd_check_format(bfdParams->bfdh, bfd_object)) {
-        LOG_E("bfd_check_format() failed");
-        return false;
+static asymbol** arch_bfdReadSyms(bfd* bfdh, long* cnt) {
+    /* Stripped DSOs still have their dynamic symbols */
+    bool dynamic = false;
+    long storage_needed = bfd_get_symtab_upper_bound(bfdh);
+    if (storage_needed <= (long)sizeof(asymbol*)) {
+        dynamic = true;
+        storage_needed = bfd_get_dynamic_symtab_upper_bound(bfdh);
     }
-
-    int storage_needed = bfd_get_symtab_upper_bound(bfdParams->bfdh);
     if (storage_needed <= 0) {
-        LOG_E("bfd_get_symtab_upper_bound() returned '%d'", storage_needed);
-        return false;
+        LOG_D("'%s' has no symbols", bfd_get_filename(bfdh));
+        *cnt = 0;
+        return NULL;
     }
 
-    bfdParams->syms = (asymbol**)util_Malloc(storage_needed);
-    bfd_canonicalize_symtab(bfdParams->bfdh, bfdParams->syms);
+    asymbol** syms = (asymbol**)util_Malloc(storage_needed);
+    *cnt = dynamic ? bfd_canonicalize_dynamic_symtab(bfdh, syms)
+                   : bfd_canonicalize_symtab(bfdh, syms);
+    if (*cnt < 0) {
+        *cnt = 0;
+    }
+    return syms;
+}
 
-    if ((bfdParams->section = bfd_get_section_by_name(bfdParams->bfdh, ".text")) == NULL) {
-        LOG_E("bfd_get_section_by_name('.text') failed");
-        return false;
+static bfdBinary_t* arch_bfdLoad(const char* fname, const struct stat* st) {
+    bfd* bfdh = bfd_openr(fname, NULL);
+    if (bfdh == NULL) {
+        LOG_E("bfd_openr(%s) failed", fname);
+        return NULL;
+    }
+    if (!bfd_check_format(bfdh, bfd_object)) {
+        LOG_E("bfd_check_format('%s') failed", fname);
+        bfd_close(bfdh);
+        return NULL;
     }
 
-    return true;
-}
+    bfdBinary_t* bin = (bfdBinary_t*)util_Calloc(sizeof(bfdBinary_t));
+    bin->dev = st->st_dev;
+    bin->ino = st->st_ino;
+    bin->mtime = st->st_mtim;
+    bin->bfdh = bfdh;
+    bin->isDyn = (bfd_get_file_flags(bfdh) & DYNAMIC) != 0;
 
-static void arch_bfdDestroy(bfd_t* bfdParams) {
-    if (bfdParams->syms) {
-        free(bfdParams->syms);
+    long symsCnt = 0;
+    bin->syms = arch_bfdReadSyms(bfdh, &symsCnt);
+    bin->funcs = (bfdSym_t*)util_Malloc(sizeof(bfdSym_t) * (symsCnt + 1));
+    for (long i = 0; i < symsCnt; i++) {
+        asymbol* sym = bin->syms[i];
+        if (!(sym->flags & BSF_FUNCTION) || sym->section == NULL ||
+            !(sym->section->flags & SEC_CODE)) {
+            continue;
+        }
+        bin->funcs[bin->funcsCnt].addr = bfd_asymbol_value(sym);
+        bin->funcs[bin->funcsCnt].name = bfd_asymbol_name(sym);
+        bin->funcsCnt++;
     }
-    if (bfdParams->bfdh) {
-        bfd_close(bfdParams->bfdh);
+    qsort(bin->funcs, bin->funcsCnt, sizeof(bfdSym_t), arch_bfdSymCmp);
+
+    for (asection* section = bfdh->sections; section; section = section->next) {
+        if (section->flags & SEC_CODE) {
+            bin->sectionsCnt++;
+        }
+        if (strcmp(section->name, ".debug_line") == 0) {
+            bin->hasLines = true;
+        }
     }
+    bin->sections = (bfdSection_t*)util_Malloc(sizeof(bfdSection_t) * (bin->sectionsCnt + 1));
+    size_t idx = 0;
+    for (asection* section = bfdh->sections; section; section = section->next) {
+        if (section->flags & SEC_CODE) {
+            bin->sections[idx++] = (bfdSection_t){
+                .vma = section->vma,
+                .size = section->size,
+                .filepos = section->filepos,
+                .section = section,
+            };
+        }
+    }
+
+#if defined(_HF_BFD_GE_2_29)
+    bin->disassemble =
+        disassembler(bfd_get_arch(bfdh), bfd_little_endian(bfdh) ? FALSE : TRUE, 0, NULL);
+#else
+    bin->disassemble = disassembler(bfdh);
+#endif  // defined(_HD_BFD_GE_2_29)
+
+    LOG_D("Loaded '%s': %zu function symbols, %zu code sections, line info: %s", fname,
+        bin->funcsCnt, bin->sectionsCnt, bin->hasLines ? "yes" : "no");
+    return bin;
 }
 
-void arch_bfdResolveSyms(pid_t pid, funcs_t* funcs, size_t num) {
-    /* Guess what? libbfd is not multi-threading safe */
+/* Returns the cached binary, loading it if it's not in the cache yet */
+static bfdBinary_t* arch_bfdGet(const char* fname) {
+    struct stat st;
+    if (stat(fname, &st) == -1) {
+        PLOG_D("stat('%s')", fname);
+        return NULL;
+    }
+
+    size_t cnt = ATOMIC_GET_ACQUIRE(arch_bfdCacheCnt);
+    for (size_t i = 0; i < cnt; i++) {
+        bfdBinary_t* bin = arch_bfdCache[i];
+        if (bin->ino == st.st_ino && bin->dev == st.st_dev &&
+            bin->mtime.tv_sec == st.st_mtim.tv_sec && bin->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            return bin;
+        }
+    }
+
     MX_SCOPED_LOCK(&arch_bfd_mutex);
+    /* Could have been loaded by another thread in the meantime */
+    for (size_t i = cnt; i < arch_bfdCacheCnt; i++) {
+        bfdBinary_t* bin = arch_bfdCache[i];
+        if (bin->ino == st.st_ino && bin->dev == st.st_dev &&
+            bin->mtime.tv_sec == st.st_mtim.tv_sec && bin->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            return bin;
+        }
+    }
+    if (arch_bfdCacheCnt == _HF_BFD_CACHE_MAX) {
+        LOG_W("The cache of binaries is full (%d entries), not symbolizing '%s'",
+            _HF_BFD_CACHE_MAX, fname);
+        return NULL;
+    }
 
     bfd_init();
+    bfdBinary_t* bin = arch_bfdLoad(fname, &st);
+    if (bin == NULL) {
+        return NULL;
+    }
+    arch_bfdCache[arch_bfdCacheCnt] = bin;
+    ATOMIC_SET_RELEASE(arch_bfdCacheCnt, arch_bfdCacheCnt + 1);
 
-    __block bfd_t bfdParams = {
-        .bfdh = NULL,
-        .section = NULL,
-        .syms = NULL,
-    };
+    return bin;
+}
+
+/* Finds the code section and the address (vma) in the binary which correspond to the frame */
+static const bfdSection_t* arch_bfdFindSection(
+    const bfdBinary_t* bin, const funcs_t* func, bfd_vma* vma) {
+    for (size_t i = 0; i < bin->sectionsCnt; i++) {
+        const bfdSection_t* s = &bin->sections[i];
+        if (func->mapOff) {
+            /* The file offset is independent of the load address */
+            if ((file_ptr)func->mapOff >= s->filepos &&
+                (file_ptr)func->mapOff < (file_ptr)(s->filepos + s->size)) {
+                *vma = s->vma + ((file_ptr)func->mapOff - s->filepos);
+                return s;
+            }
+        } else if (!bin->isDyn) {
+            bfd_vma pc = (bfd_vma)(uintptr_t)func->pc;
+            if (pc >= s->vma && pc < s->vma + s->size) {
+                *vma = pc;
+                return s;
+            }
+        }
+    }
+    return NULL;
+}
+
+static const char* arch_bfdFindFunc(const bfdBinary_t* bin, bfd_vma vma) {
+    if (bin->funcsCnt == 0 || vma < bin->funcs[0].addr) {
+        return NULL;
+    }
+    size_t lo = 0, hi = bin->funcsCnt;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (bin->funcs[mid].addr <= vma) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return bin->funcs[lo].name;
+}
 
-    if (arch_bfdInit(pid, &bfdParams) == false) {
+static void arch_bfdResolveFunc(bfdBinary_t* bin, funcs_t* func) {
+    bfd_vma vma;
+    const bfdSection_t* s = arch_bfdFindSection(bin, func, &vma);
+    if (s == NULL) {
         return;
     }
 
-    const char* func;
-    const char* file;
-    unsigned int line;
-    for (unsigned int i = 0; i < num; i++) {
+    if (bin->hasLines) {
+        /* libbfd parses (and caches) DWARF on demand, that's not multi-threading safe */
+        MX_SCOPED_LOCK(&arch_bfd_mutex);
+        const char* file;
+        const char* fn;
+        unsigned int line;
+        if (bfd_find_nearest_line(
+                bin->bfdh, s->section, bin->syms, vma - s->vma, &file, &fn, &line) &&
+            fn) {
+            snprintf(func->func, sizeof(func->func), "%s", fn);
+            func->line = line;
+            return;
+        }
+    }
+
+    const char* fn = arch_bfdFindFunc(bin, vma);
+    if (fn) {
+        snprintf(func->func, sizeof(func->func), "%s", fn);
+    }
+}
+
+static void arch_bfdResolve(const char* exe, funcs_t* funcs, size_t num) {
+    bfdBinary_t* exeBin = NULL;
+    for (size_t i = 0; i < num; i++) {
         snprintf(funcs[i].func, sizeof(funcs->func), "[UNKNOWN]");
         if (funcs[i].pc == NULL) {
             continue;
         }
-        long offset = (long)funcs[i].pc - bfdParams.section->vma;
-        if ((offset < 0 || (unsigned long)offset > bfdParams.section->size)) {
-            continue;
+        bfdBinary_t* bin;
+        if (funcs[i].mapOff && funcs[i].mapName[0] == '/') {
+            bin = arch_bfdGet(funcs[i].mapName);
+        } else {
+            if (exeBin == NULL) {
+                exeBin = arch_bfdGet(exe);
+            }
+            bin = exeBin;
         }
-        if (bfd_find_nearest_line(
-                bfdParams.bfdh, bfdParams.section, bfdParams.syms, offset, &file, &func, &line)) {
-            snprintf(funcs[i].func, sizeof(funcs->func), "%s", func);
-            funcs[i].line = line;
+        if (bin) {
+            arch_bfdResolveFunc(bin, &funcs[i]);
         }
     }
+}
 
-    arch_bfdDestroy(&bfdParams);
+void arch_bfdResolveSyms(pid_t pid, funcs_t* funcs, size_t num) {
+    char fname[PATH_MAX];
+    snprintf(fname, sizeof(fname), "/proc/%d/exe", pid);
+    arch_bfdResolve(fname, funcs, num);
+}
+
+void arch_bfdResolveSymsFile(const char* fname, funcs_t* funcs, size_t num) {
+    arch_bfdResolve(fname, funcs, num);
 }
 
 static int arch_bfdFPrintF(void* buf, const char* fmt, ...) {
@@ -143,23 +342,154 @@ static int arch_bfdFPrintF(void* buf, const char* fmt, ...) {
 }
 
 void arch_bfdDisasm(pid_t pid, uint8_t* mem, size_t size, char* instr) {
+    char fname[PATH_MAX];
+    snprintf(fname, sizeof(fname), "/proc/%d/exe", pid);
+    arch_bfdDisasmFile(fname, mem, size, instr);
+}
+
+void arch_bfdDisasmFile(const char* fname, uint8_t* mem, size_t size, char* instr) {
+    bfdBinary_t* bin = arch_bfdGet(fname);
+    if (bin == NULL) {
+        LOG_W("Couldn't load '%s' for disassembly", fname);
+        return;
+    }
+    if (bin->disassemble == NULL) {
+        LOG_W("disassembler() failed");
+        return;
+    }
+
+    /* libopcodes keeps the state of the disassembler in static variables */
+    MX_SCOPED_LOCK(&arch_bfd_mutex);
+
+    struct disassemble_info info;
+    init_disassemble_info(&info, instr, arch_bfdFPrintF);
+    info.arch = bfd_get_arch(bin->bfdh);
+    info.mach = bfd_get_mach(bin->bfdh);
+    info.buffer = mem;
+    info.buffer_length = size;
+    info.section = NULL;
+    info.endian = bfd_little_endian(bin->bfdh) ? BFD_ENDIAN_LITTLE : BFD_ENDIAN_BIG;
+    disassemble_init_for_target(&info);
+
+    strcpy(instr, "");
+    if (bin->disassemble(0, &info) <= 0) {
+        snprintf(instr, _HF_INSTR_SZ, "[DIS-ASM_FAILURE]");
+    }
+}
+
+typedef struct {
+    char instr[_HF_INSTR_SZ];
+    uint64_t target;
+    bool hasTarget;
+} bfdInsn_t;
+
+static int arch_bfdInsnFPrintF(void* stream, const char* fmt, ...) {
+    bfdInsn_t* insn = (bfdInsn_t*)stream;
+    va_list args;
+    va_start(args, fmt);
+    int ret = util_vssnprintf(insn->instr, sizeof(insn->instr), fmt, args);
+    va_end(args);
+
+    return ret;
+}
+
+/* libopcodes passes targets of direct branches (and of RIP-relative operands) through here */
+static void arch_bfdInsnPrintAddr(bfd_vma addr, struct disassemble_info* info) {
+    bfdInsn_t* insn = (bfdInsn_t*)info->stream;
+    if (!insn->hasTarget) {
+        insn->target = (uint64_t)addr;
+        insn->hasTarget = true;
+    }
+    info->fprintf_func(info->stream, "%#" PRIx64, (uint64_t)addr);
+}
+
+/* Classifies the (AT&T syntax, x86) instruction, returns false if it's not a branch */
+static bool arch_bfdBranchType(const bfdInsn_t* insn, ptBranchType_t* type) {
+    static const char* const prefixes[] = {
+        "bnd", "notrack", "cs", "ds", "data16", "addr32", "rex", "rex.W"};
+
+    const char* mnem = insn->instr;
+    for (;;) {
+        while (*mnem == ' ') {
+            mnem++;
+        }
+        size_t len = strcspn(mnem, " ");
+        bool isPrefix = false;
+        for (size_t i = 0; i < ARRAYSIZE(prefixes); i++) {
+            if (strlen(prefixes[i]) == len && strncmp(mnem, prefixes[i], len) == 0) {
+                isPrefix = true;
+            }
+        }
+        if (!isPrefix) {
+            break;
+        }
+        mnem += len;
+    }
+    bool indirect = (strchr(mnem, '*') != NULL);
+
+    if (util_strStartsWith(mnem, "jmp")) {
+        *type = indirect ? PT_BR_INDIRECT : PT_BR_JMP;
+        return true;
+    }
+    if (util_strStartsWith(mnem, "call")) {
+        *type = indirect ? PT_BR_INDIRECT : PT_BR_CALL;
+        return true;
+    }
+    if (mnem[0] == 'j' || util_strStartsWith(mnem, "loop")) {
+        *type = PT_BR_COND;
+        return true;
+    }
+    static const char* const far[] = {"ret", "lret", "iret", "ljmp", "lcall", "syscall", "sysenter",
+        "sysexit", "sysret", "int"};
+    for (size_t i = 0; i < ARRAYSIZE(far); i++) {
+        if (util_strStartsWith(mnem, far[i])) {
+            *type = PT_BR_INDIRECT;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int arch_bfdBranchCmp(const void* a, const void* b) {
+    const ptBranch_t* ba = (const ptBranch_t*)a;
+    const ptBranch_t* bb = (const ptBranch_t*)b;
+    if (ba->addr == bb->addr) {
+        return 0;
+    }
+    return ba->addr < bb->addr ? -1 : 1;
+}
+
+bool arch_bfdPtCfg(const char* fname, uint64_t pieBase, ptCfg_t* cfg) {
     MX_SCOPED_LOCK(&arch_bfd_mutex);
 
     bfd_init();
 
-    char fname[PATH_MAX];
-    snprintf(fname, sizeof(fname), "/proc/%d/exe", pid);
     bfd* bfdh = bfd_openr(fname, NULL);
     if (bfdh == NULL) {
-        LOG_W("bfd_openr('/proc/%d/exe') failed", pid);
-        return;
+        LOG_E("bfd_openr('%s') failed", fname);
+        return false;
     }
+    defer {
+        bfd_close(bfdh);
+    };
 
     if (!bfd_check_format(bfdh, bfd_object)) {
-        LOG_W("bfd_check_format() failed");
-        bfd_close(bfdh);
-        return;
+        LOG_E("bfd_check_format('%s') failed", fname);
+        return false;
+    }
+    if (bfd_get_arch(bfdh) != bfd_arch_i386) {
+        LOG_E("'%s' is not an x86 binary", fname);
+        return false;
+    }
+    uint64_t bias = 0;
+    if (bfd_get_file_flags(bfdh) & DYNAMIC) {
+        if (pieBase == 0) {
+            LOG_E("'%s' is a PIE binary, its code address is not known with ASLR enabled", fname);
+            return false;
+        }
+        bias = pieBase;
     }
+
 #if defined(_HF_BFD_GE_2_29)
     disassembler_ftype disassemble =
         disassembler(bfd_get_arch(bfdh), bfd_little_endian(bfdh) ? FALSE : TRUE, 0, NULL);
@@ -167,25 +497,87 @@ void arch_bfdDisasm(pid_t pid, uint8_t* mem, size_t size, char* instr) {
     disassembler_ftype disassemble = disassembler(bfdh);
 #endif  // defined(_HD_BFD_GE_2_29)
     if (disassemble == NULL) {
-        LOG_W("disassembler() failed");
-        bfd_close(bfdh);
-        return;
+        LOG_E("disassembler() failed");
+        return false;
     }
 
-    struct disassemble_info info;
-    init_disassemble_info(&info, instr, arch_bfdFPrintF);
-    info.arch = bfd_get_arch(bfdh);
-    info.mach = bfd_get_mach(bfdh);
-    info.buffer = mem;
-    info.buffer_length = size;
-    info.section = NULL;
-    info.endian = bfd_little_endian(bfdh) ? BFD_ENDIAN_LITTLE : BFD_ENDIAN_BIG;
-    disassemble_init_for_target(&info);
+    size_t capacity = 0;
+    cfg->branches = NULL;
+    cfg->cnt = 0;
+    cfg->start = ~(0ULL);
+    cfg->end = 0;
 
-    strcpy(instr, "");
-    if (disassemble(0, &info) <= 0) {
-        snprintf(instr, _HF_INSTR_SZ, "[DIS-ASM_FAILURE]");
+    for (asection* section = bfdh->sections; section; section = section->next) {
+        if (!(section->flags & SEC_CODE) || !(section->flags & SEC_HAS_CONTENTS) ||
+            section->size == 0) {
+            continue;
+        }
+
+        uint8_t* mem = (uint8_t*)util_Malloc(section->size);
+        defer {
+            free(mem);
+        };
+        if (!bfd_get_section_contents(bfdh, section, mem, 0, section->size)) {
+            LOG_W("bfd_get_section_contents('%s') failed", section->name);
+            continue;
+        }
+
+        bfdInsn_t insn;
+        struct disassemble_info info;
+        init_disassemble_info(&info, &insn, arch_bfdInsnFPrintF);
+        info.arch = bfd_get_arch(bfdh);
+        info.mach = bfd_get_mach(bfdh);
+        info.buffer = mem;
+        info.buffer_vma = section->vma;
+        info.buffer_length = section->size;
+        info.section = section;
+        info.endian = bfd_little_endian(bfdh) ? BFD_ENDIAN_LITTLE : BFD_ENDIAN_BIG;
+        info.print_address_func = arch_bfdInsnPrintAddr;
+        disassemble_init_for_target(&info);
+
+        for (bfd_vma pc = section->vma; pc < (section->vma + section->size);) {
+            insn.instr[0] = '\0';
+            insn.hasTarget = false;
+            int len = disassemble(pc, &info);
+            if (len <= 0) {
+                pc++;
+                continue;
+            }
+
+            ptBranchType_t type;
+            if (arch_bfdBranchType(&insn, &type)) {
+                if (type != PT_BR_INDIRECT && !insn.hasTarget) {
+                    type = PT_BR_INDIRECT;
+                }
+                if (cfg->cnt == capacity) {
+                    capacity = capacity ? (capacity * 2) : 4096;
+                    cfg->branches =
+                        (ptBranch_t*)util_Realloc(cfg->branches, capacity * sizeof(ptBranch_t));
+                    if (cfg->branches == NULL) {
+                        LOG_F("Couldn't allocate memory for %zu branches", capacity);
+                    }
+                }
+                cfg->branches[cfg->cnt++] = (ptBranch_t){
+                    .addr = (uint64_t)pc + bias,
+                    .target = insn.target + bias,
+                    .len = (uint8_t)len,
+                    .type = (uint8_t)type,
+                };
+            }
+            pc += len;
+        }
+
+        cfg->start = MIN(cfg->start, (uint64_t)section->vma + bias);
+        cfg->end = MAX(cfg->end, (uint64_t)(section->vma + section->size) + bias);
     }
 
-    bfd_close(bfdh);
+    if (cfg->cnt == 0) {
+        LOG_E("No branch instructions found in '%s'", fname);
+        return false;
+    }
+    qsort(cfg->branches, cfg->cnt, sizeof(ptBranch_t), arch_bfdBranchCmp);
+    LOG_I("Disassembled '%s': %zu branch instructions in %#" PRIx64 "-%#" PRIx64, fname, cfg->cnt,
+        cfg->start, cfg->end);
+
+    return true;
 }
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <sys/types.h>
 
+#include "linux/pt.h"
 #include "linux/unwind.h"
 
 #define _HF_INSTR_SZ 64
@@ -38,5 +39,13 @@
 
 extern void arch_bfdResolveSyms(pid_t pid, funcs_t* funcs, size_t num);
 extern void arch_bfdDisasm(pid_t pid, uint8_t* mem, size_t size, char* instr);
+/* The same, but for the binary at 'fname', which can be used once the process is gone */
+extern void arch_bfdResolveSymsFile(const char* fname, funcs_t* funcs, size_t num);
+extern void arch_bfdDisasmFile(const char* fname, uint8_t* mem, size_t size, char* instr);
+/*
+ * Disassembles the code sections of the binary, and fills 'cfg' with its branch instructions. Code
+ * of PIE binaries is relocated to 'pieBase', if it's 0 such binaries are rejected
+ */
+extern bool arch_bfdPtCfg(const char* fname, uint64_t pieBase, ptCfg_t* cfg);
 
 #endif
@@ -0,0 +1,268 @@
+/*
+ *
+ * honggfuzz - architecture dependent code (LINUX/CGROUP)
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "cgroup.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+/* Mount points of the unified (v2) hierarchy, the latter one in the 'hybrid' setups */
+#define _HF_CGROUP_ROOT "/sys/fs/cgroup"
+#define _HF_CGROUP_ROOT_HYBRID "/sys/fs/cgroup/unified"
+
+/* --linux_cgroup_dir, or the cgroup which honggfuzz was started in */
+static char arch_cgroupDir[PATH_MAX];
+
+static bool arch_cgroupEnabled(honggfuzz_t* hfuzz) {
+    return (hfuzz->linux.cgroupMem || hfuzz->linux.cgroupCpu);
+}
+
+static void arch_cgroupLeaf(char* path, size_t len, uint32_t fuzzNo) {
+    snprintf(path, len, "%s/honggfuzz.%d.%" PRIu32, arch_cgroupDir, (int)getpid(), fuzzNo);
+}
+
+/* Not with files_writeBufToFile(), which would try to unlink the file if the write fails */
+static bool arch_cgroupWrite(const char* dir, const char* knob, const char* val) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, knob);
+    int fd = TEMP_FAILURE_RETRY(open(path, O_WRONLY | O_CLOEXEC));
+    if (fd == -1) {
+        PLOG_E("open('%s', O_WRONLY)", path);
+        return false;
+    }
+    defer {
+        close(fd);
+    };
+    if (!files_writeToFd(fd, (const uint8_t*)val, strlen(val))) {
+        PLOG_E("Couldn't write '%s' to '%s'", val, path);
+        return false;
+    }
+    return true;
+}
+
+static int arch_cgroupOpen(const char* dir, const char* knob, int flags) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, knob);
+    int fd = TEMP_FAILURE_RETRY(open(path, flags | O_CLOEXEC));
+    if (fd == -1) {
+        PLOG_E("open('%s')", path);
+    }
+    return fd;
+}
+
+/* The path of the cgroup of this process, from its '0::' (unified hierarchy) entry */
+static bool arch_cgroupSelf(char* path, size_t len) {
+    char buf[PATH_MAX + 64];
+    ssize_t sz = files_readFileToBufMax("/proc/self/cgroup", (uint8_t*)buf, sizeof(buf) - 1);
+    if (sz <= 0) {
+        LOG_E("Couldn't read '/proc/self/cgroup'");
+        return false;
+    }
+    buf[sz] = '\0';
+
+    char* entry = (strncmp(buf, "0::", 3) == 0) ? buf : strstr(buf, "\n0::");
+    if (entry == NULL) {
+        LOG_E("No cgroup v2 entry in '/proc/self/cgroup'");
+        return false;
+    }
+    entry += (entry == buf) ? 3 : 4;
+    char* nl = strchr(entry, '\n');
+    if (nl) {
+        *nl = '\0';
+    }
+    /* The root cgroup */
+    if (strcmp(entry, "/") == 0) {
+        entry[0] = '\0';
+    }
+    snprintf(path, len, "%s%s",
+        files_exists(_HF_CGROUP_ROOT "/cgroup.controllers") ? _HF_CGROUP_ROOT
+                                                             : _HF_CGROUP_ROOT_HYBRID,
+        entry);
+    return true;
+}
+
+bool arch_cgroupInit(honggfuzz_t* hfuzz) {
+    if (!arch_cgroupEnabled(hfuzz)) {
+        return true;
+    }
+
+    char self[PATH_MAX];
+    if (!arch_cgroupSelf(self, sizeof(self))) {
+        return false;
+    }
+    snprintf(arch_cgroupDir, sizeof(arch_cgroupDir), "%s",
+        hfuzz->linux.cgroupDir ? hfuzz->linux.cgroupDir : self);
+
+    /*
+     * A cgroup which has processes can't pass the controllers to its children (the 'no internal
+     * processes' rule), so if honggfuzz is in that dir, it moves itself into a leaf of its own
+     */
+    struct stat dirSt, selfSt;
+    if (stat(arch_cgroupDir, &dirSt) == -1) {
+        PLOG_E("stat('%s')", arch_cgroupDir);
+        return false;
+    }
+    if (stat(self, &selfSt) != -1 && dirSt.st_dev == selfSt.st_dev &&
+        dirSt.st_ino == selfSt.st_ino) {
+        char leaf[PATH_MAX];
+        snprintf(leaf, sizeof(leaf), "%s/honggfuzz.%d", arch_cgroupDir, (int)getpid());
+        if (mkdir(leaf, 0755) == -1 && errno != EEXIST) {
+            PLOG_E("mkdir('%s', 0755)", leaf);
+            return false;
+        }
+        if (!arch_cgroupWrite(leaf, "cgroup.procs", "0")) {
+            return false;
+        }
+    }
+
+    char ctrls[32] = {};
+    if (hfuzz->linux.cgroupMem) {
+        util_ssnprintf(ctrls, sizeof(ctrls), "+memory");
+    }
+    if (hfuzz->linux.cgroupCpu) {
+        util_ssnprintf(ctrls, sizeof(ctrls), "%s+cpu", ctrls[0] ? " " : "");
+    }
+    if (!arch_cgroupWrite(arch_cgroupDir, "cgroup.subtree_control", ctrls)) {
+        LOG_E("'%s' must be a cgroup v2 dir delegated to uid=%d, with the controllers ('%s') "
+              "listed in its cgroup.controllers",
+            arch_cgroupDir, (int)getuid(), ctrls);
+        return false;
+    }
+
+    LOG_I("Processes of each fuzzing thread are placed in cgroups '%s/honggfuzz.%d.*' "
+          "(memory.max: %" PRIu64 " MiB, cpu.weight: %" PRIu64 ")",
+        arch_cgroupDir, (int)getpid(), hfuzz->linux.cgroupMem, hfuzz->linux.cgroupCpu);
+    return true;
+}
+
+bool arch_cgroupThreadInit(run_t* run) {
+    run->linux.cgroupProcsFd = -1;
+    run->linux.cgroupEventsFd = -1;
+    run->linux.cgroupOomKills = 0;
+    if (!arch_cgroupEnabled(run->global)) {
+        return true;
+    }
+
+    char leaf[PATH_MAX];
+    arch_cgroupLeaf(leaf, sizeof(leaf), run->fuzzNo);
+    if (mkdir(leaf, 0755) == -1 && errno != EEXIST) {
+        PLOG_E("mkdir('%s', 0755)", leaf);
+        return false;
+    }
+
+    char val[32];
+    if (run->global->linux.cgroupMem) {
+        snprintf(val, sizeof(val), "%" PRIu64, run->global->linux.cgroupMem * 1024U * 1024U);
+        if (!arch_cgroupWrite(leaf, "memory.max", val)) {
+            return false;
+        }
+        /* Without it, the OOM killer would pick one process, and the others could linger on */
+        if (!arch_cgroupWrite(leaf, "memory.oom.group", "1")) {
+            return false;
+        }
+        /* Swapping out would only delay the OOM kill. There's no such knob without swap */
+        char swapMax[PATH_MAX];
+        snprintf(swapMax, sizeof(swapMax), "%s/memory.swap.max", leaf);
+        if (files_exists(swapMax) && !arch_cgroupWrite(leaf, "memory.swap.max", "0")) {
+            LOG_W("Couldn't disable swap for '%s'", leaf);
+        }
+        run->linux.cgroupEventsFd = arch_cgroupOpen(leaf, "memory.events", O_RDONLY);
+        if (run->linux.cgroupEventsFd == -1) {
+            return false;
+        }
+    }
+    if (run->global->linux.cgroupCpu) {
+        snprintf(val, sizeof(val), "%" PRIu64, run->global->linux.cgroupCpu);
+        if (!arch_cgroupWrite(leaf, "cpu.weight", val)) {
+            return false;
+        }
+    }
+
+    /* Kept open, so forked children only need a write() to move themselves */
+    if ((run->linux.cgroupProcsFd = arch_cgroupOpen(leaf, "cgroup.procs", O_WRONLY)) == -1) {
+        return false;
+    }
+    return true;
+}
+
+bool arch_cgroupChild(run_t* run) {
+    if (run->linux.cgroupProcsFd == -1) {
+        return true;
+    }
+    if (!files_writeToFd(run->linux.cgroupProcsFd, (const uint8_t*)"0", 1)) {
+        PLOG_E("Couldn't move pid=%d into its cgroup", (int)getpid());
+        return false;
+    }
+    return true;
+}
+
+bool arch_cgroupOomKilled(run_t* run) {
+    if (run->linux.cgroupEventsFd == -1) {
+        return false;
+    }
+    char buf[512];
+    ssize_t sz = files_readFromFdSeek(run->linux.cgroupEventsFd, (uint8_t*)buf, sizeof(buf) - 1, 0);
+    if (sz <= 0) {
+        LOG_W("Couldn't read memory.events of the cgroup of thread #%" PRIu32, run->fuzzNo);
+        return false;
+    }
+    buf[sz] = '\0';
+
+    /* It's never the first line, and it's not to be confused with 'oom_group_kill' */
+    static const char key[] = "\noom_kill ";
+    const char* p = strstr(buf, key);
+    if (p == NULL) {
+        return false;
+    }
+    uint64_t kills = strtoull(p + strlen(key), NULL, 10);
+    bool ret = (kills > run->linux.cgroupOomKills);
+    run->linux.cgroupOomKills = kills;
+    return ret;
+}
+
+void arch_cgroupClose(honggfuzz_t* hfuzz) {
+    if (!arch_cgroupEnabled(hfuzz)) {
+        return;
+    }
+    /* Run numbers, see fuzz_threadNew() */
+    size_t runsCnt = hfuzz->threads.threadsMax * MAX(hfuzz->threads.asyncRuns, 1);
+    for (size_t i = 0; i < runsCnt; i++) {
+        char leaf[PATH_MAX];
+        arch_cgroupLeaf(leaf, sizeof(leaf), (uint32_t)i);
+        if (rmdir(leaf) == -1 && errno != ENOENT) {
+            PLOG_D("rmdir('%s')", leaf);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+/*
+ *
+ * honggfuzz - architecture dependent code (LINUX/CGROUP)
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_LINUX_CGROUP_H_
+#define _HF_LINUX_CGROUP_H_
+
+#include "honggfuzz.h"
+
+/*
+ * --linux_cgroup_mem/--linux_cgroup_cpu: processes of every run are placed in a cgroup v2 leaf of
+ * its own, created in --linux_cgroup_dir, which limits their memory.max and sets their cpu.weight
+ */
+extern bool arch_cgroupInit(honggfuzz_t* hfuzz);
+extern bool arch_cgroupThreadInit(run_t* run);
+/* Called by the forked child, it moves itself into the leaf of its run */
+extern bool arch_cgroupChild(run_t* run);
+/* Returns true if the cgroup OOM killer has killed processes of the run since the previous call */
+extern bool arch_cgroupOomKilled(run_t* run);
+/* Removes the leaves, once their processes are gone */
+extern void arch_cgroupClose(honggfuzz_t* hfuzz);
+
+#endif
@@ -27,83 +27,308 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <linux/hw_breakpoint.h>
+#include <linux/kcov.h>
 #include <linux/perf_event.h>
 #include <linux/sysctl.h>
 #include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/personality.h>
 #include <sys/poll.h>
 #include <sys/ptrace.h>
+#include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
+#include "linux/bfd.h"
 #include "pt.h"
 
 #define _HF_PERF_MAP_SZ (1024 * 512)
-#define _HF_PERF_AUX_SZ (1024 * 1024)
 /* PERF_TYPE for Intel_PT/BTS -1 if none */
 static int32_t perfIntelPtPerfType = -1;
 static int32_t perfIntelBtsPerfType = -1;
+/* Set if the kernel refused to group the instruction and branch counters */
+static bool perfCntGroupUnsupported = false;
+/* PERF_EVENT_IOC_SET_FILTER address filters for Intel PT, NULL if none */
+static char* perfPtFilter = NULL;
+
+/* The KCOV buffer: the number of the PCs, followed by them */
+#define _HF_PERF_KCOV_WORDS (1024 * 256)
+
+/*
+ * Edges (of BTS and KCOV) of a run are first deduplicated in a small per-thread hash set (open
+ * addressing, the slots hold pos + 1), as loops repeat the same ones many times. Only the unique
+ * ones are then looked up in the shared map, and only the new ones cost a locked RMW operation
+ */
+#define _HF_PERF_EDGES_SET_BITS 14
+#define _HF_PERF_EDGES_SET_SZ (1U << _HF_PERF_EDGES_SET_BITS)
+/* The set is merged into the shared map (and cleared) when it's half full */
+#define _HF_PERF_EDGES_MAX (_HF_PERF_EDGES_SET_SZ / 2)
+/* How many edges ahead arch_perfEdgesMerge() prefetches the shared map */
+#define _HF_PERF_EDGES_PREFETCH 16
+
+static inline void arch_perfEdgesInit(run_t* run) {
+    if (run->linux.perfEdgesSet == NULL) {
+        run->linux.perfEdgesSet = (uint32_t*)util_Calloc(sizeof(uint32_t) * _HF_PERF_EDGES_SET_SZ);
+        run->linux.perfEdges = (uint32_t*)util_Malloc(sizeof(uint32_t) * _HF_PERF_EDGES_MAX);
+        run->linux.perfEdgesCnt = 0;
+    }
+}
+
+/* Merges the unique edges into bbMapPc, and clears the set */
+static void arch_perfEdgesMerge(run_t* run) {
+    uint8_t* map = run->feedbackMap->bbMapPc;
+    uint32_t* set = run->linux.perfEdgesSet;
+    const uint32_t* slots = run->linux.perfEdges;
+    size_t cnt = run->linux.perfEdgesCnt;
+
+    for (size_t i = 0; i < cnt; i++) {
+        if ((i + _HF_PERF_EDGES_PREFETCH) < cnt) {
+            __builtin_prefetch(&map[(set[slots[i + _HF_PERF_EDGES_PREFETCH]] - 1) / 8], 1);
+        }
+        uint32_t pos = set[slots[i]] - 1;
+        set[slots[i]] = 0;
+        /* Most of the edges are known already, so the bit is checked before the locked RMW */
+        if (ATOMIC_GET(map[pos / 8]) & (1U << (pos % 8))) {
+            continue;
+        }
+        if (!ATOMIC_BTS(map, pos)) {
+            run->linux.hwCnts.newBBCnt++;
+        }
+    }
+    run->linux.perfEdgesCnt = 0;
+}
+
+__attribute__((hot)) static inline void arch_perfEdgeAdd(run_t* run, uint64_t pos) {
+    uint32_t key = (uint32_t)(pos & _HF_PERF_BITMAP_BITSZ_MASK) + 1;
+    uint32_t* set = run->linux.perfEdgesSet;
+    uint32_t slot = (key * 0x9E3779B1U) >> (32 - _HF_PERF_EDGES_SET_BITS);
+    for (; set[slot] != 0; slot = (slot + 1) & (_HF_PERF_EDGES_SET_SZ - 1)) {
+        if (set[slot] == key) {
+            return;
+        }
+    }
+    set[slot] = key;
+    run->linux.perfEdges[run->linux.perfEdgesCnt++] = slot;
+    if (run->linux.perfEdgesCnt == _HF_PERF_EDGES_MAX) {
+        arch_perfEdgesMerge(run);
+    }
+}
 
 #if defined(PERF_ATTR_SIZE_VER5)
-__attribute__((hot)) static inline void arch_perfBtsCount(run_t* run) {
-    struct perf_event_mmap_page* pem = (struct perf_event_mmap_page*)run->linux.perfMmapBuf;
+__attribute__((hot)) static inline void arch_perfBtsCount(run_t* run, size_t off, size_t len) {
     struct bts_branch {
         uint64_t from;
         uint64_t to;
         uint64_t misc;
     };
 
-    uint64_t aux_head = ATOMIC_GET(pem->aux_head);
-    struct bts_branch* br = (struct bts_branch*)run->linux.perfMmapAux;
-    for (; br < ((struct bts_branch*)(run->linux.perfMmapAux + aux_head)); br++) {
-        /*
-         * Kernel sometimes reports branches from the kernel (iret), we are not interested in that
-         * as it makes the whole concept of unique branch counting less predictable
-         */
-        if (run->global->linux.kernelOnly == false &&
-            (__builtin_expect(br->from > 0xFFFFFFFF00000000, false) ||
-                __builtin_expect(br->to > 0xFFFFFFFF00000000, false))) {
-            LOG_D("Adding branch %#018" PRIx64 " - %#018" PRIx64, br->from, br->to);
+    arch_perfEdgesInit(run);
+
+    /*
+     * Kernel sometimes reports branches from the kernel (iret), we are not interested in that
+     * as it makes the whole concept of unique branch counting less predictable. Such branches and
+     * the ones above the dynamic cut-off address are all dropped with a single comparison
+     */
+    uint64_t limit = run->global->linux.dynamicCutOffAddr;
+    if (run->global->linux.kernelOnly == false) {
+        limit = MIN(limit, 0xFFFFFFFF00000001ULL);
+    }
+
+    struct bts_branch* br = (struct bts_branch*)&run->linux.perfMmapAux[off];
+    struct bts_branch* end = br + (len / sizeof(struct bts_branch));
+    for (; br < end; br++) {
+        /* Padding at the end of the ring */
+        if (br->from == 0 && br->to == 0) {
             continue;
         }
-        if (br->from >= run->global->linux.dynamicCutOffAddr ||
-            br->to >= run->global->linux.dynamicCutOffAddr) {
+        if (__builtin_expect(MAX(br->from, br->to) >= limit, false)) {
             continue;
         }
 
-        register size_t pos = ((br->from << 12) ^ (br->to & 0xFFF));
-        pos &= _HF_PERF_BITMAP_BITSZ_MASK;
-        register uint8_t prev = ATOMIC_BTS(run->global->feedback.feedbackMap->bbMapPc, pos);
-        if (!prev) {
-            run->linux.hwCnts.newBBCnt++;
-        }
+        arch_perfEdgeAdd(run, (br->from << 12) ^ (br->to & 0xFFF));
     }
+
+    arch_perfEdgesMerge(run);
 }
 #endif /* defined(PERF_ATTR_SIZE_VER5) */
 
+/*
+ * KCOV records the kernel PCs (the basic blocks entered) of the task which enabled it: the fuzzed
+ * process before execve(), or libhfuzz around each persistent iteration. Consecutive PCs form the
+ * edges, hashed as the BTS ones
+ */
+static void arch_perfKcovAnalyze(run_t* run) {
+    uint64_t* area = run->linux.kcovArea;
+    uint64_t cnt = ATOMIC_GET(area[0]);
+    if (cnt >= (_HF_PERF_KCOV_WORDS - 1)) {
+        static bool warned = false;
+        if (!ATOMIC_XCHG(warned, true)) {
+            LOG_W("The KCOV buffer (%d PCs) got filled up, some kernel edges are lost",
+                _HF_PERF_KCOV_WORDS - 1);
+        }
+        cnt = _HF_PERF_KCOV_WORDS - 1;
+    }
+
+    arch_perfEdgesInit(run);
+    uint64_t prev = 0;
+    for (size_t i = 1; i <= cnt; i++) {
+        uint64_t pc = ATOMIC_GET(area[i]);
+        arch_perfEdgeAdd(run, (prev << 12) ^ (pc & 0xFFF));
+        prev = pc;
+    }
+    arch_perfEdgesMerge(run);
+
+    ATOMIC_SET(area[0], 0);
+}
+
+bool arch_perfKcovOpen(run_t* run) {
+    run->linux.kcovFd = -1;
+    run->linux.kcovArea = NULL;
+    if (!(run->global->feedback.dynFileMethod & _HF_DYNFILE_KCOV)) {
+        return true;
+    }
+
+    static const char kcov_path[] = "/sys/kernel/debug/kcov";
+    if ((run->linux.kcovFd = TEMP_FAILURE_RETRY(open(kcov_path, O_RDWR | O_CLOEXEC))) == -1) {
+        PLOG_E("open('%s'), is debugfs mounted, and the kernel built with CONFIG_KCOV?", kcov_path);
+        return false;
+    }
+    if (ioctl(run->linux.kcovFd, KCOV_INIT_TRACE, (unsigned long)_HF_PERF_KCOV_WORDS) == -1) {
+        PLOG_E("ioctl(KCOV_INIT_TRACE, %d)", _HF_PERF_KCOV_WORDS);
+        close(run->linux.kcovFd);
+        run->linux.kcovFd = -1;
+        return false;
+    }
+    void* area = mmap(NULL, sizeof(uint64_t) * _HF_PERF_KCOV_WORDS, PROT_READ | PROT_WRITE,
+        MAP_SHARED, run->linux.kcovFd, 0);
+    if (area == MAP_FAILED) {
+        PLOG_E("mmap(KCOV, sz=%zu)", sizeof(uint64_t) * _HF_PERF_KCOV_WORDS);
+        close(run->linux.kcovFd);
+        run->linux.kcovFd = -1;
+        return false;
+    }
+    run->linux.kcovArea = (uint64_t*)area;
+
+    return true;
+}
+
+/* In the child, before execve() */
+bool arch_perfKcovChild(run_t* run) {
+    if (run->linux.kcovFd == -1) {
+        return true;
+    }
+    if (TEMP_FAILURE_RETRY(dup2(run->linux.kcovFd, _HF_KCOV_FD)) == -1) {
+        PLOG_E("dup2(%d, _HF_KCOV_FD=%d)", run->linux.kcovFd, _HF_KCOV_FD);
+        return false;
+    }
+    /* Persistent processes enable it themselves, only while processing inputs */
+    if (run->global->exe.persistent) {
+        return true;
+    }
+    if (ioctl(_HF_KCOV_FD, KCOV_ENABLE, KCOV_TRACE_PC) == -1) {
+        PLOG_E("ioctl(_HF_KCOV_FD=%d, KCOV_ENABLE)", _HF_KCOV_FD);
+        return false;
+    }
+    ATOMIC_SET(run->linux.kcovArea[0], 0);
+    return true;
+}
+
+static inline void arch_perfAuxParse(run_t* run, size_t off, size_t len) {
+    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BTS_EDGE) {
+        arch_perfBtsCount(run, off, len);
+    }
+    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_IPT_BLOCK) {
+        arch_ptAnalyze(run, off, len);
+    }
+}
+
+/* Consumes the data ring, which only carries records about the AUX one, e.g. its truncation */
+static void arch_perfDataParse(run_t* run, struct perf_event_mmap_page* pem) {
+    uint64_t data_head = ATOMIC_GET(pem->data_head);
+    uint64_t data_tail = ATOMIC_GET(pem->data_tail);
+    rmb();
+
+    const uint8_t* data = run->linux.perfMmapBuf + getpagesize();
+    while ((data_head - data_tail) >= sizeof(struct perf_event_header)) {
+        struct perf_event_header hdr;
+        for (size_t i = 0; i < sizeof(hdr); i++) {
+            ((uint8_t*)&hdr)[i] = data[(data_tail + i) % _HF_PERF_MAP_SZ];
+        }
+        if (hdr.size < sizeof(hdr) || hdr.size > (data_head - data_tail)) {
+            break;
+        }
+        if (hdr.type == PERF_RECORD_AUX) {
+            uint64_t flags = 0;
+            /* aux_offset, aux_size, flags */
+            for (size_t i = 0; i < sizeof(flags); i++) {
+                ((uint8_t*)&flags)[i] =
+                    data[(data_tail + sizeof(hdr) + 2 * sizeof(uint64_t) + i) % _HF_PERF_MAP_SZ];
+            }
+            if (flags & PERF_AUX_FLAG_TRUNCATED) {
+                static bool warned = false;
+                if (!ATOMIC_XCHG(warned, true)) {
+                    LOG_W("The perf AUX data got truncated, consider increasing "
+                          "--linux_perf_aux_size, or using --linux_perf_aux_overwrite");
+                }
+            }
+        }
+        data_tail += hdr.size;
+    }
+
+    /* smp_mb() required as per /usr/include/linux/perf_event.h */
+    wmb();
+    ATOMIC_SET(pem->data_tail, data_head);
+}
+
+/*
+ * The AUX area is a ring, consumed between aux_tail and aux_head, continuously across iterations
+ * of persistent processes. In the overwrite mode (i.e. it's mapped read-only) the kernel doesn't
+ * stop at aux_tail, and only the last aux_size bytes are valid
+ */
 static inline void arch_perfMmapParse(run_t* run HF_ATTR_UNUSED) {
 #if defined(PERF_ATTR_SIZE_VER5)
     struct perf_event_mmap_page* pem = (struct perf_event_mmap_page*)run->linux.perfMmapBuf;
-    if (pem->aux_head == pem->aux_tail) {
+
+    arch_perfDataParse(run, pem);
+
+    uint64_t aux_head = ATOMIC_GET(pem->aux_head);
+    uint64_t aux_tail = ATOMIC_GET(pem->aux_tail);
+    /* smp_rmb() required as per /usr/include/linux/perf_event.h */
+    rmb();
+
+    if (aux_head == aux_tail) {
         return;
     }
-    if (pem->aux_head < pem->aux_tail) {
-        LOG_F("The PERF AUX data has been overwritten. The AUX buffer is too small");
-    }
-    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BTS_EDGE) {
-        arch_perfBtsCount(run);
+    size_t auxSz = run->global->linux.perfAuxSz;
+    if ((aux_head - aux_tail) > auxSz) {
+        LOG_D("%" PRIu64 " bytes of the perf AUX data have been overwritten",
+            aux_head - aux_tail - auxSz);
+        aux_tail = aux_head - auxSz;
     }
-    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_IPT_BLOCK) {
-        arch_ptAnalyze(run);
+
+    size_t off = (size_t)(aux_tail % auxSz);
+    size_t len = (size_t)(aux_head - aux_tail);
+    size_t chunk = MIN(len, auxSz - off);
+    arch_perfAuxParse(run, off, chunk);
+    if (len > chunk) {
+        arch_perfAuxParse(run, 0, len - chunk);
     }
+
+    /* smp_mb() required as per /usr/include/linux/perf_event.h */
+    wmb();
+    ATOMIC_SET(pem->aux_tail, aux_head);
 #endif /* defined(PERF_ATTR_SIZE_VER5) */
 }
 
@@ -113,7 +338,12 @@ static long perf_event_open(
         (uintptr_t)group_fd, (uintptr_t)flags);
 }
 
-static bool arch_perfCreate(run_t* run, pid_t pid, dynFileMethod_t method, int* perfFd) {
+/*
+ * With 'groupFd' != -1 the event is added to the group led by it, and follows the state of the
+ * leader, i.e. it's enabled, disabled and reset together with it
+ */
+static bool arch_perfCreate(
+    run_t* run, pid_t pid, dynFileMethod_t method, int* perfFd, int groupFd) {
     LOG_D("Enabling PERF for pid=%d method=%x", pid, method);
 
     if (*perfFd != -1) {
@@ -135,9 +365,11 @@ static bool arch_perfCreate(run_t* run, pid_t pid, dynFileMethod_t method, int*
     } else {
         pe.exclude_kernel = 1;
     }
-    pe.disabled = 1;
-    if (!run->global->exe.persistent) {
-        pe.enable_on_exec = 1;
+    if (groupFd == -1) {
+        pe.disabled = 1;
+        if (!run->global->exe.persistent) {
+            pe.enable_on_exec = 1;
+        }
     }
     pe.exclude_hv = 1;
     pe.type = PERF_TYPE_HARDWARE;
@@ -147,6 +379,9 @@ static bool arch_perfCreate(run_t* run, pid_t pid, dynFileMethod_t method, int*
             LOG_D("Using: PERF_COUNT_HW_INSTRUCTIONS for pid=%d", (int)pid);
             pe.config = PERF_COUNT_HW_INSTRUCTIONS;
             pe.inherit = 1;
+            if (run->linux.cpuCntGroup) {
+                pe.read_format = PERF_FORMAT_GROUP;
+            }
             break;
         case _HF_DYNFILE_BRANCH_COUNT:
             LOG_D("Using: PERF_COUNT_HW_BRANCH_INSTRUCTIONS for pid=%d", (int)pid);
@@ -171,7 +406,7 @@ static bool arch_perfCreate(run_t* run, pid_t pid, dynFileMethod_t method, int*
 #if !defined(PERF_FLAG_FD_CLOEXEC)
 #define PERF_FLAG_FD_CLOEXEC 0
 #endif
-    *perfFd = perf_event_open(&pe, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    *perfFd = perf_event_open(&pe, pid, -1, groupFd, PERF_FLAG_FD_CLOEXEC);
     if (*perfFd == -1) {
         PLOG_E("perf_event_open() failed");
         return false;
@@ -180,6 +415,16 @@ static bool arch_perfCreate(run_t* run, pid_t pid, dynFileMethod_t method, int*
     if (method != _HF_DYNFILE_BTS_EDGE && method != _HF_DYNFILE_IPT_BLOCK) {
         return true;
     }
+#if defined(PERF_EVENT_IOC_SET_FILTER)
+    /* The objects' ranges are resolved by the kernel whenever they're mapped, e.g. on execve() */
+    if (method == _HF_DYNFILE_IPT_BLOCK && perfPtFilter != NULL &&
+        ioctl(*perfFd, PERF_EVENT_IOC_SET_FILTER, perfPtFilter) == -1) {
+        PLOG_E("ioctl(PERF_EVENT_IOC_SET_FILTER, '%s')", perfPtFilter);
+        close(*perfFd);
+        *perfFd = -1;
+        return false;
+    }
+#endif /* defined(PERF_EVENT_IOC_SET_FILTER) */
 #if defined(PERF_ATTR_SIZE_VER5)
     if ((run->linux.perfMmapBuf = mmap(NULL, _HF_PERF_MAP_SZ + getpagesize(),
              PROT_READ | PROT_WRITE, MAP_SHARED, *perfFd, 0)) == MAP_FAILED) {
@@ -194,9 +439,11 @@ static bool arch_perfCreate(run_t* run, pid_t pid, dynFileMethod_t method, int*
 
     struct perf_event_mmap_page* pem = (struct perf_event_mmap_page*)run->linux.perfMmapBuf;
     pem->aux_offset = pem->data_offset + pem->data_size;
-    pem->aux_size = _HF_PERF_AUX_SZ;
+    pem->aux_size = run->global->linux.perfAuxSz;
+    /* Without PROT_WRITE the kernel uses the AUX area in the overwrite mode */
+    int auxProt = run->global->linux.perfAuxOverwrite ? PROT_READ : (PROT_READ | PROT_WRITE);
     if ((run->linux.perfMmapAux = mmap(
-             NULL, pem->aux_size, PROT_READ, MAP_SHARED, *perfFd, pem->aux_offset)) == MAP_FAILED) {
+             NULL, pem->aux_size, auxProt, MAP_SHARED, *perfFd, pem->aux_offset)) == MAP_FAILED) {
         munmap(run->linux.perfMmapBuf, _HF_PERF_MAP_SZ + getpagesize());
         run->linux.perfMmapBuf = NULL;
         run->linux.perfMmapAux = NULL;
@@ -219,26 +466,44 @@ bool arch_perfOpen(run_t* run) {
         return true;
     }
 
-    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT) {
-        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_INSTR_COUNT, &run->linux.cpuInstrFd)) {
+    /* Both counters in one group, so a single ioctl()/read() handles them */
+    run->linux.cpuCntGroup = (run->global->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT) &&
+                             (run->global->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT) &&
+                             !ATOMIC_GET(perfCntGroupUnsupported);
+    if (run->linux.cpuCntGroup) {
+        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_INSTR_COUNT, &run->linux.cpuInstrFd, -1)) {
+            LOG_W("Couldn't create a group of perf counters, using separate ones");
+            ATOMIC_SET(perfCntGroupUnsupported, true);
+            run->linux.cpuCntGroup = false;
+        } else if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_BRANCH_COUNT,
+                       &run->linux.cpuBranchFd, run->linux.cpuInstrFd)) {
+            LOG_E("Cannot set up perf for pid=%d (_HF_DYNFILE_BRANCH_COUNT)", (int)run->pid);
+            goto out;
+        }
+    }
+    if ((run->global->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT) &&
+        !run->linux.cpuCntGroup) {
+        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_INSTR_COUNT, &run->linux.cpuInstrFd, -1)) {
             LOG_E("Cannot set up perf for pid=%d (_HF_DYNFILE_INSTR_COUNT)", (int)run->pid);
             goto out;
         }
     }
-    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT) {
-        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_BRANCH_COUNT, &run->linux.cpuBranchFd)) {
+    if ((run->global->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT) &&
+        !run->linux.cpuCntGroup) {
+        if (!arch_perfCreate(
+                run, run->pid, _HF_DYNFILE_BRANCH_COUNT, &run->linux.cpuBranchFd, -1)) {
             LOG_E("Cannot set up perf for pid=%d (_HF_DYNFILE_BRANCH_COUNT)", (int)run->pid);
             goto out;
         }
     }
     if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BTS_EDGE) {
-        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_BTS_EDGE, &run->linux.cpuIptBtsFd)) {
+        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_BTS_EDGE, &run->linux.cpuIptBtsFd, -1)) {
             LOG_E("Cannot set up perf for pid=%d (_HF_DYNFILE_BTS_EDGE)", (int)run->pid);
             goto out;
         }
     }
     if (run->global->feedback.dynFileMethod & _HF_DYNFILE_IPT_BLOCK) {
-        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_IPT_BLOCK, &run->linux.cpuIptBtsFd)) {
+        if (!arch_perfCreate(run, run->pid, _HF_DYNFILE_IPT_BLOCK, &run->linux.cpuIptBtsFd, -1)) {
             LOG_E("Cannot set up perf for pid=%d (_HF_DYNFILE_IPT_BLOCK)", (int)run->pid);
             goto out;
         }
@@ -263,7 +528,8 @@ void arch_perfClose(run_t* run) {
     }
 
     if (run->linux.perfMmapAux != NULL) {
-        munmap(run->linux.perfMmapAux, _HF_PERF_AUX_SZ);
+        arch_ptClose(run);
+        munmap(run->linux.perfMmapAux, run->global->linux.perfAuxSz);
         run->linux.perfMmapAux = NULL;
     }
     if (run->linux.perfMmapBuf != NULL) {
@@ -298,11 +564,19 @@ bool arch_perfEnable(run_t* run) {
         return true;
     }
 
-    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT) {
-        ioctl(run->linux.cpuInstrFd, PERF_EVENT_IOC_ENABLE, 0);
+    if (run->linux.kcovArea != NULL) {
+        ATOMIC_SET(run->linux.kcovArea[0], 0);
     }
-    if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT) {
-        ioctl(run->linux.cpuBranchFd, PERF_EVENT_IOC_ENABLE, 0);
+
+    if (run->linux.cpuCntGroup) {
+        ioctl(run->linux.cpuInstrFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    } else {
+        if (run->global->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT) {
+            ioctl(run->linux.cpuInstrFd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT) {
+            ioctl(run->linux.cpuBranchFd, PERF_EVENT_IOC_ENABLE, 0);
+        }
     }
     if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BTS_EDGE) {
         ioctl(run->linux.cpuIptBtsFd, PERF_EVENT_IOC_ENABLE, 0);
@@ -314,17 +588,23 @@ bool arch_perfEnable(run_t* run) {
     return true;
 }
 
-static void arch_perfMmapReset(run_t* run) {
-    /* smp_mb() required as per /usr/include/linux/perf_event.h */
-    wmb();
+/* Disables, reads and resets the whole group of counters, the leader being the instruction one */
+static void arch_perfCntGroupRead(run_t* run, uint64_t* instrCount, uint64_t* branchCount) {
+    ioctl(run->linux.cpuInstrFd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    struct {
+        uint64_t nr;
+        uint64_t values[2];
+    } grp;
+    ssize_t sz = files_readFromFd(run->linux.cpuInstrFd, (uint8_t*)&grp, sizeof(grp));
+    if (sz != (ssize_t)sizeof(grp) || grp.nr != ARRAYSIZE(grp.values)) {
+        PLOG_E("read(perfFd='%d', PERF_FORMAT_GROUP) failed, sz=%zd", run->linux.cpuInstrFd, sz);
+    } else {
+        *instrCount = grp.values[0];
+        *branchCount = grp.values[1];
+    }
 
-    struct perf_event_mmap_page* pem = (struct perf_event_mmap_page*)run->linux.perfMmapBuf;
-    ATOMIC_SET(pem->data_head, 0);
-    ATOMIC_SET(pem->data_tail, 0);
-#if defined(PERF_ATTR_SIZE_VER5)
-    ATOMIC_SET(pem->aux_head, 0);
-    ATOMIC_SET(pem->aux_tail, 0);
-#endif /* defined(PERF_ATTR_SIZE_VER5) */
+    ioctl(run->linux.cpuInstrFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
 }
 
 void arch_perfAnalyze(run_t* run) {
@@ -333,8 +613,13 @@ void arch_perfAnalyze(run_t* run) {
     }
 
     uint64_t instrCount = 0;
+    uint64_t branchCount = 0;
+    if (run->linux.cpuCntGroup && run->linux.cpuInstrFd != -1) {
+        arch_perfCntGroupRead(run, &instrCount, &branchCount);
+    }
+
     if ((run->global->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT) &&
-        run->linux.cpuInstrFd != -1) {
+        !run->linux.cpuCntGroup && run->linux.cpuInstrFd != -1) {
         ioctl(run->linux.cpuInstrFd, PERF_EVENT_IOC_DISABLE, 0);
         if (files_readFromFd(run->linux.cpuInstrFd, (uint8_t*)&instrCount, sizeof(instrCount)) !=
             sizeof(instrCount)) {
@@ -343,9 +628,8 @@ void arch_perfAnalyze(run_t* run) {
         ioctl(run->linux.cpuInstrFd, PERF_EVENT_IOC_RESET, 0);
     }
 
-    uint64_t branchCount = 0;
     if ((run->global->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT) &&
-        run->linux.cpuBranchFd != -1) {
+        !run->linux.cpuCntGroup && run->linux.cpuBranchFd != -1) {
         ioctl(run->linux.cpuBranchFd, PERF_EVENT_IOC_DISABLE, 0);
         if (files_readFromFd(run->linux.cpuBranchFd, (uint8_t*)&branchCount, sizeof(branchCount)) !=
             sizeof(branchCount)) {
@@ -358,22 +642,169 @@ void arch_perfAnalyze(run_t* run) {
         run->linux.cpuIptBtsFd != -1) {
         ioctl(run->linux.cpuIptBtsFd, PERF_EVENT_IOC_DISABLE, 0);
         arch_perfMmapParse(run);
-        arch_perfMmapReset(run);
         ioctl(run->linux.cpuIptBtsFd, PERF_EVENT_IOC_RESET, 0);
     }
     if ((run->global->feedback.dynFileMethod & _HF_DYNFILE_IPT_BLOCK) &&
         run->linux.cpuIptBtsFd != -1) {
         ioctl(run->linux.cpuIptBtsFd, PERF_EVENT_IOC_DISABLE, 0);
         arch_perfMmapParse(run);
-        arch_perfMmapReset(run);
         ioctl(run->linux.cpuIptBtsFd, PERF_EVENT_IOC_RESET, 0);
     }
+    if (run->linux.kcovArea != NULL) {
+        arch_perfKcovAnalyze(run);
+    }
 
     run->linux.hwCnts.cpuInstrCnt = instrCount;
     run->linux.hwCnts.cpuBranchCnt = branchCount;
 }
 
-bool arch_perfInit(honggfuzz_t* hfuzz HF_ATTR_UNUSED) {
+/* Appends the filter covering the whole (file of the) object, i.e. all its executable mappings */
+static bool arch_perfPtFilterAdd(const char* path, char* filter, size_t filterSz) {
+    char rpath[PATH_MAX];
+    if (realpath(path, rpath) == NULL) {
+        PLOG_E("realpath('%s')", path);
+        return false;
+    }
+    struct stat st;
+    if (stat(rpath, &st) == -1) {
+        PLOG_E("stat('%s')", rpath);
+        return false;
+    }
+    size_t len = strlen(filter);
+    int ret = snprintf(&filter[len], filterSz - len, "%sfilter 0/%#" PRIx64 "@%s",
+        len ? " " : "", (uint64_t)st.st_size, rpath);
+    if (ret < 0 || (size_t)ret >= (filterSz - len)) {
+        LOG_E("The Intel PT address filter is too long");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * With ASLR disabled, every fuzzed process has its main image at the same address. It's taken from
+ * /proc/<pid>/maps of a process which is stopped right after execve() of 'fname', 0 if it's unknown
+ */
+static uint64_t arch_perfPieBase(const char* fname) {
+    char path[PATH_MAX];
+    if (realpath(fname, path) == NULL) {
+        PLOG_W("realpath('%s')", fname);
+        return 0;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        PLOG_W("fork()");
+        return 0;
+    }
+    if (pid == 0) {
+        if (syscall(__NR_personality, ADDR_NO_RANDOMIZE) == -1) {
+            _exit(1);
+        }
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) {
+            _exit(1);
+        }
+        char* const argv[] = {path, NULL};
+        execv(path, argv);
+        _exit(1);
+    }
+    defer {
+        kill(pid, SIGKILL);
+        while (TEMP_FAILURE_RETRY(waitpid(pid, NULL, __WALL)) == pid) {
+        }
+    };
+
+    int status;
+    if (TEMP_FAILURE_RETRY(waitpid(pid, &status, __WALL)) != pid || !WIFSTOPPED(status)) {
+        LOG_W("Couldn't stop '%s' after execve() (e.g. personality(ADDR_NO_RANDOMIZE) failed)",
+            path);
+        return 0;
+    }
+
+    char fProcMaps[PATH_MAX];
+    snprintf(fProcMaps, sizeof(fProcMaps), "/proc/%d/maps", (int)pid);
+    FILE* f = fopen(fProcMaps, "re");
+    if (f == NULL) {
+        PLOG_W("fopen('%s')", fProcMaps);
+        return 0;
+    }
+    defer {
+        fclose(f);
+    };
+
+    /* start-end perms offset dev inode name: the mapping of the file at offset 0 */
+    uint64_t base = 0;
+    char* line = NULL;
+    size_t lineSz = 0;
+    while (base == 0 && getline(&line, &lineSz, f) > 0) {
+        unsigned long start, offset;
+        int nameOff = 0;
+        if (sscanf(line, "%lx-%*x %*s %lx %*s %*u %n", &start, &offset, &nameOff) == 2 &&
+            nameOff && offset == 0 && strncmp(&line[nameOff], path, strlen(path)) == 0 &&
+            (line[nameOff + strlen(path)] == '\n' || line[nameOff + strlen(path)] == '\0')) {
+            base = start;
+        }
+    }
+    free(line);
+
+    if (base == 0) {
+        LOG_W("The mapping of '%s' was not found in '%s'", path, fProcMaps);
+        return 0;
+    }
+    LOG_D("The main image of '%s' is mapped at %#" PRIx64, path, base);
+    return base;
+}
+
+static bool arch_perfPtFilterInit(honggfuzz_t* hfuzz) {
+    size_t cnt = hfuzz->linux.ptFilterDsosCnt + (hfuzz->linux.ptFilterExe ? 1 : 0);
+    if (cnt == 0) {
+        return true;
+    }
+    if (!(hfuzz->feedback.dynFileMethod & _HF_DYNFILE_IPT_BLOCK)) {
+        LOG_W("The Intel PT address filters are used with --linux_perf_ipt_block/edge only");
+        return true;
+    }
+    if (hfuzz->linux.kernelOnly) {
+        LOG_E("The Intel PT address filters cannot be used with --linux_perf_kernel_only");
+        return false;
+    }
+#if !defined(PERF_EVENT_IOC_SET_FILTER)
+    LOG_E("Your <linux/perf_event.h> includes are too old to support the perf address filters");
+    return false;
+#endif /* !defined(PERF_EVENT_IOC_SET_FILTER) */
+
+    static char const ranges_path[] =
+        "/sys/bus/event_source/devices/intel_pt/caps/num_address_ranges";
+    uint8_t buf[32];
+    ssize_t sz = files_readFileToBufMax(ranges_path, buf, sizeof(buf) - 1);
+    if (sz > 0) {
+        buf[sz] = '\0';
+        size_t ranges = strtoul((char*)buf, NULL, 10);
+        if (cnt > ranges) {
+            LOG_E("%zu Intel PT address filters requested, but the CPU supports only %zu", cnt,
+                ranges);
+            return false;
+        }
+    }
+
+    size_t filterSz = (PATH_MAX + 64) * cnt;
+    char* filter = (char*)util_Calloc(filterSz);
+    if (hfuzz->linux.ptFilterExe &&
+        !arch_perfPtFilterAdd(hfuzz->exe.cmdline[0], filter, filterSz)) {
+        free(filter);
+        return false;
+    }
+    for (size_t i = 0; i < hfuzz->linux.ptFilterDsosCnt; i++) {
+        if (!arch_perfPtFilterAdd(hfuzz->linux.ptFilterDsos[i], filter, filterSz)) {
+            free(filter);
+            return false;
+        }
+    }
+    LOG_I("Intel PT address filters: '%s'", filter);
+    perfPtFilter = filter;
+    return true;
+}
+
+bool arch_perfInit(honggfuzz_t* hfuzz) {
     static char const intel_pt_path[] = "/sys/bus/event_source/devices/intel_pt/type";
     static char const intel_bts_path[] = "/sys/bus/event_source/devices/intel_bts/type";
 
@@ -399,5 +830,31 @@ bool arch_perfInit(honggfuzz_t* hfuzz HF_ATTR_UNUSED) {
 
     perf_ptInit();
 
+    size_t auxSz = hfuzz->linux.perfAuxSz;
+    if (auxSz < (size_t)getpagesize() || (auxSz & (auxSz - 1)) != 0) {
+        LOG_E("The perf AUX buffer size (%zu) must be a power of 2, and at least one page", auxSz);
+        return false;
+    }
+
+    if (!arch_perfPtFilterInit(hfuzz)) {
+        return false;
+    }
+
+    if (hfuzz->linux.ptEdges) {
+        if (hfuzz->linux.kernelOnly) {
+            LOG_E("--linux_perf_ipt_edge cannot be used with --linux_perf_kernel_only");
+            return false;
+        }
+        ptCfg_t* cfg = (ptCfg_t*)util_Calloc(sizeof(ptCfg_t));
+        uint64_t pieBase =
+            hfuzz->linux.disableRandomization ? arch_perfPieBase(hfuzz->exe.cmdline[0]) : 0;
+        if (!arch_bfdPtCfg(hfuzz->exe.cmdline[0], pieBase, cfg)) {
+            LOG_E("Couldn't disassemble '%s' for --linux_perf_ipt_edge", hfuzz->exe.cmdline[0]);
+            free(cfg);
+            return false;
+        }
+        hfuzz->linux.ptCfg = cfg;
+    }
+
     return true;
 }
@@ -31,5 +31,8 @@ extern bool arch_perfOpen(run_t* run);
 extern void arch_perfClose(run_t* run);
 extern bool arch_perfEnable(run_t* run);
 extern void arch_perfAnalyze(run_t* run);
+/* --linux_kcov: the KCOV instance is opened once per fuzzing thread, and passed to its processes */
+extern bool arch_perfKcovOpen(run_t* run);
+extern bool arch_perfKcovChild(run_t* run);
 
 #endif
@@ -26,14 +26,451 @@
 #include <inttypes.h>
 #include <linux/perf_event.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "libhfcommon/common.h"
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
 
 #ifdef _HF_LINUX_INTEL_PT_LIB
-
 #include <intel-pt.h>
+#endif /* _HF_LINUX_INTEL_PT_LIB */
+
+/* Sign-extend a uint64_t value. */
+inline static uint64_t sext(uint64_t val, uint8_t sign) {
+    uint64_t signbit, mask;
+
+    signbit = 1ull << (sign - 1);
+    mask = ~0ull << sign;
+
+    return val & signbit ? val | mask : val & ~mask;
+}
+
+__attribute__((hot)) inline static size_t perf_ptMarkIp(
+    uint64_t ip, uint64_t cutOff, uint8_t* bitmap) {
+    if (ip >= cutOff) {
+        return 0;
+    }
+    ip &= _HF_PERF_BITMAP_BITSZ_MASK;
+    register uint8_t prev = ATOMIC_BTS(bitmap, ip);
+    return prev ? 0 : 1;
+}
+
+/*
+ * The built-in scanner only looks for TIP packets, everything else is skipped by the opcode. See the
+ * "Intel Processor Trace" chapter of the Intel SDM (Vol. 3C) for the packet layouts
+ */
+static const uint8_t ptPsb[] = {
+    0x02, 0x82, 0x02, 0x82, 0x02, 0x82, 0x02, 0x82, 0x02, 0x82, 0x02, 0x82, 0x02, 0x82, 0x02, 0x82};
+
+#define PT_OPC_EXT 0x02
+#define PT_OPC_TIP 0x0D
+#define PT_OPC_TIP_PGE 0x11
+#define PT_OPC_TIP_PGD 0x01
+#define PT_OPC_FUP 0x1D
+#define PT_OPC_TSC 0x19
+#define PT_OPC_MTC 0x59
+#define PT_OPC_MODE 0x99
+
+/* Sizes of the IP payload of TIP-like packets, indexed by the IPBytes field, 0xFF is reserved */
+static const uint8_t ptIpBytes[8] = {0, 2, 4, 6, 6, 0xFF, 8, 0xFF};
+
+/* Size of the packet starting with the extended opcode (0x02 'ext'), or 0 if it's not known */
+static inline size_t perf_ptExtLen(uint8_t ext) {
+    switch (ext) {
+        case 0x82: /* PSB */
+            return sizeof(ptPsb);
+        case 0x23: /* PSBEND */
+        case 0x83: /* TraceStop */
+        case 0xF3: /* OVF */
+        case 0x62: /* EXSTOP */
+        case 0xE2: /* EXSTOP.IP */
+        case 0x33: /* BEP */
+        case 0xB3: /* BEP.IP */
+            return 2;
+        case 0x03: /* CBR */
+        case 0x22: /* PWRE */
+        case 0x13: /* CFE */
+            return 4;
+        case 0x73: /* TMA */
+        case 0xC8: /* VMCS */
+        case 0xA2: /* PWRX */
+            return 7;
+        case 0xA3: /* Long TNT */
+        case 0x43: /* PIP */
+            return 8;
+        case 0xC2: /* MWAIT */
+            return 10;
+        case 0xC3: /* MNT */
+        case 0x53: /* EVD */
+            return 11;
+        default:
+            break;
+    }
+    /* PTWRITE, with a 4 or 8 byte payload */
+    if ((ext & 0x1F) == 0x12) {
+        switch (ext & 0x60) {
+            case 0x00:
+                return 6;
+            case 0x20:
+                return 10;
+            default:
+                return 0;
+        }
+    }
+    /* BBP (its BIPs depend on the context) and unknown packets: re-sync at the next PSB */
+    return 0;
+}
+
+/* Uses libc's memmem(), vectorized in most implementations */
+static inline size_t perf_ptResync(const uint8_t* buf, size_t len, size_t off) {
+    if (off >= len) {
+        return len;
+    }
+    const uint8_t* psb = memmem(&buf[off], len - off, ptPsb, sizeof(ptPsb));
+    if (psb == NULL) {
+        return len;
+    }
+    return (size_t)(psb - buf);
+}
+
+/* Packets which the scanners care about, everything else is skipped by perf_ptNextPkt() */
+typedef enum {
+    PT_PKT_EOS = 0,
+    PT_PKT_TNT,
+    PT_PKT_TIP,
+    PT_PKT_TIP_PGE,
+    PT_PKT_TIP_PGD,
+    PT_PKT_FUP,
+    PT_PKT_PSB,
+    PT_PKT_PSBEND,
+    PT_PKT_OVF,
+} ptPktType_t;
+
+typedef struct {
+    ptPktType_t type;
+    /* IPBytes field of the TIP-like packets, or the number of TNT bits */
+    uint8_t ipc;
+    /* The (compressed) IP, or the TNT bits, the oldest one being the most significant */
+    uint64_t payload;
+} ptPkt_t;
+
+__attribute__((hot)) static inline void perf_ptNextPkt(
+    const uint8_t* buf, size_t len, size_t* off, ptPkt_t* pkt) {
+    size_t i = *off;
+
+    while (i < len) {
+        uint8_t opc = buf[i];
+
+        /* PAD, short TNT and the extended opcodes */
+        if ((opc & 0x1) == 0) {
+            if (opc == 0x00) {
+                i++;
+                continue;
+            }
+            /* Short TNT: the stop bit followed by 1-6 TNT bits, and the zero bit 0 */
+            if (opc != PT_OPC_EXT) {
+                uint8_t bits = (uint8_t)(31 - __builtin_clz(opc) - 1);
+                pkt->type = PT_PKT_TNT;
+                pkt->ipc = bits;
+                pkt->payload = (opc >> 1) & ((1U << bits) - 1);
+                *off = i + 1;
+                return;
+            }
+            if ((i + 1) >= len) {
+                break;
+            }
+            uint8_t ext = buf[i + 1];
+            switch (ext) {
+                case 0xA3: /* Long TNT: the stop bit followed by up to 47 TNT bits */
+                    if ((i + 8) > len) {
+                        *off = len;
+                        pkt->type = PT_PKT_EOS;
+                        return;
+                    }
+                    pkt->payload = 0;
+                    memcpy(&pkt->payload, &buf[i + 2], 6);
+                    if (pkt->payload == 0) {
+                        i += 8;
+                        continue;
+                    }
+                    pkt->type = PT_PKT_TNT;
+                    pkt->ipc = (uint8_t)(63 - __builtin_clzll(pkt->payload));
+                    pkt->payload &= ((1ULL << pkt->ipc) - 1);
+                    *off = i + 8;
+                    return;
+                case 0x82:
+                    pkt->type = PT_PKT_PSB;
+                    *off = i + sizeof(ptPsb);
+                    return;
+                case 0x23:
+                    pkt->type = PT_PKT_PSBEND;
+                    *off = i + 2;
+                    return;
+                case 0xF3:
+                    pkt->type = PT_PKT_OVF;
+                    *off = i + 2;
+                    return;
+                default:
+                    break;
+            }
+            size_t pktLen = perf_ptExtLen(ext);
+            i = pktLen ? (i + pktLen) : perf_ptResync(buf, len, i + 1);
+            continue;
+        }
+
+        /* CYC, with optional extension bytes */
+        if ((opc & 0x3) == 0x3) {
+            i++;
+            if (opc & 0x4) {
+                while (i < len && (buf[i++] & 0x1)) {
+                }
+            }
+            continue;
+        }
+
+        switch (opc & 0x1F) {
+            case PT_OPC_TIP:
+                pkt->type = PT_PKT_TIP;
+                break;
+            case PT_OPC_TIP_PGE:
+                pkt->type = PT_PKT_TIP_PGE;
+                break;
+            case PT_OPC_TIP_PGD:
+                pkt->type = PT_PKT_TIP_PGD;
+                break;
+            case PT_OPC_FUP:
+                pkt->type = PT_PKT_FUP;
+                break;
+            default:
+                switch (opc) {
+                    case PT_OPC_TSC:
+                        i += 8;
+                        break;
+                    case PT_OPC_MTC:
+                    case PT_OPC_MODE:
+                        i += 2;
+                        break;
+                    default:
+                        i = perf_ptResync(buf, len, i + 1);
+                        break;
+                }
+                continue;
+        }
+
+        uint8_t ipBytes = ptIpBytes[opc >> 5];
+        if (ipBytes == 0xFF) {
+            i = perf_ptResync(buf, len, i + 1);
+            continue;
+        }
+        if ((i + 1 + ipBytes) > len) {
+            break;
+        }
+        pkt->ipc = opc >> 5;
+        pkt->payload = 0;
+        memcpy(&pkt->payload, &buf[i + 1], ipBytes);
+        *off = i + 1 + ipBytes;
+        return;
+    }
+
+    *off = len;
+    pkt->type = PT_PKT_EOS;
+}
+
+__attribute__((hot)) size_t perf_ptScanTip(
+    const uint8_t* buf, size_t len, uint64_t cutOff, uint8_t* bitmap) {
+    size_t newBits = 0;
+
+    for (size_t off = 0;;) {
+        ptPkt_t pkt;
+        perf_ptNextPkt(buf, len, &off, &pkt);
+        if (pkt.type == PT_PKT_EOS) {
+            break;
+        }
+        if (pkt.type != PT_PKT_TIP || pkt.ipc == 0) {
+            continue;
+        }
+        uint64_t ip = pkt.payload;
+        /* IPBytes=011b is the sign-extended 48-bit IP */
+        if (pkt.ipc == 0x3) {
+            ip = sext(ip, 48);
+        }
+        newBits += perf_ptMarkIp(ip, cutOff, bitmap);
+    }
+
+    return newBits;
+}
+
+/* Max number of direct jumps/calls followed in search of the branch consuming a TNT bit/TIP */
+#define PT_WALK_STEPS_MAX 4096
+
+typedef struct {
+    const ptCfg_t* cfg;
+    uint64_t cutOff;
+    uint8_t* bitmap;
+    uint64_t lastIp;
+    uint64_t ip;
+    bool ipValid;
+    size_t newBits;
+} ptWalk_t;
+
+/* Decompresses the IP of a TIP-like packet, see "IP Compression" in the SDM */
+static inline uint64_t perf_ptLastIp(uint64_t lastIp, const ptPkt_t* pkt) {
+    switch (pkt->ipc) {
+        case 0x1:
+            return (lastIp & ~0xFFFFULL) | pkt->payload;
+        case 0x2:
+            return (lastIp & ~0xFFFFFFFFULL) | pkt->payload;
+        case 0x3:
+            return sext(pkt->payload, 48);
+        case 0x4:
+            return (lastIp & ~0xFFFFFFFFFFFFULL) | pkt->payload;
+        case 0x6:
+            return pkt->payload;
+        default:
+            return lastIp;
+    }
+}
+
+/* The first branch instruction at, or after 'ip' */
+static inline const ptBranch_t* perf_ptCfgFind(const ptCfg_t* cfg, uint64_t ip) {
+    if (ip < cfg->start || ip >= cfg->end) {
+        return NULL;
+    }
+    size_t lo = 0, hi = cfg->cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cfg->branches[mid].addr < ip) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < cfg->cnt) ? &cfg->branches[lo] : NULL;
+}
+
+__attribute__((hot)) static inline void perf_ptEdge(ptWalk_t* w, uint64_t from, uint64_t to) {
+    if (from >= w->cutOff || to >= w->cutOff) {
+        return;
+    }
+    register size_t pos = ((from << 12) ^ (to & 0xFFF));
+    pos &= _HF_PERF_BITMAP_BITSZ_MASK;
+    register uint8_t prev = ATOMIC_BTS(w->bitmap, pos);
+    if (!prev) {
+        w->newBits++;
+    }
+}
+
+/*
+ * Walks from the current IP over direct jumps and calls, until a branch which needs more data from
+ * the trace: a conditional one (a TNT bit) or an indirect one (a TIP)
+ */
+static inline const ptBranch_t* perf_ptWalk(ptWalk_t* w) {
+    for (size_t steps = 0; steps < PT_WALK_STEPS_MAX; steps++) {
+        const ptBranch_t* br = perf_ptCfgFind(w->cfg, w->ip);
+        if (br == NULL) {
+            return NULL;
+        }
+        if (br->type != PT_BR_JMP && br->type != PT_BR_CALL) {
+            return br;
+        }
+        w->ip = br->target;
+    }
+    return NULL;
+}
+
+static inline void perf_ptWalkTnt(ptWalk_t* w, bool taken) {
+    if (!w->ipValid) {
+        return;
+    }
+    const ptBranch_t* br = perf_ptWalk(w);
+    if (br == NULL || br->type != PT_BR_COND) {
+        w->ipValid = false;
+        return;
+    }
+    uint64_t to = taken ? br->target : (br->addr + br->len);
+    perf_ptEdge(w, br->addr, to);
+    w->ip = to;
+}
+
+static inline void perf_ptWalkTip(ptWalk_t* w, uint64_t target) {
+    if (w->ipValid) {
+        const ptBranch_t* br = perf_ptWalk(w);
+        if (br != NULL && br->type == PT_BR_INDIRECT) {
+            perf_ptEdge(w, br->addr, target);
+        }
+    }
+    w->ip = target;
+    w->ipValid = true;
+}
+
+__attribute__((hot)) size_t perf_ptScanEdges(
+    const uint8_t* buf, size_t len, const ptCfg_t* cfg, uint64_t cutOff, uint8_t* bitmap) {
+    ptWalk_t w = {
+        .cfg = cfg,
+        .cutOff = cutOff,
+        .bitmap = bitmap,
+        .lastIp = 0,
+        .ip = 0,
+        .ipValid = false,
+        .newBits = 0,
+    };
+    bool inPsb = false;
+
+    for (size_t off = 0;;) {
+        ptPkt_t pkt;
+        perf_ptNextPkt(buf, len, &off, &pkt);
+        switch (pkt.type) {
+            case PT_PKT_EOS:
+                return w.newBits;
+            case PT_PKT_TNT:
+                for (uint8_t b = pkt.ipc; b > 0; b--) {
+                    perf_ptWalkTnt(&w, (pkt.payload >> (b - 1)) & 0x1);
+                }
+                break;
+            case PT_PKT_TIP:
+            case PT_PKT_TIP_PGE:
+                if (pkt.ipc == 0) {
+                    w.ipValid = false;
+                    break;
+                }
+                w.lastIp = perf_ptLastIp(w.lastIp, &pkt);
+                if (pkt.type == PT_PKT_TIP) {
+                    perf_ptWalkTip(&w, w.lastIp);
+                } else {
+                    w.ip = w.lastIp;
+                    w.ipValid = true;
+                }
+                break;
+            case PT_PKT_FUP:
+                if (pkt.ipc != 0) {
+                    w.lastIp = perf_ptLastIp(w.lastIp, &pkt);
+                }
+                /* Within PSB+ it's the current IP, otherwise the source of an async event */
+                w.ip = w.lastIp;
+                w.ipValid = inPsb && (pkt.ipc != 0);
+                break;
+            case PT_PKT_TIP_PGD:
+                if (pkt.ipc != 0) {
+                    w.lastIp = perf_ptLastIp(w.lastIp, &pkt);
+                }
+                w.ipValid = false;
+                break;
+            case PT_PKT_PSB:
+                inPsb = true;
+                w.lastIp = 0;
+                break;
+            case PT_PKT_PSBEND:
+                inPsb = false;
+                break;
+            case PT_PKT_OVF:
+                w.ipValid = false;
+                break;
+        }
+    }
+}
+
+#ifdef _HF_LINUX_INTEL_PT_LIB
 
 struct pt_cpu ptCpu = {
     .vendor = pcv_unknown,
@@ -42,6 +479,10 @@ struct pt_cpu ptCpu = {
     .stepping = 0,
 };
 
+/* Errata of the current CPU, they don't change between iterations */
+static struct pt_errata ptErrata;
+static int ptErrataErr = 0;
+
 void perf_ptInit(void) {
     FILE* f = fopen("/proc/cpuinfo", "rb");
     if (!f) {
@@ -80,21 +521,14 @@ void perf_ptInit(void) {
         }
     }
     fclose(f);
-}
-
-/* Sign-extend a uint64_t value. */
-inline static uint64_t sext(uint64_t val, uint8_t sign) {
-    uint64_t signbit, mask;
 
-    signbit = 1ull << (sign - 1);
-    mask = ~0ull << sign;
-
-    return val & signbit ? val | mask : val & ~mask;
+    ptErrataErr = pt_cpu_errata(&ptErrata, &ptCpu);
 }
 
-__attribute__((hot)) inline static void perf_ptAnalyzePkt(run_t* run, struct pt_packet* packet) {
+__attribute__((hot)) inline static size_t perf_ptAnalyzePkt(
+    struct pt_packet* packet, uint64_t cutOff, uint8_t* bitmap) {
     if (packet->type != ppt_tip) {
-        return;
+        return 0;
     }
 
     uint64_t ip;
@@ -115,67 +549,95 @@ __attribute__((hot)) inline static void perf_ptAnalyzePkt(run_t* run, struct pt_
             ip = packet->payload.ip.ip;
             break;
         default:
-            return;
+            return 0;
     }
 
-    if (ip >= run->global->linux.dynamicCutOffAddr) {
-        return;
-    }
-
-    ip &= _HF_PERF_BITMAP_BITSZ_MASK;
-    register uint8_t prev = ATOMIC_BTS(run->global->feedback.feedbackMap->bbMapPc, ip);
-    if (!prev) {
-        run->linux.hwCnts.newBBCnt++;
-    }
-    return;
+    return perf_ptMarkIp(ip, cutOff, bitmap);
 }
 
-void arch_ptAnalyze(run_t* run) {
-    struct perf_event_mmap_page* pem = (struct perf_event_mmap_page*)run->linux.perfMmapBuf;
-
-    uint64_t aux_tail = ATOMIC_GET(pem->aux_tail);
-    uint64_t aux_head = ATOMIC_GET(pem->aux_head);
-
-    /* smp_rmb() required as per /usr/include/linux/perf_event.h */
-    rmb();
+void* perf_ptAllocDecoder(uint8_t* buf, size_t len) {
+    if (ptErrataErr < 0) {
+        LOG_F("pt_cpu_errata() failed: %s", pt_errstr(-ptErrataErr));
+    }
 
     struct pt_config ptc;
     pt_config_init(&ptc);
-    ptc.begin = &run->linux.perfMmapAux[aux_tail];
-    ptc.end = &run->linux.perfMmapAux[aux_head];
+    ptc.begin = buf;
+    ptc.end = buf + len;
     ptc.cpu = ptCpu;
-
-    int errcode = pt_cpu_errata(&ptc.errata, &ptc.cpu);
-    if (errcode < 0) {
-        LOG_F("pt_errata() failed: %s", pt_errstr(-errcode));
-    }
+    ptc.errata = ptErrata;
 
     struct pt_packet_decoder* ptd = pt_pkt_alloc_decoder(&ptc);
     if (ptd == NULL) {
         LOG_F("pt_pkt_alloc_decoder() failed");
     }
-    defer {
-        pt_pkt_free_decoder(ptd);
-    };
+    return ptd;
+}
 
-    errcode = pt_pkt_sync_forward(ptd);
+void perf_ptFreeDecoder(void* ptd) {
+    pt_pkt_free_decoder((struct pt_packet_decoder*)ptd);
+}
+
+size_t perf_ptDecodeTip(
+    void* decoder, uint64_t off, uint64_t end, uint64_t cutOff, uint8_t* bitmap) {
+    struct pt_packet_decoder* ptd = (struct pt_packet_decoder*)decoder;
+
+    /* The trace of a freshly enabled event starts with a PSB, so no need to search for one */
+    int errcode = pt_pkt_sync_set(ptd, off);
     if (errcode < 0) {
-        LOG_W("pt_pkt_sync_forward() failed: %s", pt_errstr(-errcode));
-        return;
+        LOG_W("pt_pkt_sync_set(offset=%" PRIu64 ") failed: %s", off, pt_errstr(-errcode));
+        return 0;
     }
 
+    size_t newBits = 0;
     for (;;) {
+        errcode = pt_pkt_get_offset(ptd, &off);
+        if (errcode < 0) {
+            LOG_W("pt_pkt_get_offset() failed: %s", pt_errstr(-errcode));
+            break;
+        }
+        /* Data past 'end' is a leftover from previous iterations */
+        if (off >= end) {
+            break;
+        }
+
         struct pt_packet packet;
         errcode = pt_pkt_next(ptd, &packet, sizeof(packet));
         if (errcode == -pte_eos) {
             break;
         }
         if (errcode < 0) {
-            LOG_W("pt_pkt_next() failed: %s", pt_errstr(-errcode));
-            break;
+            LOG_D("pt_pkt_next() failed: %s, re-synchronizing", pt_errstr(-errcode));
+            errcode = pt_pkt_sync_forward(ptd);
+            if (errcode < 0) {
+                break;
+            }
+            continue;
         }
-        perf_ptAnalyzePkt(run, &packet);
+        newBits += perf_ptAnalyzePkt(&packet, cutOff, bitmap);
+    }
+    return newBits;
+}
+
+/*
+ * The decoder is configured once per perf AUX mapping and spans the whole buffer, as libipt doesn't
+ * allow to change the begin/end of an existing decoder. Every analysis seeks it to 'off' instead
+ */
+static void arch_ptAnalyzeLibipt(run_t* run, size_t off, size_t len) {
+    if (run->linux.ptDecoder == NULL) {
+        run->linux.ptDecoder =
+            perf_ptAllocDecoder(run->linux.perfMmapAux, run->global->linux.perfAuxSz);
+    }
+    run->linux.hwCnts.newBBCnt += perf_ptDecodeTip(run->linux.ptDecoder, off, off + len,
+        run->global->linux.dynamicCutOffAddr, run->feedbackMap->bbMapPc);
+}
+
+void arch_ptClose(run_t* run) {
+    if (run->linux.ptDecoder == NULL) {
+        return;
     }
+    perf_ptFreeDecoder(run->linux.ptDecoder);
+    run->linux.ptDecoder = NULL;
 }
 
 #else /* _HF_LINUX_INTEL_PT_LIB */
@@ -184,9 +646,29 @@ void perf_ptInit(void) {
     return;
 }
 
-void arch_ptAnalyze(run_t* fuzzer HF_ATTR_UNUSED) {
+static void arch_ptAnalyzeLibipt(
+    run_t* run HF_ATTR_UNUSED, size_t off HF_ATTR_UNUSED, size_t len HF_ATTR_UNUSED) {
     LOG_F(
         "The program has not been linked against the Intel's Processor Trace Library (libipt.so)");
 }
 
+void arch_ptClose(run_t* run HF_ATTR_UNUSED) {
+    return;
+}
+
 #endif /* _HF_LINUX_INTEL_PT_LIB */
+
+void arch_ptAnalyze(run_t* run, size_t off, size_t len) {
+    if (run->global->linux.ptCfg != NULL) {
+        run->linux.hwCnts.newBBCnt += perf_ptScanEdges(&run->linux.perfMmapAux[off], len,
+            (const ptCfg_t*)run->global->linux.ptCfg, run->global->linux.dynamicCutOffAddr,
+            run->feedbackMap->bbMapPc);
+        return;
+    }
+    if (run->global->linux.ptLibipt) {
+        arch_ptAnalyzeLibipt(run, off, len);
+        return;
+    }
+    run->linux.hwCnts.newBBCnt += perf_ptScanTip(&run->linux.perfMmapAux[off], len,
+        run->global->linux.dynamicCutOffAddr, run->feedbackMap->bbMapPc);
+}
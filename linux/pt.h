@@ -26,7 +26,54 @@
 
 #include "honggfuzz.h"
 
-extern void arch_ptAnalyze(run_t* run);
+/* Branches of the fuzzed binary, as needed for following the PT trace with --linux_perf_ipt_edge */
+typedef enum {
+    PT_BR_COND = 0,
+    PT_BR_JMP,
+    PT_BR_CALL,
+    /* Indirect jumps and calls, returns and far transfers: the target comes with a TIP packet */
+    PT_BR_INDIRECT,
+} ptBranchType_t;
+
+typedef struct {
+    uint64_t addr;
+    uint64_t target;
+    uint8_t len;
+    uint8_t type;
+} ptBranch_t;
+
+typedef struct {
+    /* Sorted by addr */
+    ptBranch_t* branches;
+    size_t cnt;
+    uint64_t start;
+    uint64_t end;
+} ptCfg_t;
+
+/* Analyzes 'len' bytes of the PT trace, starting at offset 'off' of the perf AUX area */
+extern void arch_ptAnalyze(run_t* run, size_t off, size_t len);
+extern void arch_ptClose(run_t* run);
+
+/*
+ * Sets bits in 'bitmap' for the IPs (below 'cutOff') of all TIP packets found in the raw PT trace,
+ * and returns the number of bits which were not set before. It doesn't need libipt
+ */
+extern size_t perf_ptScanTip(const uint8_t* buf, size_t len, uint64_t cutOff, uint8_t* bitmap);
+
+/*
+ * Follows the raw PT trace (TNT and TIP packets) over the branches in 'cfg', and sets bits in
+ * 'bitmap' for the taken edges, hashed the same way as the Intel BTS ones
+ */
+extern size_t perf_ptScanEdges(
+    const uint8_t* buf, size_t len, const ptCfg_t* cfg, uint64_t cutOff, uint8_t* bitmap);
+
+#ifdef _HF_LINUX_INTEL_PT_LIB
+/* The same with the libipt's packet decoder, kept as a slower reference implementation */
+extern void* perf_ptAllocDecoder(uint8_t* buf, size_t len);
+extern void perf_ptFreeDecoder(void* ptd);
+extern size_t perf_ptDecodeTip(
+    void* ptd, uint64_t off, uint64_t end, uint64_t cutOff, uint8_t* bitmap);
+#endif /* _HF_LINUX_INTEL_PT_LIB */
 extern void perf_ptInit(void);
 
 #ifndef BIT
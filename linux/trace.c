@@ -30,11 +30,13 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
+#include <sys/param.h>
 #include <sys/personality.h>
 #include <sys/ptrace.h>
 #include <sys/resource.h>
@@ -48,12 +50,14 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "input.h"
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
 #include "linux/bfd.h"
 #include "linux/unwind.h"
+#include "report.h"
 #include "sanitizers.h"
 #include "socketfuzzer.h"
 #include "subproc.h"
@@ -73,12 +77,6 @@
 #define REG_PD "0x%016"
 #endif
 
-/*
- * Size in characters required to store a string representation of a
- * register value (0xdeadbeef style))
- */
-#define REGSIZEINCHAR (2 * sizeof(REG_TYPE) + 3)
-
 #if defined(__i386__) || defined(__x86_64__)
 #define MAX_INSTR_SZ 16
 #elif defined(__arm__) || defined(__powerpc__) || defined(__powerpc64__)
@@ -288,6 +286,14 @@ extern const char* sys_sigabbrev[];
 
 static __thread char arch_signame[32];
 static const char* arch_sigName(int signo) {
+    /* Described by the sanitizer's death callback, with --linux_inprocess_crash */
+    if (signo == 0) {
+        return "SAN";
+    }
+    /* Only the OOM killer's SIGKILLs are saved as crashes, see arch_traceOomAnalyze() */
+    if (signo == SIGKILL) {
+        return "OOM";
+    }
     if (signo < 0 || signo > _NSIG) {
         snprintf(arch_signame, sizeof(arch_signame), "UNKNOWN-%d", signo);
         return arch_signame;
@@ -539,16 +545,8 @@ static void arch_getInstrStr(pid_t pid, REG_TYPE* pc, char* instr) {
 static void arch_hashCallstack(run_t* run, funcs_t* funcs, size_t funcCnt, bool enableMasking) {
     uint64_t hash = 0;
     for (size_t i = 0; i < funcCnt && i < run->global->linux.numMajorFrames; i++) {
-        /*
-         * Convert PC to char array to be compatible with hash function
-         */
-        char pcStr[REGSIZEINCHAR] = {0};
-        snprintf(pcStr, REGSIZEINCHAR, REG_PD REG_PM, (REG_TYPE)(long)funcs[i].pc);
-
-        /*
-         * Hash the last three nibbles
-         */
-        hash ^= util_hash(&pcStr[strlen(pcStr) - 3], 3);
+        hash = util_hashFrame(hash, (uint64_t)(uintptr_t)funcs[i].pc, funcs[i].mapOff,
+            funcs[i].mapName);
     }
 
     /*
@@ -563,39 +561,94 @@ static void arch_hashCallstack(run_t* run, funcs_t* funcs, size_t funcCnt, bool
     run->backtrace = hash;
 }
 
-static void arch_traceGenerateReport(
-    pid_t pid, run_t* run, funcs_t* funcs, size_t funcCnt, siginfo_t* si, const char* instr) {
-    run->report[0] = '\0';
-    util_ssnprintf(run->report, sizeof(run->report), "ORIG_FNAME: %s\n", run->origFileName);
-    util_ssnprintf(run->report, sizeof(run->report), "FUZZ_FNAME: %s\n", run->crashFileName);
-    util_ssnprintf(run->report, sizeof(run->report), "PID: %d\n", pid);
-    util_ssnprintf(run->report, sizeof(run->report), "SIGNAL: %s (%d)\n",
-        arch_sigName(si->si_signo), si->si_signo);
-    util_ssnprintf(run->report, sizeof(run->report), "FAULT ADDRESS: %p\n",
-        SI_FROMUSER(si) ? NULL : si->si_addr);
-    util_ssnprintf(run->report, sizeof(run->report), "INSTRUCTION: %s\n", instr);
-    util_ssnprintf(
-        run->report, sizeof(run->report), "STACK HASH: %016" PRIx64 "\n", run->backtrace);
-    util_ssnprintf(run->report, sizeof(run->report), "STACK:\n");
-    for (size_t i = 0; i < funcCnt; i++) {
+/*
+ * A crash of the main worker, captured while the process was stopped. Its further analysis (the
+ * symbols, the blacklists, the crash file and the report) doesn't need the process anymore, so
+ * with --linux_triage_threads it's done by the triage threads, and the worker resumes fuzzing
+ */
+typedef struct traceCrash {
+    honggfuzz_t* global;
+    /* NULL, if the crash is analyzed by a triage thread */
+    run_t* run;
+    pid_t pid;
+    siginfo_t si;
+    REG_TYPE pc;
+    uint64_t backtrace;
+    bool saveUnique;
+    /* Symbols and the instruction are yet to be resolved (from linux.exeFd) */
+    bool resolve;
+    uint8_t instrMem[MAX_INSTR_SZ];
+    size_t instrMemSz;
+    char instr[_HF_INSTR_SZ];
+    funcs_t* funcs;
+    size_t funcCnt;
+    const uint8_t* data;
+    size_t dataSz;
+    const char* origFileName;
+    char* crashFileName;
+    char* report;
+    struct traceCrash* next;
+} traceCrash_t;
+
+#define _HF_TRIAGE_QUEUE_MAX 256
+#define _HF_TRIAGE_THREADS_MAX 64
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    traceCrash_t* head;
+    traceCrash_t* tail;
+    size_t cnt;
+    bool enabled;
+    bool done;
+    pthread_t threads[_HF_TRIAGE_THREADS_MAX];
+    size_t threadsCnt;
+} triageq = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .notEmpty = PTHREAD_COND_INITIALIZER,
+    .notFull = PTHREAD_COND_INITIALIZER,
+    .head = NULL,
+    .tail = NULL,
+    .cnt = 0,
+    .enabled = false,
+    .done = false,
+    .threadsCnt = 0,
+};
+
+static void arch_traceGenerateReport(traceCrash_t* c) {
+    char* report = c->report;
+    c->report[0] = '\0';
+    util_ssnprintf(report, _HF_REPORT_SIZE, "ORIG_FNAME: %s\n", c->origFileName);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "FUZZ_FNAME: %s\n", c->crashFileName);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "PID: %d\n", c->pid);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "SIGNAL: %s (%d)\n", arch_sigName(c->si.si_signo),
+        c->si.si_signo);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "FAULT ADDRESS: %p\n",
+        SI_FROMUSER(&c->si) ? NULL : c->si.si_addr);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "PC: " REG_PD REG_PM "\n", c->pc);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "INSTRUCTION: %s\n", c->instr);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "STACK HASH: %016" PRIx64 "\n", c->backtrace);
+    util_ssnprintf(report, _HF_REPORT_SIZE, "STACK:\n");
+    for (size_t i = 0; i < c->funcCnt; i++) {
+        funcs_t* f = &c->funcs[i];
 #ifdef __HF_USE_CAPSTONE__
-        util_ssnprintf(
-            run->report, sizeof(run->report), " <" REG_PD REG_PM "> ", (REG_TYPE)(long)funcs[i].pc);
-        if (funcs[i].func[0] != '\0')
-            util_ssnprintf(run->report, sizeof(run->report), "[%s() + 0x%x at %s]\n", funcs[i].func,
-                funcs[i].line, funcs[i].mapName);
+        util_ssnprintf(report, _HF_REPORT_SIZE, " <" REG_PD REG_PM "> ", (REG_TYPE)(long)f->pc);
+        if (f->func[0] != '\0')
+            util_ssnprintf(report, _HF_REPORT_SIZE, "[%s() + 0x%x at %s]\n", f->func, f->line,
+                f->mapName);
         else
-            util_ssnprintf(run->report, sizeof(run->report), "[]\n");
+            util_ssnprintf(report, _HF_REPORT_SIZE, "[]\n");
 #else
-        util_ssnprintf(run->report, sizeof(run->report), " <" REG_PD REG_PM "> [%s():%zu at %s]\n",
-            (REG_TYPE)(long)funcs[i].pc, funcs[i].func, funcs[i].line, funcs[i].mapName);
+        util_ssnprintf(report, _HF_REPORT_SIZE, " <" REG_PD REG_PM "> [%s():%zu at %s]\n",
+            (REG_TYPE)(long)f->pc, f->func, f->line, f->mapName);
 #endif
     }
 
 // libunwind is not working for 32bit targets in 64bit systems
 #if defined(__aarch64__)
-    if (funcCnt == 0) {
-        util_ssnprintf(run->report, sizeof(run->report),
+    if (c->funcCnt == 0) {
+        util_ssnprintf(report, _HF_REPORT_SIZE,
             " !ERROR: If 32bit fuzz target"
             " in aarch64 system, try ARM 32bit build\n");
     }
@@ -648,59 +701,208 @@ static void arch_traceAnalyzeData(run_t* run, pid_t pid) {
     arch_hashCallstack(run, funcs, funcCnt, false);
 }
 
-static void arch_traceSaveData(run_t* run, pid_t pid) {
-    REG_TYPE pc = 0;
+/* Checks the blacklists, saves the crash file and generates the report of an unwound crash */
+static void arch_traceSaveCrash(traceCrash_t* c) {
+    honggfuzz_t* hfuzz = c->global;
+    bool saveUnique = c->saveUnique;
+    REG_TYPE pc = c->pc;
 
-    /* Local copy since flag is overridden for some crashes */
-    bool saveUnique = run->global->io.saveUnique;
+#if !defined(__ANDROID__)
+    if (c->resolve) {
+        char fname[PATH_MAX];
+        snprintf(fname, sizeof(fname), "/proc/self/fd/%d", hfuzz->linux.exeFd);
+        if (c->instrMemSz == 0) {
+            snprintf(c->instr, sizeof(c->instr), "%s", "[NOT_MMAPED]");
+        } else {
+            arch_bfdDisasmFile(fname, c->instrMem, c->instrMemSz, c->instr);
+        }
+        arch_bfdResolveSymsFile(fname, c->funcs, c->funcCnt);
+    }
+#endif
 
-    char instr[_HF_INSTR_SZ] = "\x00";
-    siginfo_t si;
-    bzero(&si, sizeof(si));
+    /*
+     * Check if backtrace contains whitelisted symbol. Whitelist overrides
+     * both stackhash and symbol blacklist. Crash is always kept regardless
+     * of the status of uniqueness flag.
+     */
+    if (hfuzz->linux.symsWl) {
+        char* wlSymbol = arch_btContainsSymbol(
+            hfuzz->linux.symsWlCnt, hfuzz->linux.symsWl, c->funcCnt, c->funcs);
+        if (wlSymbol != NULL) {
+            saveUnique = false;
+            LOG_D("Whitelisted symbol '%s' found, skipping blacklist checks", wlSymbol);
+        }
+    } else {
+        /*
+         * Check if stackhash is blacklisted
+         */
+        if (input_isBlacklisted(hfuzz, c->backtrace)) {
+            LOG_I("Blacklisted stack hash '%" PRIx64 "', skipping", c->backtrace);
+            ATOMIC_POST_INC(hfuzz->cnts.blCrashesCnt);
+            return;
+        }
 
-    if (ptrace(PTRACE_GETSIGINFO, pid, 0, &si) == -1) {
-        PLOG_W("Couldn't get siginfo for pid %d", pid);
+        /*
+         * Check if backtrace contains blacklisted symbol
+         */
+        char* blSymbol = arch_btContainsSymbol(
+            hfuzz->linux.symsBlCnt, hfuzz->linux.symsBl, c->funcCnt, c->funcs);
+        if (blSymbol != NULL) {
+            LOG_I("Blacklisted symbol '%s' found, skipping", blSymbol);
+            ATOMIC_POST_INC(hfuzz->cnts.blCrashesCnt);
+            return;
+        }
     }
 
-    arch_getInstrStr(pid, &pc, instr);
+    /* If non-blacklisted crash detected, zero set two MSB */
+    ATOMIC_POST_ADD(hfuzz->cfg.dynFileIterExpire, _HF_DYNFILE_SUB_MASK);
 
-    LOG_D("Pid: %d, signo: %d, errno: %d, code: %d, addr: %p, pc: %" REG_PM ", instr: '%s'", pid,
-        si.si_signo, si.si_errno, si.si_code, si.si_addr, pc, instr);
+    void* sig_addr = c->si.si_addr;
+    if (!hfuzz->linux.disableRandomization) {
+        pc = 0UL;
+        sig_addr = NULL;
+    }
 
-    if (!SI_FROMUSER(&si) && pc && si.si_addr < run->global->linux.ignoreAddr) {
-        LOG_I("Input is interesting (%s), but the si.si_addr is %p (below %p), skipping",
-            arch_sigName(si.si_signo), si.si_addr, run->global->linux.ignoreAddr);
+    /* User-induced signals don't set si.si_addr */
+    if (SI_FROMUSER(&c->si)) {
+        sig_addr = NULL;
+    }
+
+    /* If dry run mode, copy file with same name into workspace */
+    if (hfuzz->mutate.mutationsPerRun == 0U && hfuzz->cfg.useVerifier) {
+        snprintf(c->crashFileName, PATH_MAX, "%s/%s", hfuzz->io.crashDir, c->origFileName);
+    } else if (saveUnique) {
+        snprintf(c->crashFileName, PATH_MAX,
+            "%s/%s.PC.%" REG_PM ".STACK.%" PRIx64 ".CODE.%d.ADDR.%p.INSTR.%s.%s",
+            hfuzz->io.crashDir, arch_sigName(c->si.si_signo), pc, c->backtrace, c->si.si_code,
+            sig_addr, c->instr, hfuzz->io.fileExtn);
+    } else {
+        char localtmstr[PATH_MAX];
+        util_getLocalTime("%F.%H:%M:%S", localtmstr, sizeof(localtmstr), time(NULL));
+        snprintf(c->crashFileName, PATH_MAX,
+            "%s/%s.PC.%" REG_PM ".STACK.%" PRIx64 ".CODE.%d.ADDR.%p.INSTR.%s.%s.%d.%s",
+            hfuzz->io.crashDir, arch_sigName(c->si.si_signo), pc, c->backtrace, c->si.si_code,
+            sig_addr, c->instr, localtmstr, c->pid, hfuzz->io.fileExtn);
+    }
+
+    /* Target crashed (no duplicate detection yet) */
+    if (hfuzz->socketFuzzer.enabled) {
+        LOG_D("SocketFuzzer: trace: Crash Identified");
+    }
+
+    if (files_exists(c->crashFileName)) {
+        LOG_I("Crash (dup): '%s' already exists, skipping", c->crashFileName);
+        // Clear filename so that verifier can understand we hit a duplicate
+        memset(c->crashFileName, 0, PATH_MAX);
         return;
     }
 
-    /*
-     * Unwind and resolve symbols
-     */
-    funcs_t* funcs = util_Malloc(_HF_MAX_FUNCS * sizeof(funcs_t));
-    defer {
-        free(funcs);
-    };
-    memset(funcs, 0, _HF_MAX_FUNCS * sizeof(funcs_t));
+    if (!files_writeBufToFile(
+            c->crashFileName, c->data, c->dataSz, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC)) {
+        LOG_E("Couldn't write to '%s'", c->crashFileName);
+        return;
+    }
 
-#if !defined(__ANDROID__)
-    size_t funcCnt = arch_unwindStack(pid, funcs);
-    arch_bfdResolveSyms(pid, funcs, funcCnt);
-#else
-    size_t funcCnt = arch_unwindStack(pid, funcs);
-#endif
+    /* Unique new crash, notify fuzzer */
+    if (hfuzz->socketFuzzer.enabled && c->run) {
+        LOG_D("SocketFuzzer: trace: New Uniqu Crash");
+        fuzz_notifySocketFuzzerCrash(c->run);
+    }
+    LOG_I("Crash: saved as '%s'", c->crashFileName);
+
+    ATOMIC_POST_INC(hfuzz->cnts.uniqueCrashesCnt);
+    /* If unique crash found, reset dynFile counter */
+    ATOMIC_CLEAR(hfuzz->cfg.dynFileIterExpire);
+
+    arch_traceGenerateReport(c);
+}
+
+static void arch_traceCrashFree(traceCrash_t* c) {
+    free(c->funcs);
+    free((void*)c->data);
+    free(c);
+}
+
+static void* arch_traceTriageThread(void* arg HF_ATTR_UNUSED) {
+    for (;;) {
+        traceCrash_t* c;
+        {
+            MX_SCOPED_LOCK(&triageq.mutex);
+            while (triageq.head == NULL && !triageq.done) {
+                pthread_cond_wait(&triageq.notEmpty, &triageq.mutex);
+            }
+            if (triageq.head == NULL && triageq.done) {
+                break;
+            }
+            c = triageq.head;
+            triageq.head = c->next;
+            if (triageq.head == NULL) {
+                triageq.tail = NULL;
+            }
+            triageq.cnt--;
+            pthread_cond_signal(&triageq.notFull);
+        }
 
+        arch_traceSaveCrash(c);
+        report_ReportStr(c->global, c->report);
+        arch_traceCrashFree(c);
+    }
+
+    LOG_D("The crash triage thread has finished");
+    return NULL;
+}
+
+/* Hands the crash over to the triage threads, with copies of the data it references */
+static void arch_traceTriageEnqueue(run_t* run, traceCrash_t* crash) {
+    traceCrash_t* c = util_Malloc(sizeof(traceCrash_t) + PATH_MAX * 2 + _HF_REPORT_SIZE);
+    *c = *crash;
+    char* bufs = (char*)&c[1];
+    c->run = NULL;
+    c->origFileName = bufs;
+    c->crashFileName = bufs + PATH_MAX;
+    c->report = bufs + PATH_MAX * 2;
+    snprintf(bufs, PATH_MAX, "%s", run->origFileName);
+    c->crashFileName[0] = '\0';
+    c->report[0] = '\0';
+    c->funcs = util_Malloc(MAX(c->funcCnt, 1U) * sizeof(funcs_t));
+    memcpy(c->funcs, crash->funcs, c->funcCnt * sizeof(funcs_t));
+    uint8_t* data = util_Malloc(MAX(c->dataSz, 1U));
+    memcpy(data, crash->data, c->dataSz);
+    c->data = data;
+    c->next = NULL;
+
+    MX_SCOPED_LOCK(&triageq.mutex);
+    while (triageq.cnt == _HF_TRIAGE_QUEUE_MAX) {
+        pthread_cond_wait(&triageq.notFull, &triageq.mutex);
+    }
+    if (triageq.tail) {
+        triageq.tail->next = c;
+    } else {
+        triageq.head = c;
+    }
+    triageq.tail = c;
+    triageq.cnt++;
+    pthread_cond_signal(&triageq.notEmpty);
+}
+
+/*
+ * The part of the crash analysis which is common to the unwound (ptrace) and to the self-described
+ * (--linux_inprocess_crash) crashes: the stack hash, the deduplication of crashes of other threads
+ * of the process, and saving the crash (here, or by the triage threads)
+ */
+static void arch_traceSaveFrames(run_t* run, traceCrash_t* crash) {
     /*
      * If unwinder failed (zero frames), use PC from ptrace GETREGS if not zero.
      * If PC reg zero, temporarily disable uniqueness flag since callstack
      * hash will be also zero, thus not safe for unique decisions.
      */
-    if (funcCnt == 0) {
-        if (pc) {
+    if (crash->funcCnt == 0) {
+        if (crash->pc) {
             /* Manually update major frame PC & frames counter */
-            funcs[0].pc = (void*)(uintptr_t)pc;
-            funcCnt = 1;
+            crash->funcs[0].pc = (void*)(uintptr_t)crash->pc;
+            crash->funcCnt = 1;
         } else {
-            saveUnique = false;
+            crash->saveUnique = false;
         }
     }
 
@@ -713,21 +915,23 @@ static void arch_traceSaveData(run_t* run, pid_t pid) {
     /*
      * Calculate backtrace callstack hash signature
      */
-    arch_hashCallstack(run, funcs, funcCnt, saveUnique);
+    arch_hashCallstack(run, crash->funcs, crash->funcCnt, crash->saveUnique);
 
     /*
      * If unique flag is set and single frame crash, disable uniqueness for this crash
      * to always save (timestamp will be added to the filename)
      */
-    if (saveUnique && (funcCnt == 1)) {
-        saveUnique = false;
+    if (crash->saveUnique && (crash->funcCnt == 1)) {
+        crash->saveUnique = false;
     }
 
     /*
      * If worker crashFileName member is set, it means that a tid has already crashed
-     * from target master thread.
+     * from target master thread. The triage threads don't set it, so the previous backtrace is
+     * used instead.
      */
-    if (run->crashFileName[0] != '\0') {
+    bool async = ATOMIC_GET(triageq.enabled);
+    if (run->crashFileName[0] != '\0' || (async && oldBacktrace != 0)) {
         LOG_D("Multiple crashes detected from worker against attached tids group");
 
         /*
@@ -743,125 +947,354 @@ static void arch_traceSaveData(run_t* run, pid_t pid) {
     /* Increase global crashes counter */
     ATOMIC_POST_INC(run->global->cnts.crashesCnt);
 
+    crash->backtrace = run->backtrace;
+    crash->data = run->dynamicFile;
+    crash->dataSz = run->dynamicFileSz;
+    crash->origFileName = run->origFileName;
+    crash->crashFileName = run->crashFileName;
+    crash->report = run->report;
+    crash->next = NULL;
+
+    if (async) {
+        arch_traceTriageEnqueue(run, crash);
+        return;
+    }
+    arch_traceSaveCrash(crash);
+}
+
+static void arch_traceSaveData(run_t* run, pid_t pid) {
+    REG_TYPE pc = 0;
+
+    /* Local copy since flag is overridden for some crashes */
+    bool saveUnique = run->global->io.saveUnique;
+
+    char instr[_HF_INSTR_SZ] = "\x00";
+    siginfo_t si;
+    bzero(&si, sizeof(si));
+
+    if (ptrace(PTRACE_GETSIGINFO, pid, 0, &si) == -1) {
+        PLOG_W("Couldn't get siginfo for pid %d", pid);
+    }
+
+    /* The triage threads disassemble the instruction themselves, only read it here */
+    bool async = ATOMIC_GET(triageq.enabled);
+    uint8_t instrMem[MAX_INSTR_SZ];
+    size_t instrMemSz = 0;
+    if (async) {
+        REG_TYPE status_reg = 0;
+        snprintf(instr, sizeof(instr), "%s", "[UNKNOWN]");
+        if (arch_getPC(pid, &pc, &status_reg)) {
+            instrMemSz = arch_getProcMem(pid, instrMem, sizeof(instrMem), pc);
+        }
+    } else {
+        arch_getInstrStr(pid, &pc, instr);
+    }
+
+    LOG_D("Pid: %d, signo: %d, errno: %d, code: %d, addr: %p, pc: %" REG_PM ", instr: '%s'", pid,
+        si.si_signo, si.si_errno, si.si_code, si.si_addr, pc, instr);
+
+    if (!SI_FROMUSER(&si) && pc && si.si_addr < run->global->linux.ignoreAddr) {
+        LOG_I("Input is interesting (%s), but the si.si_addr is %p (below %p), skipping",
+            arch_sigName(si.si_signo), si.si_addr, run->global->linux.ignoreAddr);
+        return;
+    }
+
     /*
-     * Check if backtrace contains whitelisted symbol. Whitelist overrides
-     * both stackhash and symbol blacklist. Crash is always kept regardless
-     * of the status of uniqueness flag.
+     * Unwind and resolve symbols
      */
-    if (run->global->linux.symsWl) {
-        char* wlSymbol = arch_btContainsSymbol(
-            run->global->linux.symsWlCnt, run->global->linux.symsWl, funcCnt, funcs);
-        if (wlSymbol != NULL) {
-            saveUnique = false;
-            LOG_D("Whitelisted symbol '%s' found, skipping blacklist checks", wlSymbol);
+    funcs_t* funcs = util_Malloc(_HF_MAX_FUNCS * sizeof(funcs_t));
+    defer {
+        free(funcs);
+    };
+    memset(funcs, 0, _HF_MAX_FUNCS * sizeof(funcs_t));
+
+#if !defined(__ANDROID__)
+    size_t funcCnt = arch_unwindStack(pid, funcs);
+    if (!async) {
+        arch_bfdResolveSyms(pid, funcs, funcCnt);
+    }
+#else
+    size_t funcCnt = arch_unwindStack(pid, funcs);
+#endif
+
+    traceCrash_t crash = {
+        .global = run->global,
+        .run = run,
+        .pid = pid,
+        .si = si,
+        .pc = pc,
+        .saveUnique = saveUnique,
+        .resolve = async,
+        .instrMemSz = instrMemSz,
+        .funcs = funcs,
+        .funcCnt = funcCnt,
+    };
+    memcpy(crash.instrMem, instrMem, instrMemSz);
+    snprintf(crash.instr, sizeof(crash.instr), "%s", instr);
+    arch_traceSaveFrames(run, &crash);
+}
+
+void arch_traceInprocReset(run_t* run) {
+    ATOMIC_SET(run->feedbackMap->crashRec[run->fuzzNo].valid, 0U);
+}
+
+/*
+ * With --linux_inprocess_crash: the (untraced) process was killed by 'signo', or exited with the
+ * sanitizer exit code (signo == 0). If it described the crash in its crash record, the crash is
+ * analyzed as if it was unwound, otherwise only the signal is known. That's also the case of the
+ * processes killed by the OOM killer (signo == SIGKILL)
+ */
+static void arch_traceInprocAnalyze(run_t* run, pid_t pid, int signo) {
+    crashRec_t* rec = &run->feedbackMap->crashRec[run->fuzzNo];
+    defer {
+        arch_traceInprocReset(run);
+    };
+
+    funcs_t* funcs = util_Calloc(_HF_MAX_FUNCS * sizeof(funcs_t));
+    defer {
+        free(funcs);
+    };
+    siginfo_t si;
+    memset(&si, 0, sizeof(si));
+    si.si_signo = signo;
+    REG_TYPE pc = 0;
+    size_t funcCnt = 0;
+    size_t instrMemSz = 0;
+
+    if (ATOMIC_GET_ACQUIRE(rec->valid) && rec->pid == pid) {
+        si.si_code = rec->code;
+        si.si_addr = (void*)(uintptr_t)rec->addr;
+        pc = (REG_TYPE)rec->pc;
+        instrMemSz = MIN((size_t)rec->instrSz, (size_t)MAX_INSTR_SZ);
+        for (uint32_t i = 0; i < rec->frameCnt && i < _HF_CRASHREC_FRAMES_MAX; i++) {
+            const crashFrame_t* f = &rec->frames[i];
+            funcs[funcCnt].pc = (void*)(uintptr_t)f->pc;
+            funcs[funcCnt].mapOff = (uintptr_t)f->modOff;
+            snprintf(funcs[funcCnt].mapName, sizeof(funcs[funcCnt].mapName), "%.*s",
+                (int)sizeof(f->module), f->module);
+            funcCnt++;
         }
     } else {
-        /*
-         * Check if stackhash is blacklisted
-         */
-        if (run->global->feedback.blacklist &&
-            (fastArray64Search(run->global->feedback.blacklist, run->global->feedback.blacklistCnt,
-                 run->backtrace) != -1)) {
-            LOG_I("Blacklisted stack hash '%" PRIx64 "', skipping", run->backtrace);
-            ATOMIC_POST_INC(run->global->cnts.blCrashesCnt);
-            return;
-        }
+        LOG_D("pid=%d (signal: %d) left no crash record", (int)pid, signo);
+    }
 
-        /*
-         * Check if backtrace contains blacklisted symbol
-         */
-        char* blSymbol = arch_btContainsSymbol(
-            run->global->linux.symsBlCnt, run->global->linux.symsBl, funcCnt, funcs);
-        if (blSymbol != NULL) {
-            LOG_I("Blacklisted symbol '%s' found, skipping", blSymbol);
-            ATOMIC_POST_INC(run->global->cnts.blCrashesCnt);
-            return;
+    LOG_D("Pid: %d, signo: %d, code: %d, addr: %p, pc: %" REG_PM ", frames: %zu", (int)pid,
+        si.si_signo, si.si_code, si.si_addr, pc, funcCnt);
+
+    if (!run->mainWorker) {
+        /* Post crash analysis (e.g. crashes verifier), only the stack hash is needed */
+        if (funcCnt == 0 && pc) {
+            funcs[0].pc = (void*)(uintptr_t)pc;
+            funcCnt = 1;
         }
+        arch_hashCallstack(run, funcs, funcCnt, false);
+        return;
     }
 
-    /* If non-blacklisted crash detected, zero set two MSB */
-    ATOMIC_POST_ADD(run->global->cfg.dynFileIterExpire, _HF_DYNFILE_SUB_MASK);
+    if (!SI_FROMUSER(&si) && pc && si.si_addr < run->global->linux.ignoreAddr) {
+        LOG_I("Input is interesting (%s), but the si.si_addr is %p (below %p), skipping",
+            arch_sigName(si.si_signo), si.si_addr, run->global->linux.ignoreAddr);
+        return;
+    }
 
-    void* sig_addr = si.si_addr;
-    if (!run->global->linux.disableRandomization) {
-        pc = 0UL;
-        sig_addr = NULL;
+    traceCrash_t crash = {
+        .global = run->global,
+        .run = run,
+        .pid = pid,
+        .si = si,
+        .pc = pc,
+        .saveUnique = run->global->io.saveUnique,
+        /* Symbols and the instruction are resolved from the binary, as with the triage threads */
+        .resolve = true,
+        .instrMemSz = instrMemSz,
+        .funcs = funcs,
+        .funcCnt = funcCnt,
+    };
+    memcpy(crash.instrMem, rec->instr, instrMemSz);
+    snprintf(crash.instr, sizeof(crash.instr), "%s", "[UNKNOWN]");
+    arch_traceSaveFrames(run, &crash);
+}
+
+void arch_traceOomAnalyze(run_t* run, pid_t pid) {
+    LOG_I("pid=%d was killed by the OOM killer of its cgroup (memory.max: %" PRIu64 " MiB)",
+        (int)pid, run->global->linux.cgroupMem);
+    input_setBatchCrashInput(run);
+    arch_traceInprocAnalyze(run, pid, SIGKILL);
+}
+
+bool arch_traceTriageInit(honggfuzz_t* hfuzz) {
+    if (hfuzz->linux.triageThreads == 0) {
+        return true;
+    }
+#if defined(__ANDROID__)
+    LOG_W("--linux_triage_threads is not supported on Android, crashes will be analyzed by the "
+          "fuzzing threads");
+    return true;
+#endif
+    if (hfuzz->cfg.useVerifier || hfuzz->socketFuzzer.enabled || hfuzz->cfg.minimize) {
+        LOG_W("--linux_triage_threads can't be used with the crash verifier, the socket fuzzer "
+              "and the corpus minimization, crashes will be analyzed by the fuzzing threads");
+        return true;
     }
 
-    /* User-induced signals don't set si.si_addr */
-    if (SI_FROMUSER(&si)) {
-        sig_addr = NULL;
+    size_t threadsCnt = MIN(hfuzz->linux.triageThreads, (size_t)_HF_TRIAGE_THREADS_MAX);
+    for (size_t i = 0; i < threadsCnt; i++) {
+        if (!subproc_runThread(hfuzz, &triageq.threads[i], arch_traceTriageThread,
+                /* joinable= */ true)) {
+            LOG_E("Couldn't start the crash triage thread #%zu", i);
+            arch_traceTriageClose();
+            return false;
+        }
+        triageq.threadsCnt++;
     }
+    ATOMIC_SET(triageq.enabled, true);
+    LOG_I("Crashes will be analyzed by %zu triage threads", threadsCnt);
 
-    /* If dry run mode, copy file with same name into workspace */
-    if (run->global->mutate.mutationsPerRun == 0U && run->global->cfg.useVerifier) {
-        snprintf(run->crashFileName, sizeof(run->crashFileName), "%s/%s", run->global->io.crashDir,
-            run->origFileName);
-    } else if (saveUnique) {
-        snprintf(run->crashFileName, sizeof(run->crashFileName),
-            "%s/%s.PC.%" REG_PM ".STACK.%" PRIx64 ".CODE.%d.ADDR.%p.INSTR.%s.%s",
-            run->global->io.crashDir, arch_sigName(si.si_signo), pc, run->backtrace, si.si_code,
-            sig_addr, instr, run->global->io.fileExtn);
-    } else {
-        char localtmstr[PATH_MAX];
-        util_getLocalTime("%F.%H:%M:%S", localtmstr, sizeof(localtmstr), time(NULL));
-        snprintf(run->crashFileName, sizeof(run->crashFileName),
-            "%s/%s.PC.%" REG_PM ".STACK.%" PRIx64 ".CODE.%d.ADDR.%p.INSTR.%s.%s.%d.%s",
-            run->global->io.crashDir, arch_sigName(si.si_signo), pc, run->backtrace, si.si_code,
-            sig_addr, instr, localtmstr, pid, run->global->io.fileExtn);
+    return true;
+}
+
+void arch_traceTriageClose(void) {
+    {
+        MX_SCOPED_LOCK(&triageq.mutex);
+        if (triageq.done) {
+            return;
+        }
+        triageq.done = true;
+        pthread_cond_broadcast(&triageq.notEmpty);
+    }
+    for (size_t i = 0; i < triageq.threadsCnt; i++) {
+        pthread_join(triageq.threads[i], NULL);
     }
+    ATOMIC_SET(triageq.enabled, false);
+}
 
-    /* Target crashed (no duplicate detection yet) */
-    if (run->global->socketFuzzer.enabled) {
-        LOG_D("SocketFuzzer: trace: Crash Identified");
+#define _HF_SAN_BUF_SZ (1024 * 256)
+#define _HF_SAN_PIPE_SZ (1024 * 1024)
+static const char arch_sanHeader[] = "==ERROR: ";
+
+bool arch_traceSanInit(run_t* run) {
+    run->linux.sanFd = -1;
+    run->linux.sanWrFd = -1;
+    run->linux.sanBuf = NULL;
+    run->linux.sanBufLen = 0;
+    run->linux.sanReportOff = -1;
+
+    if (!run->global->sanitizer.enable) {
+        return true;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1) {
+        PLOG_E("pipe2(O_CLOEXEC|O_NONBLOCK)");
+        return false;
+    }
+    /* The target blocks on a full pipe rather than losing parts of the report */
+    if (fcntl(fds[1], F_SETFL, 0) == -1) {
+        PLOG_E("fcntl(%d, F_SETFL, 0)", fds[1]);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
     }
+    /* Best effort, so a typical report fits in the pipe before we get to read it */
+    if (fcntl(fds[0], F_SETPIPE_SZ, _HF_SAN_PIPE_SZ) == -1) {
+        PLOG_D("fcntl(%d, F_SETPIPE_SZ, %d)", fds[0], _HF_SAN_PIPE_SZ);
+    }
+    run->linux.sanFd = fds[0];
+    run->linux.sanWrFd = fds[1];
+    run->linux.sanBuf = util_Malloc(_HF_SAN_BUF_SZ);
+    return true;
+}
 
-    if (files_exists(run->crashFileName)) {
-        LOG_I("Crash (dup): '%s' already exists, skipping", run->crashFileName);
-        // Clear filename so that verifier can understand we hit a duplicate
-        memset(run->crashFileName, 0, sizeof(run->crashFileName));
+/* Makes space in the full buffer, keeping a report (from its header on) if there's one */
+static void arch_traceSanCompact(run_t* run) {
+    size_t from;
+    if (run->linux.sanReportOff == 0) {
+        /* The report fills the whole buffer, the rest of it will be dropped */
         return;
+    } else if (run->linux.sanReportOff > 0) {
+        from = (size_t)run->linux.sanReportOff;
+        run->linux.sanReportOff = 0;
+    } else {
+        /* Only the last, incomplete, line can still become the header */
+        const char* nl = memrchr(run->linux.sanBuf, '\n', run->linux.sanBufLen);
+        from = nl ? (size_t)(nl - run->linux.sanBuf) + 1 : run->linux.sanBufLen;
     }
+    memmove(run->linux.sanBuf, &run->linux.sanBuf[from], run->linux.sanBufLen - from);
+    run->linux.sanBufLen -= from;
+}
 
-    if (!files_writeBufToFile(run->crashFileName, run->dynamicFile, run->dynamicFileSz,
-            O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC)) {
-        LOG_E("Couldn't write to '%s'", run->crashFileName);
+void arch_traceSanDrain(run_t* run) {
+    if (run->linux.sanFd == -1) {
         return;
     }
+    for (;;) {
+        if (run->linux.sanBufLen == _HF_SAN_BUF_SZ) {
+            arch_traceSanCompact(run);
+        }
+        bool full = (run->linux.sanBufLen == _HF_SAN_BUF_SZ);
+        char scratch[4096];
+        char* dst = full ? scratch : &run->linux.sanBuf[run->linux.sanBufLen];
+        size_t room = full ? sizeof(scratch) : _HF_SAN_BUF_SZ - run->linux.sanBufLen;
 
-    /* Unique new crash, notify fuzzer */
-    if (run->global->socketFuzzer.enabled) {
-        LOG_D("SocketFuzzer: trace: New Uniqu Crash");
-        fuzz_notifySocketFuzzerCrash(run);
-    }
-    LOG_I("Crash: saved as '%s'", run->crashFileName);
+        ssize_t sz = TEMP_FAILURE_RETRY(read(run->linux.sanFd, dst, room));
+        if (sz <= 0) {
+            return;
+        }
+        /* It's the target's stderr too */
+        if (!run->global->exe.nullifyStdio) {
+            files_writeToFd(STDERR_FILENO, (const uint8_t*)dst, (size_t)sz);
+        }
+        if (full) {
+            continue;
+        }
 
-    ATOMIC_POST_INC(run->global->cnts.uniqueCrashesCnt);
-    /* If unique crash found, reset dynFile counter */
-    ATOMIC_CLEAR(run->global->cfg.dynFileIterExpire);
+        /* Re-scan the tail of the previous data, the header might span two reads */
+        size_t scanFrom = run->linux.sanBufLen;
+        scanFrom = (scanFrom >= sizeof(arch_sanHeader)) ? scanFrom - sizeof(arch_sanHeader) : 0;
+        run->linux.sanBufLen += (size_t)sz;
+        if (run->linux.sanReportOff != -1) {
+            continue;
+        }
+        const char* hdr = memmem(&run->linux.sanBuf[scanFrom], run->linux.sanBufLen - scanFrom,
+            arch_sanHeader, strlen(arch_sanHeader));
+        if (hdr == NULL) {
+            continue;
+        }
+        /* The line's beginning, i.e. '==<pid>==ERROR: ...' */
+        while (hdr > run->linux.sanBuf && hdr[-1] != '\n') {
+            hdr--;
+        }
+        run->linux.sanReportOff = hdr - run->linux.sanBuf;
+    }
+}
 
-    arch_traceGenerateReport(pid, run, funcs, funcCnt, &si, instr);
+void arch_traceSanReset(run_t* run) {
+    arch_traceSanDrain(run);
+    run->linux.sanBufLen = 0;
+    run->linux.sanReportOff = -1;
 }
 
 /* TODO: Add report parsing support for other sanitizers too */
 static int arch_parseAsanReport(
     run_t* run, pid_t pid, funcs_t* funcs, void** crashAddr, char** op) {
-    char crashReport[PATH_MAX] = {0};
-    const char* const crashReportCpy = crashReport;
-    snprintf(
-        crashReport, sizeof(crashReport), "%s/%s.%d", run->global->io.workDir, kLOGPREFIX, pid);
+    arch_traceSanDrain(run);
+    if (run->linux.sanReportOff == -1) {
+        LOG_D("No sanitizer report from pid=%d", (int)pid);
+        return -1;
+    }
+    /* The report is consumed, with or without stack frames found in it */
+    defer {
+        arch_traceSanReset(run);
+    };
 
-    FILE* fReport = fopen(crashReport, "rb");
+    FILE* fReport = fmemopen(&run->linux.sanBuf[run->linux.sanReportOff],
+        run->linux.sanBufLen - (size_t)run->linux.sanReportOff, "rb");
     if (fReport == NULL) {
-        PLOG_D("Couldn't open '%s' - R/O mode", crashReport);
+        PLOG_W("fmemopen(sz=%zu)", run->linux.sanBufLen - (size_t)run->linux.sanReportOff);
         return -1;
     }
     defer {
         fclose(fReport);
     };
-    defer {
-        unlink(crashReportCpy);
-    };
 
     char header[35] = {0};
     snprintf(header, sizeof(header), "==%d==ERROR: AddressSanitizer:", pid);
@@ -994,8 +1427,11 @@ static void arch_traceExitSaveData(run_t* run, pid_t pid) {
     };
     memset(funcs, 0, _HF_MAX_FUNCS * sizeof(funcs_t));
 
-    /* Sanitizers save reports against parent PID */
-    if (run->pid != pid) {
+    /*
+     * Sanitizers save reports against parent PID. With the fork-server and with snapshots, the
+     * crashing process is a (single-threaded, at least initially) child of run->pid
+     */
+    if (run->pid != pid && pid != run->snapshotPid && !run->global->exe.forkServer) {
         return;
     }
     funcCnt = arch_parseAsanReport(run, pid, funcs, &crashAddr, &op);
@@ -1024,9 +1460,7 @@ static void arch_traceExitSaveData(run_t* run, pid_t pid) {
     /*
      * Check if stackhash is blacklisted
      */
-    if (run->global->feedback.blacklist &&
-        (fastArray64Search(run->global->feedback.blacklist, run->global->feedback.blacklistCnt,
-             run->backtrace) != -1)) {
+    if (input_isBlacklisted(run->global, run->backtrace)) {
         LOG_I("Blacklisted stack hash '%" PRIx64 "', skipping", run->backtrace);
         ATOMIC_POST_INC(run->global->cnts.blCrashesCnt);
         return;
@@ -1092,6 +1526,8 @@ static void arch_traceExitSaveData(run_t* run, pid_t pid) {
     if (funcCnt > 0) {
         util_ssnprintf(
             run->report, sizeof(run->report), "STACK HASH: %016" PRIx64 "\n", run->backtrace);
+        util_ssnprintf(run->report, sizeof(run->report), "PC: " REG_PD REG_PM "\n",
+            (REG_TYPE)(long)funcs[0].pc);
         util_ssnprintf(run->report, sizeof(run->report), "STACK:\n");
         for (int i = 0; i < funcCnt; i++) {
             util_ssnprintf(run->report, sizeof(run->report), " <" REG_PD REG_PM "> ",
@@ -1186,6 +1622,7 @@ void arch_traceAnalyze(run_t* run, int status, pid_t pid) {
          * If it's an interesting signal, save the testcase
          */
         if (arch_sigs[WSTOPSIG(status)].important) {
+            input_setBatchCrashInput(run);
             /*
              * If fuzzer worker is from core fuzzing process run full
              * analysis. Otherwise just unwind and get stack hash signature.
@@ -1217,12 +1654,24 @@ void arch_traceAnalyze(run_t* run, int status, pid_t pid) {
          * Target exited with sanitizer defined exitcode (used when SIGABRT is not monitored)
          */
         if (WEXITSTATUS(status) == (unsigned long)HF_SAN_EXIT_CODE) {
-            arch_traceExitAnalyze(run, pid);
+            input_setBatchCrashInput(run);
+            /* Reports of sanitizers other than ASan are not parsed, the crash record can help */
+            arch_traceSanDrain(run);
+            if (run->global->linux.inprocCrash && run->linux.sanReportOff == -1) {
+                arch_traceInprocAnalyze(run, pid, 0);
+            } else {
+                arch_traceExitAnalyze(run, pid);
+            }
         }
         return;
     }
 
     if (WIFSIGNALED(status)) {
+        /* Untraced processes (--linux_inprocess_crash) are analyzed only after they're gone */
+        if (run->global->linux.inprocCrash && arch_sigs[WTERMSIG(status)].important) {
+            input_setBatchCrashInput(run);
+            arch_traceInprocAnalyze(run, pid, WTERMSIG(status));
+        }
         return;
     }
 
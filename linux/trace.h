@@ -42,5 +42,21 @@ extern void arch_traceDetach(pid_t pid);
 extern void arch_traceGetCustomPerf(run_t* run, pid_t pid, uint64_t* cnt);
 extern void arch_traceSetCustomPerf(run_t* run, pid_t pid, uint64_t cnt);
 extern void arch_traceSignalsInit(honggfuzz_t* hfuzz);
+/*
+ * With sanitizers, their reports (log_path=stderr) reach us through a pipe, which is the target's
+ * stderr. It's read as the data arrives, and only the lines since the most recent report header
+ * are kept, for arch_traceExitAnalyze()
+ */
+extern bool arch_traceSanInit(run_t* run);
+extern void arch_traceSanDrain(run_t* run);
+extern void arch_traceSanReset(run_t* run);
+/* Forgets the crash described by the previous process with --linux_inprocess_crash */
+extern void arch_traceInprocReset(run_t* run);
+/* The process was killed by the OOM killer of its cgroup, see linux/cgroup.h */
+extern void arch_traceOomAnalyze(run_t* run, pid_t pid);
+/* Starts the --linux_triage_threads, which analyze the crashes of the fuzzing threads */
+extern bool arch_traceTriageInit(honggfuzz_t* hfuzz);
+/* Waits until all queued crashes are analyzed, and terminates the triage threads */
+extern void arch_traceTriageClose(void);
 
 #endif
@@ -24,14 +24,19 @@
 #include "linux/unwind.h"
 
 #include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <libunwind-ptrace.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "honggfuzz.h"
 #include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
 
 /*
  * WARNING: Ensure that _UPT-info structs are not shared between threads
@@ -56,76 +61,200 @@ static const char* UNW_ER[] = {
 typedef struct {
     unsigned long start;
     unsigned long end;
-    char perms[6];
     unsigned long offset;
-    char dev[8];
-    unsigned long inode;
-    char name[PATH_MAX];
+    /* Points into mapsCache.arena */
+    const char* name;
 } procMap_t;
 
-static procMap_t* arch_parsePidMaps(pid_t pid, size_t* mapsCount) {
-    FILE* f = NULL;
-    char fProcMaps[PATH_MAX] = {0};
-    snprintf(fProcMaps, PATH_MAX, "/proc/%d/maps", pid);
+/*
+ * The parsed /proc/<pid>/maps of the process most recently unwound by this thread. The layout
+ * rarely changes between crashes of the same (e.g. persistent) process, so it's reused as long as
+ * the pid and its start time (which tells reused pids apart) match, and it's re-read if a frame
+ * falls outside of the known mappings (e.g. after dlopen())
+ */
+static __thread struct {
+    pid_t pid;
+    unsigned long long startTime;
+    char* arena;
+    size_t arenaSz;
+    procMap_t* maps;
+    size_t mapsCnt;
+    size_t mapsCap;
+} mapsCache = {
+    .pid = 0,
+    .startTime = 0,
+    .arena = NULL,
+    .arenaSz = 0,
+    .maps = NULL,
+    .mapsCnt = 0,
+    .mapsCap = 0,
+};
 
-    if ((f = fopen(fProcMaps, "rb")) == NULL) {
-        PLOG_E("Couldn't open '%s' - R/O mode", fProcMaps);
-        return 0;
+/* Reads the whole /proc file into mapsCache.arena, returns its size */
+static ssize_t arch_readProcFile(const char* fname) {
+    int fd = TEMP_FAILURE_RETRY(open(fname, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        PLOG_E("Couldn't open '%s' - R/O mode", fname);
+        return -1;
     }
     defer {
-        fclose(f);
+        close(fd);
     };
 
-    *mapsCount = 0;
-    procMap_t* mapsList = malloc(sizeof(procMap_t));
-    if (mapsList == NULL) {
-        PLOG_W("malloc(size='%zu')", sizeof(procMap_t));
-        return NULL;
-    }
-
-    while (!feof(f)) {
-        char buf[sizeof(procMap_t) + 1];
-        if (fgets(buf, sizeof(buf), f) == 0) {
+    size_t len = 0;
+    for (;;) {
+        if (mapsCache.arenaSz - len < 4096) {
+            mapsCache.arenaSz = mapsCache.arenaSz ? mapsCache.arenaSz * 2 : (1024 * 64);
+            if ((mapsCache.arena = util_Realloc(mapsCache.arena, mapsCache.arenaSz)) == NULL) {
+                mapsCache.arenaSz = 0;
+                return -1;
+            }
+        }
+        /* Leave space for the terminating NUL */
+        ssize_t ret = TEMP_FAILURE_RETRY(
+            read(fd, &mapsCache.arena[len], mapsCache.arenaSz - len - 1));
+        if (ret == -1) {
+            PLOG_E("read('%s')", fname);
+            return -1;
+        }
+        if (ret == 0) {
             break;
         }
+        len += (size_t)ret;
+    }
+    mapsCache.arena[len] = '\0';
+    return (ssize_t)len;
+}
 
-        mapsList[*mapsCount].name[0] = '\0';
-        sscanf(buf, "%lx-%lx %5s %lx %7s %ld %s", &mapsList[*mapsCount].start,
-            &mapsList[*mapsCount].end, mapsList[*mapsCount].perms, &mapsList[*mapsCount].offset,
-            mapsList[*mapsCount].dev, &mapsList[*mapsCount].inode, mapsList[*mapsCount].name);
+/* Field #22 of /proc/<pid>/stat */
+static unsigned long long arch_pidStartTime(pid_t pid) {
+    char fname[PATH_MAX];
+    snprintf(fname, sizeof(fname), "/proc/%d/stat", pid);
+    char buf[1024];
+    ssize_t len = files_readFileToBufMax(fname, (uint8_t*)buf, sizeof(buf) - 1);
+    if (len <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+
+    /* The process name (field #2) can contain spaces and parentheses */
+    char* p = strrchr(buf, ')');
+    if (p == NULL) {
+        return 0;
+    }
+    unsigned long long startTime = 0;
+    if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d "
+                      "%*d %llu",
+            &startTime) != 1) {
+        return 0;
+    }
+    return startTime;
+}
 
-        *mapsCount += 1;
-        if ((mapsList = realloc(mapsList, (*mapsCount + 1) * sizeof(procMap_t))) == NULL) {
-            PLOG_W("realloc failed (sz=%zu)", (*mapsCount + 1) * sizeof(procMap_t));
-            free(mapsList);
-            return NULL;
+/*
+ * Parses the lines of /proc/<pid>/maps in place, i.e. the names are NUL-terminated in the arena:
+ *   start-end perms offset dev inode [name]
+ */
+static bool arch_parsePidMaps(pid_t pid) {
+    char fProcMaps[PATH_MAX];
+    snprintf(fProcMaps, sizeof(fProcMaps), "/proc/%d/maps", pid);
+
+    mapsCache.pid = 0;
+    mapsCache.mapsCnt = 0;
+    ssize_t len = arch_readProcFile(fProcMaps);
+    if (len < 0) {
+        return false;
+    }
+
+    for (char* line = mapsCache.arena; line < &mapsCache.arena[len] && *line;) {
+        char* eol = strchr(line, '\n');
+        if (eol) {
+            *eol = '\0';
+        }
+        char* next = eol ? eol + 1 : &mapsCache.arena[len];
+
+        char* p;
+        procMap_t map;
+        map.start = strtoul(line, &p, 16);
+        if (*p != '-') {
+            line = next;
+            continue;
+        }
+        map.end = strtoul(p + 1, &p, 16);
+        /* Skip the perms */
+        p += strspn(p, " ");
+        p += strcspn(p, " ");
+        map.offset = strtoul(p, &p, 16);
+        /* Skip the dev and the inode */
+        for (int i = 0; i < 2; i++) {
+            p += strspn(p, " ");
+            p += strcspn(p, " ");
+        }
+        p += strspn(p, " ");
+        map.name = p;
+
+        if (mapsCache.mapsCnt == mapsCache.mapsCap) {
+            mapsCache.mapsCap = mapsCache.mapsCap ? mapsCache.mapsCap * 2 : 256;
+            mapsCache.maps = util_Realloc(mapsCache.maps, mapsCache.mapsCap * sizeof(procMap_t));
+            if (mapsCache.maps == NULL) {
+                mapsCache.mapsCap = 0;
+                mapsCache.mapsCnt = 0;
+                return false;
+            }
         }
+        mapsCache.maps[mapsCache.mapsCnt++] = map;
+        line = next;
     }
 
-    return mapsList;
+    mapsCache.pid = pid;
+    return true;
 }
 
-static char* arch_searchMaps(unsigned long addr, size_t mapsCnt, procMap_t* mapsList) {
-    for (size_t i = 0; i < mapsCnt; i++) {
-        if (addr >= mapsList[i].start && addr <= mapsList[i].end) {
-            return mapsList[i].name;
-        }
+/* Makes sure that mapsCache describes the process */
+static void arch_getPidMaps(pid_t pid) {
+    unsigned long long startTime = arch_pidStartTime(pid);
+    if (mapsCache.pid == pid && mapsCache.startTime == startTime && startTime != 0) {
+        return;
+    }
+    if (arch_parsePidMaps(pid)) {
+        mapsCache.startTime = startTime;
+    }
+}
 
-        /* Benefit from maps being sorted by address */
-        if (addr < mapsList[i].start) {
-            break;
+/* Kernel lists the mappings sorted by their (non-overlapping) addresses */
+static procMap_t* arch_searchMaps(unsigned long addr) {
+    size_t lo = 0, hi = mapsCache.mapsCnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (addr < mapsCache.maps[mid].start) {
+            hi = mid;
+        } else if (addr >= mapsCache.maps[mid].end) {
+            lo = mid + 1;
+        } else {
+            return &mapsCache.maps[mid];
         }
     }
     return NULL;
 }
 
+/* Looks the address up, re-reading the maps once per unwind if it's not in any mapping */
+static procMap_t* arch_findMap(pid_t pid, unsigned long addr, bool* refreshed) {
+    procMap_t* map = arch_searchMaps(addr);
+    if (map == NULL && !*refreshed) {
+        *refreshed = true;
+        if (arch_parsePidMaps(pid)) {
+            mapsCache.startTime = arch_pidStartTime(pid);
+        }
+        map = arch_searchMaps(addr);
+    }
+    return map;
+}
+
 #ifndef __ANDROID__
 size_t arch_unwindStack(pid_t pid, funcs_t* funcs) {
-    size_t num_frames = 0, mapsCnt = 0;
-    procMap_t* mapsList = arch_parsePidMaps(pid, &mapsCnt);
-    defer {
-        free(mapsList);
-    };
+    size_t num_frames = 0;
+    bool mapsRefreshed = false;
+    arch_getPidMaps(pid);
 
     unw_addr_space_t as = unw_create_addr_space(&_UPT_accessors, __BYTE_ORDER);
     if (!as) {
@@ -154,7 +283,7 @@ size_t arch_unwindStack(pid_t pid, funcs_t* funcs) {
 
     for (num_frames = 0; unw_step(&c) > 0 && num_frames < _HF_MAX_FUNCS; num_frames++) {
         unw_word_t ip;
-        char* mapName = NULL;
+        procMap_t* map = NULL;
         ret = unw_get_reg(&c, UNW_REG_IP, &ip);
         if (ret < 0) {
             LOG_E("[pid='%d'] [%zd] failed to read IP (%s)", pid, num_frames, UNW_ER[-ret]);
@@ -162,8 +291,9 @@ size_t arch_unwindStack(pid_t pid, funcs_t* funcs) {
         } else {
             funcs[num_frames].pc = (void*)(uintptr_t)ip;
         }
-        if (mapsCnt > 0 && (mapName = arch_searchMaps(ip, mapsCnt, mapsList)) != NULL) {
-            memcpy(funcs[num_frames].mapName, mapName, sizeof(funcs[num_frames].mapName));
+        if ((map = arch_findMap(pid, ip, &mapsRefreshed)) != NULL) {
+            snprintf(funcs[num_frames].mapName, sizeof(funcs[num_frames].mapName), "%s", map->name);
+            funcs[num_frames].mapOff = ip - map->start + map->offset;
         } else {
             strncpy(funcs[num_frames].mapName, "UNKNOWN", sizeof(funcs[num_frames].mapName));
         }
@@ -174,11 +304,9 @@ size_t arch_unwindStack(pid_t pid, funcs_t* funcs) {
 
 #else  /* !defined(__ANDROID__) */
 size_t arch_unwindStack(pid_t pid, funcs_t* funcs) {
-    size_t num_frames = 0, mapsCnt = 0;
-    procMap_t* mapsList = arch_parsePidMaps(pid, &mapsCnt);
-    defer {
-        free(mapsList);
-    };
+    size_t num_frames = 0;
+    bool mapsRefreshed = false;
+    arch_getPidMaps(pid);
 
     unw_addr_space_t as = unw_create_addr_space(&_UPT_accessors, __BYTE_ORDER);
     if (!as) {
@@ -206,7 +334,7 @@ size_t arch_unwindStack(pid_t pid, funcs_t* funcs) {
     }
 
     do {
-        char* mapName = NULL;
+        procMap_t* map = NULL;
         unw_word_t pc = 0, offset = 0;
         char buf[_HF_FUNC_NAME_SZ] = {0};
 
@@ -239,8 +367,9 @@ size_t arch_unwindStack(pid_t pid, funcs_t* funcs) {
         funcs[num_frames].line = offset;
         funcs[num_frames].pc = (void*)pc;
         memcpy(funcs[num_frames].func, buf, sizeof(funcs[num_frames].func));
-        if (mapsCnt > 0 && (mapName = arch_searchMaps(pc, mapsCnt, mapsList)) != NULL) {
-            memcpy(funcs[num_frames].mapName, mapName, sizeof(funcs[num_frames].mapName));
+        if ((map = arch_findMap(pid, pc, &mapsRefreshed)) != NULL) {
+            snprintf(funcs[num_frames].mapName, sizeof(funcs[num_frames].mapName), "%s", map->name);
+            funcs[num_frames].mapOff = pc - map->start + map->offset;
         } else {
             strncpy(funcs[num_frames].mapName, "UNKNOWN", sizeof(funcs[num_frames].mapName));
         }
@@ -25,6 +25,7 @@
 #define _HF_LINUX_UNWIND_H_
 
 #include <linux/limits.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 /* String buffer size for function names in stack traces produced from libunwind */
@@ -42,6 +43,8 @@ typedef struct {
      * If ASan custom parsing it's retrieved from generated report file
      */
     char mapName[PATH_MAX];
+    /* Offset of pc in the mapped file, 0 if not known. Used to symbolize PIE binaries and DSOs */
+    uintptr_t mapOff;
 
     /*
      * If libunwind + bfd symbolizer, line is actual symbol file line
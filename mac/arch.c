@@ -29,20 +29,21 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <mach/i386/thread_status.h>
 #include <mach/mach.h>
 #include <mach/mach_types.h>
 #include <mach/mach_vm.h>
 #include <mach/task_info.h>
-#include <poll.h>
-#include <pthread.h>
 #include <servers/bootstrap.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
+#include <sys/event.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -53,6 +54,7 @@
 
 #include "fuzz.h"
 #include "honggfuzz.h"
+#include "input.h"
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
@@ -75,18 +77,13 @@
       threadStateCount:(mach_msg_type_number_t)aThreadStateCount;
 @end
 
-/*
- * Global to have exception port available in the collection thread
- */
-static mach_port_t g_exception_port = MACH_PORT_NULL;
-
 /*
  * From xnu/bsd/sys/proc_internal.h
  */
 #define PID_MAX 99999
 
 /*
- * Global to store crash info in exception handler thread
+ * Global to store crash info in exception handler (run by the fuzzing thread of the process)
  */
 run_t g_fuzzer_crash_information[PID_MAX + 1];
 
@@ -97,10 +94,15 @@ run_t g_fuzzer_crash_information[PID_MAX + 1];
 static char* g_fuzzer_crash_callstack[PID_MAX + 1];
 
 /*
- * Global to have a unique service name for each honggfuzz process
+ * Global to have a unique service name for each honggfuzz process, each fuzzing thread registers
+ * its own exception port as '<g_service_name>.<fuzzNo>'
  */
 char g_service_name[256];
 
+static void arch_serviceName(run_t* run, char* name, size_t len) {
+    snprintf(name, len, "%s.%" PRIu32, g_service_name, run->fuzzNo);
+}
+
 struct {
     bool important;
     const char* descr;
@@ -237,9 +239,7 @@ static void arch_analyzeSignal(run_t* run, int status) {
     /*
      * Check if stackhash is blacklisted
      */
-    if (run->global->feedback.blacklist &&
-        (fastArray64Search(run->global->feedback.blacklist, run->global->feedback.blacklistCnt,
-             run->backtrace) != -1)) {
+    if (input_isBlacklisted(run->global, run->backtrace)) {
         LOG_I("Blacklisted stack hash '%" PRIx64 "', skipping", run->backtrace);
         ATOMIC_POST_INC(run->global->cnts.blCrashesCnt);
         return;
@@ -291,25 +291,8 @@ pid_t arch_fork(run_t* run HF_ATTR_UNUSED) {
 }
 
 bool arch_launchChild(run_t* run) {
-#define ARGS_MAX 512
-    const char* args[ARGS_MAX + 2];
-    char argData[PATH_MAX];
-    const char inputFile[] = "/dev/fd/" HF_XSTR(_HF_INPUT_FD);
-
-    int x;
-    for (x = 0; x < ARGS_MAX && x < run->global->exe.argc; x++) {
-        if (!strcmp(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER)) {
-            args[x] = inputFile;
-        } else if (strstr(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER)) {
-            const char* off = strstr(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER);
-            snprintf(argData, sizeof(argData), "%.*s%s", (int)(off - run->global->exe.cmdline[x]),
-                run->global->exe.cmdline[x], inputFile);
-            args[x] = argData;
-        } else {
-            args[x] = run->global->exe.cmdline[x];
-        }
-    }
-    args[x++] = NULL;
+    /* Built once by the thread, see subproc_initExec() */
+    const char* const* args = run->execArgs;
 
     LOG_D("Launching '%s'", args[0]);
 
@@ -325,8 +308,10 @@ bool arch_launchChild(run_t* run) {
      * Get exception port.
      */
     mach_port_t exception_port = MACH_PORT_NULL;
+    char service_name[sizeof(g_service_name) + 16];
+    arch_serviceName(run, service_name, sizeof(service_name));
 
-    if (bootstrap_look_up(child_bootstrap, g_service_name, &exception_port) != KERN_SUCCESS) {
+    if (bootstrap_look_up(child_bootstrap, service_name, &exception_port) != KERN_SUCCESS) {
         return false;
     }
 
@@ -350,7 +335,23 @@ bool arch_launchChild(run_t* run) {
 void arch_prepareParent(run_t* run HF_ATTR_UNUSED) {
 }
 
-void arch_prepareParentAfterFork(run_t* run HF_ATTR_UNUSED) {
+static bool arch_kqAdd(
+    run_t* run, uintptr_t ident, int16_t filter, uint16_t flags, uint32_t fflags) {
+    struct kevent ev;
+    EV_SET(&ev, ident, filter, EV_ADD | flags, fflags, 0, NULL);
+    return (kevent(run->mac.kqFd, &ev, 1, NULL, 0, NULL) != -1);
+}
+
+void arch_prepareParentAfterFork(run_t* run) {
+    /* A new socket is created for every process, closing the old one removes it from the kqueue */
+    if (run->global->exe.persistent && !arch_kqAdd(run, run->persistentSock, EVFILT_READ, 0, 0)) {
+        PLOG_F("kevent(kq=%d, EVFILT_READ, fd=%d)", run->mac.kqFd, run->persistentSock);
+    }
+    /* ESRCH: it's gone already, and it'll be reaped without waiting for the event */
+    run->mac.procWatched = arch_kqAdd(run, run->pid, EVFILT_PROC, EV_ONESHOT, NOTE_EXIT);
+    if (!run->mac.procWatched) {
+        PLOG_D("kevent(kq=%d, EVFILT_PROC, pid=%d)", run->mac.kqFd, (int)run->pid);
+    }
 }
 
 static bool arch_checkWait(run_t* run) {
@@ -387,6 +388,38 @@ static bool arch_checkWait(run_t* run) {
     }
 }
 
+/*
+ * How long to wait for events: until the next time limit check is due. Without a time limit, up
+ * to 1s, as thread-directed pings (pthread_kill()) are not guaranteed to trigger EVFILT_SIGNAL
+ */
+static struct timespec* arch_reapTimeout(run_t* run, struct timespec* ts) {
+    int64_t deadline = subproc_timeLimitDeadline(run);
+    /* Past the deadline already, the process has been signaled, don't spin until it dies */
+    int64_t diff = deadline ? MAX(deadline - util_timeNowMillis() + 1, 10) : 1000;
+    ts->tv_sec = diff / 1000;
+    ts->tv_nsec = (diff % 1000) * 1000000;
+    return ts;
+}
+
+static void arch_reapWaitForEvents(run_t* run, struct timespec* ts) {
+    struct kevent evs[8];
+    int nevs = kevent(run->mac.kqFd, NULL, 0, evs, ARRAYSIZE(evs), ts);
+    if (nevs == -1 && errno != EINTR) {
+        PLOG_F("kevent(kq=%d)", run->mac.kqFd);
+    }
+    for (int i = 0; i < nevs; i++) {
+        /*
+         * A crash: the process waits for the reply before it exits, so the data for
+         * arch_analyzeSignal() is ready when it's reaped. Other events (EVFILT_PROC, EVFILT_READ,
+         * EVFILT_SIGNAL) only make the loop run again
+         */
+        if (evs[i].filter == EVFILT_MACHPORT) {
+            mach_msg_server_once(
+                mach_exc_server, 4096, run->mac.excPortSet, MACH_MSG_OPTION_NONE);
+        }
+    }
+}
+
 void arch_reapChild(run_t* run) {
     for (;;) {
         if (subproc_persistentModeStateMachine(run)) {
@@ -396,25 +429,19 @@ void arch_reapChild(run_t* run) {
         subproc_checkTimeLimit(run);
         subproc_checkTermination(run);
 
-        if (run->global->exe.persistent) {
-            struct pollfd pfd = {
-                .fd = run->persistentSock,
-                .events = POLLIN,
-            };
-            int r = poll(&pfd, 1, 250 /* 0.25s */);
-            if (r == 0 || (r == -1 && errno == EINTR)) {
-            }
-            if (r == -1 && errno != EINTR) {
-                PLOG_F("poll(fd=%d)", run->persistentSock);
-            }
-        } else {
-            /* Return with SIGIO, SIGCHLD */
-            int sig;
-            if (sigwait(&run->global->exe.waitSigSet, &sig) != 0) {
-                PLOG_F("sigwait(SIGIO|SIGCHLD)");
-            }
+        /*
+         * Without EVFILT_PROC (e.g. ESRCH, it's gone already) it's reaped with wait4() before each
+         * wait, and its exit still wakes the kqueue up with SIGCHLD (EVFILT_SIGNAL)
+         */
+        if (!run->mac.procWatched && arch_checkWait(run)) {
+            run->pid = 0;
+            break;
         }
 
+        /* Return on persistent socket data, a crash, the exit, SIGCHLD or the time limit */
+        struct timespec ts;
+        arch_reapWaitForEvents(run, arch_reapTimeout(run, &ts));
+
         if (arch_checkWait(run)) {
             run->pid = 0;
             break;
@@ -422,12 +449,6 @@ void arch_reapChild(run_t* run) {
     }
 }
 
-void* wait_for_exception() {
-    while (1) {
-        mach_msg_server_once(mach_exc_server, 4096, g_exception_port, MACH_MSG_OPTION_NONE);
-    }
-}
-
 /*
  * Called once before fuzzing starts. Prepare mach ports for attaching crash reporter.
  */
@@ -442,53 +463,11 @@ bool arch_archInit(honggfuzz_t* hfuzz) {
     }
 
     /*
-     * Allocate exception port.
-     */
-    if (mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &g_exception_port) !=
-        KERN_SUCCESS) {
-        return false;
-    }
-
-    /*
-     * Insert exception receive port.
-     */
-    if (mach_port_insert_right(mach_task_self(), g_exception_port, g_exception_port,
-            MACH_MSG_TYPE_MAKE_SEND) != KERN_SUCCESS) {
-        return false;
-    }
-
-    /*
-     * Get bootstrap port.
-     */
-    mach_port_t bootstrap = MACH_PORT_NULL;
-    if (task_get_bootstrap_port(mach_task_self(), &bootstrap) != KERN_SUCCESS) {
-        return false;
-    }
-
-    /*
-     * Generate and register exception port service.
+     * Generate the exception port service name, the ports are registered by the fuzzing threads
+     * (arch_archThreadInit())
      */
     snprintf(g_service_name, sizeof(g_service_name), "com.google.code.honggfuzz.%d",
         (int)util_rndGet(0, 999999));
-    if (bootstrap_check_in(bootstrap, g_service_name, &g_exception_port) != KERN_SUCCESS) {
-        return false;
-    }
-
-    /*
-     * Create a collection thread to catch the exceptions from the
-     * children
-     */
-    pthread_t exception_thread;
-
-    if (pthread_create(&exception_thread, NULL, wait_for_exception, 0)) {
-        LOG_F("Parent: could not create thread to wait for child's exception");
-        return false;
-    }
-
-    if (pthread_detach(exception_thread)) {
-        LOG_F("Parent: could not detach thread to wait for child's exception");
-        return false;
-    }
 
     /* Default is true for all platforms except Android */
     arch_sigs[SIGABRT].important = hfuzz->cfg.monitorSIGABRT;
@@ -778,6 +757,62 @@ kern_return_t catch_mach_exception_raise_state_identity(
     return KERN_SUCCESS;
 }
 
-bool arch_archThreadInit(run_t* run HF_ATTR_UNUSED) {
+/*
+ * The thread waits for its processes with a kqueue: their exits (EVFILT_PROC), the persistent
+ * socket (EVFILT_READ), the pings from the main thread (EVFILT_SIGNAL) and the crashes, delivered
+ * to its own exception port (EVFILT_MACHPORT)
+ */
+bool arch_archThreadInit(run_t* run) {
+    run->mac.procWatched = false;
+    if ((run->mac.kqFd = kqueue()) == -1) {
+        PLOG_E("kqueue()");
+        return false;
+    }
+    if (fcntl(run->mac.kqFd, F_SETFD, FD_CLOEXEC) == -1) {
+        PLOG_W("fcntl(%d, F_SETFD, FD_CLOEXEC)", run->mac.kqFd);
+    }
+
+    mach_port_t bootstrap = MACH_PORT_NULL;
+    if (task_get_bootstrap_port(mach_task_self(), &bootstrap) != KERN_SUCCESS) {
+        LOG_E("task_get_bootstrap_port() failed");
+        return false;
+    }
+
+    /*
+     * Register the exception port service of this thread, it's looked up by its processes
+     */
+    char service_name[sizeof(g_service_name) + 16];
+    arch_serviceName(run, service_name, sizeof(service_name));
+    mach_port_t exception_port = MACH_PORT_NULL;
+    if (bootstrap_check_in(bootstrap, service_name, &exception_port) != KERN_SUCCESS) {
+        LOG_E("bootstrap_check_in('%s') failed", service_name);
+        return false;
+    }
+
+    /*
+     * In a port set, as not all versions of kqueue's EVFILT_MACHPORT watch individual ports
+     */
+    mach_port_t port_set = MACH_PORT_NULL;
+    if (mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_PORT_SET, &port_set) !=
+        KERN_SUCCESS) {
+        LOG_E("mach_port_allocate(MACH_PORT_RIGHT_PORT_SET) failed");
+        return false;
+    }
+    if (mach_port_insert_member(mach_task_self(), exception_port, port_set) != KERN_SUCCESS) {
+        LOG_E("mach_port_insert_member('%s') failed", service_name);
+        return false;
+    }
+    run->mac.excPortSet = port_set;
+
+    if (!arch_kqAdd(run, port_set, EVFILT_MACHPORT, 0, 0)) {
+        PLOG_E("kevent(kq=%d, EVFILT_MACHPORT)", run->mac.kqFd);
+        return false;
+    }
+    /* SIGCHLD is blocked in the fuzzing threads, kqueue records its delivery nonetheless */
+    if (!arch_kqAdd(run, SIGCHLD, EVFILT_SIGNAL, 0, 0)) {
+        PLOG_E("kevent(kq=%d, EVFILT_SIGNAL, SIGCHLD)", run->mac.kqFd);
+        return false;
+    }
+
     return true;
 }
@@ -24,12 +24,14 @@
 
 #include "mangle.h"
 
+#include <ctype.h>
 #include <inttypes.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -38,6 +40,38 @@
 #include "libhfcommon/common.h"
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
+#include "mutator.h"
+
+/* Records the change of run->dynamicFile, so input_prepareDynamicInput() can undo just that */
+static inline void mangle_Journal(run_t* run, size_t off, size_t len) {
+    mangleJournal_t* j = &run->journal;
+    if (j->dynfile == NULL || j->cnt > _HF_JOURNAL_MAX || len == 0) {
+        return;
+    }
+    if (j->cnt > 0) {
+        size_t lastOff = j->ranges[j->cnt - 1].off;
+        size_t lastEnd = lastOff + j->ranges[j->cnt - 1].len;
+        if (off >= lastOff && off <= lastEnd) {
+            j->ranges[j->cnt - 1].len = MAX(lastEnd, off + len) - lastOff;
+            return;
+        }
+    }
+    if (j->cnt < _HF_JOURNAL_MAX) {
+        j->ranges[j->cnt].off = off;
+        j->ranges[j->cnt].len = len;
+    }
+    j->cnt++;
+}
+
+/* Shrinking can zero the tail of the file (ftruncate), growing exposes bytes to be overwritten */
+static inline void mangle_SetSize(run_t* run, size_t sz) {
+    if (sz < run->dynamicFileSz) {
+        mangle_Journal(run, sz, run->dynamicFileSz - sz);
+    } else {
+        mangle_Journal(run, run->dynamicFileSz, sz - run->dynamicFileSz);
+    }
+    input_setSize(run, sz);
+}
 
 static inline void mangle_Overwrite(run_t* run, const uint8_t* src, size_t off, size_t sz) {
     size_t maxToCopy = run->dynamicFileSz - off;
@@ -45,6 +79,7 @@ static inline void mangle_Overwrite(run_t* run, const uint8_t* src, size_t off,
         sz = maxToCopy;
     }
 
+    mangle_Journal(run, off, sz);
     memmove(&run->dynamicFile[off], src, sz);
 }
 
@@ -66,6 +101,7 @@ static inline void mangle_Move(run_t* run, size_t off_from, size_t off_to, size_
         len = len_to;
     }
 
+    mangle_Journal(run, off_to, len);
     memmove(&run->dynamicFile[off_to], &run->dynamicFile[off_from], len);
 }
 
@@ -77,8 +113,9 @@ static void mangle_Inflate(run_t* run, size_t off, size_t len, bool printable) {
         len = run->global->mutate.maxFileSz - run->dynamicFileSz;
     }
 
-    input_setSize(run, run->dynamicFileSz + len);
+    mangle_SetSize(run, run->dynamicFileSz + len);
     mangle_Move(run, off, off + len, run->dynamicFileSz);
+    mangle_Journal(run, off, len);
     if (printable) {
         util_rndBufPrintable(&run->dynamicFile[off], len);
     } else {
@@ -111,51 +148,60 @@ static void mangle_Bytes(run_t* run, bool printable) {
 
 static void mangle_Bit(run_t* run, bool printable) {
     size_t off = util_rndGet(0, run->dynamicFileSz - 1);
+    mangle_Journal(run, off, 1);
     run->dynamicFile[off] ^= (uint8_t)(1U << util_rndGet(0, 7));
     if (printable) {
         util_turnToPrintable(&(run->dynamicFile[off]), 1);
     }
 }
 
-static void mangle_DictionaryInsertNoCheck(run_t* run, bool printable) {
-    uint64_t choice = util_rndGet(0, run->global->mutate.dictionaryCnt - 1);
-    struct strings_t* str = TAILQ_FIRST(&run->global->mutate.dictq);
-    for (uint64_t i = 0; i < choice; i++) {
-        str = TAILQ_NEXT(str, pointers);
+/*
+ * Picks a random word from the dictionary. The ones found with --cmplog (following the --dict ones)
+ * are skipped if they are not printable, and only printable inputs are generated
+ */
+static bool mangle_DictionaryPick(run_t* run, const uint8_t** val, size_t* len, bool printable) {
+    size_t cnt = ATOMIC_GET_ACQUIRE(run->global->mutate.dict.cnt);
+    if (cnt == 0) {
+        return false;
     }
 
-    size_t off = util_rndGet(0, run->dynamicFileSz - 1);
-    mangle_Inflate(run, off, str->len, printable);
-    mangle_Overwrite(run, (uint8_t*)str->s, off, str->len);
+    size_t choice = util_rndGet(0, cnt - 1);
+    const dictEntry_t* e = &run->global->mutate.dict.entries[choice];
+    const uint8_t* v = &run->global->mutate.dict.arena[e->off];
+    bool checkPrintable = printable && (choice >= run->global->mutate.dict.staticCnt);
+    for (size_t i = 0; checkPrintable && i < e->len; i++) {
+        if (!isprint(v[i])) {
+            return false;
+        }
+    }
+    *val = v;
+    *len = e->len;
+    return true;
 }
 
 static void mangle_DictionaryInsert(run_t* run, bool printable) {
-    if (run->global->mutate.dictionaryCnt == 0) {
+    const uint8_t* val;
+    size_t len;
+    if (!mangle_DictionaryPick(run, &val, &len, printable)) {
         mangle_Bit(run, printable);
         return;
     }
-    mangle_DictionaryInsertNoCheck(run, printable);
-}
 
-static void mangle_DictionaryNoCheck(run_t* run) {
     size_t off = util_rndGet(0, run->dynamicFileSz - 1);
-
-    uint64_t choice = util_rndGet(0, run->global->mutate.dictionaryCnt - 1);
-    struct strings_t* str = TAILQ_FIRST(&run->global->mutate.dictq);
-    for (uint64_t i = 0; i < choice; i++) {
-        str = TAILQ_NEXT(str, pointers);
-    }
-
-    mangle_Overwrite(run, (uint8_t*)str->s, off, str->len);
+    mangle_Inflate(run, off, len, printable);
+    mangle_Overwrite(run, val, off, len);
 }
 
 static void mangle_Dictionary(run_t* run, bool printable) {
-    if (run->global->mutate.dictionaryCnt == 0) {
+    const uint8_t* val;
+    size_t len;
+    if (!mangle_DictionaryPick(run, &val, &len, printable)) {
         mangle_Bit(run, printable);
         return;
     }
 
-    mangle_DictionaryNoCheck(run);
+    size_t off = util_rndGet(0, run->dynamicFileSz - 1);
+    mangle_Overwrite(run, val, off, len);
 }
 
 static void mangle_Magic(run_t* run, bool printable) {
@@ -401,6 +447,7 @@ static void mangle_Magic(run_t* run, bool printable) {
     mangle_Overwrite(run, mangleMagicVals[choice].val, off, mangleMagicVals[choice].size);
 
     if (printable) {
+        mangle_Journal(run, off, mangleMagicVals[choice].size);
         util_turnToPrintable(&run->dynamicFile[off], mangleMagicVals[choice].size);
     }
 }
@@ -409,6 +456,7 @@ static void mangle_MemSetWithVal(run_t* run, int val) {
     size_t off = util_rndGet(0, run->dynamicFileSz - 1);
     size_t sz = util_rndGet(1, run->dynamicFileSz - off);
 
+    mangle_Journal(run, off, sz);
     memset(&run->dynamicFile[off], val, sz);
 }
 
@@ -420,6 +468,7 @@ static void mangle_MemSet(run_t* run, bool printable) {
 static void mangle_Random(run_t* run, bool printable) {
     size_t off = util_rndGet(0, run->dynamicFileSz - 1);
     size_t len = util_rndGet(1, run->dynamicFileSz - off);
+    mangle_Journal(run, off, len);
     if (printable) {
         util_rndBufPrintable(&run->dynamicFile[off], len);
     } else {
@@ -433,6 +482,7 @@ static void mangle_AddSubWithRange(run_t* run, size_t off, uint64_t varLen) {
 
     switch (varLen) {
         case 1: {
+            mangle_Journal(run, off, 1);
             run->dynamicFile[off] += delta;
             return;
             break;
@@ -500,12 +550,14 @@ static void mangle_AddSub(run_t* run, bool printable) {
 
     mangle_AddSubWithRange(run, off, varLen);
     if (printable) {
+        mangle_Journal(run, off, varLen);
         util_turnToPrintable((uint8_t*)&run->dynamicFile[off], varLen);
     }
 }
 
 static void mangle_IncByte(run_t* run, bool printable) {
     size_t off = util_rndGet(0, run->dynamicFileSz - 1);
+    mangle_Journal(run, off, 1);
     if (printable) {
         run->dynamicFile[off] = (run->dynamicFile[off] - 32 + 1) % 95 + 32;
     } else {
@@ -515,6 +567,7 @@ static void mangle_IncByte(run_t* run, bool printable) {
 
 static void mangle_DecByte(run_t* run, bool printable) {
     size_t off = util_rndGet(0, run->dynamicFileSz - 1);
+    mangle_Journal(run, off, 1);
     if (printable) {
         run->dynamicFile[off] = (run->dynamicFile[off] - 32 + 94) % 95 + 32;
     } else {
@@ -524,6 +577,7 @@ static void mangle_DecByte(run_t* run, bool printable) {
 
 static void mangle_NegByte(run_t* run, bool printable) {
     size_t off = util_rndGet(0, run->dynamicFileSz - 1);
+    mangle_Journal(run, off, 1);
     if (printable) {
         run->dynamicFile[off] = 94 - (run->dynamicFile[off] - 32) + 32;
     } else {
@@ -535,6 +589,8 @@ static void mangle_CloneByte(run_t* run, bool printable HF_ATTR_UNUSED) {
     size_t off1 = util_rndGet(0, run->dynamicFileSz - 1);
     size_t off2 = util_rndGet(0, run->dynamicFileSz - 1);
 
+    mangle_Journal(run, off1, 1);
+    mangle_Journal(run, off2, 1);
     uint8_t tmp = run->dynamicFile[off1];
     run->dynamicFile[off1] = run->dynamicFile[off2];
     run->dynamicFile[off2] = tmp;
@@ -555,7 +611,7 @@ static void mangle_Shrink(run_t* run, bool printable HF_ATTR_UNUSED) {
     size_t len = util_rndGet(1, run->dynamicFileSz - 1);
     size_t off = util_rndGet(0, len);
 
-    input_setSize(run, run->dynamicFileSz - len);
+    mangle_SetSize(run, run->dynamicFileSz - len);
     mangle_Move(run, off + len, off, run->dynamicFileSz);
 }
 
@@ -585,7 +641,7 @@ static void mangle_Resize(run_t* run, bool printable) {
         newsz = run->global->mutate.maxFileSz;
     }
 
-    input_setSize(run, (size_t)newsz);
+    mangle_SetSize(run, (size_t)newsz);
     if (newsz > (ssize_t)oldsz) {
         if (printable) {
             util_rndBufPrintable(&run->dynamicFile[oldsz], newsz - oldsz);
@@ -603,36 +659,305 @@ static void mangle_ASCIIVal(run_t* run, bool printable HF_ATTR_UNUSED) {
     mangle_Overwrite(run, (uint8_t*)buf, off, strlen(buf));
 }
 
-void mangle_mangleContent(run_t* run) {
-    static void (*const mangleFuncs[])(run_t * run, bool printable) = {
-        mangle_Bit,
-        mangle_Bytes,
-        mangle_Magic,
-        mangle_IncByte,
-        mangle_DecByte,
-        mangle_NegByte,
-        mangle_AddSub,
-        mangle_Dictionary,
-        mangle_DictionaryInsert,
-        mangle_MemMove,
-        mangle_MemSet,
-        mangle_Random,
-        mangle_CloneByte,
-        mangle_Expand,
-        mangle_Shrink,
-        mangle_ASCIIVal,
-    };
+/*
+ * Splice and crossover: combine the input with another (random) entry of the dynamic corpus. Its
+ * data might not be printable (e.g. seed files), so such bytes are replaced if needed
+ */
+static void mangle_CopyFrom(run_t* run, const uint8_t* src, size_t off, size_t len, bool printable) {
+    mangle_Overwrite(run, src, off, len);
+    for (size_t i = off; printable && i < MIN(off + len, run->dynamicFileSz); i++) {
+        if (!isprint(run->dynamicFile[i])) {
+            run->dynamicFile[i] = util_rndPrintable();
+        }
+    }
+}
 
+/*
+ * Looks for a short token of 'other' (at otherOff) in the input, and stores its offset in *off, so
+ * both files can be split at a common point
+ */
+static bool mangle_CommonPoint(
+    run_t* run, const struct dynfile_t* other, size_t otherOff, size_t* off) {
+    size_t tokLen = MIN(other->size - otherOff, 4);
+    if (tokLen < 2) {
+        return false;
+    }
+    const uint8_t* found =
+        memmem(run->dynamicFile, run->dynamicFileSz, &other->data[otherOff], tokLen);
+    if (!found) {
+        return false;
+    }
+    *off = (size_t)(found - run->dynamicFile);
+    return true;
+}
+
+/* Head of the input, followed by the tail of another corpus entry */
+static void mangle_Splice(run_t* run, bool printable) {
+    const struct dynfile_t* other = input_pickDynamicInput(run->global);
+    if (!other || other->size == 0) {
+        mangle_Bytes(run, printable);
+        return;
+    }
+
+    size_t otherOff = util_rndGet(0, other->size - 1);
+    size_t off;
+    if ((util_rnd64() & 0x1) || !mangle_CommonPoint(run, other, otherOff, &off)) {
+        off = util_rndGet(1, run->dynamicFileSz);
+    }
+    size_t len = MIN(other->size - otherOff, run->global->mutate.maxFileSz - off);
+    if (off + len == 0) {
+        mangle_Bytes(run, printable);
+        return;
+    }
+
+    mangle_SetSize(run, off + len);
+    mangle_CopyFrom(run, &other->data[otherOff], off, len, printable);
+}
+
+/* Inserts, or overwrites the input with, a chunk of another corpus entry */
+static void mangle_CrossOver(run_t* run, bool printable) {
+    const struct dynfile_t* other = input_pickDynamicInput(run->global);
+    if (!other || other->size == 0) {
+        mangle_Bytes(run, printable);
+        return;
+    }
+
+    size_t otherOff = util_rndGet(0, other->size - 1);
+    size_t len = util_rndGet(1, MIN(other->size - otherOff, run->global->mutate.maxFileSz));
+    size_t off = util_rndGet(0, run->dynamicFileSz - 1);
+
+    if (util_rnd64() & 0x1) {
+        size_t oldSz = run->dynamicFileSz;
+        len = MIN(len, run->global->mutate.maxFileSz - oldSz);
+        if (len == 0) {
+            return;
+        }
+        mangle_SetSize(run, oldSz + len);
+        mangle_Journal(run, off, oldSz + len - off);
+        memmove(&run->dynamicFile[off + len], &run->dynamicFile[off], oldSz - off);
+    }
+    mangle_CopyFrom(run, &other->data[otherOff], off, len, printable);
+}
+
+/*
+ * Input-to-state replacement: finds one operand of a comparison logged (--cmplog) while processing
+ * the previous input in the input, and replaces it with the other one. Integers are also looked for
+ * in the other byte order, and in the shortest width which fits both operands, and are replaced
+ * with the other operand, or with it +/- 1
+ */
+static size_t mangle_IntWidth(const uint8_t* v1, const uint8_t* v2, size_t len) {
+    size_t sig = len;
+    for (; sig > 1 && v1[sig - 1] == 0 && v2[sig - 1] == 0; sig--) {
+    }
+    if (sig <= 2) {
+        return MIN(len, 2);
+    }
+    if (sig <= 4) {
+        return MIN(len, 4);
+    }
+    return len;
+}
+
+static void mangle_IntAdd(uint8_t* val, size_t len, int delta) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t prev = val[i];
+        val[i] += (uint8_t)delta;
+        /* No carry/borrow, done */
+        if ((delta > 0 && val[i] > prev) || (delta < 0 && val[i] < prev)) {
+            return;
+        }
+    }
+}
+
+static void mangle_InputToState(run_t* run, bool printable) {
+    if (run->inputToState.cnt == 0 || run->dynamicFileSz == 0) {
+        mangle_Bit(run, printable);
+        return;
+    }
+    const cmpLogEntry_t* e = &run->inputToState.entries[util_rndGet(0, run->inputToState.cnt - 1)];
+
+    uint8_t from[_HF_CMPLOG_VAL_MAX];
+    uint8_t to[_HF_CMPLOG_VAL_MAX];
+    size_t fromLen = MIN(e->len1, _HF_CMPLOG_VAL_MAX);
+    size_t toLen = MIN(e->len2, _HF_CMPLOG_VAL_MAX);
+    if (util_rnd64() & 0x1) {
+        memcpy(from, e->v1, fromLen);
+        memcpy(to, e->v2, toLen);
+    } else {
+        memcpy(from, e->v2, toLen);
+        memcpy(to, e->v1, fromLen);
+        size_t tmp = fromLen;
+        fromLen = toLen;
+        toLen = tmp;
+    }
+
+    if (e->flags & _HF_CMPLOG_INT) {
+        fromLen = toLen = mangle_IntWidth(from, to, MIN(fromLen, toLen));
+        switch (util_rndGet(0, 3)) {
+            case 0:
+                mangle_IntAdd(to, toLen, 1);
+                break;
+            case 1:
+                mangle_IntAdd(to, toLen, -1);
+                break;
+            default:
+                break;
+        }
+        if (util_rnd64() & 0x1) {
+            for (size_t i = 0; i < fromLen / 2; i++) {
+                uint8_t t = from[i];
+                from[i] = from[fromLen - i - 1];
+                from[fromLen - i - 1] = t;
+                t = to[i];
+                to[i] = to[toLen - i - 1];
+                to[toLen - i - 1] = t;
+            }
+        }
+    }
+    if (fromLen == 0 || toLen == 0 || fromLen > run->dynamicFileSz) {
+        mangle_Bit(run, printable);
+        return;
+    }
+    for (size_t i = 0; printable && i < toLen; i++) {
+        if (!isprint(to[i])) {
+            mangle_Bit(run, printable);
+            return;
+        }
+    }
+
+    /* Search from a random offset, so all the occurrences get a chance to be replaced */
+    size_t start = util_rndGet(0, run->dynamicFileSz - 1);
+    const uint8_t* found =
+        memmem(&run->dynamicFile[start], run->dynamicFileSz - start, from, fromLen);
+    if (!found) {
+        size_t len = MIN(start + fromLen - 1, run->dynamicFileSz);
+        found = memmem(run->dynamicFile, len, from, fromLen);
+    }
+    if (!found) {
+        mangle_Bit(run, printable);
+        return;
+    }
+    mangle_Overwrite(run, to, (size_t)(found - run->dynamicFile), toLen);
+}
+
+static void (*const mangleFuncs[])(run_t* run, bool printable) = {
+    mangle_Bit,
+    mangle_Bytes,
+    mangle_Magic,
+    mangle_IncByte,
+    mangle_DecByte,
+    mangle_NegByte,
+    mangle_AddSub,
+    mangle_Dictionary,
+    mangle_DictionaryInsert,
+    mangle_MemMove,
+    mangle_MemSet,
+    mangle_Random,
+    mangle_CloneByte,
+    mangle_Expand,
+    mangle_Shrink,
+    mangle_ASCIIVal,
+    mangle_Splice,
+    mangle_CrossOver,
+    /* Must be the last one, it's not used without the --cmplog operands */
+    mangle_InputToState,
+};
+_Static_assert(ARRAYSIZE(mangleFuncs) <= _HF_MANGLE_FUNCS_MAX, "Too many mangle functions");
+
+/*
+ * Weights of the mangle functions are proportional to their (smoothed) yield: the ratio of runs
+ * which produced new coverage to all runs they were used in. They're kept within [1/8, 16] of the
+ * mean weight, so no mangle function is ever switched off completely
+ */
+#define MANGLE_WEIGHT_BASE 256.0
+#define MANGLE_WEIGHT_MIN (MANGLE_WEIGHT_BASE / 8.0)
+#define MANGLE_WEIGHT_MAX (MANGLE_WEIGHT_BASE * 16.0)
+#define MANGLE_MERGE_RUNS 1024U
+
+static void mangle_computeWeights(run_t* run, const uint64_t* used, const uint64_t* hits) {
+    double yield[ARRAYSIZE(mangleFuncs)];
+    double sum = 0.0;
+    for (size_t i = 0; i < ARRAYSIZE(mangleFuncs); i++) {
+        yield[i] = ((double)hits[i] + 1.0) / ((double)used[i] + 100.0);
+        sum += yield[i];
+    }
+    double mean = sum / (double)ARRAYSIZE(mangleFuncs);
+
+    uint32_t cum = 0;
+    for (size_t i = 0; i < ARRAYSIZE(mangleFuncs); i++) {
+        double w = MANGLE_WEIGHT_BASE * yield[i] / mean;
+        w = MAX(MANGLE_WEIGHT_MIN, MIN(w, MANGLE_WEIGHT_MAX));
+        cum += (uint32_t)w;
+        run->mangleStats.cumWeight[i] = cum;
+    }
+}
+
+static void mangle_mergeStats(run_t* run) {
+    uint64_t used[ARRAYSIZE(mangleFuncs)];
+    uint64_t hits[ARRAYSIZE(mangleFuncs)];
+    for (size_t i = 0; i < ARRAYSIZE(mangleFuncs); i++) {
+        used[i] = ATOMIC_PRE_ADD(run->global->mutate.mangleStats.used[i], run->mangleStats.used[i]);
+        hits[i] = ATOMIC_PRE_ADD(run->global->mutate.mangleStats.hits[i], run->mangleStats.hits[i]);
+        run->mangleStats.used[i] = 0;
+        run->mangleStats.hits[i] = 0;
+    }
+    mangle_computeWeights(run, used, hits);
+
+    LOG_D("Mangle function weights (thread #%" PRIu32 ", cumulative): %" PRIu32 " ... %" PRIu32,
+        run->fuzzNo, run->mangleStats.cumWeight[0],
+        run->mangleStats.cumWeight[ARRAYSIZE(mangleFuncs) - 1]);
+}
+
+static size_t mangle_pickFunc(run_t* run, uint64_t rnd) {
+    /* mangle_InputToState() is the last one, skip it if there are no operands to use */
+    size_t cnt = run->inputToState.cnt ? ARRAYSIZE(mangleFuncs) : ARRAYSIZE(mangleFuncs) - 1;
+    uint32_t r = (uint32_t)(rnd % run->mangleStats.cumWeight[cnt - 1]);
+    size_t i = 0;
+    for (; i < (cnt - 1) && r >= run->mangleStats.cumWeight[i]; i++) {
+    }
+    return i;
+}
+
+void mangle_mangleContent(run_t* run) {
     if (run->mutationsPerRun == 0U) {
         return;
     }
+    if (mutator_mutate(run)) {
+        return;
+    }
+    if (run->mangleStats.cumWeight[0] == 0) {
+        mangle_computeWeights(run, run->mangleStats.used, run->mangleStats.hits);
+    }
 
     mangle_Resize(run, /* printable= */ run->global->cfg.only_printable);
 
     /* Max number of stacked changes is, by default, 6 */
     uint64_t changesCnt = util_rndGet(1, run->global->mutate.mutationsPerRun);
+    uint64_t rnds[8];
     for (uint64_t x = 0; x < changesCnt; x++) {
-        uint64_t choice = util_rndGet(0, ARRAYSIZE(mangleFuncs) - 1);
+        if ((x % ARRAYSIZE(rnds)) == 0) {
+            util_rnd64N(rnds, MIN(changesCnt - x, ARRAYSIZE(rnds)));
+        }
+        size_t choice = mangle_pickFunc(run, rnds[x % ARRAYSIZE(rnds)]);
+        run->mangleStats.usedThisRun |= (1U << choice);
         mangleFuncs[choice](run, /* printable= */ run->global->cfg.only_printable);
     }
 }
+
+void mangle_feedback(run_t* run, bool newCov) {
+    uint32_t usedThisRun = run->mangleStats.usedThisRun;
+    if (usedThisRun == 0) {
+        return;
+    }
+    run->mangleStats.usedThisRun = 0;
+
+    for (size_t i = 0; i < ARRAYSIZE(mangleFuncs); i++) {
+        if (usedThisRun & (1U << i)) {
+            run->mangleStats.used[i]++;
+            run->mangleStats.hits[i] += newCov ? 1 : 0;
+        }
+    }
+    if ((++run->mangleStats.runs % MANGLE_MERGE_RUNS) == 0) {
+        mangle_mergeStats(run);
+    }
+}
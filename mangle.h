@@ -27,5 +27,7 @@
 #include "honggfuzz.h"
 
 extern void mangle_mangleContent(run_t* run);
+/* Feeds the result of the last run (whether it has produced new coverage) back to the mutators */
+extern void mangle_feedback(run_t* run, bool newCov);
 
 #endif
@@ -0,0 +1,511 @@
+/*
+ *
+ * honggfuzz - corpus minimization
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "minimize.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+/* Features are bit indices in one of the feedback maps, tagged with the map type */
+#define _HF_MIN_FEAT_GUARD (1ULL << 61)
+#define _HF_MIN_FEAT_CNT (2ULL << 61)
+#define _HF_MIN_FEAT_PC (3ULL << 61)
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    uint64_t timeExecUSecs;
+    uint64_t* feats;
+    size_t featsCnt;
+} minInput_t;
+
+static struct {
+    pthread_mutex_t mutex;
+    minInput_t* inputs;
+    size_t cnt;
+    size_t capacity;
+} minimize = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .inputs = NULL,
+    .cnt = 0,
+    .capacity = 0,
+};
+
+typedef struct {
+    uint64_t* feats;
+    size_t cnt;
+    size_t capacity;
+} minFeats_t;
+
+static void minimize_addFeat(minFeats_t* f, uint64_t feat) {
+    if (f->cnt == f->capacity) {
+        f->capacity = f->capacity ? (f->capacity * 2) : 1024;
+        f->feats = util_Realloc(f->feats, f->capacity * sizeof(uint64_t));
+    }
+    f->feats[f->cnt++] = feat;
+}
+
+/* Adds all bits set in the map as features, and clears them, skipping zeroed words quickly */
+static void minimize_collect(minFeats_t* f, uint8_t* map, size_t sz, uint64_t type) {
+    for (size_t i = 0; (i + sizeof(uint64_t)) <= sz; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, &map[i], sizeof(w));
+        if (w == 0) {
+            continue;
+        }
+        memset(&map[i], '\0', sizeof(w));
+        for (; w; w &= (w - 1)) {
+            minimize_addFeat(f, type | ((uint64_t)i * 8 + __builtin_ctzll(w)));
+        }
+    }
+}
+
+/* Same as minimize_collect(), but folds the words and their offsets into a single hash */
+static uint64_t minimize_hash(uint64_t h, uint8_t* map, size_t sz) {
+    for (size_t i = 0; (i + sizeof(uint64_t)) <= sz; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, &map[i], sizeof(w));
+        if (w == 0) {
+            continue;
+        }
+        memset(&map[i], '\0', sizeof(w));
+        h = (h ^ (w + i)) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+uint64_t minimize_signature(run_t* run) {
+    feedback_t* fb = run->feedbackMap;
+
+    size_t guardSz = MIN(ATOMIC_GET(fb->pcGuardMapLen),
+        ((ATOMIC_GET(fb->guardNb) / 8) + sizeof(uint64_t)) & ~(sizeof(uint64_t) - 1));
+    uint64_t h = minimize_hash(_HF_MIN_FEAT_GUARD, fb->pcGuardMap, guardSz);
+    h = minimize_hash(h ^ _HF_MIN_FEAT_CNT, fb->pcCntMap, sizeof(fb->pcCntMap));
+    h = minimize_hash(h ^ _HF_MIN_FEAT_PC, fb->bbMapPc, sizeof(fb->bbMapPc));
+    fb->pidFeedback[run->fuzzNo].pc = 0;
+    fb->pidFeedback[run->fuzzNo].edge = 0;
+    fb->pidFeedback[run->fuzzNo].cmp = 0;
+
+    return h;
+}
+
+void minimize_record(run_t* run) {
+    feedback_t* fb = run->feedbackMap;
+
+    minFeats_t f = {
+        .feats = NULL,
+        .cnt = 0,
+        .capacity = 0,
+    };
+    size_t guardSz = MIN(ATOMIC_GET(fb->pcGuardMapLen),
+        ((ATOMIC_GET(fb->guardNb) / 8) + sizeof(uint64_t)) & ~(sizeof(uint64_t) - 1));
+    minimize_collect(&f, fb->pcGuardMap, guardSz, _HF_MIN_FEAT_GUARD);
+    minimize_collect(&f, fb->pcCntMap, sizeof(fb->pcCntMap), _HF_MIN_FEAT_CNT);
+    minimize_collect(&f, fb->bbMapPc, sizeof(fb->bbMapPc), _HF_MIN_FEAT_PC);
+    fb->pidFeedback[run->fuzzNo].pc = 0;
+    fb->pidFeedback[run->fuzzNo].edge = 0;
+    fb->pidFeedback[run->fuzzNo].cmp = 0;
+
+    if (run->crashFileName[0] != '\0' || run->tmOutSignaled) {
+        LOG_I("Input '%s' has crashed or timed out, it won't be a part of the minimized corpus",
+            run->origFileName);
+        free(f.feats);
+        return;
+    }
+    if (f.cnt == 0) {
+        LOG_D("Input '%s' produced no coverage", run->origFileName);
+        free(f.feats);
+        return;
+    }
+
+    minInput_t in = {
+        .data = util_Malloc(run->dynamicFileSz ? run->dynamicFileSz : 1),
+        .len = run->dynamicFileSz,
+        .timeExecUSecs = run->timeExecUSecs,
+        .feats = f.feats,
+        .featsCnt = f.cnt,
+    };
+    memcpy(in.data, run->dynamicFile, run->dynamicFileSz);
+
+    MX_SCOPED_LOCK(&minimize.mutex);
+    if (minimize.cnt == minimize.capacity) {
+        minimize.capacity = minimize.capacity ? (minimize.capacity * 2) : 1024;
+        minimize.inputs = util_Realloc(minimize.inputs, minimize.capacity * sizeof(minInput_t));
+    }
+    minimize.inputs[minimize.cnt++] = in;
+}
+
+/* Open-addressing map of features to the best (smallest, then fastest) input which has them */
+typedef struct {
+    uint64_t feat;
+    size_t champ;
+    bool covered;
+} minFeatEntry_t;
+
+typedef struct {
+    minFeatEntry_t* e;
+    size_t capacity;
+    size_t cnt;
+} minFeatMap_t;
+
+static minFeatEntry_t* minimize_featFind(minFeatMap_t* m, uint64_t feat) {
+    size_t mask = m->capacity - 1;
+    for (size_t i = (feat * 0x9E3779B97F4A7C15ULL) & mask;; i = (i + 1) & mask) {
+        if (m->e[i].feat == feat || m->e[i].feat == 0) {
+            return &m->e[i];
+        }
+    }
+}
+
+static void minimize_featGrow(minFeatMap_t* m) {
+    minFeatMap_t n = {
+        .e = util_Calloc((m->capacity ? m->capacity * 2 : 1024 * 64) * sizeof(minFeatEntry_t)),
+        .capacity = m->capacity ? m->capacity * 2 : 1024 * 64,
+        .cnt = m->cnt,
+    };
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->e[i].feat != 0) {
+            *minimize_featFind(&n, m->e[i].feat) = m->e[i];
+        }
+    }
+    free(m->e);
+    *m = n;
+}
+
+static int minimize_cmp(const void* a, const void* b) {
+    const minInput_t* ia = &minimize.inputs[*(const size_t*)a];
+    const minInput_t* ib = &minimize.inputs[*(const size_t*)b];
+    if (ia->len != ib->len) {
+        return ia->len < ib->len ? -1 : 1;
+    }
+    if (ia->timeExecUSecs != ib->timeExecUSecs) {
+        return ia->timeExecUSecs < ib->timeExecUSecs ? -1 : 1;
+    }
+    return 0;
+}
+
+static bool minimize_save(const char* dir, const minInput_t* in) {
+    char fname[PATH_MAX];
+    snprintf(fname, sizeof(fname), "%s/%016" PRIx64 "%016" PRIx64 ".%08" PRIx32 ".honggfuzz.cov",
+        dir, util_CRC64(in->data, in->len), util_CRC64Rev(in->data, in->len), (uint32_t)in->len);
+    if (files_exists(fname)) {
+        return true;
+    }
+    return files_writeBufToFile(fname, in->data, in->len, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC);
+}
+
+/*
+ * A greedy set cover: every feature gets a champion, the first input (in the order of size and
+ * execution time) having it. Inputs are then taken in the same order if they're the champion of
+ * a feature which isn't covered by the inputs already taken
+ */
+bool minimize_finish(honggfuzz_t* hfuzz) {
+    MX_SCOPED_LOCK(&minimize.mutex);
+
+    size_t* order = util_Malloc((minimize.cnt ? minimize.cnt : 1) * sizeof(size_t));
+    defer {
+        free(order);
+    };
+    for (size_t i = 0; i < minimize.cnt; i++) {
+        order[i] = i;
+    }
+    qsort(order, minimize.cnt, sizeof(size_t), minimize_cmp);
+
+    minFeatMap_t m = {
+        .e = NULL,
+        .capacity = 0,
+        .cnt = 0,
+    };
+    defer {
+        free(m.e);
+    };
+    for (size_t i = 0; i < minimize.cnt; i++) {
+        const minInput_t* in = &minimize.inputs[order[i]];
+        for (size_t j = 0; j < in->featsCnt; j++) {
+            if (((m.cnt + 1) * 2) > m.capacity) {
+                minimize_featGrow(&m);
+            }
+            minFeatEntry_t* e = minimize_featFind(&m, in->feats[j]);
+            if (e->feat == 0) {
+                e->feat = in->feats[j];
+                e->champ = order[i];
+                e->covered = false;
+                m.cnt++;
+            }
+        }
+    }
+
+    if (mkdir(hfuzz->io.covDirAll, 0700) == -1 && errno != EEXIST) {
+        PLOG_E("Couldn't create the output directory '%s'", hfuzz->io.covDirAll);
+        return false;
+    }
+
+    size_t selectedCnt = 0, selectedSz = 0, totalSz = 0;
+    for (size_t i = 0; i < minimize.cnt; i++) {
+        const minInput_t* in = &minimize.inputs[order[i]];
+        totalSz += in->len;
+
+        bool needed = false;
+        for (size_t j = 0; j < in->featsCnt && !needed; j++) {
+            minFeatEntry_t* e = minimize_featFind(&m, in->feats[j]);
+            needed = (!e->covered && e->champ == order[i]);
+        }
+        if (!needed) {
+            continue;
+        }
+        for (size_t j = 0; j < in->featsCnt; j++) {
+            minimize_featFind(&m, in->feats[j])->covered = true;
+        }
+
+        if (!minimize_save(hfuzz->io.covDirAll, in)) {
+            LOG_E("Couldn't save the minimized input to '%s'", hfuzz->io.covDirAll);
+            return false;
+        }
+        selectedCnt++;
+        selectedSz += in->len;
+    }
+
+    LOG_I("Minimized the corpus from %zu inputs (%zu bytes) to %zu inputs (%zu bytes), covering "
+          "%zu features, and saved it in '%s'",
+        minimize.cnt, totalSz, selectedCnt, selectedSz, m.cnt, hfuzz->io.covDirAll);
+
+    for (size_t i = 0; i < minimize.cnt; i++) {
+        free(minimize.inputs[i].data);
+        free(minimize.inputs[i].feats);
+    }
+    free(minimize.inputs);
+    minimize.inputs = NULL;
+    minimize.cnt = 0;
+    minimize.capacity = 0;
+
+    return true;
+}
+
+/*
+ * Crash minimization (--minimize_crash): parallel delta debugging. Chunks of the reproducer, from
+ * half of its size down to single bytes, are removed by all threads at once. A removal is kept if
+ * the input still crashes with the same stack hash, and the candidates which were based on an older
+ * version of the input are simply retried
+ */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t* data;
+    size_t len;
+    size_t origLen;
+    uint64_t backtrace;
+    bool origIssued;
+    uint64_t version;
+    size_t chunk;
+    size_t pos;
+    bool changed;
+    size_t inflight;
+    size_t execs;
+    bool done;
+    bool failed;
+} crashmin = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .data = NULL,
+    .len = 0,
+    .origLen = 0,
+    .backtrace = 0,
+    .origIssued = false,
+    .version = 0,
+    .chunk = 0,
+    .pos = 0,
+    .changed = false,
+    .inflight = 0,
+    .execs = 0,
+    .done = false,
+    .failed = false,
+};
+
+bool minimize_crashInit(honggfuzz_t* hfuzz) {
+    off_t fileSz;
+    int fd;
+    uint8_t* map = files_mapFile(hfuzz->cfg.minimizeCrash, &fileSz, &fd, /* isWritable= */ false);
+    if (map == NULL) {
+        LOG_E("Couldn't open the crash reproducer '%s'", hfuzz->cfg.minimizeCrash);
+        return false;
+    }
+    defer {
+        munmap(map, fileSz);
+        close(fd);
+    };
+    if ((size_t)fileSz > _HF_INPUT_MAX_SIZE) {
+        LOG_E("The crash reproducer '%s' is too big: %zu > %zu", hfuzz->cfg.minimizeCrash,
+            (size_t)fileSz, (size_t)_HF_INPUT_MAX_SIZE);
+        return false;
+    }
+
+    crashmin.len = crashmin.origLen = (size_t)fileSz;
+    crashmin.data = util_Malloc(crashmin.len ? crashmin.len : 1);
+    memcpy(crashmin.data, map, crashmin.len);
+    crashmin.chunk = 1;
+    while (crashmin.chunk * 2 < crashmin.len) {
+        crashmin.chunk *= 2;
+    }
+    if (hfuzz->mutate.maxFileSz < crashmin.len) {
+        hfuzz->mutate.maxFileSz = MAX(crashmin.len, 1U);
+    }
+
+    LOG_I("Minimizing the crash reproducer '%s' (%zu bytes)", hfuzz->cfg.minimizeCrash,
+        crashmin.len);
+    return true;
+}
+
+bool minimize_crashNext(run_t* run, minCrashCand_t* cand) {
+    MX_SCOPED_LOCK(&crashmin.mutex);
+
+    for (;;) {
+        if (crashmin.done) {
+            return false;
+        }
+        /* The stack hash of the original input has to be known first */
+        if (crashmin.backtrace == 0) {
+            if (crashmin.origIssued) {
+                pthread_cond_wait(&crashmin.cond, &crashmin.mutex);
+                continue;
+            }
+            crashmin.origIssued = true;
+            *cand = (minCrashCand_t){
+                .version = crashmin.version,
+                .pos = 0,
+                .len = 0,
+                .orig = true,
+            };
+            break;
+        }
+        if (crashmin.pos < crashmin.len) {
+            *cand = (minCrashCand_t){
+                .version = crashmin.version,
+                .pos = crashmin.pos,
+                .len = MIN(crashmin.chunk, crashmin.len - crashmin.pos),
+                .orig = false,
+            };
+            crashmin.pos += crashmin.chunk;
+            break;
+        }
+        if (crashmin.inflight > 0) {
+            pthread_cond_wait(&crashmin.cond, &crashmin.mutex);
+            continue;
+        }
+        /* End of a pass: use smaller chunks, or repeat the last pass until nothing changes */
+        if (crashmin.chunk > 1) {
+            crashmin.chunk /= 2;
+        } else if (!crashmin.changed) {
+            crashmin.done = true;
+            pthread_cond_broadcast(&crashmin.cond);
+            return false;
+        }
+        crashmin.pos = 0;
+        crashmin.changed = false;
+    }
+
+    crashmin.inflight++;
+    input_setSize(run, crashmin.len - cand->len);
+    memcpy(run->dynamicFile, crashmin.data, cand->pos);
+    memcpy(&run->dynamicFile[cand->pos], &crashmin.data[cand->pos + cand->len],
+        crashmin.len - cand->pos - cand->len);
+    return true;
+}
+
+void minimize_crashResult(run_t* run, const minCrashCand_t* cand) {
+    MX_SCOPED_LOCK(&crashmin.mutex);
+    crashmin.inflight--;
+    crashmin.execs++;
+    pthread_cond_broadcast(&crashmin.cond);
+
+    if (cand->orig) {
+        if (run->backtrace == 0 || run->tmOutSignaled) {
+            LOG_E("The crash reproducer '%s' doesn't crash (or it times out), or its stack hash "
+                  "couldn't be calculated",
+                run->global->cfg.minimizeCrash);
+            crashmin.failed = true;
+            crashmin.done = true;
+            return;
+        }
+        crashmin.backtrace = run->backtrace;
+        LOG_I("The crash reproducer '%s' has the stack hash: %" PRIx64,
+            run->global->cfg.minimizeCrash, crashmin.backtrace);
+        return;
+    }
+
+    if (run->tmOutSignaled || run->backtrace != crashmin.backtrace) {
+        return;
+    }
+    if (cand->version != crashmin.version) {
+        /* Based on an older version of the input, retry it with the current one */
+        crashmin.pos = MIN(crashmin.pos, cand->pos);
+        return;
+    }
+    memmove(&crashmin.data[cand->pos], &crashmin.data[cand->pos + cand->len],
+        crashmin.len - cand->pos - cand->len);
+    crashmin.len -= cand->len;
+    crashmin.version++;
+    crashmin.pos = cand->pos;
+    crashmin.changed = true;
+    LOG_I("Crash reproducer size: %zu (chunk: %zu, execs: %zu)", crashmin.len, crashmin.chunk,
+        crashmin.execs);
+}
+
+bool minimize_crashFinish(honggfuzz_t* hfuzz) {
+    MX_SCOPED_LOCK(&crashmin.mutex);
+    if (crashmin.failed || crashmin.backtrace == 0) {
+        return false;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", hfuzz->cfg.minimizeCrash);
+    char fname[PATH_MAX];
+    snprintf(fname, sizeof(fname), "%s/%s.minimized", hfuzz->io.crashDir, basename(path));
+    if (!files_writeBufToFile(
+            fname, crashmin.data, crashmin.len, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC)) {
+        LOG_E("Couldn't save the minimized crash reproducer to '%s'", fname);
+        return false;
+    }
+
+    LOG_I("Minimized the crash reproducer '%s' (stack hash: %" PRIx64 ") from %zu to %zu bytes in "
+          "%zu executions%s, and saved it as '%s'",
+        hfuzz->cfg.minimizeCrash, crashmin.backtrace, crashmin.origLen, crashmin.len,
+        crashmin.execs, crashmin.done ? "" : " (interrupted)", fname);
+    return true;
+}
@@ -0,0 +1,54 @@
+/*
+ *
+ * honggfuzz - corpus minimization
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_MINIMIZE_H_
+#define _HF_MINIMIZE_H_
+
+#include "honggfuzz.h"
+
+/*
+ * Records the coverage signature of the input which has just been run, taken from (and cleared
+ * in) the thread's own feedback map
+ */
+extern void minimize_record(run_t* run);
+/* Same as above, but only returns the hash of the signature (used by --trim) */
+extern uint64_t minimize_signature(run_t* run);
+/* Selects the minimal set of the recorded inputs, and saves it in the covdir_all directory */
+extern bool minimize_finish(honggfuzz_t* hfuzz);
+
+/* A candidate of the crash minimization: the input without 'len' bytes at 'pos' */
+typedef struct {
+    uint64_t version;
+    size_t pos;
+    size_t len;
+    bool orig;
+} minCrashCand_t;
+
+/* Loads the crash reproducer to minimize (--minimize_crash) */
+extern bool minimize_crashInit(honggfuzz_t* hfuzz);
+/* Prepares the next candidate in the thread's input, returns false if the minimization is over */
+extern bool minimize_crashNext(run_t* run, minCrashCand_t* cand);
+/* Keeps the candidate, if it has crashed with the same stack hash as the original input */
+extern void minimize_crashResult(run_t* run, const minCrashCand_t* cand);
+/* Saves the smallest reproducer found as <crashdir>/<name>.minimized */
+extern bool minimize_crashFinish(honggfuzz_t* hfuzz);
+
+#endif /* ifndef _HF_MINIMIZE_H_ */
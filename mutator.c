@@ -0,0 +1,113 @@
+/*
+ *
+ * honggfuzz - in-process custom mutators
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "mutator.h"
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "input.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+
+/* How often (1 in N) LLVMFuzzerCustomCrossOver() is used instead of LLVMFuzzerCustomMutator() */
+#define MUTATOR_CROSSOVER_RATIO 4U
+
+bool mutator_init(honggfuzz_t* hfuzz) {
+    if (!hfuzz->mutate.custom.lib) {
+        return true;
+    }
+
+    void* handle = dlopen(hfuzz->mutate.custom.lib, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        LOG_E("dlopen('%s'): %s", hfuzz->mutate.custom.lib, dlerror());
+        return false;
+    }
+    hfuzz->mutate.custom.handle = handle;
+
+    hfuzz->mutate.custom.mutate = dlsym(handle, "LLVMFuzzerCustomMutator");
+    if (!hfuzz->mutate.custom.mutate) {
+        LOG_E("'%s' doesn't export LLVMFuzzerCustomMutator()", hfuzz->mutate.custom.lib);
+        return false;
+    }
+    hfuzz->mutate.custom.crossOver = dlsym(handle, "LLVMFuzzerCustomCrossOver");
+
+    int (*initialize)(int* argc, char*** argv) = dlsym(handle, "LLVMFuzzerInitialize");
+    if (initialize) {
+        int argc = hfuzz->exe.argc;
+        char** argv = (char**)hfuzz->exe.cmdline;
+        initialize(&argc, &argv);
+    }
+
+    LOG_I("Loaded the custom mutator from '%s' (crossover: %s)", hfuzz->mutate.custom.lib,
+        hfuzz->mutate.custom.crossOver ? "yes" : "no");
+    return true;
+}
+
+bool mutator_mutate(run_t* run) {
+    if (!run->global->mutate.custom.mutate) {
+        return false;
+    }
+
+    size_t maxSz = run->global->mutate.maxFileSz;
+    size_t sz = run->dynamicFileSz;
+    /* The mutator can write up to maxSz bytes, and anywhere, so the journal is of no use here */
+    run->journal.dynfile = NULL;
+    input_setSize(run, maxSz);
+
+    size_t newSz =
+        run->global->mutate.custom.mutate(run->dynamicFile, sz, maxSz, (unsigned int)util_rnd64());
+    if (newSz == 0 || newSz > maxSz) {
+        LOG_D("LLVMFuzzerCustomMutator() returned size: %zu (max: %zu)", newSz, maxSz);
+        input_setSize(run, sz);
+        return false;
+    }
+    input_setSize(run, newSz);
+    return true;
+}
+
+bool mutator_crossOver(run_t* run, const struct dynfile_t* dynfile) {
+    if (!run->global->mutate.custom.crossOver || util_rndGet(1, MUTATOR_CROSSOVER_RATIO) != 1) {
+        return false;
+    }
+    const struct dynfile_t* other = input_pickDynamicInput(run->global);
+    if (!other || other == dynfile) {
+        return false;
+    }
+
+    size_t maxSz = run->global->mutate.maxFileSz;
+    run->journal.dynfile = NULL;
+    input_setSize(run, maxSz);
+
+    size_t newSz = run->global->mutate.custom.crossOver(dynfile->data, dynfile->size, other->data,
+        other->size, run->dynamicFile, maxSz, (unsigned int)util_rnd64());
+    if (newSz == 0 || newSz > maxSz) {
+        LOG_D("LLVMFuzzerCustomCrossOver() returned size: %zu (max: %zu)", newSz, maxSz);
+        return false;
+    }
+    input_setSize(run, newSz);
+    return true;
+}
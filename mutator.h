@@ -0,0 +1,51 @@
+/*
+ *
+ * honggfuzz - in-process custom mutators
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_MUTATOR_H_
+#define _HF_MUTATOR_H_
+
+#include <stdbool.h>
+
+#include "honggfuzz.h"
+
+/*
+ * Loads the --custom_mutator library, which implements (libFuzzer-compatible):
+ *
+ *   size_t LLVMFuzzerCustomMutator(uint8_t* Data, size_t Size, size_t MaxSize, unsigned int Seed);
+ *
+ * and, optionally:
+ *
+ *   size_t LLVMFuzzerCustomCrossOver(const uint8_t* Data1, size_t Size1, const uint8_t* Data2,
+ *       size_t Size2, uint8_t* Out, size_t MaxOutSize, unsigned int Seed);
+ *   int LLVMFuzzerInitialize(int* argc, char*** argv);
+ *
+ * The functions are called concurrently by all fuzzing threads, so they must be thread-safe
+ */
+extern bool mutator_init(honggfuzz_t* hfuzz);
+/* Mutates run->dynamicFile in place, returns false if the internal mutators should be used */
+extern bool mutator_mutate(run_t* run);
+/*
+ * Writes a combination of 'dynfile' and of another random corpus entry to run->dynamicFile.
+ * Returns false if it was not done, and 'dynfile' should be mutated as usual
+ */
+extern bool mutator_crossOver(run_t* run, const struct dynfile_t* dynfile);
+
+#endif /* ifndef _HF_MUTATOR_H_ */
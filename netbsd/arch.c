@@ -28,6 +28,7 @@
 #include <sys/types.h>
 // clang-format on
 
+#include <sys/event.h>
 #include <sys/ptrace.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
@@ -41,7 +42,6 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <locale.h>
-#include <poll.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
@@ -74,28 +74,11 @@ pid_t arch_fork(run_t* run HF_ATTR_UNUSED) {
 }
 
 bool arch_launchChild(run_t* run) {
-#define ARGS_MAX 512
-    const char* args[ARGS_MAX + 2];
-    char argData[PATH_MAX];
-    const char inputFile[] = "/dev/fd/" HF_XSTR(_HF_INPUT_FD);
-
-    int x = 0;
-    for (x = 0; x < ARGS_MAX && x < run->global->exe.argc; x++) {
-        if (!strcmp(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER)) {
-            args[x] = inputFile;
-        } else if (strstr(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER)) {
-            const char* off = strstr(run->global->exe.cmdline[x], _HF_FILE_PLACEHOLDER);
-            snprintf(argData, sizeof(argData), "%.*s%s", (int)(off - run->global->exe.cmdline[x]),
-                run->global->exe.cmdline[x], inputFile);
-            args[x] = argData;
-        } else {
-            args[x] = run->global->exe.cmdline[x];
-        }
-    }
-    args[x++] = NULL;
+    /* Built once by the thread, see subproc_initExec() */
+    const char* const* args = run->execArgs;
 
     LOG_D("Launching '%s' on file '%s'", args[0],
-        run->global->exe.persistent ? "PERSISTENT_MODE" : inputFile);
+        run->global->exe.persistent ? "PERSISTENT_MODE" : "/dev/fd/" HF_XSTR(_HF_INPUT_FD));
 
     /* alarms persist across execve(), so disable it here */
     alarm(0);
@@ -115,10 +98,12 @@ bool arch_launchChild(run_t* run) {
 }
 
 void arch_prepareParentAfterFork(run_t* run) {
-    /* Parent */
+    /* Parent. A new socket is created for every process, closing the old one removes it */
     if (run->global->exe.persistent) {
-        if (fcntl(run->persistentSock, F_SETFL, O_ASYNC) == -1) {
-            PLOG_F("fcntl(%d, F_SETFL, O_ASYNC)", run->persistentSock);
+        struct kevent ev;
+        EV_SET(&ev, run->persistentSock, EVFILT_READ, EV_ADD, 0, 0, 0);
+        if (kevent(run->netbsd.kqFd, &ev, 1, NULL, 0, NULL) == -1) {
+            PLOG_F("kevent(kq=%d, EVFILT_READ, fd=%d)", run->netbsd.kqFd, run->persistentSock);
         }
     }
     if (!arch_traceAttach(run)) {
@@ -166,6 +151,18 @@ static bool arch_checkWait(run_t* run) {
     }
 }
 
+/*
+ * How long to wait for events: until the next time limit check is due. Without a time limit, up
+ * to 1s, as thread-directed pings (pthread_kill()) are not guaranteed to trigger EVFILT_SIGNAL
+ */
+static void arch_reapTimeout(run_t* run, struct timespec* ts) {
+    int64_t deadline = subproc_timeLimitDeadline(run);
+    /* Past the deadline already, the process has been signaled, don't spin until it dies */
+    int64_t diff = deadline ? MAX(deadline - util_timeNowMillis() + 1, 10) : 1000;
+    ts->tv_sec = diff / 1000;
+    ts->tv_nsec = (diff % 1000) * 1000000;
+}
+
 void arch_reapChild(run_t* run) {
     for (;;) {
         if (subproc_persistentModeStateMachine(run)) {
@@ -175,25 +172,12 @@ void arch_reapChild(run_t* run) {
         subproc_checkTimeLimit(run);
         subproc_checkTermination(run);
 
-        if (run->global->exe.persistent) {
-            struct pollfd pfd = {
-                .fd = run->persistentSock,
-                .events = POLLIN,
-            };
-            int r = poll(&pfd, 1, 250 /* 0.25s */);
-            if (r == -1 && errno != EINTR) {
-                PLOG_F("poll(fd=%d)", run->persistentSock);
-            }
-        } else {
-            /* Return with SIGIO, SIGCHLD */
-            const struct timespec ts = {
-                .tv_sec = 0ULL,
-                .tv_nsec = (1000ULL * 1000ULL * 250ULL),
-            };
-            int sig = sigtimedwait(&run->global->exe.waitSigSet, NULL, &ts /* 0.25s */);
-            if (sig == -1 && (errno != EAGAIN && errno != EINTR)) {
-                PLOG_F("sigtimedwait(SIGIO|SIGCHLD)");
-            }
+        /* Return on persistent socket data, SIGCHLD or the time limit */
+        struct timespec ts;
+        arch_reapTimeout(run, &ts);
+        struct kevent evs[4];
+        if (kevent(run->netbsd.kqFd, NULL, 0, evs, ARRAYSIZE(evs), &ts) == -1 && errno != EINTR) {
+            PLOG_F("kevent(kq=%d)", run->netbsd.kqFd);
         }
 
         if (arch_checkWait(run)) {
@@ -225,5 +209,17 @@ bool arch_archThreadInit(run_t* run) {
     run->netbsd.cpuBranchFd = -1;
     run->netbsd.cpuIptBtsFd = -1;
 
+    if ((run->netbsd.kqFd = kqueue1(O_CLOEXEC)) == -1) {
+        PLOG_E("kqueue1(O_CLOEXEC)");
+        return false;
+    }
+    /* SIGCHLD is blocked in the fuzzing threads, kqueue records its delivery nonetheless */
+    struct kevent ev;
+    EV_SET(&ev, SIGCHLD, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
+    if (kevent(run->netbsd.kqFd, &ev, 1, NULL, 0, NULL) == -1) {
+        PLOG_E("kevent(kq=%d, EVFILT_SIGNAL, SIGCHLD)", run->netbsd.kqFd);
+        return false;
+    }
+
     return true;
 }
@@ -51,6 +51,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "input.h"
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
@@ -60,12 +61,6 @@
 
 #include <capstone/capstone.h>
 
-/*
- * Size in characters required to store a string representation of a
- * register value (0xdeadbeef style))
- */
-#define REGSIZEINCHAR (2 * sizeof(register_t) + 3)
-
 #define _HF_INSTR_SZ 64
 
 #if defined(__i386__) || defined(__x86_64__)
@@ -235,20 +230,11 @@ static void arch_getInstrStr(pid_t pid, lwpid_t lwp, register_t* pc, char* instr
     return;
 }
 
-static void arch_hashCallstack(
-    run_t* run, funcs_t* funcs HF_ATTR_UNUSED, size_t funcCnt, bool enableMasking) {
+static void arch_hashCallstack(run_t* run, funcs_t* funcs, size_t funcCnt, bool enableMasking) {
     uint64_t hash = 0;
     for (size_t i = 0; i < funcCnt && i < run->global->netbsd.numMajorFrames; i++) {
-        /*
-         * Convert PC to char array to be compatible with hash function
-         */
-        char pcStr[REGSIZEINCHAR] = {0};
-        snprintf(pcStr, REGSIZEINCHAR, "%" PRIxREGISTER, (register_t)(long)funcs[i].pc);
-
-        /*
-         * Hash the last three nibbles
-         */
-        hash ^= util_hash(&pcStr[strlen(pcStr) - 3], 3);
+        /* There's no unwinder on NetBSD yet, so the frames have no modules */
+        hash = util_hashFrame(hash, (uint64_t)(uintptr_t)funcs[i].pc, /* modOff= */ 0, NULL);
     }
 
     /*
@@ -273,6 +259,7 @@ static void arch_traceGenerateReport(
         arch_sigName(si->si_signo), si->si_signo);
     util_ssnprintf(run->report, sizeof(run->report), "FAULT ADDRESS: %p\n",
         SI_FROMUSER(si) ? NULL : si->si_addr);
+    util_ssnprintf(run->report, sizeof(run->report), "PC: %p\n", funcCnt ? funcs[0].pc : NULL);
     util_ssnprintf(run->report, sizeof(run->report), "INSTRUCTION: %s\n", instr);
     util_ssnprintf(
         run->report, sizeof(run->report), "STACK HASH: %016" PRIx64 "\n", run->backtrace);
@@ -435,9 +422,7 @@ static void arch_traceSaveData(run_t* run, pid_t pid) {
         /*
          * Check if stackhash is blacklisted
          */
-        if (run->global->feedback.blacklist &&
-            (fastArray64Search(run->global->feedback.blacklist, run->global->feedback.blacklistCnt,
-                 run->backtrace) != -1)) {
+        if (input_isBlacklisted(run->global, run->backtrace)) {
             LOG_I("Blacklisted stack hash '%" PRIx64 "', skipping", run->backtrace);
             ATOMIC_POST_INC(run->global->cnts.blCrashesCnt);
             return;
@@ -25,10 +25,18 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <ctype.h>
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "libhfcommon/common.h"
 #include "libhfcommon/log.h"
@@ -36,69 +44,88 @@
 
 static int reportFD = -1;
 
-#if defined(_HF_ARCH_LINUX)
-static void report_printdynFileMethod(run_t* run) {
-    dprintf(reportFD, " dynFileMethod: ");
-    if (run->global->feedback.dynFileMethod == 0)
-        dprintf(reportFD, "NONE\n");
-    else {
-        if (run->global->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT)
-            dprintf(reportFD, "INSTR_COUNT ");
-        if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT)
-            dprintf(reportFD, "BRANCH_COUNT ");
-        if (run->global->feedback.dynFileMethod & _HF_DYNFILE_BTS_EDGE)
-            dprintf(reportFD, "BTS_EDGE_COUNT ");
-        if (run->global->feedback.dynFileMethod & _HF_DYNFILE_IPT_BLOCK)
-            dprintf(reportFD, "IPT_BLOCK_COUNT ");
+/* The FUZZER ARGS part of the text reports. It doesn't change, so it's built with the first one */
+static char reportArgs[8192];
 
-        dprintf(reportFD, "\n");
-    }
-}
-#endif
+/* A pre-sized buffer, so a report can be written with one syscall */
+typedef struct {
+    char* buf;
+    size_t sz;
+    size_t off;
+} reportBuf_t;
 
-static void report_printTargetCmd(run_t* run) {
-    dprintf(reportFD, " fuzzTarget   : ");
-    for (int x = 0; run->global->exe.cmdline[x]; x++) {
-        dprintf(reportFD, "%s ", run->global->exe.cmdline[x]);
+__attribute__((format(printf, 2, 3))) static void report_put(
+    reportBuf_t* b, const char* fmt, ...) {
+    if (b->off >= b->sz) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int ret = vsnprintf(&b->buf[b->off], b->sz - b->off, fmt, args);
+    va_end(args);
+    if (ret > 0) {
+        b->off = MIN(b->off + (size_t)ret, b->sz - 1);
     }
-    dprintf(reportFD, "\n");
 }
 
-void report_Report(run_t* run) {
-    if (run->report[0] == '\0') {
-        return;
+static void report_putJsonStr(reportBuf_t* b, const char* str, size_t len) {
+    report_put(b, "\"");
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\') {
+            report_put(b, "\\%c", c);
+        } else if (c == '\n') {
+            report_put(b, "\\n");
+        } else if (c == '\t') {
+            report_put(b, "\\t");
+        } else if (c < 0x20 || c == 0x7f) {
+            report_put(b, "\\u%04x", c);
+        } else if (b->off + 1 < b->sz) {
+            b->buf[b->off++] = (char)c;
+            b->buf[b->off] = '\0';
+        }
     }
+    report_put(b, "\"");
+}
 
-    MX_SCOPED_LOCK(&run->global->cfg.report_mutex);
-
-    if (reportFD == -1) {
-        char reportFName[PATH_MAX];
-        if (run->global->cfg.reportFile == NULL) {
-            snprintf(reportFName, sizeof(reportFName), "%s/%s", run->global->io.workDir,
-                _HF_REPORT_FILE);
-        } else {
-            snprintf(reportFName, sizeof(reportFName), "%s", run->global->cfg.reportFile);
-        }
+#if defined(_HF_ARCH_LINUX)
+static void report_printdynFileMethod(reportBuf_t* b, honggfuzz_t* hfuzz) {
+    report_put(b, " dynFileMethod: ");
+    if (hfuzz->feedback.dynFileMethod == 0)
+        report_put(b, "NONE\n");
+    else {
+        if (hfuzz->feedback.dynFileMethod & _HF_DYNFILE_INSTR_COUNT)
+            report_put(b, "INSTR_COUNT ");
+        if (hfuzz->feedback.dynFileMethod & _HF_DYNFILE_BRANCH_COUNT)
+            report_put(b, "BRANCH_COUNT ");
+        if (hfuzz->feedback.dynFileMethod & _HF_DYNFILE_BTS_EDGE)
+            report_put(b, "BTS_EDGE_COUNT ");
+        if (hfuzz->feedback.dynFileMethod & _HF_DYNFILE_IPT_BLOCK)
+            report_put(b, "IPT_BLOCK_COUNT ");
+        if (hfuzz->feedback.dynFileMethod & _HF_DYNFILE_KCOV)
+            report_put(b, "KCOV_EDGE_COUNT ");
 
-        reportFD =
-            TEMP_FAILURE_RETRY(open(reportFName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644));
-        if (reportFD == -1) {
-            PLOG_F("Couldn't open('%s') for writing", reportFName);
-        }
+        report_put(b, "\n");
     }
+}
+#endif
 
-    char localtmstr[PATH_MAX];
-    util_getLocalTime("%F.%H:%M:%S", localtmstr, sizeof(localtmstr), time(NULL));
+static void report_printTargetCmd(reportBuf_t* b, honggfuzz_t* hfuzz) {
+    report_put(b, " fuzzTarget   : ");
+    for (int x = 0; hfuzz->exe.cmdline[x]; x++) {
+        report_put(b, "%s ", hfuzz->exe.cmdline[x]);
+    }
+    report_put(b, "\n");
+}
 
-    dprintf(reportFD,
-        "=====================================================================\n"
-        "TIME: %s\n"
-        "=====================================================================\n"
+static void report_initArgs(honggfuzz_t* hfuzz) {
+    reportBuf_t b = {.buf = reportArgs, .sz = sizeof(reportArgs), .off = 0};
+    report_put(&b,
         "FUZZER ARGS:\n"
         " mutationsPerRun : %u\n"
         " externalCmd     : %s\n"
         " fuzzStdin       : %s\n"
-        " timeout         : %ld (sec)\n"
+        " timeout         : %" PRId64 " (msec)\n"
 #if defined(_HF_ARCH_LINUX) || defined(_HF_ARCH_NETBSD)
         " ignoreAddr      : %p\n"
 #endif
@@ -106,25 +133,192 @@ void report_Report(run_t* run) {
         " RSSLimit        : %" PRIu64 " (MiB)\n"
         " DATALimit       : %" PRIu64 " (MiB)\n"
         " wordlistFile    : %s\n",
-        localtmstr, run->global->mutate.mutationsPerRun,
-        run->global->exe.externalCommand == NULL ? "NULL" : run->global->exe.externalCommand,
-        run->global->exe.fuzzStdin ? "TRUE" : "FALSE", run->global->timing.tmOut,
+        hfuzz->mutate.mutationsPerRun,
+        hfuzz->exe.externalCommand == NULL ? "NULL" : hfuzz->exe.externalCommand,
+        hfuzz->exe.fuzzStdin ? "TRUE" : "FALSE", hfuzz->timing.tmOutMillis,
 #if defined(_HF_ARCH_LINUX)
-        run->global->linux.ignoreAddr,
+        hfuzz->linux.ignoreAddr,
 #elif defined(_HF_ARCH_NETBSD)
-        run->global->netbsd.ignoreAddr,
+        hfuzz->netbsd.ignoreAddr,
 #endif
-        run->global->exe.asLimit, run->global->exe.rssLimit, run->global->exe.dataLimit,
-        run->global->mutate.dictionaryFile == NULL ? "NULL" : run->global->mutate.dictionaryFile);
+        hfuzz->exe.asLimit, hfuzz->exe.rssLimit, hfuzz->exe.dataLimit,
+        hfuzz->mutate.dictionaryFile == NULL ? "NULL" : hfuzz->mutate.dictionaryFile);
 
 #if defined(_HF_ARCH_LINUX)
-    report_printdynFileMethod(run);
+    report_printdynFileMethod(&b, hfuzz);
 #endif
 
-    report_printTargetCmd(run);
+    report_printTargetCmd(&b, hfuzz);
+}
+
+/* Length of the key of a 'KEY: value' or a 'KEY:' line of the report, or 0 for other lines */
+static size_t report_jsonKeyLen(const char* line, size_t len) {
+    size_t i = 0;
+    for (; i < len && line[i] != ':'; i++) {
+        if ((line[i] < 'A' || line[i] > 'Z') && (line[i] < '0' || line[i] > '9') &&
+            line[i] != ' ' && line[i] != '_') {
+            return 0;
+        }
+    }
+    if (i == len || (i + 1 < len && line[i + 1] != ' ')) {
+        return 0;
+    }
+    return i;
+}
+
+static void report_putJsonKey(reportBuf_t* b, const char* key, size_t len) {
+    report_put(b, ",\"");
+    for (size_t i = 0; i < len; i++) {
+        report_put(b, "%c", (key[i] == ' ') ? '_' : (char)tolower((unsigned char)key[i]));
+    }
+    report_put(b, "\":");
+}
+
+/*
+ * One JSON object per line: 'KEY: value' lines of the report become "key":"value", and a 'KEY:'
+ * line followed by indented lines (e.g. the STACK) becomes "key":["line", ...]. Other lines go
+ * into the preceding array, or into "text":[...]
+ */
+static void report_buildJson(reportBuf_t* b, honggfuzz_t* hfuzz, const char* report, time_t tm) {
+    char localtmstr[PATH_MAX];
+    util_getLocalTime("%FT%H:%M:%S%z", localtmstr, sizeof(localtmstr), tm);
+
+    report_put(b, "{\"time\":\"%s\",\"unix_time\":%lld,\"run_time_secs\":%lld,\"fuzz_target\":[",
+        localtmstr, (long long)tm, (long long)(tm - hfuzz->timing.timeStart));
+    for (int x = 0; hfuzz->exe.cmdline[x]; x++) {
+        report_put(b, "%s", x ? "," : "");
+        report_putJsonStr(b, hfuzz->exe.cmdline[x], strlen(hfuzz->exe.cmdline[x]));
+    }
+    report_put(b, "]");
+
+    bool inArray = false;
+    size_t elems = 0;
+    for (const char* line = report; *line;) {
+        const char* nl = strchr(line, '\n');
+        size_t len = nl ? (size_t)(nl - line) : strlen(line);
+        size_t keyLen = (line[0] == ' ') ? 0 : report_jsonKeyLen(line, len);
+
+        if (keyLen) {
+            report_put(b, "%s", inArray ? "]" : "");
+            report_putJsonKey(b, line, keyLen);
+            size_t valOff = MIN(keyLen + 2, len);
+            inArray = (valOff == len);
+            elems = 0;
+            if (inArray) {
+                report_put(b, "[");
+            } else {
+                report_putJsonStr(b, &line[valOff], len - valOff);
+            }
+        } else if (len) {
+            if (!inArray) {
+                report_put(b, ",\"text\":[");
+                inArray = true;
+                elems = 0;
+            }
+            size_t skip = MIN(strspn(line, " "), len);
+            report_put(b, "%s", elems++ ? "," : "");
+            report_putJsonStr(b, &line[skip], len - skip);
+        }
+
+        line += len + (nl ? 1 : 0);
+    }
+    report_put(b, "%s}\n", inArray ? "]" : "");
+}
+
+static void report_open(honggfuzz_t* hfuzz) {
+    char reportFName[PATH_MAX];
+    if (hfuzz->cfg.reportFile == NULL) {
+        snprintf(reportFName, sizeof(reportFName), "%s/%s", hfuzz->io.workDir,
+            hfuzz->cfg.reportJson ? _HF_REPORT_JSON_FILE : _HF_REPORT_FILE);
+    } else {
+        snprintf(reportFName, sizeof(reportFName), "%s", hfuzz->cfg.reportFile);
+    }
+
+    reportFD =
+        TEMP_FAILURE_RETRY(open(reportFName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644));
+    if (reportFD == -1) {
+        PLOG_F("Couldn't open('%s') for writing", reportFName);
+    }
+    if (!hfuzz->cfg.reportJson) {
+        report_initArgs(hfuzz);
+    }
+}
+
+/* With O_APPEND each writev() lands at the end of the file, so a short one is just continued */
+static void report_writev(struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(writev(reportFD, iov, iovcnt));
+        if (ret <= 0) {
+            PLOG_W("Couldn't write the report, fd=%d", reportFD);
+            return;
+        }
+        size_t done = (size_t)ret;
+        for (; iovcnt > 0 && done >= iov->iov_len; iov++, iovcnt--) {
+            done -= iov->iov_len;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
 
-    dprintf(reportFD,
-        "%s"
+void report_Report(run_t* run) {
+    report_ReportStr(run->global, run->report);
+}
+
+void report_ReportStr(honggfuzz_t* hfuzz, const char* report) {
+    if (report[0] == '\0') {
+        return;
+    }
+
+    time_t tm = time(NULL);
+    size_t reportLen = strlen(report);
+
+    /* It's built outside of the lock, which is taken only for the (single) write */
+    if (hfuzz->cfg.reportJson) {
+        size_t cmdLen = 0;
+        for (int x = 0; hfuzz->exe.cmdline[x]; x++) {
+            cmdLen += strlen(hfuzz->exe.cmdline[x]) + 3;
+        }
+        /* Escaping makes a char at most 6 chars long, and each line adds a few more */
+        reportBuf_t b = {.sz = (reportLen + cmdLen) * 8 + 1024, .off = 0};
+        b.buf = util_Malloc(b.sz);
+        defer {
+            free(b.buf);
+        };
+        b.buf[0] = '\0';
+        report_buildJson(&b, hfuzz, report, tm);
+
+        MX_SCOPED_LOCK(&hfuzz->cfg.report_mutex);
+        if (reportFD == -1) {
+            report_open(hfuzz);
+        }
+        struct iovec iov[] = {{.iov_base = b.buf, .iov_len = b.off}};
+        report_writev(iov, ARRAYSIZE(iov));
+        return;
+    }
+
+    char localtmstr[PATH_MAX];
+    util_getLocalTime("%F.%H:%M:%S", localtmstr, sizeof(localtmstr), tm);
+    char hdr[PATH_MAX + 256];
+    int hdrLen = snprintf(hdr, sizeof(hdr),
+        "=====================================================================\n"
+        "TIME: %s\n"
         "=====================================================================\n",
-        run->report);
+        localtmstr);
+    static const char footer[] =
+        "=====================================================================\n";
+
+    MX_SCOPED_LOCK(&hfuzz->cfg.report_mutex);
+    if (reportFD == -1) {
+        report_open(hfuzz);
+    }
+    struct iovec iov[] = {
+        {.iov_base = hdr, .iov_len = MIN((size_t)hdrLen, sizeof(hdr) - 1)},
+        {.iov_base = reportArgs, .iov_len = strlen(reportArgs)},
+        {.iov_base = (void*)report, .iov_len = reportLen},
+        {.iov_base = (void*)footer, .iov_len = sizeof(footer) - 1},
+    };
+    report_writev(iov, ARRAYSIZE(iov));
 }
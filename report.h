@@ -27,5 +27,7 @@
 #include "honggfuzz.h"
 
 extern void report_Report(run_t* run);
+/* Appends 'report' (if not empty) to the report file, for crashes analyzed outside of the run */
+extern void report_ReportStr(honggfuzz_t* hfuzz, const char* report);
 
 #endif
@@ -115,8 +115,13 @@ static void sanitizers_AddFlag(honggfuzz_t* hfuzz, const char* env, char* buf, s
     if (!hfuzz->sanitizer.enable) {
         snprintf(buf, buflen, "%s=%s", env, kSAN_REGULAR);
     } else {
+#if defined(_HF_ARCH_LINUX)
+        /* The target's stderr is a pipe, parsed as the report arrives (see linux/trace.h) */
+        snprintf(buf, buflen, "%s=%s:%s:%sstderr", env, kASAN_OPTS, abortFlag, kSANLOGDIR);
+#else  /* defined(_HF_ARCH_LINUX) */
         snprintf(buf, buflen, "%s=%s:%s:%s%s/%s", env, kASAN_OPTS, abortFlag, kSANLOGDIR,
             hfuzz->io.workDir, kLOGPREFIX);
+#endif /* defined(_HF_ARCH_LINUX) */
     }
     /*
      * It will make ASAN to start background thread to check RSS mem use, which
@@ -21,6 +21,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "fuzz.h"
 #include "honggfuzz.h"
 #include "libhfcommon/common.h"
 #include "libhfcommon/files.h"
@@ -28,7 +29,150 @@
 #include "libhfcommon/ns.h"
 #include "libhfcommon/util.h"
 
+/* Binary protocol: messages are read, and sent, in batches */
+static struct {
+    uint8_t rbuf[SOCKFUZZ_MSG_MAX_LEN * 4];
+    size_t rlen;
+    uint8_t wbuf[1024 * 64];
+    size_t wlen;
+} sockFuzzBufs;
+
+static bool sockFuzz_flush(honggfuzz_t* hfuzz) {
+    if (sockFuzzBufs.wlen == 0) {
+        return true;
+    }
+    bool ret =
+        files_sendToSocket(hfuzz->socketFuzzer.clientSocket, sockFuzzBufs.wbuf, sockFuzzBufs.wlen);
+    sockFuzzBufs.wlen = 0;
+    if (!ret) {
+        LOG_E("Couldn't send the queued messages to the socket fuzzer");
+    }
+    return ret;
+}
+
+static bool sockFuzz_queue(honggfuzz_t* hfuzz, uint32_t type, const void* data, size_t len) {
+    if ((sockFuzzBufs.wlen + sizeof(sockFuzzHdr_t) + len) > sizeof(sockFuzzBufs.wbuf) &&
+        !sockFuzz_flush(hfuzz)) {
+        return false;
+    }
+    const sockFuzzHdr_t hdr = {
+        .type = type,
+        .len = (uint32_t)len,
+    };
+    memcpy(&sockFuzzBufs.wbuf[sockFuzzBufs.wlen], &hdr, sizeof(hdr));
+    memcpy(&sockFuzzBufs.wbuf[sockFuzzBufs.wlen + sizeof(hdr)], data, len);
+    sockFuzzBufs.wlen += sizeof(hdr) + len;
+    return true;
+}
+
+/*
+ * Returns the next message from the socket fuzzer. Before blocking on the socket, the queued
+ * messages are sent, so that all the results of the already received DONE messages go out together
+ */
+static bool sockFuzz_nextMsg(honggfuzz_t* hfuzz, sockFuzzHdr_t* hdr, uint8_t* payload) {
+    for (;;) {
+        if (sockFuzzBufs.rlen >= sizeof(sockFuzzHdr_t)) {
+            memcpy(hdr, sockFuzzBufs.rbuf, sizeof(sockFuzzHdr_t));
+            if (hdr->len > SOCKFUZZ_MSG_MAX_LEN) {
+                LOG_E("Message from the socket fuzzer is too long: %" PRIu32 " > %u", hdr->len,
+                    SOCKFUZZ_MSG_MAX_LEN);
+                return false;
+            }
+            size_t msgLen = sizeof(sockFuzzHdr_t) + hdr->len;
+            if (sockFuzzBufs.rlen >= msgLen) {
+                memcpy(payload, &sockFuzzBufs.rbuf[sizeof(sockFuzzHdr_t)], hdr->len);
+                memmove(
+                    sockFuzzBufs.rbuf, &sockFuzzBufs.rbuf[msgLen], sockFuzzBufs.rlen - msgLen);
+                sockFuzzBufs.rlen -= msgLen;
+                return true;
+            }
+        }
+
+        if (!sockFuzz_flush(hfuzz)) {
+            return false;
+        }
+        ssize_t sz = TEMP_FAILURE_RETRY(recv(hfuzz->socketFuzzer.clientSocket,
+            &sockFuzzBufs.rbuf[sockFuzzBufs.rlen], sizeof(sockFuzzBufs.rbuf) - sockFuzzBufs.rlen,
+            0));
+        if (sz == -1) {
+            PLOG_E("recv(sock=%d)", hfuzz->socketFuzzer.clientSocket);
+            return false;
+        }
+        if (sz == 0) {
+            LOG_E("The socket fuzzer has closed the connection");
+            return false;
+        }
+        sockFuzzBufs.rlen += (size_t)sz;
+    }
+}
+
+static bool fuzz_waitForExternalInputBinary(run_t* run) {
+    honggfuzz_t* hfuzz = run->global;
+
+    /* The crash is reported with the READY message of the new target */
+    if (run->crashFileName[0] != '\0') {
+        LOG_D("Target has crashed");
+        hfuzz->socketFuzzer.announce = true;
+        return false;
+    }
+
+    if (hfuzz->socketFuzzer.announce) {
+        const sockFuzzReady_t ready = {
+            .seq = hfuzz->socketFuzzer.seq,
+            .events = ATOMIC_XCHG(hfuzz->socketFuzzer.events, 0),
+            .pid = (uint32_t)run->pid,
+        };
+        if (!sockFuzz_queue(hfuzz, SOCKFUZZ_MSG_READY, &ready, sizeof(ready))) {
+            LOG_E("Couldn't queue the READY message");
+        }
+        hfuzz->socketFuzzer.announce = false;
+    }
+
+    for (;;) {
+        sockFuzzHdr_t hdr;
+        uint8_t payload[SOCKFUZZ_MSG_MAX_LEN];
+        if (!sockFuzz_nextMsg(hfuzz, &hdr, payload)) {
+            LOG_W("Lost the connection with the socket fuzzer, terminating");
+            if (run->pid) {
+                kill(run->pid, SIGKILL);
+            }
+            fuzz_setTerminating();
+            return false;
+        }
+
+        switch (hdr.type) {
+        case SOCKFUZZ_MSG_DONE: {
+            sockFuzzDone_t done = {};
+            memcpy(&done, payload, MIN(hdr.len, sizeof(done)));
+            hfuzz->socketFuzzer.seq = done.seq;
+            if (done.status == SOCKFUZZ_DONE_TARGET_DOWN) {
+                LOG_D("Input seq=%" PRIu64 ": target is down, restarting it", done.seq);
+                ATOMIC_POST_OR(hfuzz->socketFuzzer.events, SOCKFUZZ_EV_TARGET_DOWN);
+                hfuzz->socketFuzzer.announce = true;
+                return false;
+            }
+            return true;
+        }
+        case SOCKFUZZ_MSG_HALT:
+            LOG_D("External fuzzer ordered us to shut down.");
+            sockFuzz_flush(hfuzz);
+            if (run->pid) {
+                kill(run->pid, SIGKILL);
+            }
+            exit(0);
+        default:
+            LOG_W("Unknown message type from the socket fuzzer: %" PRIu32 ", len: %" PRIu32,
+                hdr.type, hdr.len);
+            break;
+        }
+    }
+}
+
 bool fuzz_waitForExternalInput(run_t* run) {
+    if (run->global->socketFuzzer.binary) {
+        return fuzz_waitForExternalInputBinary(run);
+    }
+
     /* if the target crashed, we need to identify here and return false,
         so honggfuzz will restart it, and the fuzzing loop */
     if (run->crashFileName[0] != '\0') {
@@ -92,6 +236,11 @@ int fuzz_waitforSocketFuzzer(run_t* run) {
 }
 
 bool fuzz_notifySocketFuzzerNewCov(honggfuzz_t* hfuzz) {
+    if (hfuzz->socketFuzzer.binary) {
+        ATOMIC_POST_OR(hfuzz->socketFuzzer.events, SOCKFUZZ_EV_NEW_COV);
+        return true;
+    }
+
     // Tell the fuzzer that the thing he sent reached new BB's
     bool ret = files_sendToSocket(hfuzz->socketFuzzer.clientSocket, (uint8_t*)"New!", 4);
     LOG_D("fuzz_notifySocketFuzzer: SEND: New!");
@@ -103,6 +252,11 @@ bool fuzz_notifySocketFuzzerNewCov(honggfuzz_t* hfuzz) {
 }
 
 bool fuzz_notifySocketFuzzerCrash(run_t* run) {
+    if (run->global->socketFuzzer.binary) {
+        ATOMIC_POST_OR(run->global->socketFuzzer.events, SOCKFUZZ_EV_CRASH);
+        return true;
+    }
+
     bool ret = files_sendToSocket(run->global->socketFuzzer.clientSocket, (uint8_t*)"Cras", 4);
     LOG_D("fuzz_notifySocketFuzzer: SEND: Crash");
     if (!ret) {
@@ -112,6 +266,28 @@ bool fuzz_notifySocketFuzzerCrash(run_t* run) {
     return true;
 }
 
+bool fuzz_notifySocketFuzzerResult(run_t* run) {
+    honggfuzz_t* hfuzz = run->global;
+    if (!hfuzz->socketFuzzer.binary) {
+        return true;
+    }
+
+    const sockFuzzResult_t res = {
+        .seq = hfuzz->socketFuzzer.seq,
+        .events = ATOMIC_XCHG(hfuzz->socketFuzzer.events, 0),
+        .cpuInstrCnt = run->linux.hwCnts.cpuInstrCnt,
+        .cpuBranchCnt = run->linux.hwCnts.cpuBranchCnt,
+        .newBBCnt = run->linux.hwCnts.newBBCnt,
+        .bbCnt = ATOMIC_GET(hfuzz->linux.hwCnts.bbCnt),
+        .softCntPc = ATOMIC_GET(hfuzz->linux.hwCnts.softCntPc),
+        .softCntEdge = ATOMIC_GET(hfuzz->linux.hwCnts.softCntEdge),
+        .softCntCmp = ATOMIC_GET(hfuzz->linux.hwCnts.softCntCmp),
+        .crashesCnt = ATOMIC_GET(hfuzz->cnts.crashesCnt),
+        .uniqueCrashesCnt = ATOMIC_GET(hfuzz->cnts.uniqueCrashesCnt),
+    };
+    return sockFuzz_queue(hfuzz, SOCKFUZZ_MSG_RESULT, &res, sizeof(res));
+}
+
 bool setupSocketFuzzer(honggfuzz_t* run) {
     int s, len;
     socklen_t t;
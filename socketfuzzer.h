@@ -1,5 +1,76 @@
 #include "honggfuzz.h"
 
+/*
+ * The binary protocol (--socket_fuzzer_binary). Every message is a sockFuzzHdr_t followed by 'len'
+ * bytes of payload; all the fields use the host byte order.
+ *
+ *   honggfuzz -> fuzzer: SOCKFUZZ_MSG_READY (sockFuzzReady_t) once the target is (re)started, and
+ *                        SOCKFUZZ_MSG_RESULT (sockFuzzResult_t) for every SOCKFUZZ_MSG_DONE
+ *   fuzzer -> honggfuzz: SOCKFUZZ_MSG_DONE (sockFuzzDone_t) after an input was sent to the target,
+ *                        SOCKFUZZ_MSG_HALT (no payload) to shut honggfuzz down
+ *
+ * The fuzzer doesn't have to wait for the result of an input before it sends the next one to the
+ * target, i.e. inputs can be pipelined, with new coverage attributed to the oldest DONE which is
+ * processed after it was seen. Results of all the DONEs which are already queued are sent
+ * together, and events which don't belong to an input (e.g. a crash, which is noticed when the
+ * target is reaped) are carried by the next RESULT or READY message. After a READY message
+ * reporting SOCKFUZZ_EV_CRASH or SOCKFUZZ_EV_TARGET_DOWN, inputs which were still in flight are
+ * lost, and have to be sent to the new target again
+ */
+#define SOCKFUZZ_MSG_READY 1U
+#define SOCKFUZZ_MSG_RESULT 2U
+#define SOCKFUZZ_MSG_DONE 3U
+#define SOCKFUZZ_MSG_HALT 4U
+
+#define SOCKFUZZ_MSG_MAX_LEN 4096U
+
+/* New coverage since the previous message */
+#define SOCKFUZZ_EV_NEW_COV (1U << 0)
+/* The target crashed (a new unique crash was saved) */
+#define SOCKFUZZ_EV_CRASH (1U << 1)
+/* The fuzzer reported the target as unresponsive (SOCKFUZZ_DONE_TARGET_DOWN) */
+#define SOCKFUZZ_EV_TARGET_DOWN (1U << 2)
+
+/* sockFuzzDone_t.status */
+#define SOCKFUZZ_DONE_OK 0U
+#define SOCKFUZZ_DONE_TARGET_DOWN 1U
+
+typedef struct {
+    uint32_t type;
+    uint32_t len;
+} sockFuzzHdr_t;
+
+typedef struct {
+    /* seq of the last DONE message */
+    uint64_t seq;
+    uint32_t events;
+    uint32_t pid;
+} sockFuzzReady_t;
+
+typedef struct {
+    /* Chosen by the fuzzer, returned in the corresponding RESULT message */
+    uint64_t seq;
+    uint32_t status;
+    uint32_t reserved;
+} sockFuzzDone_t;
+
+typedef struct {
+    uint64_t seq;
+    uint32_t events;
+    uint32_t reserved;
+    /* Of this input */
+    uint64_t cpuInstrCnt;
+    uint64_t cpuBranchCnt;
+    uint64_t newBBCnt;
+    /* Totals */
+    uint64_t bbCnt;
+    uint64_t softCntPc;
+    uint64_t softCntEdge;
+    uint64_t softCntCmp;
+    uint64_t crashesCnt;
+    uint64_t uniqueCrashesCnt;
+} sockFuzzResult_t;
+
 bool fuzz_waitForExternalInput(run_t* run);
 
 bool fuzz_prepareSocketFuzzer(run_t* run);
@@ -7,6 +78,8 @@ int fuzz_waitforSocketFuzzer(run_t* run);
 
 bool fuzz_notifySocketFuzzerNewCov(honggfuzz_t* hfuzz);
 bool fuzz_notifySocketFuzzerCrash(run_t* run);
+/* Binary protocol: queues the RESULT message of the current input */
+bool fuzz_notifySocketFuzzerResult(run_t* run);
 
 bool setupSocketFuzzer(honggfuzz_t* hfuzz);
 void cleanupSocketFuzzer();
@@ -2,6 +2,7 @@
 # Python3
 
 import socket
+import struct
 import sys
 import time
 import random
@@ -40,6 +41,58 @@ class HonggfuzzSocket:
         self.sock.close()
 
 
+class HonggfuzzBinarySocket(HonggfuzzSocket):
+    """ --socket_fuzzer_binary, the messages are described in socketfuzzer.h """
+    MSG_READY = 1
+    MSG_RESULT = 2
+    MSG_DONE = 3
+    MSG_HALT = 4
+
+    EV_NEW_COV = 1 << 0
+    EV_CRASH = 1 << 1
+    EV_TARGET_DOWN = 1 << 2
+
+    HDR = struct.Struct("=II")
+    READY = struct.Struct("=QII")
+    DONE = struct.Struct("=QII")
+    RESULT = struct.Struct("=QII9Q")
+
+    def __init__(self, pid):
+        HonggfuzzSocket.__init__(self, pid)
+        self.rbuf = b""
+
+
+    def sendMsg(self, msgType, payload=b""):
+        self.sock.sendall(self.HDR.pack(msgType, len(payload)) + payload)
+
+
+    def done(self, seq, targetDown=False):
+        self.sendMsg(self.MSG_DONE, self.DONE.pack(seq, 1 if targetDown else 0, 0))
+
+
+    def halt(self):
+        self.sendMsg(self.MSG_HALT)
+
+
+    def recvMsg(self):
+        """ Returns (type, fields), or (None, None) if honggfuzz has quit """
+        while True:
+            if len(self.rbuf) >= self.HDR.size:
+                msgType, msgLen = self.HDR.unpack_from(self.rbuf)
+                if len(self.rbuf) >= self.HDR.size + msgLen:
+                    payload = self.rbuf[self.HDR.size:self.HDR.size + msgLen]
+                    self.rbuf = self.rbuf[self.HDR.size + msgLen:]
+                    if msgType == self.MSG_READY:
+                        return msgType, self.READY.unpack(payload)
+                    if msgType == self.MSG_RESULT:
+                        return msgType, self.RESULT.unpack(payload)
+                    return msgType, payload
+            data = self.sock.recv(4096)
+            if not data:
+                return None, None
+            self.rbuf += data
+
+
 class TargetSocket:
     def __init__(self):
         self.sock = None
@@ -354,6 +407,46 @@ def interactive(pid):
             print("Exception: " + str(e))
 
 
+def pipeline(pid, depth=4):
+    """ Sends up to 'depth' inputs to the target before waiting for their results """
+    hfSocket = HonggfuzzBinarySocket(pid)
+    targetSocket = TargetSocket()
+    hfSocket.connect()
+
+    msgType, ready = hfSocket.recvMsg()
+    if msgType != hfSocket.MSG_READY:
+        print("Expected the READY message, got: " + str(msgType))
+        return
+
+    seq = 0
+    inFlight = 0
+    while True:
+        while inFlight < depth:
+            seq += 1
+            up = targetSocket.sendFuzz(random.randint(1, 5))
+            hfSocket.done(seq, targetDown=not up)
+            inFlight += 1
+            if not up:
+                break
+
+        msgType, fields = hfSocket.recvMsg()
+        if msgType is None:
+            print("Honggfuzz quit, exiting too")
+            break
+        if msgType == hfSocket.MSG_RESULT:
+            inFlight -= 1
+            if fields[1] & hfSocket.EV_NEW_COV:
+                print("--[ R #%d: new coverage, edges: %d" % (fields[0], fields[7]))
+            if fields[1] & hfSocket.EV_CRASH:
+                print("--[ R #%d: target crashed" % fields[0])
+        elif msgType == hfSocket.MSG_READY:
+            # Inputs which were in flight were lost with the old target
+            if fields[1] & hfSocket.EV_CRASH:
+                print("--[ R target crashed after #%d, restarted as pid %d" % (fields[0],
+                    fields[2]))
+            inFlight = 0
+
+
 def main():
     mode = None
     pid = None
@@ -363,16 +456,20 @@ def main():
             mode = "auto"
         elif sys.argv[1] == "interactive":
             mode = "interactive"
+        elif sys.argv[1] == "pipeline":
+            mode = "pipeline"
 
     if len(sys.argv) >= 3:
         pid = int(sys.argv[2])
     else:
-        print "honggfuzz_socketclient.py [auto/interactive] <pid>"
+        print "honggfuzz_socketclient.py [auto/interactive/pipeline] <pid>"
 
     if mode is "auto":
         auto(pid)
     elif mode is "interactive":
         interactive(pid)
+    elif mode is "pipeline":
+        pipeline(pid)
 
 
 main()
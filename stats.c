@@ -0,0 +1,474 @@
+/*
+ *
+ * honggfuzz - live statistics endpoint
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "stats.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif /* defined(__x86_64__) || defined(__i386__) */
+
+#include "input.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+#include "subproc.h"
+
+/*
+ * Log-linear histograms of nanoseconds: 4 buckets per power of 2, so the error is below 25%. Values
+ * 0-3 have their own buckets, bucket (4 * (msb - 1) + next 2 bits) holds the rest
+ */
+#define STATS_HIST_SUB_BITS 2
+#define STATS_HIST_SUB (1U << STATS_HIST_SUB_BITS)
+#define STATS_HIST_BUCKETS ((64U - STATS_HIST_SUB_BITS + 1U) * STATS_HIST_SUB)
+/* Prometheus buckets: powers of 2 from 2^10ns (~1us) to 2^36ns (~69s) */
+#define STATS_PROM_LE_MIN 10
+#define STATS_PROM_LE_MAX 36
+#define STATS_RESP_MAX (1024U * 64U)
+/* How long to compare the TSC with CLOCK_MONOTONIC_RAW for */
+#define STATS_TSC_CALIBRATION_USECS 50000
+
+static const char* const statsPhaseNames[STATS_PHASE_MAX] = {
+    [STATS_PHASE_MUTATE] = "mutate",
+    [STATS_PHASE_MANGLE] = "mangle",
+    [STATS_PHASE_SEND] = "send",
+    [STATS_PHASE_ROUNDTRIP] = "roundtrip",
+    [STATS_PHASE_RUN] = "run",
+    [STATS_PHASE_REAP] = "reap",
+    [STATS_PHASE_ANALYZE] = "analyze",
+    [STATS_PHASE_FEEDBACK] = "feedback",
+    [STATS_PHASE_PERF_FEEDBACK] = "perf_feedback",
+    [STATS_PHASE_REPORT] = "report",
+};
+
+/* Written by the owning fuzzing thread only, so relaxed loads and stores are enough */
+typedef struct {
+    uint64_t hist[STATS_PHASE_MAX][STATS_HIST_BUCKETS];
+    uint64_t sumNs[STATS_PHASE_MAX];
+    uint64_t maxNs[STATS_PHASE_MAX];
+} __attribute__((aligned(_HF_CACHELINE_SZ))) statsThread_t;
+
+/* A consistent-enough copy of all the counters, as provided by the endpoint */
+typedef struct {
+    uint64_t elapsedSecs;
+    uint64_t iterations;
+    uint64_t crashes;
+    uint64_t uniqueCrashes;
+    uint64_t verifiedCrashes;
+    uint64_t blacklistedCrashes;
+    uint64_t timeouts;
+    uint64_t corpusSize;
+    uint64_t corpusSlow;
+    uint64_t newUnits;
+    uint64_t guardNb;
+    uint64_t covEdge;
+    uint64_t covPc;
+    uint64_t covCmp;
+    uint64_t covBb;
+    uint64_t cpuInstr;
+    uint64_t cpuBranch;
+    uint64_t threadsActive;
+    uint64_t threadsMax;
+    uint64_t hist[STATS_PHASE_MAX][STATS_HIST_BUCKETS];
+    uint64_t cnt[STATS_PHASE_MAX];
+    uint64_t sumNs[STATS_PHASE_MAX];
+    uint64_t maxNs[STATS_PHASE_MAX];
+} statsSnapshot_t;
+
+static statsThread_t* statsThreads = NULL;
+static size_t statsThreadsCnt = 0;
+static int statsSock = -1;
+static phaseClock_t statsClock = _HF_PHASE_CLOCK_NONE;
+/* Length of one TSC tick, with _HF_PHASE_CLOCK_TSC */
+static double statsNsPerTick = 1.0;
+
+static size_t stats_bucket(uint64_t v) {
+    if (v < STATS_HIST_SUB) {
+        return (size_t)v;
+    }
+    unsigned msb = 63U - (unsigned)__builtin_clzll(v);
+    size_t sub = (size_t)(v >> (msb - STATS_HIST_SUB_BITS)) & (STATS_HIST_SUB - 1);
+    return ((msb - STATS_HIST_SUB_BITS + 1U) * STATS_HIST_SUB) + sub;
+}
+
+/* Smallest value which falls into the bucket */
+static uint64_t stats_bucketLow(size_t b) {
+    if (b < STATS_HIST_SUB) {
+        return b;
+    }
+    unsigned msb = (unsigned)(b / STATS_HIST_SUB) + STATS_HIST_SUB_BITS - 1U;
+    return (uint64_t)(STATS_HIST_SUB + (b % STATS_HIST_SUB)) << (msb - STATS_HIST_SUB_BITS);
+}
+
+static uint64_t stats_clockNs(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static bool stats_tscInit(void) {
+    /* Invariant TSC: constant rate, and not stopped in deep C-states */
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1U << 8))) {
+        LOG_W("The CPU doesn't have an invariant TSC");
+        return false;
+    }
+    uint64_t ns0 = stats_clockNs(CLOCK_MONOTONIC_RAW);
+    uint64_t tsc0 = __rdtsc();
+    usleep(STATS_TSC_CALIBRATION_USECS);
+    uint64_t ns1 = stats_clockNs(CLOCK_MONOTONIC_RAW);
+    uint64_t tsc1 = __rdtsc();
+    if (tsc1 <= tsc0 || ns1 <= ns0) {
+        LOG_W("The TSC didn't advance during the calibration");
+        return false;
+    }
+    statsNsPerTick = (double)(ns1 - ns0) / (double)(tsc1 - tsc0);
+    LOG_I("Phase timing with the TSC, %.3f MHz", 1000.0 / statsNsPerTick);
+    return true;
+}
+#else  /* defined(__x86_64__) || defined(__i386__) */
+static bool stats_tscInit(void) {
+    LOG_W("The TSC is supported on x86 CPUs only");
+    return false;
+}
+#endif /* defined(__x86_64__) || defined(__i386__) */
+
+uint64_t stats_start(void) {
+    switch (statsClock) {
+        case _HF_PHASE_CLOCK_NONE:
+            return 0;
+        case _HF_PHASE_CLOCK_MONOTONIC:
+            return stats_clockNs(CLOCK_MONOTONIC);
+        case _HF_PHASE_CLOCK_MONOTONIC_RAW:
+            return stats_clockNs(CLOCK_MONOTONIC_RAW);
+        case _HF_PHASE_CLOCK_TSC:
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else  /* defined(__x86_64__) || defined(__i386__) */
+            return 0;
+#endif /* defined(__x86_64__) || defined(__i386__) */
+    }
+    return 0;
+}
+
+void stats_record(run_t* run, statsPhase_t phase, uint64_t started) {
+    if (started == 0 || run->fuzzNo >= statsThreadsCnt) {
+        return;
+    }
+    uint64_t ns = stats_start() - started;
+    if (statsClock == _HF_PHASE_CLOCK_TSC) {
+        ns = (uint64_t)((double)ns * statsNsPerTick);
+    }
+    statsThread_t* st = &statsThreads[run->fuzzNo];
+    size_t b = stats_bucket(ns);
+    ATOMIC_SET(st->hist[phase][b], ATOMIC_GET(st->hist[phase][b]) + 1);
+    ATOMIC_SET(st->sumNs[phase], ATOMIC_GET(st->sumNs[phase]) + ns);
+    if (ns > ATOMIC_GET(st->maxNs[phase])) {
+        ATOMIC_SET(st->maxNs[phase], ns);
+    }
+}
+
+static void stats_snapshot(honggfuzz_t* hfuzz, statsSnapshot_t* s) {
+    memset(s, '\0', sizeof(*s));
+    s->elapsedSecs = (uint64_t)(time(NULL) - hfuzz->timing.timeStart);
+    s->iterations = ATOMIC_GET(hfuzz->cnts.mutationsCnt);
+    s->crashes = ATOMIC_GET(hfuzz->cnts.crashesCnt);
+    s->uniqueCrashes = ATOMIC_GET(hfuzz->cnts.uniqueCrashesCnt);
+    s->verifiedCrashes = ATOMIC_GET(hfuzz->cnts.verifiedCrashesCnt);
+    s->blacklistedCrashes = ATOMIC_GET(hfuzz->cnts.blCrashesCnt);
+    s->timeouts = ATOMIC_GET(hfuzz->cnts.timeoutedCnt);
+    s->corpusSize = ATOMIC_GET(hfuzz->io.dynfileqCnt);
+    s->corpusSlow = input_slowDynamicInputs(hfuzz);
+    s->newUnits = ATOMIC_GET(hfuzz->io.newUnitsAdded);
+    s->guardNb = ATOMIC_GET(hfuzz->feedback.feedbackMap->guardNb);
+    s->covEdge = ATOMIC_GET(hfuzz->linux.hwCnts.softCntEdge);
+    s->covPc = ATOMIC_GET(hfuzz->linux.hwCnts.softCntPc);
+    s->covCmp = ATOMIC_GET(hfuzz->linux.hwCnts.softCntCmp);
+    s->covBb = ATOMIC_GET(hfuzz->linux.hwCnts.bbCnt);
+    s->cpuInstr = ATOMIC_GET(hfuzz->linux.hwCnts.cpuInstrCnt);
+    s->cpuBranch = ATOMIC_GET(hfuzz->linux.hwCnts.cpuBranchCnt);
+    s->threadsActive = ATOMIC_GET(hfuzz->threads.threadsActiveCnt);
+    s->threadsMax = hfuzz->threads.threadsMax;
+
+    for (size_t t = 0; t < statsThreadsCnt; t++) {
+        for (size_t p = 0; p < STATS_PHASE_MAX; p++) {
+            for (size_t b = 0; b < STATS_HIST_BUCKETS; b++) {
+                uint64_t c = ATOMIC_GET(statsThreads[t].hist[p][b]);
+                s->hist[p][b] += c;
+                s->cnt[p] += c;
+            }
+            s->sumNs[p] += ATOMIC_GET(statsThreads[t].sumNs[p]);
+            s->maxNs[p] = MAX(s->maxNs[p], ATOMIC_GET(statsThreads[t].maxNs[p]));
+        }
+    }
+}
+
+/* Approximate (the bucket's lower bound) percentile of a phase's durations */
+static uint64_t stats_percentile(const statsSnapshot_t* s, size_t phase, unsigned pct) {
+    if (s->cnt[phase] == 0) {
+        return 0;
+    }
+    uint64_t want = ((s->cnt[phase] * pct) + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < STATS_HIST_BUCKETS; b++) {
+        seen += s->hist[phase][b];
+        if (seen >= want) {
+            return stats_bucketLow(b);
+        }
+    }
+    return s->maxNs[phase];
+}
+
+static void stats_formatJson(const statsSnapshot_t* s, char* buf, size_t sz) {
+    util_ssnprintf(buf, sz,
+        "{\"elapsed_sec\":%" PRIu64 ",\"iterations\":%" PRIu64 ",\"speed\":%" PRIu64
+        ",\"crashes\":%" PRIu64 ",\"unique_crashes\":%" PRIu64 ",\"verified_crashes\":%" PRIu64
+        ",\"blacklisted_crashes\":%" PRIu64 ",\"timeouts\":%" PRIu64 ",\"corpus_size\":%" PRIu64
+        ",\"slow_corpus_fraction\":%.4f,\"new_units\":%" PRIu64 ",",
+        s->elapsedSecs, s->iterations, s->elapsedSecs ? s->iterations / s->elapsedSecs : 0,
+        s->crashes, s->uniqueCrashes, s->verifiedCrashes, s->blacklistedCrashes, s->timeouts,
+        s->corpusSize, s->corpusSize ? (double)s->corpusSlow / s->corpusSize : 0.0, s->newUnits);
+    util_ssnprintf(buf, sz,
+        "\"coverage\":{\"guard_nb\":%" PRIu64 ",\"edge\":%" PRIu64 ",\"pc\":%" PRIu64
+        ",\"cmp\":%" PRIu64 ",\"bb\":%" PRIu64 ",\"instr\":%" PRIu64 ",\"branch\":%" PRIu64
+        "},\"threads\":{\"active\":%" PRIu64 ",\"max\":%" PRIu64 "},\"phases\":{",
+        s->guardNb, s->covEdge, s->covPc, s->covCmp, s->covBb, s->cpuInstr, s->cpuBranch,
+        s->threadsActive, s->threadsMax);
+    for (size_t p = 0; p < STATS_PHASE_MAX; p++) {
+        util_ssnprintf(buf, sz,
+            "%s\"%s\":{\"count\":%" PRIu64 ",\"sum_ns\":%" PRIu64 ",\"p50_ns\":%" PRIu64
+            ",\"p90_ns\":%" PRIu64 ",\"p99_ns\":%" PRIu64 ",\"max_ns\":%" PRIu64 "}",
+            p ? "," : "", statsPhaseNames[p], s->cnt[p], s->sumNs[p], stats_percentile(s, p, 50),
+            stats_percentile(s, p, 90), stats_percentile(s, p, 99), s->maxNs[p]);
+    }
+    util_ssnprintf(buf, sz, "}}\n");
+}
+
+static void stats_formatPromCounter(
+    char* buf, size_t sz, const char* name, const char* type, const char* help, uint64_t val) {
+    util_ssnprintf(buf, sz,
+        "# HELP honggfuzz_%s %s\n# TYPE honggfuzz_%s %s\nhonggfuzz_%s %" PRIu64 "\n", name, help,
+        name, type, name, val);
+}
+
+static void stats_formatProm(const statsSnapshot_t* s, char* buf, size_t sz) {
+    stats_formatPromCounter(
+        buf, sz, "elapsed_seconds", "gauge", "Duration of the fuzzing session", s->elapsedSecs);
+    stats_formatPromCounter(
+        buf, sz, "iterations_total", "counter", "Executed fuzzing iterations", s->iterations);
+    stats_formatPromCounter(buf, sz, "crashes_total", "counter", "Crashes", s->crashes);
+    stats_formatPromCounter(
+        buf, sz, "unique_crashes_total", "counter", "Unique crashes", s->uniqueCrashes);
+    stats_formatPromCounter(
+        buf, sz, "verified_crashes_total", "counter", "Verified crashes", s->verifiedCrashes);
+    stats_formatPromCounter(buf, sz, "blacklisted_crashes_total", "counter",
+        "Crashes with blacklisted stack hashes", s->blacklistedCrashes);
+    stats_formatPromCounter(buf, sz, "timeouts_total", "counter", "Timed out runs", s->timeouts);
+    stats_formatPromCounter(
+        buf, sz, "corpus_size", "gauge", "Entries of the dynamic corpus", s->corpusSize);
+    stats_formatPromCounter(buf, sz, "corpus_slow", "gauge",
+        "Entries of the dynamic corpus 10x slower than the median one", s->corpusSlow);
+    stats_formatPromCounter(buf, sz, "new_units_total", "counter",
+        "Inputs added to the corpus after the dry run", s->newUnits);
+    stats_formatPromCounter(
+        buf, sz, "guards", "gauge", "PC guards in the instrumented binaries", s->guardNb);
+    stats_formatPromCounter(buf, sz, "coverage_edges", "gauge", "Covered edges", s->covEdge);
+    stats_formatPromCounter(buf, sz, "coverage_pcs", "gauge", "Covered PCs", s->covPc);
+    stats_formatPromCounter(buf, sz, "coverage_cmp", "gauge", "Comparison progress", s->covCmp);
+    stats_formatPromCounter(
+        buf, sz, "coverage_bbs", "gauge", "Basic blocks/branches (hw feedback)", s->covBb);
+    stats_formatPromCounter(buf, sz, "cpu_instructions", "gauge",
+        "Max. instructions executed per run (hw feedback)", s->cpuInstr);
+    stats_formatPromCounter(buf, sz, "cpu_branches", "gauge",
+        "Max. branches executed per run (hw feedback)", s->cpuBranch);
+    stats_formatPromCounter(
+        buf, sz, "threads_active", "gauge", "Active fuzzing threads", s->threadsActive);
+
+    util_ssnprintf(buf, sz,
+        "# HELP honggfuzz_phase_duration_seconds Duration of the fuzzing iteration phases\n"
+        "# TYPE honggfuzz_phase_duration_seconds histogram\n");
+    for (size_t p = 0; p < STATS_PHASE_MAX; p++) {
+        uint64_t cum = 0;
+        size_t b = 0;
+        for (unsigned le = STATS_PROM_LE_MIN; le <= STATS_PROM_LE_MAX; le++) {
+            for (; b < STATS_HIST_BUCKETS && stats_bucketLow(b) < (1ULL << le); b++) {
+                cum += s->hist[p][b];
+            }
+            util_ssnprintf(buf, sz,
+                "honggfuzz_phase_duration_seconds_bucket{phase=\"%s\",le=\"%.9f\"} %" PRIu64 "\n",
+                statsPhaseNames[p], (double)(1ULL << le) / 1e9, cum);
+        }
+        util_ssnprintf(buf, sz,
+            "honggfuzz_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+            "honggfuzz_phase_duration_seconds_sum{phase=\"%s\"} %.9f\n"
+            "honggfuzz_phase_duration_seconds_count{phase=\"%s\"} %" PRIu64 "\n",
+            statsPhaseNames[p], s->cnt[p], statsPhaseNames[p], (double)s->sumNs[p] / 1e9,
+            statsPhaseNames[p], s->cnt[p]);
+    }
+}
+
+static void stats_serve(honggfuzz_t* hfuzz, int fd) {
+    /* Don't let a stuck client block the endpoint */
+    struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
+        PLOG_W("setsockopt(SO_RCVTIMEO)");
+    }
+    char req[1024];
+    ssize_t len = TEMP_FAILURE_RETRY(recv(fd, req, sizeof(req) - 1, 0));
+    if (len <= 0) {
+        return;
+    }
+    req[len] = '\0';
+    bool prom = util_strStartsWith(req, "GET /metrics");
+
+    statsSnapshot_t* s = util_Malloc(sizeof(statsSnapshot_t));
+    char* body = util_Malloc(STATS_RESP_MAX);
+    defer {
+        free(s);
+        free(body);
+    };
+    stats_snapshot(hfuzz, s);
+    body[0] = '\0';
+    if (prom) {
+        stats_formatProm(s, body, STATS_RESP_MAX);
+    } else {
+        stats_formatJson(s, body, STATS_RESP_MAX);
+    }
+
+    char hdr[256];
+    snprintf(hdr, sizeof(hdr),
+        "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        prom ? "text/plain; version=0.0.4" : "application/json", strlen(body));
+    if (!files_sendToSocket(fd, (uint8_t*)hdr, strlen(hdr)) ||
+        !files_sendToSocket(fd, (uint8_t*)body, strlen(body))) {
+        LOG_D("Couldn't send the stats response");
+    }
+}
+
+static void* stats_thread(void* arg) {
+    honggfuzz_t* hfuzz = (honggfuzz_t*)arg;
+    for (;;) {
+        int fd = TEMP_FAILURE_RETRY(accept(statsSock, NULL, NULL));
+        if (fd == -1) {
+            PLOG_W("accept(stats socket fd=%d)", statsSock);
+            continue;
+        }
+        stats_serve(hfuzz, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static bool stats_initSocket(honggfuzz_t* hfuzz) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(hfuzz->display.statsSocket) >= sizeof(addr.sun_path)) {
+        LOG_E("The stats socket path '%s' is too long", hfuzz->display.statsSocket);
+        return false;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", hfuzz->display.statsSocket);
+
+    statsSock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (statsSock == -1) {
+        PLOG_E("socket(AF_UNIX)");
+        return false;
+    }
+    unlink(addr.sun_path);
+    if (bind(statsSock, (const struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        PLOG_E("bind('%s')", addr.sun_path);
+        return false;
+    }
+    if (listen(statsSock, 16) == -1) {
+        PLOG_E("listen('%s')", addr.sun_path);
+        return false;
+    }
+
+    pthread_t thread;
+    if (!subproc_runThread(hfuzz, &thread, stats_thread, /* joinable= */ false)) {
+        LOG_E("Couldn't start the stats thread");
+        return false;
+    }
+    LOG_I("Serving stats on the '%s' Unix socket", addr.sun_path);
+    return true;
+}
+
+bool stats_init(honggfuzz_t* hfuzz) {
+    if (!hfuzz->display.statsSocket && hfuzz->display.phaseClock == _HF_PHASE_CLOCK_NONE) {
+        return true;
+    }
+
+    /* Indexed with run->fuzzNo, of which every thread has --async_runs */
+    statsThreadsCnt = hfuzz->threads.threadsMax * MAX(hfuzz->threads.asyncRuns, 1U);
+    statsThreads = util_Calloc(sizeof(statsThread_t) * statsThreadsCnt);
+
+    phaseClock_t clk = hfuzz->display.phaseClock;
+    if (clk == _HF_PHASE_CLOCK_NONE) {
+        clk = _HF_PHASE_CLOCK_MONOTONIC;
+    }
+    if (clk == _HF_PHASE_CLOCK_TSC && !stats_tscInit()) {
+        LOG_W("Using CLOCK_MONOTONIC_RAW for phase timing instead of the TSC");
+        clk = _HF_PHASE_CLOCK_MONOTONIC_RAW;
+    }
+
+    if (hfuzz->display.statsSocket && !stats_initSocket(hfuzz)) {
+        return false;
+    }
+    /* The fuzzing threads are not started yet */
+    statsClock = clk;
+    return true;
+}
+
+void stats_close(honggfuzz_t* hfuzz) {
+    if (statsSock != -1) {
+        unlink(hfuzz->display.statsSocket);
+    }
+    if (hfuzz->display.phaseClock == _HF_PHASE_CLOCK_NONE || !statsThreads) {
+        return;
+    }
+
+    statsSnapshot_t* s = util_Malloc(sizeof(statsSnapshot_t));
+    defer {
+        free(s);
+    };
+    stats_snapshot(hfuzz, s);
+    LOG_I("Phase durations (ns): %13s %10s %10s %10s %12s %12s", "count", "mean", "p50", "p99",
+        "max", "total(ms)");
+    for (size_t p = 0; p < STATS_PHASE_MAX; p++) {
+        if (s->cnt[p] == 0) {
+            continue;
+        }
+        LOG_I("    %-17s %13" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64
+              " %12" PRIu64,
+            statsPhaseNames[p], s->cnt[p], s->sumNs[p] / s->cnt[p], stats_percentile(s, p, 50),
+            stats_percentile(s, p, 99), s->maxNs[p], s->sumNs[p] / 1000000U);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ *
+ * honggfuzz - live statistics endpoint
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_STATS_H_
+#define _HF_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "honggfuzz.h"
+
+/*
+ * Phases of one fuzzing iteration, whose durations are kept in histograms. Some of them nest:
+ * MANGLE is a part of MUTATE (fuzz_fetchInput()), SEND/ROUNDTRIP/REAP/ANALYZE are parts of RUN
+ * (subproc_Run()), and PERF_FEEDBACK is a part of FEEDBACK
+ */
+typedef enum {
+    STATS_PHASE_MUTATE = 0,
+    STATS_PHASE_MANGLE,
+    STATS_PHASE_SEND,
+    /* From sending the input to the persistent process, till it reports being ready again */
+    STATS_PHASE_ROUNDTRIP,
+    STATS_PHASE_RUN,
+    STATS_PHASE_REAP,
+    STATS_PHASE_ANALYZE,
+    STATS_PHASE_FEEDBACK,
+    STATS_PHASE_PERF_FEEDBACK,
+    STATS_PHASE_REPORT,
+    STATS_PHASE_MAX,
+} statsPhase_t;
+
+/*
+ * Enables the phase histograms if --stats_socket or --phase_timing was used, and starts the
+ * --stats_socket server: HTTP over a Unix socket, with 'GET /metrics' returning the
+ * Prometheus text format, and any other path JSON, e.g.
+ *
+ *   curl --unix-socket <path> http://localhost/metrics
+ */
+extern bool stats_init(honggfuzz_t* hfuzz);
+/* Logs the phase histograms with --phase_timing */
+extern void stats_close(honggfuzz_t* hfuzz);
+
+/* Beginning of a phase (in --phase_timing clock units), or 0 if the stats are disabled */
+extern uint64_t stats_start(void);
+/* Records the duration of a phase which began at 'started' (see stats_start()) */
+extern void stats_record(run_t* run, statsPhase_t phase, uint64_t started);
+
+#endif /* ifndef _HF_STATS_H_ */
@@ -44,6 +44,7 @@
 #include "libhfcommon/files.h"
 #include "libhfcommon/log.h"
 #include "libhfcommon/util.h"
+#include "stats.h"
 
 extern char** environ;
 
@@ -123,8 +124,29 @@ const char* subproc_StatusToStr(int status, char* str, size_t len) {
     return str;
 }
 
+/* For how many iterations to poll the shared handshake state before going to sleep */
+#define _HF_PERSISTENT_SPIN_CNT 1024U
+
+static persistentCtl_t* subproc_persistentCtl(run_t* run) {
+    return &run->feedbackMap->persistentCtl[run->fuzzNo];
+}
+
 static bool subproc_persistentSendFileIndicator(run_t* run) {
     uint64_t len = (uint64_t)run->dynamicFileSz;
+    if (run->batchCapable) {
+        /* A zero count means a single input, passed in the regular input file */
+        run->batchHdr->cnt = run->batchCnt;
+        ATOMIC_SET(run->batchHdr->done, 0);
+    }
+    if (run->persistentShm) {
+        persistentCtl_t* ctl = subproc_persistentCtl(run);
+        ctl->len = len;
+        ATOMIC_SET_SEQCST(ctl->state, _HF_PERSISTENT_DATA);
+        if (ATOMIC_GET_SEQCST(ctl->childWaiting)) {
+            util_futexWake(&ctl->state);
+        }
+        return true;
+    }
     if (!files_sendToSocketNB(run->persistentSock, (uint8_t*)&len, sizeof(len))) {
         PLOG_W("files_sendToSocketNB(len=%zu)", sizeof(len));
         return false;
@@ -132,11 +154,7 @@ static bool subproc_persistentSendFileIndicator(run_t* run) {
     return true;
 }
 
-static bool subproc_persistentGetReady(run_t* run) {
-    uint8_t rcv;
-    if (recv(run->persistentSock, &rcv, sizeof(rcv), MSG_DONTWAIT) != sizeof(rcv)) {
-        return false;
-    }
+static bool subproc_persistentCheckTag(uint8_t rcv) {
     if (rcv != HFReadyTag) {
         LOG_E("Received invalid message from the persistent process: '%c' (0x%" PRIx8
               ") , expected '%c' (0x%" PRIx8 ")",
@@ -146,6 +164,57 @@ static bool subproc_persistentGetReady(run_t* run) {
     return true;
 }
 
+static bool subproc_persistentGetReady(run_t* run) {
+    uint8_t rcv;
+    if (recv(run->persistentSock, &rcv, sizeof(rcv), MSG_DONTWAIT) != sizeof(rcv)) {
+        return false;
+    }
+    return subproc_persistentCheckTag(rcv);
+}
+
+/* Consumes the ready tags (if any) which the persistent process has sent to wake the fuzzer up */
+bool subproc_persistentDrainTags(run_t* run) {
+    uint8_t rcv[16];
+    ssize_t sz;
+    while ((sz = recv(run->persistentSock, rcv, sizeof(rcv), MSG_DONTWAIT)) > 0) {
+        for (ssize_t i = 0; i < sz; i++) {
+            if (!subproc_persistentCheckTag(rcv[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * The persistent process sets ctl->state to READY, and writes the ready tag to the socket only if
+ * it has claimed ctl->parentWaiting (set when the fuzzer is about to sleep in epoll_wait()). Such a
+ * tag can arrive after the state was already seen, so the socket is drained on every call: a stale
+ * tag would keep the (level-triggered) socket readable, and the fuzzer would never sleep
+ */
+static bool subproc_persistentGetReadyShm(run_t* run) {
+    persistentCtl_t* ctl = subproc_persistentCtl(run);
+
+    bool ready = false;
+    for (unsigned i = 0; i < _HF_PERSISTENT_SPIN_CNT; i++) {
+        if (ATOMIC_GET_ACQUIRE(ctl->state) == _HF_PERSISTENT_READY) {
+            ready = true;
+            break;
+        }
+        util_cpuRelax();
+    }
+    if (!ready) {
+        /* Re-check after announcing the wait, the process might have missed the flag */
+        ATOMIC_SET_SEQCST(ctl->parentWaiting, 1U);
+        if (ATOMIC_GET_SEQCST(ctl->state) != _HF_PERSISTENT_READY) {
+            subproc_persistentDrainTags(run);
+            return false;
+        }
+    }
+    ATOMIC_CLEAR(ctl->parentWaiting);
+    return subproc_persistentDrainTags(run);
+}
+
 bool subproc_persistentModeStateMachine(run_t* run) {
     if (!run->global->exe.persistent) {
         return false;
@@ -154,25 +223,50 @@ bool subproc_persistentModeStateMachine(run_t* run) {
     for (;;) {
         switch (run->runState) {
             case _HF_RS_WAITING_FOR_INITIAL_READY: {
+                /*
+                 * The first ready message always goes over the socket. If the process has set the
+                 * shared state before sending it, it supports the shared memory handshake
+                 */
                 if (!subproc_persistentGetReady(run)) {
                     return false;
                 }
+                persistentCtl_t* ctl = subproc_persistentCtl(run);
+                run->persistentShm = (ATOMIC_GET_SEQCST(ctl->state) == _HF_PERSISTENT_READY);
+                if (run->global->exe.snapshot) {
+                    /* It might be a stale tag from the previous worker, wait for the new one */
+                    if (!run->persistentShm) {
+                        return false;
+                    }
+                    run->snapshotPid = ATOMIC_GET(ctl->workerPid);
+                    LOG_D("Snapshot worker pid=%d is ready", (int)run->snapshotPid);
+                }
+                run->batchCapable = run->persistentShm && run->batchHdr &&
+                                    ATOMIC_GET(ctl->batchCapable);
+                ATOMIC_CLEAR(ctl->parentWaiting);
                 run->runState = _HF_RS_SEND_DATA;
             }; break;
             case _HF_RS_SEND_DATA: {
-                if (!subproc_persistentSendFileIndicator(run)) {
+                uint64_t started = stats_start();
+                bool sent = subproc_persistentSendFileIndicator(run);
+                stats_record(run, STATS_PHASE_SEND, started);
+                if (!sent) {
                     LOG_E("Could not send the file size indicator to the persistent process. "
                           "Killing the process pid=%d",
                         (int)run->pid);
                     kill(run->pid, SIGKILL);
                     return false;
                 }
+                run->roundTripStarted = stats_start();
                 run->runState = _HF_RS_WAITING_FOR_READY;
             }; break;
             case _HF_RS_WAITING_FOR_READY: {
-                if (!subproc_persistentGetReady(run)) {
+                bool ready = run->persistentShm ? subproc_persistentGetReadyShm(run)
+                                                : subproc_persistentGetReady(run);
+                if (!ready) {
                     return false;
                 }
+                stats_record(run, STATS_PHASE_ROUNDTRIP, run->roundTripStarted);
+                run->roundTripStarted = 0;
                 run->runState = _HF_RS_SEND_DATA;
                 /* The current persistent round is done */
                 return true;
@@ -183,6 +277,119 @@ bool subproc_persistentModeStateMachine(run_t* run) {
     }
 }
 
+/* Puts 'var' ("NAME=VALUE", or "NAME" to remove it, as with putenv()) into the envp being built */
+static bool subproc_envPut(char** envs, size_t* cnt, char* var, bool overwrite) {
+    const char* eq = strchr(var, '=');
+    size_t nameLen = eq ? (size_t)(eq - var) : strlen(var);
+    for (size_t i = 0; i < *cnt; i++) {
+        if (strncmp(envs[i], var, nameLen) != 0 || envs[i][nameLen] != '=') {
+            continue;
+        }
+        if (!overwrite) {
+            return false;
+        }
+        if (eq) {
+            envs[i] = var;
+        } else {
+            envs[i] = envs[--(*cnt)];
+            envs[*cnt] = NULL;
+        }
+        return true;
+    }
+    if (eq) {
+        envs[(*cnt)++] = var;
+    }
+    return true;
+}
+
+static void subproc_envSet(
+    char** envs, size_t* cnt, const char* name, const char* val, bool overwrite) {
+    size_t len = strlen(name) + strlen(val) + 2;
+    char* var = (char*)util_Malloc(len);
+    snprintf(var, len, "%s=%s", name, val);
+    if (!subproc_envPut(envs, cnt, var, overwrite)) {
+        free(var);
+    }
+}
+
+/*
+ * argv and envp of the fuzzed processes don't change during the thread's lifetime, so they're
+ * built once, and forked children only point environ at them, instead of calling setenv() and
+ * scanning the arguments for _HF_FILE_PLACEHOLDER before every execve()
+ */
+static void subproc_initExec(run_t* run) {
+    static const char inputFile[] = "/dev/fd/" HF_XSTR(_HF_INPUT_FD);
+
+    int argc = run->global->exe.argc;
+    run->execArgs = (const char**)util_Calloc(sizeof(char*) * (argc + 1));
+    for (int x = 0; x < argc; x++) {
+        const char* arg = run->global->exe.cmdline[x];
+        const char* off = strstr(arg, _HF_FILE_PLACEHOLDER);
+        if (!strcmp(arg, _HF_FILE_PLACEHOLDER)) {
+            run->execArgs[x] = inputFile;
+        } else if (off) {
+            size_t len = (size_t)(off - arg) + sizeof(inputFile);
+            char* argData = (char*)util_Malloc(len);
+            snprintf(argData, len, "%.*s%s", (int)(off - arg), arg, inputFile);
+            run->execArgs[x] = argData;
+        } else {
+            run->execArgs[x] = arg;
+        }
+    }
+
+    size_t envsMax = ARRAYSIZE(run->global->exe.envs) + 16;
+    for (size_t i = 0; !run->global->exe.clearEnv && environ && environ[i]; i++) {
+        envsMax++;
+    }
+    char** envs = (char**)util_Calloc(sizeof(char*) * (envsMax + 1));
+    size_t cnt = 0;
+    for (size_t i = 0; !run->global->exe.clearEnv && environ && environ[i]; i++) {
+        envs[cnt++] = environ[i];
+    }
+    for (size_t i = 0; i < ARRAYSIZE(run->global->exe.envs) && run->global->exe.envs[i]; i++) {
+        subproc_envPut(envs, &cnt, run->global->exe.envs[i], /* overwrite= */ true);
+    }
+
+    char fuzzNo[128];
+    snprintf(fuzzNo, sizeof(fuzzNo), "%" PRId32, run->fuzzNo);
+    subproc_envSet(envs, &cnt, _HF_THREAD_NO_ENV, fuzzNo, true);
+    if (run->global->exe.netDriver) {
+        subproc_envSet(envs, &cnt, _HF_THREAD_NETDRIVER_ENV, "1", true);
+    }
+    if (run->global->feedback.localCov) {
+        subproc_envSet(envs, &cnt, _HF_LOCAL_COV_ENV, "1", true);
+    }
+    if (run->global->exe.forkServer) {
+        subproc_envSet(envs, &cnt, _HF_FORKSERVER_ENV, "1", true);
+    }
+    if (run->global->exe.snapshot) {
+        subproc_envSet(envs, &cnt, _HF_SNAPSHOT_ENV, "1", true);
+    }
+    if (run->global->exe.stdinPipe && run->global->exe.forkServer) {
+        subproc_envSet(envs, &cnt, _HF_STDIN_PIPE_ENV, "1", true);
+    }
+    if (run->global->linux.inprocCrash) {
+        subproc_envSet(envs, &cnt, _HF_INPROC_CRASH_ENV, "1", true);
+    }
+    if (run->global->feedback.hugePages) {
+        subproc_envSet(envs, &cnt, _HF_HUGE_PAGES_ENV, "1", true);
+    }
+    if (run->global->exe.netDriver || run->global->exe.persistent) {
+        char llstr[32];
+        snprintf(llstr, sizeof(llstr), "%d", logGetLevel());
+        subproc_envSet(envs, &cnt, _HF_LOG_LEVEL_ENV, llstr, true);
+    }
+#if defined(_HF_ARCH_LINUX)
+    if (run->linux.nsFds[0] != -1) {
+        subproc_envSet(envs, &cnt, _HF_NS_FD_ENV, "1", true);
+    }
+    /* Kill a process which corrupts its own heap (with ABRT), unless these are set already */
+    subproc_envSet(envs, &cnt, "MALLOC_CHECK_", "7", /* overwrite= */ false);
+    subproc_envSet(envs, &cnt, "MALLOC_PERTURB_", "85", /* overwrite= */ false);
+#endif /* defined(_HF_ARCH_LINUX) */
+    run->execEnvs = envs;
+}
+
 static bool subproc_PrepareExecv(run_t* run) {
     /*
      * The address space limit. If big enough - roughly the size of RAM used
@@ -230,18 +437,7 @@ static bool subproc_PrepareExecv(run_t* run) {
     }
 #endif /* ifdef RLIMIT_CORE */
 
-    if (run->global->exe.clearEnv) {
-        environ = NULL;
-    }
-    for (size_t i = 0; i < ARRAYSIZE(run->global->exe.envs) && run->global->exe.envs[i]; i++) {
-        putenv(run->global->exe.envs[i]);
-    }
-    char fuzzNo[128];
-    snprintf(fuzzNo, sizeof(fuzzNo), "%" PRId32, run->fuzzNo);
-    setenv(_HF_THREAD_NO_ENV, fuzzNo, 1);
-    if (run->global->exe.netDriver) {
-        setenv(_HF_THREAD_NETDRIVER_ENV, "1", 1);
-    }
+    environ = run->execEnvs;
 
     /* Make sure it's a new process group / session, so waitpid can wait for -(run->pid) */
     setsid();
@@ -251,8 +447,15 @@ static bool subproc_PrepareExecv(run_t* run) {
         /* close_stderr= */ run->global->exe.nullifyStdio);
 
     /* The bitmap/feedback structure */
-    if (TEMP_FAILURE_RETRY(dup2(run->global->feedback.bbFd, _HF_BITMAP_FD)) == -1) {
-        PLOG_E("dup2(%d, _HF_BITMAP_FD=%d)", run->global->feedback.bbFd, _HF_BITMAP_FD);
+    if (TEMP_FAILURE_RETRY(dup2(run->feedbackFd, _HF_BITMAP_FD)) == -1) {
+        PLOG_E("dup2(%d, _HF_BITMAP_FD=%d)", run->feedbackFd, _HF_BITMAP_FD);
+        return false;
+    }
+
+    /* PC tables of the coverage (--export_cov) */
+    if (run->global->feedback.covPcsFd != -1 &&
+        TEMP_FAILURE_RETRY(dup2(run->global->feedback.covPcsFd, _HF_COV_PCS_FD)) == -1) {
+        PLOG_E("dup2(%d, _HF_COV_PCS_FD=%d)", run->global->feedback.covPcsFd, _HF_COV_PCS_FD);
         return false;
     }
 
@@ -266,15 +469,17 @@ static bool subproc_PrepareExecv(run_t* run) {
         return false;
     }
 
+    if (run->batchFd != -1 && TEMP_FAILURE_RETRY(dup2(run->batchFd, _HF_BATCH_FD)) == -1) {
+        PLOG_E("dup2('%d', _HF_BATCH_FD='%d')", run->batchFd, _HF_BATCH_FD);
+        return false;
+    }
+
     /* The log FD */
     if ((run->global->exe.netDriver || run->global->exe.persistent)) {
         if (TEMP_FAILURE_RETRY(dup2(logFd(), _HF_LOG_FD)) == -1) {
             PLOG_E("dup2(%d, _HF_LOG_FD=%d)", logFd(), _HF_LOG_FD);
             return false;
         }
-        char llstr[32];
-        snprintf(llstr, sizeof(llstr), "%d", logGetLevel());
-        setenv(_HF_LOG_LEVEL_ENV, llstr, 1);
     }
 
     sigset_t sset;
@@ -283,8 +488,20 @@ static bool subproc_PrepareExecv(run_t* run) {
         PLOG_W("sigprocmask(empty_set)");
     }
 
-    if (run->global->exe.fuzzStdin &&
-        TEMP_FAILURE_RETRY(dup2(run->dynamicFileFd, STDIN_FILENO)) == -1) {
+    /* The fork-server creates the stdin pipes for the processes which it forks */
+    if (run->global->exe.stdinPipe && !run->global->exe.forkServer) {
+        int pipeFd = files_pipeFromBuf(run->dynamicFile, run->dynamicFileSz);
+        if (pipeFd == -1) {
+            LOG_E("Couldn't create the stdin pipe, input size: %zu", run->dynamicFileSz);
+            return false;
+        }
+        if (TEMP_FAILURE_RETRY(dup2(pipeFd, STDIN_FILENO)) == -1) {
+            PLOG_E("dup2(pipe=%d, STDIN_FILENO=%d)", pipeFd, STDIN_FILENO);
+            return false;
+        }
+        close(pipeFd);
+    } else if (run->global->exe.fuzzStdin &&
+               TEMP_FAILURE_RETRY(dup2(run->dynamicFileFd, STDIN_FILENO)) == -1) {
         PLOG_E("dup2(_HF_INPUT_FD=%d, STDIN_FILENO=%d)", run->dynamicFileFd, STDIN_FILENO);
         return false;
     }
@@ -312,6 +529,20 @@ static bool subproc_New(run_t* run) {
             return false;
         }
         run->persistentSock = sv[0];
+
+        persistentCtl_t* ctl = subproc_persistentCtl(run);
+        ATOMIC_SET(ctl->state, _HF_PERSISTENT_NONE);
+        ATOMIC_SET(ctl->parentWaiting, 1U);
+        ATOMIC_SET(ctl->childWaiting, 0U);
+        ATOMIC_SET(ctl->workerPid, 0);
+        ATOMIC_SET(ctl->batchCapable, 0U);
+        run->persistentShm = false;
+        run->batchCapable = false;
+        run->snapshotPid = 0;
+    }
+
+    if (!run->execArgs) {
+        subproc_initExec(run);
     }
 
     LOG_D("Forking new process for thread: %" PRId32, run->fuzzNo);
@@ -373,8 +604,90 @@ static bool subproc_New(run_t* run) {
     return true;
 }
 
-bool subproc_Run(run_t* run) {
+/* Exec times of a thread merged into the global histogram at once */
+#define _HF_EXEC_TIMES_FLUSH 1024
+/* Executions needed before --timeout_auto sets the limit, the histogram decays past 64x that */
+#define _HF_EXEC_TIMES_MIN 1000
+/* Lower bound of the --timeout_auto limit */
+#define _HF_TMOUT_AUTO_MIN_MILLIS 10
+
+size_t subproc_execTimesBucket(uint64_t usecs) {
+    if (usecs < 4) {
+        return usecs;
+    }
+    size_t msb = 63 - __builtin_clzll(usecs);
+    return MIN(msb * 4 + ((usecs >> (msb - 2)) & 3), _HF_EXEC_TIMES_BUCKETS - 1);
+}
+
+uint64_t subproc_execTimesBucketMax(size_t idx) {
+    if (idx < 8) {
+        return idx + 1;
+    }
+    return (uint64_t)(4 + (idx % 4) + 1) << (idx / 4 - 2);
+}
+
+/*
+ * Merges the thread's exec times into timing.execTimes, and sets timing.tmOutAutoMillis to the
+ * upper bound of their 99.9th percentile multiplied by --timeout_auto
+ */
+static void subproc_execTimesMerge(run_t* run) {
+    honggfuzz_t* hfuzz = run->global;
+
+    MX_LOCK(&hfuzz->timing.execTimesMutex);
+    defer {
+        MX_UNLOCK(&hfuzz->timing.execTimesMutex);
+    };
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < _HF_EXEC_TIMES_BUCKETS; i++) {
+        hfuzz->timing.execTimes[i] += run->execTimes.hist[i];
+        total += hfuzz->timing.execTimes[i];
+    }
+    memset(&run->execTimes, '\0', sizeof(run->execTimes));
+    if (total < _HF_EXEC_TIMES_MIN) {
+        return;
+    }
+    /* Halving the counts makes the percentile follow the exec times of the current corpus */
+    if (total > (_HF_EXEC_TIMES_MIN * 64)) {
+        total = 0;
+        for (size_t i = 0; i < _HF_EXEC_TIMES_BUCKETS; i++) {
+            hfuzz->timing.execTimes[i] /= 2;
+            total += hfuzz->timing.execTimes[i];
+        }
+    }
+
+    uint64_t target = total - (total / 1000);
+    uint64_t cum = 0;
+    size_t idx = 0;
+    for (; idx < _HF_EXEC_TIMES_BUCKETS - 1; idx++) {
+        cum += hfuzz->timing.execTimes[idx];
+        if (cum >= target) {
+            break;
+        }
+    }
+    int64_t tmOut = (int64_t)((subproc_execTimesBucketMax(idx) * hfuzz->timing.tmOutAutoMul +
+                                  999) /
+                              1000);
+    tmOut = MAX(tmOut, _HF_TMOUT_AUTO_MIN_MILLIS);
+    if (hfuzz->timing.tmOutMillis) {
+        tmOut = MIN(tmOut, hfuzz->timing.tmOutMillis);
+    }
+    if (tmOut != ATOMIC_GET(hfuzz->timing.tmOutAutoMillis)) {
+        LOG_D("Auto timeout: %" PRId64 " ms (p99.9 exec time < %" PRIu64 " us, %" PRIu64
+              " execs)",
+            tmOut, subproc_execTimesBucketMax(idx), total);
+        ATOMIC_SET(hfuzz->timing.tmOutAutoMillis, tmOut);
+    }
+}
+
+int64_t subproc_timeLimitMillis(run_t* run) {
+    int64_t autoMillis = ATOMIC_GET(run->global->timing.tmOutAutoMillis);
+    return autoMillis ? autoMillis : run->global->timing.tmOutMillis;
+}
+
+bool subproc_runStart(run_t* run) {
     run->timeStartedMillis = util_timeNowMillis();
+    run->timeStartedUSecs = util_timeNowUSecs();
 
     if (!subproc_New(run)) {
         LOG_E("subproc_New()");
@@ -382,13 +695,34 @@ bool subproc_Run(run_t* run) {
     }
 
     arch_prepareParent(run);
-    arch_reapChild(run);
+    return true;
+}
 
+void subproc_runDone(run_t* run) {
+    run->timeExecUSecs = util_timeNowUSecs() - run->timeStartedUSecs;
+    /* Timed out runs would make the limit grow with every update */
+    if (run->global->timing.tmOutAutoMul && !run->tmOutSignaled) {
+        run->execTimes.hist[subproc_execTimesBucket(run->timeExecUSecs)]++;
+        if (++run->execTimes.cnt == _HF_EXEC_TIMES_FLUSH) {
+            subproc_execTimesMerge(run);
+        }
+    }
     int64_t diffMillis = util_timeNowMillis() - run->timeStartedMillis;
     if (diffMillis >= run->global->timing.timeOfLongestUnitInMilliseconds) {
         run->global->timing.timeOfLongestUnitInMilliseconds = diffMillis;
     }
+}
+
+bool subproc_Run(run_t* run) {
+    if (!subproc_runStart(run)) {
+        return false;
+    }
 
+    uint64_t started = stats_start();
+    arch_reapChild(run);
+    stats_record(run, STATS_PHASE_REAP, started);
+
+    subproc_runDone(run);
     return true;
 }
 
@@ -451,33 +785,40 @@ uint8_t subproc_System(run_t* run, const char* const argv[]) {
     }
 }
 
+int64_t subproc_timeLimitDeadline(run_t* run) {
+    int64_t tmOut = subproc_timeLimitMillis(run);
+    if (!tmOut) {
+        return 0;
+    }
+    /* A signaled process gets another timeout period (up to 1 s) to terminate */
+    return run->timeStartedMillis + tmOut + (run->tmOutSignaled ? MIN(tmOut, 1000) : 0);
+}
+
 void subproc_checkTimeLimit(run_t* run) {
-    if (!run->global->timing.tmOut) {
+    int64_t deadline = subproc_timeLimitDeadline(run);
+    if (!deadline || util_timeNowMillis() <= deadline) {
         return;
     }
 
-    int64_t curMillis = util_timeNowMillis();
-    int64_t diffMillis = curMillis - run->timeStartedMillis;
+    /* Kill the snapshot worker only, the template will fork a new one */
+    pid_t pid = run->snapshotPid ? run->snapshotPid : run->pid;
 
-    if (run->tmOutSignaled && (diffMillis > ((run->global->timing.tmOut + 1) * 1000))) {
+    if (run->tmOutSignaled) {
         /* Has this instance been already signaled due to timeout? Just, SIGKILL it */
-        LOG_W("pid=%d has already been signaled due to timeout. Killing it with SIGKILL", run->pid);
-        kill(run->pid, SIGKILL);
+        LOG_W("pid=%d has already been signaled due to timeout. Killing it with SIGKILL", pid);
+        kill(pid, SIGKILL);
         return;
     }
 
-    if ((diffMillis > (run->global->timing.tmOut * 1000)) && !run->tmOutSignaled) {
-        run->tmOutSignaled = true;
-        LOG_W("pid=%d took too much time (limit %ld s). Killing it with %s", (int)run->pid,
-            (long)run->global->timing.tmOut,
-            run->global->timing.tmoutVTALRM ? "SIGVTALRM" : "SIGKILL");
-        if (run->global->timing.tmoutVTALRM) {
-            kill(run->pid, SIGVTALRM);
-        } else {
-            kill(run->pid, SIGKILL);
-        }
-        ATOMIC_POST_INC(run->global->cnts.timeoutedCnt);
+    run->tmOutSignaled = true;
+    LOG_W("pid=%d took too much time (limit %" PRId64 " ms). Killing it with %s", (int)pid,
+        subproc_timeLimitMillis(run), run->global->timing.tmoutVTALRM ? "SIGVTALRM" : "SIGKILL");
+    if (run->global->timing.tmoutVTALRM) {
+        kill(pid, SIGVTALRM);
+    } else {
+        kill(pid, SIGKILL);
     }
+    ATOMIC_POST_INC(run->global->cnts.timeoutedCnt);
 }
 
 void subproc_checkTermination(run_t* run) {
@@ -37,10 +37,29 @@ extern const char* subproc_StatusToStr(int status, char* str, size_t len);
 
 extern bool subproc_Run(run_t* run);
 
+/*
+ * subproc_Run() in parts, for --async_runs: starts the process (if needed) and the current run,
+ * and accounts for the run once arch_reapPoll() has returned true
+ */
+extern bool subproc_runStart(run_t* run);
+extern void subproc_runDone(run_t* run);
+
 extern bool subproc_persistentModeStateMachine(run_t* run);
+/* Consumes the ready tags sent by a persistent process using the shared memory handshake */
+extern bool subproc_persistentDrainTags(run_t* run);
 
 extern uint8_t subproc_System(run_t* run, const char* const argv[]);
 
+/* Index of the exec time in the _HF_EXEC_TIMES_BUCKETS histograms */
+extern size_t subproc_execTimesBucket(uint64_t usecs);
+/* The upper bound (exclusive) of the bucket's exec times */
+extern uint64_t subproc_execTimesBucketMax(size_t idx);
+
+/* The time limit of the current run (-t, or derived with --timeout_auto), 0 if there's none */
+extern int64_t subproc_timeLimitMillis(run_t* run);
+/* When subproc_checkTimeLimit() has to act next (in util_timeNowMillis() time), 0 for never */
+extern int64_t subproc_timeLimitDeadline(run_t* run);
+
 extern void subproc_checkTimeLimit(run_t* run);
 
 extern void subproc_checkTermination(run_t* run);
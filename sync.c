@@ -0,0 +1,828 @@
+/*
+ *
+ * honggfuzz - corpus and coverage sync between fuzzing nodes
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#include "sync.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "fuzz.h"
+#include "input.h"
+#include "libhfcommon/common.h"
+#include "libhfcommon/files.h"
+#include "libhfcommon/log.h"
+#include "libhfcommon/util.h"
+#include "subproc.h"
+
+#define SYNC_MAGIC 0x434E5953U /* "SYNC" */
+#define SYNC_VERSION 1U
+/* How often the new corpus entries are published, and disconnected peers are reconnected */
+#define SYNC_INTERVAL_MSECS 1000
+#define SYNC_IO_TIMEOUT_SECS 10
+#define SYNC_CONNS_MAX 64
+#define SYNC_BATCH_INPUTS_MAX 4096U
+/* Total size of the inputs of a batch (unless it's a single one), independent of the -F limits */
+#define SYNC_BATCH_DATA_MAX ((size_t)_HF_INPUT_MAX_SIZE)
+#define SYNC_DELTA_MAX (1024U * 1024U * 64U)
+#define SYNC_EXECQ_MAX (1024U * 16U)
+#define SYNC_SEEN_INIT_SZ (1024U * 64U)
+
+typedef enum {
+    SYNC_MSG_HELLO = 1,
+    SYNC_MSG_BATCH = 2,
+} syncMsgType_t;
+
+/* Every message starts with it, and 'len' bytes of the body follow. Host byte order is used */
+typedef struct {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t len;
+} syncMsgHdr_t;
+
+/* Coverage deltas are only meaningful between nodes which fuzz the same binary */
+typedef struct {
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t binaryId;
+} syncHello_t;
+
+/*
+ * SYNC_MSG_BATCH body: syncBatchHdr_t, the coverage delta, and the inputs, each one preceded by its
+ * uint32_t length. The delta is, for pcGuardMap and then bbMapPc, the number of bits, and the
+ * differences between the indices of consecutive bits (the first one is the index itself), all
+ * encoded as LEB128 varints
+ */
+typedef struct {
+    uint32_t inputsCnt;
+    uint32_t deltaSz;
+} syncBatchHdr_t;
+
+typedef struct {
+    int fd;
+    /* Index in hfuzz->sync.peers, or -1 for accepted connections */
+    ssize_t peer;
+    bool helloRcvd;
+    bool sameBinary;
+} syncConn_t;
+
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+} syncInput_t;
+
+typedef struct syncExec {
+    struct syncExec* next;
+    size_t len;
+    uint8_t data[];
+} syncExec_t;
+
+typedef struct {
+    uint8_t* buf;
+    size_t len;
+    size_t cap;
+} syncBuf_t;
+
+static bool syncEnabled = false;
+static int syncListenSock = -1;
+static syncConn_t syncConns[SYNC_CONNS_MAX];
+static size_t syncConnsCnt = 0;
+static uint64_t syncBinaryId = 0;
+
+/* The coverage maps, as of the previous published batch. Used by the sync thread only */
+static uint8_t* syncSnapGuard = NULL;
+static uint8_t* syncSnapPc = NULL;
+
+/* CRC64s of the inputs which were published or received. Used by the sync thread only */
+static uint64_t* syncSeen = NULL;
+static size_t syncSeenSz = 0;
+static size_t syncSeenCnt = 0;
+
+/* New corpus entries, waiting to be published */
+static pthread_mutex_t syncPendingMutex = PTHREAD_MUTEX_INITIALIZER;
+static syncInput_t* syncPending = NULL;
+static size_t syncPendingCnt = 0;
+static size_t syncPendingCap = 0;
+
+/* Imported inputs, waiting to be executed by the fuzzing threads */
+static pthread_mutex_t syncExecMutex = PTHREAD_MUTEX_INITIALIZER;
+static syncExec_t* syncExecHead = NULL;
+static syncExec_t* syncExecTail = NULL;
+static size_t syncExecCnt = 0;
+
+static struct {
+    size_t sent;
+    size_t imported;
+    size_t executed;
+    size_t seen;
+} syncCnts;
+
+static void sync_bufAppend(syncBuf_t* b, const void* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    if (b->len + len > b->cap) {
+        b->cap = MAX(b->cap * 2, b->len + len + 4096);
+        b->buf = util_Realloc(b->buf, b->cap);
+    }
+    memcpy(&b->buf[b->len], data, len);
+    b->len += len;
+}
+
+static void sync_bufVarint(syncBuf_t* b, uint64_t v) {
+    uint8_t tmp[10];
+    size_t n = 0;
+    do {
+        tmp[n] = (uint8_t)(v & 0x7F);
+        v >>= 7;
+        if (v) {
+            tmp[n] |= 0x80;
+        }
+        n++;
+    } while (v);
+    sync_bufAppend(b, tmp, n);
+}
+
+static bool sync_getVarint(const uint8_t* buf, size_t len, size_t* off, uint64_t* v) {
+    *v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*off >= len) {
+            return false;
+        }
+        uint8_t c = buf[(*off)++];
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns false if the key was already present */
+static bool sync_seenInsert(uint64_t key) {
+    /* 0 marks empty slots */
+    key = key ? key : 1;
+    if ((syncSeenCnt + 1) * 2 > syncSeenSz) {
+        uint64_t* old = syncSeen;
+        size_t oldSz = syncSeenSz;
+        syncSeenSz = oldSz ? oldSz * 2 : SYNC_SEEN_INIT_SZ;
+        syncSeen = util_Calloc(sizeof(uint64_t) * syncSeenSz);
+        syncSeenCnt = 0;
+        for (size_t i = 0; i < oldSz; i++) {
+            if (old[i]) {
+                sync_seenInsert(old[i]);
+            }
+        }
+        free(old);
+    }
+    for (size_t i = key & (syncSeenSz - 1);; i = (i + 1) & (syncSeenSz - 1)) {
+        if (syncSeen[i] == key) {
+            return false;
+        }
+        if (syncSeen[i] == 0) {
+            syncSeen[i] = key;
+            syncSeenCnt++;
+            return true;
+        }
+    }
+}
+
+/*
+ * Appends bits which are set in 'map', but not in 'snap' (or all of them, if 'snap' is NULL), and
+ * updates 'snap'. The maps are scanned by 64-bit words, as the deltas are usually sparse
+ */
+static void sync_deltaMap(syncBuf_t* b, const uint8_t* map, uint8_t* snap, size_t sz) {
+    syncBuf_t idxs = {};
+    defer {
+        free(idxs.buf);
+    };
+    uint64_t cnt = 0;
+    uint64_t prev = 0;
+    for (size_t i = 0; i + sizeof(uint64_t) <= sz; i += sizeof(uint64_t)) {
+        uint64_t m, s = 0;
+        memcpy(&m, &map[i], sizeof(m));
+        if (snap) {
+            memcpy(&s, &snap[i], sizeof(s));
+        }
+        if ((m & ~s) == 0) {
+            continue;
+        }
+        /* Byte by byte, so the bit indices don't depend on the endianness */
+        for (size_t j = i; j < i + sizeof(uint64_t); j++) {
+            uint8_t fresh = ATOMIC_GET(map[j]) & (uint8_t)~(snap ? snap[j] : 0U);
+            if (snap) {
+                snap[j] |= fresh;
+            }
+            for (; fresh; fresh &= (uint8_t)(fresh - 1U)) {
+                uint64_t idx = ((uint64_t)j * 8U) + (uint64_t)__builtin_ctz(fresh);
+                sync_bufVarint(&idxs, idx - prev);
+                prev = idx;
+                cnt++;
+            }
+        }
+    }
+    sync_bufVarint(b, cnt);
+    sync_bufAppend(b, idxs.buf, idxs.len);
+}
+
+static void sync_delta(honggfuzz_t* hfuzz, syncBuf_t* b, bool sinceSnap) {
+    feedback_t* fb = hfuzz->feedback.feedbackMap;
+    /* Bits beyond guardNb are never set, and only pcGuardMapLen bytes are backed */
+    size_t guardSz = MIN(
+        ATOMIC_GET(fb->pcGuardMapLen), ((ATOMIC_GET(fb->guardNb) + 63U) / 64U) * sizeof(uint64_t));
+    sync_deltaMap(b, fb->pcGuardMap, sinceSnap ? syncSnapGuard : NULL, guardSz);
+    sync_deltaMap(b, fb->bbMapPc, sinceSnap ? syncSnapPc : NULL, sizeof(fb->bbMapPc));
+}
+
+/* Is any bit of the delta not set in the local maps yet? Returns -1 if the delta is malformed */
+static int sync_deltaIsNew(honggfuzz_t* hfuzz, const uint8_t* delta, size_t len) {
+    feedback_t* fb = hfuzz->feedback.feedbackMap;
+    /* Bits beyond the backed part ('len') of pcGuardMap are not set locally yet */
+    const struct {
+        const uint8_t* map;
+        size_t sz;
+        size_t len;
+    } maps[] = {
+        {fb->pcGuardMap, sizeof(fb->pcGuardMap), ATOMIC_GET(fb->pcGuardMapLen)},
+        {fb->bbMapPc, sizeof(fb->bbMapPc), sizeof(fb->bbMapPc)},
+    };
+
+    bool isNew = false;
+    size_t off = 0;
+    for (size_t m = 0; m < ARRAYSIZE(maps); m++) {
+        uint64_t cnt;
+        if (!sync_getVarint(delta, len, &off, &cnt)) {
+            return -1;
+        }
+        uint64_t idx = 0;
+        for (uint64_t i = 0; i < cnt; i++) {
+            uint64_t diff;
+            if (!sync_getVarint(delta, len, &off, &diff)) {
+                return -1;
+            }
+            idx += diff;
+            if (idx >= (uint64_t)maps[m].sz * 8U) {
+                return -1;
+            }
+            if ((idx / 8U) >= maps[m].len ||
+                !(ATOMIC_GET(maps[m].map[idx / 8U]) & (1U << (idx % 8U)))) {
+                isNew = true;
+            }
+        }
+    }
+    return isNew ? 1 : 0;
+}
+
+/* Moves the last connection into the slot of the closed one */
+static void sync_closeConn(syncConn_t* conn) {
+    LOG_I("Sync: closing the connection fd=%d", conn->fd);
+    close(conn->fd);
+    *conn = syncConns[--syncConnsCnt];
+}
+
+static bool sync_sendMsg(syncConn_t* conn, syncMsgType_t type, const uint8_t* body, size_t len) {
+    syncMsgHdr_t hdr = {
+        .magic = SYNC_MAGIC,
+        .type = type,
+        .len = len,
+    };
+    if (!files_sendToSocket(conn->fd, (const uint8_t*)&hdr, sizeof(hdr)) ||
+        !files_sendToSocket(conn->fd, body, len)) {
+        PLOG_W("Sync: couldn't send %zu bytes to fd=%d", sizeof(hdr) + len, conn->fd);
+        return false;
+    }
+    return true;
+}
+
+static bool sync_addConn(int fd, ssize_t peer) {
+    if (syncConnsCnt >= SYNC_CONNS_MAX) {
+        LOG_W("Sync: too many connections (%zu), rejecting a new one", syncConnsCnt);
+        close(fd);
+        return false;
+    }
+    struct timeval tv = {.tv_sec = SYNC_IO_TIMEOUT_SECS, .tv_usec = 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1) {
+        PLOG_W("setsockopt(fd=%d, SO_RCVTIMEO/SO_SNDTIMEO)", fd);
+    }
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == -1) {
+        PLOG_D("setsockopt(fd=%d, TCP_NODELAY)", fd);
+    }
+
+    syncConn_t* conn = &syncConns[syncConnsCnt++];
+    *conn = (syncConn_t){
+        .fd = fd,
+        .peer = peer,
+        .helloRcvd = false,
+        .sameBinary = false,
+    };
+    syncHello_t hello = {
+        .version = SYNC_VERSION,
+        .reserved = 0,
+        .binaryId = syncBinaryId,
+    };
+    if (!sync_sendMsg(conn, SYNC_MSG_HELLO, (const uint8_t*)&hello, sizeof(hello))) {
+        sync_closeConn(conn);
+        return false;
+    }
+    return true;
+}
+
+/* Accepts '[host:]port' and 'host:port', with IPv6 addresses in brackets */
+static struct addrinfo* sync_resolve(const char* spec, bool passive) {
+    char host[256] = {};
+    const char* port = spec;
+    const char* colon = strrchr(spec, ':');
+    if (colon) {
+        size_t hostLen = (size_t)(colon - spec);
+        if (hostLen >= 2 && spec[0] == '[' && spec[hostLen - 1] == ']') {
+            spec++;
+            hostLen -= 2;
+        }
+        snprintf(host, sizeof(host), "%.*s", (int)hostLen, spec);
+        port = colon + 1;
+    }
+
+    struct addrinfo hints = {
+        .ai_flags = passive ? AI_PASSIVE : 0,
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo* res = NULL;
+    int ret = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+    if (ret != 0) {
+        LOG_W("getaddrinfo('%s', '%s'): %s", host, port, gai_strerror(ret));
+        return NULL;
+    }
+    return res;
+}
+
+static bool sync_listen(const char* spec) {
+    struct addrinfo* res = sync_resolve(spec, /* passive= */ true);
+    if (!res) {
+        return false;
+    }
+    defer {
+        freeaddrinfo(res);
+    };
+
+    syncListenSock = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+    if (syncListenSock == -1) {
+        PLOG_E("socket(family=%d)", res->ai_family);
+        return false;
+    }
+    int one = 1;
+    if (setsockopt(syncListenSock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1) {
+        PLOG_W("setsockopt(SO_REUSEADDR)");
+    }
+    if (bind(syncListenSock, res->ai_addr, res->ai_addrlen) == -1) {
+        PLOG_E("bind('%s')", spec);
+        return false;
+    }
+    if (listen(syncListenSock, SYNC_CONNS_MAX) == -1) {
+        PLOG_E("listen('%s')", spec);
+        return false;
+    }
+    LOG_I("Sync: listening on '%s'", spec);
+    return true;
+}
+
+static void sync_connectPeers(honggfuzz_t* hfuzz) {
+    for (size_t p = 0; p < hfuzz->sync.peersCnt; p++) {
+        bool connected = false;
+        for (size_t c = 0; c < syncConnsCnt; c++) {
+            if (syncConns[c].peer == (ssize_t)p) {
+                connected = true;
+            }
+        }
+        if (connected) {
+            continue;
+        }
+
+        struct addrinfo* res = sync_resolve(hfuzz->sync.peers[p], /* passive= */ false);
+        if (!res) {
+            continue;
+        }
+        defer {
+            freeaddrinfo(res);
+        };
+        int fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+        if (fd == -1) {
+            PLOG_W("socket(family=%d)", res->ai_family);
+            continue;
+        }
+        /* SO_SNDTIMEO bounds connect() too */
+        struct timeval tv = {.tv_sec = SYNC_IO_TIMEOUT_SECS, .tv_usec = 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (TEMP_FAILURE_RETRY(connect(fd, res->ai_addr, res->ai_addrlen)) == -1) {
+            PLOG_D("connect('%s')", hfuzz->sync.peers[p]);
+            close(fd);
+            continue;
+        }
+        if (sync_addConn(fd, (ssize_t)p)) {
+            LOG_I("Sync: connected to '%s'", hfuzz->sync.peers[p]);
+        }
+    }
+}
+
+static void sync_buildBatch(
+    syncBuf_t* b, const syncBuf_t* delta, const syncInput_t* inputs, size_t cnt) {
+    syncBatchHdr_t hdr = {
+        .inputsCnt = (uint32_t)cnt,
+        .deltaSz = (uint32_t)delta->len,
+    };
+    b->len = 0;
+    sync_bufAppend(b, &hdr, sizeof(hdr));
+    sync_bufAppend(b, delta->buf, delta->len);
+    for (size_t i = 0; i < cnt; i++) {
+        uint32_t len = (uint32_t)inputs[i].len;
+        sync_bufAppend(b, &len, sizeof(len));
+        sync_bufAppend(b, inputs[i].data, inputs[i].len);
+    }
+}
+
+/* Sends the inputs to 'conn', or to all the connected nodes (closing broken ones) if it's NULL */
+static bool sync_sendInputs(
+    syncConn_t* conn, const syncBuf_t* delta, const syncInput_t* inputs, size_t cnt) {
+    syncBuf_t b = {};
+    defer {
+        free(b.buf);
+    };
+    for (size_t i = 0, n; i < cnt; i += n) {
+        size_t dataSz = inputs[i].len;
+        for (n = 1; (i + n) < cnt && n < SYNC_BATCH_INPUTS_MAX; n++) {
+            if (dataSz + inputs[i + n].len > SYNC_BATCH_DATA_MAX) {
+                break;
+            }
+            dataSz += inputs[i + n].len;
+        }
+        sync_buildBatch(&b, delta, &inputs[i], n);
+        if (conn) {
+            if (!sync_sendMsg(conn, SYNC_MSG_BATCH, b.buf, b.len)) {
+                return false;
+            }
+            continue;
+        }
+        for (size_t c = 0; c < syncConnsCnt;) {
+            if (!sync_sendMsg(&syncConns[c], SYNC_MSG_BATCH, b.buf, b.len)) {
+                sync_closeConn(&syncConns[c]);
+                continue;
+            }
+            c++;
+        }
+    }
+    return true;
+}
+
+static void sync_publish(honggfuzz_t* hfuzz) {
+    syncInput_t* inputs;
+    size_t cnt;
+    {
+        MX_SCOPED_LOCK(&syncPendingMutex);
+        inputs = syncPending;
+        cnt = syncPendingCnt;
+        syncPending = NULL;
+        syncPendingCnt = syncPendingCap = 0;
+    }
+    defer {
+        free(inputs);
+    };
+    if (cnt == 0) {
+        return;
+    }
+
+    /* Inputs coming back from other nodes will be ignored */
+    for (size_t i = 0; i < cnt; i++) {
+        sync_seenInsert(util_hash64(inputs[i].data, inputs[i].len));
+    }
+    syncBuf_t delta = {};
+    defer {
+        free(delta.buf);
+    };
+    sync_delta(hfuzz, &delta, /* sinceSnap= */ true);
+    if (syncConnsCnt) {
+        LOG_D("Sync: publishing %zu inputs, delta: %zu bytes", cnt, delta.len);
+    }
+    sync_sendInputs(NULL, &delta, inputs, cnt);
+    syncCnts.sent += cnt;
+}
+
+/* A newly connected node receives the whole corpus, with the coverage of this node */
+static bool sync_sendCorpus(honggfuzz_t* hfuzz, syncConn_t* conn) {
+    size_t cnt = ATOMIC_GET_ACQUIRE(hfuzz->io.dynfileqCnt);
+    if (cnt == 0) {
+        return true;
+    }
+    syncInput_t* inputs = util_Malloc(sizeof(syncInput_t) * cnt);
+    defer {
+        free(inputs);
+    };
+    for (size_t i = 0; i < cnt; i++) {
+        struct dynfile_t* dynfile = input_getDynamicInput(hfuzz, i);
+        inputs[i] = (syncInput_t){.data = dynfile->data, .len = dynfile->size};
+    }
+    syncBuf_t delta = {};
+    defer {
+        free(delta.buf);
+    };
+    sync_delta(hfuzz, &delta, /* sinceSnap= */ false);
+    LOG_I("Sync: sending the corpus (%zu inputs) to fd=%d", cnt, conn->fd);
+    return sync_sendInputs(conn, &delta, inputs, cnt);
+}
+
+static void sync_queueExec(const uint8_t* data, size_t len) {
+    MX_SCOPED_LOCK(&syncExecMutex);
+    if (syncExecCnt >= SYNC_EXECQ_MAX) {
+        LOG_D("Sync: the execution queue is full, dropping an input (len=%zu)", len);
+        return;
+    }
+    syncExec_t* e = util_Malloc(sizeof(syncExec_t) + len);
+    e->next = NULL;
+    e->len = len;
+    memcpy(e->data, data, len);
+    if (syncExecTail) {
+        syncExecTail->next = e;
+    } else {
+        syncExecHead = e;
+    }
+    syncExecTail = e;
+    ATOMIC_SET(syncExecCnt, syncExecCnt + 1);
+}
+
+static bool sync_importBatch(
+    honggfuzz_t* hfuzz, syncConn_t* conn, const uint8_t* body, size_t len) {
+    syncBatchHdr_t hdr;
+    if (len < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, body, sizeof(hdr));
+    if (hdr.inputsCnt > SYNC_BATCH_INPUTS_MAX || hdr.deltaSz > len - sizeof(hdr)) {
+        LOG_W("Sync: malformed batch from fd=%d, inputs: %" PRIu32 ", delta: %" PRIu32 " bytes",
+            conn->fd, hdr.inputsCnt, hdr.deltaSz);
+        return false;
+    }
+    const uint8_t* delta = &body[sizeof(hdr)];
+    /* Without comparable coverage maps, every input has to be executed */
+    bool needExec = true;
+    if (conn->sameBinary) {
+        int isNew = sync_deltaIsNew(hfuzz, delta, hdr.deltaSz);
+        if (isNew == -1) {
+            LOG_W("Sync: malformed coverage delta from fd=%d", conn->fd);
+            return false;
+        }
+        needExec = (isNew == 1);
+    }
+
+    size_t cnt = ATOMIC_GET(hfuzz->io.dynfileqCnt);
+    uint64_t avgExecUSecs = cnt ? ATOMIC_GET(hfuzz->io.dynfileqTimeExecUSecs) / cnt : 0;
+    size_t off = sizeof(hdr) + hdr.deltaSz;
+    for (uint32_t i = 0; i < hdr.inputsCnt; i++) {
+        uint32_t inputLen;
+        if (len - off < sizeof(inputLen)) {
+            return false;
+        }
+        memcpy(&inputLen, &body[off], sizeof(inputLen));
+        off += sizeof(inputLen);
+        if (len - off < inputLen) {
+            return false;
+        }
+        const uint8_t* data = &body[off];
+        off += inputLen;
+
+        if (inputLen == 0 || inputLen > hfuzz->mutate.maxFileSz ||
+            !sync_seenInsert(util_hash64(data, inputLen))) {
+            syncCnts.seen++;
+            continue;
+        }
+        if (needExec) {
+            sync_queueExec(data, inputLen);
+            syncCnts.executed++;
+        } else {
+            if (input_addDynamicInput(hfuzz, data, inputLen, avgExecUSecs, /* newCov= */ 0)) {
+                syncCnts.imported++;
+            }
+        }
+    }
+    LOG_D("Sync: received %" PRIu32 " inputs from fd=%d, %s", hdr.inputsCnt, conn->fd,
+        needExec ? "queued for execution" : "imported");
+    return true;
+}
+
+static bool sync_recvMsg(honggfuzz_t* hfuzz, syncConn_t* conn) {
+    syncMsgHdr_t hdr;
+    if (files_readFromFd(conn->fd, (uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr)) {
+        return false;
+    }
+    /* Bigger inputs (than -F) are not imported, but the peer might use a bigger limit */
+    size_t maxLen = sizeof(syncBatchHdr_t) + SYNC_DELTA_MAX +
+                    (SYNC_BATCH_INPUTS_MAX * sizeof(uint32_t)) + SYNC_BATCH_DATA_MAX;
+    if (hdr.magic != SYNC_MAGIC || hdr.len > maxLen) {
+        LOG_W("Sync: bad message from fd=%d, magic: %#" PRIx32 ", len: %" PRIu64, conn->fd,
+            hdr.magic, hdr.len);
+        return false;
+    }
+    uint8_t* body = util_Malloc(hdr.len ? hdr.len : 1);
+    defer {
+        free(body);
+    };
+    if (files_readFromFd(conn->fd, body, hdr.len) != (ssize_t)hdr.len) {
+        return false;
+    }
+
+    switch (hdr.type) {
+        case SYNC_MSG_HELLO: {
+            syncHello_t hello;
+            if (hdr.len != sizeof(hello)) {
+                return false;
+            }
+            memcpy(&hello, body, sizeof(hello));
+            if (hello.version != SYNC_VERSION) {
+                LOG_W("Sync: fd=%d uses protocol version %" PRIu32 ", expected %u", conn->fd,
+                    hello.version, SYNC_VERSION);
+                return false;
+            }
+            conn->helloRcvd = true;
+            conn->sameBinary = (syncBinaryId != 0 && hello.binaryId == syncBinaryId);
+            if (!conn->sameBinary) {
+                LOG_W("Sync: fd=%d fuzzes a different binary, all its inputs will be executed",
+                    conn->fd);
+            }
+            return sync_sendCorpus(hfuzz, conn);
+        }
+        case SYNC_MSG_BATCH:
+            if (!conn->helloRcvd) {
+                return false;
+            }
+            return sync_importBatch(hfuzz, conn, body, hdr.len);
+        default:
+            LOG_W("Sync: unknown message type %" PRIu32 " from fd=%d", hdr.type, conn->fd);
+            return false;
+    }
+}
+
+static void sync_poll(honggfuzz_t* hfuzz, int timeoutMillis) {
+    struct pollfd pfds[SYNC_CONNS_MAX + 1];
+    size_t nfds = 0;
+    for (size_t c = 0; c < syncConnsCnt; c++) {
+        pfds[nfds++] = (struct pollfd){.fd = syncConns[c].fd, .events = POLLIN};
+    }
+    if (syncListenSock != -1) {
+        pfds[nfds++] = (struct pollfd){.fd = syncListenSock, .events = POLLIN};
+    }
+
+    int ret = TEMP_FAILURE_RETRY(poll(pfds, nfds, timeoutMillis));
+    if (ret <= 0) {
+        return;
+    }
+
+    /* Backwards, as sync_closeConn() moves the last connection into the closed one's slot */
+    for (size_t c = syncConnsCnt; c > 0; c--) {
+        if (pfds[c - 1].revents && !sync_recvMsg(hfuzz, &syncConns[c - 1])) {
+            sync_closeConn(&syncConns[c - 1]);
+        }
+    }
+    if (syncListenSock != -1 && pfds[nfds - 1].revents) {
+        int fd = TEMP_FAILURE_RETRY(accept4(syncListenSock, NULL, NULL, SOCK_CLOEXEC));
+        if (fd == -1) {
+            PLOG_W("accept(sync socket fd=%d)", syncListenSock);
+            return;
+        }
+        if (sync_addConn(fd, /* peer= */ -1)) {
+            LOG_I("Sync: accepted a connection, fd=%d", fd);
+        }
+    }
+}
+
+static void* sync_thread(void* arg) {
+    honggfuzz_t* hfuzz = (honggfuzz_t*)arg;
+
+    /* Imports are only possible once the local maps reflect the local corpus */
+    while (ATOMIC_GET(hfuzz->feedback.state) != _HF_STATE_DYNAMIC_MAIN) {
+        if (fuzz_isTerminating()) {
+            return NULL;
+        }
+        util_sleepForMSec(100);
+    }
+
+    int64_t lastMillis = 0;
+    while (!fuzz_isTerminating()) {
+        int64_t now = util_timeNowMillis();
+        if ((now - lastMillis) >= SYNC_INTERVAL_MSECS) {
+            sync_connectPeers(hfuzz);
+            sync_publish(hfuzz);
+            lastMillis = now;
+        }
+        sync_poll(hfuzz, SYNC_INTERVAL_MSECS);
+    }
+    return NULL;
+}
+
+bool sync_init(honggfuzz_t* hfuzz) {
+    if (!hfuzz->sync.listen && hfuzz->sync.peersCnt == 0) {
+        return true;
+    }
+    if (hfuzz->feedback.dynFileMethod == _HF_DYNFILE_NONE || hfuzz->socketFuzzer.enabled ||
+        hfuzz->cfg.minimize) {
+        LOG_E("--sync_listen/--sync_peer require the feedback-driven fuzzing mode");
+        return false;
+    }
+    if (hfuzz->sync.listen && !sync_listen(hfuzz->sync.listen)) {
+        return false;
+    }
+
+    syncBinaryId = files_crc64File(hfuzz->exe.cmdline[0]);
+    if (syncBinaryId == 0) {
+        LOG_W("Couldn't read '%s', coverage deltas from other nodes will be ignored",
+            hfuzz->exe.cmdline[0]);
+    }
+    syncSnapGuard = util_Calloc(sizeof(hfuzz->feedback.feedbackMap->pcGuardMap));
+    syncSnapPc = util_Calloc(sizeof(hfuzz->feedback.feedbackMap->bbMapPc));
+    syncEnabled = true;
+
+    pthread_t thread;
+    if (!subproc_runThread(hfuzz, &thread, sync_thread, /* joinable= */ false)) {
+        LOG_E("Couldn't start the sync thread");
+        return false;
+    }
+    return true;
+}
+
+void sync_close(honggfuzz_t* hfuzz HF_ATTR_UNUSED) {
+    if (!syncEnabled) {
+        return;
+    }
+    LOG_I("Sync: published %zu inputs, imported %zu, executed %zu, ignored %zu already seen",
+        syncCnts.sent, syncCnts.imported, syncCnts.executed, syncCnts.seen);
+}
+
+void sync_addInput(const uint8_t* data, size_t len) {
+    if (!syncEnabled) {
+        return;
+    }
+    MX_SCOPED_LOCK(&syncPendingMutex);
+    if (syncPendingCnt == syncPendingCap) {
+        syncPendingCap = syncPendingCap ? syncPendingCap * 2 : 1024;
+        syncPending = util_Realloc(syncPending, sizeof(syncInput_t) * syncPendingCap);
+    }
+    syncPending[syncPendingCnt++] = (syncInput_t){.data = data, .len = len};
+}
+
+bool sync_fetchInput(run_t* run) {
+    if (ATOMIC_GET(syncExecCnt) == 0) {
+        return false;
+    }
+    syncExec_t* e;
+    {
+        MX_SCOPED_LOCK(&syncExecMutex);
+        e = syncExecHead;
+        if (!e) {
+            return false;
+        }
+        syncExecHead = e->next;
+        if (!syncExecHead) {
+            syncExecTail = NULL;
+        }
+        ATOMIC_SET(syncExecCnt, syncExecCnt - 1);
+    }
+    defer {
+        free(e);
+    };
+
+    snprintf(run->origFileName, sizeof(run->origFileName), "[SYNC]");
+    run->journal.dynfile = NULL;
+    size_t len = MIN(e->len, run->global->mutate.maxFileSz);
+    input_setSize(run, len);
+    memcpy(run->dynamicFile, e->data, len);
+    return true;
+}
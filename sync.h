@@ -0,0 +1,48 @@
+/*
+ *
+ * honggfuzz - corpus and coverage sync between fuzzing nodes
+ * -----------------------------------------
+ *
+ * Copyright 2019 by Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifndef _HF_SYNC_H_
+#define _HF_SYNC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "honggfuzz.h"
+
+/*
+ * Nodes fuzzing the same target exchange (over TCP, --sync_listen/--sync_peer) batches of the
+ * inputs which were added to their dynamic corpora, each batch with the sparse delta of the
+ * coverage maps (pcGuardMap, bbMapPc) since the previous one. A node which already has all the
+ * bits of a batch's delta adds its inputs to the corpus directly, otherwise the inputs are first
+ * executed by the fuzzing threads (see sync_fetchInput()), and enter the corpus through the usual
+ * feedback path. Inputs which they add are published again, so a node with --sync_listen serves
+ * as a hub for the nodes connected to it. Newly connected nodes receive the whole corpus
+ */
+extern bool sync_init(honggfuzz_t* hfuzz);
+extern void sync_close(honggfuzz_t* hfuzz);
+
+/* Queues a new corpus entry for publishing, 'data' must stay valid (entries are never freed) */
+extern void sync_addInput(const uint8_t* data, size_t len);
+/* Prepares an imported input which needs to be executed, returns false if there are none */
+extern bool sync_fetchInput(run_t* run);
+
+#endif /* ifndef _HF_SYNC_H_ */